@@ -24,13 +24,18 @@
 #include "analyze-verify.h"
 #include "bus-error.h"
 #include "bus-util.h"
+#include "hashmap.h"
 #include "log.h"
 #include "manager.h"
 #include "pager.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "strv.h"
 #include "unit-name.h"
 
+/* How many man processes to run at the same time at most */
+#define MAN_PAGES_PARALLEL_MAX 16U
+
 static int prepare_filename(const char *filename, char **ret) {
         int r;
         const char *name;
@@ -187,34 +192,118 @@ static int verify_executables(Unit *u) {
         return r;
 }
 
-static int verify_documentation(Unit *u, bool check_man) {
+static int verify_documentation(Unit *u, OrderedHashmap *man_pages) {
         char **p;
-        int r = 0, k;
+        int r;
+
+        /* Only collects the man pages to check here, they are all checked in one go later, see check_man_pages() */
 
         STRV_FOREACH(p, u->documentation) {
                 log_unit_debug(u, "Found documentation item: %s", *p);
 
-                if (check_man && startswith(*p, "man:")) {
-                        k = show_man_page(*p + 4, true);
-                        if (k != 0) {
-                                if (k < 0)
-                                        log_unit_error_errno(u, r, "Can't show %s: %m", *p);
-                                else {
-                                        log_unit_error_errno(u, r, "man %s command failed with code %d", *p + 4, k);
-                                        k = -ENOEXEC;
-                                }
-                                if (r == 0)
-                                        r = k;
-                        }
+                if (man_pages && startswith(*p, "man:")) {
+                        r = ordered_hashmap_put(man_pages, *p + 4, NULL);
+                        if (r < 0 && r != -EEXIST)
+                                return log_oom();
                 }
         }
 
         /* Check remote URLs? */
 
+        return 0;
+}
+
+static int verify_documentation_result(Unit *u, OrderedHashmap *man_pages) {
+        char **p;
+        int r = 0, k;
+
+        STRV_FOREACH(p, u->documentation) {
+                if (!startswith(*p, "man:"))
+                        continue;
+
+                k = PTR_TO_INT(ordered_hashmap_get(man_pages, *p + 4));
+                if (k == 0)
+                        continue;
+
+                if (k < 0)
+                        log_unit_error_errno(u, k, "Can't show %s: %m", *p);
+                else {
+                        log_unit_error(u, "man %s command failed with code %d", *p + 4, k);
+                        k = -ENOEXEC;
+                }
+                if (r == 0)
+                        r = k;
+        }
+
         return r;
 }
 
-static int verify_unit(Unit *u, bool check_man) {
+static int wait_man_page(OrderedHashmap *man_pages, const char *page, pid_t pid) {
+        siginfo_t status;
+        int r;
+
+        r = wait_for_terminate(pid, &status);
+        if (r >= 0) {
+                log_debug("man %s: exit code %i status %i", page, status.si_code, status.si_status);
+                r = status.si_status;
+        }
+
+        return ordered_hashmap_replace(man_pages, (char*) page, INT_TO_PTR(r));
+}
+
+static int check_man_pages(OrderedHashmap *man_pages) {
+        const char *names[MAN_PAGES_PARALLEL_MAX];
+        pid_t pids[MAN_PAGES_PARALLEL_MAX];
+        unsigned n_max, head = 0, n = 0;
+        const char *page;
+        Iterator i;
+        void *v;
+        int r;
+
+        /* Many units reference the same man pages, each is only looked at once. man spends a good part of its time
+         * waiting for I/O, hence run a couple more of them in parallel than we have CPUs. Results are stored in
+         * the hashmap, in the same format as returned by show_man_page(). */
+
+        n_max = CLAMP((unsigned) sysconf(_SC_NPROCESSORS_ONLN) * 2, 2U, MAN_PAGES_PARALLEL_MAX);
+
+        ORDERED_HASHMAP_FOREACH_KEY(v, page, man_pages, i) {
+                pid_t pid;
+
+                if (n >= n_max) {
+                        r = wait_man_page(man_pages, names[head], pids[head]);
+                        if (r < 0)
+                                return r;
+
+                        head = (head + 1) % n_max;
+                        n--;
+                }
+
+                r = spawn_man_page(page, true, &pid);
+                if (r < 0) {
+                        r = ordered_hashmap_replace(man_pages, (char*) page, INT_TO_PTR(r));
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                names[(head + n) % n_max] = page;
+                pids[(head + n) % n_max] = pid;
+                n++;
+        }
+
+        for (; n > 0; n--) {
+                r = wait_man_page(man_pages, names[head], pids[head]);
+                if (r < 0)
+                        return r;
+
+                head = (head + 1) % n_max;
+        }
+
+        return 0;
+}
+
+static int verify_unit(Unit *u, OrderedHashmap *man_pages) {
         _cleanup_(sd_bus_error_free) sd_bus_error err = SD_BUS_ERROR_NULL;
         int r, k;
 
@@ -236,7 +325,7 @@ static int verify_unit(Unit *u, bool check_man) {
         if (k < 0 && r == 0)
                 r = k;
 
-        k = verify_documentation(u, check_man);
+        k = verify_documentation(u, man_pages);
         if (k < 0 && r == 0)
                 r = k;
 
@@ -249,6 +338,7 @@ int verify_units(char **filenames, UnitFileScope scope, bool check_man, bool run
         Manager *m = NULL;
         FILE *serial = NULL;
         FDSet *fdset = NULL;
+        _cleanup_ordered_hashmap_free_ OrderedHashmap *man_pages = NULL;
         char **filename;
         int r = 0, k;
 
@@ -305,12 +395,36 @@ int verify_units(char **filenames, UnitFileScope scope, bool check_man, bool run
                         count++;
         }
 
+        if (check_man) {
+                man_pages = ordered_hashmap_new(&string_hash_ops);
+                if (!man_pages) {
+                        r = log_oom();
+                        goto finish;
+                }
+        }
+
         for (i = 0; i < count; i++) {
-                k = verify_unit(units[i], check_man);
+                k = verify_unit(units[i], man_pages);
                 if (k < 0 && r == 0)
                         r = k;
         }
 
+        if (check_man) {
+                k = check_man_pages(man_pages);
+                if (k < 0) {
+                        log_error_errno(k, "Failed to check man pages: %m");
+                        if (r == 0)
+                                r = k;
+                        goto finish;
+                }
+
+                for (i = 0; i < count; i++) {
+                        k = verify_documentation_result(units[i], man_pages);
+                        if (k < 0 && r == 0)
+                                r = k;
+                }
+        }
+
 finish:
         manager_free(m);
 
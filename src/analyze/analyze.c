@@ -335,6 +335,140 @@ static void free_host_info(struct host_info *hi) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct host_info*, free_host_info);
 
+static int unit_times_finish(struct unit_times *t, const char *id, const struct boot_times *boot_times) {
+        assert(t);
+        assert(id);
+        assert(boot_times);
+
+        /* Turns the raw timestamps of one unit into boot-relative ones. Returns 0 if the unit never started
+         * and is to be skipped, 1 if the entry is complete. */
+
+        subtract_timestamp(&t->activating, boot_times->reverse_offset);
+        subtract_timestamp(&t->activated, boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
+
+        if (t->activated >= t->activating)
+                t->time = t->activated - t->activating;
+        else if (t->deactivated >= t->activating)
+                t->time = t->deactivated - t->activating;
+        else
+                t->time = 0;
+
+        if (t->activating == 0)
+                return 0;
+
+        t->name = strdup(id);
+        if (!t->name)
+                return log_oom();
+
+        return 1;
+}
+
+static int acquire_time_data_bulk(sd_bus *bus, const struct boot_times *boot_times, struct unit_times **out) {
+        static const struct bus_properties_map property_map[] = {
+                { "InactiveExitTimestampMonotonic",  "t", NULL, offsetof(struct unit_times, activating)   },
+                { "ActiveEnterTimestampMonotonic",   "t", NULL, offsetof(struct unit_times, activated)    },
+                { "ActiveExitTimestampMonotonic",    "t", NULL, offsetof(struct unit_times, deactivating) },
+                { "InactiveEnterTimestampMonotonic", "t", NULL, offsetof(struct unit_times, deactivated)  },
+                {}
+        };
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        struct unit_times *unit_times = NULL;
+        size_t size = 0;
+        int r, c = 0;
+
+        /* Fetches the timestamps of all units with a single GetUnitPropertiesByPatterns() call, instead of four
+         * property reads per unit. Returns -EOPNOTSUPP if the manager is too old to know the call. */
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetUnitPropertiesByPatterns");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append(m, "asas", 0, 0);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append(m, "as", 4,
+                                  "InactiveExitTimestampMonotonic",
+                                  "ActiveEnterTimestampMonotonic",
+                                  "ActiveExitTimestampMonotonic",
+                                  "InactiveEnterTimestampMonotonic");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0 && (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) ||
+                      sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED))) {
+                log_debug_errno(r, "Failed to get unit timestamps: %s Falling back to per-unit queries.", bus_error_message(&error, r));
+                return -EOPNOTSUPP;
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to get unit timestamps: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sa{sv})");
+        if (r < 0) {
+                bus_log_parse_error(r);
+                goto fail;
+        }
+
+        while ((r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "sa{sv}")) > 0) {
+                struct unit_times *t;
+                const char *id;
+
+                if (!GREEDY_REALLOC(unit_times, size, c+1)) {
+                        r = log_oom();
+                        goto fail;
+                }
+
+                t = unit_times+c;
+                *t = (struct unit_times) {};
+
+                r = sd_bus_message_read(reply, "s", &id);
+                if (r < 0) {
+                        bus_log_parse_error(r);
+                        goto fail;
+                }
+
+                r = bus_message_map_all_properties(reply, property_map, &error, t);
+                if (r < 0) {
+                        bus_log_parse_error(r);
+                        goto fail;
+                }
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0) {
+                        bus_log_parse_error(r);
+                        goto fail;
+                }
+
+                r = unit_times_finish(t, id, boot_times);
+                if (r < 0)
+                        goto fail;
+                if (r > 0)
+                        c++;
+        }
+        if (r < 0) {
+                bus_log_parse_error(r);
+                goto fail;
+        }
+
+        *out = unit_times;
+        return c;
+
+fail:
+        if (unit_times)
+                free_unit_times(unit_times, (unsigned) c);
+        return r;
+}
+
 static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
@@ -348,6 +482,10 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
         if (r < 0)
                 goto fail;
 
+        r = acquire_time_data_bulk(bus, boot_times, out);
+        if (r != -EOPNOTSUPP)
+                return r;
+
         r = sd_bus_call_method(
                         bus,
                         "org.freedesktop.systemd1",
@@ -400,27 +538,11 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
                         goto fail;
                 }
 
-                subtract_timestamp(&t->activating, boot_times->reverse_offset);
-                subtract_timestamp(&t->activated, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
-
-                if (t->activated >= t->activating)
-                        t->time = t->activated - t->activating;
-                else if (t->deactivated >= t->activating)
-                        t->time = t->deactivated - t->activating;
-                else
-                        t->time = 0;
-
-                if (t->activating == 0)
-                        continue;
-
-                t->name = strdup(u.id);
-                if (t->name == NULL) {
-                        r = log_oom();
+                r = unit_times_finish(t, u.id, boot_times);
+                if (r < 0)
                         goto fail;
-                }
-                c++;
+                if (r > 0)
+                        c++;
         }
         if (r < 0) {
                 bus_log_parse_error(r);
@@ -1039,6 +1161,128 @@ static int analyze_blame(sd_bus *bus) {
         return 0;
 }
 
+static void trace_event(bool *first, const char *name, const char *cat, unsigned tid, usec_t base, usec_t begin, usec_t end) {
+        const char *c;
+
+        assert(first);
+        assert(name);
+        assert(cat);
+
+        if (end < begin)
+                return;
+
+        /* Unit names may contain backslashes, which need escaping in JSON. They can't contain anything else that
+         * would. */
+        printf("%s\n{\"name\":\"", *first ? "" : ",");
+        for (c = name; *c; c++) {
+                if (*c == '\\')
+                        putchar('\\');
+                putchar(*c);
+        }
+        printf("\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+               "\"ts\":" USEC_FMT ",\"dur\":" USEC_FMT "}",
+               cat, tid, base + begin, end - begin);
+
+        *first = false;
+}
+
+static int analyze_trace(sd_bus *bus) {
+        struct unit_times *times, *u;
+        struct boot_times *boot;
+        bool first = true;
+        unsigned tid = 1;
+        usec_t base;
+        int n;
+
+        n = acquire_boot_times(bus, &boot);
+        if (n < 0)
+                return n;
+
+        n = acquire_time_data(bus, &times);
+        if (n <= 0)
+                return n;
+
+        qsort(times, n, sizeof(struct unit_times), compare_unit_start);
+
+        /* Outputs the boot in the Trace Event Format understood by chrome://tracing and Perfetto. The firmware and
+         * loader run before the kernel, hence shift everything so that the trace starts with them. */
+        base = boot->firmware_time;
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", stdout);
+
+        if (boot->firmware_time > 0)
+                trace_event(&first, "firmware", "boot", 0, 0, 0, boot->firmware_time - boot->loader_time);
+        if (boot->loader_time > 0)
+                trace_event(&first, "loader", "boot", 0, 0, boot->firmware_time - boot->loader_time, boot->firmware_time);
+        if (boot->kernel_time > 0)
+                trace_event(&first, "kernel", "boot", 0, base, 0, boot->kernel_done_time);
+        if (boot->initrd_time > 0)
+                trace_event(&first, "initrd", "boot", 0, base, boot->initrd_time, boot->userspace_time);
+        trace_event(&first, "userspace", "boot", 0, base, boot->userspace_time, boot->finish_time);
+        if (boot->security_start_time > 0)
+                trace_event(&first, "security", "manager", 0, base, boot->security_start_time, boot->security_finish_time);
+        if (boot->generators_start_time > 0)
+                trace_event(&first, "generators", "manager", 0, base, boot->generators_start_time, boot->generators_finish_time);
+        if (boot->unitsload_start_time > 0)
+                trace_event(&first, "units-load", "manager", 0, base, boot->unitsload_start_time, boot->unitsload_finish_time);
+
+        for (u = times; u < times + n; u++) {
+                usec_t end;
+
+                if (u->activating < boot->userspace_time ||
+                    u->activating > boot->finish_time)
+                        continue;
+
+                /* Units that failed to start have no activation timestamp, but went inactive again */
+                if (u->activated >= u->activating)
+                        end = u->activated;
+                else if (u->deactivated >= u->activating)
+                        end = u->deactivated;
+                else
+                        end = boot->finish_time;
+
+                trace_event(&first, u->name, "unit", tid, base, u->activating, end);
+
+                /* For services, split the start-up into the part before the main process was forked (ExecStartPre=,
+                 * execution environment setup) and the part until the service was considered started. */
+                if (endswith(u->name, ".service")) {
+                        _cleanup_free_ char *path = NULL;
+                        usec_t main_start;
+
+                        path = unit_dbus_path_from_name(u->name);
+                        if (!path) {
+                                free_unit_times(times, (unsigned) n);
+                                return log_oom();
+                        }
+
+                        if (sd_bus_get_property_trivial(
+                                            bus,
+                                            "org.freedesktop.systemd1",
+                                            path,
+                                            "org.freedesktop.systemd1.Service",
+                                            "ExecMainStartTimestampMonotonic",
+                                            NULL,
+                                            't', &main_start) >= 0 &&
+                            main_start > 0) {
+
+                                subtract_timestamp(&main_start, boot->reverse_offset);
+
+                                if (main_start >= u->activating && main_start <= end) {
+                                        trace_event(&first, "before main process", "service", tid, base, u->activating, main_start);
+                                        trace_event(&first, "main process start-up", "service", tid, base, main_start, end);
+                                }
+                        }
+                }
+
+                tid++;
+        }
+
+        fputs("\n]}\n", stdout);
+
+        free_unit_times(times, (unsigned) n);
+        return 0;
+}
+
 static int analyze_time(sd_bus *bus) {
         _cleanup_free_ char *buf = NULL;
         int r;
@@ -1518,6 +1762,7 @@ static void help(void) {
                "  blame                    Print list of running units ordered by time to init\n"
                "  critical-chain           Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
+               "  trace                    Output service initialization in Trace Event Format\n"
                "  dot                      Output dependency graph in man:dot(1) format\n"
                "  set-log-level LEVEL      Set logging threshold for manager\n"
                "  set-log-target TARGET    Set logging target for manager\n"
@@ -1702,6 +1947,8 @@ int main(int argc, char *argv[]) {
                         r = analyze_critical_chain(bus, argv+optind+1);
                 else if (streq(argv[optind], "plot"))
                         r = analyze_plot(bus);
+                else if (streq(argv[optind], "trace"))
+                        r = analyze_trace(bus);
                 else if (streq(argv[optind], "dot"))
                         r = dot(bus, argv+optind+1);
                 else if (streq(argv[optind], "dump"))
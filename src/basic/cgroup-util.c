@@ -33,6 +33,7 @@
 #include <unistd.h>
 
 #include "alloc-util.h"
+#include "bitmap.h"
 #include "cgroup-util.h"
 #include "def.h"
 #include "dirent-util.h"
@@ -228,21 +229,80 @@ int cg_rmdir(const char *controller, const char *path) {
         return 0;
 }
 
-int cg_kill(
+static int cg_read_pids(const char *controller, const char *path, pid_t **ret, size_t *ret_n) {
+        _cleanup_free_ char *fs = NULL, *contents = NULL;
+        _cleanup_free_ pid_t *pids = NULL;
+        size_t size, n = 0, allocated = 0;
+        const char *p, *e;
+        int r;
+
+        assert(ret);
+        assert(ret_n);
+
+        /* Reads the whole cgroup.procs file in one go and parses it by hand, which is a lot cheaper than going
+         * through fscanf() for each PID when there are tens of thousands of them. Note that the list might
+         * contain duplicates, see cg_read_pid(). */
+
+        r = cg_get_path(controller, path, "cgroup.procs", &fs);
+        if (r < 0)
+                return r;
+
+        r = read_full_file(fs, &contents, &size);
+        if (r < 0)
+                return r;
+
+        for (p = contents, e = contents + size; p < e; p++) {
+                unsigned long ul = 0;
+
+                if (*p == '\n')
+                        continue;
+
+                if (*p < '0' || *p > '9')
+                        return -EIO;
+
+                for (; p < e && *p >= '0' && *p <= '9'; p++) {
+                        ul = ul * 10 + (*p - '0');
+                        if (ul > INT_MAX)
+                                return -EIO;
+                }
+
+                if (ul <= 0)
+                        return -EIO;
+
+                if (!GREEDY_REALLOC(pids, allocated, n + 1))
+                        return -ENOMEM;
+
+                pids[n++] = (pid_t) ul;
+
+                if (p >= e)
+                        break;
+                if (*p != '\n')
+                        return -EIO;
+        }
+
+        *ret = pids;
+        pids = NULL;
+        *ret_n = n;
+
+        return 0;
+}
+
+static int cg_kill_internal(
                 const char *controller,
                 const char *path,
                 int sig,
                 CGroupFlags flags,
                 Set *s,
+                Bitmap *killed,
                 cg_kill_log_func_t log_kill,
                 void *userdata) {
 
-        _cleanup_set_free_ Set *allocated_set = NULL;
         bool done = false;
         int r, ret = 0;
         pid_t my_pid;
 
         assert(sig >= 0);
+        assert(killed);
 
          /* Don't send SIGCONT twice. Also, SIGKILL always works even when process is suspended, hence don't send
           * SIGCONT on SIGKILL. */
@@ -253,20 +313,14 @@ int cg_kill(
          * is repeated until no further processes are added to the
          * tasks list, to properly handle forking processes */
 
-        if (!s) {
-                s = allocated_set = set_new(NULL);
-                if (!s)
-                        return -ENOMEM;
-        }
-
         my_pid = getpid_cached();
 
         do {
-                _cleanup_fclose_ FILE *f = NULL;
-                pid_t pid = 0;
+                _cleanup_free_ pid_t *pids = NULL;
+                size_t n_pids = 0, i;
                 done = true;
 
-                r = cg_enumerate_processes(controller, path, &f);
+                r = cg_read_pids(controller, path, &pids, &n_pids);
                 if (r < 0) {
                         if (ret >= 0 && r != -ENOENT)
                                 return r;
@@ -274,12 +328,16 @@ int cg_kill(
                         return ret;
                 }
 
-                while ((r = cg_read_pid(f, &pid)) > 0) {
+                for (i = 0; i < n_pids; i++) {
+                        pid_t pid = pids[i];
 
                         if ((flags & CGROUP_IGNORE_SELF) && pid == my_pid)
                                 continue;
 
-                        if (set_get(s, PID_TO_PTR(pid)) == PID_TO_PTR(pid))
+                        if (bitmap_isset(killed, pid))
+                                continue;
+
+                        if (s && set_contains(s, PID_TO_PTR(pid)))
                                 continue;
 
                         if (log_kill)
@@ -300,7 +358,7 @@ int cg_kill(
 
                         done = false;
 
-                        r = set_put(s, PID_TO_PTR(pid));
+                        r = bitmap_set(killed, pid);
                         if (r < 0) {
                                 if (ret >= 0)
                                         return r;
@@ -309,13 +367,6 @@ int cg_kill(
                         }
                 }
 
-                if (r < 0) {
-                        if (ret >= 0)
-                                return r;
-
-                        return ret;
-                }
-
                 /* To avoid racing against processes which fork
                  * quicker than we can kill them we repeat this until
                  * no new pids need to be killed. */
@@ -325,30 +376,45 @@ int cg_kill(
         return ret;
 }
 
-int cg_kill_recursive(
+/* The PIDs in the set @s are left alone. PIDs killed are tracked in a bitmap internally, indexed by PID, which is
+ * much cheaper to maintain than a Set for large cgroups. */
+int cg_kill(
+                const char *controller,
+                const char *path,
+                int sig,
+                CGroupFlags flags,
+                Set *s,
+                cg_kill_log_func_t log_kill,
+                void *userdata) {
+
+        _cleanup_bitmap_free_ Bitmap *killed = NULL;
+
+        killed = bitmap_new();
+        if (!killed)
+                return -ENOMEM;
+
+        return cg_kill_internal(controller, path, sig, flags, s, killed, log_kill, userdata);
+}
+
+static int cg_kill_recursive_internal(
                 const char *controller,
                 const char *path,
                 int sig,
                 CGroupFlags flags,
                 Set *s,
+                Bitmap *killed,
                 cg_kill_log_func_t log_kill,
                 void *userdata) {
 
-        _cleanup_set_free_ Set *allocated_set = NULL;
         _cleanup_closedir_ DIR *d = NULL;
         int r, ret;
         char *fn;
 
         assert(path);
         assert(sig >= 0);
+        assert(killed);
 
-        if (!s) {
-                s = allocated_set = set_new(NULL);
-                if (!s)
-                        return -ENOMEM;
-        }
-
-        ret = cg_kill(controller, path, sig, flags, s, log_kill, userdata);
+        ret = cg_kill_internal(controller, path, sig, flags, s, killed, log_kill, userdata);
 
         r = cg_enumerate_subgroups(controller, path, &d);
         if (r < 0) {
@@ -366,7 +432,7 @@ int cg_kill_recursive(
                 if (!p)
                         return -ENOMEM;
 
-                r = cg_kill_recursive(controller, p, sig, flags, s, log_kill, userdata);
+                r = cg_kill_recursive_internal(controller, p, sig, flags, s, killed, log_kill, userdata);
                 if (r != 0 && ret >= 0)
                         ret = r;
         }
@@ -382,6 +448,107 @@ int cg_kill_recursive(
         return ret;
 }
 
+static int cg_kill_kernel(const char *controller, const char *path, CGroupFlags flags) {
+        static bool unsupported = false;
+        _cleanup_free_ char *fs = NULL;
+        int r;
+
+        assert(path);
+
+        /* Newer kernels can SIGKILL a whole cgroup subtree for us through "cgroup.kill" on the unified
+         * hierarchy, atomically and without us having to enumerate anything. Returns -EOPNOTSUPP if that's not
+         * available, in which case the caller should fall back to killing process by process. */
+
+        if (unsupported)
+                return -EOPNOTSUPP;
+
+        /* The root cgroup has no cgroup.kill attribute */
+        if (isempty(path) || path_equal(path, "/"))
+                return -EOPNOTSUPP;
+
+        r = cg_unified_controller(controller);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EOPNOTSUPP;
+
+        if (flags & CGROUP_IGNORE_SELF) {
+                _cleanup_free_ char *own = NULL;
+
+                /* If we are a member of the subtree ourselves the kernel wouldn't spare us */
+                r = cg_pid_get_path(controller, 0, &own);
+                if (r < 0)
+                        return r;
+
+                if (path_startswith(own, path))
+                        return -EOPNOTSUPP;
+        }
+
+        /* The kernel doesn't tell us whether there was anything to kill, hence check that first */
+        r = cg_is_empty_recursive(controller, path);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+        if (r > 0)
+                return 0;
+
+        r = cg_get_path(controller, path, "cgroup.kill", &fs);
+        if (r < 0)
+                return r;
+
+        r = write_string_file(fs, "1", 0);
+        if (r == -ENOENT) {
+                _cleanup_free_ char *p = NULL;
+
+                /* Distinguish an old kernel from the cgroup having vanished in the meantime */
+                r = cg_get_path(controller, path, NULL, &p);
+                if (r < 0)
+                        return r;
+
+                if (access(p, F_OK) < 0)
+                        return 0;
+
+                unsupported = true;
+                return -EOPNOTSUPP;
+        }
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+int cg_kill_recursive(
+                const char *controller,
+                const char *path,
+                int sig,
+                CGroupFlags flags,
+                Set *s,
+                cg_kill_log_func_t log_kill,
+                void *userdata) {
+
+        _cleanup_bitmap_free_ Bitmap *killed = NULL;
+        int r;
+
+        assert(path);
+        assert(sig >= 0);
+
+        /* Let the kernel do the work if we can. We can't do that if the caller wants to know about each process,
+         * or wants us to remove the cgroups right away, and the PIDs in @s won't be spared, which is fine for
+         * SIGKILL as callers put processes there that they already signalled themselves. */
+        if (sig == SIGKILL && !log_kill && !(flags & CGROUP_REMOVE)) {
+                r = cg_kill_kernel(controller, path, flags);
+                if (r != -EOPNOTSUPP)
+                        return r;
+        }
+
+        killed = bitmap_new();
+        if (!killed)
+                return -ENOMEM;
+
+        return cg_kill_recursive_internal(controller, path, sig, flags, s, killed, log_kill, userdata);
+}
+
 int cg_migrate(
                 const char *cfrom,
                 const char *pfrom,
@@ -21,6 +21,8 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +42,7 @@
 #include "fileio.h"
 #include "fs-util.h"
 #include "io-util.h"
+#include "list.h"
 #include "macro.h"
 #include "missing.h"
 #include "string-util.h"
@@ -70,7 +73,7 @@ static ssize_t try_copy_file_range(int fd_in, loff_t *off_in,
                 return -errno;
 }
 
-int copy_bytes(int fdf, int fdt, uint64_t max_bytes, CopyFlags copy_flags) {
+int copy_bytes_full(int fdf, int fdt, uint64_t max_bytes, CopyFlags copy_flags, copy_progress_bytes_t progress, void *userdata) {
         bool try_cfr = true, try_sendfile = true, try_splice = true;
         int r;
         size_t m = SSIZE_MAX; /* that is the maximum that sendfile and c_f_r accept */
@@ -78,15 +81,25 @@ int copy_bytes(int fdf, int fdt, uint64_t max_bytes, CopyFlags copy_flags) {
         assert(fdf >= 0);
         assert(fdt >= 0);
 
-        /* Try btrfs reflinks first. */
+        /* Try reflinks first. BTRFS_IOC_CLONE is the same ioctl as the generic FICLONE, hence this works
+         * on XFS and other file systems supporting shared extents too. */
         if ((copy_flags & COPY_REFLINK) &&
             max_bytes == (uint64_t) -1 &&
             lseek(fdf, 0, SEEK_CUR) == 0 &&
             lseek(fdt, 0, SEEK_CUR) == 0) {
 
                 r = btrfs_reflink(fdf, fdt);
-                if (r >= 0)
+                if (r >= 0) {
+                        struct stat st;
+
+                        if (progress && fstat(fdf, &st) >= 0) {
+                                r = progress(st.st_size, userdata);
+                                if (r < 0)
+                                        return r;
+                        }
+
                         return 0; /* we copied the whole thing, hence hit EOF, return 0 */
+                }
         }
 
         for (;;) {
@@ -164,6 +177,12 @@ int copy_bytes(int fdf, int fdt, uint64_t max_bytes, CopyFlags copy_flags) {
                 }
 
         next:
+                if (progress) {
+                        r = progress(n, userdata);
+                        if (r < 0)
+                                return r;
+                }
+
                 if (max_bytes != (uint64_t) -1) {
                         assert(max_bytes >= (uint64_t) n);
                         max_bytes -= n;
@@ -211,6 +230,271 @@ static int fd_copy_symlink(
         return 0;
 }
 
+#define COPY_WORKERS_MAX 8U
+
+typedef struct CopyJob CopyJob;
+
+struct CopyJob {
+        int fdf, fdt, dt;
+        char *to;
+        struct stat st;
+        uid_t override_uid;
+        gid_t override_gid;
+        CopyFlags copy_flags;
+
+        LIST_FIELDS(CopyJob, queue);
+};
+
+typedef struct CopyPool {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond_queued;   /* signalled when a job is queued, or on shutdown */
+        pthread_cond_t cond_taken;    /* signalled when a worker took a job off the queue */
+
+        LIST_HEAD(CopyJob, queue);
+        CopyJob *queue_tail;
+        unsigned n_queued;
+        bool shutdown;
+        int error;
+
+        pthread_t workers[COPY_WORKERS_MAX];
+        unsigned n_workers;
+
+        /* The progress callbacks are serialized through this */
+        pthread_mutex_t progress_mutex;
+        copy_progress_path_t progress_path;
+        copy_progress_bytes_t progress_bytes;
+        void *userdata;
+} CopyPool;
+
+static int copy_pool_progress_bytes(uint64_t n_bytes, void *userdata) {
+        CopyPool *pool = userdata;
+        int r;
+
+        assert_se(pthread_mutex_lock(&pool->progress_mutex) == 0);
+        r = pool->progress_bytes(n_bytes, pool->userdata);
+        assert_se(pthread_mutex_unlock(&pool->progress_mutex) == 0);
+
+        return r;
+}
+
+static int copy_pool_progress_path(CopyPool *pool, const char *path, const struct stat *st) {
+        int r;
+
+        assert(pool);
+
+        if (!pool->progress_path)
+                return 0;
+
+        if (pool->n_workers == 0)
+                return pool->progress_path(path, st, pool->userdata);
+
+        assert_se(pthread_mutex_lock(&pool->progress_mutex) == 0);
+        r = pool->progress_path(path, st, pool->userdata);
+        assert_se(pthread_mutex_unlock(&pool->progress_mutex) == 0);
+
+        return r;
+}
+
+static int fd_copy_regular_contents(
+                int fdf,
+                int fdt,
+                int dt,
+                const char *to,
+                const struct stat *st,
+                uid_t override_uid,
+                gid_t override_gid,
+                CopyFlags copy_flags,
+                copy_progress_bytes_t progress,
+                void *userdata) {
+
+        struct timespec ts[2];
+        int r;
+
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+        assert(to);
+        assert(st);
+
+        r = copy_bytes_full(fdf, fdt, (uint64_t) -1, copy_flags, progress, userdata);
+        if (r < 0) {
+                unlinkat(dt, to, 0);
+                return r;
+        }
+
+        if (fchown(fdt,
+                   uid_is_valid(override_uid) ? override_uid : st->st_uid,
+                   gid_is_valid(override_gid) ? override_gid : st->st_gid) < 0)
+                r = -errno;
+
+        if (fchmod(fdt, st->st_mode & 07777) < 0)
+                r = -errno;
+
+        ts[0] = st->st_atim;
+        ts[1] = st->st_mtim;
+        (void) futimens(fdt, ts);
+        (void) copy_xattr(fdf, fdt);
+
+        return r;
+}
+
+static CopyJob *copy_job_free(CopyJob *j) {
+        if (!j)
+                return NULL;
+
+        safe_close(j->fdf);
+        safe_close(j->fdt);
+        safe_close(j->dt);
+        free(j->to);
+
+        return mfree(j);
+}
+
+static int copy_job_run(CopyPool *pool, CopyJob *j) {
+        int r, q;
+
+        assert(pool);
+        assert(j);
+
+        r = fd_copy_regular_contents(j->fdf, j->fdt, j->dt, j->to, &j->st,
+                                     j->override_uid, j->override_gid, j->copy_flags,
+                                     pool->progress_bytes ? copy_pool_progress_bytes : NULL, pool);
+
+        q = close(j->fdt);
+        j->fdt = -1;
+
+        if (q < 0) {
+                r = -errno;
+                unlinkat(j->dt, j->to, 0);
+        }
+
+        return r;
+}
+
+static void *copy_worker(void *p) {
+        CopyPool *pool = p;
+
+        for (;;) {
+                CopyJob *j;
+                int r;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+                while (!pool->queue && !pool->shutdown)
+                        assert_se(pthread_cond_wait(&pool->cond_queued, &pool->mutex) == 0);
+
+                j = pool->queue;
+                if (!j) {
+                        /* Shut down, and nothing left to do */
+                        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+                        return NULL;
+                }
+
+                LIST_REMOVE(queue, pool->queue, j);
+                if (pool->queue_tail == j)
+                        pool->queue_tail = NULL;
+                pool->n_queued--;
+
+                assert_se(pthread_cond_signal(&pool->cond_taken) == 0);
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                r = copy_job_run(pool, j);
+                copy_job_free(j);
+
+                if (r < 0) {
+                        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                        if (pool->error >= 0)
+                                pool->error = r;
+                        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+                }
+        }
+}
+
+static void copy_pool_submit(CopyPool *pool, CopyJob *j) {
+        assert(pool);
+        assert(j);
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+        /* Every queued job pins three file descriptors, hence keep the queue short */
+        while (pool->n_queued >= 2 * pool->n_workers)
+                assert_se(pthread_cond_wait(&pool->cond_taken, &pool->mutex) == 0);
+
+        LIST_INSERT_AFTER(queue, pool->queue, pool->queue_tail, j);
+        pool->queue_tail = j;
+        pool->n_queued++;
+
+        assert_se(pthread_cond_signal(&pool->cond_queued) == 0);
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+}
+
+static void copy_pool_destroy(CopyPool *pool) {
+        assert(pool);
+
+        assert_se(pthread_cond_destroy(&pool->cond_taken) == 0);
+        assert_se(pthread_cond_destroy(&pool->cond_queued) == 0);
+        assert_se(pthread_mutex_destroy(&pool->progress_mutex) == 0);
+        assert_se(pthread_mutex_destroy(&pool->mutex) == 0);
+}
+
+static int copy_pool_start(CopyPool *pool) {
+        sigset_t ss, saved_ss;
+        unsigned n;
+        long ncpus;
+        int r;
+
+        assert(pool);
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = CLAMP(ncpus, 2, (long) COPY_WORKERS_MAX);
+
+        /* The workers shall not get any signals delivered */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        assert_se(pthread_mutex_init(&pool->mutex, NULL) == 0);
+        assert_se(pthread_mutex_init(&pool->progress_mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&pool->cond_queued, NULL) == 0);
+        assert_se(pthread_cond_init(&pool->cond_taken, NULL) == 0);
+
+        for (pool->n_workers = 0; pool->n_workers < n; pool->n_workers++) {
+                r = pthread_create(pool->workers + pool->n_workers, NULL, copy_worker, pool);
+                if (r > 0)
+                        break;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        if (pool->n_workers == 0) {
+                copy_pool_destroy(pool);
+                return -r;
+        }
+
+        return 0;
+}
+
+static int copy_pool_stop(CopyPool *pool) {
+        unsigned i;
+
+        assert(pool);
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        pool->shutdown = true;
+        assert_se(pthread_cond_broadcast(&pool->cond_queued) == 0);
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        for (i = 0; i < pool->n_workers; i++)
+                assert_se(pthread_join(pool->workers[i], NULL) == 0);
+
+        assert(!pool->queue);
+        pool->n_workers = 0;
+
+        copy_pool_destroy(pool);
+
+        return pool->error;
+}
+
 static int fd_copy_regular(
                 int df,
                 const char *from,
@@ -219,15 +503,16 @@ static int fd_copy_regular(
                 const char *to,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags) {
+                CopyFlags copy_flags,
+                CopyPool *pool) {
 
         _cleanup_close_ int fdf = -1, fdt = -1;
-        struct timespec ts[2];
         int r, q;
 
         assert(from);
         assert(st);
         assert(to);
+        assert(pool);
 
         fdf = openat(df, from, O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
         if (fdf < 0)
@@ -237,24 +522,44 @@ static int fd_copy_regular(
         if (fdt < 0)
                 return -errno;
 
-        r = copy_bytes(fdf, fdt, (uint64_t) -1, copy_flags);
-        if (r < 0) {
-                unlinkat(dt, to, 0);
-                return r;
-        }
+        if (pool->n_workers > 0) {
+                _cleanup_close_ int dt_copy = -1;
+                CopyJob *j;
 
-        if (fchown(fdt,
-                   uid_is_valid(override_uid) ? override_uid : st->st_uid,
-                   gid_is_valid(override_gid) ? override_gid : st->st_gid) < 0)
-                r = -errno;
+                /* The file is created here already, so that the directory is complete (and its timestamps
+                 * may be applied) once we return. Only copying the contents is left to the workers. */
 
-        if (fchmod(fdt, st->st_mode & 07777) < 0)
-                r = -errno;
+                dt_copy = fcntl(dt, F_DUPFD_CLOEXEC, 3);
+                if (dt_copy < 0) {
+                        r = -errno;
+                        unlinkat(dt, to, 0);
+                        return r;
+                }
 
-        ts[0] = st->st_atim;
-        ts[1] = st->st_mtim;
-        (void) futimens(fdt, ts);
-        (void) copy_xattr(fdf, fdt);
+                j = new0(CopyJob, 1);
+                if (j)
+                        j->to = strdup(to);
+                if (!j || !j->to) {
+                        unlinkat(dt, to, 0);
+                        free(j);
+                        return -ENOMEM;
+                }
+
+                j->fdf = fdf;
+                j->fdt = fdt;
+                j->dt = dt_copy;
+                j->st = *st;
+                j->override_uid = override_uid;
+                j->override_gid = override_gid;
+                j->copy_flags = copy_flags;
+                fdf = fdt = dt_copy = -1;
+
+                copy_pool_submit(pool, j);
+                return 0;
+        }
+
+        r = fd_copy_regular_contents(fdf, fdt, dt, to, st, override_uid, override_gid, copy_flags,
+                                     pool->progress_bytes, pool->userdata);
 
         q = close(fdt);
         fdt = -1;
@@ -338,7 +643,9 @@ static int fd_copy_directory(
                 dev_t original_device,
                 uid_t override_uid,
                 gid_t override_gid,
-                CopyFlags copy_flags) {
+                CopyFlags copy_flags,
+                const char *display_path,
+                CopyPool *pool) {
 
         _cleanup_close_ int fdf = -1, fdt = -1;
         _cleanup_closedir_ DIR *d = NULL;
@@ -348,6 +655,7 @@ static int fd_copy_directory(
 
         assert(st);
         assert(to);
+        assert(pool);
 
         if (from)
                 fdf = openat(df, from, O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW);
@@ -376,6 +684,8 @@ static int fd_copy_directory(
         r = 0;
 
         FOREACH_DIRENT_ALL(de, d, return -errno) {
+                _cleanup_free_ char *child_display_path = NULL;
+                const char *child;
                 struct stat buf;
                 int q;
 
@@ -390,10 +700,23 @@ static int fd_copy_directory(
                 if (buf.st_dev != original_device)
                         continue;
 
+                if (display_path) {
+                        child_display_path = strjoin(display_path, "/", de->d_name);
+                        if (!child_display_path)
+                                return -ENOMEM;
+
+                        child = child_display_path;
+                } else
+                        child = de->d_name;
+
+                q = copy_pool_progress_path(pool, child, &buf);
+                if (q < 0)
+                        return q;
+
                 if (S_ISREG(buf.st_mode))
-                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
+                        q = fd_copy_regular(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags, pool);
                 else if (S_ISDIR(buf.st_mode))
-                        q = fd_copy_directory(dirfd(d), de->d_name, &buf, fdt, de->d_name, original_device, override_uid, override_gid, copy_flags);
+                        q = fd_copy_directory(dirfd(d), de->d_name, &buf, fdt, de->d_name, original_device, override_uid, override_gid, copy_flags, child, pool);
                 else if (S_ISLNK(buf.st_mode))
                         q = fd_copy_symlink(dirfd(d), de->d_name, &buf, fdt, de->d_name, override_uid, override_gid, copy_flags);
                 else if (S_ISFIFO(buf.st_mode))
@@ -431,7 +754,69 @@ static int fd_copy_directory(
         return r;
 }
 
-int copy_tree_at(int fdf, const char *from, int fdt, const char *to, uid_t override_uid, gid_t override_gid, CopyFlags copy_flags) {
+static int fd_copy_tree(
+                int df,
+                const char *from,
+                const struct stat *st,
+                int dt,
+                const char *to,
+                uid_t override_uid,
+                gid_t override_gid,
+                CopyFlags copy_flags,
+                copy_progress_path_t progress_path,
+                copy_progress_bytes_t progress_bytes,
+                void *userdata) {
+
+        CopyPool pool = {
+                .progress_path = progress_path,
+                .progress_bytes = progress_bytes,
+                .userdata = userdata,
+        };
+        int r, q;
+
+        assert(st);
+        assert(to);
+
+        if (S_ISREG(st->st_mode))
+                return fd_copy_regular(df, from, st, dt, to, override_uid, override_gid, copy_flags, &pool);
+        else if (S_ISDIR(st->st_mode)) {
+
+                /* Only directories are worth spinning up workers for. If that doesn't work, copy everything
+                 * synchronously. */
+                if (copy_flags & COPY_PARALLEL)
+                        (void) copy_pool_start(&pool);
+
+                r = fd_copy_directory(df, from, st, dt, to, st->st_dev, override_uid, override_gid, copy_flags, NULL, &pool);
+
+                if (pool.n_workers > 0) {
+                        q = copy_pool_stop(&pool);
+                        if (q < 0)
+                                r = q;
+                }
+
+                return r;
+        } else if (S_ISLNK(st->st_mode))
+                return fd_copy_symlink(df, from, st, dt, to, override_uid, override_gid, copy_flags);
+        else if (S_ISFIFO(st->st_mode))
+                return fd_copy_fifo(df, from, st, dt, to, override_uid, override_gid, copy_flags);
+        else if (S_ISBLK(st->st_mode) || S_ISCHR(st->st_mode) || S_ISSOCK(st->st_mode))
+                return fd_copy_node(df, from, st, dt, to, override_uid, override_gid, copy_flags);
+        else
+                return -EOPNOTSUPP;
+}
+
+int copy_tree_at_full(
+                int fdf,
+                const char *from,
+                int fdt,
+                const char *to,
+                uid_t override_uid,
+                gid_t override_gid,
+                CopyFlags copy_flags,
+                copy_progress_path_t progress_path,
+                copy_progress_bytes_t progress_bytes,
+                void *userdata) {
+
         struct stat st;
 
         assert(from);
@@ -440,18 +825,7 @@ int copy_tree_at(int fdf, const char *from, int fdt, const char *to, uid_t overr
         if (fstatat(fdf, from, &st, AT_SYMLINK_NOFOLLOW) < 0)
                 return -errno;
 
-        if (S_ISREG(st.st_mode))
-                return fd_copy_regular(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
-        else if (S_ISDIR(st.st_mode))
-                return fd_copy_directory(fdf, from, &st, fdt, to, st.st_dev, override_uid, override_gid, copy_flags);
-        else if (S_ISLNK(st.st_mode))
-                return fd_copy_symlink(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
-        else if (S_ISFIFO(st.st_mode))
-                return fd_copy_fifo(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
-        else if (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode) || S_ISSOCK(st.st_mode))
-                return fd_copy_node(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags);
-        else
-                return -EOPNOTSUPP;
+        return fd_copy_tree(fdf, from, &st, fdt, to, override_uid, override_gid, copy_flags, progress_path, progress_bytes, userdata);
 }
 
 int copy_tree(const char *from, const char *to, uid_t override_uid, gid_t override_gid, CopyFlags copy_flags) {
@@ -470,7 +844,7 @@ int copy_directory_fd(int dirfd, const char *to, CopyFlags copy_flags) {
         if (!S_ISDIR(st.st_mode))
                 return -ENOTDIR;
 
-        return fd_copy_directory(dirfd, NULL, &st, AT_FDCWD, to, st.st_dev, UID_INVALID, GID_INVALID, copy_flags);
+        return fd_copy_tree(dirfd, NULL, &st, AT_FDCWD, to, UID_INVALID, GID_INVALID, copy_flags, NULL, NULL, NULL);
 }
 
 int copy_directory(const char *from, const char *to, CopyFlags copy_flags) {
@@ -485,7 +859,7 @@ int copy_directory(const char *from, const char *to, CopyFlags copy_flags) {
         if (!S_ISDIR(st.st_mode))
                 return -ENOTDIR;
 
-        return fd_copy_directory(AT_FDCWD, from, &st, AT_FDCWD, to, st.st_dev, UID_INVALID, GID_INVALID, copy_flags);
+        return fd_copy_tree(AT_FDCWD, from, &st, AT_FDCWD, to, UID_INVALID, GID_INVALID, copy_flags, NULL, NULL, NULL);
 }
 
 int copy_file_fd(const char *from, int fdt, CopyFlags copy_flags) {
@@ -62,6 +62,9 @@
                 .un.sun_path = "\0/org/freedesktop/plymouthd",  \
         }
 
+/* Files opened during boot, as recorded by systemd-readahead-collect, and replayed by PID 1 on the next boot */
+#define READAHEAD_PACK_PATH "/var/lib/systemd/readahead/pack"
+
 #define NOTIFY_FD_MAX 768
 #define NOTIFY_BUFFER_MAX PIPE_BUF
 
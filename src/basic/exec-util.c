@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -40,6 +41,7 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "util.h"
 
 /* Put this test here for a lack of better place */
@@ -98,7 +100,9 @@ static int do_execute(
 
         _cleanup_hashmap_free_free_ Hashmap *pids = NULL;
         _cleanup_strv_free_ char **paths = NULL;
+        char timespan[FORMAT_TIMESPAN_MAX];
         char **path;
+        usec_t start;
         int r;
 
         /* We fork this all off from a child process so that we can somewhat cleanly make
@@ -128,9 +132,13 @@ static int do_execute(
         if (timeout != USEC_INFINITY)
                 alarm((timeout + USEC_PER_SEC - 1) / USEC_PER_SEC);
 
+        /* In parallel mode everything is spawned right away, so the runtime of each is counted from here */
+        start = now(CLOCK_MONOTONIC);
+
         STRV_FOREACH(path, paths) {
                 _cleanup_free_ char *t = NULL;
                 _cleanup_close_ int fd = -1;
+                usec_t spawned;
                 pid_t pid;
 
                 t = strdup(*path);
@@ -143,6 +151,8 @@ static int do_execute(
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
+                spawned = now(CLOCK_MONOTONIC);
+
                 r = do_spawn(t, argv, fd, &pid);
                 if (r <= 0)
                         continue;
@@ -154,6 +164,8 @@ static int do_execute(
                         t = NULL;
                 } else {
                         r = wait_for_terminate_and_warn(t, pid, true);
+                        log_debug("%s finished after %s.", t,
+                                  format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - spawned, USEC_PER_MSEC));
                         if (r < 0)
                                 continue;
 
@@ -175,15 +187,30 @@ static int do_execute(
 
         while (!hashmap_isempty(pids)) {
                 _cleanup_free_ char *t = NULL;
+                siginfo_t si = {};
                 pid_t pid;
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
+                /* Pick up the children in the order they finish, without reaping them yet, so that we know
+                 * how long each of them took */
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT) < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return log_error_errno(errno, "Failed to wait for children: %m");
+                }
+
+                pid = si.si_pid;
                 assert(pid > 0);
 
                 t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
+                if (!t) {
+                        (void) wait_for_terminate(pid, NULL);
+                        continue;
+                }
 
                 wait_for_terminate_and_warn(t, pid, true);
+                log_debug("%s finished after %s.", t,
+                          format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC));
         }
 
         return 0;
@@ -34,6 +34,12 @@ const struct hash_ops string_hash_ops = {
         .compare = string_compare_func
 };
 
+const struct hash_ops trusted_string_hash_ops = {
+        .hash = string_hash_func,
+        .compare = string_compare_func,
+        .trusted = true,
+};
+
 void trivial_hash_func(const void *p, struct siphash *state) {
         siphash24_compress(&p, sizeof(p), state);
 }
@@ -30,12 +30,20 @@ typedef int (*compare_func_t)(const void *a, const void *b);
 struct hash_ops {
         hash_func_t hash;
         compare_func_t compare;
+
+        /* Keys never come from untrusted sources, hence the cheaper SipHash-1-3 may be used
+         * instead of SipHash-2-4. Maps are still seeded with a random key. */
+        bool trusted;
 };
 
 void string_hash_func(const void *p, struct siphash *state);
 int string_compare_func(const void *a, const void *b) _pure_;
 extern const struct hash_ops string_hash_ops;
 
+/* The same, for maps whose keys are not attacker-controlled, e.g. paths of files in directories
+ * only writable by root. */
+extern const struct hash_ops trusted_string_hash_ops;
+
 /* This will compare the passed pointers directly, and will not
  * dereference them. This is hence not useful for strings or
  * suchlike. */
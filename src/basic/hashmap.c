@@ -42,6 +42,13 @@
 #include "list.h"
 #endif
 
+#if ENABLE_HASHMAP_SIMD_PROBE && defined(__SSE2__)
+#include <emmintrin.h>
+#define HASHMAP_SIMD_PROBE 1
+#else
+#define HASHMAP_SIMD_PROBE 0
+#endif
+
 /*
  * Implementation of hashmaps.
  * Addressing: open
@@ -341,7 +348,10 @@ static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
         uint64_t hash;
 
-        siphash24_init(&state, hash_key(h));
+        if (h->hash_ops->trusted)
+                siphash13_init(&state, hash_key(h));
+        else
+                siphash24_init(&state, hash_key(h));
 
         h->hash_ops->hash(p, &state);
 
@@ -1189,6 +1199,64 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
  * Finds an entry with a matching key
  * Returns: index of the found entry, or IDX_NIL if not found.
  */
+#if HASHMAP_SIMD_PROBE
+#define DIB_GROUP_SIZE 16U
+
+/*
+ * Looks at DIB_GROUP_SIZE consecutive DIB bytes starting at idx at once. An entry in
+ * bucket idx+i may only hold the key if its DIB equals distance+i, and the scan ends at
+ * the first free bucket or the first bucket with a DIB lower than that. Returns 1 and
+ * sets *ret if the key was found, 0 if the scan ended inside the group with no match,
+ * -EAGAIN if the whole group was passed without any conclusion, and -EINVAL if it
+ * contains raw DIB values that need to be looked at one by one.
+ */
+static int base_bucket_scan_group(HashmapBase *h, unsigned idx, unsigned distance, const void *key, unsigned *ret) {
+        const __m128i offsets = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        __m128i raw, expected, eq, lt;
+        unsigned candidates, stop, special;
+
+        raw = _mm_loadu_si128((const __m128i*) (dib_raw_ptr(h) + idx));
+        expected = _mm_add_epi8(_mm_set1_epi8((char) distance), offsets);
+
+        eq = _mm_cmpeq_epi8(raw, expected);
+        lt = _mm_andnot_si128(eq, _mm_cmpeq_epi8(_mm_min_epu8(raw, expected), raw));
+
+        /* Saturated and rehash markers do not carry the real DIB. */
+        special = _mm_movemask_epi8(_mm_cmpeq_epi8(raw, _mm_set1_epi8((char) DIB_RAW_OVERFLOW))) |
+                  _mm_movemask_epi8(_mm_cmpeq_epi8(raw, _mm_set1_epi8((char) DIB_RAW_REHASH)));
+
+        candidates = _mm_movemask_epi8(eq);
+        stop = _mm_movemask_epi8(lt) |
+               _mm_movemask_epi8(_mm_cmpeq_epi8(raw, _mm_set1_epi8((char) DIB_RAW_FREE)));
+
+        if (stop != 0) {
+                /* Only what comes before the end of the scan matters. */
+                unsigned end = (1U << __builtin_ctz(stop)) - 1;
+
+                candidates &= end;
+                special &= end;
+        }
+
+        if (special != 0)
+                return -EINVAL;
+
+        while (candidates != 0) {
+                unsigned i = __builtin_ctz(candidates);
+                struct hashmap_base_entry *e;
+
+                e = bucket_at(h, idx + i);
+                if (h->hash_ops->compare(e->key, key) == 0) {
+                        *ret = idx + i;
+                        return 1;
+                }
+
+                candidates &= candidates - 1;
+        }
+
+        return stop != 0 ? 0 : -EAGAIN;
+}
+#endif
+
 static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key) {
         struct hashmap_base_entry *e;
         unsigned dib, distance;
@@ -1197,6 +1265,32 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
         assert(idx < n_buckets(h));
 
         for (distance = 0; ; distance++) {
+#if HASHMAP_SIMD_PROBE
+                /* Take whole groups as long as they neither wrap around nor reach DIBs that
+                 * would not fit into a raw DIB byte. */
+                while (idx + DIB_GROUP_SIZE <= n_buckets(h) &&
+                       distance + DIB_GROUP_SIZE <= DIB_RAW_OVERFLOW) {
+                        unsigned found;
+                        int r;
+
+                        r = base_bucket_scan_group(h, idx, distance, key, &found);
+                        if (r > 0)
+                                return found;
+                        if (r == 0)
+                                return IDX_NIL;
+
+                        if (r == -EAGAIN) {
+                                idx += DIB_GROUP_SIZE;
+                                if (idx == n_buckets(h))
+                                        idx = 0;
+                                distance += DIB_GROUP_SIZE;
+                                continue;
+                        }
+
+                        /* -EINVAL: go through one bucket the slow way */
+                        break;
+                }
+#endif
                 if (dibs[idx] == DIB_RAW_FREE)
                         return IDX_NIL;
 
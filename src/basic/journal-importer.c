@@ -36,6 +36,9 @@ enum {
         IMPORTER_STATE_EOF,         /* done */
 };
 
+/* Don't bother reading less than this at once, and don't shrink the buffer below it either */
+#define BUFFER_SIZE_MIN (16 * LINE_CHUNK)
+
 static int iovw_put(struct iovec_wrapper *iovw, void* data, size_t len) {
         if (!GREEDY_REALLOC(iovw->iovec, iovw->size_bytes, iovw->count + 1))
                 return log_oom();
@@ -123,7 +126,7 @@ static int get_line(JournalImporter *imp, char **line, size_t *size) {
                    we reallocate it, we'll increase the size at least a bit. */
                 assert_cc(DATA_SIZE_MAX < ENTRY_SIZE_MAX);
                 if (imp->size - imp->filled < LINE_CHUNK &&
-                    !realloc_buffer(imp, MIN(imp->filled + LINE_CHUNK, ENTRY_SIZE_MAX)))
+                    !realloc_buffer(imp, MIN(MAX(imp->filled + LINE_CHUNK, BUFFER_SIZE_MIN), ENTRY_SIZE_MAX)))
                                 return log_oom();
 
                 assert(imp->buf);
@@ -262,6 +265,10 @@ static int process_dunder(JournalImporter *imp, char *line, size_t n) {
         /* XXX: is it worth to support timestamps in extended format?
          * We don't produce them, but who knows... */
 
+        /* This is called for every line, make the common case quick */
+        if (n < 2 || line[0] != '_' || line[1] != '_')
+                return 0;
+
         timestamp = startswith(line, "__CURSOR=");
         if (timestamp)
                 /* ignore __CURSOR */
@@ -291,14 +298,8 @@ static int process_dunder(JournalImporter *imp, char *line, size_t n) {
                 return r < 0 ? r : 1;
         }
 
-        timestamp = startswith(line, "__");
-        if (timestamp) {
-                log_notice("Unknown dunder line %s", line);
-                return 1;
-        }
-
-        /* no dunder */
-        return 0;
+        log_notice("Unknown dunder line %.*s", (int) n - 1, line);
+        return 1;
 }
 
 int journal_importer_process_data(JournalImporter *imp) {
@@ -443,9 +444,10 @@ int journal_importer_push_data(JournalImporter *imp, const char *data, size_t si
 void journal_importer_drop_iovw(JournalImporter *imp) {
         size_t remain, target;
 
-        /* This function drops processed data that along with the iovw that points at it */
+        /* This function drops processed data that along with the iovw that points at it.
+         * The iovec array itself is kept around for the next entry. */
 
-        iovw_free_contents(&imp->iovw);
+        imp->iovw.count = 0;
 
         /* possibly reset buffer position */
         remain = imp->filled - imp->offset;
@@ -460,7 +462,7 @@ void journal_importer_drop_iovw(JournalImporter *imp) {
         }
 
         target = imp->size;
-        while (target > 16 * LINE_CHUNK && imp->filled < target / 2)
+        while (target > BUFFER_SIZE_MIN && imp->filled < target / 2)
                 target /= 2;
         if (target < imp->size) {
                 char *tmp;
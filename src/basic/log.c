@@ -42,6 +42,7 @@
 #include "io-util.h"
 #include "log.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "missing.h"
 #include "parse-util.h"
 #include "proc-cmdline.h"
@@ -58,6 +59,13 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* PID 1 never blocks on the journal socket. Entries that can't be sent right away are queued up to this size, and
+ * passed to journald as one batch once the socket is writable again. */
+#define JOURNAL_QUEUE_MAX (512U*1024U)
+
+/* Batches larger than this are passed in a sealed memfd instead of a datagram */
+#define JOURNAL_QUEUE_MEMFD_SIZE (64U*1024U)
+
 static LogTarget log_target = LOG_TARGET_CONSOLE;
 static int log_max_level[] = {LOG_INFO, LOG_INFO};
 assert_cc(ELEMENTSOF(log_max_level) == _LOG_REALM_MAX);
@@ -70,6 +78,10 @@ static int journal_fd = -1;
 
 static bool syslog_is_stream = false;
 
+static char *journal_queue = NULL;
+static size_t journal_queue_size = 0, journal_queue_allocated = 0;
+static unsigned journal_dropped = 0;
+
 static bool show_color = false;
 static bool show_location = false;
 
@@ -81,6 +93,15 @@ static bool open_when_needed = false;
  * use here. */
 static char *log_abort_msg = NULL;
 
+static int log_do_header(
+                char *header,
+                size_t size,
+                int level,
+                int error,
+                const char *file, int line, const char *func,
+                const char *object_field, const char *object,
+                const char *extra_field, const char *extra);
+
 void log_close_console(void) {
 
         if (console_fd < 0)
@@ -197,7 +218,149 @@ fail:
         return r;
 }
 
+static void journal_queue_free(void) {
+        journal_queue = mfree(journal_queue);
+        journal_queue_size = journal_queue_allocated = 0;
+        journal_dropped = 0;
+}
+
+static int journal_queue_send(void) {
+        _cleanup_close_ int buffer_fd = -1;
+        int r;
+
+        assert(journal_fd >= 0);
+        assert(journal_queue_size > 0);
+
+        if (journal_queue_size < JOURNAL_QUEUE_MEMFD_SIZE) {
+                if (send(journal_fd, journal_queue, journal_queue_size, MSG_NOSIGNAL|MSG_DONTWAIT) >= 0)
+                        return 0;
+
+                if (!IN_SET(errno, EMSGSIZE, ENOBUFS))
+                        return -errno;
+        }
+
+        /* The batch doesn't fit into a datagram, pass it by reference. journald accepts several entries
+         * separated by empty lines in a memfd just like in a datagram. */
+        buffer_fd = memfd_new("journal-queue");
+        if (buffer_fd < 0)
+                return buffer_fd;
+
+        r = loop_write(buffer_fd, journal_queue, journal_queue_size, false);
+        if (r < 0)
+                return r;
+
+        r = memfd_set_sealed(buffer_fd);
+        if (r < 0)
+                return r;
+
+        return send_one_fd(journal_fd, buffer_fd, MSG_DONTWAIT);
+}
+
+static bool journal_queue_append(const struct iovec *iovec, size_t n, const char *separator, bool force) {
+        size_t size = 0, i;
+        char *p;
+
+        for (i = 0; i < n; i++)
+                size += iovec[i].iov_len;
+        size += strlen(separator);
+
+        if (!force && journal_queue_size + size > JOURNAL_QUEUE_MAX)
+                return false;
+
+        if (!GREEDY_REALLOC(journal_queue, journal_queue_allocated, journal_queue_size + size))
+                return false;
+
+        p = journal_queue + journal_queue_size;
+        for (i = 0; i < n; i++)
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+        memcpy(p, separator, strlen(separator));
+
+        journal_queue_size += size;
+        return true;
+}
+
+int log_flush_journal(void) {
+        int r;
+
+        /* Tries to pass the entries queued up while the journal socket was busy on to journald. Returns > 0 if
+         * entries remain queued, in which case the caller should try again a bit later. */
+
+        if (journal_queue_size <= 0 && journal_dropped <= 0)
+                return 0;
+
+        if (journal_fd < 0) {
+                journal_queue_free();
+                return 0;
+        }
+
+        if (journal_dropped > 0) {
+                char header[LINE_MAX], message[sizeof("MESSAGE=Dropped  log messages, the journal socket was busy.") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec[2];
+
+                /* Let the reader know where entries are missing, after the ones that did make it */
+                log_do_header(header, sizeof(header), LOG_DAEMON|LOG_NOTICE, 0, NULL, 0, NULL, NULL, NULL, NULL, NULL);
+                xsprintf(message, "MESSAGE=Dropped %u log messages, the journal socket was busy.", journal_dropped);
+
+                iovec[0] = IOVEC_MAKE_STRING(header);
+                iovec[1] = IOVEC_MAKE_STRING(message);
+
+                /* The size limit doesn't apply to this one, so that we never lose track of drops */
+                if (!journal_queue_append(iovec, ELEMENTSOF(iovec), "\n\n", true))
+                        return 1;
+
+                journal_dropped = 0;
+        }
+
+        r = journal_queue_send();
+        if (r == -EAGAIN)
+                return 1;
+
+        /* Sent, or failed for good. Either way there's no point in keeping the entries around. */
+        journal_queue_size = 0;
+        return 0;
+}
+
+static int journal_send(const struct iovec *iovec, size_t n) {
+        struct msghdr mh = {
+                .msg_iov = (struct iovec*) iovec,
+                .msg_iovlen = n,
+        };
+
+        assert(journal_fd >= 0);
+
+        /* Everybody but PID 1 uses a blocking socket with a send timeout. PID 1 must not stall its event loop
+         * on a busy journald however, hence queue entries that can't be sent right away, and keep them in order
+         * by queueing everything that follows too, until the queue could be flushed. */
+
+        if (getpid_cached() != 1) {
+                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
+                        return -errno;
+
+                return 1;
+        }
+
+        if (log_flush_journal() == 0) {
+                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL|MSG_DONTWAIT) >= 0)
+                        return 1;
+
+                if (!IN_SET(errno, EAGAIN, EMSGSIZE, ENOBUFS))
+                        return -errno;
+        }
+
+        /* Entries are dropped rather than queued without bounds, the caller falls back to kmsg for them */
+        if (!journal_queue_append(iovec, n, "\n", false)) {
+                journal_dropped++;
+                return -EAGAIN;
+        }
+
+        return 1;
+}
+
 void log_close_journal(void) {
+        if (journal_fd >= 0)
+                (void) log_flush_journal();
+        journal_queue_free();
+
         journal_fd = safe_close(journal_fd);
 }
 
@@ -542,7 +705,6 @@ static int write_to_journal(
 
         char header[LINE_MAX];
         struct iovec iovec[4] = {};
-        struct msghdr mh = {};
 
         if (journal_fd < 0)
                 return 0;
@@ -554,13 +716,7 @@ static int write_to_journal(
         iovec[2] = IOVEC_MAKE_STRING(buffer);
         iovec[3] = IOVEC_MAKE_STRING("\n");
 
-        mh.msg_iov = iovec;
-        mh.msg_iovlen = ELEMENTSOF(iovec);
-
-        if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
-
-        return 1;
+        return journal_send(iovec, ELEMENTSOF(iovec));
 }
 
 int log_dispatch_internal(
@@ -931,9 +1087,6 @@ int log_struct_internal(
                         struct iovec iovec[17] = {};
                         size_t n = 0, i;
                         int r;
-                        struct msghdr mh = {
-                                .msg_iov = iovec,
-                        };
                         bool fallback = false;
 
                         /* If the journal is available do structured logging */
@@ -944,10 +1097,8 @@ int log_struct_internal(
                         r = log_format_iovec(iovec, ELEMENTSOF(iovec), &n, true, error, format, ap);
                         if (r < 0)
                                 fallback = true;
-                        else {
-                                mh.msg_iovlen = n;
-                                (void) sendmsg(journal_fd, &mh, MSG_NOSIGNAL);
-                        }
+                        else
+                                (void) journal_send(iovec, n);
 
                         va_end(ap);
                         for (i = 1; i < n; i += 2)
@@ -1029,10 +1180,6 @@ int log_struct_iovec_internal(
 
                 struct iovec iovec[1 + n_input_iovec*2];
                 char header[LINE_MAX];
-                struct msghdr mh = {
-                        .msg_iov = iovec,
-                        .msg_iovlen = 1 + n_input_iovec*2,
-                };
 
                 log_do_header(header, sizeof(header), level, error, file, line, func, NULL, NULL, NULL, NULL);
                 iovec[0] = IOVEC_MAKE_STRING(header);
@@ -1042,7 +1189,7 @@ int log_struct_iovec_internal(
                         iovec[1+i*2+1] = IOVEC_MAKE_STRING("\n");
                 }
 
-                if (sendmsg(journal_fd, &mh, MSG_NOSIGNAL) >= 0)
+                if (journal_send(iovec, 1 + n_input_iovec*2) >= 0)
                         return -error;
         }
 
@@ -99,6 +99,7 @@ void log_forget_fds(void);
 
 void log_close_syslog(void);
 void log_close_journal(void);
+int log_flush_journal(void);
 void log_close_kmsg(void);
 void log_close_console(void);
 
@@ -24,6 +24,7 @@
 
 #include "macro.h"
 #include "mempool.h"
+#include "string-util.h"
 #include "util.h"
 
 struct pool {
@@ -32,6 +33,14 @@ struct pool {
         unsigned n_used;
 };
 
+/* Pools are only used from the main thread, hence no locking */
+static struct mempool *mempools = NULL;
+
+static void mempool_account_alloc(struct mempool *mp) {
+        mp->n_used++;
+        mp->n_used_max = MAX(mp->n_used_max, mp->n_used);
+}
+
 void* mempool_alloc_tile(struct mempool *mp) {
         unsigned i;
 
@@ -46,6 +55,7 @@ void* mempool_alloc_tile(struct mempool *mp) {
 
                 r = mp->freelist;
                 mp->freelist = * (void**) mp->freelist;
+                mempool_account_alloc(mp);
                 return r;
         }
 
@@ -64,14 +74,21 @@ void* mempool_alloc_tile(struct mempool *mp) {
                 if (!p)
                         return NULL;
 
+                if (!mp->first_pool) {
+                        mp->next_mempool = mempools;
+                        mempools = mp;
+                }
+
                 p->next = mp->first_pool;
                 p->n_tiles = n;
                 p->n_used = 0;
 
                 mp->first_pool = p;
+                mp->n_tiles += n;
         }
 
         i = mp->first_pool->n_used++;
+        mempool_account_alloc(mp);
 
         return ((uint8_t*) mp->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
 }
@@ -86,20 +103,43 @@ void* mempool_alloc0_tile(struct mempool *mp) {
 }
 
 void mempool_free_tile(struct mempool *mp, void *p) {
+        assert(mp->n_used > 0);
+
         * (void**) p = mp->freelist;
         mp->freelist = p;
+        mp->n_used--;
+}
+
+void mempool_dump_all(FILE *f) {
+        struct mempool *mp;
+
+        if (!f)
+                f = stdout;
+
+        for (mp = mempools; mp; mp = mp->next_mempool)
+                fprintf(f,
+                        "Memory pool %s: %zu objects in use (%zu at most) of %zu allocated, %zu bytes\n",
+                        strna(mp->name), mp->n_used, mp->n_used_max, mp->n_tiles, mp->n_tiles * mp->tile_size);
 }
 
 #ifdef VALGRIND
 
 void mempool_drop(struct mempool *mp) {
         struct pool *p = mp->first_pool;
+        struct mempool **i;
+
         while (p) {
                 struct pool *n;
                 n = p->next;
                 free(p);
                 p = n;
         }
+
+        for (i = &mempools; *i; i = &(*i)->next_mempool)
+                if (*i == mp) {
+                        *i = mp->next_mempool;
+                        break;
+                }
 }
 
 #endif
@@ -22,6 +22,7 @@
 ***/
 
 #include <stddef.h>
+#include <stdio.h>
 
 struct pool;
 
@@ -30,16 +31,27 @@ struct mempool {
         void *freelist;
         size_t tile_size;
         unsigned at_least;
+
+        /* All pools in use are linked together, so that they can be dumped */
+        const char *name;
+        struct mempool *next_mempool;
+
+        size_t n_tiles;         /* tiles we got from malloc() */
+        size_t n_used;          /* tiles handed out right now */
+        size_t n_used_max;
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
 void* mempool_alloc0_tile(struct mempool *mp);
 void mempool_free_tile(struct mempool *mp, void *p);
 
+void mempool_dump_all(FILE *f);
+
 #define DEFINE_MEMPOOL(pool_name, tile_type, alloc_at_least) \
 static struct mempool pool_name = { \
         .tile_size = sizeof(tile_type), \
         .at_least = alloc_at_least, \
+        .name = #tile_type, \
 }
 
 
@@ -74,6 +74,23 @@ static inline int memfd_create(const char *name, unsigned int flags) {
 
 /* ======================================================================= */
 
+#if !HAVE_PIDFD_OPEN
+#  ifndef __NR_pidfd_open
+#    if defined __alpha__
+#      define __NR_pidfd_open 544
+#    else
+/* Syscalls added since Linux 5.1 have the same number on all other architectures */
+#      define __NR_pidfd_open 434
+#    endif
+#  endif
+
+static inline int pidfd_open(pid_t pid, unsigned flags) {
+        return (int) syscall(__NR_pidfd_open, pid, flags);
+}
+#endif
+
+/* ======================================================================= */
+
 #if !HAVE_GETRANDOM
 #  ifndef __NR_getrandom
 #    if defined __x86_64__
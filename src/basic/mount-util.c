@@ -407,6 +407,8 @@ static int get_mount_flags(const char *path, unsigned long *flags) {
 int bind_remount_recursive_with_mountinfo(const char *prefix, bool ro, char **blacklist, FILE *proc_self_mountinfo) {
         _cleanup_set_free_free_ Set *done = NULL;
         _cleanup_free_ char *cleaned = NULL;
+        char **sub_blacklist, **i;
+        unsigned n = 0;
         int r;
 
         assert(proc_self_mountinfo);
@@ -428,6 +430,21 @@ int bind_remount_recursive_with_mountinfo(const char *prefix, bool ro, char **bl
 
         path_kill_slashes(cleaned);
 
+        /* Only the blacklist entries below the prefix can ever match, pick them out once instead of testing all of
+         * them against every mount over and over again */
+        sub_blacklist = newa(char*, strv_length(blacklist) + 1);
+        STRV_FOREACH(i, blacklist) {
+
+                if (path_equal(*i, cleaned))
+                        continue;
+
+                if (!path_startswith(*i, cleaned))
+                        continue;
+
+                sub_blacklist[n++] = *i;
+        }
+        sub_blacklist[n] = NULL;
+
         done = set_new(&string_hash_ops);
         if (!done)
                 return -ENOMEM;
@@ -470,9 +487,15 @@ int bind_remount_recursive_with_mountinfo(const char *prefix, bool ro, char **bl
                                 continue;
                         }
 
-                        r = cunescape(path, UNESCAPE_RELAX, &p);
-                        if (r < 0)
-                                return r;
+                        /* Most paths contain nothing to unescape, save the copy for those */
+                        if (strchr(path, '\\')) {
+                                r = cunescape(path, UNESCAPE_RELAX, &p);
+                                if (r < 0)
+                                        return r;
+                        } else {
+                                p = path;
+                                path = NULL;
+                        }
 
                         if (!path_startswith(p, cleaned))
                                 continue;
@@ -481,15 +504,8 @@ int bind_remount_recursive_with_mountinfo(const char *prefix, bool ro, char **bl
                          * operate on. */
                         if (!path_equal(cleaned, p)) {
                                 bool blacklisted = false;
-                                char **i;
-
-                                STRV_FOREACH(i, blacklist) {
-
-                                        if (path_equal(*i, cleaned))
-                                                continue;
 
-                                        if (!path_startswith(*i, cleaned))
-                                                continue;
+                                STRV_FOREACH(i, sub_blacklist) {
 
                                         if (path_startswith(p, *i)) {
                                                 blacklisted = true;
@@ -57,6 +57,10 @@ static inline bool ordered_set_isempty(OrderedSet *s) {
         return ordered_hashmap_isempty((OrderedHashmap*) s);
 }
 
+static inline void *ordered_set_steal_first(OrderedSet *s) {
+        return ordered_hashmap_steal_first((OrderedHashmap*) s);
+}
+
 static inline bool ordered_set_iterate(OrderedSet *s, Iterator *i, void **value) {
         return ordered_hashmap_iterate((OrderedHashmap*) s, i, value, NULL);
 }
@@ -25,7 +25,10 @@
  * priority. Insertion and removal are Θ(log n). Optionally, the caller can
  * provide a pointer to an index which will be kept up-to-date by the prioq.
  *
- * The underlying algorithm used in this implementation is a Heap.
+ * The underlying algorithm used in this implementation is a Heap. Queues ordered
+ * by a key function use a 4-ary heap, and compare the keys stored inline in the
+ * heap array, so that neither function calls nor the objects themselves are
+ * needed to find the way through it.
  */
 
 #include <errno.h>
@@ -38,10 +41,13 @@
 struct prioq_item {
         void *data;
         unsigned *idx;
+        uint64_t key;
 };
 
 struct Prioq {
         compare_func_t compare_func;
+        prioq_key_func_t key_func;
+        unsigned arity;
         unsigned n_items, n_allocated;
 
         struct prioq_item *items;
@@ -55,6 +61,21 @@ Prioq *prioq_new(compare_func_t compare_func) {
                 return q;
 
         q->compare_func = compare_func;
+        q->arity = 2;
+        return q;
+}
+
+Prioq *prioq_new_keyed(prioq_key_func_t key_func) {
+        Prioq *q;
+
+        assert(key_func);
+
+        q = new0(Prioq, 1);
+        if (!q)
+                return q;
+
+        q->key_func = key_func;
+        q->arity = 4;
         return q;
 }
 
@@ -79,9 +100,33 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
+int prioq_ensure_allocated_keyed(Prioq **q, prioq_key_func_t key_func) {
+        assert(q);
+
+        if (*q)
+                return 0;
+
+        *q = prioq_new_keyed(key_func);
+        if (!*q)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static inline int compare(Prioq *q, unsigned j, unsigned k) {
+        if (q->key_func) {
+                if (q->items[j].key < q->items[k].key)
+                        return -1;
+                if (q->items[j].key > q->items[k].key)
+                        return 1;
+                return 0;
+        }
+
+        return q->compare_func(q->items[j].data, q->items[k].data);
+}
+
 static void swap(Prioq *q, unsigned j, unsigned k) {
-        void *saved_data;
-        unsigned *saved_idx;
+        struct prioq_item saved;
 
         assert(q);
         assert(j < q->n_items);
@@ -90,12 +135,9 @@ static void swap(Prioq *q, unsigned j, unsigned k) {
         assert(!q->items[j].idx || *(q->items[j].idx) == j);
         assert(!q->items[k].idx || *(q->items[k].idx) == k);
 
-        saved_data = q->items[j].data;
-        saved_idx = q->items[j].idx;
-        q->items[j].data = q->items[k].data;
-        q->items[j].idx = q->items[k].idx;
-        q->items[k].data = saved_data;
-        q->items[k].idx = saved_idx;
+        saved = q->items[j];
+        q->items[j] = q->items[k];
+        q->items[k] = saved;
 
         if (q->items[j].idx)
                 *q->items[j].idx = j;
@@ -110,9 +152,9 @@ static unsigned shuffle_up(Prioq *q, unsigned idx) {
         while (idx > 0) {
                 unsigned k;
 
-                k = (idx-1)/2;
+                k = (idx-1) / q->arity;
 
-                if (q->compare_func(q->items[k].data, q->items[idx].data) <= 0)
+                if (compare(q, k, idx) <= 0)
                         break;
 
                 swap(q, idx, k);
@@ -128,28 +170,16 @@ static unsigned shuffle_down(Prioq *q, unsigned idx) {
         for (;;) {
                 unsigned j, k, s;
 
-                k = (idx+1)*2; /* right child */
-                j = k-1;       /* left child */
-
+                j = idx * q->arity + 1; /* first child */
                 if (j >= q->n_items)
                         break;
 
-                if (q->compare_func(q->items[j].data, q->items[idx].data) < 0)
-
-                        /* So our left child is smaller than we are, let's
-                         * remember this fact */
-                        s = j;
-                else
-                        s = idx;
+                k = MIN(j + q->arity, q->n_items); /* after the last child */
 
-                if (k < q->n_items &&
-                    q->compare_func(q->items[k].data, q->items[s].data) < 0)
-
-                        /* So our right child is smaller than we are, let's
-                         * remember this fact */
-                        s = k;
-
-                /* s now points to the smallest of the three items */
+                /* Find the smallest of us and our children */
+                for (s = idx; j < k; j++)
+                        if (compare(q, j, s) < 0)
+                                s = j;
 
                 if (s == idx)
                         /* No swap necessary, we're done */
@@ -185,6 +215,8 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
         i = q->items + k;
         i->data = data;
         i->idx = idx;
+        if (q->key_func)
+                i->key = q->key_func(data);
 
         if (idx)
                 *idx = k;
@@ -213,8 +245,7 @@ static void remove_item(Prioq *q, struct prioq_item *i) {
 
                 k = i - q->items;
 
-                i->data = l->data;
-                i->idx = l->idx;
+                *i = *l;
                 if (i->idx)
                         *i->idx = k;
                 q->n_items--;
@@ -271,6 +302,9 @@ int prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
         if (!i)
                 return 0;
 
+        if (q->key_func)
+                i->key = q->key_func(data);
+
         k = i - q->items;
         k = shuffle_down(q, k);
         shuffle_up(q, k);
@@ -21,6 +21,7 @@
 ***/
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "hashmap.h"
 #include "macro.h"
@@ -29,9 +30,15 @@ typedef struct Prioq Prioq;
 
 #define PRIOQ_IDX_NULL ((unsigned) -1)
 
+/* Queues ordered by a scalar may use a key function instead of a compare function. The key is kept next to the
+ * entry in the heap, and only recalculated by prioq_put() and prioq_reshuffle(). Lower keys come first. */
+typedef uint64_t (*prioq_key_func_t)(const void *data);
+
 Prioq *prioq_new(compare_func_t compare);
+Prioq *prioq_new_keyed(prioq_key_func_t key_func);
 Prioq *prioq_free(Prioq *q);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
+int prioq_ensure_allocated_keyed(Prioq **q, prioq_key_func_t key_func);
 
 int prioq_put(Prioq *q, void *data, unsigned *idx);
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
@@ -20,16 +20,21 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/statfs.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
 #include "btrfs-util.h"
 #include "cgroup-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "list.h"
 #include "log.h"
 #include "macro.h"
 #include "mount-util.h"
@@ -42,6 +47,327 @@ static bool is_physical_fs(const struct statfs *sfs) {
         return !is_temporary_fs(sfs) && !is_cgroup_fs(sfs);
 }
 
+/* Looks at one directory entry. Removes it right away if it is not a directory. If it is a directory we shall
+ * descend into, returns an fd for it in *ret_subdir_fd, otherwise -1. */
+static int rm_rf_child(int fd, const struct dirent *de, RemoveFlags flags, const struct stat *root_dev, int *ret_subdir_fd) {
+        _cleanup_close_ int subdir_fd = -1;
+        struct stat st;
+        bool is_dir;
+        int r;
+
+        assert(fd >= 0);
+        assert(de);
+        assert(ret_subdir_fd);
+
+        *ret_subdir_fd = -1;
+
+        if (dot_or_dot_dot(de->d_name))
+                return 0;
+
+        if (de->d_type == DT_UNKNOWN ||
+            (de->d_type == DT_DIR && (root_dev || (flags & REMOVE_SUBVOLUME)))) {
+                if (fstatat(fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                        return errno == ENOENT ? 0 : -errno;
+
+                is_dir = S_ISDIR(st.st_mode);
+        } else
+                is_dir = de->d_type == DT_DIR;
+
+        if (!is_dir) {
+                if (flags & REMOVE_ONLY_DIRECTORIES)
+                        return 0;
+
+                if (unlinkat(fd, de->d_name, 0) < 0 && errno != ENOENT)
+                        return -errno;
+
+                return 0;
+        }
+
+        /* if root_dev is set, remove subdirectories only if device is same */
+        if (root_dev && st.st_dev != root_dev->st_dev)
+                return 0;
+
+        subdir_fd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
+        if (subdir_fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        /* Stop at mount points */
+        r = fd_is_mount_point(fd, de->d_name, 0);
+        if (r < 0)
+                return r == -ENOENT ? 0 : r;
+        if (r)
+                return 0;
+
+        if ((flags & REMOVE_SUBVOLUME) && st.st_ino == 256) {
+
+                /* This could be a subvolume, try to remove it */
+
+                r = btrfs_subvol_remove_fd(fd, de->d_name, BTRFS_REMOVE_RECURSIVE|BTRFS_REMOVE_QUOTA);
+                if (r < 0) {
+                        if (!IN_SET(r, -ENOTTY, -EINVAL))
+                                return r;
+
+                        /* ENOTTY, then it wasn't a
+                         * btrfs subvolume, continue
+                         * below. */
+                } else
+                        /* It was a subvolume, continue. */
+                        return 0;
+        }
+
+        *ret_subdir_fd = subdir_fd;
+        subdir_fd = -1;
+
+        return 0;
+}
+
+/* Directories that are queued or being worked on keep their fd open. Beyond this many, workers descend into
+ * further subdirectories on their own instead of queueing them. */
+#define RM_RF_OPEN_DIRS_MAX 256U
+
+#define RM_RF_WORKERS_MAX 8U
+
+typedef struct RemoveDir RemoveDir;
+
+struct RemoveDir {
+        RemoveDir *parent;
+        char *name;               /* relative to the parent */
+
+        int fd;                   /* before it is scanned */
+        DIR *d;                   /* while it is scanned and its subdirectories are removed */
+
+        unsigned n_ref;           /* one for scanning it, and one per subdirectory not removed yet */
+
+        LIST_FIELDS(RemoveDir, queue);
+};
+
+typedef struct RemovePool {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;      /* signalled when a directory is queued, or when we are done */
+
+        LIST_HEAD(RemoveDir, queue);
+        unsigned n_open;
+        bool done;
+        int error;
+
+        RemoveFlags flags;
+        struct stat *root_dev;
+} RemovePool;
+
+static void remove_pool_error(RemovePool *pool, int r) {
+        if (r >= 0)
+                return;
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        if (pool->error == 0)
+                pool->error = r;
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+}
+
+static void remove_dir_release(RemovePool *pool, RemoveDir *dir) {
+
+        /* Drops a reference to the directory. If it was the last one, the directory is empty now, hence
+         * remove it, and drop the reference it held on its parent. */
+
+        while (dir) {
+                RemoveDir *parent;
+                unsigned n;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                assert(dir->n_ref > 0);
+                n = --dir->n_ref;
+                if (n == 0)
+                        pool->n_open--;
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                if (n > 0)
+                        return;
+
+                parent = dir->parent;
+
+                if (dir->d)
+                        closedir(dir->d);
+                else
+                        safe_close(dir->fd);
+
+                if (!parent) {
+                        /* That's the top-level directory, we are done. */
+                        free(dir);
+
+                        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                        pool->done = true;
+                        assert_se(pthread_cond_broadcast(&pool->cond) == 0);
+                        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+                        return;
+                }
+
+                if (unlinkat(dirfd(parent->d), dir->name, AT_REMOVEDIR) < 0 && errno != ENOENT)
+                        remove_pool_error(pool, -errno);
+
+                free(dir->name);
+                free(dir);
+
+                dir = parent;
+        }
+}
+
+static void remove_dir_scan(RemovePool *pool, RemoveDir *dir) {
+        struct dirent *de;
+        int r;
+
+        assert(pool);
+        assert(dir);
+
+        dir->d = fdopendir(dir->fd);
+        if (!dir->d) {
+                if (errno != ENOENT)
+                        remove_pool_error(pool, -errno);
+                goto finish;
+        }
+        dir->fd = -1;
+
+        FOREACH_DIRENT_ALL(de, dir->d, remove_pool_error(pool, -errno); break) {
+                _cleanup_free_ char *name = NULL;
+                RemoveDir *child;
+                int subdir_fd;
+                bool inline_;
+
+                r = rm_rf_child(dirfd(dir->d), de, pool->flags, pool->root_dev, &subdir_fd);
+                if (r < 0) {
+                        remove_pool_error(pool, r);
+                        continue;
+                }
+                if (subdir_fd < 0)
+                        continue;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                inline_ = pool->n_open >= RM_RF_OPEN_DIRS_MAX;
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                name = strdup(de->d_name);
+                child = name ? new(RemoveDir, 1) : NULL;
+
+                if (inline_ || !child) {
+                        free(child);
+
+                        r = rm_rf_children(subdir_fd, pool->flags, pool->root_dev);
+                        remove_pool_error(pool, r);
+
+                        if (unlinkat(dirfd(dir->d), de->d_name, AT_REMOVEDIR) < 0 && errno != ENOENT)
+                                remove_pool_error(pool, -errno);
+
+                        continue;
+                }
+
+                *child = (RemoveDir) {
+                        .parent = dir,
+                        .name = name,
+                        .fd = subdir_fd,
+                        .n_ref = 1,
+                };
+                name = NULL;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                dir->n_ref++;
+                pool->n_open++;
+                LIST_PREPEND(queue, pool->queue, child);
+                assert_se(pthread_cond_signal(&pool->cond) == 0);
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+        }
+
+finish:
+        remove_dir_release(pool, dir);
+}
+
+static void *remove_worker(void *p) {
+        RemovePool *pool = p;
+
+        for (;;) {
+                RemoveDir *dir;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+                while (!pool->queue && !pool->done)
+                        assert_se(pthread_cond_wait(&pool->cond, &pool->mutex) == 0);
+
+                dir = pool->queue;
+                if (dir)
+                        LIST_REMOVE(queue, pool->queue, dir);
+
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                if (!dir)
+                        return NULL;
+
+                remove_dir_scan(pool, dir);
+        }
+}
+
+static int rm_rf_children_parallel(int fd, RemoveFlags flags, struct stat *root_dev) {
+        pthread_t workers[RM_RF_WORKERS_MAX];
+        unsigned n_workers, i;
+        sigset_t ss, saved_ss;
+        RemovePool pool = {
+                .flags = flags,
+                .root_dev = root_dev,
+                .n_open = 1,
+        };
+        RemoveDir *root;
+        long ncpus;
+        int r;
+
+        assert(fd >= 0);
+
+        /* Removes the directory tree from a bunch of threads. Each queued directory is scanned by one
+         * worker, which removes everything but subdirectories right away and queues those in turn. A
+         * directory is removed by whoever finishes the last of its subdirectories. */
+
+        root = new0(RemoveDir, 1);
+        if (!root) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        root->fd = fd;
+        root->n_ref = 1;
+
+        assert_se(pthread_mutex_init(&pool.mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&pool.cond, NULL) == 0);
+
+        LIST_PREPEND(queue, pool.queue, root);
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = CLAMP(ncpus, 2, (long) RM_RF_WORKERS_MAX) - 1;
+
+        /* The workers shall not get any signals delivered */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                n_workers = 0;
+
+        for (i = 0; i < n_workers; i++)
+                if (pthread_create(workers + i, NULL, remove_worker, &pool) > 0)
+                        break;
+        n_workers = i;
+
+        if (r == 0)
+                assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        /* The calling thread joins in, which also means things just work if no worker could be started. */
+        (void) remove_worker(&pool);
+
+        for (i = 0; i < n_workers; i++)
+                assert_se(pthread_join(workers[i], NULL) == 0);
+
+        assert(!pool.queue);
+        assert(pool.n_open == 0);
+
+        assert_se(pthread_cond_destroy(&pool.cond) == 0);
+        assert_se(pthread_mutex_destroy(&pool.mutex) == 0);
+
+        return pool.error;
+}
+
 int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
@@ -74,6 +400,11 @@ int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
                 }
         }
 
+        /* We pass REMOVE_PHYSICAL on, to avoid doing the fstatfs() to
+         * check the file system type again for each directory */
+        if (flags & REMOVE_PARALLEL)
+                return rm_rf_children_parallel(fd, (flags | REMOVE_PHYSICAL) & ~REMOVE_PARALLEL, root_dev);
+
         d = fdopendir(fd);
         if (!d) {
                 safe_close(fd);
@@ -81,94 +412,24 @@ int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev) {
         }
 
         FOREACH_DIRENT_ALL(de, d, return -errno) {
-                bool is_dir;
-                struct stat st;
-
-                if (dot_or_dot_dot(de->d_name))
-                        continue;
-
-                if (de->d_type == DT_UNKNOWN ||
-                    (de->d_type == DT_DIR && (root_dev || (flags & REMOVE_SUBVOLUME)))) {
-                        if (fstatat(fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                                if (ret == 0 && errno != ENOENT)
-                                        ret = -errno;
-                                continue;
-                        }
-
-                        is_dir = S_ISDIR(st.st_mode);
-                } else
-                        is_dir = de->d_type == DT_DIR;
-
-                if (is_dir) {
-                        int subdir_fd;
-
-                        /* if root_dev is set, remove subdirectories only if device is same */
-                        if (root_dev && st.st_dev != root_dev->st_dev)
-                                continue;
-
-                        subdir_fd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
-                        if (subdir_fd < 0) {
-                                if (ret == 0 && errno != ENOENT)
-                                        ret = -errno;
-                                continue;
-                        }
+                int subdir_fd;
 
-                        /* Stop at mount points */
-                        r = fd_is_mount_point(fd, de->d_name, 0);
-                        if (r < 0) {
-                                if (ret == 0 && r != -ENOENT)
-                                        ret = r;
-
-                                safe_close(subdir_fd);
-                                continue;
-                        }
-                        if (r) {
-                                safe_close(subdir_fd);
-                                continue;
-                        }
-
-                        if ((flags & REMOVE_SUBVOLUME) && st.st_ino == 256) {
-
-                                /* This could be a subvolume, try to remove it */
-
-                                r = btrfs_subvol_remove_fd(fd, de->d_name, BTRFS_REMOVE_RECURSIVE|BTRFS_REMOVE_QUOTA);
-                                if (r < 0) {
-                                        if (!IN_SET(r, -ENOTTY, -EINVAL)) {
-                                                if (ret == 0)
-                                                        ret = r;
-
-                                                safe_close(subdir_fd);
-                                                continue;
-                                        }
-
-                                        /* ENOTTY, then it wasn't a
-                                         * btrfs subvolume, continue
-                                         * below. */
-                                } else {
-                                        /* It was a subvolume, continue. */
-                                        safe_close(subdir_fd);
-                                        continue;
-                                }
-                        }
-
-                        /* We pass REMOVE_PHYSICAL here, to avoid
-                         * doing the fstatfs() to check the file
-                         * system type again for each directory */
-                        r = rm_rf_children(subdir_fd, flags | REMOVE_PHYSICAL, root_dev);
-                        if (r < 0 && ret == 0)
+                r = rm_rf_child(fd, de, flags, root_dev, &subdir_fd);
+                if (r < 0) {
+                        if (ret == 0)
                                 ret = r;
+                        continue;
+                }
+                if (subdir_fd < 0)
+                        continue;
 
-                        if (unlinkat(fd, de->d_name, AT_REMOVEDIR) < 0) {
-                                if (ret == 0 && errno != ENOENT)
-                                        ret = -errno;
-                        }
-
-                } else if (!(flags & REMOVE_ONLY_DIRECTORIES)) {
+                r = rm_rf_children(subdir_fd, flags | REMOVE_PHYSICAL, root_dev);
+                if (r < 0 && ret == 0)
+                        ret = r;
 
-                        if (unlinkat(fd, de->d_name, 0) < 0) {
-                                if (ret == 0 && errno != ENOENT)
-                                        ret = -errno;
-                        }
+                if (unlinkat(fd, de->d_name, AT_REMOVEDIR) < 0) {
+                        if (ret == 0 && errno != ENOENT)
+                                ret = -errno;
                 }
         }
         return ret;
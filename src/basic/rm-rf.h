@@ -27,6 +27,7 @@ typedef enum RemoveFlags {
         REMOVE_ROOT = 2,
         REMOVE_PHYSICAL = 4, /* if not set, only removes files on tmpfs, never physical file systems */
         REMOVE_SUBVOLUME = 8,
+        REMOVE_PARALLEL = 16, /* remove from a pool of worker threads */
 } RemoveFlags;
 
 int rm_rf_children(int fd, RemoveFlags flags, struct stat *root_dev);
@@ -143,6 +143,12 @@ int mac_selinux_fix(const char *path, bool ignore_enoent, bool ignore_erofs) {
                         return 0;
 
                 if (r >= 0) {
+                        _cleanup_freecon_ char* oldcon = NULL;
+
+                        /* Don't write the label again if it is right already */
+                        if (lgetfilecon_raw(path, &oldcon) >= 0 && streq_ptr(oldcon, fcon))
+                                return 0;
+
                         r = lsetfilecon_raw(path, fcon);
 
                         /* If the FS doesn't support labels, then exit without warning */
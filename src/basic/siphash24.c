@@ -48,6 +48,15 @@ static inline void sipround(struct siphash *state) {
         state->v2 = rotate_left(state->v2, 32);
 }
 
+/* Only 2-4 and 1-3 are supported, spelled out so that the common case stays unrolled */
+static inline void sipcompress(struct siphash *state, uint64_t m) {
+        state->v3 ^= m;
+        sipround(state);
+        if (state->c_rounds > 1)
+                sipround(state);
+        state->v0 ^= m;
+}
+
 void siphash24_init(struct siphash *state, const uint8_t k[16]) {
         uint64_t k0, k1;
 
@@ -65,9 +74,18 @@ void siphash24_init(struct siphash *state, const uint8_t k[16]) {
                 .v3 = 0x7465646279746573ULL ^ k1,
                 .padding = 0,
                 .inlen = 0,
+                .c_rounds = 2,
+                .d_rounds = 4,
         };
 }
 
+void siphash13_init(struct siphash *state, const uint8_t k[16]) {
+        siphash24_init(state, k);
+
+        state->c_rounds = 1;
+        state->d_rounds = 3;
+}
+
 void siphash24_compress(const void *_in, size_t inlen, struct siphash *state) {
 
         const uint8_t *in = _in;
@@ -98,10 +116,7 @@ void siphash24_compress(const void *_in, size_t inlen, struct siphash *state) {
                 printf("(%3zu) compress padding %08x %08x\n", state->inlen, (uint32_t) (state->padding >> 32), (uint32_t)state->padding);
 #endif
 
-                state->v3 ^= state->padding;
-                sipround(state);
-                sipround(state);
-                state->v0 ^= state->padding;
+                sipcompress(state, state->padding);
 
                 state->padding = 0;
         }
@@ -117,10 +132,7 @@ void siphash24_compress(const void *_in, size_t inlen, struct siphash *state) {
                 printf("(%3zu) v3 %08x %08x\n", state->inlen, (uint32_t) (state->v3 >> 32), (uint32_t) state->v3);
                 printf("(%3zu) compress %08x %08x\n", state->inlen, (uint32_t) (m >> 32), (uint32_t) m);
 #endif
-                state->v3 ^= m;
-                sipround(state);
-                sipround(state);
-                state->v0 ^= m;
+                sipcompress(state, m);
         }
 
         left = state->inlen & 7;
@@ -166,10 +178,7 @@ uint64_t siphash24_finalize(struct siphash *state) {
         printf("(%3zu) padding   %08x %08x\n", state->inlen, (uint32_t) (state->padding >> 32), (uint32_t) state->padding);
 #endif
 
-        state->v3 ^= b;
-        sipround(state);
-        sipround(state);
-        state->v0 ^= b;
+        sipcompress(state, b);
 
 #ifdef DEBUG
         printf("(%3zu) v0 %08x %08x\n", state->inlen, (uint32_t) (state->v0 >> 32), (uint32_t) state->v0);
@@ -182,7 +191,8 @@ uint64_t siphash24_finalize(struct siphash *state) {
         sipround(state);
         sipround(state);
         sipround(state);
-        sipround(state);
+        if (state->d_rounds > 3)
+                sipround(state);
 
         return state->v0 ^ state->v1 ^ state->v2  ^ state->v3;
 }
@@ -198,3 +208,15 @@ uint64_t siphash24(const void *in, size_t inlen, const uint8_t k[16]) {
 
         return siphash24_finalize(&state);
 }
+
+uint64_t siphash13(const void *in, size_t inlen, const uint8_t k[16]) {
+        struct siphash state;
+
+        assert(in);
+        assert(k);
+
+        siphash13_init(&state, k);
+        siphash24_compress(in, inlen, &state);
+
+        return siphash24_finalize(&state);
+}
@@ -12,12 +12,20 @@ struct siphash {
         uint64_t v3;
         uint64_t padding;
         size_t inlen;
+        unsigned c_rounds;
+        unsigned d_rounds;
 };
 
 void siphash24_init(struct siphash *state, const uint8_t k[16]);
+
+/* SipHash-1-3: the same construction with fewer rounds. Considerably cheaper for short inputs, but
+ * with a smaller security margin, hence only to be used where the input is not attacker-controlled.
+ * The state is fed and finalized with siphash24_compress() and siphash24_finalize() as usual. */
+void siphash13_init(struct siphash *state, const uint8_t k[16]);
 void siphash24_compress(const void *in, size_t inlen, struct siphash *state);
 #define siphash24_compress_byte(byte, state) siphash24_compress((const uint8_t[]) { (byte) }, 1, (state))
 
 uint64_t siphash24_finalize(struct siphash *state);
 
 uint64_t siphash24(const void *in, size_t inlen, const uint8_t k[16]);
+uint64_t siphash13(const void *in, size_t inlen, const uint8_t k[16]);
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "set.h"
+#include "string-pool.h"
+
+/* Each string is allocated together with its reference counter, directly in front of it. The set is
+ * keyed by the string itself. strbuf is not used here, as it can only grow and never release
+ * individual strings. */
+typedef struct PooledString {
+        unsigned n_ref;
+        char str[];
+} PooledString;
+
+struct StringPool {
+        Set *strings;
+};
+
+static PooledString *pooled_string(const char *s) {
+        return (PooledString*) ((uint8_t*) s - offsetof(PooledString, str));
+}
+
+StringPool *string_pool_new(void) {
+        StringPool *p;
+
+        p = new0(StringPool, 1);
+        if (!p)
+                return NULL;
+
+        p->strings = set_new(&string_hash_ops);
+        if (!p->strings)
+                return mfree(p);
+
+        return p;
+}
+
+StringPool *string_pool_free(StringPool *p) {
+        char *s;
+
+        if (!p)
+                return NULL;
+
+        /* Whatever is still referenced goes away with the pool */
+        while ((s = set_steal_first(p->strings)))
+                free(pooled_string(s));
+
+        set_free(p->strings);
+        return mfree(p);
+}
+
+int string_pool_intern(StringPool *p, const char *s, const char **ret) {
+        PooledString *e;
+        const char *found;
+        size_t l;
+        int r;
+
+        assert(p);
+        assert(s);
+        assert(ret);
+
+        found = set_get(p->strings, (char*) s);
+        if (found) {
+                pooled_string(found)->n_ref++;
+                *ret = found;
+                return 0;
+        }
+
+        l = strlen(s);
+        e = malloc(offsetof(PooledString, str) + l + 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->n_ref = 1;
+        memcpy(e->str, s, l + 1);
+
+        r = set_put(p->strings, e->str);
+        if (r < 0) {
+                free(e);
+                return r;
+        }
+
+        *ret = e->str;
+        return 1;
+}
+
+const char *string_pool_lookup(StringPool *p, const char *s) {
+        assert(p);
+        assert(s);
+
+        /* Returns the interned copy of s, if there is one, without taking a reference */
+        return set_get(p->strings, (char*) s);
+}
+
+const char *string_pool_ref(StringPool *p, const char *s) {
+        assert(p);
+
+        if (!s)
+                return NULL;
+
+        assert(pooled_string(s)->n_ref > 0);
+
+        pooled_string(s)->n_ref++;
+        return s;
+}
+
+const char *string_pool_unref(StringPool *p, const char *s) {
+        PooledString *e;
+
+        assert(p);
+
+        if (!s)
+                return NULL;
+
+        e = pooled_string(s);
+        assert(e->n_ref > 0);
+
+        e->n_ref--;
+        if (e->n_ref > 0)
+                return NULL;
+
+        set_remove(p->strings, (char*) s);
+        free(e);
+
+        return NULL;
+}
+
+size_t string_pool_size(StringPool *p) {
+        return p ? set_size(p->strings) : 0;
+}
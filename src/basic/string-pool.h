@@ -0,0 +1,41 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+#include "macro.h"
+
+/* A pool of refcounted, immutable strings. Interning the same string twice returns the same pointer,
+ * hence strings from the same pool may be compared by pointer, and maps with interned keys only may
+ * use trivial_hash_ops. The strings must only be released with string_pool_unref(), never with
+ * free(). Not thread-safe, like everything else around hashmaps. */
+
+typedef struct StringPool StringPool;
+
+StringPool *string_pool_new(void);
+StringPool *string_pool_free(StringPool *p);
+
+int string_pool_intern(StringPool *p, const char *s, const char **ret);
+const char *string_pool_lookup(StringPool *p, const char *s);
+const char *string_pool_ref(StringPool *p, const char *s);
+const char *string_pool_unref(StringPool *p, const char *s);
+
+size_t string_pool_size(StringPool *p);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(StringPool*, string_pool_free);
@@ -19,6 +19,8 @@
 ***/
 
 #include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include "sd-bus.h"
 
@@ -31,12 +33,15 @@
 #include "busctl-introspect.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "io-util.h"
+#include "list.h"
 #include "locale-util.h"
 #include "log.h"
 #include "pager.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "set.h"
+#include "socket-util.h"
 #include "strv.h"
 #include "terminal-util.h"
 #include "user-util.h"
@@ -54,6 +59,7 @@ static BusTransport arg_transport = BUS_TRANSPORT_LOCAL;
 static char *arg_host = NULL;
 static bool arg_user = false;
 static size_t arg_snaplen = 4096;
+static size_t arg_capture_buffer = 16U*1024U*1024U;
 static bool arg_list = false;
 static bool arg_quiet = false;
 static bool arg_verbose = false;
@@ -1068,14 +1074,248 @@ static int introspect(sd_bus *bus, char **argv) {
 }
 
 static int message_dump(sd_bus_message *m, FILE *f) {
-        return bus_message_dump(m, f, BUS_MESSAGE_DUMP_WITH_HEADER);
+        /* Don't stop monitoring because of a message we can't make sense of */
+        (void) bus_message_dump(m, f, BUS_MESSAGE_DUMP_WITH_HEADER);
+        return 0;
+}
+
+/* Captured frames are collected in chunks of this size, and each chunk is written out in one go by a separate
+ * thread, so that we can keep reading from the bus while the output is slow. */
+#define CAPTURE_CHUNK_SIZE (1024U*1024U)
+
+typedef struct CaptureChunk CaptureChunk;
+
+struct CaptureChunk {
+        LIST_FIELDS(CaptureChunk, chunks);
+        size_t size;
+        size_t allocated;
+        uint8_t data[];
+};
+
+typedef struct CaptureWriter {
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        /* Chunks waiting to be written, in order, and chunks that may be filled again */
+        LIST_HEAD(CaptureChunk, queued);
+        CaptureChunk *queued_tail;
+        LIST_HEAD(CaptureChunk, unused);
+
+        /* The chunk we are currently filling, only accessed from the main thread */
+        CaptureChunk *current;
+
+        size_t n_allocated;
+        size_t n_max;
+
+        int fd;
+        int error;
+        bool done;
+} CaptureWriter;
+
+static volatile sig_atomic_t monitor_quit = false;
+
+static void monitor_quit_handler(int sig) {
+        monitor_quit = true;
+}
+
+static CaptureWriter capture_writer = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .fd = -1,
+};
+
+static void *capture_writer_thread(void *userdata) {
+        CaptureWriter *w = userdata;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                CaptureChunk *c;
+                int r;
+
+                c = w->queued;
+                if (!c) {
+                        if (w->done)
+                                break;
+
+                        assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+                        continue;
+                }
+
+                LIST_REMOVE(chunks, w->queued, c);
+                if (w->queued_tail == c)
+                        w->queued_tail = NULL;
+
+                assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+                r = w->error < 0 ? 0 : loop_write(w->fd, c->data, c->size, false);
+                assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+                if (r < 0 && w->error >= 0)
+                        w->error = r;
+
+                if (c->allocated > CAPTURE_CHUNK_SIZE) {
+                        /* Oversized chunks for single large frames are not reused */
+                        free(c);
+                        w->n_allocated--;
+                } else {
+                        c->size = 0;
+                        LIST_PREPEND(chunks, w->unused, c);
+                }
+
+                assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return NULL;
+}
+
+static int capture_writer_start(CaptureWriter *w, int fd) {
+        sigset_t ss, saved_ss;
+        int r;
+
+        assert(w);
+        assert(fd >= 0);
+
+        w->fd = fd;
+        w->n_max = MAX(arg_capture_buffer / CAPTURE_CHUNK_SIZE, 2U);
+
+        /* Signals are for the main thread, which needs to write out what's buffered before exiting */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0);
+
+        r = pthread_create(&w->thread, NULL, capture_writer_thread, w);
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        if (r != 0)
+                return -r;
+
+        return 0;
+}
+
+static void capture_writer_submit(CaptureWriter *w) {
+        CaptureChunk *c;
+
+        assert(w);
+
+        c = w->current;
+        if (!c || c->size == 0)
+                return;
+
+        w->current = NULL;
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        LIST_INSERT_AFTER(chunks, w->queued, w->queued_tail, c);
+        w->queued_tail = c;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+}
+
+static int capture_writer_get_chunk(CaptureWriter *w, size_t size, CaptureChunk **ret) {
+        CaptureChunk *c = NULL;
+        int r;
+
+        assert(w);
+        assert(ret);
+
+        if (w->current && w->current->allocated - w->current->size >= size) {
+                *ret = w->current;
+                return 0;
+        }
+
+        capture_writer_submit(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+
+        for (;;) {
+                r = w->error;
+                if (r < 0)
+                        break;
+
+                if (size <= CAPTURE_CHUNK_SIZE && w->unused) {
+                        c = w->unused;
+                        LIST_REMOVE(chunks, w->unused, c);
+                        break;
+                }
+
+                if (w->n_allocated < w->n_max) {
+                        c = malloc(offsetof(CaptureChunk, data) + MAX(size, CAPTURE_CHUNK_SIZE));
+                        if (!c) {
+                                r = -ENOMEM;
+                                break;
+                        }
+
+                        c->size = 0;
+                        c->allocated = MAX(size, CAPTURE_CHUNK_SIZE);
+                        LIST_INIT(chunks, c);
+                        w->n_allocated++;
+                        break;
+                }
+
+                /* The buffer is full. Wait for the writer rather than losing frames. */
+                assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        if (r < 0)
+                return r;
+
+        w->current = *ret = c;
+        return 0;
+}
+
+static int capture_writer_stop(CaptureWriter *w) {
+        CaptureChunk *c;
+
+        assert(w);
+
+        capture_writer_submit(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        w->done = true;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        assert_se(pthread_join(w->thread, NULL) == 0);
+
+        free(w->current);
+        w->current = NULL;
+
+        while ((c = w->unused)) {
+                LIST_REMOVE(chunks, w->unused, c);
+                free(c);
+        }
+
+        return w->error;
 }
 
 static int message_pcap(sd_bus_message *m, FILE *f) {
-        return bus_message_pcap_frame(m, arg_snaplen, f);
+        CaptureChunk *c;
+        size_t size;
+        int r;
+
+        size = bus_message_pcap_frame_size(m, arg_snaplen);
+
+        r = capture_writer_get_chunk(&capture_writer, size, &c);
+        if (r < 0)
+                return r;
+
+        bus_message_pcap_frame_to_buffer(m, arg_snaplen, c->data + c->size);
+        c->size += size;
+
+        return 0;
 }
 
-static int monitor(sd_bus *bus, char *argv[], int (*dump)(sd_bus_message *m, FILE *f)) {
+static int message_pcap_idle(void) {
+        /* Nothing to read right now, let's write out what we have */
+        capture_writer_submit(&capture_writer);
+        return 0;
+}
+
+static int monitor(sd_bus *bus, char *argv[], int (*dump)(sd_bus_message *m, FILE *f), int (*idle)(void)) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *message = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char **i;
@@ -1148,6 +1388,11 @@ static int monitor(sd_bus *bus, char *argv[], int (*dump)(sd_bus_message *m, FIL
         for (;;) {
                 _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
 
+                if (monitor_quit) {
+                        log_info("Interrupted, exiting.");
+                        return 0;
+                }
+
                 r = sd_bus_process(bus, &m);
                 if (r < 0)
                         return log_error_errno(r, "Failed to process bus: %m");
@@ -1170,7 +1415,9 @@ static int monitor(sd_bus *bus, char *argv[], int (*dump)(sd_bus_message *m, FIL
                 }
 
                 if (m) {
-                        dump(m, stdout);
+                        r = dump(m, stdout);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to write message: %m");
                         fflush(stdout);
 
                         if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected") > 0) {
@@ -1184,14 +1431,25 @@ static int monitor(sd_bus *bus, char *argv[], int (*dump)(sd_bus_message *m, FIL
                 if (r > 0)
                         continue;
 
+                if (idle) {
+                        r = idle();
+                        if (r < 0)
+                                return r;
+                }
+
                 r = sd_bus_wait(bus, (uint64_t) -1);
+                if (r == -EINTR)
+                        continue;
                 if (r < 0)
                         return log_error_errno(r, "Failed to wait for bus: %m");
         }
 }
 
 static int capture(sd_bus *bus, char *argv[]) {
-        int r;
+        static const struct sigaction sa = {
+                .sa_handler = monitor_quit_handler,
+        };
+        int r, q;
 
         if (isatty(fileno(stdout)) > 0) {
                 log_error("Refusing to write message data to console, please redirect output to a file.");
@@ -1200,13 +1458,28 @@ static int capture(sd_bus *bus, char *argv[]) {
 
         bus_pcap_header(arg_snaplen, stdout);
 
-        r = monitor(bus, argv, message_pcap);
+        /* We must keep up with the bus, or we'll be disconnected as a slow monitor. A large receive buffer helps
+         * us with bursts, the writer thread with slow output. */
+        r = sd_bus_get_fd(bus);
+        if (r >= 0)
+                (void) fd_inc_rcvbuf(r, arg_capture_buffer);
+
+        r = capture_writer_start(&capture_writer, fileno(stdout));
         if (r < 0)
-                return r;
+                return log_error_errno(r, "Failed to start writer thread: %m");
+
+        /* Stop cleanly on SIGINT/SIGTERM, so that the buffered messages make it into the capture file */
+        (void) sigaction(SIGINT, &sa, NULL);
+        (void) sigaction(SIGTERM, &sa, NULL);
 
-        if (ferror(stdout)) {
-                log_error("Couldn't write capture file.");
-                return -EIO;
+        r = monitor(bus, argv, message_pcap, message_pcap_idle);
+
+        q = capture_writer_stop(&capture_writer);
+        if (r < 0)
+                return r;
+        if (q < 0 || ferror(stdout)) {
+                log_error_errno(q, "Couldn't write capture file: %m");
+                return q < 0 ? q : -EIO;
         }
 
         return r;
@@ -1732,6 +2005,8 @@ static int help(void) {
                "     --activatable        Only show activatable names\n"
                "     --match=MATCH        Only show matching messages\n"
                "     --size=SIZE          Maximum length of captured packet\n"
+               "     --capture-buffer=SIZE\n"
+               "                          Memory to buffer captured packets in\n"
                "     --list               Don't show tree, but simple object path list\n"
                "  -q --quiet              Don't show method call reply\n"
                "     --verbose            Show result values in long format\n"
@@ -1775,6 +2050,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_ACQUIRED,
                 ARG_ACTIVATABLE,
                 ARG_SIZE,
+                ARG_CAPTURE_BUFFER,
                 ARG_LIST,
                 ARG_VERBOSE,
                 ARG_EXPECT_REPLY,
@@ -1800,6 +2076,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "host",         required_argument, NULL, 'H'              },
                 { "machine",      required_argument, NULL, 'M'              },
                 { "size",         required_argument, NULL, ARG_SIZE         },
+                { "capture-buffer", required_argument, NULL, ARG_CAPTURE_BUFFER },
                 { "list",         no_argument,       NULL, ARG_LIST         },
                 { "quiet",        no_argument,       NULL, 'q'              },
                 { "verbose",      no_argument,       NULL, ARG_VERBOSE      },
@@ -1885,6 +2162,24 @@ static int parse_argv(int argc, char *argv[]) {
                         break;
                 }
 
+                case ARG_CAPTURE_BUFFER: {
+                        uint64_t sz;
+
+                        r = parse_size(optarg, 1024, &sz);
+                        if (r < 0) {
+                                log_error("Failed to parse capture buffer size: %s", optarg);
+                                return r;
+                        }
+
+                        if ((uint64_t) (size_t) sz != sz) {
+                                log_error("Capture buffer size out of range.");
+                                return -E2BIG;
+                        }
+
+                        arg_capture_buffer = (size_t) sz;
+                        break;
+                }
+
                 case ARG_LIST:
                         arg_list = true;
                         break;
@@ -1976,7 +2271,7 @@ static int busctl_main(sd_bus *bus, int argc, char *argv[]) {
                 return list_bus_names(bus, argv + optind);
 
         if (streq(argv[optind], "monitor"))
-                return monitor(bus, argv + optind, message_dump);
+                return monitor(bus, argv + optind, message_dump, NULL);
 
         if (streq(argv[optind], "capture"))
                 return capture(bus, argv + optind);
@@ -418,6 +418,10 @@ static int refresh_one(
         if (r < 0)
                 return r;
 
+        /* Children of the deepest level we show would be skipped right away, don't even enumerate them */
+        if (depth >= arg_depth)
+                goto finish;
+
         r = cg_enumerate_subgroups(controller, path, &d);
         if (r == -ENOENT)
                 return 0;
@@ -461,6 +465,7 @@ static int refresh_one(
                 }
         }
 
+finish:
         if (ret)
                 *ret = ours;
 
@@ -468,31 +473,44 @@ static int refresh_one(
 }
 
 static int refresh(const char *root, Hashmap *a, Hashmap *b, unsigned iteration) {
-        int r;
+        int r, all_unified;
 
         assert(a);
 
+        all_unified = cg_all_unified();
+        if (all_unified < 0)
+                return all_unified;
+
+        /* On the unified hierarchy all controllers share the same tree, hence walking it for a controller process()
+         * reads nothing for only costs time. */
+
         r = refresh_one(SYSTEMD_CGROUP_CONTROLLER, root, a, b, iteration, 0, NULL);
         if (r < 0)
                 return r;
         r = refresh_one("cpu", root, a, b, iteration, 0, NULL);
         if (r < 0)
                 return r;
-        r = refresh_one("cpuacct", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
+        if (!all_unified) {
+                r = refresh_one("cpuacct", root, a, b, iteration, 0, NULL);
+                if (r < 0)
+                        return r;
+        }
         r = refresh_one("memory", root, a, b, iteration, 0, NULL);
         if (r < 0)
                 return r;
         r = refresh_one("io", root, a, b, iteration, 0, NULL);
         if (r < 0)
                 return r;
-        r = refresh_one("blkio", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
-        r = refresh_one("pids", root, a, b, iteration, 0, NULL);
-        if (r < 0)
-                return r;
+        if (!all_unified) {
+                r = refresh_one("blkio", root, a, b, iteration, 0, NULL);
+                if (r < 0)
+                        return r;
+        }
+        if (!all_unified || arg_count == COUNT_PIDS) {
+                r = refresh_one("pids", root, a, b, iteration, 0, NULL);
+                if (r < 0)
+                        return r;
+        }
 
         return 0;
 }
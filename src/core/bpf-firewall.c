@@ -37,7 +37,11 @@
 #include "bpf-firewall.h"
 #include "bpf-program.h"
 #include "fd-util.h"
+#include "hashmap.h"
+#include "in-addr-util.h"
 #include "ip-address-access.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "unit.h"
 
 enum {
@@ -50,6 +54,23 @@ enum {
         ACCESS_DENIED  = 2,
 };
 
+struct BPFFirewallPolicy {
+        unsigned n_ref;
+        Manager *manager;
+
+        /* The combined allow and deny lists of the unit and its slices, in textual form */
+        char *key;
+
+        int ipv4_allow_map_fd;
+        int ipv6_allow_map_fd;
+        int ipv4_deny_map_fd;
+        int ipv6_deny_map_fd;
+
+        /* The programs for units without IP accounting, which only reference the access maps above */
+        BPFProgram *ingress;
+        BPFProgram *egress;
+};
+
 /* Compile instructions for one list of addresses, one direction and one specific verdict on matches. */
 
 static int add_lookup_instructions(
@@ -141,7 +162,8 @@ static int add_lookup_instructions(
 }
 
 static int bpf_firewall_compile_bpf(
-                Unit *u,
+                BPFFirewallPolicy *policy,
+                int accounting_map_fd,
                 bool is_ingress,
                 BPFProgram **ret) {
 
@@ -188,21 +210,16 @@ static int bpf_firewall_compile_bpf(
         };
 
         _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
-        int accounting_map_fd, r;
         bool access_enabled;
+        int r;
 
-        assert(u);
         assert(ret);
 
-        accounting_map_fd = is_ingress ?
-                u->ip_accounting_ingress_map_fd :
-                u->ip_accounting_egress_map_fd;
-
-        access_enabled =
-                u->ipv4_allow_map_fd >= 0 ||
-                u->ipv6_allow_map_fd >= 0 ||
-                u->ipv4_deny_map_fd >= 0 ||
-                u->ipv6_deny_map_fd >= 0;
+        access_enabled = policy && (
+                policy->ipv4_allow_map_fd >= 0 ||
+                policy->ipv6_allow_map_fd >= 0 ||
+                policy->ipv4_deny_map_fd >= 0 ||
+                policy->ipv6_deny_map_fd >= 0);
 
         if (accounting_map_fd < 0 && !access_enabled) {
                 *ret = NULL;
@@ -226,26 +243,26 @@ static int bpf_firewall_compile_bpf(
                  * - Otherwise, access will be granted
                  */
 
-                if (u->ipv4_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
+                if (policy->ipv4_deny_map_fd >= 0) {
+                        r = add_lookup_instructions(p, policy->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
+                if (policy->ipv6_deny_map_fd >= 0) {
+                        r = add_lookup_instructions(p, policy->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv4_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
+                if (policy->ipv4_allow_map_fd >= 0) {
+                        r = add_lookup_instructions(p, policy->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
+                if (policy->ipv6_allow_map_fd >= 0) {
+                        r = add_lookup_instructions(p, policy->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
@@ -484,6 +501,197 @@ static int bpf_firewall_prepare_accounting_maps(bool enabled, int *fd_ingress, i
         return 0;
 }
 
+BPFFirewallPolicy *bpf_firewall_policy_unref(BPFFirewallPolicy *p) {
+        if (!p)
+                return NULL;
+
+        assert(p->n_ref > 0);
+        p->n_ref--;
+
+        if (p->n_ref > 0)
+                return NULL;
+
+        if (p->key)
+                (void) hashmap_remove_value(p->manager->bpf_firewall_policies, p->key, p);
+
+        safe_close(p->ipv4_allow_map_fd);
+        safe_close(p->ipv6_allow_map_fd);
+        safe_close(p->ipv4_deny_map_fd);
+        safe_close(p->ipv6_deny_map_fd);
+
+        bpf_program_unref(p->ingress);
+        bpf_program_unref(p->egress);
+
+        free(p->key);
+        return mfree(p);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BPFFirewallPolicy*, bpf_firewall_policy_unref);
+
+static int bpf_firewall_policy_key_append(char **key, const char *prefix, IPAddressAccessItem *list) {
+        IPAddressAccessItem *a;
+        int r;
+
+        assert(key);
+        assert(prefix);
+
+        LIST_FOREACH(items, a, list) {
+                _cleanup_free_ char *s = NULL;
+                char prefixlen[DECIMAL_STR_MAX(unsigned)];
+
+                r = in_addr_to_string(a->family, &a->address, &s);
+                if (r < 0)
+                        return r;
+
+                xsprintf(prefixlen, "%u", a->prefixlen);
+
+                if (!strextend(key, prefix, s, "/", prefixlen, " ", NULL))
+                        return -ENOMEM;
+        }
+
+        return 0;
+}
+
+static int bpf_firewall_policy_key(Unit *u, char **ret) {
+        _cleanup_free_ char *key = NULL;
+        Unit *p;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        /* Serializes the access lists of the unit and all its slices in the same order
+         * bpf_firewall_prepare_access_maps() adds them to the maps, so that units with the same key end up with
+         * maps of identical contents. */
+
+        key = strdup("");
+        if (!key)
+                return -ENOMEM;
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                r = bpf_firewall_policy_key_append(&key, "allow:", cc->ip_address_allow);
+                if (r < 0)
+                        return r;
+        }
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                r = bpf_firewall_policy_key_append(&key, "deny:", cc->ip_address_deny);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = key;
+        key = NULL;
+
+        return 0;
+}
+
+static int bpf_firewall_policy_get(Unit *u, BPFFirewallPolicy **ret) {
+        _cleanup_(bpf_firewall_policy_unrefp) BPFFirewallPolicy *policy = NULL;
+        _cleanup_free_ char *key = NULL;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        r = bpf_firewall_policy_key(u, &key);
+        if (r < 0)
+                return r;
+
+        /* No access lists configured, nothing to share */
+        if (isempty(key)) {
+                *ret = NULL;
+                return 0;
+        }
+
+        policy = hashmap_get(u->manager->bpf_firewall_policies, key);
+        if (policy) {
+                policy->n_ref++;
+
+                *ret = policy;
+                policy = NULL;
+
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&u->manager->bpf_firewall_policies, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        policy = new0(BPFFirewallPolicy, 1);
+        if (!policy)
+                return -ENOMEM;
+
+        policy->n_ref = 1;
+        policy->manager = u->manager;
+        policy->ipv4_allow_map_fd = policy->ipv6_allow_map_fd = -1;
+        policy->ipv4_deny_map_fd = policy->ipv6_deny_map_fd = -1;
+
+        r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &policy->ipv4_allow_map_fd, &policy->ipv6_allow_map_fd);
+        if (r < 0)
+                return r;
+
+        r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &policy->ipv4_deny_map_fd, &policy->ipv6_deny_map_fd);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(u->manager->bpf_firewall_policies, key, policy);
+        if (r < 0)
+                return r;
+
+        policy->key = key;
+        key = NULL;
+
+        *ret = policy;
+        policy = NULL;
+
+        return 0;
+}
+
+static int bpf_firewall_get_program(Unit *u, bool ip_accounting, bool is_ingress, BPFProgram **ret) {
+        BPFFirewallPolicy *policy;
+        BPFProgram **shared;
+        int r;
+
+        assert(u);
+        assert(ret);
+
+        policy = u->ip_bpf_policy;
+
+        if (ip_accounting || !policy)
+                return bpf_firewall_compile_bpf(
+                                policy,
+                                is_ingress ? u->ip_accounting_ingress_map_fd : u->ip_accounting_egress_map_fd,
+                                is_ingress,
+                                ret);
+
+        /* Without accounting the program references nothing but the shared access maps, hence all units with the
+         * same access lists can use the very same program, and it only needs to be verified and uploaded into the
+         * kernel once. */
+
+        shared = is_ingress ? &policy->ingress : &policy->egress;
+        if (!*shared) {
+                r = bpf_firewall_compile_bpf(policy, -1, is_ingress, shared);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = bpf_program_ref(*shared);
+        return 0;
+}
+
 int bpf_firewall_compile(Unit *u) {
         CGroupContext *cc;
         int r;
@@ -500,38 +708,31 @@ int bpf_firewall_compile(Unit *u) {
 
         /* Note that when we compile a new firewall we first flush out the access maps and the BPF programs themselves,
          * but we reuse the the accounting maps. That way the firewall in effect always maps to the actual
-         * configuration, but we don't flush out the accounting unnecessarily */
+         * configuration, but we don't flush out the accounting unnecessarily. The access maps are shared between all
+         * units with the same access lists, and are only really released once the last of them lets go of them. */
 
         u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
         u->ip_bpf_egress = bpf_program_unref(u->ip_bpf_egress);
 
-        u->ipv4_allow_map_fd = safe_close(u->ipv4_allow_map_fd);
-        u->ipv4_deny_map_fd = safe_close(u->ipv4_deny_map_fd);
-
-        u->ipv6_allow_map_fd = safe_close(u->ipv6_allow_map_fd);
-        u->ipv6_deny_map_fd = safe_close(u->ipv6_deny_map_fd);
+        u->ip_bpf_policy = bpf_firewall_policy_unref(u->ip_bpf_policy);
 
         cc = unit_get_cgroup_context(u);
         if (!cc)
                 return -EINVAL;
 
-        r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &u->ipv4_allow_map_fd, &u->ipv6_allow_map_fd);
+        r = bpf_firewall_policy_get(u, &u->ip_bpf_policy);
         if (r < 0)
-                return log_error_errno(r, "Preparation of eBPF allow maps failed: %m");
-
-        r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &u->ipv4_deny_map_fd, &u->ipv6_deny_map_fd);
-        if (r < 0)
-                return log_error_errno(r, "Preparation of eBPF deny maps failed: %m");
+                return log_error_errno(r, "Preparation of eBPF access maps failed: %m");
 
         r = bpf_firewall_prepare_accounting_maps(cc->ip_accounting, &u->ip_accounting_ingress_map_fd, &u->ip_accounting_egress_map_fd);
         if (r < 0)
                 return log_error_errno(r, "Preparation of eBPF accounting maps failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, true, &u->ip_bpf_ingress);
+        r = bpf_firewall_get_program(u, cc->ip_accounting, true, &u->ip_bpf_ingress);
         if (r < 0)
                 return log_error_errno(r, "Compilation for ingress BPF program failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, false, &u->ip_bpf_egress);
+        r = bpf_firewall_get_program(u, cc->ip_accounting, false, &u->ip_bpf_egress);
         if (r < 0)
                 return log_error_errno(r, "Compilation for egress BPF program failed: %m");
 
@@ -565,9 +766,12 @@ int bpf_firewall_install(Unit *u) {
                 return log_error_errno(r, "Failed to determine cgroup path: %m");
 
         if (u->ip_bpf_egress) {
-                r = bpf_program_load_kernel(u->ip_bpf_egress, NULL, 0);
-                if (r < 0)
-                        return log_error_errno(r, "Kernel upload of egress BPF program failed: %m");
+                /* Programs shared with other units might have been uploaded already */
+                if (u->ip_bpf_egress->kernel_fd < 0) {
+                        r = bpf_program_load_kernel(u->ip_bpf_egress, NULL, 0);
+                        if (r < 0)
+                                return log_error_errno(r, "Kernel upload of egress BPF program failed: %m");
+                }
 
                 r = bpf_program_cgroup_attach(u->ip_bpf_egress, BPF_CGROUP_INET_EGRESS, path, cc->delegate ? BPF_F_ALLOW_OVERRIDE : 0);
                 if (r < 0)
@@ -580,9 +784,12 @@ int bpf_firewall_install(Unit *u) {
         }
 
         if (u->ip_bpf_ingress) {
-                r = bpf_program_load_kernel(u->ip_bpf_ingress, NULL, 0);
-                if (r < 0)
-                        return log_error_errno(r, "Kernel upload of ingress BPF program failed: %m");
+                /* Programs shared with other units might have been uploaded already */
+                if (u->ip_bpf_ingress->kernel_fd < 0) {
+                        r = bpf_program_load_kernel(u->ip_bpf_ingress, NULL, 0);
+                        if (r < 0)
+                                return log_error_errno(r, "Kernel upload of ingress BPF program failed: %m");
+                }
 
                 r = bpf_program_cgroup_attach(u->ip_bpf_ingress, BPF_CGROUP_INET_INGRESS, path, cc->delegate ? BPF_F_ALLOW_OVERRIDE : 0);
                 if (r < 0)
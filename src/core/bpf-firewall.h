@@ -26,6 +26,8 @@
 
 int bpf_firewall_supported(void);
 
+BPFFirewallPolicy *bpf_firewall_policy_unref(BPFFirewallPolicy *p);
+
 int bpf_firewall_compile(Unit *u);
 int bpf_firewall_install(Unit *u);
 
@@ -1549,7 +1549,7 @@ static void unit_remove_from_cgroup_realize_queue(Unit *u) {
  *
  * Returns 0 on success and < 0 on failure. */
 static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
-        CGroupMask target_mask, enable_mask;
+        CGroupMask target_mask, enable_mask, apply_mask;
         bool needs_bpf, apply_bpf;
         int r;
 
@@ -1569,6 +1569,10 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
          * this will trickle down properly to cgroupfs. */
         apply_bpf = needs_bpf || u->cgroup_bpf_state != UNIT_CGROUP_BPF_OFF;
 
+        /* Only the attributes of controllers that are not realized yet need to be written, the others are still in
+         * place from the last time. If the cgroup isn't realized at all, everything needs to be written. */
+        apply_mask = u->cgroup_realized ? target_mask & ~u->cgroup_realized_mask : target_mask;
+
         /* First, realize parents */
         if (UNIT_ISSET(u->slice)) {
                 r = unit_realize_cgroup_now(UNIT_DEREF(u->slice), state);
@@ -1582,7 +1586,7 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
                 return r;
 
         /* Finally, apply the necessary attributes. */
-        cgroup_context_apply(u, target_mask, apply_bpf, state);
+        cgroup_context_apply(u, apply_mask, apply_bpf, state);
         cgroup_xattr_apply(u);
 
         return 0;
@@ -1688,6 +1692,8 @@ void unit_release_cgroup(Unit *u) {
 
         /* Forgets all cgroup details for this cgroup */
 
+        u->memory_current_timestamp = u->tasks_current_timestamp = 0;
+
         if (u->cgroup_path) {
                 (void) hashmap_remove(u->manager->cgroup_unit, u->cgroup_path);
                 u->cgroup_path = mfree(u->cgroup_path);
@@ -1870,6 +1876,17 @@ static int on_cgroup_empty_event(sd_event_source *s, void *userdata) {
                         log_debug_errno(r, "Failed to reenable cgroup empty event source: %m");
         }
 
+        /* Let's verify that the cgroup is really empty */
+        if (!u->cgroup_path)
+                return 0;
+        r = cg_is_empty_recursive(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path);
+        if (r < 0) {
+                log_unit_debug_errno(u, r, "Failed to determine whether cgroup %s is empty: %m", u->cgroup_path);
+                return 0;
+        }
+        if (r == 0)
+                return 0;
+
         unit_add_to_gc_queue(u);
 
         if (UNIT_VTABLE(u)->notify_cgroup_empty)
@@ -1894,25 +1911,18 @@ void unit_add_to_cgroup_empty_queue(Unit *u) {
          * 4. On the legacy hierarchy, in service units we start watching all processes of the cgroup for SIGCHLD as
          *    soon as we get one SIGCHLD, to deal with unreliable cgroup notifications.
          *
-         * Regardless which way we got the notification, we'll verify it here, and then add it to a separate
-         * queue. This queue will be dispatched at a lower priority than the SIGCHLD handler, so that we always use
-         * SIGCHLD if we can get it first, and only use the cgroup empty notifications if there's no SIGCHLD pending
-         * (which might happen if the cgroup doesn't contain processes that are our own child, which is typically the
-         * case for scope units). */
+         * Regardless which way we got the notification, we'll add it to a separate queue, and verify it when it is
+         * dispatched. This queue will be dispatched at a lower priority than the SIGCHLD handler, so that we always
+         * use SIGCHLD if we can get it first, and only use the cgroup empty notifications if there's no SIGCHLD
+         * pending (which might happen if the cgroup doesn't contain processes that are our own child, which is
+         * typically the case for scope units). Verifying only at dispatch time means a burst of notifications for the
+         * same cgroup results in a single check, done when the state has settled. */
 
         if (u->in_cgroup_empty_queue)
                 return;
 
-        /* Let's verify that the cgroup is really empty */
         if (!u->cgroup_path)
                 return;
-        r = cg_is_empty_recursive(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path);
-        if (r < 0) {
-                log_unit_debug_errno(u, r, "Failed to determine whether cgroup %s is empty: %m", u->cgroup_path);
-                return;
-        }
-        if (r == 0)
-                return;
 
         LIST_PREPEND(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
         u->in_cgroup_empty_queue = true;
@@ -2214,6 +2224,30 @@ int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
         return 1;
 }
 
+static bool unit_accounting_is_final(Unit *u) {
+        assert(u);
+
+        /* Once a unit is dead its counters don't move anymore, hence the values snapshotted when it stopped may be
+         * returned from then on, until it is started again and the counters are reset. */
+
+        return UNIT_IS_INACTIVE_OR_FAILED(unit_active_state(u));
+}
+
+static bool unit_accounting_cache_is_fresh(Unit *u, usec_t timestamp) {
+        usec_t window;
+
+        assert(u);
+
+        /* Checks whether a counter read at the specified time may still be returned instead of reading it anew, see
+         * AccountingCacheSec= */
+
+        window = u->manager->accounting_cache_usec;
+        if (window <= 0 || timestamp <= 0)
+                return false;
+
+        return now(CLOCK_MONOTONIC) < usec_add(timestamp, window);
+}
+
 int unit_get_memory_current(Unit *u, uint64_t *ret) {
         _cleanup_free_ char *v = NULL;
         int r;
@@ -2230,6 +2264,11 @@ int unit_get_memory_current(Unit *u, uint64_t *ret) {
         if ((u->cgroup_realized_mask & CGROUP_MASK_MEMORY) == 0)
                 return -ENODATA;
 
+        if (unit_accounting_cache_is_fresh(u, u->memory_current_timestamp)) {
+                *ret = u->memory_current_cached;
+                return 0;
+        }
+
         r = cg_all_unified();
         if (r < 0)
                 return r;
@@ -2242,7 +2281,13 @@ int unit_get_memory_current(Unit *u, uint64_t *ret) {
         if (r < 0)
                 return r;
 
-        return safe_atou64(v, ret);
+        r = safe_atou64(v, ret);
+        if (r < 0)
+                return r;
+
+        u->memory_current_cached = *ret;
+        u->memory_current_timestamp = now(CLOCK_MONOTONIC);
+        return 0;
 }
 
 int unit_get_tasks_current(Unit *u, uint64_t *ret) {
@@ -2261,13 +2306,24 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret) {
         if ((u->cgroup_realized_mask & CGROUP_MASK_PIDS) == 0)
                 return -ENODATA;
 
+        if (unit_accounting_cache_is_fresh(u, u->tasks_current_timestamp)) {
+                *ret = u->tasks_current_cached;
+                return 0;
+        }
+
         r = cg_get_attribute("pids", u->cgroup_path, "pids.current", &v);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
                 return r;
 
-        return safe_atou64(v, ret);
+        r = safe_atou64(v, ret);
+        if (r < 0)
+                return r;
+
+        u->tasks_current_cached = *ret;
+        u->tasks_current_timestamp = now(CLOCK_MONOTONIC);
+        return 0;
 }
 
 static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
@@ -2328,11 +2384,18 @@ int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
 
         /* Retrieve the current CPU usage counter. This will subtract the CPU counter taken when the unit was
          * started. If the cgroup has been removed already, returns the last cached value. To cache the value, simply
-         * call this function with a NULL return value. */
+         * call this function with a NULL return value, which always reads the counter anew. */
 
         if (!UNIT_CGROUP_BOOL(u, cpu_accounting))
                 return -ENODATA;
 
+        if (ret &&
+            u->cpu_usage_last != NSEC_INFINITY &&
+            (unit_accounting_cache_is_fresh(u, u->cpu_usage_timestamp) || unit_accounting_is_final(u))) {
+                *ret = u->cpu_usage_last;
+                return 0;
+        }
+
         r = unit_get_cpu_usage_raw(u, &ns);
         if (r == -ENODATA && u->cpu_usage_last != NSEC_INFINITY) {
                 /* If we can't get the CPU usage anymore (because the cgroup was already removed, for example), use our
@@ -2351,6 +2414,7 @@ int unit_get_cpu_usage(Unit *u, nsec_t *ret) {
                 ns = 0;
 
         u->cpu_usage_last = ns;
+        u->cpu_usage_timestamp = now(CLOCK_MONOTONIC);
         if (ret)
                 *ret = ns;
 
@@ -2380,6 +2444,11 @@ int unit_get_ip_accounting(
         if (!UNIT_CGROUP_BOOL(u, ip_accounting))
                 return -ENODATA;
 
+        if (u->ip_accounting_last[metric] != UINT64_MAX && unit_accounting_is_final(u)) {
+                *ret = u->ip_accounting_last[metric];
+                return 0;
+        }
+
         fd = IN_SET(metric, CGROUP_IP_INGRESS_BYTES, CGROUP_IP_INGRESS_PACKETS) ?
                 u->ip_accounting_ingress_map_fd :
                 u->ip_accounting_egress_map_fd;
@@ -2397,11 +2466,49 @@ int unit_get_ip_accounting(
          * all BPF programs and maps anew, but serialize the old counters. When deserializing we store them in the
          * ip_accounting_extra[] field, and add them in here transparently. */
 
-        *ret = value + u->ip_accounting_extra[metric];
+        *ret = u->ip_accounting_last[metric] = value + u->ip_accounting_extra[metric];
 
         return r;
 }
 
+static void unit_snapshot_ip_accounting(Unit *u) {
+        struct {
+                int fd;
+                CGroupIPAccountingMetric bytes, packets;
+        } directions[] = {
+                { u->ip_accounting_ingress_map_fd, CGROUP_IP_INGRESS_BYTES, CGROUP_IP_INGRESS_PACKETS },
+                { u->ip_accounting_egress_map_fd,  CGROUP_IP_EGRESS_BYTES,  CGROUP_IP_EGRESS_PACKETS  },
+        };
+        size_t i;
+
+        if (u->type == UNIT_SLICE || !UNIT_CGROUP_BOOL(u, ip_accounting))
+                return;
+
+        for (i = 0; i < ELEMENTSOF(directions); i++) {
+                uint64_t bytes, packets;
+
+                if (directions[i].fd < 0)
+                        continue;
+
+                /* Get both counters of the map in one go */
+                if (bpf_firewall_read_accounting(directions[i].fd, &bytes, &packets) < 0)
+                        continue;
+
+                u->ip_accounting_last[directions[i].bytes] = bytes + u->ip_accounting_extra[directions[i].bytes];
+                u->ip_accounting_last[directions[i].packets] = packets + u->ip_accounting_extra[directions[i].packets];
+        }
+}
+
+void unit_snapshot_resources(Unit *u) {
+        assert(u);
+
+        /* Reads all counters of the unit once, and caches them. Called when the unit stops, so that the values can be
+         * logged and later be queried via the bus, without touching the cgroup or the BPF maps again. */
+
+        (void) unit_get_cpu_usage(u, NULL);
+        unit_snapshot_ip_accounting(u);
+}
+
 int unit_reset_cpu_accounting(Unit *u) {
         nsec_t ns;
         int r;
@@ -2432,6 +2539,7 @@ int unit_reset_ip_accounting(Unit *u) {
                 q = bpf_firewall_reset_accounting(u->ip_accounting_egress_map_fd);
 
         zero(u->ip_accounting_extra);
+        memset(u->ip_accounting_last, 0xFF, sizeof(u->ip_accounting_last));
 
         return r < 0 ? r : q;
 }
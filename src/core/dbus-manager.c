@@ -1093,6 +1093,22 @@ static int method_reset_failed(sd_bus_message *message, void *userdata, sd_bus_e
         return sd_bus_reply_method_return(message, NULL);
 }
 
+static bool unit_matches_filter(Unit *u, char **states, char **patterns) {
+        assert(u);
+
+        if (!strv_isempty(states) &&
+            !strv_contains(states, unit_load_state_to_string(u->load_state)) &&
+            !strv_contains(states, unit_active_state_to_string(unit_active_state(u))) &&
+            !strv_contains(states, unit_sub_state_to_string(u)))
+                return false;
+
+        if (!strv_isempty(patterns) &&
+            !strv_fnmatch_or_empty(patterns, u->id, FNM_NOESCAPE))
+                return false;
+
+        return true;
+}
+
 static int list_units_filtered(sd_bus_message *message, void *userdata, sd_bus_error *error, char **states, char **patterns) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1122,14 +1138,7 @@ static int list_units_filtered(sd_bus_message *message, void *userdata, sd_bus_e
                 if (k != u->id)
                         continue;
 
-                if (!strv_isempty(states) &&
-                    !strv_contains(states, unit_load_state_to_string(u->load_state)) &&
-                    !strv_contains(states, unit_active_state_to_string(unit_active_state(u))) &&
-                    !strv_contains(states, unit_sub_state_to_string(u)))
-                        continue;
-
-                if (!strv_isempty(patterns) &&
-                    !strv_fnmatch_or_empty(patterns, u->id, FNM_NOESCAPE))
+                if (!unit_matches_filter(u, states, patterns))
                         continue;
 
                 r = reply_unit_info(reply, u);
@@ -1175,6 +1184,103 @@ static int method_list_units_by_patterns(sd_bus_message *message, void *userdata
         return list_units_filtered(message, userdata, error, states, patterns);
 }
 
+static int unit_compare_by_type_and_name(const void *a, const void *b) {
+        Unit * const *x = a, * const *y = b;
+        const char *d1, *d2;
+        int r;
+
+        /* Same order "systemctl" shows units in: by type suffix first, then by name */
+        d1 = strrchr((*x)->id, '.');
+        d2 = strrchr((*y)->id, '.');
+        if (d1 && d2) {
+                r = strcasecmp(d1, d2);
+                if (r != 0)
+                        return r;
+        }
+
+        return strcasecmp((*x)->id, (*y)->id);
+}
+
+static int method_get_unit_properties_by_patterns(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **states = NULL, **patterns = NULL, **properties = NULL;
+        _cleanup_free_ Unit **units = NULL;
+        size_t n = 0, allocated = 0, j;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = sd_bus_message_read_strv(message, &states);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &patterns);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(message, &properties);
+        if (r < 0)
+                return r;
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                if (k != u->id)
+                        continue;
+
+                if (!unit_matches_filter(u, states, patterns))
+                        continue;
+
+                if (!GREEDY_REALLOC(units, allocated, n + 1))
+                        return -ENOMEM;
+
+                units[n++] = u;
+        }
+
+        qsort_safe(units, n, sizeof(Unit*), unit_compare_by_type_and_name);
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sa{sv})");
+        if (r < 0)
+                return r;
+
+        for (j = 0; j < n; j++) {
+                r = sd_bus_message_open_container(reply, 'r', "sa{sv}");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", units[j]->id);
+                if (r < 0)
+                        return r;
+
+                r = bus_unit_append_properties(sd_bus_message_get_bus(message), reply, units[j], properties, error);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_list_jobs(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1308,6 +1414,44 @@ static int method_dump(sd_bus_message *message, void *userdata, sd_bus_error *er
         return sd_bus_reply_method_return(message, "s", dump);
 }
 
+static uint64_t metric_units_loaded(void *userdata) {
+        Manager *m = userdata;
+
+        return hashmap_size(m->units);
+}
+
+static uint64_t metric_jobs_queued(void *userdata) {
+        Manager *m = userdata;
+
+        return hashmap_size(m->jobs);
+}
+
+static const MetricDescriptor manager_metrics[] = {
+        METRIC_FUNC("units.loaded", METRIC_GAUGE, metric_units_loaded),
+        METRIC_FUNC("jobs.queued", METRIC_GAUGE, metric_jobs_queued),
+        METRIC_FIELD("jobs.running", METRIC_GAUGE, Manager, n_running_jobs),
+        METRIC_FIELD("jobs.installed", METRIC_COUNTER, Manager, n_installed_jobs),
+        METRIC_FIELD("jobs.failed", METRIC_COUNTER, Manager, n_failed_jobs),
+        METRIC_HISTOGRAM_FIELD("jobs.duration_usec", Manager, job_duration_usec),
+        METRIC_END
+};
+
+static int method_get_metrics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        Manager *m = userdata;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        return bus_reply_metrics(message, manager_metrics, m);
+}
+
 static int method_refuse_snapshot(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         return sd_bus_error_setf(error, SD_BUS_ERROR_NOT_SUPPORTED, "Support for snapshots has been removed.");
 }
@@ -1346,8 +1490,7 @@ int verify_run_space_and_log(const char *message) {
         return r;
 }
 
-static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        Manager *m = userdata;
+static int reload_daemon(sd_bus_message *message, Manager *m, bool if_changed, sd_bus_error *error) {
         int r;
 
         assert(message);
@@ -1367,6 +1510,11 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         if (r == 0)
                 return 1; /* No authorization for now, but the async polkit stuff will call us again when it has it */
 
+        if (if_changed && !manager_unit_files_changed(m)) {
+                log_debug("Unit files unchanged on disk, skipping reload.");
+                return sd_bus_reply_method_return(message, NULL);
+        }
+
         /* Instead of sending the reply back right away, we just
          * remember that we need to and then send it after the reload
          * is finished. That way the caller knows when the reload
@@ -1382,6 +1530,14 @@ static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *
         return 1;
 }
 
+static int method_reload(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return reload_daemon(message, userdata, false, error);
+}
+
+static int method_reload_if_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        return reload_daemon(message, userdata, true, error);
+}
+
 static int method_reexecute(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         int r;
@@ -2509,14 +2665,17 @@ const sd_bus_vtable bus_manager_vtable[] = {
         SD_BUS_METHOD("ListUnits", NULL, "a(ssssssouso)", method_list_units, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsFiltered", "as", "a(ssssssouso)", method_list_units_filtered, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByPatterns", "asas", "a(ssssssouso)", method_list_units_by_patterns, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetUnitPropertiesByPatterns", "asasas", "a(sa{sv})", method_get_unit_properties_by_patterns, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListUnitsByNames", "as", "a(ssssssouso)", method_list_units_by_names, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListJobs", NULL, "a(usssoo)", method_list_jobs, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Subscribe", NULL, NULL, method_subscribe, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Unsubscribe", NULL, NULL, method_unsubscribe, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Dump", NULL, "s", method_dump, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetMetrics", NULL, "a(sst)", method_get_metrics, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("CreateSnapshot", "sb", "o", method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("RemoveSnapshot", "s", NULL, method_refuse_snapshot, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reload", NULL, NULL, method_reload, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ReloadIfChanged", NULL, NULL, method_reload_if_changed, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Reexecute", NULL, NULL, method_reexecute, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("Exit", NULL, NULL, method_exit, 0),
         SD_BUS_METHOD("Reboot", NULL, NULL, method_reboot, SD_BUS_VTABLE_CAPABILITY(CAP_SYS_BOOT)),
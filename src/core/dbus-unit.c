@@ -23,8 +23,12 @@
 #include "alloc-util.h"
 #include "bpf-firewall.h"
 #include "bus-common-errors.h"
+#include "bus-objects.h"
 #include "cgroup-util.h"
+#include "dbus-cgroup.h"
+#include "dbus-execute.h"
 #include "dbus-job.h"
+#include "dbus-kill.h"
 #include "dbus-unit.h"
 #include "dbus.h"
 #include "fd-util.h"
@@ -1137,6 +1141,65 @@ const sd_bus_vtable bus_unit_cgroup_vtable[] = {
         SD_BUS_VTABLE_END
 };
 
+int bus_unit_append_properties(sd_bus *bus, sd_bus_message *reply, Unit *u, char **properties, sd_bus_error *error) {
+        _cleanup_free_ char *p = NULL;
+        const char *interface;
+        void *c;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(u);
+
+        /* Appends the properties of all interfaces of the unit as one "a{sv}" array, in the same order as
+         * GetAll() on the unit object with an empty interface name would return them, but without looking up
+         * the object for each interface again. */
+
+        p = unit_dbus_path(u);
+        if (!p)
+                return -ENOMEM;
+
+        interface = unit_dbus_interface_from_type(u->type);
+
+        r = sd_bus_message_open_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        r = bus_vtable_append_properties(bus, reply, p, interface, unit_vtable[u->type]->bus_vtable, u, properties, error);
+        if (r < 0)
+                return r;
+
+        if (UNIT_HAS_CGROUP_CONTEXT(u)) {
+                r = bus_vtable_append_properties(bus, reply, p, interface, bus_unit_cgroup_vtable, u, properties, error);
+                if (r < 0)
+                        return r;
+
+                r = bus_vtable_append_properties(bus, reply, p, interface, bus_cgroup_vtable, unit_get_cgroup_context(u), properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        c = unit_get_exec_context(u);
+        if (c) {
+                r = bus_vtable_append_properties(bus, reply, p, interface, bus_exec_vtable, c, properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        c = unit_get_kill_context(u);
+        if (c) {
+                r = bus_vtable_append_properties(bus, reply, p, interface, bus_kill_vtable, c, properties, error);
+                if (r < 0)
+                        return r;
+        }
+
+        r = bus_vtable_append_properties(bus, reply, p, "org.freedesktop.systemd1.Unit", bus_unit_vtable, u, properties, error);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int send_new_signal(sd_bus *bus, void *userdata) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_free_ char *p = NULL;
@@ -1546,7 +1609,7 @@ static int bus_unit_set_transient_property(
         return 0;
 }
 
-int bus_unit_set_properties(
+static int bus_unit_set_properties_internal(
                 Unit *u,
                 sd_bus_message *message,
                 UnitWriteFlags flags,
@@ -1635,6 +1698,35 @@ int bus_unit_set_properties(
         return n;
 }
 
+int bus_unit_set_properties(
+                Unit *u,
+                sd_bus_message *message,
+                UnitWriteFlags flags,
+                bool commit,
+                sd_bus_error *error) {
+
+        int r, q;
+
+        assert(u);
+        assert(message);
+
+        /* For transient units all settings of this call are appended to the unit file in one go, instead of being
+         * written to one drop-in per property */
+        q = unit_begin_transient_update(u, flags);
+        if (q < 0)
+                return q;
+
+        r = bus_unit_set_properties_internal(u, message, flags, commit, error);
+
+        if (q > 0) {
+                q = unit_end_transient_update(u);
+                if (q < 0 && r >= 0)
+                        r = q;
+        }
+
+        return r;
+}
+
 int bus_unit_check_load_state(Unit *u, sd_bus_error *error) {
         assert(u);
 
@@ -695,6 +695,8 @@ static int bus_on_connection(sd_event_source *s, int fd, uint32_t revents, void
                 return 0;
         }
 
+        (void) bus_set_cork(bus, true);
+
         r = bus_setup_disconnected_match(m, bus);
         if (r < 0)
                 return 0;
@@ -869,6 +871,8 @@ static int bus_init_api(Manager *m) {
                         return 0;
                 }
 
+                (void) bus_set_cork(bus, true);
+
                 r = bus_setup_disconnected_match(m, bus);
                 if (r < 0)
                         return 0;
@@ -939,6 +943,10 @@ static int bus_init_system(Manager *m) {
                 return 0;
         }
 
+        /* Signals are sent in bursts, e.g. when dispatching the D-Bus queue, write them out in batches at
+         * the end of each event loop iteration */
+        (void) bus_set_cork(bus, true);
+
         r = bus_setup_system(m, bus);
         if (r < 0) {
                 log_error_errno(r, "Failed to set up system bus: %m");
@@ -1074,6 +1082,10 @@ static void destroy_bus(Manager *m, sd_bus **bus) {
         if (m->queued_message && sd_bus_message_get_bus(m->queued_message) == *bus)
                 m->queued_message = sd_bus_message_unref(m->queued_message);
 
+        /* Write out what is still corked, without waiting for the peer. Replies to Reexecute() and friends
+         * are usually still queued at this point. */
+        (void) bus_set_cork(*bus, false);
+
         /* Possibly flush unwritten data, but only if we are
          * unprivileged, since we don't want to sync here */
         if (!MANAGER_IS_SYSTEM(m))
@@ -36,6 +36,9 @@
 #include "unit-name.h"
 #include "unit.h"
 
+/* maximum number of udev events processed per wakeup */
+#define DEVICE_DISPATCH_BATCH_MAX 64
+
 static const UnitActiveState state_translation_table[_DEVICE_STATE_MAX] = {
         [DEVICE_DEAD] = UNIT_INACTIVE,
         [DEVICE_TENTATIVE] = UNIT_ACTIVATING,
@@ -98,6 +101,7 @@ static int device_set_sysfs(Device *d, const char *sysfs) {
         }
 
         d->sysfs = copy;
+        unit_add_to_dbus_queue(UNIT(d));
 
         return 0;
 }
@@ -394,6 +398,7 @@ static int device_setup_unit(Manager *m, struct udev_device *dev, const char *pa
                         goto fail;
 
                 unit_add_to_load_queue(u);
+                unit_add_to_dbus_queue(u);
         }
 
         /* If this was created via some dependency and has not
@@ -418,9 +423,11 @@ static int device_setup_unit(Manager *m, struct udev_device *dev, const char *pa
         if (dev && device_is_bound_by_mounts(DEVICE(u), dev))
                 device_upgrade_mount_deps(u);
 
-        /* Note that this won't dispatch the load queue, the caller has to do that if needed and appropriate */
+        /* Note that this won't dispatch the load queue, the caller has to do that if needed and appropriate. The
+         * unit is only queued for a D-Bus change signal if something that is exposed actually changed: the sysfs
+         * path and the description queue it themselves, and dependencies are not signalled. Every change event
+         * of every device ends up here for all of its aliases, hence don't send out signals for nothing. */
 
-        unit_add_to_dbus_queue(u);
         return 0;
 
 fail:
@@ -758,41 +765,23 @@ fail:
         device_shutdown(m);
 }
 
-static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
-        Manager *m = userdata;
+static void device_process_udev_event(Manager *m, struct udev_device *dev) {
         const char *action, *sysfs;
         int r;
 
         assert(m);
-
-        if (revents != EPOLLIN) {
-                static RATELIMIT_DEFINE(limit, 10*USEC_PER_SEC, 5);
-
-                if (!ratelimit_test(&limit))
-                        log_error_errno(errno, "Failed to get udev event: %m");
-                if (!(revents & EPOLLIN))
-                        return 0;
-        }
-
-        /*
-         * libudev might filter-out devices which pass the bloom
-         * filter, so getting NULL here is not necessarily an error.
-         */
-        dev = udev_monitor_receive_device(m->udev_monitor);
-        if (!dev)
-                return 0;
+        assert(dev);
 
         sysfs = udev_device_get_syspath(dev);
         if (!sysfs) {
                 log_error("Failed to get udev sys path.");
-                return 0;
+                return;
         }
 
         action = udev_device_get_action(dev);
         if (!action) {
                 log_error("Failed to get udev action string.");
-                return 0;
+                return;
         }
 
         if (streq(action, "change"))  {
@@ -845,6 +834,39 @@ static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
 
                 device_update_found_by_sysfs(m, sysfs, false, DEVICE_FOUND_UDEV, true);
         }
+}
+
+static int device_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        unsigned n;
+
+        assert(m);
+
+        if (revents != EPOLLIN) {
+                static RATELIMIT_DEFINE(limit, 10*USEC_PER_SEC, 5);
+
+                if (!ratelimit_test(&limit))
+                        log_error_errno(errno, "Failed to get udev event: %m");
+                if (!(revents & EPOLLIN))
+                        return 0;
+        }
+
+        /* During coldplug udev sends events in bursts. Drain a bunch of them from the
+         * non-blocking monitor socket in one go, instead of going through a full event loop
+         * iteration for every single one. If more are queued we are called again. */
+        for (n = 0; n < DEVICE_DISPATCH_BATCH_MAX; n++) {
+                _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
+
+                /*
+                 * libudev might filter-out devices which pass the bloom
+                 * filter, so getting NULL here is not necessarily an error.
+                 */
+                dev = udev_monitor_receive_device(m->udev_monitor);
+                if (!dev)
+                        break;
+
+                device_process_udev_event(m, dev);
+        }
 
         return 0;
 }
@@ -21,6 +21,7 @@
 #include <grp.h>
 #include <pwd.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 
 #include "clean-ipc.h"
 #include "dynamic-user.h"
@@ -34,8 +35,96 @@
 #include "string-util.h"
 #include "user-util.h"
 
+#define DYNAMIC_UID_COUNT (DYNAMIC_UID_MAX - DYNAMIC_UID_MIN + 1)
+#define DYNAMIC_UID_WORDS ((DYNAMIC_UID_COUNT + 63) / 64)
+
 /* Takes a value generated randomly or by hashing and turns it into a UID in the right range */
-#define UID_CLAMP_INTO_RANGE(rnd) (((uid_t) (rnd) % (DYNAMIC_UID_MAX - DYNAMIC_UID_MIN + 1)) + DYNAMIC_UID_MIN)
+#define UID_CLAMP_INTO_RANGE(rnd) (((uid_t) (rnd) % DYNAMIC_UID_COUNT) + DYNAMIC_UID_MIN)
+
+/* Which dynamic UIDs are known to be in use. This lives in an anonymous shared mapping, since UIDs are allocated in
+ * the processes we fork off, but released by PID 1. It is only a hint that allows us to skip candidates without
+ * probing their lock files and asking NSS about them, the lock files remain authoritative. "allocated" tracks the
+ * UIDs we allocated ourselves, "taken" the UIDs we found to be used by somebody else. The latter might go stale,
+ * hence it is reset whenever we run out of candidates. */
+struct DynamicUIDMap {
+        uint64_t allocated[DYNAMIC_UID_WORDS];
+        uint64_t taken[DYNAMIC_UID_WORDS];
+};
+
+static void uid_bits_set(uint64_t *bits, uid_t uid, bool b) {
+        unsigned n;
+
+        assert(uid_is_dynamic(uid));
+
+        n = uid - DYNAMIC_UID_MIN;
+        if (b)
+                __sync_fetch_and_or(bits + n / 64, UINT64_C(1) << (n % 64));
+        else
+                __sync_fetch_and_and(bits + n / 64, ~(UINT64_C(1) << (n % 64)));
+}
+
+static bool uid_bits_isset(const uint64_t *bits, uid_t uid) {
+        unsigned n;
+
+        assert(uid_is_dynamic(uid));
+
+        n = uid - DYNAMIC_UID_MIN;
+        return bits[n / 64] & (UINT64_C(1) << (n % 64));
+}
+
+static DynamicUIDMap* dynamic_uid_map_new(void) {
+        void *p;
+
+        p = mmap(NULL, sizeof(DynamicUIDMap), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+                return NULL;
+
+        return p;
+}
+
+DynamicUIDMap* dynamic_uid_map_free(DynamicUIDMap *map) {
+        if (map)
+                (void) munmap(map, sizeof(DynamicUIDMap));
+
+        return NULL;
+}
+
+static bool dynamic_uid_map_is_busy(DynamicUIDMap *map, uid_t uid) {
+        return map && (uid_bits_isset(map->allocated, uid) || uid_bits_isset(map->taken, uid));
+}
+
+static void dynamic_uid_map_set_allocated(DynamicUIDMap *map, uid_t uid, bool b) {
+        if (map)
+                uid_bits_set(map->allocated, uid, b);
+}
+
+static void dynamic_uid_map_set_taken(DynamicUIDMap *map, uid_t uid) {
+        if (map)
+                uid_bits_set(map->taken, uid, true);
+}
+
+static uid_t dynamic_uid_map_find_free(DynamicUIDMap *map, uid_t start) {
+        uid_t i;
+
+        assert(uid_is_dynamic(start));
+
+        if (!map)
+                return start;
+
+        /* Returns the first UID from start on that isn't known to be in use, wrapping around at the end of the
+         * range. If there's none, forget about the UIDs used by others, things might have changed since we looked
+         * at them. */
+
+        for (i = 0; i < DYNAMIC_UID_COUNT; i++) {
+                uid_t candidate = DYNAMIC_UID_MIN + (start - DYNAMIC_UID_MIN + i) % DYNAMIC_UID_COUNT;
+
+                if (!dynamic_uid_map_is_busy(map, candidate))
+                        return candidate;
+        }
+
+        memzero(map->taken, sizeof(map->taken));
+        return start;
+}
 
 static DynamicUser* dynamic_user_free(DynamicUser *d) {
         if (!d)
@@ -77,6 +166,13 @@ static int dynamic_user_add(Manager *m, const char *name, int storage_socket[2],
 
         d->manager = m;
 
+        /* Set this up before we fork off any process that might allocate a dynamic user, so that it is shared */
+        if (!m->dynamic_uid_map) {
+                m->dynamic_uid_map = dynamic_uid_map_new();
+                if (!m->dynamic_uid_map)
+                        log_debug_errno(errno, "Failed to allocate dynamic UID map, ignoring: %m");
+        }
+
         if (ret)
                 *ret = d;
 
@@ -184,7 +280,7 @@ static int make_uid_symlinks(uid_t uid, const char *name, bool b) {
         return r;
 }
 
-static int pick_uid(char **suggested_paths, const char *name, uid_t *ret_uid) {
+static int pick_uid(DynamicUIDMap *map, char **suggested_paths, const char *name, uid_t *ret_uid) {
 
         /* Find a suitable free UID. We use the following strategy to find a suitable UID:
          *
@@ -199,6 +295,8 @@ static int pick_uid(char **suggested_paths, const char *name, uid_t *ret_uid) {
          *
          * 3. Finally, if that didn't work, we randomly pick UIDs, until we find one that is empty.
          *
+         * In all phases, we skip UIDs that the dynamic UID map tells us are in use already.
+         *
          * Since the dynamic UID space is relatively small we'll stop trying after 100 iterations, giving up. */
 
         enum {
@@ -257,7 +355,7 @@ static int pick_uid(char **suggested_paths, const char *name, uid_t *ret_uid) {
 
                         /* Pick another random UID, and see if that works for us. */
                         random_bytes(&candidate, sizeof(candidate));
-                        candidate = UID_CLAMP_INTO_RANGE(candidate);
+                        candidate = dynamic_uid_map_find_free(map, UID_CLAMP_INTO_RANGE(candidate));
                         break;
 
                 default:
@@ -268,6 +366,9 @@ static int pick_uid(char **suggested_paths, const char *name, uid_t *ret_uid) {
                 if (!uid_is_dynamic(candidate))
                         continue;
 
+                if (phase != PHASE_RANDOM && dynamic_uid_map_is_busy(map, candidate))
+                        continue;
+
                 xsprintf(lock_path, "/run/systemd/dynamic-uid/" UID_FMT, candidate);
 
                 for (;;) {
@@ -279,8 +380,10 @@ static int pick_uid(char **suggested_paths, const char *name, uid_t *ret_uid) {
 
                         r = flock(lock_fd, LOCK_EX|LOCK_NB); /* Try to get a BSD file lock on the UID lock file */
                         if (r < 0) {
-                                if (IN_SET(errno, EBUSY, EAGAIN))
+                                if (IN_SET(errno, EBUSY, EAGAIN)) {
+                                        dynamic_uid_map_set_taken(map, candidate);
                                         goto next; /* already in use */
+                                }
 
                                 return -errno;
                         }
@@ -299,6 +402,7 @@ static int pick_uid(char **suggested_paths, const char *name, uid_t *ret_uid) {
                 if (getpwuid(candidate) ||
                     getgrgid((gid_t) candidate) ||
                     search_ipc(candidate, (gid_t) candidate) != 0) {
+                        dynamic_uid_map_set_taken(map, candidate);
                         (void) unlink(lock_path);
                         continue;
                 }
@@ -317,6 +421,7 @@ static int pick_uid(char **suggested_paths, const char *name, uid_t *ret_uid) {
 
                 (void) ftruncate(lock_fd, l);
                 (void) make_uid_symlinks(candidate, name, true); /* also add direct lookup symlinks */
+                dynamic_uid_map_set_allocated(map, candidate, true);
 
                 *ret_uid = candidate;
                 r = lock_fd;
@@ -410,16 +515,21 @@ static int dynamic_user_push(DynamicUser *d, uid_t uid, int lock_fd) {
         return 0;
 }
 
-static void unlink_uid_lock(int lock_fd, uid_t uid, const char *name) {
+static void unlink_uid_lock(DynamicUser *d, int lock_fd, uid_t uid) {
         char lock_path[strlen("/run/systemd/dynamic-uid/") + DECIMAL_STR_MAX(uid_t) + 1];
 
+        assert(d);
+
         if (lock_fd < 0)
                 return;
 
         xsprintf(lock_path, "/run/systemd/dynamic-uid/" UID_FMT, uid);
         (void) unlink(lock_path);
 
-        (void) make_uid_symlinks(uid, name, false); /* remove direct lookup symlinks */
+        (void) make_uid_symlinks(uid, d->name, false); /* remove direct lookup symlinks */
+
+        if (uid_is_dynamic(uid))
+                dynamic_uid_map_set_allocated(d->manager->dynamic_uid_map, uid, false);
 }
 
 static int lockfp(int fd, int *fd_lock) {
@@ -514,7 +624,7 @@ static int dynamic_user_realize(
                 if (num == UID_INVALID) {
                         /* No static UID assigned yet, excellent. Let's pick a new dynamic one, and lock it. */
 
-                        uid_lock_fd = pick_uid(suggested_dirs, d->name, &num);
+                        uid_lock_fd = pick_uid(d->manager->dynamic_uid_map, suggested_dirs, d->name, &num);
                         if (uid_lock_fd < 0)
                                 return uid_lock_fd;
                 }
@@ -522,7 +632,7 @@ static int dynamic_user_realize(
                 /* So, we found a working UID/lock combination. Let's see if we actually still need it. */
                 r = lockfp(d->storage_socket[0], &storage_socket0_lock);
                 if (r < 0) {
-                        unlink_uid_lock(uid_lock_fd, num, d->name);
+                        unlink_uid_lock(d, uid_lock_fd, num);
                         return r;
                 }
 
@@ -530,7 +640,7 @@ static int dynamic_user_realize(
                 if (r < 0) {
                         if (r != -EAGAIN) {
                                 /* OK, something bad happened, let's get rid of the bits we acquired. */
-                                unlink_uid_lock(uid_lock_fd, num, d->name);
+                                unlink_uid_lock(d, uid_lock_fd, num);
                                 return r;
                         }
 
@@ -539,7 +649,7 @@ static int dynamic_user_realize(
                         /* Hmm, so as it appears there's now something stored in the storage socket. Throw away what we
                          * acquired, and use what's stored now. */
 
-                        unlink_uid_lock(uid_lock_fd, num, d->name);
+                        unlink_uid_lock(d, uid_lock_fd, num);
                         safe_close(uid_lock_fd);
 
                         num = new_uid;
@@ -635,7 +745,7 @@ static int dynamic_user_close(DynamicUser *d) {
                 return r;
 
         /* This dynamic user was realized and dynamically allocated. In this case, let's remove the lock file. */
-        unlink_uid_lock(lock_fd, uid, d->name);
+        unlink_uid_lock(d, lock_fd, uid);
         return 1;
 }
 
@@ -684,8 +794,38 @@ int dynamic_user_serialize(Manager *m, FILE *f, FDSet *fds) {
         return 0;
 }
 
+static void dynamic_user_seed_map(DynamicUser *d) {
+        _cleanup_(unlockfp) int storage_socket0_lock = -1;
+        int lock_fd = -1, r;
+        uid_t uid;
+
+        assert(d);
+
+        /* After a daemon reload the dynamic UID map is fresh, hence mark the UID that is currently realized for this
+         * user as in use again. */
+
+        if (!d->manager->dynamic_uid_map)
+                return;
+
+        r = lockfp(d->storage_socket[0], &storage_socket0_lock);
+        if (r < 0)
+                return;
+
+        r = dynamic_user_pop(d, &uid, &lock_fd);
+        if (r < 0)
+                return;
+
+        if (lock_fd >= 0 && uid_is_dynamic(uid))
+                dynamic_uid_map_set_allocated(d->manager->dynamic_uid_map, uid, true);
+
+        r = dynamic_user_push(d, uid, lock_fd);
+        if (r < 0)
+                log_debug_errno(r, "Failed to push dynamic user %s back into storage socket: %m", d->name);
+}
+
 void dynamic_user_deserialize_one(Manager *m, const char *value, FDSet *fds) {
         _cleanup_free_ char *name = NULL, *s0 = NULL, *s1 = NULL;
+        DynamicUser *d;
         int r, fd0, fd1;
 
         assert(m);
@@ -710,7 +850,7 @@ void dynamic_user_deserialize_one(Manager *m, const char *value, FDSet *fds) {
                 return;
         }
 
-        r = dynamic_user_add(m, name, (int[]) { fd0, fd1 }, NULL);
+        r = dynamic_user_add(m, name, (int[]) { fd0, fd1 }, &d);
         if (r < 0) {
                 log_debug_errno(r, "Failed to add dynamic user: %m");
                 return;
@@ -718,6 +858,8 @@ void dynamic_user_deserialize_one(Manager *m, const char *value, FDSet *fds) {
 
         (void) fdset_remove(fds, fd0);
         (void) fdset_remove(fds, fd1);
+
+        dynamic_user_seed_map(d);
 }
 
 void dynamic_user_vacuum(Manager *m, bool close_user) {
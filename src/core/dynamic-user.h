@@ -21,6 +21,7 @@
 ***/
 
 typedef struct DynamicUser DynamicUser;
+typedef struct DynamicUIDMap DynamicUIDMap;
 
 typedef struct DynamicCreds {
         /* A combination of a dynamic user and group */
@@ -48,6 +49,8 @@ int dynamic_user_serialize(Manager *m, FILE *f, FDSet *fds);
 void dynamic_user_deserialize_one(Manager *m, const char *value, FDSet *fds);
 void dynamic_user_vacuum(Manager *m, bool close_user);
 
+DynamicUIDMap* dynamic_uid_map_free(DynamicUIDMap *map);
+
 int dynamic_user_lookup_uid(Manager *m, uid_t uid, char **ret);
 int dynamic_user_lookup_name(Manager *m, const char *name, uid_t *ret);
 
@@ -3506,16 +3506,20 @@ int exec_spawn(Unit *unit,
                 return log_unit_error_errno(unit, r, "Failed to load environment files: %m");
 
         argv = params->argv ?: command->argv;
-        line = exec_command_line(argv);
-        if (!line)
-                return log_oom();
 
-        log_struct(LOG_DEBUG,
-                   LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
-                   "EXECUTABLE=%s", command->path,
-                   LOG_UNIT_ID(unit),
-                   LOG_UNIT_INVOCATION_ID(unit),
-                   NULL);
+        /* The command line is only needed for the debug message, don't bother formatting it otherwise */
+        if (_unlikely_(log_get_max_level() >= LOG_DEBUG)) {
+                line = exec_command_line(argv);
+                if (!line)
+                        return log_oom();
+
+                log_struct(LOG_DEBUG,
+                           LOG_UNIT_MESSAGE(unit, "About to execute: %s", line),
+                           "EXECUTABLE=%s", command->path,
+                           LOG_UNIT_ID(unit),
+                           LOG_UNIT_INVOCATION_ID(unit),
+                           NULL);
+        }
 
         pid = fork();
         if (pid < 0)
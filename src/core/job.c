@@ -56,6 +56,7 @@ Job* job_new_raw(Unit *unit) {
         j->manager = unit->manager;
         j->unit = unit;
         j->type = _JOB_TYPE_INVALID;
+        j->deferred_start_idx = PRIOQ_IDX_NULL;
 
         return j;
 }
@@ -94,6 +95,9 @@ void job_free(Job *j) {
         if (j->in_gc_queue)
                 LIST_REMOVE(gc_queue, j->manager->gc_job_queue, j);
 
+        if (j->deferred_start_idx != PRIOQ_IDX_NULL)
+                prioq_remove(j->manager->deferred_start_jobs, j, &j->deferred_start_idx);
+
         sd_event_source_unref(j->timer_event_source);
 
         sd_bus_track_unref(j->bus_track);
@@ -102,6 +106,25 @@ void job_free(Job *j) {
         free(j);
 }
 
+static void job_release_start_slot(Job *j) {
+        Manager *m;
+
+        assert(j);
+
+        if (!j->start_admitted)
+                return;
+
+        m = j->manager;
+
+        assert(m->n_admitted_start_jobs > 0);
+        m->n_admitted_start_jobs--;
+        j->start_admitted = false;
+
+        /* A slot became free, make sure the run queue gets dispatched to admit the next deferred job */
+        if (!prioq_isempty(m->deferred_start_jobs) && !m->run_queue)
+                sd_event_source_set_enabled(m->run_queue_event_source, SD_EVENT_ONESHOT);
+}
+
 static void job_set_state(Job *j, JobState state) {
         assert(j);
         assert(state >= 0);
@@ -123,11 +146,33 @@ static void job_set_state(Job *j, JobState state) {
 
                 j->unit->manager->n_running_jobs--;
 
+                job_release_start_slot(j);
+
                 if (j->unit->manager->n_running_jobs <= 0)
                         j->unit->manager->jobs_in_progress_event_source = sd_event_source_unref(j->unit->manager->jobs_in_progress_event_source);
         }
 }
 
+static void job_update_ordering_jobs(Job *j, int delta) {
+        Unit *other;
+        Iterator i;
+        void *v;
+
+        assert(j);
+        assert(j->type != JOB_NOP);
+
+        /* Accounts for j being installed or uninstalled as the job of its unit (or changing its type) in the
+         * counters of the units ordered against it, see job_is_runnable(). This relies on UNIT_BEFORE and
+         * UNIT_AFTER being each other's inverse. */
+
+        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i)
+                other->n_after_jobs += delta;
+
+        if (IN_SET(j->type, JOB_STOP, JOB_RESTART))
+                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i)
+                        other->n_before_stop_jobs += delta;
+}
+
 void job_uninstall(Job *j) {
         Job **pj;
 
@@ -144,8 +189,14 @@ void job_uninstall(Job *j) {
         if (!MANAGER_IS_RELOADING(j->manager))
                 bus_job_send_removed_signal(j);
 
+        if (j->type != JOB_NOP)
+                job_update_ordering_jobs(j, -1);
+
         *pj = NULL;
 
+        if (j->deferred_start_idx != PRIOQ_IDX_NULL)
+                prioq_remove(j->manager->deferred_start_jobs, j, &j->deferred_start_idx);
+
         unit_add_to_gc_queue(j->unit);
 
         hashmap_remove(j->manager->jobs, UINT32_TO_PTR(j->id));
@@ -173,9 +224,11 @@ static void job_merge_into_installed(Job *j, Job *other) {
         assert(j->installed);
         assert(j->unit == other->unit);
 
-        if (j->type != JOB_NOP)
+        if (j->type != JOB_NOP) {
+                job_update_ordering_jobs(j, -1);
                 job_type_merge_and_collapse(&j->type, other->type, j->unit);
-        else
+                job_update_ordering_jobs(j, +1);
+        } else
                 assert(other->type == JOB_NOP);
 
         j->irreversible = j->irreversible || other->irreversible;
@@ -226,6 +279,9 @@ Job* job_install(Job *j) {
         *pj = j;
         j->installed = true;
 
+        if (j->type != JOB_NOP)
+                job_update_ordering_jobs(j, +1);
+
         j->manager->n_installed_jobs++;
         log_unit_debug(j->unit,
                        "Installed new job %s/%s as %u",
@@ -255,6 +311,9 @@ int job_install_deserialized(Job *j) {
         *pj = j;
         j->installed = true;
 
+        if (j->type != JOB_NOP)
+                job_update_ordering_jobs(j, +1);
+
         if (j->state == JOB_RUNNING)
                 j->unit->manager->n_running_jobs++;
 
@@ -436,10 +495,6 @@ int job_type_merge_and_collapse(JobType *a, JobType b, Unit *u) {
 }
 
 static bool job_is_runnable(Job *j) {
-        Iterator i;
-        Unit *other;
-        void *v;
-
         assert(j);
         assert(j->installed);
 
@@ -460,24 +515,22 @@ static bool job_is_runnable(Job *j) {
         if (j->type == JOB_NOP)
                 return true;
 
-        if (IN_SET(j->type, JOB_START, JOB_VERIFY_ACTIVE, JOB_RELOAD)) {
-                /* Immediate result is that the job is or might be
-                 * started. In this case let's wait for the
-                 * dependencies, regardless whether they are
-                 * starting or stopping something. */
+        /* The jobs of the units we are ordered against are counted as they come and go, hence this needs
+         * to look neither at the dependencies nor at the other jobs. */
 
-                HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i)
-                        if (other->job)
-                                return false;
-        }
+        /* Immediate result is that the job is or might be
+         * started. In this case let's wait for the
+         * dependencies, regardless whether they are
+         * starting or stopping something. */
+        if (IN_SET(j->type, JOB_START, JOB_VERIFY_ACTIVE, JOB_RELOAD) &&
+            j->unit->n_after_jobs > 0)
+                return false;
 
         /* Also, if something else is being stopped and we should
          * change state after it, then let's wait. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i)
-                if (other->job &&
-                    IN_SET(other->job->type, JOB_STOP, JOB_RESTART))
-                        return false;
+        if (j->unit->n_before_stop_jobs > 0)
+                return false;
 
         /* This means that for a service a and a service b where b
          * shall be started after a:
@@ -501,7 +554,13 @@ static void job_change_type(Job *j, JobType newtype) {
                        j->unit->id, job_type_to_string(j->type),
                        j->unit->id, job_type_to_string(newtype));
 
+        if (j->installed)
+                job_update_ordering_jobs(j, -1);
+
         j->type = newtype;
+
+        if (j->installed)
+                job_update_ordering_jobs(j, +1);
 }
 
 static int job_perform_on_unit(Job **j) {
@@ -554,6 +613,54 @@ static int job_perform_on_unit(Job **j) {
         return r;
 }
 
+static uint64_t job_deferred_start_key(const void *p) {
+        const Job *j = p;
+
+        /* Units without default dependencies are the ones early boot and the basic system are made of, and
+         * everything else tends to be ordered after them. Admit their jobs first, the rest in the order the
+         * jobs were created in. */
+
+        return ((uint64_t) j->unit->default_dependencies << 32) | j->id;
+}
+
+static bool job_admit_start(Job *j) {
+        Manager *m;
+
+        assert(j);
+
+        /* Enforces StartJobsMax=. Only start jobs on units that actually do something when started take a
+         * slot; a device or target start job costs nothing. Returns false if the job has been deferred until
+         * a slot becomes free. */
+
+        if (!IN_SET(j->type, JOB_START, JOB_RESTART) || !UNIT_VTABLE(j->unit)->start)
+                return true;
+
+        m = j->manager;
+
+        if (m->start_jobs_max > 0 && m->n_admitted_start_jobs >= m->start_jobs_max) {
+                if (j->deferred_start_idx != PRIOQ_IDX_NULL)
+                        return false;
+
+                if (prioq_ensure_allocated_keyed(&m->deferred_start_jobs, job_deferred_start_key) >= 0 &&
+                    prioq_put(m->deferred_start_jobs, j, &j->deferred_start_idx) >= 0) {
+                        log_unit_debug(j->unit, "Deferring job %s/%s, %u start jobs are running already.",
+                                       j->unit->id, job_type_to_string(j->type), m->n_admitted_start_jobs);
+                        return false;
+                }
+
+                /* Rather exceed the limit than lose track of the job */
+                log_oom();
+        }
+
+        if (j->deferred_start_idx != PRIOQ_IDX_NULL)
+                prioq_remove(m->deferred_start_jobs, j, &j->deferred_start_idx);
+
+        j->start_admitted = true;
+        m->n_admitted_start_jobs++;
+
+        return true;
+}
+
 int job_run_and_invalidate(Job *j) {
         int r;
 
@@ -571,6 +678,9 @@ int job_run_and_invalidate(Job *j) {
         if (!job_is_runnable(j))
                 return -EAGAIN;
 
+        if (!job_admit_start(j))
+                return -EAGAIN;
+
         job_start_timer(j, true);
         job_set_state(j, JOB_RUNNING);
         job_add_to_dbus_queue(j);
@@ -887,6 +997,9 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
         if (IN_SET(result, JOB_FAILED, JOB_INVALID))
                 j->manager->n_failed_jobs++;
 
+        if (j->begin_usec > 0)
+                histogram_add(&j->manager->job_duration_usec, usec_sub_unsigned(now(CLOCK_MONOTONIC), j->begin_usec));
+
         job_uninstall(j);
         job_free(j);
 
@@ -165,6 +165,8 @@ struct Job {
 
         JobResult result;
 
+        unsigned deferred_start_idx;
+
         bool installed:1;
         bool in_run_queue:1;
         bool matters_to_anchor:1;
@@ -174,6 +176,7 @@ struct Job {
         bool irreversible:1;
         bool in_gc_queue:1;
         bool ref_by_private_bus:1;
+        bool start_admitted:1;
 };
 
 Job* job_new(Unit *unit, JobType type);
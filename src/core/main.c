@@ -23,6 +23,7 @@
 #include <getopt.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <string.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
@@ -120,6 +121,9 @@ static usec_t arg_default_start_limit_interval = DEFAULT_START_LIMIT_INTERVAL;
 static unsigned arg_default_start_limit_burst = DEFAULT_START_LIMIT_BURST;
 static usec_t arg_runtime_watchdog = 0;
 static usec_t arg_shutdown_watchdog = 10 * USEC_PER_MINUTE;
+static usec_t arg_dbus_signal_coalesce_usec = 0;
+static usec_t arg_accounting_cache_usec = 0;
+static unsigned arg_start_jobs_max = 0;
 static char **arg_default_environment = NULL;
 static struct rlimit *arg_default_rlimit[_RLIMIT_MAX] = {};
 static uint64_t arg_capability_bounding_set = CAP_ALL;
@@ -751,6 +755,9 @@ static int parse_config_file(void) {
                 { "Manager", "JoinControllers",           config_parse_join_controllers, 0, &arg_join_controllers                  },
                 { "Manager", "RuntimeWatchdogSec",        config_parse_sec,              0, &arg_runtime_watchdog                  },
                 { "Manager", "ShutdownWatchdogSec",       config_parse_sec,              0, &arg_shutdown_watchdog                 },
+                { "Manager", "DBusSignalCoalesceSec",     config_parse_sec,              0, &arg_dbus_signal_coalesce_usec         },
+                { "Manager", "AccountingCacheSec",        config_parse_sec,              0, &arg_accounting_cache_usec             },
+                { "Manager", "StartJobsMax",              config_parse_unsigned,         0, &arg_start_jobs_max                    },
                 { "Manager", "CapabilityBoundingSet",     config_parse_capability_set,   0, &arg_capability_bounding_set           },
 #if HAVE_SECCOMP
                 { "Manager", "SystemCallArchitectures",   config_parse_syscall_archs,    0, &arg_syscall_archs                     },
@@ -846,6 +853,9 @@ static void set_manager_settings(Manager *m) {
         m->confirm_spawn = arg_confirm_spawn;
         m->runtime_watchdog = arg_runtime_watchdog;
         m->shutdown_watchdog = arg_shutdown_watchdog;
+        m->dbus_signal_coalesce_usec = arg_dbus_signal_coalesce_usec;
+        m->accounting_cache_usec = arg_accounting_cache_usec;
+        m->start_jobs_max = arg_start_jobs_max;
         m->cad_burst_action = arg_cad_burst_action;
 
         manager_set_show_status(m, arg_show_status);
@@ -1083,6 +1093,8 @@ static int parse_argv(int argc, char *argv[]) {
                         if (!f)
                                 return log_error_errno(errno, "Failed to open serialization fd: %m");
 
+                        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
                         safe_fclose(arg_serialization);
                         arg_serialization = f;
 
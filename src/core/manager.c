@@ -41,6 +41,7 @@
 #include "sd-path.h"
 
 #include "alloc-util.h"
+#include "async.h"
 #include "audit-fd.h"
 #include "boot-timestamps.h"
 #include "bus-common-errors.h"
@@ -52,6 +53,7 @@
 #include "dbus-manager.h"
 #include "dbus-unit.h"
 #include "dbus.h"
+#include "def.h"
 #include "dirent-util.h"
 #include "env-util.h"
 #include "escape.h"
@@ -79,6 +81,7 @@
 #include "signal-util.h"
 #include "special.h"
 #include "stat-util.h"
+#include "string-pool.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -93,6 +96,7 @@
 #include "watchdog.h"
 
 #define NOTIFY_RCVBUF_SIZE (8*1024*1024)
+#define NOTIFY_MESSAGES_PER_WAKEUP_MAX 64U
 #define CGROUPS_AGENT_RCVBUF_SIZE (8*1024*1024)
 
 /* Initial delay and the interval for printing status messages about running jobs */
@@ -100,6 +104,23 @@
 #define JOBS_IN_PROGRESS_PERIOD_USEC (USEC_PER_SEC / 3)
 #define JOBS_IN_PROGRESS_PERIOD_DIVISOR 3
 
+/* Unit files are small, don't read ahead more than this of each */
+#define UNIT_FILE_PREFETCH_BYTES (64U*1024U)
+#define FILE_PREFETCH_THREADS_MAX 4
+
+/* Don't read ahead more than this of each file recorded in the readahead pack */
+#define READAHEAD_FILE_BYTES_MAX (16U*1024U*1024U)
+
+/* Log at most this many resource usage messages of stopped units per interval, summarize the rest */
+#define UNIT_RESOURCES_RATELIMIT_INTERVAL (10*USEC_PER_SEC)
+#define UNIT_RESOURCES_RATELIMIT_BURST 200
+
+/* How soon to retry passing queued log messages on to journald */
+#define JOURNAL_FLUSH_RETRY_USEC (50*USEC_PER_MSEC)
+
+/* How many units to look at in one GC run before returning to the event loop */
+#define GC_UNIT_QUEUE_BUDGET 1024U
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -649,7 +670,7 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
 
         m->pin_cgroupfs_fd = m->notify_fd = m->cgroups_agent_fd = m->signal_fd = m->time_change_fd =
                 m->dev_autofs_fd = m->private_listen_fd = m->cgroup_inotify_fd =
-                m->ask_password_inotify_fd = -1;
+                m->ask_password_inotify_fd = m->path_inotify_fd = -1;
 
         m->user_lookup_fds[0] = m->user_lookup_fds[1] = -1;
 
@@ -662,6 +683,7 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
 
         /* Reboot immediately if the user hits C-A-D more often than 7x per 2s */
         RATELIMIT_INIT(m->ctrl_alt_del_ratelimit, 2 * USEC_PER_SEC, 7);
+        RATELIMIT_INIT(m->unit_resources_ratelimit, UNIT_RESOURCES_RATELIMIT_INTERVAL, UNIT_RESOURCES_RATELIMIT_BURST);
 
         r = manager_default_environment(m);
         if (r < 0)
@@ -683,6 +705,12 @@ int manager_new(UnitFileScope scope, unsigned test_run_flags, Manager **_m) {
         if (r < 0)
                 goto fail;
 
+        m->string_pool = string_pool_new();
+        if (!m->string_pool) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
         r = sd_event_default(&m->event);
         if (r < 0)
                 goto fail;
@@ -1044,12 +1072,21 @@ good:
 
 static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
         unsigned n = 0, gc_marker;
+        usec_t start;
         Unit *u;
 
         assert(m);
 
+        if (!m->gc_unit_queue)
+                return 0;
+
         /* log_debug("Running GC..."); */
 
+        /* Every run starts with a fresh marker, hence units left in the queue when the budget is used up are
+         * simply judged again next time, based on the state at that point. */
+
+        start = now(CLOCK_MONOTONIC);
+
         m->gc_marker += _GC_OFFSET_MAX;
         if (m->gc_marker + _GC_OFFSET_MAX <= _GC_OFFSET_MAX)
                 m->gc_marker = 1;
@@ -1072,9 +1109,18 @@ static unsigned manager_dispatch_gc_unit_queue(Manager *m) {
                                 log_unit_debug(u, "Collecting.");
                         u->gc_marker = gc_marker + GC_OFFSET_BAD;
                         unit_add_to_cleanup_queue(u);
+                        m->n_gc_units_collected++;
+                }
+
+                if (n >= GC_UNIT_QUEUE_BUDGET && m->gc_unit_queue) {
+                        m->gc_unit_queue_yield = true;
+                        break;
                 }
         }
 
+        m->n_gc_units_swept += n;
+        m->gc_usec += now(CLOCK_MONOTONIC) - start;
+
         return n;
 }
 
@@ -1125,8 +1171,33 @@ static void manager_clear_jobs_and_units(Manager *m) {
 
         m->n_on_console = 0;
         m->n_running_jobs = 0;
+        m->n_admitted_start_jobs = 0;
+}
+
+struct unit_path_listing {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        nsec_t mtime; /* NSEC_INFINITY if the listing may not be reused */
+        char **entries;
+        size_t n_entries, n_allocated;
+};
+
+static struct unit_path_listing* unit_path_listing_free(struct unit_path_listing *l) {
+        size_t k;
+
+        if (!l)
+                return NULL;
+
+        for (k = 0; k < l->n_entries; k++)
+                free(l->entries[k]);
+        free(l->entries);
+        free(l->path);
+        return mfree(l);
 }
 
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct unit_path_listing*, unit_path_listing_free);
+
 Manager* manager_free(Manager *m) {
         UnitType c;
         int i;
@@ -1150,6 +1221,7 @@ Manager* manager_free(Manager *m) {
 
         dynamic_user_vacuum(m, false);
         hashmap_free(m->dynamic_users);
+        m->dynamic_uid_map = dynamic_uid_map_free(m->dynamic_uid_map);
 
         hashmap_free(m->units);
         hashmap_free(m->units_by_invocation_id);
@@ -1166,9 +1238,12 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->cgroups_agent_event_source);
         sd_event_source_unref(m->time_change_event_source);
         sd_event_source_unref(m->jobs_in_progress_event_source);
+        sd_event_source_unref(m->dbus_queue_event_source);
         sd_event_source_unref(m->run_queue_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
 
+        prioq_free(m->deferred_start_jobs);
+
         safe_close(m->signal_fd);
         safe_close(m->notify_fd);
         safe_close(m->cgroups_agent_fd);
@@ -1188,7 +1263,9 @@ Manager* manager_free(Manager *m) {
         strv_free(m->environment);
 
         hashmap_free(m->cgroup_unit);
-        set_free_free(m->unit_path_cache);
+        hashmap_free(m->bpf_firewall_policies);
+        set_free(m->unit_path_cache);
+        hashmap_free_with_destructor(m->unit_path_listings, unit_path_listing_free);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1199,6 +1276,9 @@ Manager* manager_free(Manager *m) {
         assert(hashmap_isempty(m->units_requiring_mounts_for));
         hashmap_free(m->units_requiring_mounts_for);
 
+        assert(string_pool_size(m->string_pool) == 0);
+        string_pool_free(m->string_pool);
+
         hashmap_free(m->uid_refs);
         hashmap_free(m->gid_refs);
 
@@ -1251,54 +1331,401 @@ static void manager_coldplug(Manager *m) {
         }
 }
 
+static bool unit_path_listing_is_current(struct unit_path_listing *l, const struct stat *st) {
+        assert(l);
+        assert(st);
+
+        return l->mtime != NSEC_INFINITY &&
+                l->dev == st->st_dev &&
+                l->ino == st->st_ino &&
+                l->mtime == timespec_load_nsec(&st->st_mtim);
+}
+
+static int unit_path_listing_read(const char *path, DIR *d, const struct stat *st, struct unit_path_listing **ret) {
+        _cleanup_(unit_path_listing_freep) struct unit_path_listing *l = NULL;
+        struct dirent *de;
+
+        assert(path);
+        assert(d);
+        assert(st);
+        assert(ret);
+
+        l = new0(struct unit_path_listing, 1);
+        if (!l)
+                return -ENOMEM;
+
+        l->path = strdup(path);
+        if (!l->path)
+                return -ENOMEM;
+
+        l->dev = st->st_dev;
+        l->ino = st->st_ino;
+        l->mtime = timespec_load_nsec(&st->st_mtim);
+
+        /* The mtime granularity of file systems is coarse, hence don't trust a listing of a directory that
+         * changed very recently, as it might be changed again without the mtime moving on. */
+        if (now_nsec(CLOCK_REALTIME) < l->mtime + NSEC_PER_SEC)
+                l->mtime = NSEC_INFINITY;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                char *p;
+
+                p = strjoin(streq(path, "/") ? "" : path, "/", de->d_name);
+                if (!p)
+                        return -ENOMEM;
+
+                if (!GREEDY_REALLOC(l->entries, l->n_allocated, l->n_entries + 1)) {
+                        free(p);
+                        return -ENOMEM;
+                }
+
+                l->entries[l->n_entries++] = p;
+        }
+
+        *ret = l;
+        l = NULL;
+
+        return 0;
+}
+
 static void manager_build_unit_path_cache(Manager *m) {
+        Hashmap *old;
         char **i;
         int r;
 
         assert(m);
 
-        set_free_free(m->unit_path_cache);
+        m->unit_path_cache = set_free(m->unit_path_cache);
 
-        m->unit_path_cache = set_new(&string_hash_ops);
-        if (!m->unit_path_cache) {
+        old = m->unit_path_listings;
+        m->unit_path_listings = NULL;
+
+        /* Everything changing on disk from now on might not be seen by the units we are about to load */
+        m->unit_path_timestamp = now(CLOCK_REALTIME);
+
+        m->unit_path_cache = set_new(&trusted_string_hash_ops);
+        m->unit_path_listings = hashmap_new(&trusted_string_hash_ops);
+        if (!m->unit_path_cache || !m->unit_path_listings) {
                 r = -ENOMEM;
                 goto fail;
         }
 
         /* This simply builds a list of files we know exist, so that
-         * we don't always have to go to disk */
+         * we don't always have to go to disk. The directory listings
+         * are kept across reloads, and only directories whose mtime
+         * changed since are read again. */
 
         STRV_FOREACH(i, m->lookup_paths.search_path) {
-                _cleanup_closedir_ DIR *d = NULL;
-                struct dirent *de;
+                struct unit_path_listing *l;
+                struct stat st;
+                size_t k;
 
-                d = opendir(*i);
-                if (!d) {
+                if (stat(*i, &st) < 0) {
                         if (errno != ENOENT)
-                                log_warning_errno(errno, "Failed to open directory %s, ignoring: %m", *i);
+                                log_warning_errno(errno, "Failed to stat directory %s, ignoring: %m", *i);
                         continue;
                 }
 
-                FOREACH_DIRENT(de, d, r = -errno; goto fail) {
-                        char *p;
+                l = hashmap_get(old, *i);
+                if (l && unit_path_listing_is_current(l, &st))
+                        hashmap_remove(old, *i);
+                else {
+                        _cleanup_closedir_ DIR *d = NULL;
 
-                        p = strjoin(streq(*i, "/") ? "" : *i, "/", de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto fail;
+                        d = opendir(*i);
+                        if (!d) {
+                                if (errno != ENOENT)
+                                        log_warning_errno(errno, "Failed to open directory %s, ignoring: %m", *i);
+                                continue;
                         }
 
-                        r = set_consume(m->unit_path_cache, p);
+                        r = unit_path_listing_read(*i, d, &st, &l);
+                        if (r < 0)
+                                goto fail;
+                }
+
+                r = hashmap_put(m->unit_path_listings, l->path, l);
+                if (r < 0) {
+                        unit_path_listing_free(l);
+                        goto fail;
+                }
+
+                for (k = 0; k < l->n_entries; k++) {
+                        r = set_put(m->unit_path_cache, l->entries[k]);
                         if (r < 0)
                                 goto fail;
                 }
         }
 
+        hashmap_free_with_destructor(old, unit_path_listing_free);
         return;
 
 fail:
         log_warning_errno(r, "Failed to build unit path cache, proceeding without: %m");
-        m->unit_path_cache = set_free_free(m->unit_path_cache);
+        m->unit_path_cache = set_free(m->unit_path_cache);
+        m->unit_path_listings = hashmap_free_with_destructor(m->unit_path_listings, unit_path_listing_free);
+        hashmap_free_with_destructor(old, unit_path_listing_free);
+}
+
+typedef struct FilePrefetch {
+        unsigned n_ref;
+        size_t next;
+        size_t n_paths;
+        size_t max_bytes;
+        char **paths;
+} FilePrefetch;
+
+static void file_prefetch_unref(FilePrefetch *w) {
+        if (__sync_sub_and_fetch(&w->n_ref, 1) > 0)
+                return;
+
+        strv_free(w->paths);
+        free(w);
+}
+
+static void *file_prefetch_thread(void *p) {
+        FilePrefetch *w = p;
+
+        /* Runs without any access to the manager, and only pulls the files into the page cache */
+
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+                size_t k;
+
+                k = __sync_fetch_and_add(&w->next, 1);
+                if (k >= w->n_paths)
+                        break;
+
+                fd = open(w->paths[k], O_RDONLY|O_CLOEXEC|O_NOCTTY|O_NONBLOCK);
+                if (fd < 0)
+                        continue;
+
+                (void) readahead(fd, 0, w->max_bytes);
+        }
+
+        file_prefetch_unref(w);
+        return NULL;
+}
+
+/* Takes possession of the paths */
+static void manager_prefetch_files(char **paths, size_t max_bytes) {
+        FilePrefetch *w;
+        unsigned n_threads, j;
+        long ncpus;
+        int r;
+
+        if (strv_isempty(paths)) {
+                strv_free(paths);
+                return;
+        }
+
+        w = new0(FilePrefetch, 1);
+        if (!w) {
+                strv_free(paths);
+                log_oom();
+                return;
+        }
+
+        w->n_ref = 1;
+        w->paths = paths;
+        w->n_paths = strv_length(paths);
+        w->max_bytes = max_bytes;
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (unsigned) CLAMP(ncpus, 1L, (long) FILE_PREFETCH_THREADS_MAX);
+        n_threads = MIN(n_threads, (unsigned) w->n_paths);
+
+        for (j = 0; j < n_threads; j++) {
+                __sync_add_and_fetch(&w->n_ref, 1);
+
+                r = asynchronous_job(file_prefetch_thread, w);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to spawn file prefetch thread, ignoring: %m");
+                        file_prefetch_unref(w);
+                        break;
+                }
+        }
+
+        file_prefetch_unref(w);
+}
+
+static void manager_prefetch_unit_files(Manager *m) {
+        _cleanup_strv_free_ char **paths = NULL;
+        size_t n_allocated = 0, n_paths = 0;
+        const char *p;
+        Iterator i;
+
+        assert(m);
+
+        /* Loading units is sequential, as parsing directly builds up the Unit objects and their
+         * dependencies. On a cold boot much of that time is spent waiting for the disk however, hence let
+         * a few threads pull the unit files into memory in parallel, ahead of the loading. */
+
+        if (m->test_run_flags != 0 || set_isempty(m->unit_path_cache))
+                return;
+
+        SET_FOREACH(p, m->unit_path_cache, i) {
+                if (!unit_name_is_valid(basename(p), UNIT_NAME_ANY))
+                        continue;
+
+                if (!GREEDY_REALLOC(paths, n_allocated, n_paths + 2)) {
+                        log_oom();
+                        return;
+                }
+
+                paths[n_paths] = strdup(p);
+                if (!paths[n_paths]) {
+                        log_oom();
+                        return;
+                }
+
+                paths[++n_paths] = NULL;
+        }
+
+        manager_prefetch_files(paths, UNIT_FILE_PREFETCH_BYTES);
+        paths = NULL;
+}
+
+static void manager_replay_readahead_pack(Manager *m) {
+#if ENABLE_READAHEAD
+        _cleanup_free_ char *contents = NULL;
+        char **paths, **i;
+        size_t n = 0;
+        int r;
+
+        assert(m);
+
+        /* The readahead pack lists the files opened during the previous boot, as recorded by
+         * systemd-readahead-collect. Pull them in from the background right away, so that the generators and the
+         * unit loading, and later on the services themselves, find them in memory instead of waiting for cold
+         * storage one random read after the other. */
+
+        if (!MANAGER_IS_SYSTEM(m) || m->test_run_flags != 0)
+                return;
+
+        r = read_full_file(READAHEAD_PACK_PATH, &contents, NULL);
+        if (r < 0) {
+                if (r != -ENOENT)
+                        log_debug_errno(r, "Failed to read " READAHEAD_PACK_PATH ", ignoring: %m");
+                return;
+        }
+
+        paths = strv_split_newlines(contents);
+        if (!paths) {
+                log_oom();
+                return;
+        }
+
+        /* Drop comments and anything else that isn't a path */
+        STRV_FOREACH(i, paths)
+                if (path_is_absolute(*i))
+                        paths[n++] = *i;
+                else
+                        free(*i);
+        paths[n] = NULL;
+
+        log_debug("Reading ahead %zu files recorded during the last boot.", n);
+
+        manager_prefetch_files(paths, READAHEAD_FILE_BYTES_MAX);
+#endif
+}
+
+static bool unit_dir_changed_since(int dir_fd, const char *path, usec_t since, bool recurse) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        struct stat st;
+        int fd;
+
+        fd = openat(dir_fd, path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0)
+                return true;
+
+        d = fdopendir(fd);
+        if (!d) {
+                safe_close(fd);
+                return true;
+        }
+
+        if (fstat(dirfd(d), &st) < 0)
+                return true;
+
+        /* The ctime of a directory moves on whenever entries are added, removed or renamed, and the ctime
+         * of a file whenever it is written to, no matter what the mtime is set to. */
+        if (timespec_load(&st.st_ctim) >= since)
+                return true;
+
+        FOREACH_DIRENT(de, d, return true) {
+
+                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                        return true;
+
+                if (timespec_load(&st.st_ctim) >= since)
+                        return true;
+
+                /* Look into drop-in, .wants/ and .requires/ directories, too */
+                if (recurse && S_ISDIR(st.st_mode) &&
+                    unit_dir_changed_since(dirfd(d), de->d_name, since, false))
+                        return true;
+        }
+
+        return false;
+}
+
+bool manager_unit_files_changed(Manager *m) {
+        Iterator i;
+        usec_t since;
+        char **p;
+        const char *k;
+        Unit *u;
+
+        assert(m);
+
+        /* Checks whether anything in the unit search paths changed since the units were loaded the last
+         * time, or whether any loaded unit refers to a modified file outside of them. If this returns false
+         * a reload would result in the very same units again, except for changes to generator inputs, as
+         * the generators are not run here. */
+
+        if (!m->unit_path_listings || m->unit_path_timestamp <= 0)
+                return true;
+
+        /* Leave some room for the coarse timestamp granularity of file systems */
+        since = usec_sub_unsigned(m->unit_path_timestamp, USEC_PER_SEC);
+
+        STRV_FOREACH(p, m->lookup_paths.search_path) {
+                bool existed;
+
+                existed = hashmap_contains(m->unit_path_listings, *p);
+
+                if (access(*p, F_OK) < 0) {
+                        if (errno != ENOENT || existed)
+                                return true;
+
+                        continue;
+                }
+
+                if (!existed)
+                        return true;
+
+                /* The generator output is only ever changed by running the generators, which happens
+                 * right before the units are loaded, so don't bother */
+                if (path_equal_ptr(*p, m->lookup_paths.generator) ||
+                    path_equal_ptr(*p, m->lookup_paths.generator_early) ||
+                    path_equal_ptr(*p, m->lookup_paths.generator_late))
+                        continue;
+
+                if (unit_dir_changed_since(AT_FDCWD, *p, since, true))
+                        return true;
+        }
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                if (k != u->id)
+                        continue;
+
+                if (unit_need_daemon_reload(u))
+                        return true;
+        }
+
+        return false;
 }
 
 static void manager_distribute_fds(Manager *m, FDSet *fds) {
@@ -1324,6 +1751,10 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
         assert(m);
 
+        /* When coming up fresh, get the files the last boot needed into memory first */
+        if (!serialization)
+                manager_replay_readahead_pack(m);
+
         /* If we are running in test mode, we still want to run the generators,
          * but we should not touch the real generator directories. */
         r = lookup_paths_init(&m->lookup_paths, m->unit_file_scope,
@@ -1357,6 +1788,7 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
         lookup_paths_reduce(&m->lookup_paths);
         manager_build_unit_path_cache(m);
+        manager_prefetch_unit_files(m);
 
         /* If we will deserialize make sure that during enumeration
          * this is already known, so we increase the counter here
@@ -1706,6 +2138,7 @@ void manager_dump_units(Manager *s, FILE *f, const char *prefix) {
 }
 
 void manager_dump(Manager *m, FILE *f, const char *prefix) {
+        char timespan[FORMAT_TIMESPAN_MAX];
         ManagerTimestamp q;
 
         assert(m);
@@ -1721,6 +2154,14 @@ void manager_dump(Manager *m, FILE *f, const char *prefix) {
                                 format_timestamp(buf, sizeof(buf), m->timestamps[q].realtime));
         }
 
+        fprintf(f,
+                "%sGC Units Swept: %" PRIu64 "\n"
+                "%sGC Units Collected: %" PRIu64 "\n"
+                "%sGC Time: %s\n",
+                strempty(prefix), m->n_gc_units_swept,
+                strempty(prefix), m->n_gc_units_collected,
+                strempty(prefix), format_timespan(timespan, sizeof(timespan), m->gc_usec, 1));
+
         manager_dump_units(m, f, prefix);
         manager_dump_jobs(m, f, prefix);
 }
@@ -1771,11 +2212,25 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         assert(source);
         assert(m);
 
-        while ((j = m->run_queue)) {
-                assert(j->installed);
-                assert(j->in_run_queue);
+        for (;;) {
+                while ((j = m->run_queue)) {
+                        assert(j->installed);
+                        assert(j->in_run_queue);
 
-                job_run_and_invalidate(j);
+                        job_run_and_invalidate(j);
+                }
+
+                /* Hand free StartJobsMax= slots to deferred start jobs. A job that is not runnable yet gives
+                 * its slot right back and is queued again once whatever it is waiting for is done. */
+                if (m->start_jobs_max > 0 && m->n_admitted_start_jobs >= m->start_jobs_max)
+                        break;
+
+                j = prioq_peek(m->deferred_start_jobs);
+                if (!j)
+                        break;
+
+                prioq_remove(m->deferred_start_jobs, j, &j->deferred_start_idx);
+                job_add_to_run_queue(j);
         }
 
         if (m->n_running_jobs > 0)
@@ -1787,7 +2242,7 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         return 1;
 }
 
-static unsigned manager_dispatch_dbus_queue(Manager *m) {
+static unsigned manager_flush_dbus_queue(Manager *m) {
         Job *j;
         Unit *u;
         unsigned n = 0;
@@ -1797,6 +2252,8 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
         if (m->dispatching_dbus_queue)
                 return 0;
 
+        m->dbus_queue_event_source = sd_event_source_unref(m->dbus_queue_event_source);
+
         m->dispatching_dbus_queue = true;
 
         while ((u = m->dbus_unit_queue)) {
@@ -1827,6 +2284,60 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
         return n;
 }
 
+static int manager_dispatch_dbus_queue_timer(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        (void) manager_flush_dbus_queue(m);
+        return 0;
+}
+
+static bool manager_hold_dbus_queue(Manager *m) {
+        int r;
+
+        assert(m);
+
+        /* Hold back change signals for DBusSignalCoalesceSec=, so that units passing through a number of states
+         * in short succession only report the state they end up in. Not if a reply is waiting for them though,
+         * since the caller expects the signals to precede it. */
+
+        if (m->dbus_signal_coalesce_usec <= 0 || m->dbus_signal_coalesce_usec == USEC_INFINITY)
+                return false;
+
+        if (!m->dbus_unit_queue && !m->dbus_job_queue)
+                return false;
+
+        if (m->queued_message || m->send_reloading_done)
+                return false;
+
+        if (m->dbus_queue_event_source)
+                return true;
+
+        r = sd_event_add_time(
+                        m->event,
+                        &m->dbus_queue_event_source,
+                        CLOCK_MONOTONIC,
+                        usec_add(now(CLOCK_MONOTONIC), m->dbus_signal_coalesce_usec), 0,
+                        manager_dispatch_dbus_queue_timer, m);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to allocate D-Bus queue timer, sending signals right away: %m");
+                return false;
+        }
+
+        (void) sd_event_source_set_description(m->dbus_queue_event_source, "manager-dbus-queue");
+        return true;
+}
+
+static unsigned manager_dispatch_dbus_queue(Manager *m) {
+        assert(m);
+
+        if (manager_hold_dbus_queue(m))
+                return 0;
+
+        return manager_flush_dbus_queue(m);
+}
+
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
         char buf[PATH_MAX+1];
@@ -1881,14 +2392,11 @@ static void manager_invoke_notify_message(Manager *m, Unit *u, pid_t pid, const
         }
 }
 
-static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-
+static int manager_receive_notify_message(Manager *m, char *buf, size_t size, struct ucred *ret_ucred, FDSet **ret_fds) {
         _cleanup_fdset_free_ FDSet *fds = NULL;
-        Manager *m = userdata;
-        char buf[NOTIFY_BUFFER_MAX+1];
         struct iovec iovec = {
                 .iov_base = buf,
-                .iov_len = sizeof(buf)-1,
+                .iov_len = size-1,
         };
         union {
                 struct cmsghdr cmsghdr;
@@ -1904,28 +2412,25 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
 
         struct cmsghdr *cmsg;
         struct ucred *ucred = NULL;
-        Unit *u1, *u2, *u3;
         int r, *fd_array = NULL;
         unsigned n_fds = 0;
         ssize_t n;
 
         assert(m);
-        assert(m->notify_fd == fd);
+        assert(buf);
+        assert(size > 1);
+        assert(ret_ucred);
+        assert(ret_fds);
 
-        if (revents != EPOLLIN) {
-                log_warning("Got unexpected poll event for notify fd.");
-                return 0;
-        }
+        /* Reads one message off the notify socket. Returns 1 if a valid message was read, 0 if one was read
+         * but is to be ignored, and -EAGAIN if there's nothing queued. */
 
         n = recvmsg(m->notify_fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC|MSG_TRUNC);
         if (n < 0) {
                 if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0; /* Spurious wakeup, try again */
+                        return -EAGAIN;
 
-                /* If this is any other, real error, then let's stop processing this socket. This of course means we
-                 * won't take notification messages anymore, but that's still better than busy looping around this:
-                 * being woken up over and over again but being unable to actually read the message off the socket. */
-                return log_error_errno(errno, "Failed to receive notification message: %m");
+                return -errno;
         }
 
         CMSG_FOREACH(cmsg, &msghdr) {
@@ -1958,7 +2463,7 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
                 return 0;
         }
 
-        if ((size_t) n >= sizeof(buf) || (msghdr.msg_flags & MSG_TRUNC)) {
+        if ((size_t) n >= size || (msghdr.msg_flags & MSG_TRUNC)) {
                 log_warning("Received notify message exceeded maximum size. Ignoring.");
                 return 0;
         }
@@ -1973,25 +2478,86 @@ static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t
         /* Make sure it's NUL-terminated. */
         buf[n] = 0;
 
+        *ret_ucred = *ucred;
+        *ret_fds = fds;
+        fds = NULL;
+
+        return 1;
+}
+
+static void manager_notify_units(Manager *m, pid_t pid, const char *buf, FDSet *fds) {
+        Unit *u1, *u2, *u3;
+
+        assert(m);
+        assert(pid > 0);
+        assert(buf);
+
         /* Notify every unit that might be interested, but try
          * to avoid notifying the same one multiple times. */
-        u1 = manager_get_unit_by_pid_cgroup(m, ucred->pid);
+        u1 = manager_get_unit_by_pid_cgroup(m, pid);
         if (u1)
-                manager_invoke_notify_message(m, u1, ucred->pid, buf, fds);
+                manager_invoke_notify_message(m, u1, pid, buf, fds);
 
-        u2 = hashmap_get(m->watch_pids1, PID_TO_PTR(ucred->pid));
+        u2 = hashmap_get(m->watch_pids1, PID_TO_PTR(pid));
         if (u2 && u2 != u1)
-                manager_invoke_notify_message(m, u2, ucred->pid, buf, fds);
+                manager_invoke_notify_message(m, u2, pid, buf, fds);
 
-        u3 = hashmap_get(m->watch_pids2, PID_TO_PTR(ucred->pid));
+        u3 = hashmap_get(m->watch_pids2, PID_TO_PTR(pid));
         if (u3 && u3 != u2 && u3 != u1)
-                manager_invoke_notify_message(m, u3, ucred->pid, buf, fds);
+                manager_invoke_notify_message(m, u3, pid, buf, fds);
 
         if (!u1 && !u2 && !u3)
-                log_warning("Cannot find unit for notify message of PID "PID_FMT".", ucred->pid);
+                log_warning("Cannot find unit for notify message of PID "PID_FMT".", pid);
 
         if (fdset_size(fds) > 0)
                 log_warning("Got extra auxiliary fds with notification message, closing them.");
+}
+
+static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        char bufs[2][NOTIFY_BUFFER_MAX+1];
+        Manager *m = userdata;
+        pid_t previous_pid = 0;
+        unsigned k, current = 0;
+        int r;
+
+        assert(m);
+        assert(m->notify_fd == fd);
+
+        if (revents != EPOLLIN) {
+                log_warning("Got unexpected poll event for notify fd.");
+                return 0;
+        }
+
+        /* Services sending frequent updates tend to queue up many messages, hence read a batch of them per
+         * wakeup. A message that is an exact repetition of the one just processed for the same PID (think
+         * WATCHDOG=1 pings) carries nothing new, and is skipped. Messages with fds are never skipped. */
+
+        for (k = 0; k < NOTIFY_MESSAGES_PER_WAKEUP_MAX; k++) {
+                _cleanup_fdset_free_ FDSet *fds = NULL;
+                struct ucred ucred;
+
+                r = manager_receive_notify_message(m, bufs[current], sizeof(bufs[current]), &ucred, &fds);
+                if (r == -EAGAIN)
+                        break;
+                if (r < 0)
+                        /* If this is any other, real error, then let's stop processing this socket. This of course
+                         * means we won't take notification messages anymore, but that's still better than busy
+                         * looping around this: being woken up over and over again but being unable to actually
+                         * read the message off the socket. */
+                        return log_error_errno(r, "Failed to receive notification message: %m");
+                if (r == 0) {
+                        previous_pid = 0;
+                        continue;
+                }
+
+                if (!fds && ucred.pid == previous_pid && streq(bufs[current], bufs[!current]))
+                        continue;
+
+                manager_notify_units(m, ucred.pid, bufs[current], fds);
+
+                previous_pid = fds ? 0 : ucred.pid;
+                current = !current;
+        }
 
         return 0;
 }
@@ -2048,7 +2614,9 @@ static int manager_dispatch_sigchld(Manager *m) {
                         _cleanup_free_ char *name = NULL;
                         Unit *u1, *u2, *u3;
 
-                        get_process_comm(si.si_pid, &name);
+                        /* Reading the comm costs another /proc access, only do so if it is going to be logged */
+                        if (_unlikely_(log_get_max_level() >= LOG_DEBUG))
+                                (void) get_process_comm(si.si_pid, &name);
 
                         log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
                                   si.si_pid, strna(name),
@@ -2379,8 +2947,8 @@ int manager_loop(Manager *m) {
         assert(m);
         m->exit_code = MANAGER_OK;
 
-        /* Release the path cache */
-        m->unit_path_cache = set_free_free(m->unit_path_cache);
+        /* Release the path cache, the directory listings it was built from are kept for the next reload */
+        m->unit_path_cache = set_free(m->unit_path_cache);
 
         manager_check_finished(m);
 
@@ -2408,7 +2976,9 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_gc_job_queue(m) > 0)
                         continue;
 
-                if (manager_dispatch_gc_unit_queue(m) > 0)
+                /* GC work is bounded, if it had to stop early let the other queues and pending events go
+                 * first before continuing */
+                if (!m->gc_unit_queue_yield && manager_dispatch_gc_unit_queue(m) > 0)
                         continue;
 
                 if (manager_dispatch_cleanup_queue(m) > 0)
@@ -2420,17 +2990,25 @@ int manager_loop(Manager *m) {
                 if (manager_dispatch_dbus_queue(m) > 0)
                         continue;
 
-                /* Sleep for half the watchdog time */
-                if (m->runtime_watchdog > 0 && m->runtime_watchdog != USEC_INFINITY && MANAGER_IS_SYSTEM(m)) {
+                /* Sleep for half the watchdog time, or not at all if GC work is left */
+                if (m->gc_unit_queue_yield)
+                        wait_usec = 0;
+                else if (m->runtime_watchdog > 0 && m->runtime_watchdog != USEC_INFINITY && MANAGER_IS_SYSTEM(m)) {
                         wait_usec = m->runtime_watchdog / 2;
                         if (wait_usec <= 0)
                                 wait_usec = 1;
                 } else
                         wait_usec = USEC_INFINITY;
 
+                /* Log messages that couldn't be passed to a busy journald are queued, retry them soon */
+                if (log_flush_journal() > 0)
+                        wait_usec = MIN(wait_usec, JOURNAL_FLUSH_RETRY_USEC);
+
                 r = sd_event_run(m->event, wait_usec);
                 if (r < 0)
                         return log_error_errno(r, "Failed to run event loop: %m");
+
+                m->gc_unit_queue_yield = false;
         }
 
         return m->exit_code;
@@ -2605,6 +3183,9 @@ int manager_open_serialization(Manager *m, FILE **_f) {
                 return -errno;
         }
 
+        /* The state is written and read back line by line, and only ever from this thread */
+        (void) __fsetlocking(f, FSETLOCKING_BYCALLER);
+
         *_f = f;
         return 0;
 }
@@ -32,7 +32,10 @@
 #include "hashmap.h"
 #include "ip-address-access.h"
 #include "list.h"
+#include "metrics.h"
+#include "prioq.h"
 #include "ratelimit.h"
+#include "string-pool.h"
 
 /* Enforce upper limit how many names we allow */
 #define MANAGER_MAX_NAMES 131072 /* 128K */
@@ -162,6 +165,9 @@ struct Manager {
 
         sd_event_source *run_queue_event_source;
 
+        /* Start jobs held back by StartJobsMax=, in the order they are to be admitted */
+        Prioq *deferred_start_jobs;
+
         char *notify_socket;
         int notify_fd;
         sd_event_source *notify_event_source;
@@ -177,17 +183,26 @@ struct Manager {
 
         sd_event_source *jobs_in_progress_event_source;
 
+        /* Armed while change signals are held back to coalesce them */
+        sd_event_source *dbus_queue_event_source;
+
         int user_lookup_fds[2];
         sd_event_source *user_lookup_event_source;
 
         UnitFileScope unit_file_scope;
         LookupPaths lookup_paths;
         Set *unit_path_cache;
+        /* Search path → directory listing the path cache is built from, kept across reloads */
+        Hashmap *unit_path_listings;
+        usec_t unit_path_timestamp;
 
         char **environment;
 
         usec_t runtime_watchdog;
         usec_t shutdown_watchdog;
+        usec_t dbus_signal_coalesce_usec;
+        usec_t accounting_cache_usec;
+        unsigned start_jobs_max;
 
         dual_timestamp timestamps[_MANAGER_TIMESTAMP_MAX];
 
@@ -201,6 +216,12 @@ struct Manager {
         /* Data specific to the mount subsystem */
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
+        struct libmnt_table *mount_table; /* the mount table as we processed it last */
+
+        /* Data specific to the path subsystem */
+        int path_inotify_fd;
+        sd_event_source *path_inotify_event_source;
+        Hashmap *path_watches; /* inotify watch descriptor → Set of PathSpec */
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
@@ -244,6 +265,9 @@ struct Manager {
         sd_event_source *cgroup_inotify_event_source;
         Hashmap *cgroup_inotify_wd_unit;
 
+        /* BPF access maps and programs, shared between units with identical IP address access lists */
+        Hashmap *bpf_firewall_policies;
+
         /* A defer event for handling cgroup empty events and processing them after SIGCHLD in all cases. */
         sd_event_source *cgroup_empty_event_source;
 
@@ -253,12 +277,20 @@ struct Manager {
 
         unsigned gc_marker;
 
+        /* Garbage collection statistics, shown in the dump */
+        uint64_t n_gc_units_swept;
+        uint64_t n_gc_units_collected;
+        usec_t gc_usec;
+
         /* Flags */
         ManagerExitCode exit_code:5;
 
         bool dispatching_load_queue:1;
         bool dispatching_dbus_queue:1;
 
+        /* Set when the GC unit queue ran out of budget, so that pending events are processed first */
+        bool gc_unit_queue_yield:1;
+
         bool taint_usr:1;
 
         bool ready_sent:1;
@@ -299,8 +331,12 @@ struct Manager {
         unsigned n_installed_jobs;
         unsigned n_failed_jobs;
 
+        /* Time from a job starting to run until it completed */
+        Histogram job_duration_usec;
+
         /* Jobs in progress watching */
         unsigned n_running_jobs;
+        unsigned n_admitted_start_jobs;
         unsigned n_on_console;
         unsigned jobs_in_progress_iteration;
 
@@ -321,11 +357,16 @@ struct Manager {
          * value where Unit objects are contained. */
         Hashmap *units_requiring_mounts_for;
 
+        /* Strings that tend to be repeated across many units, e.g. the paths in RequiresMountsFor= that
+         * PrivateTmp= and friends add to every service, are interned here */
+        StringPool *string_pool;
+
         /* Used for processing polkit authorization responses */
         Hashmap *polkit_registry;
 
         /* Dynamic users/groups, indexed by their name */
         Hashmap *dynamic_users;
+        DynamicUIDMap *dynamic_uid_map;
 
         /* Keep track of all UIDs and GIDs any of our services currently use. This is useful for the RemoveIPC= logic. */
         Hashmap *uid_refs;
@@ -333,6 +374,13 @@ struct Manager {
 
         /* When the user hits C-A-D more than 7 times per 2s, do something immediately... */
         RateLimit ctrl_alt_del_ratelimit;
+
+        /* Flood protection for the resource usage messages logged when units stop, and what got suppressed */
+        RateLimit unit_resources_ratelimit;
+        unsigned n_unit_resources_suppressed;
+        nsec_t unit_resources_suppressed_cpu;
+        uint64_t unit_resources_suppressed_ingress_bytes;
+        uint64_t unit_resources_suppressed_egress_bytes;
         EmergencyAction cad_burst_action;
 
         const char *unit_log_field;
@@ -394,6 +442,7 @@ int manager_serialize(Manager *m, FILE *f, FDSet *fds, bool switching_root);
 int manager_deserialize(Manager *m, FILE *f, FDSet *fds);
 
 int manager_reload(Manager *m);
+bool manager_unit_files_changed(Manager *m);
 
 void manager_reset_failed(Manager *m);
 
@@ -51,6 +51,7 @@
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_table*, mnt_free_table);
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_iter*, mnt_free_iter);
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct libmnt_tabdiff*, mnt_free_tabdiff);
 
 static const UnitActiveState state_translation_table[_MOUNT_STATE_MAX] = {
         [MOUNT_DEAD] = UNIT_INACTIVE,
@@ -1589,57 +1590,176 @@ fail:
         return r;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
-        _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
+static int mount_process_fs(Manager *m, struct libmnt_fs *fs, bool set_flags) {
+        _cleanup_free_ char *d = NULL, *p = NULL;
+        const char *device, *path, *options, *fstype;
+
+        assert(m);
+        assert(fs);
+
+        device = mnt_fs_get_source(fs);
+        path = mnt_fs_get_target(fs);
+        options = mnt_fs_get_options(fs);
+        fstype = mnt_fs_get_fstype(fs);
+
+        if (!device || !path)
+                return 0;
+
+        if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
+                return log_oom();
+
+        if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
+                return log_oom();
+
+        (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
+
+        return mount_setup_unit(m, d, p, options, fstype, set_flags);
+}
+
+static int mount_forget_fs(Manager *m, struct libmnt_table *t, struct libmnt_fs *fs) {
+        _cleanup_free_ char *p = NULL, *e = NULL;
+        struct libmnt_fs *below;
+        const char *path;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(t);
+        assert(fs);
+
+        /* The specified entry is gone from the mount table. If something else is still mounted at the same place
+         * (think stacked mounts), that's what the unit refers to now. Otherwise the unit isn't mounted anymore. */
+
+        path = mnt_fs_get_target(fs);
+        if (!path)
+                return 0;
+
+        below = mnt_table_find_target(t, path, MNT_ITER_BACKWARD);
+        if (below)
+                return mount_process_fs(m, below, true);
+
+        if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
+                return log_oom();
+
+        if (!is_path(p))
+                return 0;
+
+        r = unit_name_from_path(p, ".mount", &e);
+        if (r < 0)
+                return r;
+
+        u = manager_get_unit(m, e);
+        if (u)
+                MOUNT(u)->is_mounted = false;
+
+        return 0;
+}
+
+static int mount_apply_table_diff(Manager *m, struct libmnt_table *old_table, struct libmnt_table *new_table) {
+        _cleanup_(mnt_free_tabdiffp) struct libmnt_tabdiff *df = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
-        int r = 0;
+        Unit *u;
+        int r = 0, n;
 
         assert(m);
+        assert(old_table);
+        assert(new_table);
 
-        t = mnt_new_table();
-        if (!t)
+        df = mnt_new_tabdiff();
+        if (!df)
                 return log_oom();
 
         i = mnt_new_iter(MNT_ITER_FORWARD);
         if (!i)
                 return log_oom();
 
-        r = mnt_table_parse_mtab(t, NULL);
-        if (r < 0)
-                return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
+        n = mnt_diff_tables(df, old_table, new_table);
+        if (n < 0)
+                return log_error_errno(n, "Failed to compare mount tables: %m");
+
+        log_debug("Mount table changed in %i places.", n);
+
+        /* Everything we knew about before is still mounted, unless the diff tells us otherwise */
+        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
+                if (MOUNT(u)->from_proc_self_mountinfo)
+                        MOUNT(u)->is_mounted = true;
 
-        r = 0;
         for (;;) {
-                const char *device, *path, *options, *fstype;
-                _cleanup_free_ char *d = NULL, *p = NULL;
-                struct libmnt_fs *fs;
-                int k;
+                struct libmnt_fs *old_fs, *new_fs;
+                int oper, k;
 
-                k = mnt_table_next_fs(t, i, &fs);
+                k = mnt_tabdiff_next_change(df, i, &old_fs, &new_fs, &oper);
                 if (k == 1)
                         break;
                 if (k < 0)
-                        return log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
+                        return log_error_errno(k, "Failed to get next mount table change: %m");
 
-                device = mnt_fs_get_source(fs);
-                path = mnt_fs_get_target(fs);
-                options = mnt_fs_get_options(fs);
-                fstype = mnt_fs_get_fstype(fs);
+                if (old_fs && IN_SET(oper, MNT_TABDIFF_UMOUNT, MNT_TABDIFF_MOVE)) {
+                        k = mount_forget_fs(m, new_table, old_fs);
+                        if (r == 0 && k < 0)
+                                r = k;
+                }
 
-                if (!device || !path)
-                        continue;
+                if (new_fs && oper != MNT_TABDIFF_UMOUNT) {
+                        k = mount_process_fs(m, new_fs, true);
+                        if (r == 0 && k < 0)
+                                r = k;
+                }
+        }
 
-                if (cunescape(device, UNESCAPE_RELAX, &d) < 0)
-                        return log_oom();
+        return r;
+}
+
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, bool full) {
+        _cleanup_(mnt_free_tablep) struct libmnt_table *t = NULL;
+        _cleanup_(mnt_free_iterp) struct libmnt_iter *i = NULL;
+        int r = 0;
 
-                if (cunescape(path, UNESCAPE_RELAX, &p) < 0)
+        assert(m);
+
+        t = mnt_new_table();
+        if (!t)
+                return log_oom();
+
+        r = mnt_table_parse_mtab(t, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
+
+        /* On hosts with many mounts, most of the table stays the same between two change events. Hence, if we know
+         * what we processed last time, only look at the entries that changed since then. */
+        if (set_flags && !full && m->mount_table)
+                r = mount_apply_table_diff(m, m->mount_table, t);
+        else {
+                i = mnt_new_iter(MNT_ITER_FORWARD);
+                if (!i)
                         return log_oom();
 
-                (void) device_found_node(m, d, true, DEVICE_FOUND_MOUNT, set_flags);
+                r = 0;
+                for (;;) {
+                        struct libmnt_fs *fs;
+                        int k;
 
-                k = mount_setup_unit(m, d, p, options, fstype, set_flags);
-                if (r == 0 && k < 0)
-                        r = k;
+                        k = mnt_table_next_fs(t, i, &fs);
+                        if (k == 1)
+                                break;
+                        if (k < 0) {
+                                r = log_error_errno(k, "Failed to get next entry from /proc/self/mountinfo: %m");
+                                break;
+                        }
+
+                        k = mount_process_fs(m, fs, set_flags);
+                        if (r == 0 && k < 0)
+                                r = k;
+                }
+        }
+
+        mnt_free_table(m->mount_table);
+        m->mount_table = NULL;
+
+        /* If we failed to process some entry, don't base the next diff on this table, rescan fully instead */
+        if (r >= 0) {
+                m->mount_table = t;
+                t = NULL;
         }
 
         return r;
@@ -1652,6 +1772,9 @@ static void mount_shutdown(Manager *m) {
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
+
+        mnt_free_table(m->mount_table);
+        m->mount_table = NULL;
 }
 
 static int mount_get_timeout(Unit *u, usec_t *timeout) {
@@ -1757,7 +1880,7 @@ static void mount_enumerate(Manager *m) {
                 (void) sd_event_source_set_description(m->mount_event_source, "mount-monitor-dispatch");
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        r = mount_load_proc_self_mountinfo(m, false, true);
         if (r < 0)
                 goto fail;
 
@@ -1768,8 +1891,9 @@ fail:
 }
 
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        _cleanup_set_free_ Set *around = NULL, *gone = NULL;
+        _cleanup_set_free_ Set *gone = NULL;
         Manager *m = userdata;
+        bool full = true;
         const char *what;
         Iterator i;
         Unit *u;
@@ -1780,6 +1904,9 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
 
         if (fd == mnt_monitor_get_fd(m->mount_monitor)) {
                 bool rescan = false;
+                int type;
+
+                full = false;
 
                 /* Drain all events and verify that the event is valid.
                  *
@@ -1789,19 +1916,24 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                  *
                  * error: r < 0; valid: r == 0, false positive: rc == 1 */
                 do {
-                        r = mnt_monitor_next_change(m->mount_monitor, NULL, NULL);
-                        if (r == 0)
+                        r = mnt_monitor_next_change(m->mount_monitor, NULL, &type);
+                        if (r == 0) {
                                 rescan = true;
-                        else if (r < 0)
+
+                                /* The kernel doesn't know about the options in utab, and they are not covered by
+                                 * libmount's table diff, hence look at every entry again if they changed. */
+                                if (type == MNT_MONITOR_TYPE_USERSPACE)
+                                        full = true;
+                        } else if (r < 0)
                                 return log_error_errno(r, "Failed to drain libmount events");
                 } while (r == 0);
 
-                log_debug("libmount event [rescan: %s]", yes_no(rescan));
+                log_debug("libmount event [rescan: %s, full: %s]", yes_no(rescan), yes_no(full));
                 if (!rescan)
                         return 0;
         }
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        r = mount_load_proc_self_mountinfo(m, true, full);
         if (r < 0) {
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
@@ -1879,26 +2011,26 @@ static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                         }
                 }
 
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
-
-                        if (set_ensure_allocated(&around, &string_hash_ops) < 0 ||
-                            set_put(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
-                }
-
                 /* Reset the flags for later calls */
                 mount->is_mounted = mount->just_mounted = mount->just_changed = false;
         }
 
-        SET_FOREACH(what, gone, i) {
-                if (set_contains(around, what))
-                        continue;
+        if (set_isempty(gone))
+                return 0;
+
+        /* A device might still be mounted elsewhere. Only units that are still mounted have
+         * from_proc_self_mountinfo set at this point. */
+        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                Mount *mount = MOUNT(u);
 
+                if (mount->from_proc_self_mountinfo &&
+                    mount->parameters_proc_self_mountinfo.what)
+                        (void) set_remove(gone, mount->parameters_proc_self_mountinfo.what);
+        }
+
+        SET_FOREACH(what, gone, i)
                 /* Let the device units know that the device is no longer mounted */
                 (void) device_found_node(m, what, false, DEVICE_FOUND_MOUNT, true);
-        }
 
         return 0;
 }
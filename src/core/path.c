@@ -46,45 +46,179 @@ static const UnitActiveState state_translation_table[_PATH_STATE_MAX] = {
         [PATH_FAILED] = UNIT_FAILED
 };
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata);
-
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
+static const uint32_t flags_table[_PATH_TYPE_MAX] = {
+        [PATH_EXISTS] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
+        [PATH_EXISTS_GLOB] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
+        [PATH_CHANGED] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO,
+        [PATH_MODIFIED] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_MODIFY,
+        [PATH_DIRECTORY_NOT_EMPTY] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CREATE|IN_MOVED_TO
+};
 
-        static const int flags_table[_PATH_TYPE_MAX] = {
-                [PATH_EXISTS] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
-                [PATH_EXISTS_GLOB] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB,
-                [PATH_CHANGED] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO,
-                [PATH_MODIFIED] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_MODIFY,
-                [PATH_DIRECTORY_NOT_EMPTY] = IN_DELETE_SELF|IN_MOVE_SELF|IN_ATTRIB|IN_CREATE|IN_MOVED_TO
-        };
+static int path_inotify_dispatch(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 
-        bool exists = false;
-        char *slash, *oldslash = NULL;
+static int path_inotify_get(Manager *m) {
         int r;
 
+        assert(m);
+
+        /* All path units share one inotify fd, and watches on the same inode are shared between them */
+
+        if (m->path_inotify_fd >= 0)
+                return m->path_inotify_fd;
+
+        m->path_inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (m->path_inotify_fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(m->event, &m->path_inotify_event_source, m->path_inotify_fd, EPOLLIN, path_inotify_dispatch, m);
+        if (r < 0) {
+                m->path_inotify_fd = safe_close(m->path_inotify_fd);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(m->path_inotify_event_source, "path");
+
+        return m->path_inotify_fd;
+}
+
+static PathSpecWatch *path_spec_find_watch(PathSpecWatch *watches, size_t n_watches, int wd) {
+        size_t i;
+
+        for (i = 0; i < n_watches; i++)
+                if (watches[i].wd == wd)
+                        return watches + i;
+
+        return NULL;
+}
+
+static void path_watch_unref(Manager *m, int wd, PathSpec *s) {
+        Set *specs;
+
+        assert(m);
         assert(s);
-        assert(s->unit);
-        assert(handler);
 
-        path_spec_unwatch(s);
+        specs = hashmap_get(m->path_watches, INT_TO_PTR(wd));
+        if (!specs)
+                return;
+
+        if (!set_remove(specs, s))
+                return;
+
+        if (!set_isempty(specs))
+                return;
+
+        /* We were the last one interested in this watch */
+        (void) hashmap_remove(m->path_watches, INT_TO_PTR(wd));
+        set_free(specs);
+
+        (void) inotify_rm_watch(m->path_inotify_fd, wd);
+}
+
+static int path_spec_add_watch(PathSpec *s, int fd, const char *path, uint32_t mask) {
+        Manager *m = s->unit->manager;
+        PathSpecWatch *w;
+        Set *specs;
+        int wd, r;
+
+        /* Somebody else might be watching the same inode already, hence extend the mask rather than replace it. The
+         * specs filter the events they get by their own mask. */
+        wd = inotify_add_watch(fd, path, mask|IN_MASK_ADD);
+        if (wd < 0)
+                return -errno;
+
+        w = path_spec_find_watch(s->watches, s->n_watches, wd);
+        if (w) {
+                w->mask |= mask;
+                return wd;
+        }
+
+        if (!GREEDY_REALLOC(s->watches, s->n_watches_allocated, s->n_watches + 1)) {
+                r = -ENOMEM;
+                goto fail;
+        }
 
-        s->inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (s->inotify_fd < 0) {
-                r = -errno;
+        r = hashmap_ensure_allocated(&m->path_watches, NULL);
+        if (r < 0)
                 goto fail;
+
+        specs = hashmap_get(m->path_watches, INT_TO_PTR(wd));
+        if (!specs) {
+                specs = set_new(NULL);
+                if (!specs) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                r = hashmap_put(m->path_watches, INT_TO_PTR(wd), specs);
+                if (r < 0) {
+                        set_free(specs);
+                        goto fail;
+                }
         }
 
-        r = sd_event_add_io(s->unit->manager->event, &s->event_source, s->inotify_fd, EPOLLIN, handler, s);
+        r = set_put(specs, s);
         if (r < 0)
                 goto fail;
 
-        (void) sd_event_source_set_description(s->event_source, "path");
+        s->watches[s->n_watches++] = (PathSpecWatch) {
+                .wd = wd,
+                .mask = mask,
+        };
+
+        return wd;
+
+fail:
+        specs = hashmap_get(m->path_watches, INT_TO_PTR(wd));
+        if (set_isempty(specs)) {
+                (void) hashmap_remove(m->path_watches, INT_TO_PTR(wd));
+                set_free(specs);
+                (void) inotify_rm_watch(fd, wd);
+        }
+
+        return r;
+}
+
+static void path_spec_release_watches(PathSpec *s, PathSpecWatch *watches, size_t n_watches) {
+        size_t i;
+
+        assert(s);
+
+        /* Releases the watches in the specified array, except for those the spec currently holds */
+
+        for (i = 0; i < n_watches; i++)
+                if (!path_spec_find_watch(s->watches, s->n_watches, watches[i].wd))
+                        path_watch_unref(s->unit->manager, watches[i].wd, s);
+}
+
+int path_spec_watch(PathSpec *s) {
+        _cleanup_free_ PathSpecWatch *old_watches = NULL;
+        size_t n_old_watches;
+        bool exists = false;
+        char *slash, *oldslash = NULL;
+        int fd, r;
+
+        assert(s);
+        assert(s->unit);
+
+        fd = path_inotify_get(s->unit->manager);
+        if (fd < 0) {
+                r = fd;
+                goto fail;
+        }
+
+        /* Set up the new watches before releasing the old ones, so that watches we keep are not needlessly
+         * removed and added again. */
+        old_watches = s->watches;
+        n_old_watches = s->n_watches;
+        s->watches = NULL;
+        s->n_watches = s->n_watches_allocated = 0;
+        s->primary_wd = -1;
 
         /* This assumes the path was passed through path_kill_slashes()! */
 
         for (slash = strchr(s->path, '/'); ; slash = strchr(slash+1, '/')) {
                 char *cut = NULL;
-                int flags;
+                uint32_t flags;
                 char tmp;
 
                 if (slash) {
@@ -96,15 +230,15 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                 } else
                         flags = flags_table[s->type];
 
-                r = inotify_add_watch(s->inotify_fd, s->path, flags);
+                r = path_spec_add_watch(s, fd, s->path, flags);
                 if (r < 0) {
-                        if (IN_SET(errno, EACCES, ENOENT)) {
+                        if (IN_SET(r, -EACCES, -ENOENT)) {
                                 if (cut)
                                         *cut = tmp;
                                 break;
                         }
 
-                        r = log_warning_errno(errno, "Failed to add watch on %s: %s", s->path, errno == ENOSPC ? "too many watches" : strerror(-r));
+                        r = log_warning_errno(r, "Failed to add watch on %s: %s", s->path, r == -ENOSPC ? "too many watches" : strerror(-r));
                         if (cut)
                                 *cut = tmp;
                         goto fail;
@@ -117,7 +251,7 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
                                 char tmp2 = *cut2;
                                 *cut2 = '\0';
 
-                                (void) inotify_add_watch(s->inotify_fd, s->path, IN_MOVE_SELF);
+                                (void) path_spec_add_watch(s, fd, s->path, IN_MOVE_SELF);
                                 /* Error is ignored, the worst can happen is we get spurious events. */
 
                                 *cut2 = tmp2;
@@ -137,51 +271,44 @@ int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler) {
         }
 
         if (!exists) {
-                r = log_error_errno(errno, "Failed to add watch on any of the components of %s: %m", s->path);
+                r = log_error_errno(r, "Failed to add watch on any of the components of %s: %m", s->path);
                 /* either EACCESS or ENOENT */
                 goto fail;
         }
 
+        path_spec_release_watches(s, old_watches, n_old_watches);
         return 0;
 
 fail:
         path_spec_unwatch(s);
+        path_spec_release_watches(s, old_watches, n_old_watches);
         return r;
 }
 
 void path_spec_unwatch(PathSpec *s) {
-        assert(s);
+        size_t i;
 
-        s->event_source = sd_event_source_unref(s->event_source);
-        s->inotify_fd = safe_close(s->inotify_fd);
-}
+        assert(s);
 
-int path_spec_fd_event(PathSpec *s, uint32_t revents) {
-        union inotify_event_buffer buffer;
-        struct inotify_event *e;
-        ssize_t l;
-        int r = 0;
+        for (i = 0; i < s->n_watches; i++)
+                path_watch_unref(s->unit->manager, s->watches[i].wd, s);
 
-        if (revents != EPOLLIN) {
-                log_error("Got invalid poll event on inotify.");
-                return -EINVAL;
-        }
+        s->n_watches = 0;
+        s->primary_wd = -1;
+}
 
-        l = read(s->inotify_fd, &buffer, sizeof(buffer));
-        if (l < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0;
+static bool path_spec_wants_event(PathSpec *s, const struct inotify_event *e) {
+        PathSpecWatch *w;
 
-                return log_error_errno(errno, "Failed to read inotify event: %m");
-        }
+        assert(s);
+        assert(e);
 
-        FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                if (IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) &&
-                    s->primary_wd == e->wd)
-                        r = 1;
-        }
+        w = path_spec_find_watch(s->watches, s->n_watches, e->wd);
+        if (!w)
+                return false;
 
-        return r;
+        /* The kernel's mask is the combination of everybody's masks, only look at what this spec asked for */
+        return e->mask & (w->mask | IN_IGNORED | IN_UNMOUNT);
 }
 
 static bool path_spec_check_good(PathSpec *s, bool initial) {
@@ -243,8 +370,9 @@ static void path_spec_dump(PathSpec *s, FILE *f, const char *prefix) {
 
 void path_spec_done(PathSpec *s) {
         assert(s);
-        assert(s->inotify_fd == -1);
+        assert(s->n_watches == 0);
 
+        free(s->watches);
         free(s->path);
 }
 
@@ -415,7 +543,7 @@ static int path_watch(Path *p) {
         assert(p);
 
         LIST_FOREACH(spec, s, p->specs) {
-                r = path_spec_watch(s, path_dispatch_io);
+                r = path_spec_watch(s);
                 if (r < 0)
                         return r;
         }
@@ -667,49 +795,108 @@ _pure_ static const char *path_sub_state_to_string(Unit *u) {
         return path_state_to_string(PATH(u)->state);
 }
 
-static int path_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
-        PathSpec *s = userdata;
-        Path *p;
-        int changed;
+static void path_dispatch_event(Path *p, bool changed) {
+        assert(p);
 
-        assert(s);
-        assert(s->unit);
-        assert(fd >= 0);
+        if (!IN_SET(p->state, PATH_WAITING, PATH_RUNNING))
+                return;
 
-        p = PATH(s->unit);
+        /* If we are already running, then remember that one event was
+         * dispatched so that we restart the service only if something
+         * actually changed on disk */
+        p->inotify_triggered = true;
 
-        if (!IN_SET(p->state, PATH_WAITING, PATH_RUNNING))
+        if (changed)
+                path_enter_running(p);
+        else
+                path_enter_waiting(p, false, true);
+}
+
+static int path_trigger_add(Hashmap **triggered, Path *p, bool changed) {
+        int r;
+
+        assert(triggered);
+        assert(p);
+
+        /* Values are 1 for "recheck", and 2 for "changed" */
+        if (!changed && hashmap_get(*triggered, p))
                 return 0;
 
-        /* log_debug("inotify wakeup on %s.", u->id); */
+        r = hashmap_ensure_allocated(triggered, NULL);
+        if (r < 0)
+                return r;
 
-        LIST_FOREACH(spec, s, p->specs)
-                if (path_spec_owns_inotify_fd(s, fd))
-                        break;
+        return hashmap_replace(*triggered, p, INT_TO_PTR(changed ? 2 : 1));
+}
+
+static int path_inotify_dispatch(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        _cleanup_hashmap_free_ Hashmap *triggered = NULL;
+        union inotify_event_buffer buffer;
+        struct inotify_event *e;
+        Manager *m = userdata;
+        bool overflow = false;
+        Iterator i;
+        ssize_t l;
+        void *v;
+        Path *p;
+        Unit *u;
+
+        assert(m);
+        assert(fd == m->path_inotify_fd);
 
-        if (!s) {
-                log_error("Got event on unknown fd.");
+        if (revents != EPOLLIN) {
+                log_error("Got invalid poll event on inotify.");
                 goto fail;
         }
 
-        changed = path_spec_fd_event(s, revents);
-        if (changed < 0)
+        l = read(fd, &buffer, sizeof(buffer));
+        if (l < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                log_error_errno(errno, "Failed to read inotify event: %m");
                 goto fail;
+        }
 
-        /* If we are already running, then remember that one event was
-         * dispatched so that we restart the service only if something
-         * actually changed on disk */
-        p->inotify_triggered = true;
+        /* First collect which units are affected, only then process them, as that changes the watches */
 
-        if (changed)
-                path_enter_running(p);
-        else
-                path_enter_waiting(p, false, true);
+        FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                PathSpec *s;
+                Iterator j;
+                Set *specs;
+
+                if (e->mask & IN_Q_OVERFLOW) {
+                        overflow = true;
+                        continue;
+                }
+
+                specs = hashmap_get(m->path_watches, INT_TO_PTR(e->wd));
+                SET_FOREACH(s, specs, j) {
+                        if (!path_spec_wants_event(s, e))
+                                continue;
+
+                        if (path_trigger_add(&triggered, PATH(s->unit),
+                                             IN_SET(s->type, PATH_CHANGED, PATH_MODIFIED) && s->primary_wd == e->wd) < 0)
+                                overflow = true;
+                }
+        }
+
+        /* We lost events, hence recheck everything */
+        if (overflow)
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_PATH])
+                        if (path_trigger_add(&triggered, PATH(u), false) < 0)
+                                path_dispatch_event(PATH(u), false);
+
+        HASHMAP_FOREACH_KEY(v, p, triggered, i)
+                path_dispatch_event(p, PTR_TO_INT(v) > 1);
 
         return 0;
 
 fail:
-        path_enter_dead(p, PATH_FAILURE_RESOURCES);
+        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_PATH])
+                if (IN_SET(PATH(u)->state, PATH_WAITING, PATH_RUNNING))
+                        path_enter_dead(PATH(u), PATH_FAILURE_RESOURCES);
+
         return 0;
 }
 
@@ -747,6 +934,14 @@ static void path_reset_failed(Unit *u) {
         p->result = PATH_SUCCESS;
 }
 
+static void path_shutdown(Manager *m) {
+        assert(m);
+
+        m->path_inotify_event_source = sd_event_source_unref(m->path_inotify_event_source);
+        m->path_inotify_fd = safe_close(m->path_inotify_fd);
+        m->path_watches = hashmap_free_with_destructor(m->path_watches, set_free);
+}
+
 static const char* const path_type_table[_PATH_TYPE_MAX] = {
         [PATH_EXISTS] = "PathExists",
         [PATH_EXISTS_GLOB] = "PathExistsGlob",
@@ -779,6 +974,8 @@ const UnitVTable path_vtable = {
 
         .coldplug = path_coldplug,
 
+        .shutdown = path_shutdown,
+
         .dump = path_dump,
 
         .start = path_start,
@@ -35,31 +35,32 @@ typedef enum PathType {
         _PATH_TYPE_INVALID = -1
 } PathType;
 
+typedef struct PathSpecWatch {
+        int wd;
+        uint32_t mask; /* the events this spec is interested in */
+} PathSpecWatch;
+
 typedef struct PathSpec {
         Unit *unit;
 
         char *path;
 
-        sd_event_source *event_source;
-
         LIST_FIELDS(struct PathSpec, spec);
 
         PathType type;
-        int inotify_fd;
         int primary_wd;
 
+        /* The watches on the manager's shared inotify fd this spec holds a reference to */
+        PathSpecWatch *watches;
+        size_t n_watches, n_watches_allocated;
+
         bool previous_exists;
 } PathSpec;
 
-int path_spec_watch(PathSpec *s, sd_event_io_handler_t handler);
+int path_spec_watch(PathSpec *s);
 void path_spec_unwatch(PathSpec *s);
-int path_spec_fd_event(PathSpec *s, uint32_t events);
 void path_spec_done(PathSpec *s);
 
-static inline bool path_spec_owns_inotify_fd(PathSpec *s, int fd) {
-        return s->inotify_fd == fd;
-}
-
 typedef enum PathResult {
         PATH_SUCCESS,
         PATH_FAILURE_RESOURCES,
@@ -43,6 +43,7 @@
 #include "string-util.h"
 #include "switch-root.h"
 #include "terminal-util.h"
+#include "time-util.h"
 #include "umount.h"
 #include "util.h"
 #include "virt.h"
@@ -159,6 +160,12 @@ static int switch_root_initramfs(void) {
         return switch_root("/run/initramfs", "/oldroot", false, MS_BIND);
 }
 
+static void log_duration(const char *what, usec_t start) {
+        char buf[FORMAT_TIMESPAN_MAX];
+
+        log_debug("%s took %s.", what, format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - start, USEC_PER_MSEC));
+}
+
 int main(int argc, char *argv[]) {
         bool need_umount, need_swapoff, need_loop_detach, need_dm_detach;
         bool in_container, use_watchdog = false;
@@ -243,8 +250,12 @@ int main(int argc, char *argv[]) {
                         cg_trim(SYSTEMD_CGROUP_CONTROLLER, cgroup, false);
 
                 if (need_umount) {
+                        usec_t ts = now(CLOCK_MONOTONIC);
+
                         log_info("Unmounting file systems.");
                         r = umount_all(&changed);
+                        log_duration("Unmounting file systems", ts);
+
                         if (r == 0) {
                                 need_umount = false;
                                 log_info("All filesystems unmounted.");
@@ -255,8 +266,12 @@ int main(int argc, char *argv[]) {
                 }
 
                 if (need_swapoff) {
+                        usec_t ts = now(CLOCK_MONOTONIC);
+
                         log_info("Deactivating swaps.");
                         r = swapoff_all(&changed);
+                        log_duration("Deactivating swaps", ts);
+
                         if (r == 0) {
                                 need_swapoff = false;
                                 log_info("All swaps deactivated.");
@@ -267,8 +282,12 @@ int main(int argc, char *argv[]) {
                 }
 
                 if (need_loop_detach) {
+                        usec_t ts = now(CLOCK_MONOTONIC);
+
                         log_info("Detaching loop devices.");
                         r = loopback_detach_all(&changed);
+                        log_duration("Detaching loop devices", ts);
+
                         if (r == 0) {
                                 need_loop_detach = false;
                                 log_info("All loop devices detached.");
@@ -279,8 +298,12 @@ int main(int argc, char *argv[]) {
                 }
 
                 if (need_dm_detach) {
+                        usec_t ts = now(CLOCK_MONOTONIC);
+
                         log_info("Detaching DM devices.");
                         r = dm_detach_all(&changed);
+                        log_duration("Detaching DM devices", ts);
+
                         if (r == 0) {
                                 need_dm_detach = false;
                                 log_info("All DM devices detached.");
@@ -61,6 +61,9 @@
 #include "unit.h"
 #include "user-util.h"
 
+/* How many queued connections an Accept=yes socket takes per wakeup */
+#define SOCKET_ACCEPT_BATCH_MAX 16
+
 struct SocketPeer {
         unsigned n_ref;
 
@@ -2809,17 +2812,62 @@ static int socket_accept_do(Socket *s, int fd) {
         return cfd;
 }
 
-static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
+static int socket_accept_many(Socket *s, int fd, int *cfds, size_t n_cfds, int (*deliver)(int cfd, void *userdata), void *userdata) {
+        size_t n = 0;
+        int cfd, r;
+
+        assert(s);
+        assert(fd >= 0);
+        assert(cfds || deliver);
+        assert(n_cfds > 0);
+
+        /* Accepts up to n_cfds connections that are already queued on the listening socket. Each one is either
+         * stored in cfds or handed to deliver(). Failing to accept the first connection is an error, a later
+         * failure (usually EAGAIN) just ends the batch. Returns the number of connections accepted. */
+
+        while (n < n_cfds) {
+                cfd = socket_accept_do(s, fd);
+                if (cfd < 0) {
+                        if (n > 0)
+                                break;
+
+                        return cfd;
+                }
+
+                if (deliver) {
+                        r = deliver(cfd, userdata);
+                        safe_close(cfd);
+                        if (r < 0)
+                                return n > 0 ? (int) n : r;
+                } else
+                        cfds[n] = cfd;
+
+                n++;
+        }
+
+        return (int) n;
+}
+
+static int send_connection_fd(int cfd, void *userdata) {
+        return send_one_fd(PTR_TO_FD(userdata), cfd, 0);
+}
+
+static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd, int *cfds, size_t n_cfds) {
         _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        size_t n = 0;
         int cfd, r;
         pid_t pid;
 
         assert(s);
         assert(p);
         assert(fd >= 0);
+        assert(cfds);
+        assert(n_cfds > 0);
 
         /* Similar to socket_address_listen_in_cgroup(), but for accept() rathern than socket(): make sure that any
-         * connection socket is also properly associated with the cgroup. */
+         * connection socket is also properly associated with the cgroup. Accepts up to n_cfds connections at
+         * once, so that the helper process is only forked off once for a burst of them. Returns the number of
+         * connections accepted. */
 
         if (!IN_SET(p->address.sockaddr.sa.sa_family, AF_INET, AF_INET6))
                 goto shortcut;
@@ -2841,15 +2889,9 @@ static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
 
                 pair[0] = safe_close(pair[0]);
 
-                cfd = socket_accept_do(s, fd);
-                if (cfd < 0) {
-                        log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
-                        _exit(EXIT_FAILURE);
-                }
-
-                r = send_one_fd(pair[1], cfd, 0);
+                r = socket_accept_many(s, fd, NULL, n_cfds, send_connection_fd, FD_TO_PTR(pair[1]));
                 if (r < 0) {
-                        log_unit_error_errno(UNIT(s), r, "Failed to send connection socket to parent: %m");
+                        log_unit_error_errno(UNIT(s), r, "Failed to accept connection socket: %m");
                         _exit(EXIT_FAILURE);
                 }
 
@@ -2857,31 +2899,40 @@ static int socket_accept_in_cgroup(Socket *s, SocketPort *p, int fd) {
         }
 
         pair[1] = safe_close(pair[1]);
-        cfd = receive_one_fd(pair[0], 0);
+
+        /* The helper sends one connection per datagram, and we see EOF once it exited */
+        while (n < n_cfds) {
+                cfd = receive_one_fd(pair[0], 0);
+                if (cfd < 0)
+                        break;
+
+                cfds[n++] = cfd;
+        }
 
         /* We synchronously wait for the helper, as it shouldn't be slow */
         r = wait_for_terminate_and_warn("accept-cgroup-helper", pid, false);
         if (r < 0) {
-                safe_close(cfd);
+                close_many(cfds, n);
                 return r;
         }
 
-        if (cfd < 0)
+        if (n == 0)
                 return log_unit_error_errno(UNIT(s), cfd, "Failed to receive connection socket: %m");
 
-        return cfd;
+        return (int) n;
 
 shortcut:
-        cfd = socket_accept_do(s, fd);
-        if (cfd < 0)
-                return log_unit_error_errno(UNIT(s), cfd, "Failed to accept connection socket: %m");
+        r = socket_accept_many(s, fd, cfds, n_cfds, NULL, NULL);
+        if (r < 0)
+                return log_unit_error_errno(UNIT(s), r, "Failed to accept connection socket: %m");
 
-        return cfd;
+        return r;
 }
 
 static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         SocketPort *p = userdata;
-        int cfd = -1;
+        int cfds[SOCKET_ACCEPT_BATCH_MAX];
+        int i, n;
 
         assert(p);
         assert(fd >= 0);
@@ -2900,18 +2951,29 @@ static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
                 goto fail;
         }
 
-        if (p->socket->accept &&
-            p->type == SOCKET_SOCKET &&
-            socket_address_can_accept(&p->address)) {
+        if (!p->socket->accept ||
+            p->type != SOCKET_SOCKET ||
+            !socket_address_can_accept(&p->address)) {
+                socket_enter_running(p->socket, -1);
+                return 0;
+        }
 
-                cfd = socket_accept_in_cgroup(p->socket, p, fd);
-                if (cfd < 0)
-                        goto fail;
+        /* Drain a burst of connections in one go, instead of returning to the event loop for each of them */
+        n = socket_accept_in_cgroup(p->socket, p, fd, cfds, ELEMENTSOF(cfds));
+        if (n < 0)
+                goto fail;
+
+        for (i = 0; i < n; i++) {
+                /* socket_enter_running() might have stopped the socket, drop whatever is left then */
+                if (p->socket->state != SOCKET_LISTENING) {
+                        close_many(cfds + i, n - i);
+                        break;
+                }
 
-                socket_apply_socket_options(p->socket, cfd);
+                socket_apply_socket_options(p->socket, cfds[i]);
+                socket_enter_running(p->socket, cfds[i]);
         }
 
-        socket_enter_running(p->socket, cfd);
         return 0;
 
 fail:
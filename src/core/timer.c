@@ -386,9 +386,22 @@ static void timer_enter_waiting(Timer *t, bool initial) {
 
                         b = t->last_trigger.realtime > 0 ? t->last_trigger.realtime : ts.realtime;
 
-                        r = calendar_spec_next_usec(v->calendar_spec, b, &v->next_elapse);
-                        if (r < 0)
-                                continue;
+                        /* The next elapse time stays the same as long as the base is between the one we calculated
+                         * it from and the elapse time itself. Calculating it is expensive for sparse specs (and
+                         * needs a fork() for specs with a time zone), and timers are rearmed on every clock change,
+                         * hence reuse the last result when we can. */
+                        if (v->next_elapse_base == USEC_INFINITY ||
+                            b < v->next_elapse_base ||
+                            b >= v->next_elapse) {
+
+                                r = calendar_spec_next_usec(v->calendar_spec, b, &v->next_elapse);
+                                if (r < 0) {
+                                        v->next_elapse_base = USEC_INFINITY;
+                                        continue;
+                                }
+
+                                v->next_elapse_base = b;
+                        }
 
                         if (!found_realtime)
                                 t->next_elapse_realtime = v->next_elapse;
@@ -42,6 +42,7 @@ typedef struct TimerValue {
         usec_t value; /* only for monotonic events */
         CalendarSpec *calendar_spec; /* only for calendar events */
         usec_t next_elapse;
+        usec_t next_elapse_base; /* only for calendar events: the time next_elapse was calculated from */
 
         LIST_FIELDS(struct TimerValue, value);
 } TimerValue;
@@ -302,12 +302,17 @@ static void transaction_drop_redundant(Transaction *tr) {
 
         /* Goes through the transaction and removes all jobs of the units
          * whose jobs are all noops. If not all of a unit's jobs are
-         * redundant, they are kept. */
+         * redundant, they are kept.
+         *
+         * Whether a job is redundant only depends on its own unit, and
+         * deleting without dependencies never touches the jobs of other
+         * units, hence a single pass is enough. Only the current hashmap
+         * entry is ever removed, which is safe while iterating. */
 
         assert(tr);
 
-rescan:
         HASHMAP_FOREACH(j, tr->jobs, i) {
+                Unit *u = j->unit;
                 Job *k;
 
                 LIST_FOREACH(transaction, k, j) {
@@ -319,8 +324,8 @@ rescan:
                 }
 
                 /* log_debug("Found redundant job %s/%s, dropping.", j->unit->id, job_type_to_string(j->type)); */
-                transaction_delete_job(tr, j, false);
-                goto rescan;
+                while ((k = hashmap_get(tr->jobs, u)))
+                        transaction_delete_job(tr, k, false);
         next_unit:;
         }
 }
@@ -503,14 +508,62 @@ static int transaction_verify_order(Transaction *tr, unsigned *generation, sd_bu
 }
 
 static void transaction_collect_garbage(Transaction *tr) {
+        _cleanup_free_ Job **queue = NULL;
+        size_t n_queue = 0, n_allocated = 0;
         Iterator i;
-        Job *j;
+        Job *j, *k;
 
         assert(tr);
 
-        /* Drop jobs that are not required by any other job */
+        /* Drop jobs that are not required by any other job.
+         *
+         * Instead of rescanning the whole transaction after every
+         * deletion, keep a queue of unreferenced jobs. A garbage job has
+         * no object links, so deleting it never cascades, and the only
+         * jobs that can become garbage because of it are the ones it
+         * pulled in itself. Each job is queued at most once, as its
+         * object list only ever shrinks. */
+
+        HASHMAP_FOREACH(j, tr->jobs, i)
+                LIST_FOREACH(transaction, k, j) {
+                        if (tr->anchor_job == k || k->object_list)
+                                continue;
+
+                        if (!GREEDY_REALLOC(queue, n_allocated, n_queue + 1))
+                                goto rescan;
+
+                        queue[n_queue++] = k;
+                }
+
+        while (n_queue > 0) {
+                j = queue[--n_queue];
+
+                assert(!j->object_list);
+
+                while (j->subject_list) {
+                        Job *other = j->subject_list->object;
+
+                        job_dependency_free(j->subject_list);
+
+                        if (tr->anchor_job == other || other->object_list)
+                                continue;
+
+                        if (!GREEDY_REALLOC(queue, n_allocated, n_queue + 1)) {
+                                transaction_delete_job(tr, j, true);
+                                goto rescan;
+                        }
+
+                        queue[n_queue++] = other;
+                }
+
+                /* log_debug("Garbage collecting job %s/%s", j->unit->id, job_type_to_string(j->type)); */
+                transaction_delete_job(tr, j, true);
+        }
+
+        return;
 
 rescan:
+        /* Out of memory, fall back to the plain fixpoint loop */
         HASHMAP_FOREACH(j, tr->jobs, i) {
                 if (tr->anchor_job == j || j->object_list) {
                         /* log_debug("Keeping job %s/%s because of %s/%s", */
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/loop.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/mount.h>
 #include <sys/swap.h>
@@ -31,6 +32,7 @@
 #include "escape.h"
 #include "fd-util.h"
 #include "fstab-util.h"
+#include "hashmap.h"
 #include "linux-3.13/dm-ioctl.h"
 #include "list.h"
 #include "mount-setup.h"
@@ -42,11 +44,21 @@
 #include "util.h"
 #include "virt.h"
 
+/* When unmounting, at most this many mounts are processed at the same time */
+#define UMOUNT_WORKERS_MAX 16
+
 typedef struct MountPoint {
         char *path;
         char *options;
         char *type;
         dev_t devnum;
+
+        /* Mount table relationship, only used for file systems */
+        int mount_id;
+        int parent_id;
+        struct MountPoint *parent;
+        unsigned n_children;
+
         LIST_FIELDS(struct MountPoint, mount_point);
 } MountPoint;
 
@@ -82,11 +94,12 @@ static int mount_points_list_get(MountPoint **head) {
                 _cleanup_free_ char *path = NULL, *options = NULL, *type = NULL;
                 char *p = NULL;
                 MountPoint *m;
+                int mount_id, parent_id;
                 int k;
 
                 k = fscanf(proc_self_mountinfo,
-                           "%*s "       /* (1) mount id */
-                           "%*s "       /* (2) parent id */
+                           "%d "        /* (1) mount id */
+                           "%d "        /* (2) parent id */
                            "%*s "       /* (3) major:minor */
                            "%*s "       /* (4) root */
                            "%ms "       /* (5) mount point */
@@ -97,8 +110,8 @@ static int mount_points_list_get(MountPoint **head) {
                            "%*s"        /* (10) mount source */
                            "%ms"        /* (11) mount options */
                            "%*[^\n]",   /* some rubbish at the end */
-                           &path, &type, &options);
-                if (k != 3) {
+                           &mount_id, &parent_id, &path, &type, &options);
+                if (k != 5) {
                         if (k == EOF)
                                 break;
 
@@ -133,6 +146,8 @@ static int mount_points_list_get(MountPoint **head) {
                 }
 
                 m->path = p;
+                m->mount_id = mount_id;
+                m->parent_id = parent_id;
                 m->options = options;
                 options = NULL;
                 m->type = type;
@@ -376,90 +391,226 @@ static bool nonunmountable_path(const char *path) {
                 || path_startswith(path, "/run/initramfs");
 }
 
+/* Remounts the mount point read-only and unmounts it. Returns > 0 if it was unmounted, 0 if it was left in place
+ * on purpose, and < 0 on failure. */
+
+static int mount_point_umount(MountPoint *m, bool in_container, bool log_error) {
+        bool mount_is_readonly, failed = false;
+        int r;
+
+        assert(m);
+
+        mount_is_readonly = fstab_test_yes_no_option(m->options, "ro\0rw\0");
+
+        /* If we are in a container, don't attempt to
+           read-only mount anything as that brings no real
+           benefits, but might confuse the host, as we remount
+           the superblock here, not the bind mount.
+           If the filesystem is a network fs, also skip the
+           remount.  It brings no value (we cannot leave
+           a "dirty fs") and could hang if the network is down.
+           Note that umount2() is more careful and will not
+           hang because of the network being down. */
+        if (!in_container &&
+            !fstype_is_network(m->type) &&
+            !mount_is_readonly) {
+                _cleanup_free_ char *options = NULL;
+                /* MS_REMOUNT requires that the data parameter
+                 * should be the same from the original mount
+                 * except for the desired changes. Since we want
+                 * to remount read-only, we should filter out
+                 * rw (and ro too, because it confuses the kernel) */
+                (void) fstab_filter_options(m->options, "rw\0ro\0", NULL, NULL, &options);
+
+                /* We always try to remount directories
+                 * read-only first, before we go on and umount
+                 * them.
+                 *
+                 * Mount points can be stacked. If a mount
+                 * point is stacked below / or /usr, we
+                 * cannot umount or remount it directly,
+                 * since there is no way to refer to the
+                 * underlying mount. There's nothing we can do
+                 * about it for the general case, but we can
+                 * do something about it if it is aliased
+                 * somehwere else via a bind mount. If we
+                 * explicitly remount the super block of that
+                 * alias read-only we hence should be
+                 * relatively safe regarding keeping dirty an fs
+                 * we cannot otherwise see. */
+                log_info("Remounting '%s' read-only with options '%s'.", m->path, options);
+                if (mount(NULL, m->path, NULL, MS_REMOUNT|MS_RDONLY, options) < 0) {
+                        if (log_error)
+                                log_notice_errno(errno, "Failed to remount '%s' read-only: %m", m->path);
+                        if (nonunmountable_path(m->path))
+                                failed = true;
+                }
+        }
+
+        /* Skip / and /usr since we cannot unmount that
+         * anyway, since we are running from it. They have
+         * already been remounted ro. */
+        if (nonunmountable_path(m->path))
+                return failed ? -EBUSY : 0;
+
+        /* Trying to umount. Using MNT_FORCE causes some
+         * filesystems (e.g. FUSE and NFS and other network
+         * filesystems) to abort any pending requests and
+         * return -EIO rather than blocking indefinitely.
+         * If the filesysten is "busy", this may allow processes
+         * to die, thus making the filesystem less busy so
+         * the unmount might succeed (rather then return EBUSY).*/
+        log_info("Unmounting %s.", m->path);
+        if (umount2(m->path, MNT_FORCE) < 0) {
+                r = -errno;
+                if (log_error)
+                        log_warning_errno(r, "Could not unmount %s: %m", m->path);
+                return r;
+        }
+
+        return 1;
+}
+
+typedef struct UmountQueue {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        /* Mount points whose submounts have all been dealt with already */
+        MountPoint **ready;
+        size_t n_ready;
+
+        unsigned n_pending;
+        unsigned n_failed;
+        bool changed;
+
+        bool in_container;
+        bool log_error;
+} UmountQueue;
+
+static void *umount_worker(void *userdata) {
+        UmountQueue *q = userdata;
+
+        assert(q);
+
+        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+
+        for (;;) {
+                MountPoint *m;
+                int r;
+
+                while (q->n_ready == 0 && q->n_pending > 0)
+                        assert_se(pthread_cond_wait(&q->cond, &q->mutex) == 0);
+
+                if (q->n_ready == 0)
+                        break;
+
+                m = q->ready[--q->n_ready];
+
+                assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+                r = mount_point_umount(m, q->in_container, q->log_error);
+                assert_se(pthread_mutex_lock(&q->mutex) == 0);
+
+                if (r > 0)
+                        q->changed = true;
+                else if (r < 0)
+                        q->n_failed++;
+
+                /* Once all submounts are out of the way the parent may go too. We also try if some of them failed,
+                 * in which case this will most likely fail with EBUSY, but at least the parent is remounted
+                 * read-only. */
+                if (m->parent) {
+                        assert(m->parent->n_children > 0);
+
+                        if (--m->parent->n_children == 0)
+                                q->ready[q->n_ready++] = m->parent;
+                }
+
+                q->n_pending--;
+                assert_se(pthread_cond_broadcast(&q->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+
+        return NULL;
+}
+
 /* This includes remounting readonly, which changes the kernel mount options.
- * Therefore the list passed to this function is invalidated, and should not be reused. */
+ * Therefore the list passed to this function is invalidated, and should not be reused.
+ *
+ * Mount points are unmounted children first, but independent subtrees are processed in parallel, since
+ * unmounting can take a while, and there might be thousands of them. */
 
 static int mount_points_list_umount(MountPoint **head, bool *changed, bool log_error) {
+        _cleanup_hashmap_free_ Hashmap *by_id = NULL;
+        pthread_t threads[UMOUNT_WORKERS_MAX - 1];
+        unsigned n_threads = 0, n_mounts = 0, i;
+        UmountQueue q = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .log_error = log_error,
+        };
         MountPoint *m;
-        int n_failed = 0;
+        int r;
 
         assert(head);
 
+        by_id = hashmap_new(NULL);
+        if (!by_id)
+                return -ENOMEM;
+
         LIST_FOREACH(mount_point, m, *head) {
-                bool mount_is_readonly;
-
-                mount_is_readonly = fstab_test_yes_no_option(m->options, "ro\0rw\0");
-
-                /* If we are in a container, don't attempt to
-                   read-only mount anything as that brings no real
-                   benefits, but might confuse the host, as we remount
-                   the superblock here, not the bind mount.
-                   If the filesystem is a network fs, also skip the
-                   remount.  It brings no value (we cannot leave
-                   a "dirty fs") and could hang if the network is down.
-                   Note that umount2() is more careful and will not
-                   hang because of the network being down. */
-                if (detect_container() <= 0 &&
-                    !fstype_is_network(m->type) &&
-                    !mount_is_readonly) {
-                        _cleanup_free_ char *options = NULL;
-                        /* MS_REMOUNT requires that the data parameter
-                         * should be the same from the original mount
-                         * except for the desired changes. Since we want
-                         * to remount read-only, we should filter out
-                         * rw (and ro too, because it confuses the kernel) */
-                        (void) fstab_filter_options(m->options, "rw\0ro\0", NULL, NULL, &options);
-
-                        /* We always try to remount directories
-                         * read-only first, before we go on and umount
-                         * them.
-                         *
-                         * Mount points can be stacked. If a mount
-                         * point is stacked below / or /usr, we
-                         * cannot umount or remount it directly,
-                         * since there is no way to refer to the
-                         * underlying mount. There's nothing we can do
-                         * about it for the general case, but we can
-                         * do something about it if it is aliased
-                         * somehwere else via a bind mount. If we
-                         * explicitly remount the super block of that
-                         * alias read-only we hence should be
-                         * relatively safe regarding keeping dirty an fs
-                         * we cannot otherwise see. */
-                        log_info("Remounting '%s' read-only with options '%s'.", m->path, options);
-                        if (mount(NULL, m->path, NULL, MS_REMOUNT|MS_RDONLY, options) < 0) {
-                                if (log_error)
-                                        log_notice_errno(errno, "Failed to remount '%s' read-only: %m", m->path);
-                                if (nonunmountable_path(m->path))
-                                        n_failed++;
-                        }
-                }
+                r = hashmap_put(by_id, INT_TO_PTR(m->mount_id), m);
+                if (r < 0)
+                        return r;
 
-                /* Skip / and /usr since we cannot unmount that
-                 * anyway, since we are running from it. They have
-                 * already been remounted ro. */
-                if (nonunmountable_path(m->path))
-                        continue;
+                n_mounts++;
+        }
 
-                /* Trying to umount. Using MNT_FORCE causes some
-                 * filesystems (e.g. FUSE and NFS and other network
-                 * filesystems) to abort any pending requests and
-                 * return -EIO rather than blocking indefinitely.
-                 * If the filesysten is "busy", this may allow processes
-                 * to die, thus making the filesystem less busy so
-                 * the unmount might succeed (rather then return EBUSY).*/
-                log_info("Unmounting %s.", m->path);
-                if (umount2(m->path, MNT_FORCE) == 0) {
-                        if (changed)
-                                *changed = true;
-                } else {
-                        if (log_error)
-                                log_warning_errno(errno, "Could not unmount %s: %m", m->path);
-                        n_failed++;
+        if (n_mounts == 0)
+                return 0;
+
+        LIST_FOREACH(mount_point, m, *head) {
+                m->parent = m->parent_id != m->mount_id ? hashmap_get(by_id, INT_TO_PTR(m->parent_id)) : NULL;
+                if (m->parent)
+                        m->parent->n_children++;
+        }
+
+        q.ready = new(MountPoint*, n_mounts);
+        if (!q.ready)
+                return -ENOMEM;
+
+        LIST_FOREACH(mount_point, m, *head)
+                if (m->n_children == 0)
+                        q.ready[q.n_ready++] = m;
+
+        q.n_pending = n_mounts;
+
+        /* detect_container() caches its result in a non-thread-safe way, hence query it before starting threads */
+        q.in_container = detect_container() > 0;
+
+        for (i = 0; i < MIN(n_mounts, (unsigned) UMOUNT_WORKERS_MAX) - 1; i++) {
+                r = pthread_create(&threads[n_threads], NULL, umount_worker, &q);
+                if (r != 0) {
+                        /* The calling thread takes part too, so we can continue with what we have */
+                        log_debug_errno(r, "Failed to start unmount thread, continuing with %u: %m", n_threads + 1);
+                        break;
                 }
+
+                n_threads++;
         }
 
-        return n_failed;
+        (void) umount_worker(&q);
+
+        for (i = 0; i < n_threads; i++)
+                (void) pthread_join(threads[i], NULL);
+
+        assert(q.n_pending == 0);
+        free(q.ready);
+
+        if (q.changed && changed)
+                *changed = true;
+
+        return q.n_failed;
 }
 
 static int swap_points_list_off(MountPoint **head, bool *changed) {
@@ -577,14 +728,19 @@ int umount_all(bool *changed) {
         bool umount_changed;
         int r;
 
-        /* retry umount, until nothing can be umounted anymore */
+        /* retry umount, until nothing can be umounted anymore. Since submounts are taken care of before
+         * their parents, a pass that leaves nothing behind is final, and there's no point in rereading the mount
+         * table once more. */
         do {
                 umount_changed = false;
 
-                umount_all_once(&umount_changed, false);
+                r = umount_all_once(&umount_changed, false);
                 if (umount_changed)
                         *changed = true;
-        } while (umount_changed);
+        } while (umount_changed && r != 0);
+
+        if (r == 0)
+                return 0;
 
         /* umount one more time with logging enabled */
         r = umount_all_once(&umount_changed, true);
@@ -28,6 +28,7 @@
 #include "sd-messages.h"
 
 #include "alloc-util.h"
+#include "bpf-firewall.h"
 #include "bus-common-errors.h"
 #include "bus-util.h"
 #include "cgroup-util.h"
@@ -109,14 +110,11 @@ Unit *unit_new(Manager *m, size_t size) {
         u->ref_uid = UID_INVALID;
         u->ref_gid = GID_INVALID;
         u->cpu_usage_last = NSEC_INFINITY;
+        memset(u->ip_accounting_last, 0xFF, sizeof(u->ip_accounting_last));
         u->cgroup_bpf_state = UNIT_CGROUP_BPF_INVALIDATED;
 
         u->ip_accounting_ingress_map_fd = -1;
         u->ip_accounting_egress_map_fd = -1;
-        u->ipv4_allow_map_fd = -1;
-        u->ipv6_allow_map_fd = -1;
-        u->ipv4_deny_map_fd = -1;
-        u->ipv6_deny_map_fd = -1;
 
         u->last_section_private = -1;
 
@@ -456,6 +454,36 @@ void unit_add_to_dbus_queue(Unit *u) {
         u->in_dbus_queue = true;
 }
 
+static void unit_update_ordering_jobs(Unit *u, UnitDependency d, Unit *other, int delta) {
+        assert(u);
+        assert(other);
+
+        /* Accounts for "other" being added to or removed from our dependencies of type "d" */
+
+        if (!other->job)
+                return;
+
+        if (d == UNIT_AFTER)
+                u->n_after_jobs += delta;
+        else if (d == UNIT_BEFORE && IN_SET(other->job->type, JOB_STOP, JOB_RESTART))
+                u->n_before_stop_jobs += delta;
+}
+
+static void unit_recount_ordering_jobs(Unit *u) {
+        Unit *other;
+        Iterator i;
+        void *v;
+
+        assert(u);
+
+        u->n_after_jobs = u->n_before_stop_jobs = 0;
+
+        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_AFTER], i)
+                unit_update_ordering_jobs(u, UNIT_AFTER, other, +1);
+        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BEFORE], i)
+                unit_update_ordering_jobs(u, UNIT_BEFORE, other, +1);
+}
+
 static void bidi_set_free(Unit *u, Hashmap *h) {
         Unit *other;
         Iterator i;
@@ -465,6 +493,10 @@ static void bidi_set_free(Unit *u, Hashmap *h) {
 
         /* Frees the hashmap and makes sure we are dropped from the inverse pointers */
 
+        /* Our jobs are uninstalled already, hence dropping us from the ordering dependencies of other units
+         * doesn't change their n_after_jobs/n_before_stop_jobs counters */
+        assert(!u->job);
+
         HASHMAP_FOREACH_KEY(v, other, h, i) {
                 UnitDependency d;
 
@@ -512,7 +544,7 @@ static void unit_free_requires_mounts_for(Unit *u) {
         assert(u);
 
         for (;;) {
-                _cleanup_free_ char *path;
+                const char *path;
 
                 path = hashmap_steal_first_key(u->requires_mounts_for);
                 if (!path)
@@ -537,6 +569,8 @@ static void unit_free_requires_mounts_for(Unit *u) {
                                 }
                         }
                 }
+
+                string_pool_unref(u->manager->string_pool, path);
         }
 
         u->requires_mounts_for = hashmap_free(u->requires_mounts_for);
@@ -665,10 +699,7 @@ void unit_free(Unit *u) {
         safe_close(u->ip_accounting_ingress_map_fd);
         safe_close(u->ip_accounting_egress_map_fd);
 
-        safe_close(u->ipv4_allow_map_fd);
-        safe_close(u->ipv6_allow_map_fd);
-        safe_close(u->ipv4_deny_map_fd);
-        safe_close(u->ipv6_deny_map_fd);
+        bpf_firewall_policy_unref(u->ip_bpf_policy);
 
         bpf_program_unref(u->ip_bpf_ingress);
         bpf_program_unref(u->ip_bpf_egress);
@@ -839,6 +870,9 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
 int unit_merge(Unit *u, Unit *other) {
         UnitDependency d;
         const char *other_id = NULL;
+        Unit *back;
+        Iterator i;
+        void *v;
         int r;
 
         assert(u);
@@ -899,6 +933,14 @@ int unit_merge(Unit *u, Unit *other) {
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
                 merge_dependencies(u, other, other_id, d);
 
+        /* Units that were ordered against the other unit are ordered against us now, and we might have gained
+         * ordering dependencies. Merging is rare, hence just count from scratch here. */
+        unit_recount_ordering_jobs(u);
+        HASHMAP_FOREACH_KEY(v, back, u->dependencies[UNIT_AFTER], i)
+                unit_recount_ordering_jobs(back);
+        HASHMAP_FOREACH_KEY(v, back, u->dependencies[UNIT_BEFORE], i)
+                unit_recount_ordering_jobs(back);
+
         other->load_state = UNIT_MERGED;
         other->merged_into = u;
 
@@ -2176,13 +2218,34 @@ void unit_trigger_notify(Unit *u) {
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
 
+static void unit_log_suppressed_resources(Manager *m) {
+        char cpu[FORMAT_TIMESPAN_MAX], ingress[FORMAT_BYTES_MAX], egress[FORMAT_BYTES_MAX];
+
+        assert(m);
+
+        if (m->n_unit_resources_suppressed == 0)
+                return;
+
+        log_info("Resource usage messages of %u units suppressed, which consumed %s CPU time, received %s and sent %s IP traffic in total.",
+                 m->n_unit_resources_suppressed,
+                 format_timespan(cpu, sizeof(cpu), m->unit_resources_suppressed_cpu / NSEC_PER_USEC, USEC_PER_MSEC),
+                 format_bytes(ingress, sizeof(ingress), m->unit_resources_suppressed_ingress_bytes),
+                 format_bytes(egress, sizeof(egress), m->unit_resources_suppressed_egress_bytes));
+
+        m->n_unit_resources_suppressed = 0;
+        m->unit_resources_suppressed_cpu = 0;
+        m->unit_resources_suppressed_ingress_bytes = m->unit_resources_suppressed_egress_bytes = 0;
+}
+
 static int unit_log_resources(Unit *u) {
 
         struct iovec iovec[1 + _CGROUP_IP_ACCOUNTING_METRIC_MAX + 4];
         size_t n_message_parts = 0, n_iovec = 0;
         char* message_parts[3 + 1], *t;
+        uint64_t ip[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
         nsec_t nsec = NSEC_INFINITY;
         CGroupIPAccountingMetric m;
+        bool any = false;
         size_t i;
         int r;
         const char* const ip_fields[_CGROUP_IP_ACCOUNTING_METRIC_MAX] = {
@@ -2196,9 +2259,47 @@ static int unit_log_resources(Unit *u) {
 
         /* Invoked whenever a unit enters failed or dead state. Logs information about consumed resources if resource
          * accounting was enabled for a unit. It does this in two ways: a friendly human readable string with reduced
-         * information and the complete data in structured fields. */
+         * information and the complete data in structured fields.
+         *
+         * The counters are read once here, and are then served from the cache when queried via the bus later on.
+         * If lots of units stop in a short time, the messages are rate limited, and a summary of what was suppressed
+         * is logged with the next message that gets through. */
+
+        unit_snapshot_resources(u);
+
+        if (log_get_max_level() < LOG_INFO)
+                return 0;
 
         (void) unit_get_cpu_usage(u, &nsec);
+        any = nsec != NSEC_INFINITY;
+
+        for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++) {
+                ip[m] = UINT64_MAX;
+                (void) unit_get_ip_accounting(u, m, ip + m);
+                any = any || ip[m] != UINT64_MAX;
+        }
+
+        /* Is there any accounting data available at all? */
+        if (!any)
+                return 0;
+
+        if (!ratelimit_test(&u->manager->unit_resources_ratelimit)) {
+                Manager *mgr = u->manager;
+
+                mgr->n_unit_resources_suppressed++;
+
+                if (nsec != NSEC_INFINITY)
+                        mgr->unit_resources_suppressed_cpu += nsec;
+                if (ip[CGROUP_IP_INGRESS_BYTES] != UINT64_MAX)
+                        mgr->unit_resources_suppressed_ingress_bytes += ip[CGROUP_IP_INGRESS_BYTES];
+                if (ip[CGROUP_IP_EGRESS_BYTES] != UINT64_MAX)
+                        mgr->unit_resources_suppressed_egress_bytes += ip[CGROUP_IP_EGRESS_BYTES];
+
+                return 0;
+        }
+
+        unit_log_suppressed_resources(u->manager);
+
         if (nsec != NSEC_INFINITY) {
                 char buf[FORMAT_TIMESPAN_MAX] = "";
 
@@ -2222,11 +2323,10 @@ static int unit_log_resources(Unit *u) {
 
         for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++) {
                 char buf[FORMAT_BYTES_MAX] = "";
-                uint64_t value = UINT64_MAX;
+                uint64_t value = ip[m];
 
                 assert(ip_fields[m]);
 
-                (void) unit_get_ip_accounting(u, m, &value);
                 if (value == UINT64_MAX)
                         continue;
 
@@ -2257,12 +2357,6 @@ static int unit_log_resources(Unit *u) {
                 message_parts[n_message_parts++] = t;
         }
 
-        /* Is there any accounting data available at all? */
-        if (n_iovec == 0) {
-                r = 0;
-                goto finish;
-        }
-
         if (n_message_parts == 0)
                 t = strjoina("MESSAGE=", u->id, ": Completed");
         else {
@@ -2683,6 +2777,10 @@ static int unit_add_dependency_hashmap(
                 info.destination_mask |= destination_mask;
 
                 r = hashmap_update(*h, other, info.data);
+                if (r < 0)
+                        return r;
+
+                return 0;
         } else {
                 info = (UnitDependencyInfo) {
                         .origin_mask = origin_mask,
@@ -2754,11 +2852,15 @@ int unit_add_dependency(
         r = unit_add_dependency_hashmap(u->dependencies + d, other, mask, 0);
         if (r < 0)
                 return r;
+        if (r > 0)
+                unit_update_ordering_jobs(u, d, other, +1);
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
                 r = unit_add_dependency_hashmap(other->dependencies + inverse_table[d], u, 0, mask);
                 if (r < 0)
                         return r;
+                if (r > 0)
+                        unit_update_ordering_jobs(other, inverse_table[d], u, +1);
         }
 
         if (add_reference) {
@@ -4376,6 +4478,54 @@ int unit_make_transient(Unit *u) {
         return 0;
 }
 
+int unit_begin_transient_update(Unit *u, UnitWriteFlags flags) {
+        FILE *f;
+
+        assert(u);
+
+        /* Reopens the unit file of an already loaded transient unit for appending, so that unit_write_setting()
+         * adds to it rather than creating a drop-in per setting. The settings written are self-contained, hence
+         * appending them in order has the same effect as the drop-ins replacing each other. If any drop-ins exist
+         * already those would be parsed after the unit file, hence don't do this then. Returns > 0 if the file
+         * was opened, in which case unit_end_transient_update() needs to be called. */
+
+        if (UNIT_WRITE_FLAGS_NOOP(flags))
+                return 0;
+
+        if (!u->transient || u->transient_file || !u->fragment_path)
+                return 0;
+
+        if (u->load_state != UNIT_LOADED || !strv_isempty(u->dropin_paths))
+                return 0;
+
+        f = fopen(u->fragment_path, "ae");
+        if (!f)
+                return -errno;
+
+        u->transient_file = f;
+        u->last_section_private = -1;
+
+        return 1;
+}
+
+int unit_end_transient_update(Unit *u) {
+        int r;
+
+        assert(u);
+
+        if (!u->transient_file)
+                return 0;
+
+        r = fflush_and_check(u->transient_file);
+        u->transient_file = safe_fclose(u->transient_file);
+        if (r < 0)
+                return r;
+
+        /* Don't consider the file we just wrote ourselves as changed on disk */
+        u->fragment_mtime = now(CLOCK_REALTIME);
+        return 0;
+}
+
 static void log_kill(pid_t pid, int sig, void *userdata) {
         _cleanup_free_ char *comm = NULL;
 
@@ -4541,6 +4691,7 @@ int unit_kill_context(
 int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask) {
         char prefix[strlen(path) + 1], *p;
         UnitDependencyInfo di;
+        const char *interned;
         int r;
 
         assert(u);
@@ -4558,29 +4709,27 @@ int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask)
         if (r < 0)
                 return r;
 
-        p = strdup(path);
-        if (!p)
-                return -ENOMEM;
-
+        p = strdupa(path);
         path_kill_slashes(p);
 
-        if (!path_is_normalized(p)) {
-                free(p);
+        if (!path_is_normalized(p))
                 return -EPERM;
-        }
 
-        if (hashmap_contains(u->requires_mounts_for, p)) {
-                free(p);
+        if (hashmap_contains(u->requires_mounts_for, p))
                 return 0;
-        }
+
+        /* The same few paths are required by lots of units, hence share them */
+        r = string_pool_intern(u->manager->string_pool, p, &interned);
+        if (r < 0)
+                return r;
 
         di = (UnitDependencyInfo) {
                 .origin_mask = mask
         };
 
-        r = hashmap_put(u->requires_mounts_for, p, di.data);
+        r = hashmap_put(u->requires_mounts_for, interned, di.data);
         if (r < 0) {
-                free(p);
+                string_pool_unref(u->manager->string_pool, interned);
                 return r;
         }
 
@@ -5017,6 +5166,7 @@ static void unit_update_dependency_mask(Unit *u, UnitDependency d, Unit *other,
         if (di.origin_mask == 0 && di.destination_mask == 0) {
                 /* No bit set anymore, let's drop the whole entry */
                 assert_se(hashmap_remove(u->dependencies[d], other));
+                unit_update_ordering_jobs(u, d, other, -1);
                 log_unit_debug(u, "%s lost dependency %s=%s", u->id, unit_dependency_to_string(d), other->id);
         } else
                 /* Mask was reduced, let's update the entry */
@@ -5034,46 +5184,43 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                 return;
 
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
-                bool done;
-
-                do {
-                        UnitDependencyInfo di;
-                        Unit *other;
-                        Iterator i;
-
-                        done = true;
-
-                        HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
-                                UnitDependency q;
+                UnitDependencyInfo di;
+                Unit *other;
+                Iterator i;
 
-                                if ((di.origin_mask & ~mask) == di.origin_mask)
-                                        continue;
-                                di.origin_mask &= ~mask;
-                                unit_update_dependency_mask(u, d, other, di);
+                /* Updating or dropping the current entry is safe while iterating, and the reverse dependencies
+                 * live in the other unit's hashmaps, hence a single pass suffices. */
 
-                                /* We updated the dependency from our unit to the other unit now. But most dependencies
-                                 * imply a reverse dependency. Hence, let's delete that one too. For that we go through
-                                 * all dependency types on the other unit and delete all those which point to us and
-                                 * have the right mask set. */
+                HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
+                        UnitDependency q;
 
-                                for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
-                                        UnitDependencyInfo dj;
+                        if ((di.origin_mask & ~mask) == di.origin_mask)
+                                continue;
+                        di.origin_mask &= ~mask;
+                        unit_update_dependency_mask(u, d, other, di);
 
-                                        dj.data = hashmap_get(other->dependencies[q], u);
-                                        if ((dj.destination_mask & ~mask) == dj.destination_mask)
-                                                continue;
-                                        dj.destination_mask &= ~mask;
+                        /* We updated the dependency from our unit to the other unit now. But most dependencies
+                         * imply a reverse dependency. Hence, let's delete that one too. For that we go through
+                         * all dependency types on the other unit and delete all those which point to us and
+                         * have the right mask set. */
 
-                                        unit_update_dependency_mask(other, q, u, dj);
-                                }
+                        for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
+                                UnitDependencyInfo dj;
 
-                                unit_add_to_gc_queue(other);
+                                dj.data = hashmap_get(other->dependencies[q], u);
+                                if ((dj.destination_mask & ~mask) == dj.destination_mask)
+                                        continue;
+                                dj.destination_mask &= ~mask;
 
-                                done = false;
-                                break;
+                                unit_update_dependency_mask(other, q, u, dj);
                         }
 
-                } while (!done);
+                        unit_add_to_gc_queue(other);
+                }
+
+                /* Don't keep emptied hashmaps around, they'd only take up memory */
+                if (hashmap_isempty(u->dependencies[d]))
+                        u->dependencies[d] = hashmap_free(u->dependencies[d]);
         }
 }
 
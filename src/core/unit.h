@@ -28,6 +28,7 @@ typedef struct Unit Unit;
 typedef struct UnitVTable UnitVTable;
 typedef struct UnitRef UnitRef;
 typedef struct UnitStatusMessageFormats UnitStatusMessageFormats;
+typedef struct BPFFirewallPolicy BPFFirewallPolicy;
 
 #include "bpf-program.h"
 #include "condition.h"
@@ -172,6 +173,13 @@ struct Unit {
         /* JOB_NOP jobs are special and can be installed without disturbing the real job. */
         Job *nop_job;
 
+        /* How many units we are ordered after have a job installed, and how many units we are ordered before
+         * have a stop or restart job installed. Our own job may only run while these are zero, see
+         * job_is_runnable(). Kept up-to-date by job_install()/job_uninstall() and when ordering
+         * dependencies change, so that this check doesn't need to iterate the dependencies. */
+        unsigned n_after_jobs;
+        unsigned n_before_stop_jobs;
+
         /* The slot used for watching NameOwnerChanged signals */
         sd_bus_slot *match_bus_slot;
 
@@ -267,6 +275,13 @@ struct Unit {
         /* Where the cpu.stat or cpuacct.usage was at the time the unit was started */
         nsec_t cpu_usage_base;
         nsec_t cpu_usage_last; /* the most recently read value */
+        usec_t cpu_usage_timestamp; /* when it was read */
+
+        /* The most recently read memory and tasks counters, and when they were read, see AccountingCacheSec= */
+        uint64_t memory_current_cached;
+        uint64_t tasks_current_cached;
+        usec_t memory_current_timestamp;
+        usec_t tasks_current_timestamp;
 
         /* Counterparts in the cgroup filesystem */
         char *cgroup_path;
@@ -280,15 +295,13 @@ struct Unit {
         int ip_accounting_ingress_map_fd;
         int ip_accounting_egress_map_fd;
 
-        int ipv4_allow_map_fd;
-        int ipv6_allow_map_fd;
-        int ipv4_deny_map_fd;
-        int ipv6_deny_map_fd;
+        BPFFirewallPolicy *ip_bpf_policy; /* access maps, shared between units with the same access lists */
 
         BPFProgram *ip_bpf_ingress;
         BPFProgram *ip_bpf_egress;
 
         uint64_t ip_accounting_extra[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+        uint64_t ip_accounting_last[_CGROUP_IP_ACCOUNTING_METRIC_MAX]; /* the most recently read values */
 
         /* How to start OnFailure units */
         JobMode on_failure_job_mode;
@@ -745,6 +758,8 @@ int unit_write_settingf(Unit *u, UnitWriteFlags mode, const char *name, const ch
 int unit_kill_context(Unit *u, KillContext *c, KillOperation k, pid_t main_pid, pid_t control_pid, bool main_pid_alien);
 
 int unit_make_transient(Unit *u);
+int unit_begin_transient_update(Unit *u, UnitWriteFlags flags);
+int unit_end_transient_update(Unit *u);
 
 int unit_require_mounts_for(Unit *u, const char *path, UnitDependencyMask mask);
 
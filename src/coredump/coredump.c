@@ -78,6 +78,10 @@
  * size. See DATA_SIZE_MAX in journald-native.c. */
 assert_cc(JOURNAL_SIZE_MAX <= DATA_SIZE_MAX);
 
+/* How many coredumps of the same executable we keep on disk within the rate limit interval */
+#define RATELIMIT_INTERVAL_USEC (5*USEC_PER_MINUTE)
+#define RATELIMIT_BURST 10
+
 enum {
         /* We use this as array indexes for a couple of special fields we use for
          * naming coredump files, and attaching xattrs, and for indexing argv[].
@@ -131,6 +135,8 @@ static uint64_t arg_external_size_max = EXTERNAL_SIZE_MAX;
 static uint64_t arg_journal_size_max = JOURNAL_SIZE_MAX;
 static uint64_t arg_keep_free = (uint64_t) -1;
 static uint64_t arg_max_use = (uint64_t) -1;
+static usec_t arg_ratelimit_interval = RATELIMIT_INTERVAL_USEC;
+static unsigned arg_ratelimit_burst = RATELIMIT_BURST;
 
 static int parse_config(void) {
         static const ConfigTableItem items[] = {
@@ -141,6 +147,8 @@ static int parse_config(void) {
                 { "Coredump", "JournalSizeMax",   config_parse_iec_size,          0, &arg_journal_size_max  },
                 { "Coredump", "KeepFree",         config_parse_iec_uint64,        0, &arg_keep_free         },
                 { "Coredump", "MaxUse",           config_parse_iec_uint64,        0, &arg_max_use           },
+                { "Coredump", "RateLimitIntervalSec", config_parse_sec,           0, &arg_ratelimit_interval },
+                { "Coredump", "RateLimitBurst",   config_parse_unsigned,          0, &arg_ratelimit_burst   },
                 {}
         };
 
@@ -320,6 +328,135 @@ static int make_filename(const char *context[_CONTEXT_MAX], char **ret) {
         return 0;
 }
 
+static int count_recent_coredumps(const char *context[_CONTEXT_MAX], usec_t since, unsigned *ret) {
+        _cleanup_free_ char *c = NULL, *u = NULL, *prefix = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        sd_id128_t boot = {};
+        unsigned n = 0;
+        struct dirent *de;
+        int r;
+
+        assert(context);
+        assert(ret);
+
+        /* Counts the coredumps of the same executable and user from this boot that we stored since the specified
+         * time. We key this off the file names generated by make_filename(), hence need no state of our own. */
+
+        c = filename_escape(context[CONTEXT_COMM]);
+        if (!c)
+                return -ENOMEM;
+
+        u = filename_escape(context[CONTEXT_UID]);
+        if (!u)
+                return -ENOMEM;
+
+        r = sd_id128_get_boot(&boot);
+        if (r < 0)
+                return r;
+
+        if (asprintf(&prefix, "core.%s.%s." SD_ID128_FORMAT_STR ".", c, u, SD_ID128_FORMAT_VAL(boot)) < 0)
+                return -ENOMEM;
+
+        d = opendir("/var/lib/systemd/coredump");
+        if (!d) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                *ret = 0;
+                return 0;
+        }
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                struct stat st;
+
+                if (!startswith(de->d_name, prefix))
+                        continue;
+
+                if (fstatat(dirfd(d), de->d_name, &st, AT_NO_AUTOMOUNT|AT_SYMLINK_NOFOLLOW) < 0)
+                        continue;
+
+                if (!S_ISREG(st.st_mode))
+                        continue;
+
+                if (timespec_load(&st.st_mtim) >= since)
+                        n++;
+        }
+
+        *ret = n;
+        return 0;
+}
+
+static bool coredump_ratelimited(const char *context[_CONTEXT_MAX]) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        unsigned n;
+        usec_t ts;
+        int r;
+
+        assert(context);
+
+        if (arg_storage != COREDUMP_STORAGE_EXTERNAL)
+                return false;
+
+        if (arg_ratelimit_interval == 0 || arg_ratelimit_burst == 0)
+                return false;
+
+        ts = now(CLOCK_REALTIME);
+        r = count_recent_coredumps(context, ts > arg_ratelimit_interval ? ts - arg_ratelimit_interval : 0, &n);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to count recent coredumps, not rate limiting: %m");
+                return false;
+        }
+
+        if (n < arg_ratelimit_burst)
+                return false;
+
+        log_info("The core will not be stored: %u coredumps of %s were stored in the last %s (the configured maximum is %u)",
+                 n, context[CONTEXT_COMM], format_timespan(buf, sizeof(buf), arg_ratelimit_interval, 0),
+                 arg_ratelimit_burst);
+        return true;
+}
+
+#if HAVE_XZ || HAVE_LZ4
+typedef struct CoredumpCopy {
+        int fd;
+        uint64_t size;
+        bool dropped;
+} CoredumpCopy;
+
+static int coredump_copy_tee(const void *data, size_t size, void *userdata) {
+        CoredumpCopy *c = userdata;
+        ssize_t k;
+
+        assert(c);
+
+        /* The uncompressed copy is only used to generate the stack
+         * trace, which we don't do for cores larger than
+         * arg_process_size_max. Stop writing it once the core grows
+         * past that, instead of storing it twice. */
+
+        if (c->dropped)
+                return 0;
+
+        if (c->size + size > arg_process_size_max) {
+                log_debug("Core is larger than %"PRIu64" bytes, not keeping an uncompressed copy.",
+                          arg_process_size_max);
+
+                if (ftruncate(c->fd, 0) < 0)
+                        log_debug_errno(errno, "Failed to truncate uncompressed core, ignoring: %m");
+
+                c->dropped = true;
+                return 0;
+        }
+
+        k = loop_write(c->fd, data, size, false);
+        if (k < 0)
+                return k;
+
+        c->size += size;
+        return 0;
+}
+#endif
+
 static int save_external_coredump(
                 const char *context[_CONTEXT_MAX],
                 int input_fd,
@@ -371,35 +508,17 @@ static int save_external_coredump(
         if (fd < 0)
                 return log_error_errno(fd, "Failed to create temporary file for coredump %s: %m", fn);
 
-        r = copy_bytes(input_fd, fd, max_size, 0);
-        if (r < 0) {
-                log_error_errno(r, "Cannot store coredump of %s (%s): %m", context[CONTEXT_PID], context[CONTEXT_COMM]);
-                goto fail;
-        }
-        *ret_truncated = r == 1;
-        if (*ret_truncated)
-                log_struct(LOG_INFO,
-                           LOG_MESSAGE("Core file was truncated to %zu bytes.", max_size),
-                           "SIZE_LIMIT=%zu", max_size,
-                           "MESSAGE_ID=" SD_MESSAGE_TRUNCATED_CORE_STR,
-                           NULL);
-
-        if (fstat(fd, &st) < 0) {
-                log_error_errno(errno, "Failed to fstat core file %s: %m", coredump_tmpfile_name(tmp));
-                goto fail;
-        }
-
-        if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
-                log_error_errno(errno, "Failed to seek on %s: %m", coredump_tmpfile_name(tmp));
-                goto fail;
-        }
-
 #if HAVE_XZ || HAVE_LZ4
-        /* If we will remove the coredump anyway, do not compress. */
-        if (arg_compress && !maybe_remove_external_coredump(NULL, st.st_size)) {
+        /* If we will remove the coredump anyway, do not compress. Otherwise, compress the core while it
+         * is read from the kernel, instead of storing it first and compressing it in a second pass. */
+        if (arg_compress && !maybe_remove_external_coredump(NULL, 0)) {
 
                 _cleanup_free_ char *fn_compressed = NULL, *tmp_compressed = NULL;
                 _cleanup_close_ int fd_compressed = -1;
+                CoredumpCopy copy = {
+                        .fd = fd,
+                };
+                uint64_t size = 0;
 
                 fn_compressed = strappend(fn, COMPRESSED_EXT);
                 if (!fn_compressed) {
@@ -413,15 +532,27 @@ static int save_external_coredump(
                         goto uncompressed;
                 }
 
-                r = compress_stream(fd, fd_compressed, -1);
+                r = compress_stream_tee(input_fd, fd_compressed, max_size, coredump_copy_tee, &copy, &size);
                 if (r < 0) {
+                        /* Part of the input is consumed already, hence there is no point in falling back
+                         * to storing it uncompressed. */
                         log_error_errno(r, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
-                        goto fail_compressed;
+                        (void) unlink(tmp_compressed);
+                        goto fail;
                 }
+                *ret_truncated = r == 1;
+                if (*ret_truncated)
+                        log_struct(LOG_INFO,
+                                   LOG_MESSAGE("Core file was truncated to %zu bytes.", max_size),
+                                   "SIZE_LIMIT=%zu", max_size,
+                                   "MESSAGE_ID=" SD_MESSAGE_TRUNCATED_CORE_STR,
+                                   NULL);
 
                 r = fix_permissions(fd_compressed, tmp_compressed, fn_compressed, context, uid);
-                if (r < 0)
-                        goto fail_compressed;
+                if (r < 0) {
+                        (void) unlink(tmp_compressed);
+                        goto fail;
+                }
 
                 /* OK, this worked, we can get rid of the uncompressed version now */
                 if (tmp)
@@ -429,22 +560,41 @@ static int save_external_coredump(
 
                 *ret_filename = fn_compressed;     /* compressed */
                 *ret_node_fd = fd_compressed;      /* compressed */
-                *ret_data_fd = fd;                 /* uncompressed */
-                *ret_size = (uint64_t) st.st_size; /* uncompressed */
+                *ret_data_fd = fd;                 /* uncompressed, empty if dropped */
+                *ret_size = size;                  /* uncompressed */
 
                 fn_compressed = NULL;
                 fd = fd_compressed = -1;
 
                 return 0;
-
-        fail_compressed:
-                if (tmp_compressed)
-                        (void) unlink(tmp_compressed);
         }
 
 uncompressed:
 #endif
 
+        r = copy_bytes(input_fd, fd, max_size, 0);
+        if (r < 0) {
+                log_error_errno(r, "Cannot store coredump of %s (%s): %m", context[CONTEXT_PID], context[CONTEXT_COMM]);
+                goto fail;
+        }
+        *ret_truncated = r == 1;
+        if (*ret_truncated)
+                log_struct(LOG_INFO,
+                           LOG_MESSAGE("Core file was truncated to %zu bytes.", max_size),
+                           "SIZE_LIMIT=%zu", max_size,
+                           "MESSAGE_ID=" SD_MESSAGE_TRUNCATED_CORE_STR,
+                           NULL);
+
+        if (fstat(fd, &st) < 0) {
+                log_error_errno(errno, "Failed to fstat core file %s: %m", coredump_tmpfile_name(tmp));
+                goto fail;
+        }
+
+        if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
+                log_error_errno(errno, "Failed to seek on %s: %m", coredump_tmpfile_name(tmp));
+                goto fail;
+        }
+
         r = fix_permissions(fd, tmp, fn, context, uid);
         if (r < 0)
                 goto fail;
@@ -731,6 +881,11 @@ static int submit_coredump(
 
         journald_crash = is_journald_crash(context);
 
+        /* If this executable is crashing in a loop, don't spend any more disk space and time on its cores, just log
+         * the crash. Closing the input early also lets the kernel stop dumping right away. */
+        if (!journald_crash && coredump_ratelimited(context))
+                goto log;
+
         /* Vacuum before we write anything again */
         (void) coredump_vacuum(-1, arg_keep_free, arg_max_use);
 
@@ -34,6 +34,7 @@
 #include "mkdir.h"
 #include "path-util.h"
 #include "selinux-util.h"
+#include "siphash24.h"
 #include "strbuf.h"
 #include "string-util.h"
 #include "strv.h"
@@ -54,6 +55,11 @@ static const char * const conf_file_dirs[] = {
         NULL
 };
 
+static const uint8_t sources_hash_key[16] = {
+        0x4b, 0x1e, 0x7a, 0x2d, 0x93, 0x5c, 0x40, 0xf8,
+        0xa6, 0x0b, 0xd3, 0x61, 0x2f, 0xc9, 0x85, 0x17
+};
+
 /* in-memory trie objects */
 struct trie {
         struct trie_node *root;
@@ -382,7 +388,7 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename) {
+static int trie_store(struct trie *trie, const char *filename, uint64_t sources_hash) {
         struct trie_f t = {
                 .trie = trie,
         };
@@ -397,6 +403,7 @@ static int trie_store(struct trie *trie, const char *filename) {
                 .node_size = htole64(sizeof(struct trie_node_f)),
                 .child_entry_size = htole64(sizeof(struct trie_child_entry_f)),
                 .value_entry_size = htole64(sizeof(struct trie_value_entry2_f)),
+                .sources_hash = htole64(sources_hash),
         };
         int r;
 
@@ -630,14 +637,91 @@ static int hwdb_query(int argc, char *argv[], void *userdata) {
         return 0;
 }
 
+static int hash_sources(char **files, uint64_t *ret) {
+        struct siphash state;
+        char **f;
+        int r;
+
+        assert(ret);
+
+        siphash24_init(&state, sources_hash_key);
+
+        STRV_FOREACH(f, files) {
+                _cleanup_free_ char *contents = NULL;
+                uint64_t size;
+                size_t n;
+
+                r = read_full_file(*f, &contents, &n);
+                if (r < 0)
+                        return r;
+
+                /* the file names end up in the database, and their order determines priorities */
+                size = htole64(n);
+                siphash24_compress(*f, strlen(*f) + 1, &state);
+                siphash24_compress(&size, sizeof(size), &state);
+                siphash24_compress(contents, n, &state);
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static bool hwdb_bin_up_to_date(const char *filename, uint64_t sources_hash) {
+        _cleanup_fclose_ FILE *f = NULL;
+        struct trie_header_f h;
+        const char sig[] = HWDB_SIG;
+        struct stat st;
+
+        if (sources_hash == 0)
+                return false;
+
+        f = fopen(filename, "re");
+        if (!f)
+                return false;
+
+        if (fstat(fileno(f), &st) < 0)
+                return false;
+
+        if (fread(&h, sizeof(h), 1, f) != 1)
+                return false;
+
+        if (memcmp(h.signature, sig, sizeof(h.signature)) != 0 ||
+            le64toh(h.file_size) != (uint64_t) st.st_size ||
+            le64toh(h.tool_version) != (uint64_t) atoi(PACKAGE_VERSION))
+                return false;
+
+        /* databases written by older versions have no hash */
+        if (le64toh(h.header_size) < offsetof(struct trie_header_f, sources_hash) + sizeof(h.sources_hash))
+                return false;
+
+        return le64toh(h.sources_hash) == sources_hash;
+}
+
 static int hwdb_update(int argc, char *argv[], void *userdata) {
         _cleanup_free_ char *hwdb_bin = NULL;
         _cleanup_(trie_freep) struct trie *trie = NULL;
         _cleanup_strv_free_ char **files = NULL;
         char **f;
         uint16_t file_priority = 1;
+        uint64_t sources_hash = 0;
         int r;
 
+        r = conf_files_list_strv(&files, ".hwdb", arg_root, 0, conf_file_dirs);
+        if (r < 0)
+                return log_error_errno(r, "Failed to enumerate hwdb files: %m");
+
+        hwdb_bin = path_join(arg_root, arg_hwdb_bin_dir, "hwdb.bin");
+        if (!hwdb_bin)
+                return -ENOMEM;
+
+        r = hash_sources(files, &sources_hash);
+        if (r < 0)
+                log_debug_errno(r, "Failed to hash hwdb files, rebuilding database: %m");
+        else if (hwdb_bin_up_to_date(hwdb_bin, sources_hash)) {
+                log_debug("Database %s is up to date.", hwdb_bin);
+                return 0;
+        }
+
         trie = new0(struct trie, 1);
         if (!trie)
                 return -ENOMEM;
@@ -654,10 +738,6 @@ static int hwdb_update(int argc, char *argv[], void *userdata) {
 
         trie->nodes_count++;
 
-        r = conf_files_list_strv(&files, ".hwdb", arg_root, 0, conf_file_dirs);
-        if (r < 0)
-                return log_error_errno(r, "Failed to enumerate hwdb files: %m");
-
         STRV_FOREACH(f, files) {
                 log_debug("Reading file \"%s\"", *f);
                 import_file(trie, *f, file_priority++);
@@ -679,12 +759,8 @@ static int hwdb_update(int argc, char *argv[], void *userdata) {
         log_debug("strings dedup'ed: %8zu bytes (%8zu)",
                   trie->strings->dedup_len, trie->strings->dedup_count);
 
-        hwdb_bin = path_join(arg_root, arg_hwdb_bin_dir, "hwdb.bin");
-        if (!hwdb_bin)
-                return -ENOMEM;
-
         mkdir_parents_label(hwdb_bin, 0755);
-        r = trie_store(trie, hwdb_bin);
+        r = trie_store(trie, hwdb_bin, sources_hash);
         if (r < 0)
                 return log_error_errno(r, "Failure writing database %s: %m", hwdb_bin);
 
@@ -18,6 +18,7 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <gcrypt.h>
 #include <sys/sendfile.h>
 
 /* When we include libgen.h because we need dirname() we immediately
@@ -34,6 +35,7 @@
 #include "export-raw.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "hexdecoct.h"
 #include "import-common.h"
 #include "missing.h"
 #include "ratelimit.h"
@@ -55,6 +57,9 @@ struct RawExport {
 
         ImportCompress compress;
 
+        gcry_md_hd_t checksum_context;
+        char *checksum;
+
         sd_event_source *output_event_source;
 
         void *buffer;
@@ -82,11 +87,15 @@ RawExport *raw_export_unref(RawExport *e) {
 
         import_compress_free(&e->compress);
 
+        if (e->checksum_context)
+                gcry_md_close(e->checksum_context);
+
         sd_event_unref(e->event);
 
         safe_close(e->input_fd);
 
         free(e->buffer);
+        free(e->checksum);
         free(e->path);
         return mfree(e);
 }
@@ -148,13 +157,37 @@ static void raw_export_report_progress(RawExport *e) {
         e->last_percent = percent;
 }
 
+static int raw_export_finish_checksum(RawExport *e) {
+        const uint8_t *k;
+
+        assert(e);
+
+        if (!e->checksum_context)
+                return 0;
+
+        k = gcry_md_read(e->checksum_context, GCRY_MD_SHA256);
+        if (!k) {
+                log_error("Failed to get checksum.");
+                return -EIO;
+        }
+
+        e->checksum = hexmem(k, gcry_md_get_algo_dlen(GCRY_MD_SHA256));
+        if (!e->checksum)
+                return log_oom();
+
+        log_debug("SHA256 of exported image is %s.", e->checksum);
+        return 0;
+}
+
 static int raw_export_process(RawExport *e) {
         ssize_t l;
         int r;
 
         assert(e);
 
-        if (!e->tried_reflink && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
+        /* The checksum has to see every byte we write, hence only reflink or sendfile if we don't
+         * calculate one */
+        if (!e->tried_reflink && !e->checksum_context && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
 
                 /* If we shall take an uncompressed snapshot we can
                  * reflink source to destination directly. Let's see
@@ -169,7 +202,7 @@ static int raw_export_process(RawExport *e) {
                 e->tried_reflink = true;
         }
 
-        if (!e->tried_sendfile && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
+        if (!e->tried_sendfile && !e->checksum_context && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
 
                 l = sendfile(e->output_fd, e->input_fd, NULL, COPY_BUFFER_SIZE);
                 if (l < 0) {
@@ -226,6 +259,9 @@ static int raw_export_process(RawExport *e) {
                 goto finish;
         }
 
+        if (e->checksum_context)
+                gcry_md_write(e->checksum_context, e->buffer, l);
+
         assert((size_t) l <= e->buffer_size);
         memmove(e->buffer, (uint8_t*) e->buffer + l, e->buffer_size - l);
         e->buffer_size -= l;
@@ -239,6 +275,8 @@ finish:
         if (r >= 0) {
                 (void) copy_times(e->input_fd, e->output_fd);
                 (void) copy_xattr(e->input_fd, e->output_fd);
+
+                r = raw_export_finish_checksum(e);
         }
 
         if (e->on_finished)
@@ -292,7 +330,7 @@ static int reflink_snapshot(int fd, const char *path) {
         return new_fd;
 }
 
-int raw_export_start(RawExport *e, const char *path, int fd, ImportCompressType compress) {
+int raw_export_start(RawExport *e, const char *path, int fd, ImportCompressType compress, bool checksum) {
         _cleanup_close_ int sfd = -1, tfd = -1;
         int r;
 
@@ -336,6 +374,13 @@ int raw_export_start(RawExport *e, const char *path, int fd, ImportCompressType
         if (r < 0)
                 return r;
 
+        if (checksum && !e->checksum_context) {
+                if (gcry_md_open(&e->checksum_context, GCRY_MD_SHA256, 0) != 0) {
+                        log_error("Failed to initialize hash context.");
+                        return -EIO;
+                }
+        }
+
         r = sd_event_add_io(e->event, &e->output_event_source, fd, EPOLLOUT, raw_export_on_output, e);
         if (r == -EPERM) {
                 r = sd_event_add_defer(e->event, &e->output_event_source, raw_export_on_defer, e);
@@ -350,3 +395,9 @@ int raw_export_start(RawExport *e, const char *path, int fd, ImportCompressType
         e->output_fd = fd;
         return r;
 }
+
+const char *raw_export_get_checksum(RawExport *e) {
+        assert(e);
+
+        return e->checksum;
+}
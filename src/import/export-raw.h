@@ -20,6 +20,8 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <stdbool.h>
+
 #include "sd-event.h"
 
 #include "import-compress.h"
@@ -34,4 +36,5 @@ RawExport* raw_export_unref(RawExport *export);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(RawExport*, raw_export_unref);
 
-int raw_export_start(RawExport *export, const char *path, int fd, ImportCompressType compress);
+int raw_export_start(RawExport *export, const char *path, int fd, ImportCompressType compress, bool checksum);
+const char *raw_export_get_checksum(RawExport *export);
@@ -18,6 +18,8 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <gcrypt.h>
+
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
@@ -25,6 +27,7 @@
 #include "export-tar.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "hexdecoct.h"
 #include "import-common.h"
 #include "process-util.h"
 #include "ratelimit.h"
@@ -47,6 +50,9 @@ struct TarExport {
 
         ImportCompress compress;
 
+        gcry_md_hd_t checksum_context;
+        char *checksum;
+
         sd_event_source *output_event_source;
 
         void *buffer;
@@ -86,11 +92,15 @@ TarExport *tar_export_unref(TarExport *e) {
 
         import_compress_free(&e->compress);
 
+        if (e->checksum_context)
+                gcry_md_close(e->checksum_context);
+
         sd_event_unref(e->event);
 
         safe_close(e->tar_fd);
 
         free(e->buffer);
+        free(e->checksum);
         free(e->path);
         return mfree(e);
 }
@@ -157,13 +167,36 @@ static void tar_export_report_progress(TarExport *e) {
         e->last_percent = percent;
 }
 
+static int tar_export_finish_checksum(TarExport *e) {
+        const uint8_t *k;
+
+        assert(e);
+
+        if (!e->checksum_context)
+                return 0;
+
+        k = gcry_md_read(e->checksum_context, GCRY_MD_SHA256);
+        if (!k) {
+                log_error("Failed to get checksum.");
+                return -EIO;
+        }
+
+        e->checksum = hexmem(k, gcry_md_get_algo_dlen(GCRY_MD_SHA256));
+        if (!e->checksum)
+                return log_oom();
+
+        log_debug("SHA256 of exported image is %s.", e->checksum);
+        return 0;
+}
+
 static int tar_export_process(TarExport *e) {
         ssize_t l;
         int r;
 
         assert(e);
 
-        if (!e->tried_splice && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
+        /* The checksum has to see every byte we write, hence only splice if we don't calculate one */
+        if (!e->tried_splice && !e->checksum_context && e->compress.type == IMPORT_COMPRESS_UNCOMPRESSED) {
 
                 l = splice(e->tar_fd, NULL, e->output_fd, NULL, COPY_BUFFER_SIZE, 0);
                 if (l < 0) {
@@ -220,6 +253,9 @@ static int tar_export_process(TarExport *e) {
                 goto finish;
         }
 
+        if (e->checksum_context)
+                gcry_md_write(e->checksum_context, e->buffer, l);
+
         assert((size_t) l <= e->buffer_size);
         memmove(e->buffer, (uint8_t*) e->buffer + l, e->buffer_size - l);
         e->buffer_size -= l;
@@ -230,6 +266,9 @@ static int tar_export_process(TarExport *e) {
         return 0;
 
 finish:
+        if (r >= 0)
+                r = tar_export_finish_checksum(e);
+
         if (e->on_finished)
                 e->on_finished(e, r, e->userdata);
         else
@@ -250,7 +289,7 @@ static int tar_export_on_defer(sd_event_source *s, void *userdata) {
         return tar_export_process(i);
 }
 
-int tar_export_start(TarExport *e, const char *path, int fd, ImportCompressType compress) {
+int tar_export_start(TarExport *e, const char *path, int fd, ImportCompressType compress, bool checksum) {
         _cleanup_close_ int sfd = -1;
         int r;
 
@@ -305,6 +344,13 @@ int tar_export_start(TarExport *e, const char *path, int fd, ImportCompressType
         if (r < 0)
                 return r;
 
+        if (checksum && !e->checksum_context) {
+                if (gcry_md_open(&e->checksum_context, GCRY_MD_SHA256, 0) != 0) {
+                        log_error("Failed to initialize hash context.");
+                        return -EIO;
+                }
+        }
+
         r = sd_event_add_io(e->event, &e->output_event_source, fd, EPOLLOUT, tar_export_on_output, e);
         if (r == -EPERM) {
                 r = sd_event_add_defer(e->event, &e->output_event_source, tar_export_on_defer, e);
@@ -325,3 +371,9 @@ int tar_export_start(TarExport *e, const char *path, int fd, ImportCompressType
         e->output_fd = fd;
         return r;
 }
+
+const char *tar_export_get_checksum(TarExport *e) {
+        assert(e);
+
+        return e->checksum;
+}
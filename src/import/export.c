@@ -26,6 +26,7 @@
 #include "export-raw.h"
 #include "export-tar.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "hostname-util.h"
 #include "import-util.h"
@@ -35,6 +36,7 @@
 #include "verbs.h"
 
 static ImportCompressType arg_compress = IMPORT_COMPRESS_UNKNOWN;
+static bool arg_checksum = false;
 
 static void determine_compression_from_filename(const char *p) {
 
@@ -56,6 +58,33 @@ static void determine_compression_from_filename(const char *p) {
                 arg_compress = IMPORT_COMPRESS_UNCOMPRESSED;
 }
 
+static int write_checksum_file(const char *path, const char *checksum) {
+        _cleanup_free_ char *p = NULL, *line = NULL;
+        int r;
+
+        assert(path);
+
+        if (!checksum)
+                return 0;
+
+        /* Write the checksum in SHA256SUMS format, so that the file may be concatenated with others into a
+         * SHA256SUMS file for systemd-pull to verify against. */
+        p = strappend(path, ".sha256");
+        if (!p)
+                return log_oom();
+
+        line = strjoin(checksum, " *", basename(path));
+        if (!line)
+                return log_oom();
+
+        r = write_string_file(p, line, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+        if (r < 0)
+                return log_error_errno(r, "Failed to write checksum file %s: %m", p);
+
+        log_info("Wrote checksum to '%s'.", p);
+        return 0;
+}
+
 static int interrupt_signal_handler(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
         log_notice("Transfer aborted.");
         sd_event_exit(sd_event_source_get_event(s), EINTR);
@@ -98,6 +127,11 @@ static int export_tar(int argc, char *argv[], void *userdata) {
         if (isempty(path) || streq(path, "-"))
                 path = NULL;
 
+        if (arg_checksum && !path) {
+                log_error("Calculating a checksum requires an output file.");
+                return -EINVAL;
+        }
+
         determine_compression_from_filename(path);
 
         if (path) {
@@ -129,13 +163,18 @@ static int export_tar(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate exporter: %m");
 
-        r = tar_export_start(export, local, fd, arg_compress);
+        r = tar_export_start(export, local, fd, arg_compress, arg_checksum);
         if (r < 0)
                 return log_error_errno(r, "Failed to export image: %m");
 
         r = sd_event_loop(event);
         if (r < 0)
                 return log_error_errno(r, "Failed to run event loop: %m");
+        if (r == 0) {
+                r = write_checksum_file(path, tar_export_get_checksum(export));
+                if (r < 0)
+                        return r;
+        }
 
         log_info("Exiting.");
         return -r;
@@ -177,6 +216,11 @@ static int export_raw(int argc, char *argv[], void *userdata) {
         if (isempty(path) || streq(path, "-"))
                 path = NULL;
 
+        if (arg_checksum && !path) {
+                log_error("Calculating a checksum requires an output file.");
+                return -EINVAL;
+        }
+
         determine_compression_from_filename(path);
 
         if (path) {
@@ -208,13 +252,18 @@ static int export_raw(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate exporter: %m");
 
-        r = raw_export_start(export, local, fd, arg_compress);
+        r = raw_export_start(export, local, fd, arg_compress, arg_checksum);
         if (r < 0)
                 return log_error_errno(r, "Failed to export image: %m");
 
         r = sd_event_loop(event);
         if (r < 0)
                 return log_error_errno(r, "Failed to run event loop: %m");
+        if (r == 0) {
+                r = write_checksum_file(path, raw_export_get_checksum(export));
+                if (r < 0)
+                        return r;
+        }
 
         log_info("Exiting.");
         return -r;
@@ -226,7 +275,9 @@ static int help(int argc, char *argv[], void *userdata) {
                "Export container or virtual machine images.\n\n"
                "  -h --help                    Show this help\n"
                "     --version                 Show package version\n"
-               "     --format=FORMAT           Select format\n\n"
+               "     --format=FORMAT           Select format\n"
+               "     --checksum                Write SHA256 checksum of the exported image\n"
+               "                               to FILE.sha256\n\n"
                "Commands:\n"
                "  tar NAME [FILE]              Export a TAR image\n"
                "  raw NAME [FILE]              Export a RAW image\n",
@@ -240,12 +291,14 @@ static int parse_argv(int argc, char *argv[]) {
         enum {
                 ARG_VERSION = 0x100,
                 ARG_FORMAT,
+                ARG_CHECKSUM,
         };
 
         static const struct option options[] = {
-                { "help",    no_argument,       NULL, 'h'         },
-                { "version", no_argument,       NULL, ARG_VERSION },
-                { "format",  required_argument, NULL, ARG_FORMAT  },
+                { "help",     no_argument,       NULL, 'h'          },
+                { "version",  no_argument,       NULL, ARG_VERSION  },
+                { "format",   required_argument, NULL, ARG_FORMAT   },
+                { "checksum", no_argument,       NULL, ARG_CHECKSUM },
                 {}
         };
 
@@ -279,6 +332,10 @@ static int parse_argv(int argc, char *argv[]) {
                         }
                         break;
 
+                case ARG_CHECKSUM:
+                        arg_checksum = true;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
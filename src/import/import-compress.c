@@ -19,6 +19,7 @@
 ***/
 
 #include "import-compress.h"
+#include "log.h"
 #include "string-table.h"
 #include "util.h"
 
@@ -195,6 +196,37 @@ int import_uncompress(ImportCompress *c, const void *data, size_t size, ImportCo
         return 1;
 }
 
+#define XZ_ENCODER_THREADS_MAX 8U
+
+static int xz_encoder_init(lzma_stream *xz) {
+#if LZMA_VERSION >= UINT32_C(50020002)
+        lzma_mt mt = {
+                .preset = LZMA_PRESET_DEFAULT,
+                .check = LZMA_CHECK_CRC64,
+                .timeout = 0,
+        };
+        uint64_t limit;
+
+        /* xz is by far the slowest of the formats we support, hence split the stream into blocks and
+         * compress them on all CPUs we have. The result is a regular multi-block .xz file that any xz
+         * decoder (including ours) can read. Don't let the per-thread buffers eat more than a quarter of
+         * RAM though: drop threads until the estimate fits, and use the plain encoder if we end up with
+         * just one. */
+        mt.threads = MIN(lzma_cputhreads(), XZ_ENCODER_THREADS_MAX);
+        limit = physical_memory() / 4;
+
+        while (mt.threads > 1 && lzma_stream_encoder_mt_memusage(&mt) > limit)
+                mt.threads--;
+
+        if (mt.threads > 1 && lzma_stream_encoder_mt(xz, &mt) == LZMA_OK) {
+                log_debug("Compressing with %" PRIu32 " xz encoder threads.", mt.threads);
+                return 0;
+        }
+#endif
+
+        return lzma_easy_encoder(xz, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64) == LZMA_OK ? 0 : -EIO;
+}
+
 int import_compress_init(ImportCompress *c, ImportCompressType t) {
         int r;
 
@@ -202,16 +234,13 @@ int import_compress_init(ImportCompress *c, ImportCompressType t) {
 
         switch (t) {
 
-        case IMPORT_COMPRESS_XZ: {
-                lzma_ret xzr;
-
-                xzr = lzma_easy_encoder(&c->xz, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
-                if (xzr != LZMA_OK)
-                        return -EIO;
+        case IMPORT_COMPRESS_XZ:
+                r = xz_encoder_init(&c->xz);
+                if (r < 0)
+                        return r;
 
                 c->type = IMPORT_COMPRESS_XZ;
                 break;
-        }
 
         case IMPORT_COMPRESS_GZIP:
                 r = deflateInit2(&c->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
@@ -18,6 +18,8 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <pthread.h>
+#include <signal.h>
 #include <sys/xattr.h>
 
 #include "alloc-util.h"
@@ -25,6 +27,7 @@
 #include "hexdecoct.h"
 #include "import-util.h"
 #include "io-util.h"
+#include "list.h"
 #include "machine-pool.h"
 #include "parse-util.h"
 #include "pull-common.h"
@@ -33,10 +36,276 @@
 #include "strv.h"
 #include "xattr-util.h"
 
+/* Don't queue more than this many bytes of compressed data for the pipeline stages, beyond that the transfer is
+ * throttled until the stages caught up */
+#define PULL_PIPELINE_QUEUE_MAX (8U*1024U*1024U)
+
+typedef enum PullStageType {
+        PULL_STAGE_CHECKSUM,
+        PULL_STAGE_WRITE,
+        _PULL_STAGE_MAX,
+} PullStageType;
+
+typedef struct PullBuffer PullBuffer;
+
+struct PullBuffer {
+        unsigned n_ref;           /* one for each stage that still needs to look at it */
+        size_t size;
+        LIST_FIELDS(PullBuffer, buffers);
+        uint8_t data[];
+};
+
+typedef struct PullStage {
+        PullPipeline *pipeline;
+        PullStageType type;
+        pthread_t thread;
+        bool running;
+        PullBuffer *next;         /* the next buffer this stage shall process, NULL if it caught up */
+} PullStage;
+
+struct PullPipeline {
+        PullJob *job;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;      /* signalled when a buffer is queued or released, and when we shall stop */
+
+        /* The oldest buffer is at the head, and is also the first to be released by all stages */
+        LIST_HEAD(PullBuffer, buffers);
+        PullBuffer *buffers_tail;
+        size_t n_queued;
+
+        PullStage stages[_PULL_STAGE_MAX];
+        unsigned n_stages;
+
+        bool eof;
+        int error;
+};
+
+static int pull_job_write_uncompressed(const void *p, size_t sz, void *userdata);
+
+static int pull_stage_process(PullStage *s, const PullBuffer *b) {
+        PullJob *j = s->pipeline->job;
+
+        switch (s->type) {
+
+        case PULL_STAGE_CHECKSUM:
+                gcry_md_write(j->checksum_context, b->data, b->size);
+                return 0;
+
+        case PULL_STAGE_WRITE:
+                return import_uncompress(&j->compress, b->data, b->size, pull_job_write_uncompressed, j);
+
+        default:
+                assert_not_reached("Unknown stage type.");
+        }
+}
+
+static void *pull_stage_thread(void *userdata) {
+        PullStage *s = userdata;
+        PullPipeline *p = s->pipeline;
+
+        for (;;) {
+                PullBuffer *b;
+                int r;
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                while (!s->next && !p->eof && p->error == 0)
+                        assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+
+                b = p->error == 0 ? s->next : NULL;
+
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                if (!b)
+                        return NULL;
+
+                r = pull_stage_process(s, b);
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+                if (r < 0 && p->error == 0)
+                        p->error = r;
+
+                s->next = b->buffers_next;
+
+                assert(b->n_ref > 0);
+                if (--b->n_ref == 0) {
+                        /* All stages process the buffers in order, hence the last one to release a buffer
+                         * always releases the oldest one. */
+                        assert(b == p->buffers);
+
+                        LIST_REMOVE(buffers, p->buffers, b);
+                        if (p->buffers_tail == b)
+                                p->buffers_tail = NULL;
+                        p->n_queued -= b->size;
+                        free(b);
+                }
+
+                assert_se(pthread_cond_broadcast(&p->cond) == 0);
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+        }
+}
+
+static int pull_pipeline_stop(PullPipeline *p, int error) {
+        PullBuffer *b;
+        unsigned i;
+        int r;
+
+        assert(p);
+
+        /* Tells the stages to finish processing what is queued and exit, or, if error is set, to exit right
+         * away. Returns the first error any stage ran into. */
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->eof = true;
+        if (error < 0 && p->error == 0)
+                p->error = error;
+        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        for (i = 0; i < _PULL_STAGE_MAX; i++)
+                if (p->stages[i].running) {
+                        assert_se(pthread_join(p->stages[i].thread, NULL) == 0);
+                        p->stages[i].running = false;
+                }
+
+        while ((b = p->buffers)) {
+                LIST_REMOVE(buffers, p->buffers, b);
+                free(b);
+        }
+        p->buffers_tail = NULL;
+        p->n_queued = 0;
+
+        r = p->error;
+
+        assert_se(pthread_cond_destroy(&p->cond) == 0);
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+        free(p);
+
+        return r;
+}
+
+static int pull_job_stop_pipeline(PullJob *j, int error) {
+        PullPipeline *p;
+
+        assert(j);
+
+        p = j->pipeline;
+        if (!p)
+                return 0;
+
+        j->pipeline = NULL;
+
+        return pull_pipeline_stop(p, error);
+}
+
+static void pull_job_start_pipeline(PullJob *j) {
+        sigset_t ss, saved_ss;
+        PullPipeline *p;
+        unsigned i;
+        int r;
+
+        assert(j);
+        assert(!j->pipeline);
+
+        /* Moves hashing and the decompression plus disk writes into threads of their own, so that neither
+         * stalls the transfer, and both run in parallel on multi-core machines. If anything goes wrong here
+         * we just do everything inline in the curl callback, as before. */
+
+        p = new0(PullPipeline, 1);
+        if (!p)
+                return;
+
+        p->job = j;
+        assert_se(pthread_mutex_init(&p->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&p->cond, NULL) == 0);
+
+        for (i = 0; i < _PULL_STAGE_MAX; i++)
+                p->stages[i] = (PullStage) {
+                        .pipeline = p,
+                        .type = i,
+                };
+
+        /* The stages shall not get any signals delivered */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                goto fail;
+
+        for (i = 0; i < _PULL_STAGE_MAX; i++) {
+                if (i == PULL_STAGE_CHECKSUM && !j->checksum_context)
+                        continue;
+
+                if (pthread_create(&p->stages[i].thread, NULL, pull_stage_thread, p->stages + i) > 0)
+                        break;
+
+                p->stages[i].running = true;
+                p->n_stages++;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        if (i < _PULL_STAGE_MAX)
+                goto fail;
+
+        j->pipeline = p;
+        return;
+
+fail:
+        log_debug("Failed to start pipeline threads, processing %s inline.", j->url);
+        (void) pull_pipeline_stop(p, -ECANCELED);
+}
+
+static int pull_pipeline_push(PullPipeline *p, const void *data, size_t sz) {
+        PullBuffer *b;
+        unsigned i;
+        int r;
+
+        assert(p);
+        assert(data);
+
+        b = malloc(offsetof(PullBuffer, data) + sz);
+        if (!b)
+                return -ENOMEM;
+
+        b->n_ref = p->n_stages;
+        b->size = sz;
+        memcpy(b->data, data, sz);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        /* Bound the memory we use for the queue, even if that means we block the event loop for a while */
+        while (p->n_queued >= PULL_PIPELINE_QUEUE_MAX && p->error == 0)
+                assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+
+        r = p->error;
+        if (r == 0) {
+                LIST_INSERT_AFTER(buffers, p->buffers, p->buffers_tail, b);
+                p->buffers_tail = b;
+                p->n_queued += sz;
+
+                for (i = 0; i < _PULL_STAGE_MAX; i++)
+                        if (p->stages[i].running && !p->stages[i].next)
+                                p->stages[i].next = b;
+
+                assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        if (r < 0)
+                free(b);
+
+        return r;
+}
+
 PullJob* pull_job_unref(PullJob *j) {
         if (!j)
                 return NULL;
 
+        (void) pull_job_stop_pipeline(j, -ECANCELED);
+
         curl_glue_remove_and_free(j->glue, j->curl);
         curl_slist_free_all(j->request_header);
 
@@ -62,6 +331,9 @@ static void pull_job_finish(PullJob *j, int ret) {
         if (IN_SET(j->state, PULL_JOB_DONE, PULL_JOB_FAILED))
                 return;
 
+        /* Make sure nothing touches the disk fd behind the back of whoever handles the result */
+        (void) pull_job_stop_pipeline(j, ret < 0 ? ret : -ECANCELED);
+
         if (ret == 0) {
                 j->state = PULL_JOB_DONE;
                 j->progress_percent = 100;
@@ -85,6 +357,8 @@ static int pull_job_restart(PullJob *j) {
 
         free(j->url);
         j->url = chksum_url;
+        (void) pull_job_stop_pipeline(j, -ECANCELED);
+
         j->state = PULL_JOB_INIT;
         j->payload = mfree(j->payload);
         j->payload_size = 0;
@@ -171,6 +445,11 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
                 goto finish;
         }
 
+        /* Wait until the pipeline stages dealt with everything we got */
+        r = pull_job_stop_pipeline(j, 0);
+        if (r < 0)
+                goto finish;
+
         if (j->checksum_context) {
                 uint8_t *k;
 
@@ -298,12 +577,18 @@ static int pull_job_write_compressed(PullJob *j, void *p, size_t sz) {
                 return -EFBIG;
         }
 
-        if (j->checksum_context)
-                gcry_md_write(j->checksum_context, p, sz);
+        if (j->pipeline) {
+                r = pull_pipeline_push(j->pipeline, p, sz);
+                if (r < 0)
+                        return r;
+        } else {
+                if (j->checksum_context)
+                        gcry_md_write(j->checksum_context, p, sz);
 
-        r = import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
-        if (r < 0)
-                return r;
+                r = import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
+                if (r < 0)
+                        return r;
+        }
 
         j->written_compressed += sz;
 
@@ -364,6 +649,9 @@ static int pull_job_detect_compression(PullJob *j) {
         if (r < 0)
                 return r;
 
+        if (j->disk_fd >= 0)
+                pull_job_start_pipeline(j);
+
         /* Now, take the payload we read so far, and decompress it */
         stub = j->payload;
         stub_size = j->payload_size;
@@ -27,6 +27,7 @@
 #include "macro.h"
 
 typedef struct PullJob PullJob;
+typedef struct PullPipeline PullPipeline;
 
 typedef void (*PullJobFinished)(PullJob *job);
 typedef int (*PullJobOpenDisk)(PullJob *job);
@@ -102,6 +103,9 @@ struct PullJob {
         bool grow_machine_directory;
         uint64_t written_since_last_grow;
 
+        /* Hashing, decompression and disk writes happen off the main thread in here, once we write to disk */
+        PullPipeline *pipeline;
+
         VerificationStyle style;
 };
 
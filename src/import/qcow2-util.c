@@ -18,10 +18,14 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <zlib.h>
 
 #include "alloc-util.h"
 #include "btrfs-util.h"
+#include "list.h"
 #include "qcow2-util.h"
 #include "sparse-endian.h"
 #include "util.h"
@@ -79,32 +83,69 @@ static uint32_t HEADER_HEADER_LENGTH(const Header *h) {
         return be32toh(h->header_length);
 }
 
-static int copy_cluster(
+/* Runs of clusters that are laid out sequentially in the image are copied with a single call, up to this size */
+#define QCOW2_EXTENT_MAX (4U*1024U*1024U)
+
+#define QCOW2_WORKERS_MAX 8U
+
+static bool buffer_is_zero(const uint8_t *p, size_t n) {
+        assert(p);
+        assert(n > 0);
+
+        return p[0] == 0 && memcmp(p, p + 1, n - 1) == 0;
+}
+
+static int write_clusters(int dfd, uint64_t doffset, const uint8_t *buffer, uint64_t size, uint64_t cluster_size) {
+        uint64_t i = 0;
+        ssize_t l;
+
+        /* Writes out the buffer, but skips all clusters that are entirely zero. The output file has been
+         * truncated before, hence those end up as holes. Consecutive non-zero clusters are written in one go. */
+
+        while (i < size) {
+                uint64_t n = 0;
+
+                while (i + n < size && !buffer_is_zero(buffer + i + n, cluster_size))
+                        n += cluster_size;
+
+                if (n > 0) {
+                        l = pwrite(dfd, buffer + i, n, doffset + i);
+                        if (l < 0)
+                                return -errno;
+                        if ((uint64_t) l != n)
+                                return -EIO;
+                }
+
+                i += n + cluster_size;
+        }
+
+        return 0;
+}
+
+static int copy_extent(
                 int sfd, uint64_t soffset,
                 int dfd, uint64_t doffset,
+                uint64_t size,
                 uint64_t cluster_size,
                 void *buffer) {
 
         ssize_t l;
         int r;
 
-        r = btrfs_clone_range(sfd, soffset, dfd, doffset, cluster_size);
+        assert(size <= QCOW2_EXTENT_MAX);
+        assert(size % cluster_size == 0);
+
+        r = btrfs_clone_range(sfd, soffset, dfd, doffset, size);
         if (r >= 0)
                 return r;
 
-        l = pread(sfd, buffer, cluster_size, soffset);
+        l = pread(sfd, buffer, size, soffset);
         if (l < 0)
                 return -errno;
-        if ((uint64_t) l != cluster_size)
+        if ((uint64_t) l != size)
                 return -EIO;
 
-        l = pwrite(dfd, buffer, cluster_size, doffset);
-        if (l < 0)
-                return -errno;
-        if ((uint64_t) l != cluster_size)
-                return -EIO;
-
-        return 0;
+        return write_clusters(dfd, doffset, buffer, size, cluster_size);
 }
 
 static int decompress_cluster(
@@ -153,15 +194,197 @@ static int decompress_cluster(
         if (r != Z_STREAM_END || sz != cluster_size)
                 return -EIO;
 
-        l = pwrite(dfd, buffer2, cluster_size, doffset);
-        if (l < 0)
-                return -errno;
-        if ((uint64_t) l != cluster_size)
-                return -EIO;
+        return write_clusters(dfd, doffset, buffer2, cluster_size, cluster_size);
+}
+
+typedef struct DecompressJob DecompressJob;
+
+struct DecompressJob {
+        uint64_t soffset, doffset, compressed_size;
+
+        LIST_FIELDS(DecompressJob, queue);
+};
+
+typedef struct DecompressPool {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond_queued;   /* signalled when a job is queued, or on shutdown */
+        pthread_cond_t cond_taken;    /* signalled when a worker took a job off the queue */
+
+        LIST_HEAD(DecompressJob, queue);
+        DecompressJob *queue_tail;
+        unsigned n_queued;
+        bool shutdown;
+        int error;
+
+        int sfd, dfd;
+        uint64_t cluster_size;
+
+        pthread_t workers[QCOW2_WORKERS_MAX];
+        unsigned n_workers;
+} DecompressPool;
+
+static void *decompress_worker(void *p) {
+        _cleanup_free_ void *buffer1 = NULL, *buffer2 = NULL;
+        DecompressPool *pool = p;
+
+        buffer1 = malloc(pool->cluster_size);
+        buffer2 = malloc(pool->cluster_size);
+
+        for (;;) {
+                DecompressJob *j;
+                int r;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+                while (!pool->queue && !pool->shutdown)
+                        assert_se(pthread_cond_wait(&pool->cond_queued, &pool->mutex) == 0);
+
+                j = pool->queue;
+                if (!j) {
+                        /* Shut down, and nothing left to do */
+                        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+                        return NULL;
+                }
+
+                LIST_REMOVE(queue, pool->queue, j);
+                if (pool->queue_tail == j)
+                        pool->queue_tail = NULL;
+                pool->n_queued--;
+
+                assert_se(pthread_cond_signal(&pool->cond_taken) == 0);
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                if (buffer1 && buffer2)
+                        r = decompress_cluster(
+                                        pool->sfd, j->soffset,
+                                        pool->dfd, j->doffset,
+                                        j->compressed_size, pool->cluster_size,
+                                        buffer1, buffer2);
+                else
+                        r = -ENOMEM;
+                free(j);
+
+                if (r < 0) {
+                        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                        if (pool->error >= 0)
+                                pool->error = r;
+                        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+                }
+        }
+}
+
+static int decompress_pool_submit(DecompressPool *pool, uint64_t soffset, uint64_t doffset, uint64_t compressed_size) {
+        DecompressJob *j;
+        int r;
+
+        assert(pool);
+
+        j = new(DecompressJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (DecompressJob) {
+                .soffset = soffset,
+                .doffset = doffset,
+                .compressed_size = compressed_size,
+        };
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+        /* Keep a few jobs queued per worker, so that none of them runs dry */
+        while (pool->n_queued >= 4 * pool->n_workers && pool->error >= 0)
+                assert_se(pthread_cond_wait(&pool->cond_taken, &pool->mutex) == 0);
+
+        r = pool->error;
+        if (r >= 0) {
+                LIST_INSERT_AFTER(queue, pool->queue, pool->queue_tail, j);
+                pool->queue_tail = j;
+                pool->n_queued++;
+
+                assert_se(pthread_cond_signal(&pool->cond_queued) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        if (r < 0)
+                free(j);
+
+        return r;
+}
+
+static void decompress_pool_destroy(DecompressPool *pool) {
+        assert(pool);
+
+        assert_se(pthread_cond_destroy(&pool->cond_taken) == 0);
+        assert_se(pthread_cond_destroy(&pool->cond_queued) == 0);
+        assert_se(pthread_mutex_destroy(&pool->mutex) == 0);
+}
+
+static int decompress_pool_start(DecompressPool *pool) {
+        sigset_t ss, saved_ss;
+        unsigned n;
+        long ncpus;
+        int r;
+
+        assert(pool);
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = CLAMP(ncpus, 2, (long) QCOW2_WORKERS_MAX);
+
+        /* The workers shall not get any signals delivered */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        assert_se(pthread_mutex_init(&pool->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&pool->cond_queued, NULL) == 0);
+        assert_se(pthread_cond_init(&pool->cond_taken, NULL) == 0);
+
+        for (pool->n_workers = 0; pool->n_workers < n; pool->n_workers++) {
+                r = pthread_create(pool->workers + pool->n_workers, NULL, decompress_worker, pool);
+                if (r > 0)
+                        break;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        if (pool->n_workers == 0) {
+                decompress_pool_destroy(pool);
+                return -r;
+        }
 
         return 0;
 }
 
+static int decompress_pool_stop(DecompressPool *pool) {
+        DecompressJob *j;
+        unsigned i;
+
+        assert(pool);
+
+        if (pool->n_workers == 0)
+                return 0;
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        pool->shutdown = true;
+        assert_se(pthread_cond_broadcast(&pool->cond_queued) == 0);
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        for (i = 0; i < pool->n_workers; i++)
+                assert_se(pthread_join(pool->workers[i], NULL) == 0);
+
+        while ((j = pool->queue)) {
+                LIST_REMOVE(queue, pool->queue, j);
+                free(j);
+        }
+        pool->n_workers = 0;
+
+        decompress_pool_destroy(pool);
+
+        return pool->error;
+}
+
 static int normalize_offset(
                 const Header *header,
                 uint64_t p,
@@ -244,13 +467,106 @@ static int verify_header(const Header *header) {
         return 0;
 }
 
+static int qcow2_convert_tables(
+                int qcow2_fd,
+                int raw_fd,
+                const Header *header,
+                const be64_t *l1_table,
+                be64_t *l2_table,
+                void *buffer1,
+                void *buffer2,
+                DecompressPool *pool) {
+
+        uint64_t extent_source = 0, extent_dest = 0, extent_size = 0, i;
+        ssize_t l;
+        int r;
+
+        for (i = 0; i < HEADER_L1_SIZE(header); i ++) {
+                uint64_t l2_begin, j;
+
+                r = normalize_offset(header, l1_table[i], &l2_begin, NULL, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                l = pread(qcow2_fd, l2_table, HEADER_CLUSTER_SIZE(header), l2_begin);
+                if (l < 0)
+                        return -errno;
+                if ((uint64_t) l != HEADER_CLUSTER_SIZE(header))
+                        return -EIO;
+
+                for (j = 0; j < HEADER_L2_SIZE(header); j++) {
+                        uint64_t data_begin, p, compressed_size;
+                        bool compressed;
+
+                        p = ((i << HEADER_L2_BITS(header)) + j) << HEADER_CLUSTER_BITS(header);
+
+                        r = normalize_offset(header, l2_table[j], &data_begin, &compressed, &compressed_size);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                continue;
+
+                        if (compressed) {
+                                if (pool->n_workers > 0)
+                                        r = decompress_pool_submit(pool, data_begin, p, compressed_size);
+                                else
+                                        r = decompress_cluster(
+                                                        qcow2_fd, data_begin,
+                                                        raw_fd, p,
+                                                        compressed_size, HEADER_CLUSTER_SIZE(header),
+                                                        buffer1, buffer2);
+                                if (r < 0)
+                                        return r;
+
+                                continue;
+                        }
+
+                        /* Extend the current extent if this cluster directly follows it, both in the image
+                         * and in the output */
+                        if (extent_size > 0 &&
+                            extent_source + extent_size == data_begin &&
+                            extent_dest + extent_size == p &&
+                            extent_size + HEADER_CLUSTER_SIZE(header) <= QCOW2_EXTENT_MAX) {
+                                extent_size += HEADER_CLUSTER_SIZE(header);
+                                continue;
+                        }
+
+                        if (extent_size > 0) {
+                                r = copy_extent(
+                                                qcow2_fd, extent_source,
+                                                raw_fd, extent_dest,
+                                                extent_size, HEADER_CLUSTER_SIZE(header),
+                                                buffer1);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        extent_source = data_begin;
+                        extent_dest = p;
+                        extent_size = HEADER_CLUSTER_SIZE(header);
+                }
+        }
+
+        if (extent_size > 0)
+                return copy_extent(
+                                qcow2_fd, extent_source,
+                                raw_fd, extent_dest,
+                                extent_size, HEADER_CLUSTER_SIZE(header),
+                                buffer1);
+
+        return 0;
+}
+
 int qcow2_convert(int qcow2_fd, int raw_fd) {
         _cleanup_free_ void *buffer1 = NULL, *buffer2 = NULL;
         _cleanup_free_ be64_t *l1_table = NULL, *l2_table = NULL;
-        uint64_t sz, i;
+        DecompressPool pool = {};
+        uint64_t sz;
         Header header;
         ssize_t l;
-        int r;
+        int r, q;
 
         l = pread(qcow2_fd, &header, sizeof(header), 0);
         if (l < 0)
@@ -270,7 +586,7 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
         if (!l2_table)
                 return -ENOMEM;
 
-        buffer1 = malloc(HEADER_CLUSTER_SIZE(&header));
+        buffer1 = malloc(QCOW2_EXTENT_MAX);
         if (!buffer1)
                 return -ENOMEM;
 
@@ -292,50 +608,23 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
         if ((uint64_t) l != sz)
                 return -EIO;
 
-        for (i = 0; i < HEADER_L1_SIZE(&header); i ++) {
-                uint64_t l2_begin, j;
-
-                r = normalize_offset(&header, l1_table[i], &l2_begin, NULL, NULL);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        continue;
-
-                l = pread(qcow2_fd, l2_table, HEADER_CLUSTER_SIZE(&header), l2_begin);
-                if (l < 0)
-                        return -errno;
-                if ((uint64_t) l != HEADER_CLUSTER_SIZE(&header))
-                        return -EIO;
-
-                for (j = 0; j < HEADER_L2_SIZE(&header); j++) {
-                        uint64_t data_begin, p, compressed_size;
-                        bool compressed;
+        /* Data clusters are usually allocated in ascending order, hence tell the kernel to read ahead */
+        (void) posix_fadvise(qcow2_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-                        p = ((i << HEADER_L2_BITS(&header)) + j) << HEADER_CLUSTER_BITS(&header);
+        /* Compressed clusters are decompressed by a bunch of worker threads, while we copy the rest. If the
+         * workers can't be started, we do everything ourselves. */
+        pool.sfd = qcow2_fd;
+        pool.dfd = raw_fd;
+        pool.cluster_size = HEADER_CLUSTER_SIZE(&header);
+        (void) decompress_pool_start(&pool);
 
-                        r = normalize_offset(&header, l2_table[j], &data_begin, &compressed, &compressed_size);
-                        if (r < 0)
-                                return r;
-                        if (r == 0)
-                                continue;
+        r = qcow2_convert_tables(qcow2_fd, raw_fd, &header, l1_table, l2_table, buffer1, buffer2, &pool);
 
-                        if (compressed)
-                                r = decompress_cluster(
-                                                qcow2_fd, data_begin,
-                                                raw_fd, p,
-                                                compressed_size, HEADER_CLUSTER_SIZE(&header),
-                                                buffer1, buffer2);
-                        else
-                                r = copy_cluster(
-                                                qcow2_fd, data_begin,
-                                                raw_fd, p,
-                                                HEADER_CLUSTER_SIZE(&header), buffer1);
-                        if (r < 0)
-                                return r;
-                }
-        }
+        q = decompress_pool_stop(&pool);
+        if (r >= 0 && q < 0)
+                r = q;
 
-        return 0;
+        return r;
 }
 
 int qcow2_detect(int fd) {
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <microhttpd.h>
+#include <regex.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -34,11 +35,14 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hostname-util.h"
+#include "journal-util.h"
 #include "log.h"
 #include "logs-show.h"
 #include "microhttpd-util.h"
 #include "parse-util.h"
 #include "sigbus.h"
+#include "strv.h"
+#include "time-util.h"
 #include "util.h"
 
 #define JOURNAL_WAIT_TIMEOUT (10*USEC_PER_SEC)
@@ -48,6 +52,11 @@ static char *arg_cert_pem = NULL;
 static char *arg_trust_pem = NULL;
 static char *arg_directory = NULL;
 
+typedef struct RequestRegex {
+        char *field;
+        regex_t regex;
+} RequestRegex;
+
 typedef struct RequestMeta {
         sd_journal *journal;
 
@@ -58,7 +67,16 @@ typedef struct RequestMeta {
         uint64_t n_entries;
         bool n_entries_set;
 
+        /* Filters which cannot be expressed as journal matches */
+        usec_t since, until;
+        bool until_reached;
+        RequestRegex *regexes;
+        size_t n_regexes;
+
+        /* The serialized current entry, which is copied into the response buffers piecewise */
         FILE *tmp;
+        char *buffer;
+        size_t buffer_size;
         uint64_t delta, size;
 
         int argument_parse_error;
@@ -88,6 +106,8 @@ static RequestMeta *request_meta(void **connection_cls) {
         if (!m)
                 return NULL;
 
+        m->until = USEC_INFINITY;
+
         *connection_cls = m;
         return m;
 }
@@ -99,6 +119,7 @@ static void request_meta_free(
                 enum MHD_RequestTerminationCode toe) {
 
         RequestMeta *m = *connection_cls;
+        size_t i;
 
         if (!m)
                 return;
@@ -106,6 +127,13 @@ static void request_meta_free(
         sd_journal_close(m->journal);
 
         safe_fclose(m->tmp);
+        free(m->buffer);
+
+        for (i = 0; i < m->n_regexes; i++) {
+                free(m->regexes[i].field);
+                regfree(&m->regexes[i].regex);
+        }
+        free(m->regexes);
 
         free(m->cursor);
         free(m);
@@ -126,25 +154,194 @@ static int open_journal(RequestMeta *m) {
 static int request_meta_ensure_tmp(RequestMeta *m) {
         assert(m);
 
+        /* Entries are serialized into memory, which is then copied
+         * straight into the response buffers. The stream is reused
+         * for all entries of a request. */
+
         if (m->tmp)
                 rewind(m->tmp);
         else {
-                int fd;
+                m->tmp = open_memstream(&m->buffer, &m->buffer_size);
+                if (!m->tmp)
+                        return -ENOMEM;
+        }
 
-                fd = open_tmpfile_unlinkable("/tmp", O_RDWR|O_CLOEXEC);
-                if (fd < 0)
-                        return fd;
+        return 0;
+}
 
-                m->tmp = fdopen(fd, "w+");
-                if (!m->tmp) {
-                        safe_close(fd);
-                        return -errno;
-                }
-        }
+static int request_meta_flush_tmp(RequestMeta *m) {
+        off_t sz;
 
+        assert(m);
+        assert(m->tmp);
+
+        if (fflush(m->tmp) != 0)
+                return errno > 0 ? -errno : -ENOMEM;
+
+        sz = ftello(m->tmp);
+        if (sz == (off_t) -1)
+                return -errno;
+
+        m->size = (uint64_t) sz;
         return 0;
 }
 
+static bool request_has_filters(RequestMeta *m) {
+        assert(m);
+
+        return m->since > 0 || m->until != USEC_INFINITY || m->n_regexes > 0;
+}
+
+static int request_test_regexes(RequestMeta *m) {
+        size_t i;
+        int r;
+
+        assert(m);
+
+        for (i = 0; i < m->n_regexes; i++) {
+                RequestRegex *x = m->regexes + i;
+                regmatch_t match;
+                const void *d;
+                size_t l, k;
+
+                r = sd_journal_get_data(m->journal, x->field, &d, &l);
+                if (r == -ENOENT)
+                        return 0;
+                if (r < 0)
+                        return r;
+
+                k = strlen(x->field) + 1;
+                assert(l >= k);
+
+                /* Field data is not NUL terminated, hence pass the bounds explicitly */
+                match.rm_so = 0;
+                match.rm_eo = l - k;
+                if (regexec(&x->regex, (const char*) d + k, 1, &match, REG_STARTEND) != 0)
+                        return 0;
+        }
+
+        return 1;
+}
+
+static int request_test_filters(RequestMeta *m) {
+        usec_t t;
+        int r;
+
+        assert(m);
+
+        /* Returns > 0 if the current entry should be serialized, 0
+         * if not, and -ERANGE if it is newer than the "until" limit. */
+
+        if (m->since > 0 || m->until != USEC_INFINITY) {
+                r = sd_journal_get_realtime_usec(m->journal, &t);
+                if (r < 0)
+                        return r;
+
+                if (t < m->since)
+                        return 0;
+                if (t > m->until)
+                        return -ERANGE;
+        }
+
+        return request_test_regexes(m);
+}
+
+static int request_advance(RequestMeta *m) {
+        uint64_t skip;
+        int r;
+
+        assert(m);
+
+        /* Moves to the next entry to serialize and applies the
+         * requested skip. Returns 0 if there is none (yet). */
+
+        if (!request_has_filters(m)) {
+                if (m->n_skip < 0)
+                        r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
+                else if (m->n_skip > 0)
+                        r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
+                else
+                        r = sd_journal_next(m->journal);
+
+                if (r > 0)
+                        m->n_skip = 0;
+                return r;
+        }
+
+        /* With filters the skip has to count matching entries only,
+         * hence step through the journal one entry at a time. */
+
+        if (m->n_skip < 0) {
+                uint64_t found = 0;
+
+                skip = (uint64_t) -m->n_skip + 1;
+                m->n_skip = 0;
+
+                for (;;) {
+                        r = sd_journal_previous(m->journal);
+                        if (r < 0)
+                                return r;
+                        if (r == 0) {
+                                /* Fewer matches than requested, start from the beginning */
+                                r = sd_journal_seek_head(m->journal);
+                                if (r < 0)
+                                        return r;
+                                break;
+                        }
+
+                        r = request_test_filters(m);
+                        if (r == -ERANGE)
+                                continue;
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ++found >= skip)
+                                return 1;
+
+                        if (m->since > 0) {
+                                usec_t t;
+
+                                /* Older entries cannot match anymore, continue forwards from here */
+                                r = sd_journal_get_realtime_usec(m->journal, &t);
+                                if (r < 0)
+                                        return r;
+                                if (t < m->since)
+                                        break;
+                        }
+                }
+
+                skip = 0;
+        } else
+                skip = (uint64_t) m->n_skip;
+
+        for (;;) {
+                r = sd_journal_next(m->journal);
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        m->n_skip = (int64_t) skip;
+                        return 0;
+                }
+
+                r = request_test_filters(m);
+                if (r == -ERANGE) {
+                        m->until_reached = true;
+                        return 0;
+                }
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                if (skip > 0) {
+                        skip--;
+                        continue;
+                }
+
+                m->n_skip = 0;
+                return 1;
+        }
+}
+
 static ssize_t request_reader_entries(
                 void *cls,
                 uint64_t pos,
@@ -153,7 +350,7 @@ static ssize_t request_reader_entries(
 
         RequestMeta *m = cls;
         int r;
-        size_t n, k;
+        size_t n;
 
         assert(m);
         assert(buf);
@@ -163,7 +360,6 @@ static ssize_t request_reader_entries(
         pos -= m->delta;
 
         while (pos >= m->size) {
-                off_t sz;
 
                 /* End of this entry, so let's serialize the next
                  * one */
@@ -172,19 +368,13 @@ static ssize_t request_reader_entries(
                     m->n_entries <= 0)
                         return MHD_CONTENT_READER_END_OF_STREAM;
 
-                if (m->n_skip < 0)
-                        r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
-                else if (m->n_skip > 0)
-                        r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
-                else
-                        r = sd_journal_next(m->journal);
-
+                r = request_advance(m);
                 if (r < 0) {
                         log_error_errno(r, "Failed to advance journal pointer: %m");
                         return MHD_CONTENT_READER_END_WITH_ERROR;
                 } else if (r == 0) {
 
-                        if (m->follow) {
+                        if (m->follow && !m->until_reached) {
                                 r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
                                 if (r < 0) {
                                         log_error_errno(r, "Couldn't wait for journal event: %m");
@@ -218,11 +408,9 @@ static ssize_t request_reader_entries(
                 if (m->n_entries_set)
                         m->n_entries -= 1;
 
-                m->n_skip = 0;
-
                 r = request_meta_ensure_tmp(m);
                 if (r < 0) {
-                        log_error_errno(r, "Failed to create temporary file: %m");
+                        log_error_errno(r, "Failed to allocate serialization buffer: %m");
                         return MHD_CONTENT_READER_END_WITH_ERROR;
                 }
 
@@ -232,37 +420,25 @@ static ssize_t request_reader_entries(
                         return MHD_CONTENT_READER_END_WITH_ERROR;
                 }
 
-                sz = ftello(m->tmp);
-                if (sz == (off_t) -1) {
-                        log_error_errno(errno, "Failed to retrieve file position: %m");
+                r = request_meta_flush_tmp(m);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to serialize item: %m");
                         return MHD_CONTENT_READER_END_WITH_ERROR;
                 }
-
-                m->size = (uint64_t) sz;
         }
 
         if (m->tmp == NULL && m->follow)
                 return 0;
 
-        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
-                log_error_errno(errno, "Failed to seek to position: %m");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
-        }
-
         n = m->size - pos;
         if (n < 1)
                 return 0;
         if (n > max)
                 n = max;
 
-        errno = 0;
-        k = fread(buf, 1, n, m->tmp);
-        if (k != n) {
-                log_error("Failed to read from file: %s", errno ? strerror(errno) : "Premature EOF");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
-        }
+        memcpy(buf, m->buffer + pos, n);
 
-        return (ssize_t) k;
+        return (ssize_t) n;
 }
 
 static int request_parse_accept(
@@ -435,6 +611,81 @@ static int request_parse_arguments_iterator(
                 return MHD_YES;
         }
 
+        if (STR_IN_SET(key, "since", "until")) {
+                usec_t t;
+
+                r = parse_timestamp(strempty(value), &t);
+                if (r < 0) {
+                        m->argument_parse_error = r;
+                        return MHD_NO;
+                }
+
+                if (streq(key, "since"))
+                        m->since = t;
+                else
+                        m->until = t;
+
+                return MHD_YES;
+        }
+
+        if (streq(key, "limit")) {
+                r = safe_atou64(strempty(value), &m->n_entries);
+                if (r < 0 || m->n_entries <= 0) {
+                        m->argument_parse_error = r < 0 ? r : -EINVAL;
+                        return MHD_NO;
+                }
+
+                m->n_entries_set = true;
+                return MHD_YES;
+        }
+
+        if (streq(key, "offset")) {
+                r = safe_atoi64(strempty(value), &m->n_skip);
+                if (r < 0) {
+                        m->argument_parse_error = r;
+                        return MHD_NO;
+                }
+
+                return MHD_YES;
+        }
+
+        if (endswith(key, "~")) {
+                _cleanup_free_ char *field = NULL;
+                RequestRegex *x;
+
+                /* FIELD~=REGEX matches the field against an extended regular expression */
+
+                field = strndup(key, strlen(key) - 1);
+                if (!field) {
+                        m->argument_parse_error = log_oom();
+                        return MHD_NO;
+                }
+
+                if (!journal_field_valid(field, strlen(field), true)) {
+                        m->argument_parse_error = -EINVAL;
+                        return MHD_NO;
+                }
+
+                x = realloc_multiply(m->regexes, sizeof(RequestRegex), m->n_regexes + 1);
+                if (!x) {
+                        m->argument_parse_error = log_oom();
+                        return MHD_NO;
+                }
+                m->regexes = x;
+                x += m->n_regexes;
+
+                if (regcomp(&x->regex, strempty(value), REG_EXTENDED|REG_NOSUB) != 0) {
+                        m->argument_parse_error = -EINVAL;
+                        return MHD_NO;
+                }
+
+                x->field = field;
+                field = NULL;
+                m->n_regexes++;
+
+                return MHD_YES;
+        }
+
         p = strjoin(key, "=", strempty(value));
         if (!p) {
                 m->argument_parse_error = log_oom();
@@ -495,11 +746,19 @@ static int request_handler_entries(
                 m->n_entries_set = true;
         }
 
+        if (m->since > m->until)
+                return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Empty time range requested.");
+
+        /* Use the time range to bisect to the first (or last) relevant entry directly */
         if (m->cursor)
                 r = sd_journal_seek_cursor(m->journal, m->cursor);
+        else if (m->n_skip >= 0 && m->since > 0)
+                r = sd_journal_seek_realtime_usec(m->journal, m->since);
         else if (m->n_skip >= 0)
                 r = sd_journal_seek_head(m->journal);
-        else if (m->n_skip < 0)
+        else if (m->until != USEC_INFINITY)
+                r = sd_journal_seek_realtime_usec(m->journal, m->until + 1);
+        else
                 r = sd_journal_seek_tail(m->journal);
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
@@ -546,7 +805,7 @@ static ssize_t request_reader_fields(
 
         RequestMeta *m = cls;
         int r;
-        size_t n, k;
+        size_t n;
 
         assert(m);
         assert(buf);
@@ -556,7 +815,6 @@ static ssize_t request_reader_fields(
         pos -= m->delta;
 
         while (pos >= m->size) {
-                off_t sz;
                 const void *d;
                 size_t l;
 
@@ -582,7 +840,7 @@ static ssize_t request_reader_fields(
 
                 r = request_meta_ensure_tmp(m);
                 if (r < 0) {
-                        log_error_errno(r, "Failed to create temporary file: %m");
+                        log_error_errno(r, "Failed to allocate serialization buffer: %m");
                         return MHD_CONTENT_READER_END_WITH_ERROR;
                 }
 
@@ -592,32 +850,20 @@ static ssize_t request_reader_fields(
                         return MHD_CONTENT_READER_END_WITH_ERROR;
                 }
 
-                sz = ftello(m->tmp);
-                if (sz == (off_t) -1) {
-                        log_error_errno(errno, "Failed to retrieve file position: %m");
+                r = request_meta_flush_tmp(m);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to serialize item: %m");
                         return MHD_CONTENT_READER_END_WITH_ERROR;
                 }
-
-                m->size = (uint64_t) sz;
-        }
-
-        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
-                log_error_errno(errno, "Failed to seek to position: %m");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
         }
 
         n = m->size - pos;
         if (n > max)
                 n = max;
 
-        errno = 0;
-        k = fread(buf, 1, n, m->tmp);
-        if (k != n) {
-                log_error("Failed to read from file: %s", errno ? strerror(errno) : "Premature EOF");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
-        }
+        memcpy(buf, m->buffer + pos, n);
 
-        return (ssize_t) k;
+        return (ssize_t) n;
 }
 
 static int request_handler_fields(
@@ -30,6 +30,7 @@ void source_free(RemoteSource *source) {
                 return;
 
         journal_importer_cleanup(&source->importer);
+        free(source->encoded);
 
         log_debug("Writer ref count %i", source->writer->n_ref);
         writer_unref(source->writer);
@@ -72,7 +73,11 @@ int process_source(RemoteSource *source, bool compress, bool seal) {
         assert(source);
         assert(source->writer);
 
-        r = journal_importer_process_data(&source->importer);
+        /* Parse everything up to the end of the entry in one go, there
+         * is no point in going back to the event loop for every field. */
+        do
+                r = journal_importer_process_data(&source->importer);
+        while (r == 0 && !journal_importer_eof(&source->importer));
         if (r <= 0)
                 return r;
 
@@ -30,6 +30,11 @@ typedef struct RemoteSource {
 
         Writer *writer;
 
+        /* For compressed HTTP uploads, the body is collected here first */
+        int compression;
+        void *encoded;
+        size_t encoded_size, encoded_allocated;
+
         sd_event_source *event;
         sd_event_source *buffer_event;
 } RemoteSource;
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,6 +33,7 @@
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
+#include "compress.h"
 #include "conf-parser.h"
 #include "def.h"
 #include "escape.h"
@@ -43,7 +45,10 @@
 #include "journald-native.h"
 #include "macro.h"
 #include "parse-util.h"
+#include "process-util.h"
+#include "random-util.h"
 #include "signal-util.h"
+#include "siphash24.h"
 #include "socket-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
@@ -69,6 +74,7 @@ static int http_socket = -1, https_socket = -1;
 static char** arg_gnutls_log = NULL;
 
 static JournalWriteSplitMode arg_split_mode = _JOURNAL_WRITE_SPLIT_INVALID;
+static unsigned arg_workers = 1;
 static char* arg_output = NULL;
 
 static char *arg_key = NULL;
@@ -308,6 +314,12 @@ static int dispatch_http_event(sd_event_source *event,
                                int fd,
                                uint32_t revents,
                                void *userdata);
+static int add_listener(RemoteServer *s, int fd, RemoteConnectionType type);
+static int dispatch_connection(RemoteServer *s, int fd,
+                               RemoteConnectionType type, const char *hostname);
+static int dispatch_worker_exit(sd_event_source *event,
+                                const siginfo_t *si,
+                                void *userdata);
 
 static int get_source_for_fd(RemoteServer *s,
                              int fd, char *name, RemoteSource **source) {
@@ -426,6 +438,11 @@ static int add_raw_socket(RemoteServer *s, int fd) {
 
         assert(fd >= 0);
 
+        if (s->n_workers > 0) {
+                fd_ = -1;
+                return add_listener(s, fd, REMOTE_CONNECTION_RAW);
+        }
+
         r = sd_event_add_io(s->events, &s->listen_event,
                             fd, EPOLLIN,
                             dispatch_raw_connection_event, s);
@@ -517,15 +534,59 @@ static int process_http_upload(
         if (*upload_data_size) {
                 log_trace("Received %zu bytes", *upload_data_size);
 
-                r = journal_importer_push_data(&source->importer,
-                                               upload_data, *upload_data_size);
-                if (r < 0)
-                        return mhd_respond_oom(connection);
+                if (source->compression > 0) {
+                        /* The body can only be decompressed once we have all of it */
+                        if (source->encoded_size + *upload_data_size > ENTRY_SIZE_MAX)
+                                return mhd_respondf(connection,
+                                                    0, MHD_HTTP_PAYLOAD_TOO_LARGE,
+                                                    "Compressed upload is too large, maximum is %u bytes.",
+                                                    ENTRY_SIZE_MAX);
+
+                        if (!GREEDY_REALLOC(source->encoded, source->encoded_allocated,
+                                            source->encoded_size + *upload_data_size))
+                                return mhd_respond_oom(connection);
+
+                        memcpy((uint8_t*) source->encoded + source->encoded_size,
+                               upload_data, *upload_data_size);
+                        source->encoded_size += *upload_data_size;
+                } else {
+                        r = journal_importer_push_data(&source->importer,
+                                                       upload_data, *upload_data_size);
+                        if (r < 0)
+                                return mhd_respond_oom(connection);
+                }
 
                 *upload_data_size = 0;
-        } else
+        } else {
                 finished = true;
 
+                if (source->compression > 0 && source->encoded_size > 0) {
+                        _cleanup_free_ void *data = NULL;
+                        size_t allocated = 0, size;
+
+                        r = decompress_blob(source->compression,
+                                            source->encoded, source->encoded_size,
+                                            &data, &allocated, &size, ENTRY_SIZE_MAX);
+                        if (r < 0) {
+                                log_warning_errno(r, "Failed to decompress upload of %zu bytes: %m",
+                                                  source->encoded_size);
+                                return mhd_respondf(connection,
+                                                    r, MHD_HTTP_UNPROCESSABLE_ENTITY,
+                                                    "Decompression failed: %m.");
+                        }
+
+                        log_debug("Decompressed upload from %zu to %zu bytes",
+                                  source->encoded_size, size);
+
+                        source->encoded = mfree(source->encoded);
+                        source->encoded_size = source->encoded_allocated = 0;
+
+                        r = journal_importer_push_data(&source->importer, data, size);
+                        if (r < 0)
+                                return mhd_respond_oom(connection);
+                }
+        }
+
         for (;;) {
                 r = process_source(source, arg_compress, arg_seal);
                 if (r == -EAGAIN)
@@ -571,7 +632,7 @@ static int request_handler(
                 void **connection_cls) {
 
         const char *header;
-        int r, code, fd;
+        int r, code, fd, compression = 0;
         _cleanup_free_ char *hostname = NULL;
 
         assert(connection);
@@ -598,6 +659,17 @@ static int request_handler(
                 return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
                                    "Content-Type: application/vnd.fdo.journal is required.");
 
+        header = MHD_lookup_connection_value(connection,
+                                             MHD_HEADER_KIND, "Content-Encoding");
+        if (header && !streq(header, "identity")) {
+                /* Content codings are case-insensitive, our names are upper case */
+                compression = object_compressed_from_string(ascii_strupper(strdupa(header)));
+                if (compression <= 0)
+                        return mhd_respondf(connection,
+                                            0, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
+                                            "Content-Encoding: %s is not supported.", header);
+        }
+
         {
                 const union MHD_ConnectionInfo *ci;
 
@@ -633,6 +705,7 @@ static int request_handler(
                 return mhd_respondf(connection, r, MHD_HTTP_INTERNAL_SERVER_ERROR, "%m");
 
         hostname = NULL;
+        ((RemoteSource*) *connection_cls)->compression = compression;
         return MHD_YES;
 }
 
@@ -640,18 +713,19 @@ static int setup_microhttpd_server(RemoteServer *s,
                                    int fd,
                                    const char *key,
                                    const char *cert,
-                                   const char *trust) {
+                                   const char *trust,
+                                   MHDDaemonWrapper **ret) {
         struct MHD_OptionItem opts[] = {
                 { MHD_OPTION_NOTIFY_COMPLETED, (intptr_t) request_meta_free},
                 { MHD_OPTION_EXTERNAL_LOGGER, (intptr_t) microhttpd_logger},
-                { MHD_OPTION_LISTEN_SOCKET, fd},
                 { MHD_OPTION_CONNECTION_MEMORY_LIMIT, 128*1024},
                 { MHD_OPTION_END},
                 { MHD_OPTION_END},
                 { MHD_OPTION_END},
                 { MHD_OPTION_END},
+                { MHD_OPTION_END},
                 { MHD_OPTION_END}};
-        int opts_pos = 4;
+        int opts_pos = 3;
         int flags =
                 MHD_USE_DEBUG |
                 MHD_USE_DUAL_STACK |
@@ -662,11 +736,21 @@ static int setup_microhttpd_server(RemoteServer *s,
         int r, epoll_fd;
         MHDDaemonWrapper *d;
 
-        assert(fd >= 0);
+        if (s->n_workers > 0) {
+                assert(fd >= 0);
+                return add_listener(s, fd, key ? REMOTE_CONNECTION_HTTPS : REMOTE_CONNECTION_HTTP);
+        }
 
-        r = fd_nonblock(fd, true);
-        if (r < 0)
-                return log_error_errno(r, "Failed to make fd:%d nonblocking: %m", fd);
+        /* Without a socket, connections are handed to the daemon with MHD_add_connection() */
+        if (fd >= 0) {
+                r = fd_nonblock(fd, true);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to make fd:%d nonblocking: %m", fd);
+
+                opts[opts_pos++] = (struct MHD_OptionItem)
+                        {MHD_OPTION_LISTEN_SOCKET, fd};
+        } else
+                flags |= MHD_USE_NO_LISTEN_SOCKET;
 
 /* MHD_OPTION_STRICT_FOR_CLIENT is introduced in microhttpd 0.9.54,
  * and MHD_USE_PEDANTIC_CHECKS will be deprecated in future.
@@ -701,8 +785,6 @@ static int setup_microhttpd_server(RemoteServer *s,
         if (!d)
                 return log_oom();
 
-        d->fd = (uint64_t) fd;
-
         d->daemon = MHD_start_daemon(flags, 0,
                                      NULL, NULL,
                                      request_handler, NULL,
@@ -732,6 +814,9 @@ static int setup_microhttpd_server(RemoteServer *s,
                 goto error;
         }
 
+        /* The epoll fd is just as unique as the listening socket */
+        d->fd = (uint64_t) (fd >= 0 ? fd : epoll_fd);
+
         r = sd_event_add_io(s->events, &d->io_event,
                             epoll_fd, EPOLLIN,
                             dispatch_http_event, d);
@@ -773,6 +858,8 @@ static int setup_microhttpd_server(RemoteServer *s,
         }
 
         s->active++;
+        if (ret)
+                *ret = d;
         return 0;
 
 error:
@@ -793,7 +880,7 @@ static int setup_microhttpd_socket(RemoteServer *s,
         if (fd < 0)
                 return fd;
 
-        return setup_microhttpd_server(s, fd, key, cert, trust);
+        return setup_microhttpd_server(s, fd, key, cert, trust, NULL);
 }
 
 static int null_timer_event_handler(sd_event_source *timer_event,
@@ -843,7 +930,8 @@ static int setup_signals(RemoteServer *s) {
 
         assert(s);
 
-        assert_se(sigprocmask_many(SIG_SETMASK, NULL, SIGINT, SIGTERM, -1) >= 0);
+        /* SIGCHLD is blocked already if we have workers, let's keep it that way */
+        assert_se(sigprocmask_many(SIG_SETMASK, NULL, SIGINT, SIGTERM, SIGCHLD, -1) >= 0);
 
         r = sd_event_add_signal(s->events, &s->sigterm_event, SIGTERM, NULL, s);
         if (r < 0)
@@ -877,6 +965,7 @@ static int remoteserver_init(RemoteServer *s,
                              const char* trust) {
         int r, n, fd;
         char **file;
+        unsigned i;
 
         assert(s);
 
@@ -914,9 +1003,9 @@ static int remoteserver_init(RemoteServer *s,
                         log_debug("Received a listening socket (fd:%d)", fd);
 
                         if (fd == http_socket)
-                                r = setup_microhttpd_server(s, fd, NULL, NULL, NULL);
+                                r = setup_microhttpd_server(s, fd, NULL, NULL, NULL, NULL);
                         else if (fd == https_socket)
-                                r = setup_microhttpd_server(s, fd, key, cert, trust);
+                                r = setup_microhttpd_server(s, fd, key, cert, trust, NULL);
                         else
                                 r = add_raw_socket(s, fd);
                 } else if (sd_is_socket(fd, AF_UNSPEC, 0, false)) {
@@ -928,7 +1017,12 @@ static int remoteserver_init(RemoteServer *s,
 
                         log_debug("Received a connection socket (fd:%d) from %s", fd, hostname);
 
-                        r = add_source(s, fd, hostname, true);
+                        if (s->n_workers > 0) {
+                                r = dispatch_connection(s, fd, REMOTE_CONNECTION_RAW, hostname);
+                                safe_close(fd);
+                                free(hostname);
+                        } else
+                                r = add_source(s, fd, hostname, true);
                 } else {
                         log_error("Unknown socket passed on fd:%d", fd);
 
@@ -1026,6 +1120,15 @@ static int remoteserver_init(RemoteServer *s,
                         return r;
         }
 
+        for (i = 0; i < s->n_workers; i++) {
+                r = sd_event_add_child(s->events, &s->workers[i].child_event,
+                                       s->workers[i].pid, WEXITED,
+                                       dispatch_worker_exit, s->workers + i);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to watch worker "PID_FMT": %m",
+                                               s->workers[i].pid);
+        }
+
         if (s->active == 0) {
                 log_error("Zero sources specified");
                 return -EINVAL;
@@ -1050,10 +1153,29 @@ static void MHDDaemonWrapper_free(MHDDaemonWrapper *d) {
         free(d);
 }
 
+static void RemoteListener_free(RemoteListener *l) {
+        sd_event_source_unref(l->event);
+        free(l);
+}
+
 static void server_destroy(RemoteServer *s) {
         size_t i;
 
         hashmap_free_with_destructor(s->daemons, MHDDaemonWrapper_free);
+        hashmap_free_with_destructor(s->listeners, RemoteListener_free);
+
+        /* Closing the connection makes the worker finish up, wait for that
+         * so that all output files are closed properly when we return. */
+        for (i = 0; i < s->n_workers; i++)
+                safe_close(s->workers[i].fd);
+        for (i = 0; i < s->n_workers; i++) {
+                sd_event_source_unref(s->workers[i].child_event);
+                if (s->workers[i].pid > 0)
+                        (void) wait_for_terminate(s->workers[i].pid, NULL);
+        }
+        free(s->workers);
+
+        sd_event_source_unref(s->dispatch_event);
 
         assert(s->sources_size == 0 || s->sources);
         for (i = 0; i < s->sources_size; i++)
@@ -1227,6 +1349,434 @@ static int dispatch_raw_connection_event(sd_event_source *event,
         return add_source(s, fd2, hostname, true);
 }
 
+/**********************************************************************
+ **********************************************************************
+ **********************************************************************/
+
+static const char* const remote_connection_type_table[_REMOTE_CONNECTION_TYPE_MAX] = {
+        [REMOTE_CONNECTION_RAW] = "raw",
+        [REMOTE_CONNECTION_HTTP] = "http",
+        [REMOTE_CONNECTION_HTTPS] = "https",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(remote_connection_type, RemoteConnectionType);
+
+static int dispatch_connection(RemoteServer *s, int fd,
+                               RemoteConnectionType type, const char *hostname) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int))];
+        } control = {};
+        uint8_t t = type;
+        struct iovec iovec[2] = {
+                { .iov_base = &t, .iov_len = sizeof(t) },
+                { .iov_base = (char*) hostname, .iov_len = strlen(hostname) },
+        };
+        struct msghdr mh = {
+                .msg_iov = iovec,
+                .msg_iovlen = ELEMENTSOF(iovec),
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        struct cmsghdr *cmsg;
+        RemoteWorker *w;
+
+        assert(s);
+        assert(s->n_workers > 0);
+        assert(fd >= 0);
+        assert(hostname);
+
+        /* The worker is picked by the name the output file will be
+         * named after, so that every output file is only ever written
+         * by a single process. */
+        w = s->workers + siphash24(hostname, strlen(hostname), s->worker_hash_key) % s->n_workers;
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+        if (sendmsg(w->fd, &mh, MSG_NOSIGNAL) < 0)
+                return log_error_errno(errno, "Failed to pass %s connection from %s to worker "PID_FMT": %m",
+                                       remote_connection_type_to_string(type), hostname, w->pid);
+
+        log_debug("Passed %s connection from %s to worker "PID_FMT,
+                  remote_connection_type_to_string(type), hostname, w->pid);
+        return 0;
+}
+
+static int dispatch_listener_event(sd_event_source *event,
+                                   int fd,
+                                   uint32_t revents,
+                                   void *userdata) {
+        RemoteListener *l = userdata;
+        _cleanup_close_ int fd2 = -1;
+        _cleanup_free_ char *hostname = NULL;
+        int r;
+
+        assert(l);
+
+        /* Failures only affect this one connection, hence we never
+         * return an error here, which would disable the listener. */
+
+        if (l->type == REMOTE_CONNECTION_RAW) {
+                SocketAddress addr = {
+                        .size = sizeof(union sockaddr_union),
+                        .type = SOCK_STREAM,
+                };
+
+                fd2 = accept_connection("raw", fd, &addr, &hostname);
+                if (fd2 < 0)
+                        return 0;
+        } else {
+                fd2 = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
+                if (fd2 < 0) {
+                        if (errno != EAGAIN)
+                                log_error_errno(errno, "accept() on fd:%d failed: %m", fd);
+                        return 0;
+                }
+
+                /* This is what request_handler() will name the writer after */
+                r = getpeername_pretty(fd2, false, &hostname);
+                if (r < 0) {
+                        log_warning_errno(r, "Failed to retrieve remote name: %m");
+                        return 0;
+                }
+        }
+
+        (void) dispatch_connection(l->server, fd2, l->type, hostname);
+        return 0;
+}
+
+static int add_listener(RemoteServer *s, int fd, RemoteConnectionType type) {
+        RemoteListener *l;
+        int r;
+
+        assert(s);
+        assert(fd >= 0);
+
+        r = fd_nonblock(fd, true);
+        if (r < 0)
+                return log_error_errno(r, "Failed to make fd:%d nonblocking: %m", fd);
+
+        l = new0(RemoteListener, 1);
+        if (!l)
+                return log_oom();
+
+        l->fd = (uint64_t) fd;
+        l->type = type;
+        l->server = s;
+
+        r = sd_event_add_io(s->events, &l->event,
+                            fd, EPOLLIN,
+                            dispatch_listener_event, l);
+        if (r < 0) {
+                log_error_errno(r, "Failed to add event callback: %m");
+                goto error;
+        }
+
+        r = sd_event_source_set_description(l->event, remote_connection_type_to_string(type));
+        if (r < 0) {
+                log_error_errno(r, "Failed to set source name: %m");
+                goto error;
+        }
+
+        r = hashmap_ensure_allocated(&s->listeners, &uint64_hash_ops);
+        if (r < 0) {
+                log_oom();
+                goto error;
+        }
+
+        r = hashmap_put(s->listeners, &l->fd, l);
+        if (r < 0) {
+                log_error_errno(r, "Failed to add listener to hashmap: %m");
+                goto error;
+        }
+
+        log_debug("Dispatching %s connections on fd:%d to workers",
+                  remote_connection_type_to_string(type), fd);
+
+        s->active++;
+        return 0;
+
+error:
+        RemoteListener_free(l);
+        return r;
+}
+
+static int dispatch_worker_exit(sd_event_source *event,
+                                const siginfo_t *si,
+                                void *userdata) {
+        RemoteWorker *w = userdata;
+
+        assert(w);
+        assert(si);
+
+        log_error("Worker "PID_FMT" terminated unexpectedly (%s %i), exiting.",
+                  w->pid,
+                  si->si_code == CLD_EXITED ? "status" : "signal",
+                  si->si_status);
+
+        w->pid = 0;
+        w->server->worker_failed = true;
+
+        return sd_event_exit(w->server->events, 0);
+}
+
+static int dispatch_worker_event(sd_event_source *event,
+                                 int fd,
+                                 uint32_t revents,
+                                 void *userdata) {
+        RemoteServer *s = userdata;
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int))];
+        } control = {};
+        char buf[1 + NI_MAXHOST + 1];
+        struct iovec iovec = {
+                .iov_base = buf,
+                .iov_len = sizeof(buf) - 1,
+        };
+        struct msghdr mh = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        struct cmsghdr *cmsg;
+        _cleanup_close_ int fd2 = -1;
+        RemoteConnectionType type;
+        const char *hostname;
+        ssize_t n;
+        int r;
+
+        assert(s);
+
+        n = recvmsg(fd, &mh, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+                if (errno == EAGAIN)
+                        return 0;
+
+                return log_error_errno(errno, "Failed to receive connection from dispatcher: %m");
+        }
+        if (n == 0) {
+                log_debug("Dispatcher closed the connection, finishing.");
+                return sd_event_exit(s->events, 0);
+        }
+
+        CMSG_FOREACH(cmsg, &mh)
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_RIGHTS &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+                        assert(fd2 < 0);
+                        fd2 = *(int*) CMSG_DATA(cmsg);
+                }
+
+        if (fd2 < 0 || n < 2 || (mh.msg_flags & (MSG_TRUNC|MSG_CTRUNC)) ||
+            (uint8_t) buf[0] >= _REMOTE_CONNECTION_TYPE_MAX) {
+                log_warning("Received malformed message from dispatcher, ignoring.");
+                return 0;
+        }
+
+        type = (uint8_t) buf[0];
+        buf[n] = 0;
+        hostname = buf + 1;
+
+        if (type == REMOTE_CONNECTION_RAW) {
+                char *name;
+
+                name = strdup(hostname);
+                if (!name)
+                        return log_oom();
+
+                r = add_source(s, fd2, name, true);
+                fd2 = -1;
+                if (r < 0)
+                        log_warning_errno(r, "Failed to add source for %s, ignoring: %m", hostname);
+        } else {
+                MHDDaemonWrapper *d = s->worker_daemons[type];
+                union sockaddr_union sa;
+                socklen_t salen = sizeof(sa);
+
+                if (!d) {
+                        log_warning("Received unexpected %s connection, ignoring.",
+                                    remote_connection_type_to_string(type));
+                        return 0;
+                }
+
+                if (getpeername(fd2, &sa.sa, &salen) < 0) {
+                        log_warning_errno(errno, "Failed to get address of %s, ignoring: %m", hostname);
+                        return 0;
+                }
+
+                /* µhttpd takes the socket over, even if it fails */
+                r = MHD_add_connection(d->daemon, fd2, &sa.sa, salen);
+                fd2 = -1;
+                if (r != MHD_YES) {
+                        log_warning("µhttpd refused connection from %s, ignoring.", hostname);
+                        return 0;
+                }
+
+                /* Get going with the new connection, and update the timeout */
+                (void) dispatch_http_event(event, 0, 0, d);
+        }
+
+        return 0;
+}
+
+static int worker_init(RemoteServer *s,
+                       int fd,
+                       const char *key,
+                       const char *cert,
+                       const char *trust) {
+        int r;
+
+        assert(s);
+        assert(fd >= 0);
+
+        r = sd_event_default(&s->events);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        setup_signals(s);
+
+        assert(server == NULL);
+        server = s;
+
+        r = init_writer_hashmap(s);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_io(s->events, &s->dispatch_event,
+                            fd, EPOLLIN,
+                            dispatch_worker_event, s);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add event callback: %m");
+
+        r = sd_event_source_set_description(s->dispatch_event, "dispatch");
+        if (r < 0)
+                return log_error_errno(r, "Failed to set source name: %m");
+
+        s->active++;
+
+        if (arg_listen_http || http_socket >= 0) {
+                r = setup_microhttpd_server(s, -1, NULL, NULL, NULL,
+                                            &s->worker_daemons[REMOTE_CONNECTION_HTTP]);
+                if (r < 0)
+                        return r;
+        }
+
+        if (arg_listen_https || https_socket >= 0) {
+                r = setup_microhttpd_server(s, -1, key, cert, trust,
+                                            &s->worker_daemons[REMOTE_CONNECTION_HTTPS]);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int server_run(RemoteServer *s);
+
+static int run_worker(unsigned index,
+                      int fd,
+                      const char *key,
+                      const char *cert,
+                      const char *trust) {
+        RemoteServer s = {};
+        int r;
+
+        r = worker_init(&s, fd, key, cert, trust);
+        if (r >= 0) {
+                log_debug("Worker %u running as pid "PID_FMT, index, getpid_cached());
+
+                r = server_run(&s);
+
+                log_info("Worker %u finishing after writing %" PRIu64 " entries", index, s.event_count);
+        }
+
+        server_destroy(&s);
+        safe_close(fd);
+
+        return r;
+}
+
+static int start_workers(RemoteServer *s,
+                         const char *key,
+                         const char *cert,
+                         const char *trust) {
+        pid_t parent_pid;
+        unsigned i;
+        int r;
+
+        assert(s);
+        assert(arg_workers > 1);
+
+        s->workers = new0(RemoteWorker, arg_workers);
+        if (!s->workers)
+                return log_oom();
+
+        random_bytes(s->worker_hash_key, sizeof(s->worker_hash_key));
+
+        /* Make sure we notice workers that die before the event loop is up */
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGCHLD, -1) >= 0);
+
+        parent_pid = getpid_cached();
+
+        for (i = 0; i < arg_workers; i++) {
+                RemoteWorker *w = s->workers + i;
+                int pair[2];
+                pid_t pid;
+
+                if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) < 0)
+                        return log_error_errno(errno, "Failed to create socket pair: %m");
+
+                pid = fork();
+                if (pid < 0) {
+                        r = log_error_errno(errno, "Failed to fork: %m");
+                        safe_close_pair(pair);
+                        return r;
+                }
+
+                /* In the child */
+                if (pid == 0) {
+                        (void) reset_all_signal_handlers();
+                        (void) reset_signal_mask();
+
+                        /* Make sure the worker goes away when the dispatcher dies */
+                        if (prctl(PR_SET_PDEATHSIG, SIGTERM) < 0)
+                                _exit(EXIT_FAILURE);
+
+                        if (getppid() != parent_pid)
+                                _exit(EXIT_SUCCESS);
+
+                        /* Drop the listening sockets and the other workers' connections */
+                        log_close();
+                        r = close_all_fds(pair + 1, 1);
+                        log_open();
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to close remaining fds: %m");
+                                _exit(EXIT_FAILURE);
+                        }
+
+                        r = run_worker(i, pair[1], key, cert, trust);
+                        _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+                }
+
+                safe_close(pair[1]);
+
+                w->pid = pid;
+                w->fd = pair[0];
+                w->server = s;
+                s->n_workers++;
+
+                log_debug("Started worker %u as pid "PID_FMT, i, pid);
+        }
+
+        return 0;
+}
+
 /**********************************************************************
  **********************************************************************
  **********************************************************************/
@@ -1246,6 +1796,7 @@ static int parse_config(void) {
         const ConfigTableItem items[] = {
                 { "Remote",  "Seal",                   config_parse_bool,             0, &arg_seal       },
                 { "Remote",  "SplitMode",              config_parse_write_split_mode, 0, &arg_split_mode },
+                { "Remote",  "Workers",                config_parse_unsigned,         0, &arg_workers    },
                 { "Remote",  "ServerKeyFile",          config_parse_path,             0, &arg_key        },
                 { "Remote",  "ServerCertificateFile",  config_parse_path,             0, &arg_cert       },
                 { "Remote",  "TrustedCertificateFile", config_parse_path,             0, &arg_trust      },
@@ -1279,6 +1830,7 @@ static void help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --workers=N            Write output files from N worker processes\n"
                "\n"
                "Note: file descriptors from sd_listen_fds() will be consumed, too.\n"
                , program_invocation_short_name);
@@ -1299,6 +1851,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CERT,
                 ARG_TRUST,
                 ARG_GNUTLS_LOG,
+                ARG_WORKERS,
         };
 
         static const struct option options[] = {
@@ -1317,6 +1870,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "cert",         required_argument, NULL, ARG_CERT         },
                 { "trust",        required_argument, NULL, ARG_TRUST        },
                 { "gnutls-log",   required_argument, NULL, ARG_GNUTLS_LOG   },
+                { "workers",      required_argument, NULL, ARG_WORKERS      },
                 {}
         };
 
@@ -1504,6 +2058,14 @@ static int parse_argv(int argc, char *argv[]) {
 #endif
                 }
 
+                case ARG_WORKERS:
+                        r = safe_atou(optarg, &arg_workers);
+                        if (r < 0 || arg_workers == 0) {
+                                log_error("Failed to parse --workers= argument: %s", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -1558,8 +2120,21 @@ static int parse_argv(int argc, char *argv[]) {
                 return -EINVAL;
         }
 
-        log_debug("Full config: SplitMode=%s Key=%s Cert=%s Trust=%s",
+        if (arg_workers > 1) {
+                if (arg_split_mode != JOURNAL_WRITE_SPLIT_HOST) {
+                        log_error("Worker processes require SplitMode=host.");
+                        return -EINVAL;
+                }
+
+                if (arg_url) {
+                        log_error("Option --url cannot be used with worker processes.");
+                        return -EINVAL;
+                }
+        }
+
+        log_debug("Full config: SplitMode=%s Workers=%u Key=%s Cert=%s Trust=%s",
                   journal_write_split_mode_to_string(arg_split_mode),
+                  arg_workers,
                   strna(arg_key),
                   strna(arg_cert),
                   strna(arg_trust));
@@ -1592,6 +2167,28 @@ static int load_certificates(char **key, char **cert, char **trust) {
         return 0;
 }
 
+static int server_run(RemoteServer *s) {
+        int r = 0;
+
+        assert(s);
+
+        while (s->active) {
+                r = sd_event_get_state(s->events);
+                if (r < 0)
+                        break;
+                if (r == SD_EVENT_FINISHED)
+                        break;
+
+                r = sd_event_run(s->events, -1);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to run event loop: %m");
+                        break;
+                }
+        }
+
+        return r;
+}
+
 int main(int argc, char **argv) {
         RemoteServer s = {};
         int r;
@@ -1619,6 +2216,10 @@ int main(int argc, char **argv) {
                 if (load_certificates(&key, &cert, &trust) < 0)
                         return EXIT_FAILURE;
 
+        if (arg_workers > 1)
+                if (start_workers(&s, key, cert, trust) < 0)
+                        return EXIT_FAILURE;
+
         if (remoteserver_init(&s, key, cert, trust) < 0)
                 return EXIT_FAILURE;
 
@@ -1634,19 +2235,9 @@ int main(int argc, char **argv) {
                   "READY=1\n"
                   "STATUS=Processing requests...");
 
-        while (s.active) {
-                r = sd_event_get_state(s.events);
-                if (r < 0)
-                        break;
-                if (r == SD_EVENT_FINISHED)
-                        break;
-
-                r = sd_event_run(s.events, -1);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to run event loop: %m");
-                        break;
-                }
-        }
+        r = server_run(&s);
+        if (s.worker_failed)
+                r = -ECHILD;
 
         sd_notifyf(false,
                    "STOPPING=1\n"
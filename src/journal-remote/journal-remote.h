@@ -37,6 +37,30 @@ struct MHDDaemonWrapper {
         sd_event_source *timer_event;
 };
 
+typedef enum RemoteConnectionType {
+        REMOTE_CONNECTION_RAW,
+        REMOTE_CONNECTION_HTTP,
+        REMOTE_CONNECTION_HTTPS,
+        _REMOTE_CONNECTION_TYPE_MAX,
+        _REMOTE_CONNECTION_TYPE_INVALID = -1,
+} RemoteConnectionType;
+
+typedef struct RemoteListener {
+        uint64_t fd;
+        RemoteConnectionType type;
+        RemoteServer *server;
+
+        sd_event_source *event;
+} RemoteListener;
+
+typedef struct RemoteWorker {
+        pid_t pid;
+        int fd;
+        RemoteServer *server;
+
+        sd_event_source *child_event;
+} RemoteWorker;
+
 struct RemoteServer {
         RemoteSource **sources;
         size_t sources_size;
@@ -51,4 +75,15 @@ struct RemoteServer {
 
         bool check_trust;
         Hashmap *daemons;
+
+        /* In the dispatcher: connections are accepted here and handed to the workers */
+        Hashmap *listeners;
+        RemoteWorker *workers;
+        unsigned n_workers;
+        uint8_t worker_hash_key[16];
+        bool worker_failed;
+
+        /* In a worker: connections arrive from the dispatcher */
+        sd_event_source *dispatch_event;
+        MHDDaemonWrapper *worker_daemons[_REMOTE_CONNECTION_TYPE_MAX];
 };
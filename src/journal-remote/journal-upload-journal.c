@@ -22,6 +22,7 @@
 #include <stdbool.h>
 
 #include "alloc-util.h"
+#include "compress.h"
 #include "journal-upload.h"
 #include "log.h"
 #include "utf8.h"
@@ -260,6 +261,19 @@ static inline void check_update_watchdog(Uploader *u) {
         }
 }
 
+static bool check_batch_full(Uploader *u) {
+        assert(u);
+
+        if (u->batch_entries_max <= 0 ||
+            u->entries_sent - u->batch_start < u->batch_entries_max)
+                return false;
+
+        log_debug("Sent %zu entries, ending this upload.", u->batch_entries_max);
+
+        u->batch_full = true;
+        return true;
+}
+
 static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
         Uploader *u = userp;
         int r;
@@ -276,6 +290,11 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
 
         while (j && filled < size * nmemb) {
                 if (u->entry_state == ENTRY_DONE) {
+                        if (check_batch_full(u)) {
+                                u->uploading = false;
+                                break;
+                        }
+
                         r = sd_journal_next(j);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to move to next entry in journal: %m");
@@ -315,6 +334,100 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
         return filled;
 }
 
+static size_t batch_input_callback(void *buf, size_t size, size_t nmemb, void *userp) {
+        Uploader *u = userp;
+        size_t n;
+
+        assert(u);
+        assert(nmemb <= SSIZE_MAX / size);
+
+        check_update_watchdog(u);
+
+        n = MIN(size * nmemb, u->compressed_size - u->compressed_pos);
+        memcpy(buf, (uint8_t*) u->compressed + u->compressed_pos, n);
+        u->compressed_pos += n;
+
+        if (n == 0)
+                u->uploading = false;
+
+        return n;
+}
+
+static int fill_batch(Uploader *u) {
+        size_t n;
+        int r;
+
+        assert(u);
+        assert(u->compression > 0);
+        assert(u->entry_state == ENTRY_CURSOR);
+
+        /* Collects entries up to the batch limits in memory, and compresses them
+         * in one go. The result is then sent by batch_input_callback(). */
+
+        u->batch_filled = 0;
+
+        for (;;) {
+                ssize_t w;
+
+                if (!GREEDY_REALLOC(u->batch, u->batch_allocated, u->batch_filled + 64 * 1024))
+                        return log_oom();
+
+                w = write_entry(u->batch + u->batch_filled, u->batch_allocated - u->batch_filled, u);
+                if (w < 0)
+                        return w;
+                u->batch_filled += w;
+
+                if (u->entry_state != ENTRY_DONE)
+                        /* This means that all available space was used up */
+                        continue;
+
+                log_debug("Entry %zu (%s) has been added to the batch.",
+                          u->entries_sent, u->current_cursor);
+
+                if (check_batch_full(u))
+                        break;
+
+                if (u->batch_filled >= JOURNAL_UPLOAD_BATCH_SIZE_MAX) {
+                        log_debug("Batch has reached %zu bytes, ending this upload.", u->batch_filled);
+                        u->batch_full = true;
+                        break;
+                }
+
+                r = sd_journal_next(u->journal);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to move to next entry in journal: %m");
+                if (r == 0) {
+                        if (u->input_event)
+                                log_debug("No more entries, waiting for journal.");
+                        else {
+                                log_info("No more entries, closing journal.");
+                                close_journal_input(u);
+                        }
+
+                        break;
+                }
+
+                u->entry_state = ENTRY_CURSOR;
+        }
+
+        /* Make sure there is room even if the data turns out not to be compressible */
+        n = u->batch_filled + u->batch_filled / 16 + 4096;
+        if (!GREEDY_REALLOC(u->compressed, u->compressed_allocated, n))
+                return log_oom();
+
+        r = compress_blob_explicit(u->compression, u->batch, u->batch_filled,
+                                   u->compressed, u->compressed_allocated, &u->compressed_size);
+        if (r < 0)
+                return log_error_errno(r, "Failed to compress batch of %zu bytes: %m", u->batch_filled);
+
+        u->compressed_pos = 0;
+
+        log_debug("Compressed %zu entries from %zu to %zu bytes.",
+                  u->entries_sent - u->batch_start, u->batch_filled, u->compressed_size);
+
+        return 0;
+}
+
 void close_journal_input(Uploader *u) {
         assert(u);
 
@@ -341,11 +454,23 @@ static int process_journal_input(Uploader *u, int skip) {
 
         /* have data */
         u->entry_state = ENTRY_CURSOR;
+        u->batch_start = u->entries_sent;
+        u->batch_full = false;
+
+        if (u->compression > 0) {
+                r = fill_batch(u);
+                if (r < 0)
+                        return r;
+
+                return start_upload(u, batch_input_callback, u);
+        }
+
         return start_upload(u, journal_input_callback, u);
 }
 
 int check_journal_input(Uploader *u) {
-        if (u->input_event) {
+        /* If the last batch was full, there is more to send right away */
+        if (u->input_event && !u->batch_full) {
                 int r;
 
                 r = sd_journal_process(u->journal);
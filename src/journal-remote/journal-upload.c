@@ -27,6 +27,7 @@
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
+#include "compress.h"
 #include "conf-parser.h"
 #include "def.h"
 #include "fd-util.h"
@@ -60,6 +61,8 @@ static const char *arg_machine = NULL;
 static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
+static int arg_compression = 0;
+static unsigned arg_batch_size = 0;
 
 static void close_fd_input(Uploader *u);
 
@@ -211,6 +214,17 @@ int start_upload(Uploader *u,
                         return log_oom();
                 }
 
+                if (u->compression > 0) {
+                        const char *encoding;
+
+                        encoding = strjoina("Content-Encoding: ", object_compressed_to_string(u->compression));
+                        h = curl_slist_append(h, ascii_strlower((char*) encoding));
+                        if (!h) {
+                                curl_slist_free_all(h);
+                                return log_oom();
+                        }
+                }
+
                 u->header = h;
         }
 
@@ -455,6 +469,8 @@ static int setup_uploader(Uploader *u, const char *url, const char *state_file)
                 return log_oom();
 
         u->state_file = state_file;
+        u->compression = arg_compression;
+        u->batch_entries_max = arg_batch_size;
 
         r = sd_event_default(&u->events);
         if (r < 0)
@@ -479,6 +495,9 @@ static void destroy_uploader(Uploader *u) {
         free(u->last_cursor);
         free(u->current_cursor);
 
+        free(u->batch);
+        free(u->compressed);
+
         free(u->url);
 
         u->input_event = sd_event_source_unref(u->input_event);
@@ -533,12 +552,85 @@ static int perform_upload(Uploader *u) {
         return update_cursor_state(u);
 }
 
+static int upload_compression_from_string(const char *s) {
+        int i, r;
+
+        assert(s);
+
+        /* Returns one of OBJECT_COMPRESSED_*, or 0 for no compression */
+
+        r = parse_boolean(s);
+        if (r == 0)
+                return 0;
+        if (r > 0) {
+                /* Pick the best algorithm we have */
+#if HAVE_ZSTD
+                return OBJECT_COMPRESSED_ZSTD;
+#elif HAVE_LZ4
+                return OBJECT_COMPRESSED_LZ4;
+#elif HAVE_XZ
+                return OBJECT_COMPRESSED_XZ;
+#else
+                return -EPROTONOSUPPORT;
+#endif
+        }
+
+        for (i = OBJECT_COMPRESSED_XZ; i < _OBJECT_COMPRESSED_MAX; i <<= 1)
+                if (strcaseeq(s, object_compressed_to_string(i))) {
+#if !HAVE_XZ
+                        if (i == OBJECT_COMPRESSED_XZ)
+                                return -EPROTONOSUPPORT;
+#endif
+#if !HAVE_LZ4
+                        if (i == OBJECT_COMPRESSED_LZ4)
+                                return -EPROTONOSUPPORT;
+#endif
+#if !HAVE_ZSTD
+                        if (i == OBJECT_COMPRESSED_ZSTD)
+                                return -EPROTONOSUPPORT;
+#endif
+                        return i;
+                }
+
+        return -EINVAL;
+}
+
+static int config_parse_compression(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        int *compression = data, c;
+
+        assert(filename);
+        assert(rvalue);
+        assert(data);
+
+        c = upload_compression_from_string(rvalue);
+        if (c < 0) {
+                log_syntax(unit, LOG_ERR, filename, line, c, "Failed to parse compression setting, ignoring: %s", rvalue);
+                return 0;
+        }
+
+        *compression = c;
+        return 0;
+}
+
 static int parse_config(void) {
         const ConfigTableItem items[] = {
-                { "Upload",  "URL",                    config_parse_string, 0, &arg_url    },
-                { "Upload",  "ServerKeyFile",          config_parse_path,   0, &arg_key    },
-                { "Upload",  "ServerCertificateFile",  config_parse_path,   0, &arg_cert   },
-                { "Upload",  "TrustedCertificateFile", config_parse_path,   0, &arg_trust  },
+                { "Upload",  "URL",                    config_parse_string,      0, &arg_url         },
+                { "Upload",  "ServerKeyFile",          config_parse_path,        0, &arg_key         },
+                { "Upload",  "ServerCertificateFile",  config_parse_path,        0, &arg_cert        },
+                { "Upload",  "TrustedCertificateFile", config_parse_path,        0, &arg_trust       },
+                { "Upload",  "Compression",            config_parse_compression, 0, &arg_compression },
+                { "Upload",  "BatchSize",              config_parse_unsigned,    0, &arg_batch_size  },
                 {}};
 
         return config_parse_many_nulstr(PKGSYSCONFDIR "/journal-upload.conf",
@@ -571,6 +663,9 @@ static void help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --compression=ALGORITHM\n"
+               "                            Compress uploads with zstd, lz4 or xz (default: no)\n"
+               "     --batch-size=ENTRIES   Upload at most this many entries per request\n"
                , program_invocation_short_name);
 }
 
@@ -587,6 +682,8 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_AFTER_CURSOR,
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
+                ARG_COMPRESSION,
+                ARG_BATCH_SIZE,
         };
 
         static const struct option options[] = {
@@ -606,6 +703,8 @@ static int parse_argv(int argc, char *argv[]) {
                 { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
                 { "follow",       optional_argument, NULL, ARG_FOLLOW         },
                 { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "compression",  required_argument, NULL, ARG_COMPRESSION    },
+                { "batch-size",   required_argument, NULL, ARG_BATCH_SIZE     },
                 {}
         };
 
@@ -734,6 +833,29 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_COMPRESSION:
+                        r = upload_compression_from_string(optarg);
+                        if (r == -EPROTONOSUPPORT) {
+                                log_error("Compression %s is not supported by this build.", optarg);
+                                return r;
+                        }
+                        if (r < 0) {
+                                log_error("Failed to parse --compression= parameter: %s", optarg);
+                                return r;
+                        }
+
+                        arg_compression = r;
+                        break;
+
+                case ARG_BATCH_SIZE:
+                        r = safe_atou(optarg, &arg_batch_size);
+                        if (r < 0) {
+                                log_error("Failed to parse --batch-size= parameter: %s", optarg);
+                                return r;
+                        }
+
+                        break;
+
                 case '?':
                         log_error("Unknown option %s.", argv[optind-1]);
                         return -EINVAL;
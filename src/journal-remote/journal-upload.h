@@ -44,6 +44,18 @@ typedef struct Uploader {
         const void *field_data;
         size_t field_pos, field_length;
 
+        /* batching */
+        size_t batch_entries_max;  /* end the upload after this many entries, 0 for no limit */
+        size_t batch_start;        /* value of entries_sent when this upload started */
+        bool batch_full;           /* the last upload ended because of the limit */
+
+        /* compression: a batch is collected in batch, and sent from compressed */
+        int compression;
+        char *batch;
+        size_t batch_allocated, batch_filled;
+        void *compressed;
+        size_t compressed_allocated, compressed_size, compressed_pos;
+
         /* general metrics */
         const char *state_file;
 
@@ -55,6 +67,9 @@ typedef struct Uploader {
 
 #define JOURNAL_UPLOAD_POLL_TIMEOUT (10 * USEC_PER_SEC)
 
+/* Compressed batches are collected in memory, so they need a limit */
+#define JOURNAL_UPLOAD_BATCH_SIZE_MAX (16U*1024U*1024U)
+
 int start_upload(Uploader *u,
                  size_t (*input_callback)(void *ptr,
                                           size_t size,
@@ -34,6 +34,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hashmap.h"
+#include "io-util.h"
 #include "log.h"
 #include "mkdir.h"
 #include "path-util.h"
@@ -42,6 +43,7 @@
 #include "strbuf.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "util.h"
 
 const char * const catalog_file_dirs[] = {
@@ -59,8 +61,24 @@ typedef struct CatalogHeader {
         le64_t header_size;
         le64_t n_items;
         le64_t catalog_item_size;
+
+        /* Added later: fingerprint of the source files, see catalog_sources_hash() */
+        le64_t sources_hash;
 } CatalogHeader;
 
+#define CATALOG_HEADER_CONTAINS(h, field) \
+        (le64toh((h)->header_size) >= offsetof(CatalogHeader, field) + sizeof((h)->field))
+
+#define CATALOG_HEADER_SIZE_MIN offsetof(CatalogHeader, sources_hash)
+
+struct CatalogCache {
+        void *p;
+        size_t size;
+        dev_t dev;
+        ino_t ino;
+        usec_t mtime;
+};
+
 typedef struct CatalogItem {
         sd_id128_t id;
         char language[32];
@@ -392,7 +410,7 @@ int catalog_import_file(Hashmap *h, const char *path) {
 }
 
 static int64_t write_catalog(const char *database, struct strbuf *sb,
-                             CatalogItem *items, size_t n) {
+                             CatalogItem *items, size_t n, uint64_t sources_hash) {
         CatalogHeader header;
         _cleanup_fclose_ FILE *w = NULL;
         int r;
@@ -417,6 +435,7 @@ static int64_t write_catalog(const char *database, struct strbuf *sb,
         header.header_size = htole64(ALIGN_TO(sizeof(CatalogHeader), 8));
         header.catalog_item_size = htole64(sizeof(CatalogItem));
         header.n_items = htole64(n);
+        header.sources_hash = htole64(sources_hash);
 
         r = -EIO;
 
@@ -458,6 +477,65 @@ error:
         return r;
 }
 
+static int catalog_sources_hash(char **files, uint64_t *ret) {
+        static const uint8_t hash_key[16] = {
+                0x3b, 0x0c, 0x87, 0x5e, 0x1a, 0x49, 0x4e, 0x2d,
+                0x9f, 0x61, 0x77, 0xd2, 0x05, 0xb8, 0xc4, 0x13,
+        };
+        struct siphash state;
+        char **f;
+
+        assert(ret);
+
+        /* Summarizes which source files the database was built from,
+         * and in which version, so that rebuilding it can be skipped
+         * if nothing changed. Files are replaced by package managers,
+         * so the inode and modification time catch updates. */
+
+        siphash24_init(&state, hash_key);
+
+        STRV_FOREACH(f, files) {
+                struct stat st;
+                uint64_t v[4];
+
+                if (stat(*f, &st) < 0)
+                        return -errno;
+
+                siphash24_compress(*f, strlen(*f) + 1, &state);
+
+                v[0] = htole64((uint64_t) st.st_ino);
+                v[1] = htole64((uint64_t) st.st_dev);
+                v[2] = htole64((uint64_t) st.st_size);
+                v[3] = htole64(timespec_load_nsec(&st.st_mtim));
+                siphash24_compress(v, sizeof(v), &state);
+        }
+
+        *ret = siphash24_finalize(&state);
+        return 0;
+}
+
+static int catalog_is_current(const char *database, uint64_t sources_hash) {
+        _cleanup_close_ int fd = -1;
+        CatalogHeader h;
+        ssize_t k;
+
+        fd = open(database, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        k = loop_read(fd, &h, sizeof(h), false);
+        if (k < 0)
+                return (int) k;
+        if ((size_t) k < sizeof(h))
+                return 0;
+
+        if (memcmp(h.signature, CATALOG_SIGNATURE, sizeof(h.signature)) != 0 ||
+            !CATALOG_HEADER_CONTAINS(&h, sources_hash))
+                return 0;
+
+        return le64toh(h.sources_hash) == sources_hash;
+}
+
 int catalog_update(const char* database, const char* root, const char* const* dirs) {
         _cleanup_strv_free_ char **files = NULL;
         char **f;
@@ -471,6 +549,7 @@ int catalog_update(const char* database, const char* root, const char* const* di
         unsigned n;
         int r;
         int64_t sz;
+        uint64_t sources_hash;
 
         h = hashmap_new(&catalog_hash_ops);
         sb = strbuf_new();
@@ -486,6 +565,20 @@ int catalog_update(const char* database, const char* root, const char* const* di
                 goto finish;
         }
 
+        r = catalog_sources_hash(files, &sources_hash);
+        if (r < 0) {
+                log_error_errno(r, "Failed to check catalog files: %m");
+                goto finish;
+        }
+
+        r = catalog_is_current(database, sources_hash);
+        if (r < 0)
+                log_debug_errno(r, "Failed to read existing database %s, ignoring: %m", database);
+        else if (r > 0) {
+                log_debug("%s is up to date.", database);
+                goto finish;
+        }
+
         STRV_FOREACH(f, files) {
                 log_debug("Reading file '%s'", *f);
                 r = catalog_import_file(h, *f);
@@ -527,7 +620,7 @@ int catalog_update(const char* database, const char* root, const char* const* di
 
         strbuf_complete(sb);
 
-        sz = write_catalog(database, sb, items, n);
+        sz = write_catalog(database, sb, items, n, sources_hash);
         if (sz < 0)
                 r = log_error_errno(sz, "Failed to write %s: %m", database);
         else {
@@ -574,7 +667,7 @@ static int open_mmap(const char *database, int *_fd, struct stat *_st, void **_p
 
         h = p;
         if (memcmp(h->signature, CATALOG_SIGNATURE, sizeof(h->signature)) != 0 ||
-            le64toh(h->header_size) < sizeof(CatalogHeader) ||
+            le64toh(h->header_size) < CATALOG_HEADER_SIZE_MIN ||
             le64toh(h->catalog_item_size) < sizeof(CatalogItem) ||
             h->incompatible_flags != 0 ||
             le64toh(h->n_items) <= 0 ||
@@ -666,6 +759,72 @@ finish:
         return r;
 }
 
+CatalogCache *catalog_cache_free(CatalogCache *c) {
+        if (!c)
+                return NULL;
+
+        if (c->p)
+                munmap(c->p, c->size);
+
+        return mfree(c);
+}
+
+int catalog_get_cached(CatalogCache **cache, const char* database, sd_id128_t id, char **_text) {
+        CatalogCache *c;
+        struct stat st;
+        const char *s;
+        char *text;
+
+        assert(cache);
+        assert(_text);
+
+        /* Like catalog_get(), but keeps the database mapped between
+         * calls. It is remapped only when it was replaced. */
+
+        if (stat(database, &st) < 0)
+                return -errno;
+
+        c = *cache;
+        if (!c ||
+            c->dev != st.st_dev ||
+            c->ino != st.st_ino ||
+            c->size != (size_t) st.st_size ||
+            c->mtime != timespec_load(&st.st_mtim)) {
+                _cleanup_close_ int fd = -1;
+                int r;
+
+                *cache = c = catalog_cache_free(c);
+
+                c = new0(CatalogCache, 1);
+                if (!c)
+                        return -ENOMEM;
+
+                r = open_mmap(database, &fd, &st, &c->p);
+                if (r < 0) {
+                        free(c);
+                        return r;
+                }
+
+                c->size = st.st_size;
+                c->dev = st.st_dev;
+                c->ino = st.st_ino;
+                c->mtime = timespec_load(&st.st_mtim);
+
+                *cache = c;
+        }
+
+        s = find_id(c->p, id);
+        if (!s)
+                return -ENOENT;
+
+        text = strdup(s);
+        if (!text)
+                return -ENOMEM;
+
+        *_text = text;
+        return 0;
+}
+
 static char *find_header(const char *s, const char *header) {
 
         for (;;) {
@@ -30,6 +30,11 @@
 int catalog_import_file(Hashmap *h, const char *path);
 int catalog_update(const char* database, const char* root, const char* const* dirs);
 int catalog_get(const char* database, sd_id128_t id, char **data);
+
+typedef struct CatalogCache CatalogCache;
+int catalog_get_cached(CatalogCache **cache, const char* database, sd_id128_t id, char **data);
+CatalogCache *catalog_cache_free(CatalogCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CatalogCache*, catalog_cache_free);
 int catalog_list(FILE *f, const char* database, bool oneline);
 int catalog_list_items(FILE *f, const char* database, bool oneline, char **items);
 int catalog_file_lang(const char *filename, char **lang);
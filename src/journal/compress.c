@@ -33,6 +33,11 @@
 #include <lz4frame.h>
 #endif
 
+#if HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
 #include "alloc-util.h"
 #include "compress.h"
 #include "fd-util.h"
@@ -49,11 +54,29 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_compressionContext_t, LZ4F_freeCompressionConte
 DEFINE_TRIVIAL_CLEANUP_FUNC(LZ4F_decompressionContext_t, LZ4F_freeDecompressionContext);
 #endif
 
+#if HAVE_ZSTD
+DEFINE_TRIVIAL_CLEANUP_FUNC(ZSTD_DCtx*, ZSTD_freeDCtx);
+
+static int zstd_ret_to_errno(size_t ret) {
+        switch (ZSTD_getErrorCode(ret)) {
+        case ZSTD_error_dstSize_tooSmall:
+                return -ENOBUFS;
+        case ZSTD_error_memory_allocation:
+                return -ENOMEM;
+        default:
+                return -EBADMSG;
+        }
+}
+#endif
+
 #define ALIGN_8(l) ALIGN_TO(l, sizeof(size_t))
 
+#define XZ_THREADS_MAX 4U
+
 static const char* const object_compressed_table[_OBJECT_COMPRESSED_MAX] = {
         [OBJECT_COMPRESSED_XZ] = "XZ",
         [OBJECT_COMPRESSED_LZ4] = "LZ4",
+        [OBJECT_COMPRESSED_ZSTD] = "ZSTD",
 };
 
 DEFINE_STRING_TABLE_LOOKUP(object_compressed, int);
@@ -130,6 +153,43 @@ int compress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size) {
+#if HAVE_ZSTD
+        size_t k;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size > 0);
+        assert(dst_size);
+
+        /* Returns < 0 if we couldn't compress the data or the
+         * compressed result is longer than the original */
+
+        k = ZSTD_compress(dst, dst_alloc_size, src, src_size, 0);
+        if (ZSTD_isError(k))
+                return zstd_ret_to_errno(k);
+
+        *dst_size = k;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
+int compress_blob_explicit(int compression,
+                           const void *src, uint64_t src_size,
+                           void *dst, size_t dst_alloc_size, size_t *dst_size) {
+        if (compression == OBJECT_COMPRESSED_XZ)
+                return compress_blob_xz(src, src_size, dst, dst_alloc_size, dst_size);
+        else if (compression == OBJECT_COMPRESSED_LZ4)
+                return compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return compress_blob_zstd(src, src_size, dst, dst_alloc_size, dst_size);
+        else
+                return -EOPNOTSUPP;
+}
 
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
@@ -231,6 +291,60 @@ int decompress_blob_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = NULL;
+        ZSTD_inBuffer input = {
+                .src = src,
+                .size = src_size,
+        };
+        ZSTD_outBuffer output = {};
+        uint64_t size;
+        size_t k;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size);
+        assert(dst_size);
+        assert(*dst_alloc_size == 0 || *dst);
+
+        size = ZSTD_getFrameContentSize(src, src_size);
+        if (IN_SET(size, ZSTD_CONTENTSIZE_ERROR, ZSTD_CONTENTSIZE_UNKNOWN))
+                return -EBADMSG;
+
+        if (dst_max > 0 && size > dst_max)
+                size = dst_max;
+        if (size > SIZE_MAX)
+                return -E2BIG;
+
+        if (!(greedy_realloc(dst, dst_alloc_size, MAX(ZSTD_DStreamOutSize(), size), 1)))
+                return -ENOMEM;
+
+        dctx = ZSTD_createDCtx();
+        if (!dctx)
+                return -ENOMEM;
+
+        output.dst = *dst;
+        output.size = *dst_alloc_size;
+
+        k = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(k)) {
+                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(k));
+                return zstd_ret_to_errno(k);
+        }
+        if (output.pos < size)
+                return -EBADMSG;
+
+        *dst_size = size;
+        return 0;
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_blob(int compression,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
@@ -240,6 +354,9 @@ int decompress_blob(int compression,
         else if (compression == OBJECT_COMPRESSED_LZ4)
                 return decompress_blob_lz4(src, src_size,
                                            dst, dst_alloc_size, dst_size, dst_max);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_blob_zstd(src, src_size,
+                                            dst, dst_alloc_size, dst_size, dst_max);
         else
                 return -EBADMSG;
 }
@@ -353,6 +470,60 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
 #endif
 }
 
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra) {
+#if HAVE_ZSTD
+        _cleanup_(ZSTD_freeDCtxp) ZSTD_DCtx *dctx = NULL;
+        ZSTD_inBuffer input = {
+                .src = src,
+                .size = src_size,
+        };
+        ZSTD_outBuffer output = {};
+        size_t k;
+
+        /* Checks whether the decompressed blob starts with the
+         * mentioned prefix. The byte extra needs to follow the
+         * prefix */
+
+        assert(src);
+        assert(src_size > 0);
+        assert(buffer);
+        assert(buffer_size);
+        assert(prefix);
+        assert(*buffer_size == 0 || *buffer);
+
+        if (ZSTD_getFrameContentSize(src, src_size) == ZSTD_CONTENTSIZE_ERROR)
+                return -EBADMSG;
+
+        if (!(greedy_realloc(buffer, buffer_size, MAX(ZSTD_DStreamOutSize(), prefix_len + 1), 1)))
+                return -ENOMEM;
+
+        dctx = ZSTD_createDCtx();
+        if (!dctx)
+                return -ENOMEM;
+
+        output.dst = *buffer;
+        output.size = *buffer_size;
+
+        k = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(k)) {
+                log_debug("ZSTD decoder failed: %s", ZSTD_getErrorName(k));
+                return zstd_ret_to_errno(k);
+        }
+
+        if (output.pos >= prefix_len + 1)
+                return memcmp(*buffer, prefix, prefix_len) == 0 &&
+                        ((const uint8_t*) *buffer)[prefix_len] == extra;
+        else
+                return 0;
+
+#else
+        return -EPROTONOSUPPORT;
+#endif
+}
+
 int decompress_startswith(int compression,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
@@ -368,21 +539,51 @@ int decompress_startswith(int compression,
                                                  buffer, buffer_size,
                                                  prefix, prefix_len,
                                                  extra);
+        else if (compression == OBJECT_COMPRESSED_ZSTD)
+                return decompress_startswith_zstd(src, src_size,
+                                                  buffer, buffer_size,
+                                                  prefix, prefix_len,
+                                                  extra);
         else
                 return -EBADMSG;
 }
 
-int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
+#if HAVE_XZ
+static lzma_ret xz_stream_encoder(lzma_stream *s) {
+#if LZMA_VERSION >= UINT32_C(50020002)
+        /* Each thread compresses its own block, which costs about
+         * 100 MiB of memory at the default preset, hence don't
+         * spawn too many of them. */
+        lzma_mt mt = {
+                .threads = CLAMP(lzma_cputhreads(), 1U, XZ_THREADS_MAX),
+                .preset = LZMA_PRESET_DEFAULT,
+                .check = LZMA_CHECK_CRC64,
+        };
+
+        return lzma_stream_encoder_mt(s, &mt);
+#else
+        return lzma_easy_encoder(s, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+#endif
+}
+#endif
+
+int compress_stream_xz_tee(int fdf, int fdt, uint64_t max_bytes,
+                           compress_tee_t tee, void *userdata, uint64_t *ret_size) {
 #if HAVE_XZ
         _cleanup_(lzma_end) lzma_stream s = LZMA_STREAM_INIT;
         lzma_ret ret;
         uint8_t buf[BUFSIZ], out[BUFSIZ];
         lzma_action action = LZMA_RUN;
+        bool truncated = false;
+        int r;
 
         assert(fdf >= 0);
         assert(fdt >= 0);
 
-        ret = lzma_easy_encoder(&s, LZMA_PRESET_DEFAULT, LZMA_CHECK_CRC64);
+        /* Returns 1 if max_bytes were read before reaching the end
+         * of the input, 0 otherwise. */
+
+        ret = xz_stream_encoder(&s);
         if (ret != LZMA_OK) {
                 log_error("Failed to initialize XZ encoder: code %u", ret);
                 return -EINVAL;
@@ -396,12 +597,23 @@ int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
                         if (max_bytes != (uint64_t) -1 && (uint64_t) m > max_bytes)
                                 m = (size_t) max_bytes;
 
-                        n = read(fdf, buf, m);
-                        if (n < 0)
-                                return -errno;
+                        if (m == 0) {
+                                truncated = true;
+                                n = 0;
+                        } else {
+                                n = read(fdf, buf, m);
+                                if (n < 0)
+                                        return -errno;
+                        }
                         if (n == 0)
                                 action = LZMA_FINISH;
                         else {
+                                if (tee) {
+                                        r = tee(buf, n, userdata);
+                                        if (r < 0)
+                                                return r;
+                                }
+
                                 s.next_in = buf;
                                 s.avail_in = n;
 
@@ -437,7 +649,10 @@ int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
                                           s.total_in, s.total_out,
                                           (double) s.total_out / s.total_in * 100);
 
-                                return 0;
+                                if (ret_size)
+                                        *ret_size = s.total_in;
+
+                                return truncated;
                         }
                 }
         }
@@ -446,101 +661,128 @@ int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
 #endif
 }
 
+int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
+        int r;
+
+        r = compress_stream_xz_tee(fdf, fdt, max_bytes, NULL, NULL, NULL);
+        return r < 0 ? r : 0;
+}
+
 #define LZ4_BUFSIZE (512*1024u)
 
-int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
+int compress_stream_lz4_tee(int fdf, int fdt, uint64_t max_bytes,
+                            compress_tee_t tee, void *userdata, uint64_t *ret_size) {
 
 #if HAVE_LZ4
         LZ4F_errorCode_t c;
         _cleanup_(LZ4F_freeCompressionContextp) LZ4F_compressionContext_t ctx = NULL;
-        _cleanup_free_ char *buf = NULL;
-        char *src = NULL;
-        size_t size, n, total_in = 0, total_out, offset = 0, frame_size;
-        struct stat st;
+        _cleanup_free_ char *buf = NULL, *src = NULL;
+        size_t size, n, offset = 0, frame_size;
+        uint64_t total_in = 0, total_out;
+        bool truncated = false;
         int r;
-        static const LZ4F_compressOptions_t options = {
-                .stableSrc = 1,
-        };
         static const LZ4F_preferences_t preferences = {
                 .frameInfo.blockSizeID = 5,
         };
 
+        assert(fdf >= 0);
+        assert(fdt >= 0);
+
+        /* The input is read piecewise rather than mapped, so that it
+         * may be a pipe. Returns 1 if max_bytes were read before
+         * reaching the end of the input, 0 otherwise. */
+
         c = LZ4F_createCompressionContext(&ctx, LZ4F_VERSION);
         if (LZ4F_isError(c))
                 return -ENOMEM;
 
-        if (fstat(fdf, &st) < 0)
-                return log_debug_errno(errno, "fstat() failed: %m");
-
         frame_size = LZ4F_compressBound(LZ4_BUFSIZE, &preferences);
         size =  frame_size + 64*1024; /* add some space for header and trailer */
         buf = malloc(size);
-        if (!buf)
+        src = malloc(LZ4_BUFSIZE);
+        if (!buf || !src)
                 return -ENOMEM;
 
         n = offset = total_out = LZ4F_compressBegin(ctx, buf, size, &preferences);
         if (LZ4F_isError(n))
                 return -EINVAL;
 
-        src = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fdf, 0);
-        if (src == MAP_FAILED)
-                return -errno;
-
         log_debug("Buffer size is %zu bytes, header size %zu bytes.", size, n);
 
-        while (total_in < (size_t) st.st_size) {
+        for (;;) {
+                size_t m = LZ4_BUFSIZE;
                 ssize_t k;
 
-                k = MIN(LZ4_BUFSIZE, st.st_size - total_in);
-                n = LZ4F_compressUpdate(ctx, buf + offset, size - offset,
-                                        src + total_in, k, &options);
-                if (LZ4F_isError(n)) {
-                        r = -ENOTRECOVERABLE;
-                        goto cleanup;
+                if (max_bytes != (uint64_t) -1 && (uint64_t) m > max_bytes)
+                        m = (size_t) max_bytes;
+                if (m == 0) {
+                        truncated = true;
+                        break;
+                }
+
+                k = loop_read(fdf, src, m, true);
+                if (k < 0)
+                        return k;
+                if (k == 0)
+                        break;
+
+                if (tee) {
+                        r = tee(src, k, userdata);
+                        if (r < 0)
+                                return r;
                 }
 
+                n = LZ4F_compressUpdate(ctx, buf + offset, size - offset, src, k, NULL);
+                if (LZ4F_isError(n))
+                        return -ENOTRECOVERABLE;
+
                 total_in += k;
                 offset += n;
                 total_out += n;
 
-                if (max_bytes != (uint64_t) -1 && total_out > (size_t) max_bytes) {
-                        log_debug("Compressed stream longer than %"PRIu64" bytes", max_bytes);
-                        return -EFBIG;
+                if (max_bytes != (uint64_t) -1) {
+                        assert(max_bytes >= (uint64_t) k);
+                        max_bytes -= k;
                 }
 
                 if (size - offset < frame_size + 4) {
                         k = loop_write(fdt, buf, offset, false);
-                        if (k < 0) {
-                                r = k;
-                                goto cleanup;
-                        }
+                        if (k < 0)
+                                return k;
                         offset = 0;
                 }
         }
 
-        n = LZ4F_compressEnd(ctx, buf + offset, size - offset, &options);
-        if (LZ4F_isError(n)) {
-                r = -ENOTRECOVERABLE;
-                goto cleanup;
-        }
+        n = LZ4F_compressEnd(ctx, buf + offset, size - offset, NULL);
+        if (LZ4F_isError(n))
+                return -ENOTRECOVERABLE;
 
         offset += n;
         total_out += n;
         r = loop_write(fdt, buf, offset, false);
         if (r < 0)
-                goto cleanup;
+                return r;
 
-        log_debug("LZ4 compression finished (%zu -> %zu bytes, %.1f%%)",
+        log_debug("LZ4 compression finished (%"PRIu64" -> %"PRIu64" bytes, %.1f%%)",
                   total_in, total_out,
                   (double) total_out / total_in * 100);
- cleanup:
-        munmap(src, st.st_size);
-        return r;
+
+        if (ret_size)
+                *ret_size = total_in;
+
+        return truncated;
 #else
         return -EPROTONOSUPPORT;
 #endif
 }
 
+int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes) {
+        int r;
+
+        r = compress_stream_lz4_tee(fdf, fdt, max_bytes, NULL, NULL, NULL);
+        return r < 0 ? r : 0;
+}
+
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_bytes) {
 
 #if HAVE_XZ
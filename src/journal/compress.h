@@ -31,11 +31,17 @@ int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size);
 int compress_blob_lz4(const void *src, uint64_t src_size,
                       void *dst, size_t dst_alloc_size, size_t *dst_size);
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size);
 
 static inline int compress_blob(const void *src, uint64_t src_size,
                                 void *dst, size_t dst_alloc_size, size_t *dst_size) {
         int r;
-#if HAVE_LZ4
+#if HAVE_ZSTD
+        r = compress_blob_zstd(src, src_size, dst, dst_alloc_size, dst_size);
+        if (r == 0)
+                return OBJECT_COMPRESSED_ZSTD;
+#elif HAVE_LZ4
         r = compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
         if (r == 0)
                 return OBJECT_COMPRESSED_LZ4;
@@ -47,10 +53,16 @@ static inline int compress_blob(const void *src, uint64_t src_size,
         return r;
 }
 
+int compress_blob_explicit(int compression,
+                           const void *src, uint64_t src_size,
+                           void *dst, size_t dst_alloc_size, size_t *dst_size);
+
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob_lz4(const void *src, uint64_t src_size,
                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob(int compression,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
@@ -63,12 +75,24 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
                               void **buffer, size_t *buffer_size,
                               const void *prefix, size_t prefix_len,
                               uint8_t extra);
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra);
 int decompress_startswith(int compression,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
                           const void *prefix, size_t prefix_len,
                           uint8_t extra);
 
+/* Called with every chunk of uncompressed data read by compress_stream_*_tee() */
+typedef int (*compress_tee_t)(const void *data, size_t size, void *userdata);
+
+int compress_stream_xz_tee(int fdf, int fdt, uint64_t max_bytes,
+                           compress_tee_t tee, void *userdata, uint64_t *ret_size);
+int compress_stream_lz4_tee(int fdf, int fdt, uint64_t max_bytes,
+                            compress_tee_t tee, void *userdata, uint64_t *ret_size);
+
 int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes);
 int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes);
 
@@ -77,9 +101,11 @@ int decompress_stream_lz4(int fdf, int fdt, uint64_t max_size);
 
 #if HAVE_LZ4
 #  define compress_stream compress_stream_lz4
+#  define compress_stream_tee compress_stream_lz4_tee
 #  define COMPRESSED_EXT ".lz4"
 #else
 #  define compress_stream compress_stream_xz
+#  define compress_stream_tee compress_stream_xz_tee
 #  define COMPRESSED_EXT ".xz"
 #endif
 
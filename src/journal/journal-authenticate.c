@@ -167,8 +167,11 @@ int journal_file_fsprg_evolve(JournalFile *f, uint64_t realtime) {
         }
 }
 
+/* Evolving the key is a single modular squaring, seeking needs exponentiation. Hence for short distances
+ * evolving step by step is cheaper. */
+#define FSPRG_EVOLVE_MAX 256U
+
 int journal_file_fsprg_seek(JournalFile *f, uint64_t goal) {
-        void *msk;
         uint64_t epoch;
 
         assert(f);
@@ -185,8 +188,10 @@ int journal_file_fsprg_seek(JournalFile *f, uint64_t goal) {
                 if (goal == epoch)
                         return 0;
 
-                if (goal == epoch+1) {
-                        FSPRG_Evolve(f->fsprg_state);
+                if (goal > epoch && goal - epoch <= FSPRG_EVOLVE_MAX) {
+                        for (; epoch < goal; epoch++)
+                                FSPRG_Evolve(f->fsprg_state);
+
                         return 0;
                 }
         } else {
@@ -199,9 +204,17 @@ int journal_file_fsprg_seek(JournalFile *f, uint64_t goal) {
 
         log_debug("Seeking FSPRG key to %"PRIu64".", goal);
 
-        msk = alloca(FSPRG_mskinbytes(FSPRG_RECOMMENDED_SECPAR));
-        FSPRG_GenMK(msk, NULL, f->fsprg_seed, f->fsprg_seed_size, FSPRG_RECOMMENDED_SECPAR);
-        FSPRG_Seek(f->fsprg_state, goal, msk, f->fsprg_seed, f->fsprg_seed_size);
+        /* Generating the master key means searching for two large primes, which is by far the most expensive
+         * step. It only depends on the seed, hence do it once and keep the result for subsequent seeks. */
+        if (!f->fsprg_msk) {
+                f->fsprg_msk = malloc(FSPRG_mskinbytes(FSPRG_RECOMMENDED_SECPAR));
+                if (!f->fsprg_msk)
+                        return -ENOMEM;
+
+                FSPRG_GenMK(f->fsprg_msk, NULL, f->fsprg_seed, f->fsprg_seed_size, FSPRG_RECOMMENDED_SECPAR);
+        }
+
+        FSPRG_Seek(f->fsprg_state, goal, f->fsprg_msk, f->fsprg_seed, f->fsprg_seed_size);
         return 0;
 }
 
@@ -308,7 +321,8 @@ int journal_file_hmac_put_header(JournalFile *f) {
          * tail_entry_seqnum, head_entry_seqnum, entry_array_offset,
          * head_entry_realtime, tail_entry_realtime,
          * tail_entry_monotonic, n_data, n_fields, n_tags,
-         * n_entry_arrays. */
+         * n_entry_arrays, data_hash_chain_depth,
+         * field_hash_chain_depth. */
 
         gcry_md_write(f->hmac, f->header->signature, offsetof(Header, state) - offsetof(Header, signature));
         gcry_md_write(f->hmac, &f->header->file_id, offsetof(Header, boot_id) - offsetof(Header, file_id));
@@ -0,0 +1,525 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "journal-boot-index.h"
+#include "journal-def.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "path-util.h"
+#include "string-util.h"
+#include "util.h"
+
+/* Which boots a journal file contains, and when they started and ended, can be read from the _BOOT_ID data
+ * objects of the file without iterating through its entries. Since archived files are never modified, we
+ * additionally record what we found in an index file in the directory, so that enumerating the boots of a
+ * large archive only needs to open that, as long as the inode, size and modification time of the files
+ * still match. */
+#define BOOT_INDEX ".boot-index"
+
+typedef struct BootIndexFile {
+        uint64_t inode;
+        uint64_t size;
+        nsec_t mtime;
+
+        JournalBoot *boots;
+        size_t n_boots, n_allocated;
+
+        char filename[];
+} BootIndexFile;
+
+typedef struct BootIndex {
+        char *directory;
+        Hashmap *files;
+        bool dirty;
+} BootIndex;
+
+static void boot_index_file_free(BootIndexFile *f) {
+        if (!f)
+                return;
+
+        free(f->boots);
+        free(f);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(BootIndexFile*, boot_index_file_free);
+
+static BootIndex* boot_index_free(BootIndex *index) {
+        if (!index)
+                return NULL;
+
+        hashmap_free_with_destructor(index->files, boot_index_file_free);
+        free(index->directory);
+
+        return mfree(index);
+}
+
+static BootIndexFile* boot_index_file_new(const char *filename, const struct stat *st) {
+        BootIndexFile *f;
+
+        assert(filename);
+        assert(st);
+
+        f = malloc0(offsetof(BootIndexFile, filename) + strlen(filename) + 1);
+        if (!f)
+                return NULL;
+
+        f->inode = st->st_ino;
+        f->size = st->st_size;
+        f->mtime = timespec_load_nsec(&st->st_mtim);
+        strcpy(f->filename, filename);
+
+        return f;
+}
+
+static int boot_index_load(const char *directory, BootIndex **ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+        BootIndex *index;
+        const char *fn;
+        char line[LINE_MAX];
+        int r;
+
+        assert(directory);
+        assert(ret);
+
+        index = new0(BootIndex, 1);
+        if (!index)
+                return -ENOMEM;
+
+        index->directory = strdup(directory);
+        if (!index->directory) {
+                boot_index_free(index);
+                return -ENOMEM;
+        }
+
+        index->files = hashmap_new(&string_hash_ops);
+        if (!index->files) {
+                boot_index_free(index);
+                return -ENOMEM;
+        }
+
+        /* A missing or unreadable index is not an error, we'll just have to look at the files themselves */
+        *ret = index;
+
+        fn = strjoina(directory, "/" BOOT_INDEX);
+        f = fopen(fn, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        FOREACH_LINE(line, f, return -errno) {
+                uint64_t inode, size, mtime, first, last, first_seqnum, last_seqnum;
+                char id[SD_ID128_STRING_MAX];
+                BootIndexFile *e;
+                sd_id128_t boot_id;
+                int k = 0;
+                char *name;
+
+                if (IN_SET(line[0], '#', '\n'))
+                        continue;
+
+                if (sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %32s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %n",
+                           &inode, &size, &mtime, id, &first, &last, &first_seqnum, &last_seqnum, &k) != 8 || k <= 0)
+                        continue;
+
+                if (sd_id128_from_string(id, &boot_id) < 0)
+                        continue;
+
+                name = strstrip(line + k);
+                if (!filename_is_valid(name))
+                        continue;
+
+                e = hashmap_get(index->files, name);
+                if (!e) {
+                        e = malloc0(offsetof(BootIndexFile, filename) + strlen(name) + 1);
+                        if (!e)
+                                return -ENOMEM;
+
+                        e->inode = inode;
+                        e->size = size;
+                        e->mtime = mtime;
+                        strcpy(e->filename, name);
+
+                        r = hashmap_put(index->files, e->filename, e);
+                        if (r < 0) {
+                                free(e);
+                                return r;
+                        }
+                }
+
+                /* A file without any boots is recorded with a null boot ID */
+                if (sd_id128_is_null(boot_id))
+                        continue;
+
+                if (!GREEDY_REALLOC(e->boots, e->n_allocated, e->n_boots + 1))
+                        return -ENOMEM;
+
+                e->boots[e->n_boots++] = (JournalBoot) {
+                        .id = boot_id,
+                        .first = first,
+                        .last = last,
+                        .first_seqnum = first_seqnum,
+                        .last_seqnum = last_seqnum,
+                };
+        }
+
+        return 0;
+}
+
+static int boot_index_save(BootIndex *index) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *t = NULL;
+        _cleanup_close_ int dir_fd = -1;
+        BootIndexFile *e;
+        const char *fn;
+        Iterator i;
+        size_t k;
+        int r;
+
+        assert(index);
+
+        fn = strjoina(index->directory, "/" BOOT_INDEX);
+
+        r = fopen_temporary(fn, &f, &t);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0640);
+
+        fputs("# Inode, size, mtime of archived journal files, and ID, first and last realtime and seqnum of the boots in them\n", f);
+
+        dir_fd = open(index->directory, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dir_fd < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        HASHMAP_FOREACH(e, index->files, i) {
+                struct stat st;
+
+                /* Don't keep entries for files that have been vacuumed in the meantime */
+                if (fstatat(dir_fd, e->filename, &st, AT_SYMLINK_NOFOLLOW) < 0 && errno == ENOENT)
+                        continue;
+
+                if (e->n_boots == 0)
+                        fprintf(f, "%" PRIu64 " %" PRIu64 " %" PRIu64 " " SD_ID128_FORMAT_STR " 0 0 0 0 %s\n",
+                                e->inode, e->size, e->mtime, SD_ID128_FORMAT_VAL(SD_ID128_NULL), e->filename);
+
+                for (k = 0; k < e->n_boots; k++)
+                        fprintf(f, "%" PRIu64 " %" PRIu64 " %" PRIu64 " " SD_ID128_FORMAT_STR " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %s\n",
+                                e->inode, e->size, e->mtime,
+                                SD_ID128_FORMAT_VAL(e->boots[k].id),
+                                e->boots[k].first, e->boots[k].last,
+                                e->boots[k].first_seqnum, e->boots[k].last_seqnum,
+                                e->filename);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(t, fn) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return r;
+}
+
+static int journal_file_read_boot_edge(JournalFile *f, uint64_t data_offset, direction_t direction, usec_t *realtime, uint64_t *seqnum) {
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(realtime);
+        assert(seqnum);
+
+        r = journal_file_next_entry_for_data(f, NULL, 0, data_offset, direction, &o, NULL);
+        if (r <= 0)
+                return r;
+
+        *realtime = le64toh(o->entry.realtime);
+        *seqnum = le64toh(o->entry.seqnum);
+
+        return 1;
+}
+
+static int journal_file_get_boots(JournalFile *f, BootIndexFile *e) {
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(e);
+
+        /* Every boot is one _BOOT_ID data object, and its first and last entries are the first and last items
+         * of its entry array. All _BOOT_ID data objects are linked from the field object. */
+
+        r = journal_file_find_field_object(f, "_BOOT_ID", strlen("_BOOT_ID"), &o, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                /* Entries without _BOOT_ID= fields? Let the caller find the boots the slow way then. */
+                return le64toh(f->header->n_entries) > 0 ? -ENODATA : 0;
+
+        p = le64toh(o->field.head_data_offset);
+        while (p > 0) {
+                char id[SD_ID128_STRING_MAX];
+                JournalBoot b = {};
+                uint64_t next, l;
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                next = le64toh(o->data.next_field_offset);
+                l = le64toh(o->object.size) - offsetof(Object, data.payload);
+
+                /* _BOOT_ID= data is way too small to ever get compressed */
+                if ((o->object.flags & OBJECT_COMPRESSION_MASK) != 0 ||
+                    l != strlen("_BOOT_ID=") + SD_ID128_STRING_MAX - 1 ||
+                    memcmp(o->data.payload, "_BOOT_ID=", strlen("_BOOT_ID=")) != 0)
+                        return -ENODATA;
+
+                memcpy(id, o->data.payload + strlen("_BOOT_ID="), SD_ID128_STRING_MAX - 1);
+                id[SD_ID128_STRING_MAX - 1] = 0;
+
+                r = sd_id128_from_string(id, &b.id);
+                if (r < 0)
+                        return -ENODATA;
+
+                /* Note that this moves the window, o is invalid from here on */
+                r = journal_file_read_boot_edge(f, p, DIRECTION_DOWN, &b.first, &b.first_seqnum);
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        r = journal_file_read_boot_edge(f, p, DIRECTION_UP, &b.last, &b.last_seqnum);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                return -ENODATA;
+
+                        if (!GREEDY_REALLOC(e->boots, e->n_allocated, e->n_boots + 1))
+                                return -ENOMEM;
+
+                        e->boots[e->n_boots++] = b;
+                }
+
+                p = next;
+        }
+
+        return 0;
+}
+
+static int boot_compare_id(const void *_a, const void *_b) {
+        const JournalBoot *a = _a, *b = _b;
+        int r;
+
+        r = memcmp(&a->id, &b->id, sizeof(sd_id128_t));
+        if (r != 0)
+                return r;
+
+        if (a->first < b->first)
+                return -1;
+        if (a->first > b->first)
+                return 1;
+
+        return 0;
+}
+
+static int boot_compare_time(const void *_a, const void *_b) {
+        const JournalBoot *a = _a, *b = _b;
+
+        if (a->first < b->first)
+                return -1;
+        if (a->first > b->first)
+                return 1;
+
+        if (a->first_seqnum < b->first_seqnum)
+                return -1;
+        if (a->first_seqnum > b->first_seqnum)
+                return 1;
+
+        return memcmp(&a->id, &b->id, sizeof(sd_id128_t));
+}
+
+static int boot_index_get(Hashmap **indexes, const char *path, BootIndex **ret) {
+        _cleanup_free_ char *directory = NULL;
+        BootIndex *index = NULL;
+        int r;
+
+        assert(indexes);
+        assert(path);
+        assert(ret);
+
+        directory = dirname_malloc(path);
+        if (!directory)
+                return -ENOMEM;
+
+        index = hashmap_get(*indexes, directory);
+        if (index) {
+                *ret = index;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(indexes, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = boot_index_load(directory, &index);
+        if (!index)
+                return r;
+        if (r < 0)
+                log_debug_errno(r, "Failed to read boot index of %s, ignoring: %m", directory);
+
+        r = hashmap_put(*indexes, index->directory, index);
+        if (r < 0) {
+                boot_index_free(index);
+                return r;
+        }
+
+        *ret = index;
+        return 0;
+}
+
+int journal_get_boots(sd_journal *j, JournalBoot **ret, size_t *ret_n) {
+        Hashmap *indexes = NULL;
+        _cleanup_free_ JournalBoot *boots = NULL;
+        size_t n_boots = 0, n_allocated = 0, k, n;
+        BootIndex *index;
+        JournalFile *f;
+        Iterator i;
+        int r;
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Returns the boots in all files of the journal, oldest first, merging boots that span several files.
+         * Returns -ENODATA if the boots of some file can't be determined from its _BOOT_ID data objects. */
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                _cleanup_(boot_index_file_freep) BootIndexFile *fresh = NULL;
+                BootIndexFile *e = NULL;
+                bool archived;
+
+                archived = f->path && f->header->state == STATE_ARCHIVED;
+
+                index = NULL;
+                if (archived) {
+                        r = boot_index_get(&indexes, f->path, &index);
+                        if (r < 0)
+                                goto finish;
+
+                        e = hashmap_get(index->files, basename(f->path));
+                        if (e &&
+                            (e->inode != (uint64_t) f->last_stat.st_ino ||
+                             e->size != (uint64_t) f->last_stat.st_size ||
+                             e->mtime != timespec_load_nsec(&f->last_stat.st_mtim)))
+                                e = NULL;
+                }
+
+                if (!e) {
+                        fresh = boot_index_file_new(f->path ? basename(f->path) : "", &f->last_stat);
+                        if (!fresh) {
+                                r = -ENOMEM;
+                                goto finish;
+                        }
+
+                        r = journal_file_get_boots(f, fresh);
+                        if (r < 0)
+                                goto finish;
+
+                        e = fresh;
+                }
+
+                if (!GREEDY_REALLOC(boots, n_allocated, n_boots + e->n_boots)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                memcpy(boots + n_boots, e->boots, e->n_boots * sizeof(JournalBoot));
+                n_boots += e->n_boots;
+
+                if (index && e == fresh) {
+                        BootIndexFile *old;
+
+                        old = hashmap_remove(index->files, fresh->filename);
+                        boot_index_file_free(old);
+
+                        r = hashmap_put(index->files, fresh->filename, fresh);
+                        if (r < 0)
+                                goto finish;
+
+                        fresh = NULL;
+                        index->dirty = true;
+                }
+        }
+
+        /* Merge the parts of boots that span several files */
+        qsort_safe(boots, n_boots, sizeof(JournalBoot), boot_compare_id);
+        for (k = 0, n = 0; k < n_boots; k++) {
+                if (n > 0 && sd_id128_equal(boots[n-1].id, boots[k].id)) {
+                        /* Sorted by start time already, hence only the end may move */
+                        if (boots[k].last > boots[n-1].last) {
+                                boots[n-1].last = boots[k].last;
+                                boots[n-1].last_seqnum = boots[k].last_seqnum;
+                        }
+                        continue;
+                }
+
+                boots[n++] = boots[k];
+        }
+        n_boots = n;
+
+        qsort_safe(boots, n_boots, sizeof(JournalBoot), boot_compare_time);
+
+        *ret = boots;
+        boots = NULL;
+        *ret_n = n_boots;
+        r = 0;
+
+finish:
+        HASHMAP_FOREACH(index, indexes, i) {
+                if (r >= 0 && index->dirty) {
+                        int q;
+
+                        /* Only works with write access to the journal directory, which is fine, we'll
+                         * just have to look at the files again next time otherwise */
+                        q = boot_index_save(index);
+                        if (q < 0)
+                                log_debug_errno(q, "Failed to write boot index of %s, ignoring: %m", index->directory);
+                }
+
+                boot_index_free(index);
+        }
+        hashmap_free(indexes);
+
+        return r;
+}
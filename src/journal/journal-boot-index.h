@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include "sd-id128.h"
+#include "sd-journal.h"
+
+#include "time-util.h"
+
+typedef struct JournalBoot {
+        sd_id128_t id;
+        usec_t first;
+        usec_t last;
+        uint64_t first_seqnum;
+        uint64_t last_seqnum;
+} JournalBoot;
+
+int journal_get_boots(sd_journal *j, JournalBoot **ret, size_t *ret_n);
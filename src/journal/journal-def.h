@@ -66,10 +66,11 @@ typedef enum ObjectType {
 enum {
         OBJECT_COMPRESSED_XZ = 1 << 0,
         OBJECT_COMPRESSED_LZ4 = 1 << 1,
+        OBJECT_COMPRESSED_ZSTD = 1 << 2,
         _OBJECT_COMPRESSED_MAX
 };
 
-#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4)
+#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4 | OBJECT_COMPRESSED_ZSTD)
 
 struct ObjectHeader {
         uint8_t type;
@@ -159,19 +160,17 @@ enum {
 enum {
         HEADER_INCOMPATIBLE_COMPRESSED_XZ = 1 << 0,
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 = 1 << 1,
+        HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 2,
+        HEADER_INCOMPATIBLE_KEYED_HASH = 1 << 3,
 };
 
-#define HEADER_INCOMPATIBLE_ANY (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4)
+#define HEADER_INCOMPATIBLE_ANY (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4|HEADER_INCOMPATIBLE_COMPRESSED_ZSTD|HEADER_INCOMPATIBLE_KEYED_HASH)
 
-#if HAVE_XZ && HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_ANY
-#elif HAVE_XZ
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_XZ
-#elif HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_LZ4
-#else
-#  define HEADER_INCOMPATIBLE_SUPPORTED 0
-#endif
+#define HEADER_INCOMPATIBLE_SUPPORTED                                   \
+        ((HAVE_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ : 0) |            \
+         (HAVE_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0) |          \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSED_ZSTD : 0) |        \
+         HEADER_INCOMPATIBLE_KEYED_HASH)
 
 enum {
         HEADER_COMPATIBLE_SEALED = 1
@@ -217,8 +216,11 @@ struct Header {
         /* Added in 189 */
         le64_t n_tags;
         le64_t n_entry_arrays;
+        /* Added in 236 */
+        le64_t data_hash_chain_depth;
+        le64_t field_hash_chain_depth;
 
-        /* Size: 240 */
+        /* Size: 256 */
 } _packed_;
 
 #define FSS_HEADER_SIGNATURE ((char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
@@ -26,12 +26,14 @@
 #include <sys/mman.h>
 #include <sys/statvfs.h>
 #include <sys/uio.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
 #include "btrfs-util.h"
 #include "chattr-util.h"
 #include "compress.h"
+#include "env-util.h"
 #include "fd-util.h"
 #include "journal-authenticate.h"
 #include "journal-def.h"
@@ -39,9 +41,11 @@
 #include "lookup3.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "prioq.h"
 #include "random-util.h"
 #include "sd-event.h"
 #include "set.h"
+#include "siphash24.h"
 #include "string-util.h"
 #include "strv.h"
 #include "xattr-util.h"
@@ -79,8 +83,48 @@
 /* n_data was the first entry we added after the initial file format design */
 #define HEADER_SIZE_MIN ALIGN64(offsetof(Header, n_data))
 
-/* How many entries to keep in the entry array chain cache at max */
+/* How many entries to keep in the entry array chain cache at max, by default and as upper limit if the size is
+ * adjusted to the number of chains in use */
 #define CHAIN_CACHE_MAX 20
+#define CHAIN_CACHE_LIMIT 1024
+
+/* How long hash chains may get before we suggest rotation */
+#define HASH_CHAIN_DEPTH_MAX 100
+
+/* Archived files carry a bloom filter over the values of a few fields commonly matched on in an extended attribute,
+ * so that readers can skip files quickly that can't contain a match. 16384 bits with 4 hash functions give a
+ * false positive rate of about 1% for 1500 values. If there are much more values we don't bother. */
+#define DATA_BLOOM_XATTR "user.journal.bloom"
+#define DATA_BLOOM_SIZE 2048
+#define DATA_BLOOM_N_HASH 4
+#define DATA_BLOOM_N_MAX 4096
+
+static const char data_bloom_fields[] =
+        "_SYSTEMD_UNIT\0"
+        "_SYSTEMD_USER_UNIT\0"
+        "_SYSTEMD_SLICE\0"
+        "_SYSTEMD_CGROUP\0"
+        "UNIT\0"
+        "USER_UNIT\0"
+        "OBJECT_SYSTEMD_UNIT\0"
+        "OBJECT_SYSTEMD_USER_UNIT\0"
+        "COREDUMP_UNIT\0"
+        "COREDUMP_USER_UNIT\0"
+        "SYSLOG_IDENTIFIER\0"
+        "MESSAGE_ID\0"
+        "PRIORITY\0"
+        "_TRANSPORT\0"
+        "_COMM\0"
+        "_EXE\0"
+        "_UID\0"
+        "_BOOT_ID\0"
+        "_HOSTNAME\0"
+        "_MACHINE_ID\0";
+
+/* The in-memory data hash filter keeps one 32bit word per data hash table bucket. The top bit marks the
+ * bucket's chain as fully known, the other bits form a tiny bloom filter over the hashes linked into it. */
+#define DATA_HASH_FILTER_VALID (UINT32_C(1) << 31)
+#define DATA_HASH_FILTER_BITS 31U
 
 /* How much to increase the journal file size at once each time we allocate something new. */
 #define FILE_SIZE_INCREASE (8ULL*1024ULL*1024ULL)              /* 8MB */
@@ -98,6 +142,103 @@
 /* This may be called from a separate thread to prevent blocking the caller for the duration of fsync().
  * As a result we use atomic operations on f->offline_state for inter-thread communications with
  * journal_file_set_offline() and journal_file_set_online(). */
+static bool data_bloom_field(const void *data, uint64_t size) {
+        const char *eq, *field;
+        size_t l;
+
+        assert(data || size == 0);
+
+        if (!data)
+                return false;
+
+        eq = memchr(data, '=', size);
+        if (!eq)
+                return false;
+
+        l = eq - (const char*) data;
+
+        NULSTR_FOREACH(field, data_bloom_fields)
+                if (strlen(field) == l && memcmp(field, data, l) == 0)
+                        return true;
+
+        return false;
+}
+
+static void data_bloom_add(uint64_t *bloom, uint64_t hash) {
+        uint32_t a = (uint32_t) hash, b = (uint32_t) (hash >> 32) | 1;
+        unsigned i;
+
+        for (i = 0; i < DATA_BLOOM_N_HASH; i++) {
+                unsigned bit = (a + i * b) % (DATA_BLOOM_SIZE * 8);
+
+                bloom[bit / 64] |= UINT64_C(1) << (bit % 64);
+        }
+}
+
+static bool data_bloom_test(const uint64_t *bloom, uint64_t hash) {
+        uint32_t a = (uint32_t) hash, b = (uint32_t) (hash >> 32) | 1;
+        unsigned i;
+
+        for (i = 0; i < DATA_BLOOM_N_HASH; i++) {
+                unsigned bit = (a + i * b) % (DATA_BLOOM_SIZE * 8);
+
+                if (!(bloom[bit / 64] & (UINT64_C(1) << (bit % 64))))
+                        return false;
+        }
+
+        return true;
+}
+
+static void journal_file_write_data_bloom(JournalFile *f) {
+        assert(f);
+
+        /* We only know about all values if we created the file ourselves */
+        if (!f->data_bloom)
+                return;
+
+        if (f->n_data_bloom > DATA_BLOOM_N_MAX)
+                return;
+
+        if (fsetxattr(f->fd, DATA_BLOOM_XATTR, f->data_bloom, DATA_BLOOM_SIZE, 0) < 0)
+                log_debug_errno(errno, "Failed to store bloom filter of %s, ignoring: %m", f->path);
+}
+
+bool journal_file_may_contain_data(JournalFile *f, const void *data, uint64_t size, uint64_t hash) {
+        assert(f);
+        assert(f->header);
+
+        /* Returns false if the file definitely doesn't contain the specified data object. Note that this
+         * only looks at the bloom filter stored along with archived files, callers need to look into the
+         * hash table to find out whether the data is really there. */
+
+        if (f->writable || f->header->state != STATE_ARCHIVED)
+                return true;
+
+        if (!data_bloom_field(data, size))
+                return true;
+
+        if (!f->data_bloom_loaded) {
+                ssize_t n;
+
+                f->data_bloom_loaded = true;
+
+                f->data_bloom = malloc(DATA_BLOOM_SIZE);
+                if (!f->data_bloom)
+                        return true;
+
+                n = fgetxattr(f->fd, DATA_BLOOM_XATTR, f->data_bloom, DATA_BLOOM_SIZE);
+                if (n != DATA_BLOOM_SIZE) {
+                        f->data_bloom = mfree(f->data_bloom);
+                        return true;
+                }
+        }
+
+        if (!f->data_bloom)
+                return true;
+
+        return data_bloom_test(f->data_bloom, hash);
+}
+
 static void journal_file_set_offline_internal(JournalFile *f) {
         assert(f);
         assert(f->fd >= 0);
@@ -126,6 +267,9 @@ static void journal_file_set_offline_internal(JournalFile *f) {
                         if (!__sync_bool_compare_and_swap(&f->offline_state, OFFLINE_SYNCING, OFFLINE_OFFLINING))
                                 continue;
 
+                        if (f->archive)
+                                journal_file_write_data_bloom(f);
+
                         f->header->state = f->archive ? STATE_ARCHIVED : STATE_OFFLINE;
                         (void) fsync(f->fd);
                         break;
@@ -331,9 +475,38 @@ bool journal_file_is_offlining(JournalFile *f) {
         return true;
 }
 
+static char *journal_file_standby_path(const char *path) {
+        const char *fn;
+
+        assert(path);
+
+        /* Neither ends in .journal nor in .journal~, hence readers won't pick the file up */
+        fn = strjoina(".#", basename(path), ".standby");
+        return file_in_same_dir(path, fn);
+}
+
+static void journal_file_drop_standby(JournalFile *f) {
+        _cleanup_free_ char *p = NULL;
+
+        assert(f);
+
+        if (!f->standby)
+                return;
+
+        p = journal_file_standby_path(f->path);
+
+        f->standby = journal_file_close(f->standby);
+
+        if (p)
+                (void) unlink(p);
+}
+
 JournalFile* journal_file_close(JournalFile *f) {
         assert(f);
 
+        /* An unused standby file is of no use to anybody, remove it */
+        journal_file_drop_standby(f);
+
 #if HAVE_GCRYPT
         /* Write the final tag */
         if (f->seal && f->writable) {
@@ -380,8 +553,11 @@ JournalFile* journal_file_close(JournalFile *f) {
         mmap_cache_unref(f->mmap);
 
         ordered_hashmap_free_free(f->chain_cache);
+        free(f->data_hash_filter);
+        free(f->entry_array_index);
+        free(f->data_bloom);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         free(f->compress_buffer);
 #endif
 
@@ -392,6 +568,7 @@ JournalFile* journal_file_close(JournalFile *f) {
                 free(f->fsprg_state);
 
         free(f->fsprg_seed);
+        free(f->fsprg_msk);
 
         if (f->hmac)
                 gcry_md_close(f->hmac);
@@ -412,7 +589,9 @@ static int journal_file_init_header(JournalFile *f, JournalFile *template) {
 
         h.incompatible_flags |= htole32(
                 f->compress_xz * HEADER_INCOMPATIBLE_COMPRESSED_XZ |
-                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4);
+                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |
+                f->compress_zstd * HEADER_INCOMPATIBLE_COMPRESSED_ZSTD |
+                f->keyed_hash * HEADER_INCOMPATIBLE_KEYED_HASH);
 
         h.compatible_flags = htole32(
                 f->seal * HEADER_COMPATIBLE_SEALED);
@@ -515,7 +694,7 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[3];
+                        const char* strv[4];
                         unsigned n = 0;
                         _cleanup_free_ char *t = NULL;
 
@@ -525,6 +704,8 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                 strv[n++] = "xz-compressed";
                         if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
                                 strv[n++] = "lz4-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+                                strv[n++] = "zstd-compressed";
                         strv[n] = NULL;
                         assert(n < ELEMENTSOF(strv));
 
@@ -620,6 +801,8 @@ static int journal_file_verify_header(JournalFile *f) {
 
         f->compress_xz = JOURNAL_HEADER_COMPRESSED_XZ(f->header);
         f->compress_lz4 = JOURNAL_HEADER_COMPRESSED_LZ4(f->header);
+        f->compress_zstd = JOURNAL_HEADER_COMPRESSED_ZSTD(f->header);
+        f->keyed_hash = JOURNAL_HEADER_KEYED_HASH(f->header);
 
         f->seal = JOURNAL_HEADER_SEALED(f->header);
 
@@ -926,6 +1109,20 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
         return 0;
 }
 
+uint64_t journal_file_hash_data(JournalFile *f, const void *data, size_t sz) {
+        assert(f);
+        assert(data || sz == 0);
+
+        /* Untrusted clients control what ends up in the data and field hash tables, and could otherwise craft
+         * payloads that all end up in the same hash chain. Hence optionally use SipHash, keyed by the file ID,
+         * so that collisions can't be precomputed. */
+
+        if (f->keyed_hash)
+                return siphash24(data, sz, f->header->file_id.bytes);
+
+        return hash64(data, sz);
+}
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret) {
         int r;
         void *t;
@@ -1022,22 +1219,16 @@ static uint64_t journal_file_entry_seqnum(JournalFile *f, uint64_t *seqnum) {
         return r;
 }
 
-int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, Object **ret, uint64_t *offset) {
-        int r;
+static int journal_file_tail_end(JournalFile *f, uint64_t *ret_offset) {
+        Object *tail;
         uint64_t p;
-        Object *tail, *o;
-        void *t;
+        int r;
 
         assert(f);
         assert(f->header);
-        assert(type > OBJECT_UNUSED && type < _OBJECT_TYPE_MAX);
-        assert(size >= sizeof(ObjectHeader));
-        assert(offset);
-        assert(ret);
+        assert(ret_offset);
 
-        r = journal_file_set_online(f);
-        if (r < 0)
-                return r;
+        /* Returns the offset right after the last object in the file, i.e. where the next object will be placed */
 
         p = le64toh(f->header->tail_object_offset);
         if (p == 0)
@@ -1050,6 +1241,31 @@ int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, O
                 p += ALIGN64(le64toh(tail->object.size));
         }
 
+        *ret_offset = p;
+        return 0;
+}
+
+int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, Object **ret, uint64_t *offset) {
+        int r;
+        uint64_t p;
+        Object *o;
+        void *t;
+
+        assert(f);
+        assert(f->header);
+        assert(type > OBJECT_UNUSED && type < _OBJECT_TYPE_MAX);
+        assert(size >= sizeof(ObjectHeader));
+        assert(offset);
+        assert(ret);
+
+        r = journal_file_set_online(f);
+        if (r < 0)
+                return r;
+
+        r = journal_file_tail_end(f, &p);
+        if (r < 0)
+                return r;
+
         r = journal_file_allocate(f, p, size);
         if (r < 0)
                 return r;
@@ -1231,6 +1447,11 @@ static int journal_file_link_field(
         return 0;
 }
 
+static inline uint32_t data_hash_filter_bit(uint64_t hash, uint64_t m) {
+        /* The bucket is selected by hash % m, hence use the remaining bits for the filter */
+        return UINT32_C(1) << ((hash / m) % DATA_HASH_FILTER_BITS);
+}
+
 static int journal_file_link_data(
                 JournalFile *f,
                 Object *o,
@@ -1276,18 +1497,52 @@ static int journal_file_link_data(
 
         f->data_hash_table[h].tail_hash_offset = htole64(offset);
 
+        if (f->data_hash_filter)
+                f->data_hash_filter[h] |= data_hash_filter_bit(hash, m);
+
         if (JOURNAL_HEADER_CONTAINS(f->header, n_data))
                 f->header->n_data = htole64(le64toh(f->header->n_data) + 1);
 
         return 0;
 }
 
+static void journal_file_update_hash_chain_depth(JournalFile *f, bool data, uint64_t depth) {
+        le64_t *d;
+
+        assert(f);
+        assert(f->header);
+
+        /* Remember the longest hash chain we had to walk in full, i.e. for a lookup that didn't find its object,
+         * which is the case for every object we add. The hash tables are sized once when the file is created,
+         * hence if the hash function distributes badly for the actual data, or there is an unexpectedly large
+         * number of different objects, the chains might grow long well before the fill level reaches the limit
+         * checked by journal_file_rotate_suggested(). */
+
+        if (!f->writable)
+                return;
+
+        if (data) {
+                if (!JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth))
+                        return;
+
+                d = &f->header->data_hash_chain_depth;
+        } else {
+                if (!JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth))
+                        return;
+
+                d = &f->header->field_hash_chain_depth;
+        }
+
+        if (depth > le64toh(*d))
+                *d = htole64(depth);
+}
+
 int journal_file_find_field_object_with_hash(
                 JournalFile *f,
                 const void *field, uint64_t size, uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
-        uint64_t p, osize, h, m;
+        uint64_t p, osize, h, m, depth = 0;
         int r;
 
         assert(f);
@@ -1332,8 +1587,11 @@ int journal_file_find_field_object_with_hash(
                 }
 
                 p = le64toh(o->field.next_hash_offset);
+                depth++;
         }
 
+        journal_file_update_hash_chain_depth(f, false, depth);
+
         return 0;
 }
 
@@ -1347,7 +1605,7 @@ int journal_file_find_field_object(
         assert(f);
         assert(field && size > 0);
 
-        hash = hash64(field, size);
+        hash = journal_file_hash_data(f, field, size);
 
         return journal_file_find_field_object_with_hash(f,
                                                         field, size, hash,
@@ -1359,7 +1617,8 @@ int journal_file_find_data_object_with_hash(
                 const void *data, uint64_t size, uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
-        uint64_t p, osize, h, m;
+        uint64_t p, osize, h, m, depth = 0;
+        uint32_t filter;
         int r;
 
         assert(f);
@@ -1382,6 +1641,21 @@ int journal_file_find_data_object_with_hash(
                 return -EBADMSG;
 
         h = hash % m;
+
+        /* We are the only writer of the file, hence for writable files we can remember which hashes have been
+         * linked into each bucket. This makes lookups of values we haven't seen before cheap, which is the
+         * common case for fields carrying unique values such as timestamps or request IDs: otherwise each
+         * such lookup walks the full chain, touching every object on it. Readers can't do this, as the file
+         * might be modified behind their back. */
+        if (f->writable && !f->data_hash_filter)
+                f->data_hash_filter = new0(uint32_t, m);
+
+        if (f->data_hash_filter &&
+            (f->data_hash_filter[h] & DATA_HASH_FILTER_VALID) &&
+            !(f->data_hash_filter[h] & data_hash_filter_bit(hash, m)))
+                return 0;
+
+        filter = 0;
         p = le64toh(f->data_hash_table[h].head_hash_offset);
 
         while (p > 0) {
@@ -1391,11 +1665,13 @@ int journal_file_find_data_object_with_hash(
                 if (r < 0)
                         return r;
 
+                filter |= data_hash_filter_bit(le64toh(o->data.hash), m);
+
                 if (le64toh(o->data.hash) != hash)
                         goto next;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
                         uint64_t l;
                         size_t rsize = 0;
 
@@ -1438,8 +1714,15 @@ int journal_file_find_data_object_with_hash(
 
         next:
                 p = le64toh(o->data.next_hash_offset);
+                depth++;
         }
 
+        /* We walked the whole chain, hence the filter for this bucket is complete now */
+        if (f->data_hash_filter)
+                f->data_hash_filter[h] = filter | DATA_HASH_FILTER_VALID;
+
+        journal_file_update_hash_chain_depth(f, true, depth);
+
         return 0;
 }
 
@@ -1453,7 +1736,7 @@ int journal_file_find_data_object(
         assert(f);
         assert(data || size == 0);
 
-        hash = hash64(data, size);
+        hash = journal_file_hash_data(f, data, size);
 
         return journal_file_find_data_object_with_hash(f,
                                                        data, size, hash,
@@ -1473,7 +1756,7 @@ static int journal_file_append_field(
         assert(f);
         assert(field && size > 0);
 
-        hash = hash64(field, size);
+        hash = journal_file_hash_data(f, field, size);
 
         r = journal_file_find_field_object_with_hash(f, field, size, hash, &o, &p);
         if (r < 0)
@@ -1522,12 +1805,13 @@ static int journal_file_append_field(
         return 0;
 }
 
-static int journal_file_append_data(
+static int journal_file_append_data_with_hash(
                 JournalFile *f,
                 const void *data, uint64_t size,
+                uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
-        uint64_t hash, p;
+        uint64_t p;
         uint64_t osize;
         Object *o;
         int r, compression = 0;
@@ -1536,8 +1820,6 @@ static int journal_file_append_data(
         assert(f);
         assert(data || size == 0);
 
-        hash = hash64(data, size);
-
         r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
         if (r < 0)
                 return r;
@@ -1559,7 +1841,7 @@ static int journal_file_append_data(
 
         o->data.hash = htole64(hash);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         if (JOURNAL_FILE_COMPRESS(f) && size >= COMPRESSION_SIZE_THRESHOLD) {
                 size_t rsize = 0;
 
@@ -1584,6 +1866,11 @@ static int journal_file_append_data(
         if (r < 0)
                 return r;
 
+        if (f->data_bloom && data_bloom_field(data, size)) {
+                data_bloom_add(f->data_bloom, hash);
+                f->n_data_bloom++;
+        }
+
 #if HAVE_GCRYPT
         r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
         if (r < 0)
@@ -1623,6 +1910,17 @@ static int journal_file_append_data(
         return 0;
 }
 
+static int journal_file_append_data(
+                JournalFile *f,
+                const void *data, uint64_t size,
+                Object **ret, uint64_t *offset) {
+
+        assert(f);
+        assert(data || size == 0);
+
+        return journal_file_append_data_with_hash(f, data, size, journal_file_hash_data(f, data, size), ret, offset);
+}
+
 uint64_t journal_file_entry_n_items(Object *o) {
         assert(o);
 
@@ -1968,22 +2266,116 @@ static int entry_item_cmp(const void *_a, const void *_b) {
         return 0;
 }
 
-int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+typedef struct BatchDataItem {
+        uint64_t hash;
+        const void *data;
+        uint64_t size;
+        uint64_t offset;
+} BatchDataItem;
+
+typedef struct BatchDataCache {
+        Hashmap *by_hash;
+        BatchDataItem *items;
+        size_t n_items;
+        size_t n_allocated;
+} BatchDataCache;
+
+static void batch_data_cache_done(BatchDataCache *c) {
+        assert(c);
+
+        c->by_hash = hashmap_free(c->by_hash);
+        c->items = mfree(c->items);
+        c->n_items = c->n_allocated = 0;
+}
+
+static int journal_file_append_data_batched(
+                JournalFile *f,
+                BatchDataCache *c,
+                const void *data, uint64_t size,
+                uint64_t *ret_hash, uint64_t *ret_offset) {
+
+        BatchDataItem *i;
+        uint64_t hash, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(data || size == 0);
+        assert(ret_hash);
+        assert(ret_offset);
+
+        if (!c) {
+                r = journal_file_append_data(f, data, size, &o, &p);
+                if (r < 0)
+                        return r;
+
+                *ret_hash = le64toh(o->data.hash);
+                *ret_offset = p;
+                return 0;
+        }
+
+        /* Within a batch the same field values (_HOSTNAME=, _BOOT_ID=, _SYSTEMD_UNIT=, …) tend to repeat for
+         * every single entry. Remember the data objects we already looked up or created during this batch,
+         * so that we can skip walking the on-disk hash chain for them. The payloads are compared against the
+         * caller's buffers, which stay valid for the whole batch, hence this never needs to touch the mmap. */
+
+        hash = journal_file_hash_data(f, data, size);
+
+        i = hashmap_get(c->by_hash, &hash);
+        if (i && i->size == size && (size == 0 || memcmp(i->data, data, size) == 0)) {
+                *ret_hash = hash;
+                *ret_offset = i->offset;
+                return 0;
+        }
+
+        r = journal_file_append_data_with_hash(f, data, size, hash, NULL, &p);
+        if (r < 0)
+                return r;
+
+        *ret_hash = hash;
+        *ret_offset = p;
+
+        /* On hash collisions within the batch simply keep the first item, the lookup above will fall back to
+         * the regular path for the other one. */
+        if (i)
+                return 0;
+
+        /* Caching is only an optimization, hence don't fail if we can't allocate memory for it */
+        if (c->n_items >= c->n_allocated)
+                return 0;
+
+        i = c->items + c->n_items;
+        *i = (BatchDataItem) {
+                .hash = hash,
+                .data = data,
+                .size = size,
+                .offset = p,
+        };
+
+        if (hashmap_put(c->by_hash, &i->hash, i) > 0)
+                c->n_items++;
+
+        return 0;
+}
+
+static int journal_file_append_entry_batched(
+                JournalFile *f,
+                BatchDataCache *c,
+                const dual_timestamp *ts,
+                const struct iovec iovec[], unsigned n_iovec,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
         unsigned i;
         EntryItem *items;
         int r;
         uint64_t xor_hash = 0;
-        struct dual_timestamp _ts;
 
         assert(f);
         assert(f->header);
+        assert(ts);
         assert(iovec || n_iovec == 0);
 
-        if (!ts) {
-                dual_timestamp_get(&_ts);
-                ts = &_ts;
-        }
-
 #if HAVE_GCRYPT
         r = journal_file_maybe_append_tag(f, ts->realtime);
         if (r < 0)
@@ -1994,23 +2386,49 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
         items = alloca(sizeof(EntryItem) * MAX(1u, n_iovec));
 
         for (i = 0; i < n_iovec; i++) {
-                uint64_t p;
-                Object *o;
+                uint64_t h, p;
 
-                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, &o, &p);
+                r = journal_file_append_data_batched(f, c, iovec[i].iov_base, iovec[i].iov_len, &h, &p);
                 if (r < 0)
                         return r;
 
-                xor_hash ^= le64toh(o->data.hash);
+                /* The XOR hash is used to recognize the same entry in different files, hence always calculate it
+                 * the same way, independently of the hash function the file uses */
+                xor_hash ^= f->keyed_hash ? hash64(iovec[i].iov_base, iovec[i].iov_len) : h;
                 items[i].object_offset = htole64(p);
-                items[i].hash = o->data.hash;
+                items[i].hash = htole64(h);
         }
 
         /* Order by the position on disk, in order to improve seek
          * times for rotating media. */
         qsort_safe(items, n_iovec, sizeof(EntryItem), entry_item_cmp);
 
-        r = journal_file_append_entry_internal(f, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
+        return journal_file_append_entry_internal(f, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
+}
+
+static void journal_file_append_finish(JournalFile *f) {
+        assert(f);
+
+        if (f->post_change_timer)
+                schedule_post_change(f);
+        else
+                journal_file_post_change(f);
+}
+
+int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+        int r;
+        struct dual_timestamp _ts;
+
+        assert(f);
+        assert(f->header);
+        assert(iovec || n_iovec == 0);
+
+        if (!ts) {
+                dual_timestamp_get(&_ts);
+                ts = &_ts;
+        }
+
+        r = journal_file_append_entry_batched(f, NULL, ts, iovec, n_iovec, seqnum, ret, offset);
 
         /* If the memory mapping triggered a SIGBUS then we return an
          * IO error and ignore the error code passed down to us, since
@@ -2020,10 +2438,93 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
         if (mmap_cache_got_sigbus(f->mmap, f->cache_fd))
                 r = -EIO;
 
-        if (f->post_change_timer)
-                schedule_post_change(f);
-        else
-                journal_file_post_change(f);
+        journal_file_append_finish(f);
+
+        return r;
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const JournalAppendItem batch[], unsigned n_batch,
+                uint64_t *seqnum,
+                unsigned *ret_n_appended) {
+
+        _cleanup_(batch_data_cache_done) BatchDataCache c = {};
+        uint64_t size = 0, p;
+        size_t n_data = 0;
+        unsigned i, j;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(batch || n_batch == 0);
+
+        /* Appends a number of entries in one go. This is mostly equivalent to calling journal_file_append_entry()
+         * for each of them, but shares the data object lookups between the entries of the batch, reserves disk
+         * space for all of them at once and posts only a single change notification at the end.
+         *
+         * Unlike journal_file_append_entry() a batch may be written only partially: on failure the entries
+         * before the failing one have been written already. The number of appended entries is returned in
+         * *ret_n_appended in all cases, so that the caller may rotate and retry with the rest. */
+
+        i = 0;
+
+        if (n_batch == 0) {
+                r = 0;
+                goto finish;
+        }
+
+        for (j = 0; j < n_batch; j++) {
+                unsigned k;
+
+                assert(batch[j].iovec || batch[j].n_iovec == 0);
+
+                size += ALIGN64(offsetof(Object, entry.items) + batch[j].n_iovec * sizeof(EntryItem));
+                for (k = 0; k < batch[j].n_iovec; k++)
+                        size += ALIGN64(offsetof(Object, data.payload) + batch[j].iovec[k].iov_len);
+
+                n_data += batch[j].n_iovec;
+        }
+
+        if (n_data > 0) {
+                c.by_hash = hashmap_new(&uint64_hash_ops);
+                c.items = new(BatchDataItem, n_data);
+                if (c.by_hash && c.items)
+                        c.n_allocated = n_data;
+        }
+
+        r = journal_file_set_online(f);
+        if (r < 0)
+                goto finish;
+
+        /* Reserve space for the worst case, i.e. for all data objects being new and uncompressed. This is only
+         * a hint, the real limit checks are done for each object as usual, hence don't fail on -E2BIG or
+         * similar here, but only if the file is unusable anyway. */
+        r = journal_file_tail_end(f, &p);
+        if (r < 0)
+                goto finish;
+
+        r = journal_file_allocate(f, p, size);
+        if (IN_SET(r, -EIO, -EIDRM))
+                goto finish;
+
+        for (; i < n_batch; i++) {
+                r = journal_file_append_entry_batched(f, &c, &batch[i].ts, batch[i].iovec, batch[i].n_iovec, seqnum, NULL, NULL);
+                if (r < 0)
+                        goto finish;
+        }
+
+        r = 0;
+
+finish:
+        if (mmap_cache_got_sigbus(f->mmap, f->cache_fd))
+                r = -EIO;
+
+        if (i > 0)
+                journal_file_append_finish(f);
+
+        if (ret_n_appended)
+                *ret_n_appended = i;
 
         return r;
 }
@@ -2037,7 +2538,7 @@ typedef struct ChainCacheItem {
 } ChainCacheItem;
 
 static void chain_cache_put(
-                OrderedHashmap *h,
+                JournalFile *f,
                 ChainCacheItem *ci,
                 uint64_t first,
                 uint64_t array,
@@ -2045,13 +2546,19 @@ static void chain_cache_put(
                 uint64_t total,
                 uint64_t last_index) {
 
+        OrderedHashmap *h;
+
+        assert(f);
+
+        h = f->chain_cache;
+
         if (!ci) {
                 /* If the chain item to cache for this chain is the
                  * first one it's not worth caching anything */
                 if (array == first)
                         return;
 
-                if (ordered_hashmap_size(h) >= CHAIN_CACHE_MAX) {
+                if (ordered_hashmap_size(h) >= f->chain_cache_max) {
                         ci = ordered_hashmap_steal_first(h);
                         assert(ci);
                 } else {
@@ -2061,20 +2568,57 @@ static void chain_cache_put(
                 }
 
                 ci->first = first;
-
-                if (ordered_hashmap_put(h, &ci->first, ci) < 0) {
-                        free(ci);
-                        return;
-                }
-        } else
+        } else {
                 assert(ci->first == first);
 
+                /* Move the item to the end, so that the least recently used item is the one dropped first when
+                 * the cache is full */
+                ordered_hashmap_remove(h, &ci->first);
+        }
+
+        if (ordered_hashmap_put(h, &ci->first, ci) < 0) {
+                free(ci);
+                return;
+        }
+
         ci->array = array;
         ci->begin = begin;
         ci->total = total;
         ci->last_index = last_index;
 }
 
+void journal_file_drop_caches(JournalFile *f) {
+        assert(f);
+
+        /* Forget what we learnt about a file we only read from, apart from its header. All of it is loaded
+         * again on demand, should the file be used again. */
+
+        if (f->writable)
+                return;
+
+        ordered_hashmap_clear_free(f->chain_cache);
+
+        f->entry_array_index = mfree(f->entry_array_index);
+        f->n_entry_array_index = f->n_entry_array_index_allocated = 0;
+
+        f->data_bloom = mfree(f->data_bloom);
+        f->data_bloom_loaded = false;
+
+        mmap_cache_fd_release(f->mmap, f->cache_fd);
+}
+
+void journal_file_set_chain_cache_max(JournalFile *f, unsigned n) {
+        assert(f);
+
+        /* Each chain we iterate through needs its own cache item to be effective, hence let the caller size
+         * the cache according to the number of chains it is going to look at at once. */
+
+        f->chain_cache_max = CLAMP(n, CHAIN_CACHE_MAX, CHAIN_CACHE_LIMIT);
+
+        while (ordered_hashmap_size(f->chain_cache) > f->chain_cache_max)
+                free(ordered_hashmap_steal_first(f->chain_cache));
+}
+
 static int generic_array_get(
                 JournalFile *f,
                 uint64_t first,
@@ -2096,7 +2640,9 @@ static int generic_array_get(
                 a = ci->array;
                 i -= ci->total;
                 t = ci->total;
-        }
+                f->chain_cache_hit++;
+        } else
+                f->chain_cache_missed++;
 
         while (a > 0) {
                 uint64_t k;
@@ -2120,7 +2666,7 @@ static int generic_array_get(
 
 found:
         /* Let's cache this item for the next invocation */
-        chain_cache_put(f->chain_cache, ci, first, a, le64toh(o->entry_array.items[0]), t, i);
+        chain_cache_put(f, ci, first, a, le64toh(o->entry_array.items[0]), t, i);
 
         r = journal_file_move_to_object(f, OBJECT_ENTRY, p, &o);
         if (r < 0)
@@ -2171,6 +2717,92 @@ enum {
         TEST_RIGHT
 };
 
+static void entry_array_index_add(
+                JournalFile *f,
+                uint64_t array,
+                uint64_t begin,
+                uint64_t total,
+                uint64_t n,
+                uint64_t last) {
+
+        EntryArraySegment *s;
+        Object *o;
+
+        assert(f);
+        assert(array > 0);
+
+        /* Remember the position and the seqnum/realtime range of a completely filled array of the global entry
+         * array chain we just walked past. Since the chain is append-only these never change, and later seeks
+         * can use them to jump right to the array they are looking for, without walking the chain again. We
+         * only append to the index, hence only take arrays directly following the last indexed one. */
+
+        if (f->n_entry_array_index > 0) {
+                s = f->entry_array_index + f->n_entry_array_index - 1;
+                if (s->total + s->n != total)
+                        return;
+        } else if (total != 0)
+                return;
+
+        if (journal_file_move_to_object(f, OBJECT_ENTRY, last, &o) < 0)
+                return;
+
+        if (!GREEDY_REALLOC(f->entry_array_index, f->n_entry_array_index_allocated, f->n_entry_array_index + 1))
+                return;
+
+        f->entry_array_index[f->n_entry_array_index++] = (EntryArraySegment) {
+                .array = array,
+                .begin = begin,
+                .total = total,
+                .n = n,
+                .last_seqnum = le64toh(o->entry.seqnum),
+                .last_realtime = le64toh(o->entry.realtime),
+        };
+}
+
+static void entry_array_index_seed(JournalFile *f, bool by_seqnum, uint64_t needle) {
+        EntryArraySegment *s;
+        ChainCacheItem *ci;
+        uint64_t first;
+        size_t left, right;
+
+        assert(f);
+        assert(f->header);
+
+        if (f->n_entry_array_index <= 1)
+                return;
+
+        /* Find the first indexed array whose last entry is not before the needle */
+        left = 0;
+        right = f->n_entry_array_index;
+        while (left < right) {
+                size_t m = (left + right) / 2;
+                uint64_t v;
+
+                s = f->entry_array_index + m;
+                v = by_seqnum ? s->last_seqnum : s->last_realtime;
+
+                if (v < needle)
+                        left = m + 1;
+                else
+                        right = m;
+        }
+
+        /* Start the bisection one array earlier: all its entries are before the needle, hence the chain cache
+         * logic in generic_array_bisect() will accept it as starting point, and we know where the previous
+         * array ended if the entry we are looking for is the last one before the needle. */
+        if (left == 0)
+                return;
+
+        s = f->entry_array_index + MIN(left, f->n_entry_array_index) - 1;
+
+        first = le64toh(f->header->entry_array_offset);
+        ci = ordered_hashmap_get(f->chain_cache, &first);
+        if (ci && ci->array == s->array)
+                return;
+
+        chain_cache_put(f, ci, first, s->array, s->begin, s->total, (uint64_t) -1);
+}
+
 static int generic_array_bisect(
                 JournalFile *f,
                 uint64_t first,
@@ -2182,7 +2814,7 @@ static int generic_array_bisect(
                 uint64_t *offset,
                 uint64_t *idx) {
 
-        uint64_t a, p, t = 0, i = 0, last_p = 0, last_index = (uint64_t) -1;
+        uint64_t a, p, t = 0, i = 0, last_p = 0, last_index = (uint64_t) -1, next;
         bool subtract_one = false;
         Object *o, *array = NULL;
         int r;
@@ -2216,8 +2848,11 @@ static int generic_array_bisect(
                         n -= ci->total;
                         t = ci->total;
                         last_index = ci->last_index;
-                }
-        }
+                        f->chain_cache_hit++;
+                } else
+                        f->chain_cache_missed++;
+        } else
+                f->chain_cache_missed++;
 
         while (a > 0) {
                 uint64_t left, right, k, lp;
@@ -2353,7 +2988,12 @@ static int generic_array_bisect(
                 n -= k;
                 t += k;
                 last_index = (uint64_t) -1;
-                a = le64toh(array->entry_array.next_entry_array_offset);
+
+                next = le64toh(array->entry_array.next_entry_array_offset);
+                if (next > 0 && first == le64toh(f->header->entry_array_offset))
+                        entry_array_index_add(f, a, le64toh(array->entry_array.items[0]), t - k, k, lp);
+
+                a = next;
         }
 
         return 0;
@@ -2363,7 +3003,7 @@ found:
                 return 0;
 
         /* Let's cache this item for the next invocation */
-        chain_cache_put(f->chain_cache, ci, first, a, le64toh(array->entry_array.items[0]), t, subtract_one ? (i > 0 ? i-1 : (uint64_t) -1) : i);
+        chain_cache_put(f, ci, first, a, le64toh(array->entry_array.items[0]), t, subtract_one ? (i > 0 ? i-1 : (uint64_t) -1) : i);
 
         if (subtract_one && i == 0)
                 p = last_p;
@@ -2501,6 +3141,8 @@ int journal_file_move_to_entry_by_seqnum(
         assert(f);
         assert(f->header);
 
+        entry_array_index_seed(f, true, seqnum);
+
         return generic_array_bisect(f,
                                     le64toh(f->header->entry_array_offset),
                                     le64toh(f->header->n_entries),
@@ -2538,6 +3180,8 @@ int journal_file_move_to_entry_by_realtime(
         assert(f);
         assert(f->header);
 
+        entry_array_index_seed(f, false, realtime);
+
         return generic_array_bisect(f,
                                     le64toh(f->header->entry_array_offset),
                                     le64toh(f->header->n_entries),
@@ -3116,7 +3760,7 @@ void journal_file_print_header(JournalFile *f) {
                "Sequential Number ID: %s\n"
                "State: %s\n"
                "Compatible Flags:%s%s\n"
-               "Incompatible Flags:%s%s%s\n"
+               "Incompatible Flags:%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data Hash Table Size: %"PRIu64"\n"
@@ -3141,6 +3785,8 @@ void journal_file_print_header(JournalFile *f) {
                (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_ANY) ? " ???" : "",
                JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
+               JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
+               JOURNAL_HEADER_KEYED_HASH(f->header) ? " KEYED-HASH" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
@@ -3174,6 +3820,14 @@ void journal_file_print_header(JournalFile *f) {
                 printf("Entry Array Objects: %"PRIu64"\n",
                        le64toh(f->header->n_entry_arrays));
 
+        if (JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth))
+                printf("Deepest field hash chain: %"PRIu64"\n",
+                       le64toh(f->header->field_hash_chain_depth));
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth))
+                printf("Deepest data hash chain: %"PRIu64"\n",
+                       le64toh(f->header->data_hash_chain_depth));
+
         if (fstat(f->fd, &st) >= 0)
                 printf("Disk usage: %s\n", format_bytes(bytes, sizeof(bytes), (uint64_t) st.st_blocks * 512ULL));
 }
@@ -3253,7 +3907,9 @@ int journal_file_open(
         f->flags = flags;
         f->prot = prot_from_flags(flags);
         f->writable = (flags & O_ACCMODE) != O_RDONLY;
-#if HAVE_LZ4
+#if HAVE_ZSTD
+        f->compress_zstd = compress;
+#elif HAVE_LZ4
         f->compress_lz4 = compress;
 #elif HAVE_XZ
         f->compress_xz = compress;
@@ -3262,6 +3918,10 @@ int journal_file_open(
         f->seal = seal;
 #endif
 
+        /* Files using the keyed hash can't be read by older versions, hence only do this when asked to. Whether an
+         * existing file uses it is determined by its header. */
+        f->keyed_hash = getenv_bool("SYSTEMD_JOURNAL_KEYED_HASH") > 0;
+
         if (mmap_cache)
                 f->mmap = mmap_cache_ref(mmap_cache);
         else {
@@ -3286,6 +3946,8 @@ int journal_file_open(
                 }
         }
 
+        f->chain_cache_max = CHAIN_CACHE_MAX;
+        f->location_prioq_idx = PRIOQ_IDX_NULL;
         f->chain_cache = ordered_hashmap_new(&uint64_hash_ops);
         if (!f->chain_cache) {
                 r = -ENOMEM;
@@ -3404,6 +4066,9 @@ int journal_file_open(
                 if (r < 0)
                         goto fail;
 
+                /* We'll see every data object of this file, hence we can build the bloom filter for it */
+                f->data_bloom = malloc0(DATA_BLOOM_SIZE);
+
 #if HAVE_GCRYPT
                 r = journal_file_append_first_tag(f);
                 if (r < 0)
@@ -3441,6 +4106,87 @@ fail:
         return r;
 }
 
+int journal_file_prepare_standby(JournalFile *f, bool compress, bool seal) {
+        _cleanup_free_ char *p = NULL;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(f);
+
+        /* Creates an empty journal file next to f, with the header, hash tables and first tag already set up, so
+         * that rotating f later on only needs a rename(). */
+
+        if (f->standby)
+                return 0;
+
+        if (!f->writable)
+                return -EINVAL;
+
+        if (path_startswith(f->path, "/proc/self/fd"))
+                return -EINVAL;
+
+        if (!endswith(f->path, ".journal"))
+                return -EINVAL;
+
+        p = journal_file_standby_path(f->path);
+        if (!p)
+                return -ENOMEM;
+
+        /* Might be left over from a previous instance */
+        if (unlink(p) < 0 && errno != ENOENT)
+                return -errno;
+
+        fd = open(p, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC|O_NOCTTY, f->mode);
+        if (fd < 0)
+                return -errno;
+
+        /* We pass the fd rather than the name, since the latter has no .journal suffix. The file inherits the
+         * metrics and the sequence number ID from f. */
+        r = journal_file_open(fd, NULL, f->flags, f->mode, compress, seal, NULL, f->mmap, NULL, f, &f->standby);
+        if (r < 0) {
+                (void) unlink(p);
+                return r;
+        }
+
+        fd = -1;
+
+        log_debug("Prepared standby file for %s.", f->path);
+        return 0;
+}
+
+static int journal_file_take_standby(JournalFile *f, JournalFile **ret) {
+        _cleanup_free_ char *p = NULL, *path = NULL;
+        JournalFile *standby;
+
+        assert(f);
+        assert(ret);
+
+        if (!f->standby)
+                return -ENOENT;
+
+        p = journal_file_standby_path(f->path);
+        path = strdup(f->path);
+        if (!p || !path)
+                return -ENOMEM;
+
+        if (rename(p, f->path) < 0)
+                return -errno;
+
+        standby = f->standby;
+        f->standby = NULL;
+
+        /* Continue the sequence numbers where the predecessor stopped. The rest of the header is final already,
+         * only the creation time is refreshed for the sake of vacuuming. */
+        standby->header->seqnum_id = f->header->seqnum_id;
+        standby->header->tail_entry_seqnum = f->header->tail_entry_seqnum;
+        fd_setcrtime(standby->fd, 0);
+
+        free_and_replace(standby->path, path);
+
+        *ret = standby;
+        return 0;
+}
+
 int journal_file_rotate(JournalFile **f, bool compress, bool seal, Set *deferred_closes) {
         _cleanup_free_ char *p = NULL;
         size_t l;
@@ -3495,7 +4241,15 @@ int journal_file_rotate(JournalFile **f, bool compress, bool seal, Set *deferred
          * we archive them */
         old_file->defrag_on_close = true;
 
-        r = journal_file_open(-1, old_file->path, old_file->flags, old_file->mode, compress, seal, NULL, old_file->mmap, deferred_closes, old_file, &new_file);
+        r = journal_file_take_standby(old_file, &new_file);
+        if (r < 0) {
+                if (r != -ENOENT)
+                        log_debug_errno(r, "Failed to use standby file for %s, creating a new one: %m", old_file->path);
+
+                journal_file_drop_standby(old_file);
+
+                r = journal_file_open(-1, old_file->path, old_file->flags, old_file->mode, compress, seal, NULL, old_file->mmap, deferred_closes, old_file, &new_file);
+        }
 
         if (deferred_closes &&
             set_put(deferred_closes, old_file) >= 0)
@@ -3615,7 +4369,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return -E2BIG;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
                         size_t rsize = 0;
 
                         r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
@@ -3635,7 +4389,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 if (r < 0)
                         return r;
 
-                xor_hash ^= le64toh(u->data.hash);
+                xor_hash ^= to->keyed_hash ? hash64(data, l) : le64toh(u->data.hash);
                 items[i].object_offset = htole64(h);
                 items[i].hash = u->data.hash;
 
@@ -3823,6 +4577,35 @@ int journal_file_get_cutoff_monotonic_usec(JournalFile *f, sd_id128_t boot_id, u
         return 1;
 }
 
+bool journal_file_standby_suggested(JournalFile *f, usec_t max_file_usec) {
+        assert(f);
+        assert(f->header);
+
+        /* Suggests preparing a standby file once f is half way towards one of the limits that usually cause
+         * rotation, i.e. the file size, the fill level of the data hash table and the file age. */
+
+        if (f->standby || !f->writable)
+                return false;
+
+        if (f->metrics.max_size > 0 &&
+            le64toh(f->header->header_size) + le64toh(f->header->arena_size) > f->metrics.max_size / 2)
+                return true;
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
+            le64toh(f->header->n_data) * 8ULL > (le64toh(f->header->data_hash_table_size) / sizeof(HashItem)) * 3ULL)
+                return true;
+
+        if (max_file_usec > 0) {
+                usec_t h;
+
+                h = le64toh(f->header->head_entry_realtime);
+                if (h > 0 && now(CLOCK_REALTIME) > h + max_file_usec / 2)
+                        return true;
+        }
+
+        return false;
+}
+
 bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec) {
         assert(f);
         assert(f->header);
@@ -3862,6 +4645,22 @@ bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec) {
                         return true;
                 }
 
+        /* If one of the hash chains got too long, lookups and insertions get slow. Since the hash tables
+         * cannot be resized in place, starting a new file with freshly sized tables is the remedy. */
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth) &&
+            le64toh(f->header->data_hash_chain_depth) > HASH_CHAIN_DEPTH_MAX) {
+                log_debug("Data hash table of %s has deepest hash chain of length %"PRIu64", suggesting rotation.",
+                          f->path, le64toh(f->header->data_hash_chain_depth));
+                return true;
+        }
+
+        if (JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth) &&
+            le64toh(f->header->field_hash_chain_depth) > HASH_CHAIN_DEPTH_MAX) {
+                log_debug("Field hash table of %s has deepest hash chain of length %"PRIu64", suggesting rotation.",
+                          f->path, le64toh(f->header->field_hash_chain_depth));
+                return true;
+        }
+
         /* Are the data objects properly indexed by field objects? */
         if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
             JOURNAL_HEADER_CONTAINS(f->header, n_fields) &&
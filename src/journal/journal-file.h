@@ -74,6 +74,15 @@ typedef enum OfflineState {
         OFFLINE_DONE
 } OfflineState;
 
+typedef struct EntryArraySegment {
+        uint64_t array;         /* offset of the entry array object */
+        uint64_t begin;         /* offset of its first entry */
+        uint64_t total;         /* number of entries in all arrays before this one */
+        uint64_t n;             /* number of entries in this array */
+        uint64_t last_seqnum;   /* seqnum and realtime of its last entry */
+        uint64_t last_realtime;
+} EntryArraySegment;
+
 typedef struct JournalFile {
         int fd;
         MMapFileDescriptor *cache_fd;
@@ -85,7 +94,9 @@ typedef struct JournalFile {
         bool writable:1;
         bool compress_xz:1;
         bool compress_lz4:1;
+        bool compress_zstd:1;
         bool seal:1;
+        bool keyed_hash:1;
         bool defrag_on_close:1;
         bool close_fd:1;
         bool archive:1;
@@ -95,6 +106,7 @@ typedef struct JournalFile {
         direction_t last_direction;
         LocationType location_type;
         uint64_t last_n_entries;
+        unsigned location_prioq_idx;
 
         char *path;
         struct stat last_stat;
@@ -118,11 +130,26 @@ typedef struct JournalFile {
         usec_t post_change_timer_period;
 
         OrderedHashmap *chain_cache;
+        unsigned chain_cache_max;
+        unsigned chain_cache_hit, chain_cache_missed;
+
+        uint32_t *data_hash_filter;
+
+        EntryArraySegment *entry_array_index;
+        size_t n_entry_array_index, n_entry_array_index_allocated;
+
+        uint64_t *data_bloom;
+        uint64_t n_data_bloom;
+        bool data_bloom_loaded;
 
         pthread_t offline_thread;
         volatile OfflineState offline_state;
 
-#if HAVE_XZ || HAVE_LZ4
+        /* A fully initialized, empty file that journal_file_rotate() renames into place instead of creating
+         * a new one */
+        struct JournalFile *standby;
+
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         void *compress_buffer;
         size_t compress_buffer_size;
 #endif
@@ -142,6 +169,8 @@ typedef struct JournalFile {
 
         void *fsprg_seed;
         size_t fsprg_seed_size;
+
+        void *fsprg_msk; /* master secret key derived from the seed, cached for seeking */
 #endif
 } JournalFile;
 
@@ -208,8 +237,16 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_COMPRESSED_LZ4(h) \
         (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
 
+#define JOURNAL_HEADER_COMPRESSED_ZSTD(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+
+#define JOURNAL_HEADER_KEYED_HASH(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_KEYED_HASH))
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret);
 
+uint64_t journal_file_hash_data(JournalFile *f, const void *data, size_t sz);
+
 uint64_t journal_file_entry_n_items(Object *o) _pure_;
 uint64_t journal_file_entry_array_n_items(Object *o) _pure_;
 uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
@@ -217,8 +254,17 @@ uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
 int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqno, Object **ret, uint64_t *offset);
 
+typedef struct JournalAppendItem {
+        dual_timestamp ts;
+        const struct iovec *iovec;
+        unsigned n_iovec;
+} JournalAppendItem;
+
+int journal_file_append_entries(JournalFile *f, const JournalAppendItem batch[], unsigned n_batch, uint64_t *seqno, unsigned *ret_n_appended);
+
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
+bool journal_file_may_contain_data(JournalFile *f, const void *data, uint64_t size, uint64_t hash);
 
 int journal_file_find_field_object(JournalFile *f, const void *field, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_field_object_with_hash(JournalFile *f, const void *field, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
@@ -245,6 +291,7 @@ void journal_file_dump(JournalFile *f);
 void journal_file_print_header(JournalFile *f);
 
 int journal_file_rotate(JournalFile **f, bool compress, bool seal, Set *deferred_closes);
+int journal_file_prepare_standby(JournalFile *f, bool compress, bool seal);
 
 void journal_file_post_change(JournalFile *f);
 int journal_file_enable_post_change_timer(JournalFile *f, sd_event *e, usec_t t);
@@ -256,11 +303,15 @@ int journal_file_get_cutoff_realtime_usec(JournalFile *f, usec_t *from, usec_t *
 int journal_file_get_cutoff_monotonic_usec(JournalFile *f, sd_id128_t boot, usec_t *from, usec_t *to);
 
 bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec);
+bool journal_file_standby_suggested(JournalFile *f, usec_t max_file_usec);
+
+void journal_file_set_chain_cache_max(JournalFile *f, unsigned n);
+void journal_file_drop_caches(JournalFile *f);
 
 int journal_file_map_data_hash_table(JournalFile *f);
 int journal_file_map_field_hash_table(JournalFile *f);
 
 static inline bool JOURNAL_FILE_COMPRESS(JournalFile *f) {
         assert(f);
-        return f->compress_xz || f->compress_lz4;
+        return f->compress_xz || f->compress_lz4 || f->compress_zstd;
 }
@@ -27,15 +27,18 @@
 #include "sd-id128.h"
 #include "sd-journal.h"
 
+#include "catalog.h"
 #include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
 typedef struct Location Location;
 typedef struct Directory Directory;
+typedef struct DataCacheEntry DataCacheEntry;
 
 typedef enum MatchType {
         MATCH_DISCRETE,
@@ -74,6 +77,11 @@ struct Location {
         sd_id128_t boot_id;
 
         uint64_t xor_hash;
+
+        /* Where the entry was found last time, only a hint */
+        bool offset_set;
+        sd_id128_t file_id;
+        uint64_t offset;
 };
 
 struct Directory {
@@ -108,6 +116,7 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        Set *unique_hashes; /* Hashes of the values returned so far */
 
         /* Iterating through known fields */
         JournalFile *fields_file;
@@ -131,6 +140,24 @@ struct sd_journal {
 
         size_t data_threshold;
 
+        /* Recently decompressed data objects, most recently used first */
+        Hashmap *data_cache;
+        LIST_HEAD(DataCacheEntry, data_cache_lru);
+        DataCacheEntry *data_cache_lru_tail;
+        size_t data_cache_size, data_cache_max;
+        unsigned data_cache_hit, data_cache_missed;
+
+        /* The catalog database, kept mapped for sd_journal_get_catalog() */
+        CatalogCache *catalog_cache;
+
+        unsigned n_matches;
+
+        /* Files with a candidate entry, ordered by the location of that entry in the current direction */
+        Prioq *files_by_location;
+        direction_t files_by_location_direction;
+        bool files_by_location_valid;
+        unsigned chain_cache_hit, chain_cache_missed;
+
         Hashmap *directories_by_path;
         Hashmap *directories_by_wd;
 
@@ -139,6 +166,7 @@ struct sd_journal {
 
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
+void journal_get_chain_cache_stats(sd_journal *j, unsigned *ret_hit, unsigned *ret_missed);
 
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
@@ -27,6 +27,8 @@
 #include "alloc-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
@@ -35,6 +37,11 @@
 #include "util.h"
 #include "xattr-util.h"
 
+/* Determining whether an archived file is empty and when it was created requires opening it. Since archived files
+ * are never modified, we record what we found out about them in an index file in the directory, so that we don't
+ * have to do that again on the next run, as long as the inode, size and modification time still match. */
+#define VACUUM_INDEX ".vacuum-index"
+
 struct vacuum_info {
         uint64_t usage;
         char *filename;
@@ -44,8 +51,22 @@ struct vacuum_info {
         sd_id128_t seqnum_id;
         uint64_t seqnum;
         bool have_seqnum;
+
+        bool deleted;
+
+        uint64_t inode;
+        uint64_t size;
+        nsec_t mtime;
 };
 
+typedef struct VacuumIndexEntry {
+        uint64_t inode;
+        uint64_t size;
+        nsec_t mtime;
+        uint64_t realtime;
+        char filename[];
+} VacuumIndexEntry;
+
 static int vacuum_compare(const void *_a, const void *_b) {
         const struct vacuum_info *a, *b;
 
@@ -143,6 +164,109 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
+static int vacuum_index_load(int dir_fd, Hashmap **ret) {
+        _cleanup_(hashmap_free_freep) Hashmap *h = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        char line[LINE_MAX];
+        int fd, r;
+
+        assert(dir_fd >= 0);
+        assert(ret);
+
+        fd = openat(dir_fd, VACUUM_INDEX, O_RDONLY|O_CLOEXEC|O_NOFOLLOW);
+        if (fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        f = fdopen(fd, "re");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        h = hashmap_new(&string_hash_ops);
+        if (!h)
+                return -ENOMEM;
+
+        FOREACH_LINE(line, f, return -errno) {
+                uint64_t inode, size, mtime, realtime;
+                VacuumIndexEntry *e;
+                char *fn;
+                int k = 0;
+
+                if (IN_SET(line[0], '#', '\n'))
+                        continue;
+
+                if (sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %n", &inode, &size, &mtime, &realtime, &k) != 4 || k <= 0)
+                        continue;
+
+                fn = strstrip(line + k);
+                if (!filename_is_valid(fn))
+                        continue;
+
+                e = malloc(offsetof(VacuumIndexEntry, filename) + strlen(fn) + 1);
+                if (!e)
+                        return -ENOMEM;
+
+                e->inode = inode;
+                e->size = size;
+                e->mtime = mtime;
+                e->realtime = realtime;
+                strcpy(e->filename, fn);
+
+                r = hashmap_put(h, e->filename, e);
+                if (r <= 0) {
+                        free(e);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret = h;
+        h = NULL;
+
+        return 0;
+}
+
+static int vacuum_index_save(const char *directory, const struct vacuum_info *list, unsigned n_list) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *t = NULL;
+        const char *fn;
+        unsigned i;
+        int r;
+
+        assert(directory);
+
+        fn = strjoina(directory, "/" VACUUM_INDEX);
+
+        r = fopen_temporary(fn, &f, &t);
+        if (r < 0)
+                return r;
+
+        (void) fchmod(fileno(f), 0640);
+
+        fputs("# Inode, size, mtime and creation time of archived journal files, used for vacuuming\n", f);
+
+        for (i = 0; i < n_list; i++)
+                if (!list[i].deleted)
+                        fprintf(f, "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %s\n",
+                                list[i].inode, list[i].size, list[i].mtime, list[i].realtime, list[i].filename);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(t, fn) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return r;
+}
+
 int journal_directory_vacuum(
                 const char *directory,
                 uint64_t max_use,
@@ -151,9 +275,11 @@ int journal_directory_vacuum(
                 usec_t *oldest_usec,
                 bool verbose) {
 
+        _cleanup_(hashmap_free_freep) Hashmap *index = NULL;
         _cleanup_closedir_ DIR *d = NULL;
         struct vacuum_info *list = NULL;
-        unsigned n_list = 0, i, n_active_files = 0;
+        unsigned n_list = 0, i, n_active_files = 0, n_indexed = 0;
+        bool index_dirty = false;
         size_t n_allocated = 0;
         uint64_t sum = 0, freed = 0;
         usec_t retention_limit = 0;
@@ -178,10 +304,15 @@ int journal_directory_vacuum(
         if (!d)
                 return -errno;
 
+        r = vacuum_index_load(dirfd(d), &index);
+        if (r < 0)
+                log_debug_errno(r, "Failed to read vacuum index of %s, ignoring: %m", directory);
+
         FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
 
                 unsigned long long seqnum = 0, realtime;
                 _cleanup_free_ char *p = NULL;
+                VacuumIndexEntry *e;
                 sd_id128_t seqnum_id;
                 bool have_seqnum;
                 uint64_t size;
@@ -196,6 +327,9 @@ int journal_directory_vacuum(
                 if (!S_ISREG(st.st_mode))
                         continue;
 
+                if (streq(de->d_name, VACUUM_INDEX))
+                        continue;
+
                 q = strlen(de->d_name);
 
                 if (endswith(de->d_name, ".journal")) {
@@ -270,39 +404,59 @@ int journal_directory_vacuum(
 
                 size = 512UL * (uint64_t) st.st_blocks;
 
-                r = journal_file_empty(dirfd(d), p);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
-                        continue;
-                }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
+                e = hashmap_get(index, p);
+                if (e)
+                        n_indexed++;
+
+                if (e &&
+                    e->inode == (uint64_t) st.st_ino &&
+                    e->size == (uint64_t) st.st_size &&
+                    e->mtime == timespec_load_nsec(&st.st_mtim))
+                        /* We looked at this file before, and it didn't change since. Files are only ever indexed
+                         * if they are not empty. */
+                        realtime = e->realtime;
+                else {
+                        index_dirty = true;
+
+                        r = journal_file_empty(dirfd(d), p);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
+                                continue;
+                        }
+                        if (r > 0) {
+                                /* Always vacuum empty non-online files. */
 
-                        if (unlinkat(dirfd(d), p, 0) >= 0) {
+                                if (unlinkat(dirfd(d), p, 0) >= 0) {
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, format_bytes(sbytes, sizeof(sbytes), size));
+                                        log_full(verbose ? LOG_INFO : LOG_DEBUG,
+                                                 "Deleted empty archived journal %s/%s (%s).", directory, p, format_bytes(sbytes, sizeof(sbytes), size));
 
-                                freed += size;
-                        } else if (errno != ENOENT)
-                                log_warning_errno(errno, "Failed to delete empty archived journal %s/%s: %m", directory, p);
+                                        freed += size;
+                                } else if (errno != ENOENT)
+                                        log_warning_errno(errno, "Failed to delete empty archived journal %s/%s: %m", directory, p);
 
-                        continue;
-                }
+                                continue;
+                        }
 
-                patch_realtime(dirfd(d), p, &st, &realtime);
+                        patch_realtime(dirfd(d), p, &st, &realtime);
+                }
 
                 if (!GREEDY_REALLOC(list, n_allocated, n_list + 1)) {
                         r = -ENOMEM;
                         goto finish;
                 }
 
-                list[n_list].filename = p;
-                list[n_list].usage = size;
-                list[n_list].seqnum = seqnum;
-                list[n_list].realtime = realtime;
-                list[n_list].seqnum_id = seqnum_id;
-                list[n_list].have_seqnum = have_seqnum;
+                list[n_list] = (struct vacuum_info) {
+                        .filename = p,
+                        .usage = size,
+                        .seqnum = seqnum,
+                        .realtime = realtime,
+                        .seqnum_id = seqnum_id,
+                        .have_seqnum = have_seqnum,
+                        .inode = st.st_ino,
+                        .size = st.st_size,
+                        .mtime = timespec_load_nsec(&st.st_mtim),
+                };
                 n_list++;
 
                 p = NULL;
@@ -330,13 +484,23 @@ int journal_directory_vacuum(
                         else
                                 sum = 0;
 
-                } else if (errno != ENOENT)
+                        list[i].deleted = true;
+                } else if (errno == ENOENT)
+                        list[i].deleted = true;
+                else
                         log_warning_errno(errno, "Failed to delete archived journal %s/%s: %m", directory, list[i].filename);
         }
 
         if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
                 *oldest_usec = list[i].realtime;
 
+        /* Update the index if we learnt something new, deleted something, or if it refers to files that are gone */
+        if (index_dirty || i > 0 || n_indexed < hashmap_size(index)) {
+                r = vacuum_index_save(directory, list, n_list);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to write vacuum index of %s, ignoring: %m", directory);
+        }
+
         r = 0;
 
 finish:
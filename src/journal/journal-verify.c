@@ -32,7 +32,6 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-verify.h"
-#include "lookup3.h"
 #include "macro.h"
 #include "terminal-util.h"
 #include "util.h"
@@ -135,7 +134,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
          * possible field values. It does not follow any references to
          * other objects. */
 
-        if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
+        if ((o->object.flags & OBJECT_COMPRESSION_MASK) &&
             o->object.type != OBJECT_DATA) {
                 error(offset, "Found compressed object that isn't of type DATA, which is not allowed.");
                 return -EBADMSG;
@@ -179,9 +178,9 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                                 return r;
                         }
 
-                        h2 = hash64(b, b_size);
+                        h2 = journal_file_hash_data(f, b, b_size);
                 } else
-                        h2 = hash64(o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload));
+                        h2 = journal_file_hash_data(f, o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload));
 
                 if (h1 != h2) {
                         error(offset, "Invalid hash (%08"PRIx64" vs. %08"PRIx64, h1, h2);
@@ -941,8 +940,8 @@ int journal_file_verify(
                         goto fail;
                 }
 
-                if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
-                    (o->object.flags & OBJECT_COMPRESSED_LZ4)) {
+                if (!IN_SET(o->object.flags & OBJECT_COMPRESSION_MASK,
+                            0, OBJECT_COMPRESSED_XZ, OBJECT_COMPRESSED_LZ4, OBJECT_COMPRESSED_ZSTD)) {
                         error(p, "Objected with double compression");
                         r = -EINVAL;
                         goto fail;
@@ -960,6 +959,12 @@ int journal_file_verify(
                         goto fail;
                 }
 
+                if ((o->object.flags & OBJECT_COMPRESSED_ZSTD) && !JOURNAL_HEADER_COMPRESSED_ZSTD(f->header)) {
+                        error(p, "ZSTD compressed object in file without ZSTD compression");
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
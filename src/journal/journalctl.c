@@ -32,6 +32,7 @@
 #include <string.h>
 #include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "sd-bus.h"
@@ -50,6 +51,7 @@
 #include "glob-util.h"
 #include "hostname-util.h"
 #include "io-util.h"
+#include "journal-boot-index.h"
 #include "journal-def.h"
 #include "journal-internal.h"
 #include "journal-qrcode.h"
@@ -1133,7 +1135,7 @@ static int discover_next_boot(sd_journal *j,
         return 0;
 }
 
-static int get_boots(
+static int get_boots_by_seeking(
                 sd_journal *j,
                 BootId **boots,
                 sd_id128_t *boot_id,
@@ -1255,6 +1257,79 @@ finish:
         return count;
 }
 
+static int get_boots(
+                sd_journal *j,
+                BootId **boots,
+                sd_id128_t *boot_id,
+                int offset) {
+
+        _cleanup_free_ JournalBoot *list = NULL;
+        BootId *head = NULL, *tail = NULL;
+        size_t n, k;
+        int r;
+
+        assert(j);
+
+        /* Read the boots from the _BOOT_ID data objects of the journal files (or the boot index in the
+         * journal directories), which is much quicker than stepping through the journal from boot to boot.
+         * Only if some file doesn't let us do that, do it the slow way. */
+        r = journal_get_boots(j, &list, &n);
+        if (r == -ENODATA) {
+                log_debug("Failed to find boots in journal files directly, seeking through the journal instead.");
+                return get_boots_by_seeking(j, boots, boot_id, offset);
+        }
+        if (r < 0)
+                return r;
+
+        if (boot_id) {
+                ssize_t idx;
+
+                /* Adjust for the asymmetry that offset 0 is the last (and current) boot, while 1 is considered
+                 * the (chronological) first boot in the journal. */
+                if (sd_id128_is_null(*boot_id))
+                        idx = offset <= 0 ? (ssize_t) n - 1 + offset : offset - 1;
+                else {
+                        for (k = 0; k < n; k++)
+                                if (sd_id128_equal(list[k].id, *boot_id))
+                                        break;
+                        if (k >= n)
+                                return 0;
+
+                        idx = (ssize_t) k + offset;
+                }
+
+                if (idx < 0 || (size_t) idx >= n)
+                        return 0;
+
+                *boot_id = list[idx].id;
+                return 1;
+        }
+
+        for (k = 0; k < n; k++) {
+                BootId *id;
+
+                id = new0(BootId, 1);
+                if (!id) {
+                        boot_id_free_all(head);
+                        return -ENOMEM;
+                }
+
+                id->id = list[k].id;
+                id->first = list[k].first;
+                id->last = list[k].last;
+
+                LIST_INSERT_AFTER(boot_list, head, tail, id);
+                tail = id;
+        }
+
+        if (boots)
+                *boots = head;
+        else
+                boot_id_free_all(head);
+
+        return (int) n;
+}
+
 static int list_boots(sd_journal *j) {
         int w, i, count;
         BootId *id, *all_ids;
@@ -1779,48 +1854,127 @@ finish:
 #endif
 }
 
+static int verify_one(JournalFile *f, bool show_progress) {
+        usec_t first = 0, validated = 0, last = 0;
+        int k;
+
+        assert(f);
+
+#if HAVE_GCRYPT
+        if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
+                log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
+#endif
+
+        k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, show_progress);
+        if (k == -EINVAL)
+                /* If the key was invalid give up right-away. */
+                return k;
+        else if (k < 0)
+                log_warning_errno(k, "FAIL: %s (%m)", f->path);
+        else {
+                char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
+                log_info("PASS: %s", f->path);
+
+                if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
+                        if (validated > 0) {
+                                log_info("=> Validated from %s to %s, final %s entries not sealed.",
+                                         format_timestamp_maybe_utc(a, sizeof(a), first),
+                                         format_timestamp_maybe_utc(b, sizeof(b), validated),
+                                         format_timespan(c, sizeof(c), last > validated ? last - validated : 0, 0));
+                        } else if (last > 0)
+                                log_info("=> No sealing yet, %s of entries not sealed.",
+                                         format_timespan(c, sizeof(c), last - first, 0));
+                        else
+                                log_info("=> No sealing yet, no entries in file.");
+                }
+        }
+
+        return k;
+}
+
+static int verify_wait(unsigned *n_running) {
+        siginfo_t status = {};
+
+        assert(n_running);
+        assert(*n_running > 0);
+
+        /* Waits for one of the verification workers to finish, and returns its result. The workers exit with the
+         * (positive) errno of a failed verification. */
+
+        if (waitid(P_ALL, 0, &status, WEXITED) < 0) {
+                *n_running = 0;
+                return log_error_errno(errno, "Failed to wait for verification workers: %m");
+        }
+
+        (*n_running)--;
+
+        if (status.si_code != CLD_EXITED) {
+                log_error("Verification worker " PID_FMT " terminated abnormally.", status.si_pid);
+                return -EPROTO;
+        }
+
+        return -status.si_status;
+}
+
 static int verify(sd_journal *j) {
-        int r = 0;
+        unsigned n_jobs, n_running = 0;
+        int r = 0, k;
         Iterator i;
         JournalFile *f;
+        long ncpus;
 
         assert(j);
 
         log_show_color(true);
 
-        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
-                int k;
-                usec_t first = 0, validated = 0, last = 0;
+        /* Verifying is CPU bound, and files are independent of each other. Hence, if there are multiple files,
+         * verify them in parallel, one worker process per CPU. */
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_jobs = (unsigned) MIN((long) ordered_hashmap_size(j->files), MAX(ncpus, 1L));
+
+        if (n_jobs <= 1) {
+                ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                        k = verify_one(f, true);
+                        if (k == -EINVAL)
+                                return k;
+                        if (k < 0)
+                                r = k;
+                }
 
-#if HAVE_GCRYPT
-                if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
-                        log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
-#endif
+                return r;
+        }
 
-                k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, true);
-                if (k == -EINVAL) {
-                        /* If the key was invalid give up right-away. */
-                        return k;
-                } else if (k < 0) {
-                        log_warning_errno(k, "FAIL: %s (%m)", f->path);
-                        r = k;
-                } else {
-                        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
-                        log_info("PASS: %s", f->path);
-
-                        if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
-                                if (validated > 0) {
-                                        log_info("=> Validated from %s to %s, final %s entries not sealed.",
-                                                 format_timestamp_maybe_utc(a, sizeof(a), first),
-                                                 format_timestamp_maybe_utc(b, sizeof(b), validated),
-                                                 format_timespan(c, sizeof(c), last > validated ? last - validated : 0, 0));
-                                } else if (last > 0)
-                                        log_info("=> No sealing yet, %s of entries not sealed.",
-                                                 format_timespan(c, sizeof(c), last - first, 0));
-                                else
-                                        log_info("=> No sealing yet, no entries in file.");
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                pid_t pid;
+
+                if (n_running >= n_jobs) {
+                        k = verify_wait(&n_running);
+                        if (k == -EINVAL) {
+                                r = k;
+                                break;
                         }
+                        if (k < 0)
+                                r = k;
+                }
+
+                pid = fork();
+                if (pid < 0) {
+                        r = log_error_errno(errno, "Failed to fork verification worker: %m");
+                        break;
+                }
+                if (pid == 0) {
+                        /* The progress bars of multiple workers would overwrite each other, hence don't show any */
+                        k = verify_one(f, false);
+                        _exit(k < 0 ? -k : EXIT_SUCCESS);
                 }
+
+                n_running++;
+        }
+
+        while (n_running > 0) {
+                k = verify_wait(&n_running);
+                if (k < 0 && r != -EINVAL)
+                        r = k;
         }
 
         return r;
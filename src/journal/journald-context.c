@@ -18,6 +18,8 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <sys/inotify.h>
+
 #if HAVE_SELINUX
 #include <selinux/selinux.h>
 #endif
@@ -62,6 +64,14 @@
  *    stream connection. This should improve cases where a service process logs immediately before exiting and we
  *    previously had trouble associating the log message with the service.
  *
+ * Metadata derived from the cgroup of a client (the unit, slice, session, invocation ID, maximum log level and extra log
+ * fields) is kept in a second-level cache indexed by the cgroup path, which is shared by all client entries referencing
+ * that cgroup. The unit name, slice and session are determined from the cgroup path alone, and hence never change for
+ * a cgroup entry. The rest is read from the files PID 1 exports in /run/systemd/units/, which we watch with inotify:
+ * whenever one of these files changes the entries for the unit in question are refreshed the next time they are
+ * used. If we can't watch that directory we fall back to refreshing entries once per second. Cgroup entries are
+ * released as soon as the last client entry referencing them is flushed out.
+ *
  * NB: With and without the metadata cache: the implicitly added entry metadata in the journal (with the exception of
  *     UID/PID/GID and SELinux label) must be understood as possibly slightly out of sync (i.e. sometimes slighly older
  *     and sometimes slightly newer than what was current at the log event).
@@ -78,6 +88,106 @@
  * clients itself is limited.) */
 #define CACHE_MAX (16*1024)
 
+#define UNITS_DIR "/run/systemd/units"
+
+static CgroupContext* cgroup_context_free(Server *s, CgroupContext *g) {
+        assert(s);
+
+        if (!g)
+                return NULL;
+
+        if (g->cgroup)
+                assert_se(hashmap_remove(s->cgroup_contexts, g->cgroup) == g);
+
+        free(g->cgroup);
+        free(g->session);
+        free(g->unit);
+        free(g->user_unit);
+        free(g->slice);
+        free(g->user_slice);
+        free(g->extra_fields_iovec);
+        free(g->extra_fields_data);
+
+        return mfree(g);
+}
+
+static CgroupContext* cgroup_context_unref(Server *s, CgroupContext *g) {
+        assert(s);
+
+        if (!g)
+                return NULL;
+
+        assert(g->n_ref > 0);
+
+        g->n_ref--;
+        if (g->n_ref > 0)
+                return NULL;
+
+        return cgroup_context_free(s, g);
+}
+
+static int cgroup_context_new(Server *s, char *cgroup, const char *unit_id, CgroupContext **ret) {
+        CgroupContext *g;
+        int r;
+
+        assert(s);
+        assert(cgroup || unit_id);
+        assert(ret);
+
+        /* Takes possession of the cgroup path passed in, even on failure. If no cgroup path is known, an entry that is
+         * not indexed and not shared is created for the unit passed in. */
+
+        if (cgroup) {
+                r = hashmap_ensure_allocated(&s->cgroup_contexts, &string_hash_ops);
+                if (r < 0) {
+                        free(cgroup);
+                        return r;
+                }
+        }
+
+        g = new0(CgroupContext, 1);
+        if (!g) {
+                free(cgroup);
+                return -ENOMEM;
+        }
+
+        g->n_ref = 1;
+        g->timestamp = USEC_INFINITY;
+        g->owner_uid = UID_INVALID;
+        g->extra_fields_mtime = NSEC_INFINITY;
+        g->log_level_max = -1;
+
+        if (cgroup) {
+                g->cgroup = cgroup;
+
+                r = hashmap_put(s->cgroup_contexts, g->cgroup, g);
+                if (r < 0) {
+                        g->cgroup = mfree(g->cgroup);
+                        cgroup_context_free(s, g);
+                        return r;
+                }
+
+                (void) cg_path_get_session(g->cgroup, &g->session);
+
+                if (cg_path_get_owner_uid(g->cgroup, &g->owner_uid) < 0)
+                        g->owner_uid = UID_INVALID;
+
+                (void) cg_path_get_unit(g->cgroup, &g->unit);
+                (void) cg_path_get_user_unit(g->cgroup, &g->user_unit);
+                (void) cg_path_get_slice(g->cgroup, &g->slice);
+                (void) cg_path_get_user_slice(g->cgroup, &g->user_slice);
+        } else {
+                g->unit = strdup(unit_id);
+                if (!g->unit) {
+                        cgroup_context_free(s, g);
+                        return -ENOMEM;
+                }
+        }
+
+        *ret = g;
+        return 0;
+}
+
 static int client_context_compare(const void *a, const void *b) {
         const ClientContext *x = a, *y = b;
 
@@ -120,11 +230,8 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         c->gid = GID_INVALID;
         c->auditid = AUDIT_SESSION_INVALID;
         c->loginuid = UID_INVALID;
-        c->owner_uid = UID_INVALID;
         c->lru_index = PRIOQ_IDX_NULL;
         c->timestamp = USEC_INFINITY;
-        c->extra_fields_mtime = NSEC_INFINITY;
-        c->log_level_max = -1;
 
         r = hashmap_put(s->client_contexts, PID_TO_PTR(pid), c);
         if (r < 0) {
@@ -136,7 +243,8 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         return 0;
 }
 
-static void client_context_reset(ClientContext *c) {
+static void client_context_reset(Server *s, ClientContext *c) {
+        assert(s);
         assert(c);
 
         c->timestamp = USEC_INFINITY;
@@ -152,25 +260,10 @@ static void client_context_reset(ClientContext *c) {
         c->auditid = AUDIT_SESSION_INVALID;
         c->loginuid = UID_INVALID;
 
-        c->cgroup = mfree(c->cgroup);
-        c->session = mfree(c->session);
-        c->owner_uid = UID_INVALID;
-        c->unit = mfree(c->unit);
-        c->user_unit = mfree(c->user_unit);
-        c->slice = mfree(c->slice);
-        c->user_slice = mfree(c->user_slice);
-
-        c->invocation_id = SD_ID128_NULL;
-
         c->label = mfree(c->label);
         c->label_size = 0;
 
-        c->extra_fields_iovec = mfree(c->extra_fields_iovec);
-        c->extra_fields_n_iovec = 0;
-        c->extra_fields_data = mfree(c->extra_fields_data);
-        c->extra_fields_mtime = NSEC_INFINITY;
-
-        c->log_level_max = -1;
+        c->cgroup_context = cgroup_context_unref(s, c->cgroup_context);
 }
 
 static ClientContext* client_context_free(Server *s, ClientContext *c) {
@@ -184,7 +277,7 @@ static ClientContext* client_context_free(Server *s, ClientContext *c) {
         if (c->in_lru)
                 assert_se(prioq_remove(s->client_contexts_lru, c, &c->lru_index) >= 0);
 
-        client_context_reset(c);
+        client_context_reset(s, c);
 
         return mfree(c);
 }
@@ -260,91 +353,42 @@ static int client_context_read_label(
         return 0;
 }
 
-static int client_context_read_cgroup(Server *s, ClientContext *c, const char *unit_id) {
-        char *t = NULL;
-        int r;
-
-        assert(c);
-
-        /* Try to acquire the current cgroup path */
-        r = cg_pid_get_path_shifted(c->pid, s->cgroup_root, &t);
-        if (r < 0) {
-
-                /* If that didn't work, we use the unit ID passed in as fallback, if we have nothing cached yet */
-                if (unit_id && !c->unit) {
-                        c->unit = strdup(unit_id);
-                        if (c->unit)
-                                return 0;
-                }
-
-                return r;
-        }
-
-        /* Let's shortcut this if the cgroup path didn't change */
-        if (streq_ptr(c->cgroup, t)) {
-                free(t);
-                return 0;
-        }
-
-        free_and_replace(c->cgroup, t);
-
-        (void) cg_path_get_session(c->cgroup, &t);
-        free_and_replace(c->session, t);
-
-        if (cg_path_get_owner_uid(c->cgroup, &c->owner_uid) < 0)
-                c->owner_uid = UID_INVALID;
-
-        (void) cg_path_get_unit(c->cgroup, &t);
-        free_and_replace(c->unit, t);
-
-        (void) cg_path_get_user_unit(c->cgroup, &t);
-        free_and_replace(c->user_unit, t);
-
-        (void) cg_path_get_slice(c->cgroup, &t);
-        free_and_replace(c->slice, t);
-
-        (void) cg_path_get_user_slice(c->cgroup, &t);
-        free_and_replace(c->user_slice, t);
-
-        return 0;
-}
-
-static int client_context_read_invocation_id(
+static int cgroup_context_read_invocation_id(
                 Server *s,
-                ClientContext *c) {
+                CgroupContext *g) {
 
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r;
 
         assert(s);
-        assert(c);
+        assert(g);
 
         /* Read the invocation ID of a unit off a unit. PID 1 stores it in a per-unit symlink in /run/systemd/units/ */
 
-        if (!c->unit)
+        if (!g->unit)
                 return 0;
 
-        p = strjoina("/run/systemd/units/invocation:", c->unit);
+        p = strjoina(UNITS_DIR "/invocation:", g->unit);
         r = readlink_malloc(p, &value);
         if (r < 0)
                 return r;
 
-        return sd_id128_from_string(value, &c->invocation_id);
+        return sd_id128_from_string(value, &g->invocation_id);
 }
 
-static int client_context_read_log_level_max(
+static int cgroup_context_read_log_level_max(
                 Server *s,
-                ClientContext *c) {
+                CgroupContext *g) {
 
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r, ll;
 
-        if (!c->unit)
+        if (!g->unit)
                 return 0;
 
-        p = strjoina("/run/systemd/units/log-level-max:", c->unit);
+        p = strjoina(UNITS_DIR "/log-level-max:", g->unit);
         r = readlink_malloc(p, &value);
         if (r < 0)
                 return r;
@@ -353,13 +397,13 @@ static int client_context_read_log_level_max(
         if (ll < 0)
                 return -EINVAL;
 
-        c->log_level_max = ll;
+        g->log_level_max = ll;
         return 0;
 }
 
-static int client_context_read_extra_fields(
+static int cgroup_context_read_extra_fields(
                 Server *s,
-                ClientContext *c) {
+                CgroupContext *g) {
 
         size_t size = 0, n_iovec = 0, n_allocated = 0, left;
         _cleanup_free_ struct iovec *iovec = NULL;
@@ -370,12 +414,12 @@ static int client_context_read_extra_fields(
         uint8_t *q;
         int r;
 
-        if (!c->unit)
+        if (!g->unit)
                 return 0;
 
-        p = strjoina("/run/systemd/units/log-extra-fields:", c->unit);
+        p = strjoina(UNITS_DIR "/log-extra-fields:", g->unit);
 
-        if (c->extra_fields_mtime != NSEC_INFINITY) {
+        if (g->extra_fields_mtime != NSEC_INFINITY) {
                 if (stat(p, &st) < 0) {
                         if (errno == ENOENT)
                                 return 0;
@@ -383,7 +427,7 @@ static int client_context_read_extra_fields(
                         return -errno;
                 }
 
-                if (timespec_load_nsec(&st.st_mtim) == c->extra_fields_mtime)
+                if (timespec_load_nsec(&st.st_mtim) == g->extra_fields_mtime)
                         return 0;
         }
 
@@ -436,13 +480,13 @@ static int client_context_read_extra_fields(
                 left -= n, q += n;
         }
 
-        free(c->extra_fields_iovec);
-        free(c->extra_fields_data);
+        free(g->extra_fields_iovec);
+        free(g->extra_fields_data);
 
-        c->extra_fields_iovec = iovec;
-        c->extra_fields_n_iovec = n_iovec;
-        c->extra_fields_data = data;
-        c->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
+        g->extra_fields_iovec = iovec;
+        g->extra_fields_n_iovec = n_iovec;
+        g->extra_fields_data = data;
+        g->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
 
         iovec = NULL;
         data = NULL;
@@ -450,6 +494,79 @@ static int client_context_read_extra_fields(
         return 0;
 }
 
+static void cgroup_context_maybe_refresh(
+                Server *s,
+                CgroupContext *g,
+                usec_t timestamp) {
+
+        assert(s);
+        assert(g);
+
+        /* Entries we can't get change notifications for are refreshed once per second, the others only if the
+         * exported unit data changed since we last read it. */
+        if (g->timestamp != USEC_INFINITY) {
+                if (g->cgroup && s->units_watch_fd >= 0)
+                        return;
+
+                if (g->timestamp + REFRESH_USEC >= timestamp)
+                        return;
+        }
+
+        (void) cgroup_context_read_invocation_id(s, g);
+        (void) cgroup_context_read_log_level_max(s, g);
+        (void) cgroup_context_read_extra_fields(s, g);
+
+        g->timestamp = timestamp;
+}
+
+static int client_context_read_cgroup(Server *s, ClientContext *c, const char *unit_id, usec_t timestamp) {
+        CgroupContext *g;
+        char *t = NULL;
+        int r;
+
+        assert(c);
+
+        /* Try to acquire the current cgroup path */
+        r = cg_pid_get_path_shifted(c->pid, s->cgroup_root, &t);
+        if (r < 0) {
+
+                /* If that didn't work, we use the unit ID passed in as fallback, if we have nothing cached yet */
+                if (unit_id && !c->cgroup_context) {
+                        if (cgroup_context_new(s, NULL, unit_id, &c->cgroup_context) >= 0)
+                                r = 0;
+                }
+
+                if (c->cgroup_context)
+                        cgroup_context_maybe_refresh(s, c->cgroup_context, timestamp);
+
+                return r;
+        }
+
+        /* Let's shortcut this if the cgroup path didn't change */
+        if (c->cgroup_context && streq_ptr(c->cgroup_context->cgroup, t)) {
+                free(t);
+                cgroup_context_maybe_refresh(s, c->cgroup_context, timestamp);
+                return 0;
+        }
+
+        /* Share the entry with all other clients in the same cgroup, if there is one already */
+        g = hashmap_get(s->cgroup_contexts, t);
+        if (g) {
+                free(t);
+                g->n_ref++;
+        } else {
+                r = cgroup_context_new(s, t, NULL, &g);
+                if (r < 0)
+                        return r;
+        }
+
+        cgroup_context_unref(s, c->cgroup_context);
+        c->cgroup_context = g;
+
+        cgroup_context_maybe_refresh(s, g, timestamp);
+        return 0;
+}
+
 static void client_context_really_refresh(
                 Server *s,
                 ClientContext *c,
@@ -472,10 +589,7 @@ static void client_context_really_refresh(
         (void) audit_session_from_pid(c->pid, &c->auditid);
         (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
 
-        (void) client_context_read_cgroup(s, c, unit_id);
-        (void) client_context_read_invocation_id(s, c);
-        (void) client_context_read_log_level_max(s, c);
-        (void) client_context_read_extra_fields(s, c);
+        (void) client_context_read_cgroup(s, c, unit_id, timestamp);
 
         c->timestamp = timestamp;
 
@@ -506,7 +620,7 @@ void client_context_maybe_refresh(
         /* If the data isn't pinned and if the cashed data is older than the upper limit, we flush it out
          * entirely. This follows the logic that as long as an entry is pinned the PID reuse is unlikely. */
         if (c->n_ref == 0 && c->timestamp + MAX_USEC < timestamp) {
-                client_context_reset(c);
+                client_context_reset(s, c);
                 goto refresh;
         }
 
@@ -565,9 +679,11 @@ void client_context_flush_all(Server *s) {
 
         assert(prioq_size(s->client_contexts_lru) == 0);
         assert(hashmap_size(s->client_contexts) == 0);
+        assert(hashmap_size(s->cgroup_contexts) == 0);
 
         s->client_contexts_lru = prioq_free(s->client_contexts_lru);
         s->client_contexts = hashmap_free(s->client_contexts);
+        s->cgroup_contexts = hashmap_free(s->cgroup_contexts);
 }
 
 static int client_context_get_internal(
@@ -706,3 +822,109 @@ void client_context_acquire_default(Server *s) {
 
         }
 }
+
+static void cgroup_context_invalidate_unit(Server *s, const char *unit) {
+        CgroupContext *g;
+        Iterator i;
+
+        assert(s);
+
+        /* Marks the entries of the specified unit as outdated, or all entries if no unit is specified. They'll be
+         * refreshed the next time they are used. */
+
+        HASHMAP_FOREACH(g, s->cgroup_contexts, i)
+                if (!unit || streq_ptr(g->unit, unit))
+                        g->timestamp = USEC_INFINITY;
+}
+
+static int dispatch_units_watch(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+        assert(fd == s->units_watch_fd);
+
+        for (;;) {
+                union inotify_event_buffer buffer;
+                struct inotify_event *e;
+                ssize_t l;
+
+                l = read(fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (IN_SET(errno, EAGAIN, EINTR))
+                                return 0;
+
+                        /* Don't trust the cached data anymore, and fall back to polling */
+                        log_warning_errno(errno, "Failed to read " UNITS_DIR " inotify events, polling instead: %m");
+
+                        s->units_watch_event_source = sd_event_source_unref(s->units_watch_event_source);
+                        s->units_watch_fd = safe_close(s->units_watch_fd);
+
+                        cgroup_context_invalidate_unit(s, NULL);
+                        return 0;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+                        const char *unit;
+
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                cgroup_context_invalidate_unit(s, NULL);
+                                continue;
+                        }
+
+                        if (e->len <= 0)
+                                continue;
+
+                        unit = startswith(e->name, "invocation:");
+                        if (!unit)
+                                unit = startswith(e->name, "log-level-max:");
+                        if (!unit)
+                                unit = startswith(e->name, "log-extra-fields:");
+                        if (!unit)
+                                continue;
+
+                        cgroup_context_invalidate_unit(s, unit);
+                }
+        }
+}
+
+int client_context_watch_units(Server *s) {
+        int r;
+
+        assert(s);
+        assert(s->units_watch_fd < 0);
+
+        /* PID 1 exports the invocation ID, maximum log level and extra log fields of each unit in /run/systemd/units/.
+         * Watch the directory, so that we know when to refresh the cached data. If this fails we'll poll the files
+         * instead. */
+
+        s->units_watch_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (s->units_watch_fd < 0)
+                return log_warning_errno(errno, "Failed to create inotify watch, ignoring: %m");
+
+        if (inotify_add_watch(s->units_watch_fd, UNITS_DIR, IN_CREATE|IN_DELETE|IN_MOVED_TO|IN_ONLYDIR) < 0) {
+                r = log_warning_errno(errno, "Failed to watch " UNITS_DIR ", ignoring: %m");
+                goto fail;
+        }
+
+        r = sd_event_add_io(s->event, &s->units_watch_event_source, s->units_watch_fd, EPOLLIN, dispatch_units_watch, s);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to register " UNITS_DIR " inotify watch in event loop, ignoring: %m");
+                goto fail;
+        }
+
+        /* Process changes before any log messages that are generated afterwards */
+        r = sd_event_source_set_priority(s->units_watch_event_source, SD_EVENT_PRIORITY_IMPORTANT-10);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to adjust priority of " UNITS_DIR " inotify event source, ignoring: %m");
+                goto fail;
+        }
+
+        /* Anything we cached so far might be outdated already */
+        cgroup_context_invalidate_unit(s, NULL);
+        return 0;
+
+fail:
+        s->units_watch_event_source = sd_event_source_unref(s->units_watch_event_source);
+        s->units_watch_fd = safe_close(s->units_watch_fd);
+        return r;
+}
@@ -26,26 +26,15 @@
 #include "sd-id128.h"
 
 typedef struct ClientContext ClientContext;
+typedef struct CgroupContext CgroupContext;
 
 #include "journald-server.h"
 
-struct ClientContext {
+/* Metadata derived from the cgroup of a client, and from the unit owning it. This is shared between all clients in the
+ * same cgroup. */
+struct CgroupContext {
         unsigned n_ref;
-        unsigned lru_index;
         usec_t timestamp;
-        bool in_lru;
-
-        pid_t pid;
-        uid_t uid;
-        gid_t gid;
-
-        char *comm;
-        char *exe;
-        char *cmdline;
-        char *capeff;
-
-        uint32_t auditid;
-        uid_t loginuid;
 
         char *cgroup;
         char *session;
@@ -59,9 +48,6 @@ struct ClientContext {
 
         sd_id128_t invocation_id;
 
-        char *label;
-        size_t label_size;
-
         int log_level_max;
 
         struct iovec *extra_fields_iovec;
@@ -70,6 +56,30 @@ struct ClientContext {
         nsec_t extra_fields_mtime;
 };
 
+struct ClientContext {
+        unsigned n_ref;
+        unsigned lru_index;
+        usec_t timestamp;
+        bool in_lru;
+
+        pid_t pid;
+        uid_t uid;
+        gid_t gid;
+
+        char *comm;
+        char *exe;
+        char *cmdline;
+        char *capeff;
+
+        uint32_t auditid;
+        uid_t loginuid;
+
+        char *label;
+        size_t label_size;
+
+        CgroupContext *cgroup_context;
+};
+
 int client_context_get(
                 Server *s,
                 pid_t pid,
@@ -99,16 +109,22 @@ void client_context_maybe_refresh(
 void client_context_acquire_default(Server *s);
 void client_context_flush_all(Server *s);
 
+int client_context_watch_units(Server *s);
+
+static inline const char *client_context_unit(const ClientContext *c) {
+        return c && c->cgroup_context ? c->cgroup_context->unit : NULL;
+}
+
 static inline size_t client_context_extra_fields_n_iovec(const ClientContext *c) {
-        return c ? c->extra_fields_n_iovec : 0;
+        return c && c->cgroup_context ? c->cgroup_context->extra_fields_n_iovec : 0;
 }
 
 static inline bool client_context_test_priority(const ClientContext *c, int priority) {
-        if (!c)
+        if (!c || !c->cgroup_context)
                 return true;
 
-        if (c->log_level_max < 0)
+        if (c->cgroup_context->log_level_max < 0)
                 return true;
 
-        return LOG_PRI(priority) <= c->log_level_max;
+        return LOG_PRI(priority) <= c->cgroup_context->log_level_max;
 }
@@ -75,7 +75,8 @@ static void server_process_entry_meta(
                  p[17] >= '0' && p[17] <= '9')
                 *priority = (*priority & LOG_PRIMASK) | (((p[16] - '0')*10 + (p[17] - '0')) << 3);
 
-        else if (l >= 19 &&
+        else if (identifier &&
+                 l >= 19 &&
                  startswith(p, "SYSLOG_IDENTIFIER=")) {
                 char *t;
 
@@ -85,7 +86,8 @@ static void server_process_entry_meta(
                         *identifier = t;
                 }
 
-        } else if (l >= 8 &&
+        } else if (message &&
+                   l >= 8 &&
                    startswith(p, "MESSAGE=")) {
                 char *t;
 
@@ -126,10 +128,14 @@ static int server_process_entry(
         int priority = LOG_INFO;
         pid_t object_pid = 0;
         const char *p;
+        bool forward;
         int r = 0;
 
         p = buffer;
 
+        /* The message and identifier are only needed for forwarding, don't copy them out otherwise */
+        forward = s->forward_to_syslog || s->forward_to_kmsg || s->forward_to_console || s->forward_to_wall;
+
         while (*remaining > 0) {
                 const char *e, *q;
 
@@ -181,8 +187,8 @@ static int server_process_entry(
 
                                 server_process_entry_meta(p, l, ucred,
                                                           &priority,
-                                                          &identifier,
-                                                          &message,
+                                                          forward ? &identifier : NULL,
+                                                          forward ? &message : NULL,
                                                           &object_pid);
                         }
 
@@ -229,8 +235,8 @@ static int server_process_entry(
 
                                 server_process_entry_meta(k, (e - p) + 1 + l, ucred,
                                                           &priority,
-                                                          &identifier,
-                                                          &message,
+                                                          forward ? &identifier : NULL,
+                                                          forward ? &message : NULL,
                                                           &object_pid);
                         } else
                                 free(k);
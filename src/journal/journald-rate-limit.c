@@ -25,13 +25,11 @@
 #include "hashmap.h"
 #include "journald-rate-limit.h"
 #include "list.h"
-#include "random-util.h"
 #include "string-util.h"
 #include "util.h"
 
 #define POOLS_MAX 5
-#define BUCKETS_MAX 127
-#define GROUPS_MAX 2047
+#define GROUPS_MAX (16*1024-1)
 
 static const int priority_map[] = {
         [LOG_EMERG]   = 0,
@@ -58,9 +56,9 @@ struct JournalRateLimitGroup {
 
         char *id;
         JournalRateLimitPool pools[POOLS_MAX];
-        uint64_t hash;
 
-        LIST_FIELDS(JournalRateLimitGroup, bucket);
+        uint64_t n_suppressed;
+
         LIST_FIELDS(JournalRateLimitGroup, lru);
 };
 
@@ -68,12 +66,15 @@ struct JournalRateLimit {
         usec_t interval;
         unsigned burst;
 
-        JournalRateLimitGroup* buckets[BUCKETS_MAX];
+        /* Groups indexed by their ID, and ordered by last use, most recently used first */
+        Hashmap *groups;
         JournalRateLimitGroup *lru, *lru_tail;
 
-        unsigned n_groups;
+        /* The burst value modulated with the available disk space, for the last value passed in */
+        uint64_t modulated_available;
+        unsigned modulated_burst;
 
-        uint8_t hash_key[16];
+        uint64_t n_suppressed;
 };
 
 JournalRateLimit *journal_rate_limit_new(usec_t interval, unsigned burst) {
@@ -87,8 +88,11 @@ JournalRateLimit *journal_rate_limit_new(usec_t interval, unsigned burst) {
 
         r->interval = interval;
         r->burst = burst;
+        r->modulated_available = UINT64_MAX;
 
-        random_bytes(r->hash_key, sizeof(r->hash_key));
+        r->groups = hashmap_new(&string_hash_ops);
+        if (!r->groups)
+                return mfree(r);
 
         return r;
 }
@@ -97,15 +101,11 @@ static void journal_rate_limit_group_free(JournalRateLimitGroup *g) {
         assert(g);
 
         if (g->parent) {
-                assert(g->parent->n_groups > 0);
-
                 if (g->parent->lru_tail == g)
                         g->parent->lru_tail = g->lru_prev;
 
                 LIST_REMOVE(lru, g->parent->lru, g);
-                LIST_REMOVE(bucket, g->parent->buckets[g->hash % BUCKETS_MAX], g);
-
-                g->parent->n_groups--;
+                assert_se(hashmap_remove(g->parent->groups, g->id) == g);
         }
 
         free(g->id);
@@ -118,6 +118,7 @@ void journal_rate_limit_free(JournalRateLimit *r) {
         while (r->lru)
                 journal_rate_limit_group_free(r->lru);
 
+        hashmap_free(r->groups);
         free(r);
 }
 
@@ -137,16 +138,17 @@ static void journal_rate_limit_vacuum(JournalRateLimit *r, usec_t ts) {
         assert(r);
 
         /* Makes room for at least one new item, but drop all
-         * expored items too. */
+         * expired items too. As groups are moved to the front of the
+         * LRU list whenever they are used, expired ones collect at
+         * the end, hence it is sufficient to look there. */
 
-        while (r->n_groups >= GROUPS_MAX ||
+        while (hashmap_size(r->groups) >= GROUPS_MAX ||
                (r->lru_tail && journal_rate_limit_group_expired(r->lru_tail, ts)))
                 journal_rate_limit_group_free(r->lru_tail);
 }
 
 static JournalRateLimitGroup* journal_rate_limit_group_new(JournalRateLimit *r, const char *id, usec_t ts) {
         JournalRateLimitGroup *g;
-        struct siphash state;
 
         assert(r);
         assert(id);
@@ -159,17 +161,14 @@ static JournalRateLimitGroup* journal_rate_limit_group_new(JournalRateLimit *r,
         if (!g->id)
                 goto fail;
 
-        siphash24_init(&state, r->hash_key);
-        string_hash_func(g->id, &state);
-        g->hash = siphash24_finalize(&state);
-
         journal_rate_limit_vacuum(r, ts);
 
-        LIST_PREPEND(bucket, r->buckets[g->hash % BUCKETS_MAX], g);
+        if (hashmap_put(r->groups, g->id, g) < 0)
+                goto fail;
+
         LIST_PREPEND(lru, r->lru, g);
         if (!g->lru_next)
                 r->lru_tail = g;
-        r->n_groups++;
 
         g->parent = r;
         return g;
@@ -207,12 +206,25 @@ static unsigned burst_modulate(unsigned burst, uint64_t available) {
         return burst;
 }
 
+static void journal_rate_limit_group_touch(JournalRateLimit *r, JournalRateLimitGroup *g) {
+        assert(r);
+        assert(g);
+
+        /* Moves the group to the front of the LRU list */
+
+        if (r->lru == g)
+                return;
+
+        if (r->lru_tail == g)
+                r->lru_tail = g->lru_prev;
+
+        LIST_REMOVE(lru, r->lru, g);
+        LIST_PREPEND(lru, r->lru, g);
+}
+
 int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, uint64_t available) {
-        uint64_t h;
         JournalRateLimitGroup *g;
         JournalRateLimitPool *p;
-        struct siphash state;
-        unsigned burst;
         usec_t ts;
 
         assert(id);
@@ -230,20 +242,19 @@ int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, u
         if (r->interval == 0 || r->burst == 0)
                 return 1;
 
-        burst = burst_modulate(r->burst, available);
+        /* The available disk space is only updated every now and then, hence remember the burst we calculated
+         * for it */
+        if (available != r->modulated_available) {
+                r->modulated_burst = burst_modulate(r->burst, available);
+                r->modulated_available = available;
+        }
 
         ts = now(CLOCK_MONOTONIC);
 
-        siphash24_init(&state, r->hash_key);
-        string_hash_func(id, &state);
-        h = siphash24_finalize(&state);
-        g = r->buckets[h % BUCKETS_MAX];
-
-        LIST_FOREACH(bucket, g, g)
-                if (streq(g->id, id))
-                        break;
-
-        if (!g) {
+        g = hashmap_get(r->groups, id);
+        if (g)
+                journal_rate_limit_group_touch(r, g);
+        else {
                 g = journal_rate_limit_group_new(r, id, ts);
                 if (!g)
                         return -ENOMEM;
@@ -269,11 +280,29 @@ int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, u
                 return 1 + s;
         }
 
-        if (p->num < burst) {
+        if (p->num < r->modulated_burst) {
                 p->num++;
                 return 1;
         }
 
         p->suppressed++;
+        g->n_suppressed++;
+        r->n_suppressed++;
         return 0;
 }
+
+uint64_t journal_rate_limit_get_suppressed(JournalRateLimit *r, const char *id) {
+        JournalRateLimitGroup *g;
+
+        /* Returns the number of messages suppressed in total, or for the specified group, as long as we still track
+         * it */
+
+        if (!r)
+                return 0;
+
+        if (!id)
+                return r->n_suppressed;
+
+        g = hashmap_get(r->groups, id);
+        return g ? g->n_suppressed : 0;
+}
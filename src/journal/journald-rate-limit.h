@@ -27,3 +27,4 @@ typedef struct JournalRateLimit JournalRateLimit;
 JournalRateLimit *journal_rate_limit_new(usec_t interval, unsigned burst);
 void journal_rate_limit_free(JournalRateLimit *r);
 int journal_rate_limit_test(JournalRateLimit *r, const char *id, int priority, uint64_t available);
+uint64_t journal_rate_limit_get_suppressed(JournalRateLimit *r, const char *id);
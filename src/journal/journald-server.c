@@ -78,6 +78,10 @@
 #define USER_JOURNALS_MAX 1024
 
 #define DEFAULT_SYNC_INTERVAL_USEC (5*USEC_PER_MINUTE)
+
+/* High priority messages are synced to disk right away, but not more often than this */
+#define SYNC_MERGE_WINDOW_MIN_USEC (1*USEC_PER_MSEC)
+#define SYNC_MERGE_WINDOW_MAX_USEC (100*USEC_PER_MSEC)
 #define DEFAULT_RATE_LIMIT_INTERVAL (30*USEC_PER_SEC)
 #define DEFAULT_RATE_LIMIT_BURST 1000
 #define DEFAULT_MAX_FILE_USEC USEC_PER_MONTH
@@ -93,6 +97,19 @@
  * for a bit of additional metadata. */
 #define DEFAULT_LINE_MAX (48*1024)
 
+/* The number of datagrams we read from one socket per event loop iteration at most */
+#define DATAGRAMS_PER_WAKEUP_MAX 16
+#define DATAGRAM_BATCH_MAX DATAGRAMS_PER_WAKEUP_MAX
+
+/* The number of entries we copy from /run to /var per event loop iteration while flushing */
+#define FLUSH_ENTRIES_PER_ITERATION 1024U
+
+static int server_flush_step(Server *s, unsigned max);
+
+/* Syslog and audit datagrams larger than this are truncated. RFC 5426 only requires receivers to take 2048 bytes,
+ * and audit messages are bounded by MAX_AUDIT_MESSAGE_LENGTH. */
+#define DATAGRAM_BATCH_SLOT_SIZE (64U*1024U)
+
 static int determine_path_usage(Server *s, const char *path, uint64_t *ret_used, uint64_t *ret_free) {
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
@@ -476,6 +493,11 @@ void server_rotate(Server *s) {
 
         log_debug("Rotating...");
 
+        /* Finish a flush in progress first, unless we are called from it. The runtime journal goes away then
+         * anyway. */
+        if (s->flush_journal && !s->flushing)
+                (void) server_flush_step(s, UINT_MAX);
+
         (void) do_rotate(s, &s->runtime_journal, "runtime", false, 0);
         (void) do_rotate(s, &s->system_journal, "system", s->seal, 0);
 
@@ -496,11 +518,68 @@ void server_rotate(Server *s) {
                 }
 }
 
+static void server_prepare_standby(Server *s, JournalFile *f, bool seal) {
+        int r;
+
+        assert(s);
+
+        if (!f || !journal_file_standby_suggested(f, s->max_file_usec))
+                return;
+
+        r = journal_file_prepare_standby(f, s->compress, seal);
+        if (r < 0)
+                log_warning_errno(r, "Failed to prepare standby file for %s, ignoring: %m", f->path);
+}
+
+static int dispatch_standby_event(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
+        JournalFile *f;
+        Iterator i;
+
+        assert(s);
+
+        server_prepare_standby(s, s->runtime_journal, false);
+        server_prepare_standby(s, s->system_journal, s->seal);
+
+        ORDERED_HASHMAP_FOREACH(f, s->user_journals, i)
+                server_prepare_standby(s, f, s->seal);
+
+        return 0;
+}
+
+static void server_schedule_standby(Server *s, JournalFile *f) {
+        int r;
+
+        assert(s);
+        assert(f);
+
+        /* Setting up a new journal file is costly, hence do it ahead of time when we are idle, instead of when the
+         * old file needs to be rotated. */
+
+        if (!journal_file_standby_suggested(f, s->max_file_usec))
+                return;
+
+        if (!s->standby_event_source) {
+                r = sd_event_add_defer(s->event, &s->standby_event_source, dispatch_standby_event, s);
+                if (r >= 0)
+                        r = sd_event_source_set_priority(s->standby_event_source, SD_EVENT_PRIORITY_IDLE);
+        } else
+                r = sd_event_source_set_enabled(s->standby_event_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                log_debug_errno(r, "Failed to schedule preparing a standby journal file, ignoring: %m");
+}
+
 void server_sync(Server *s) {
         JournalFile *f;
         Iterator i;
+        usec_t start, d;
         int r;
 
+        /* Note that this only initiates taking the files offline, which happens in a thread, but first waits for
+         * syncs still in progress from the last time. If the disk is slow, this is where we notice. Files that
+         * didn't change since the last sync are already offline and are skipped quickly. */
+        start = now(CLOCK_MONOTONIC);
+
         if (s->system_journal) {
                 r = journal_file_set_offline(s->system_journal, false);
                 if (r < 0)
@@ -520,6 +599,16 @@ void server_sync(Server *s) {
         }
 
         s->sync_scheduled = false;
+
+        s->sync_timestamp = now(CLOCK_MONOTONIC);
+        d = s->sync_timestamp - start;
+
+        /* Exponentially weighted moving average, new samples count 1/8 */
+        s->sync_latency_usec = s->n_syncs == 0 ? d : (s->sync_latency_usec * 7 + d) / 8;
+
+        s->n_syncs++;
+        s->sync_total_usec += d;
+        s->sync_max_usec = MAX(s->sync_max_usec, d);
 }
 
 static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
@@ -698,6 +787,7 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, unsigned
         r = journal_file_append_entry(f, &ts, iovec, n, &s->seqnum, NULL, NULL);
         if (r >= 0) {
                 server_schedule_sync(s, priority);
+                server_schedule_standby(s, f);
                 return;
         }
 
@@ -761,6 +851,7 @@ static void dispatch_message_real(
                 pid_t object_pid) {
 
         char source_time[sizeof("_SOURCE_REALTIME_TIMESTAMP=") + DECIMAL_STR_MAX(usec_t)];
+        const CgroupContext *g;
         uid_t journal_uid;
         ClientContext *o;
 
@@ -787,19 +878,22 @@ static void dispatch_message_real(
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->auditid, uint32_t, audit_session_is_valid, "%" PRIu32, "_AUDIT_SESSION");
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->loginuid, uid_t, uid_is_valid, UID_FMT, "_AUDIT_LOGINUID");
 
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->cgroup, "_SYSTEMD_CGROUP");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->session, "_SYSTEMD_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->owner_uid, uid_t, uid_is_valid, UID_FMT, "_SYSTEMD_OWNER_UID");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->unit, "_SYSTEMD_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_unit, "_SYSTEMD_USER_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->slice, "_SYSTEMD_SLICE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_slice, "_SYSTEMD_USER_SLICE");
-
-                IOVEC_ADD_ID128_FIELD(iovec, n, c->invocation_id, "_SYSTEMD_INVOCATION_ID");
-
-                if (c->extra_fields_n_iovec > 0) {
-                        memcpy(iovec + n, c->extra_fields_iovec, c->extra_fields_n_iovec * sizeof(struct iovec));
-                        n += c->extra_fields_n_iovec;
+                g = c->cgroup_context;
+                if (g) {
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->cgroup, "_SYSTEMD_CGROUP");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->session, "_SYSTEMD_SESSION");
+                        IOVEC_ADD_NUMERIC_FIELD(iovec, n, g->owner_uid, uid_t, uid_is_valid, UID_FMT, "_SYSTEMD_OWNER_UID");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->unit, "_SYSTEMD_UNIT");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->user_unit, "_SYSTEMD_USER_UNIT");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->slice, "_SYSTEMD_SLICE");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->user_slice, "_SYSTEMD_USER_SLICE");
+
+                        IOVEC_ADD_ID128_FIELD(iovec, n, g->invocation_id, "_SYSTEMD_INVOCATION_ID");
+
+                        if (g->extra_fields_n_iovec > 0) {
+                                memcpy(iovec + n, g->extra_fields_iovec, g->extra_fields_n_iovec * sizeof(struct iovec));
+                                n += g->extra_fields_n_iovec;
+                        }
                 }
         }
 
@@ -821,15 +915,18 @@ static void dispatch_message_real(
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->auditid, uint32_t, audit_session_is_valid, "%" PRIu32, "OBJECT_AUDIT_SESSION");
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->loginuid, uid_t, uid_is_valid, UID_FMT, "OBJECT_AUDIT_LOGINUID");
 
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->cgroup, "OBJECT_SYSTEMD_CGROUP");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->session, "OBJECT_SYSTEMD_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->owner_uid, uid_t, uid_is_valid, UID_FMT, "OBJECT_SYSTEMD_OWNER_UID");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->unit, "OBJECT_SYSTEMD_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->user_unit, "OBJECT_SYSTEMD_USER_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->slice, "OBJECT_SYSTEMD_SLICE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->user_slice, "OBJECT_SYSTEMD_USER_SLICE");
-
-                IOVEC_ADD_ID128_FIELD(iovec, n, o->invocation_id, "OBJECT_SYSTEMD_INVOCATION_ID=");
+                g = o->cgroup_context;
+                if (g) {
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->cgroup, "OBJECT_SYSTEMD_CGROUP");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->session, "OBJECT_SYSTEMD_SESSION");
+                        IOVEC_ADD_NUMERIC_FIELD(iovec, n, g->owner_uid, uid_t, uid_is_valid, UID_FMT, "OBJECT_SYSTEMD_OWNER_UID");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->unit, "OBJECT_SYSTEMD_UNIT");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->user_unit, "OBJECT_SYSTEMD_USER_UNIT");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->slice, "OBJECT_SYSTEMD_SLICE");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, g->user_slice, "OBJECT_SYSTEMD_USER_SLICE");
+
+                        IOVEC_ADD_ID128_FIELD(iovec, n, g->invocation_id, "OBJECT_SYSTEMD_INVOCATION_ID=");
+                }
         }
 
         assert(n <= m);
@@ -856,13 +953,13 @@ static void dispatch_message_real(
         if (s->split_mode == SPLIT_UID && c && uid_is_valid(c->uid))
                 /* Split up strictly by (non-root) UID */
                 journal_uid = c->uid;
-        else if (s->split_mode == SPLIT_LOGIN && c && c->uid > 0 && uid_is_valid(c->owner_uid))
+        else if (s->split_mode == SPLIT_LOGIN && c && c->uid > 0 && c->cgroup_context && uid_is_valid(c->cgroup_context->owner_uid))
                 /* Split up by login UIDs.  We do this only if the
                  * realuid is not root, in order not to accidentally
                  * leak privileged information to the user that is
                  * logged by a privileged process that is part of an
                  * unprivileged session. */
-                journal_uid = c->owner_uid;
+                journal_uid = c->cgroup_context->owner_uid;
         else
                 journal_uid = 0;
 
@@ -927,6 +1024,7 @@ void server_dispatch_message(
                 pid_t object_pid) {
 
         uint64_t available = 0;
+        const char *unit;
         int rl;
 
         assert(s);
@@ -943,10 +1041,11 @@ void server_dispatch_message(
         if (s->storage == STORAGE_NONE)
                 return;
 
-        if (c && c->unit) {
+        unit = client_context_unit(c);
+        if (unit) {
                 (void) determine_space(s, &available, NULL);
 
-                rl = journal_rate_limit_test(s->rate_limit, c->unit, priority & LOG_PRIMASK, available);
+                rl = journal_rate_limit_test(s->rate_limit, unit, priority & LOG_PRIMASK, available);
                 if (rl == 0)
                         return;
 
@@ -954,7 +1053,7 @@ void server_dispatch_message(
                 if (rl > 1)
                         server_driver_message(s, c->pid,
                                               "MESSAGE_ID=" SD_MESSAGE_JOURNAL_DROPPED_STR,
-                                              LOG_MESSAGE("Suppressed %i messages from %s", rl - 1, c->unit),
+                                              LOG_MESSAGE("Suppressed %i messages from %s", rl - 1, unit),
                                               "N_DROPPED=%i", rl - 1,
                                               NULL);
         }
@@ -962,52 +1061,81 @@ void server_dispatch_message(
         dispatch_message_real(s, iovec, n, m, c, tv, priority, object_pid);
 }
 
-int server_flush_to_var(Server *s, bool require_flag_file) {
-        sd_id128_t machine;
-        sd_journal *j = NULL;
-        char ts[FORMAT_TIMESPAN_MAX];
-        usec_t start;
-        unsigned n = 0;
+static void server_flush_notify(Server *s) {
         int r;
 
         assert(s);
 
-        if (!IN_SET(s->storage, STORAGE_AUTO, STORAGE_PERSISTENT))
-                return 0;
+        /* If the flush was explicitly requested, let the requester know that it is complete */
 
-        if (!s->runtime_journal)
-                return 0;
+        if (!s->flush_requested)
+                return;
 
-        if (require_flag_file && !flushed_flag_is_set())
-                return 0;
+        s->flush_requested = false;
 
-        (void) system_journal_open(s, true);
+        server_sync(s);
+        server_vacuum(s, false);
 
-        if (!s->system_journal)
-                return 0;
+        r = touch("/run/systemd/journal/flushed");
+        if (r < 0)
+                log_warning_errno(r, "Failed to touch /run/systemd/journal/flushed, ignoring: %m");
 
-        log_debug("Flushing to /var...");
+        server_space_usage_message(s, NULL);
+}
 
-        start = now(CLOCK_MONOTONIC);
+static void server_flush_finish(Server *s, int r) {
+        char ts[FORMAT_TIMESPAN_MAX];
 
-        r = sd_id128_get_machine(&machine);
-        if (r < 0)
-                return r;
+        assert(s);
 
-        r = sd_journal_open(&j, SD_JOURNAL_RUNTIME_ONLY);
-        if (r < 0)
-                return log_error_errno(r, "Failed to read runtime journal: %m");
+        if (s->system_journal)
+                journal_file_post_change(s->system_journal);
 
-        sd_journal_set_data_threshold(j, 0);
+        s->runtime_journal = journal_file_close(s->runtime_journal);
+
+        if (r >= 0)
+                (void) rm_rf("/run/log/journal", REMOVE_ROOT);
+
+        sd_journal_close(s->flush_journal);
+        s->flush_journal = NULL;
+        s->flush_event_source = sd_event_source_unref(s->flush_event_source);
 
-        SD_JOURNAL_FOREACH(j) {
+        server_driver_message(s, 0, NULL,
+                              LOG_MESSAGE("Time spent on flushing to /var is %s for %u entries.",
+                                          format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - s->flush_timestamp, 0),
+                                          s->n_flushed),
+                              NULL);
+
+        server_flush_notify(s);
+}
+
+static int server_flush_step(Server *s, unsigned max) {
+        sd_journal *j;
+        unsigned i;
+        int r = 0;
+
+        assert(s);
+        assert(s->flush_journal);
+
+        /* Copies up to the specified number of entries from the runtime journal to the system journal. Returns > 0
+         * if the flush is complete, in which case the runtime journal is closed, and 0 otherwise. */
+
+        j = s->flush_journal;
+        s->flushing = true;
+
+        for (i = 0; i < max; i++) {
                 Object *o = NULL;
                 JournalFile *f;
 
+                if (sd_journal_next(j) <= 0) {
+                        r = 0;
+                        goto finish;
+                }
+
                 f = j->current_file;
                 assert(f && f->current_offset > 0);
 
-                n++;
+                s->n_flushed++;
 
                 r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
                 if (r < 0) {
@@ -1041,98 +1169,116 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
                 }
         }
 
-        r = 0;
+        s->flushing = false;
+        return 0;
 
 finish:
-        journal_file_post_change(s->system_journal);
+        s->flushing = false;
+        server_flush_finish(s, r);
+        return 1;
+}
 
-        s->runtime_journal = journal_file_close(s->runtime_journal);
+static int dispatch_flush_event(sd_event_source *es, void *userdata) {
+        Server *s = userdata;
 
-        if (r >= 0)
-                (void) rm_rf("/run/log/journal", REMOVE_ROOT);
+        assert(s);
 
-        sd_journal_close(j);
+        (void) server_flush_step(s, FLUSH_ENTRIES_PER_ITERATION);
+        return 0;
+}
 
-        server_driver_message(s, 0, NULL,
-                              LOG_MESSAGE("Time spent on flushing to /var is %s for %u entries.",
-                                          format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 0),
-                                          n),
-                              NULL);
+int server_flush_to_var(Server *s, bool require_flag_file) {
+        sd_journal *j = NULL;
+        int r;
 
-        return r;
-}
+        assert(s);
 
-int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
-        Server *s = userdata;
-        struct ucred *ucred = NULL;
-        struct timeval *tv = NULL;
-        struct cmsghdr *cmsg;
-        char *label = NULL;
-        size_t label_len = 0, m;
-        struct iovec iovec;
-        ssize_t n;
-        int *fds = NULL, v = 0;
-        unsigned n_fds = 0;
+        if (!IN_SET(s->storage, STORAGE_AUTO, STORAGE_PERSISTENT))
+                return 0;
 
-        union {
-                struct cmsghdr cmsghdr;
-
-                /* We use NAME_MAX space for the SELinux label
-                 * here. The kernel currently enforces no
-                 * limit, but according to suggestions from
-                 * the SELinux people this will change and it
-                 * will probably be identical to NAME_MAX. For
-                 * now we use that, but this should be updated
-                 * one day when the final limit is known. */
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(struct timeval)) +
-                            CMSG_SPACE(sizeof(int)) + /* fd */
-                            CMSG_SPACE(NAME_MAX)]; /* selinux label */
-        } control = {};
+        if (!s->runtime_journal)
+                return 0;
 
-        union sockaddr_union sa = {};
+        /* Already in progress? */
+        if (s->flush_journal)
+                return 0;
 
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &sa,
-                .msg_namelen = sizeof(sa),
-        };
+        if (require_flag_file && !flushed_flag_is_set())
+                return 0;
 
-        assert(s);
-        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+        (void) system_journal_open(s, true);
 
-        if (revents != EPOLLIN) {
-                log_error("Got invalid event from epoll for datagram fd: %"PRIx32, revents);
-                return -EIO;
-        }
+        if (!s->system_journal)
+                return 0;
 
-        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
-         * it.) */
-        (void) ioctl(fd, SIOCINQ, &v);
+        log_debug("Flushing to /var...");
 
-        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
-        m = PAGE_ALIGN(MAX3((size_t) v + 1,
-                            (size_t) LINE_MAX,
-                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+        r = sd_journal_open(&j, SD_JOURNAL_RUNTIME_ONLY);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read runtime journal: %m");
 
-        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
-                return log_oom();
+        sd_journal_set_data_threshold(j, 0);
 
-        iovec.iov_base = s->buffer;
-        iovec.iov_len = s->buffer_size - 1; /* Leave room for trailing NUL we add later */
+        s->flush_journal = j;
+        s->flush_timestamp = now(CLOCK_MONOTONIC);
+        s->n_flushed = 0;
 
-        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (n < 0) {
-                if (IN_SET(errno, EINTR, EAGAIN))
-                        return 0;
+        /* Copy the entries in batches from the event loop, so that we keep processing log messages in between. Those
+         * are still written to the runtime journal until the flush is complete (see find_journal()), and are hence
+         * copied over too, in the right order. */
+        r = sd_event_add_defer(s->event, &s->flush_event_source, dispatch_flush_event, s);
+        if (r >= 0)
+                r = sd_event_source_set_priority(s->flush_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (r >= 0)
+                r = sd_event_source_set_enabled(s->flush_event_source, SD_EVENT_ON);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to set up event source for flushing, flushing synchronously: %m");
+                s->flush_event_source = sd_event_source_unref(s->flush_event_source);
 
-                return log_error_errno(errno, "recvmsg() failed: %m");
+                (void) server_flush_step(s, UINT_MAX);
         }
 
-        CMSG_FOREACH(cmsg, &msghdr) {
+        return 0;
+}
+
+typedef union ControlBuffer {
+        struct cmsghdr cmsghdr;
+
+        /* We use NAME_MAX space for the SELinux label
+         * here. The kernel currently enforces no
+         * limit, but according to suggestions from
+         * the SELinux people this will change and it
+         * will probably be identical to NAME_MAX. For
+         * now we use that, but this should be updated
+         * one day when the final limit is known. */
+        uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                    CMSG_SPACE(sizeof(struct timeval)) +
+                    CMSG_SPACE(sizeof(int)) + /* fd */
+                    CMSG_SPACE(NAME_MAX)]; /* selinux label */
+} ControlBuffer;
+
+struct DatagramBatch {
+        struct mmsghdr msgs[DATAGRAM_BATCH_MAX];
+        struct iovec iovecs[DATAGRAM_BATCH_MAX];
+        ControlBuffer controls[DATAGRAM_BATCH_MAX];
+        union sockaddr_union addresses[DATAGRAM_BATCH_MAX];
+        char buffers[DATAGRAM_BATCH_MAX][DATAGRAM_BATCH_SLOT_SIZE + 1];
+};
+
+static void server_dispatch_datagram(Server *s, int fd, char *buffer, size_t n, struct msghdr *msghdr) {
+        struct ucred *ucred = NULL;
+        struct timeval *tv = NULL;
+        struct cmsghdr *cmsg;
+        char *label = NULL;
+        size_t label_len = 0;
+        int *fds = NULL;
+        unsigned n_fds = 0;
+
+        assert(s);
+        assert(buffer);
+        assert(msghdr);
+
+        CMSG_FOREACH(cmsg, msghdr) {
 
                 if (cmsg->cmsg_level == SOL_SOCKET &&
                     cmsg->cmsg_type == SCM_CREDENTIALS &&
@@ -1154,17 +1300,17 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
         }
 
         /* And a trailing NUL, just in case */
-        s->buffer[n] = 0;
+        buffer[n] = 0;
 
         if (fd == s->syslog_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, strstrip(s->buffer), ucred, tv, label, label_len);
+                        server_process_syslog_message(s, strstrip(buffer), ucred, tv, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via syslog socket. Ignoring.");
 
         } else if (fd == s->native_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n == 0 && n_fds == 1)
                         server_process_native_file(s, fds[0], ucred, tv, label, label_len);
                 else if (n_fds > 0)
@@ -1174,32 +1320,156 @@ int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void
                 assert(fd == s->audit_fd);
 
                 if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
+                        server_process_audit_message(s, buffer, n, ucred, msghdr->msg_name, msghdr->msg_namelen);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via audit socket. Ignoring.");
         }
 
         close_many(fds, n_fds);
+}
+
+static int server_process_one_datagram(Server *s, int fd) {
+        union sockaddr_union sa = {};
+        ControlBuffer control = {};
+        struct iovec iovec;
+        size_t m;
+        ssize_t n;
+        int v = 0;
+
+        struct msghdr msghdr = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+                .msg_name = &sa,
+                .msg_namelen = sizeof(sa),
+        };
+
+        assert(s);
+
+        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
+         * it.) */
+        (void) ioctl(fd, SIOCINQ, &v);
+
+        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
+        m = PAGE_ALIGN(MAX3((size_t) v + 1,
+                            (size_t) LINE_MAX,
+                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+
+        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
+                return log_oom();
+
+        iovec.iov_base = s->buffer;
+        iovec.iov_len = s->buffer_size - 1; /* Leave room for trailing NUL we add later */
+
+        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+                if (errno == EINTR)
+                        return 1;
+                if (errno == EAGAIN)
+                        return 0;
+
+                return log_error_errno(errno, "recvmsg() failed: %m");
+        }
+
+        server_dispatch_datagram(s, fd, s->buffer, n, &msghdr);
+        return 1;
+}
+
+static int server_process_datagram_batch(Server *s, int fd) {
+        DatagramBatch *b;
+        unsigned i;
+        int n;
+
+        assert(s);
+
+        if (!s->datagram_batch) {
+                s->datagram_batch = new(DatagramBatch, 1);
+                if (!s->datagram_batch)
+                        return log_oom();
+        }
+
+        b = s->datagram_batch;
+
+        for (i = 0; i < DATAGRAM_BATCH_MAX; i++) {
+                b->iovecs[i] = (struct iovec) {
+                        .iov_base = b->buffers[i],
+                        .iov_len = DATAGRAM_BATCH_SLOT_SIZE, /* Leave room for trailing NUL we add later */
+                };
+
+                b->msgs[i] = (struct mmsghdr) {
+                        .msg_hdr.msg_iov = b->iovecs + i,
+                        .msg_hdr.msg_iovlen = 1,
+                        .msg_hdr.msg_control = b->controls + i,
+                        .msg_hdr.msg_controllen = sizeof(b->controls[i]),
+                        .msg_hdr.msg_name = b->addresses + i,
+                        .msg_hdr.msg_namelen = sizeof(b->addresses[i]),
+                };
+        }
+
+        n = recvmmsg(fd, b->msgs, DATAGRAM_BATCH_MAX, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                return log_error_errno(errno, "recvmmsg() failed: %m");
+        }
+
+        for (i = 0; i < (unsigned) n; i++) {
+                if (b->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                        log_debug("Got datagram larger than %u bytes, truncating.", DATAGRAM_BATCH_SLOT_SIZE);
+
+                server_dispatch_datagram(s, fd, b->buffers[i], b->msgs[i].msg_len, &b->msgs[i].msg_hdr);
+        }
+
         return 0;
 }
 
-static int dispatch_sigusr1(sd_event_source *es, const struct signalfd_siginfo *si, void *userdata) {
+int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
+        unsigned i;
         int r;
 
+        assert(s);
+        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+
+        if (revents != EPOLLIN) {
+                log_error("Got invalid event from epoll for datagram fd: %"PRIx32, revents);
+                return -EIO;
+        }
+
+        /* Syslog and audit messages are short, hence we can receive them in one go into fixed size buffers. Native
+         * messages may be much larger than that, and we don't want to cut them off, hence they are read one by one,
+         * each with a buffer sized to fit. */
+        if (fd != s->native_fd)
+                return server_process_datagram_batch(s, fd);
+
+        /* Under load, waking up once per datagram is a major part of the cost of processing it. Hence read a
+         * couple of them in one go, but not too many, so that other sockets and streams don't starve. */
+        for (i = 0; i < DATAGRAMS_PER_WAKEUP_MAX; i++) {
+                r = server_process_one_datagram(s, fd);
+                if (r <= 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int dispatch_sigusr1(sd_event_source *es, const struct signalfd_siginfo *si, void *userdata) {
+        Server *s = userdata;
+
         assert(s);
 
         log_info("Received request to flush runtime journal from PID " PID_FMT, si->ssi_pid);
 
-        (void) server_flush_to_var(s, false);
-        server_sync(s);
-        server_vacuum(s, false);
+        /* Unless a flush is still in progress now, we are done, otherwise we'll let the requester know once it is
+         * complete */
+        s->flush_requested = true;
 
-        r = touch("/run/systemd/journal/flushed");
-        if (r < 0)
-                log_warning_errno(r, "Failed to touch /run/systemd/journal/flushed, ignoring: %m");
+        (void) server_flush_to_var(s, false);
+        if (!s->flush_journal)
+                server_flush_notify(s);
 
-        server_space_usage_message(s, NULL);
         return 0;
 }
 
@@ -1425,53 +1695,83 @@ static int server_dispatch_sync(sd_event_source *es, usec_t t, void *userdata) {
         return 0;
 }
 
-int server_schedule_sync(Server *s, int priority) {
+static int server_schedule_sync_at(Server *s, usec_t when) {
         int r;
 
         assert(s);
 
-        if (priority <= LOG_CRIT) {
-                /* Immediately sync to disk when this is of priority CRIT, ALERT, EMERG */
-                server_sync(s);
-                return 0;
-        }
+        if (s->sync_scheduled) {
+                usec_t t;
 
-        if (s->sync_scheduled)
-                return 0;
+                /* Only ever move an already scheduled sync closer */
+                r = sd_event_source_get_time(s->sync_event_source, &t);
+                if (r < 0)
+                        return r;
+                if (t <= when)
+                        return 0;
 
-        if (s->sync_interval_usec > 0) {
-                usec_t when;
+                return sd_event_source_set_time(s->sync_event_source, when);
+        }
 
-                r = sd_event_now(s->event, CLOCK_MONOTONIC, &when);
+        if (!s->sync_event_source) {
+                r = sd_event_add_time(
+                                s->event,
+                                &s->sync_event_source,
+                                CLOCK_MONOTONIC,
+                                when, 0,
+                                server_dispatch_sync, s);
                 if (r < 0)
                         return r;
 
-                when += s->sync_interval_usec;
+                r = sd_event_source_set_priority(s->sync_event_source, SD_EVENT_PRIORITY_IMPORTANT);
+        } else {
+                r = sd_event_source_set_time(s->sync_event_source, when);
+                if (r < 0)
+                        return r;
 
-                if (!s->sync_event_source) {
-                        r = sd_event_add_time(
-                                        s->event,
-                                        &s->sync_event_source,
-                                        CLOCK_MONOTONIC,
-                                        when, 0,
-                                        server_dispatch_sync, s);
-                        if (r < 0)
-                                return r;
+                r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_ONESHOT);
+        }
+        if (r < 0)
+                return r;
 
-                        r = sd_event_source_set_priority(s->sync_event_source, SD_EVENT_PRIORITY_IMPORTANT);
-                } else {
-                        r = sd_event_source_set_time(s->sync_event_source, when);
-                        if (r < 0)
-                                return r;
+        s->sync_scheduled = true;
+
+        return 0;
+}
+
+int server_schedule_sync(Server *s, int priority) {
+        usec_t n;
+        int r;
+
+        assert(s);
+
+        r = sd_event_now(s->event, CLOCK_MONOTONIC, &n);
+        if (r < 0)
+                return r;
+
+        if (priority <= LOG_CRIT) {
+                usec_t window;
 
-                        r = sd_event_source_set_enabled(s->sync_event_source, SD_EVENT_ONESHOT);
+                /* Sync to disk quickly when this is of priority CRIT, ALERT, EMERG. If we synced only a moment
+                 * ago, merge this one with whatever else comes in during a short window though, rather than
+                 * issuing one sync per message. The window grows with the time syncs take. */
+                window = CLAMP(s->sync_latency_usec * 4, SYNC_MERGE_WINDOW_MIN_USEC, SYNC_MERGE_WINDOW_MAX_USEC);
+
+                if (s->sync_timestamp == 0 || n >= s->sync_timestamp + window) {
+                        server_sync(s);
+                        return 0;
                 }
-                if (r < 0)
-                        return r;
 
-                s->sync_scheduled = true;
+                s->n_syncs_merged++;
+                return server_schedule_sync_at(s, s->sync_timestamp + window);
         }
 
+        if (s->sync_scheduled)
+                return 0;
+
+        if (s->sync_interval_usec > 0)
+                return server_schedule_sync_at(s, n + s->sync_interval_usec);
+
         return 0;
 }
 
@@ -1685,7 +1985,7 @@ int server_init(Server *s) {
         assert(s);
 
         zero(*s);
-        s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = -1;
+        s->syslog_fd = s->native_fd = s->stdout_fd = s->dev_kmsg_fd = s->audit_fd = s->hostname_fd = s->notify_fd = s->units_watch_fd = -1;
         s->compress = true;
         s->seal = true;
         s->read_kmsg = true;
@@ -1877,6 +2177,7 @@ int server_init(Server *s) {
 
         (void) server_connect_notify(s);
 
+        (void) client_context_watch_units(s);
         (void) client_context_acquire_default(s);
 
         return system_journal_open(s, false);
@@ -1899,8 +2200,23 @@ void server_maybe_append_tags(Server *s) {
 }
 
 void server_done(Server *s) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+
         assert(s);
 
+        log_debug("Sync statistics: %u syncs taking %s total, %s at most, %u merged",
+                  s->n_syncs,
+                  format_timespan(a, sizeof(a), s->sync_total_usec, 0),
+                  format_timespan(b, sizeof(b), s->sync_max_usec, 0),
+                  s->n_syncs_merged);
+
+        log_debug("Rate limit statistics: %" PRIu64 " messages suppressed",
+                  journal_rate_limit_get_suppressed(s->rate_limit, NULL));
+
+        /* Don't leave a partial copy of the runtime journal behind */
+        if (s->flush_journal)
+                (void) server_flush_step(s, UINT_MAX);
+
         set_free_with_destructor(s->deferred_closes, journal_file_close);
 
         while (s->stdout_streams)
@@ -1930,6 +2246,9 @@ void server_done(Server *s) {
         sd_event_source_unref(s->hostname_event_source);
         sd_event_source_unref(s->notify_event_source);
         sd_event_source_unref(s->watchdog_event_source);
+        sd_event_source_unref(s->units_watch_event_source);
+        sd_event_source_unref(s->flush_event_source);
+        sd_event_source_unref(s->standby_event_source);
         sd_event_unref(s->event);
 
         safe_close(s->syslog_fd);
@@ -1939,6 +2258,7 @@ void server_done(Server *s) {
         safe_close(s->audit_fd);
         safe_close(s->hostname_fd);
         safe_close(s->notify_fd);
+        safe_close(s->units_watch_fd);
 
         if (s->rate_limit)
                 journal_rate_limit_free(s->rate_limit);
@@ -1947,6 +2267,7 @@ void server_done(Server *s) {
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
 
         free(s->buffer);
+        free(s->datagram_batch);
         free(s->tty_path);
         free(s->cgroup_root);
         free(s->hostname_field);
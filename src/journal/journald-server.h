@@ -24,8 +24,10 @@
 #include <sys/types.h>
 
 #include "sd-event.h"
+#include "sd-journal.h"
 
 typedef struct Server Server;
+typedef struct DatagramBatch DatagramBatch;
 
 #include "hashmap.h"
 #include "journal-file.h"
@@ -95,6 +97,8 @@ struct Server {
         sd_event_source *hostname_event_source;
         sd_event_source *notify_event_source;
         sd_event_source *watchdog_event_source;
+        sd_event_source *flush_event_source;
+        sd_event_source *standby_event_source;
 
         JournalFile *runtime_journal;
         JournalFile *system_journal;
@@ -105,14 +109,27 @@ struct Server {
         char *buffer;
         size_t buffer_size;
 
+        DatagramBatch *datagram_batch;
+
         JournalRateLimit *rate_limit;
         usec_t sync_interval_usec;
+
+        /* When the last sync happened, how long syncs take on average, and some statistics */
+        usec_t sync_timestamp;
+        usec_t sync_latency_usec;
+        unsigned n_syncs, n_syncs_merged;
+        usec_t sync_total_usec, sync_max_usec;
         usec_t rate_limit_interval;
         unsigned rate_limit_burst;
 
         JournalStorage runtime_storage;
         JournalStorage system_storage;
 
+        /* A flush of the runtime journal to /var that is in progress */
+        sd_journal *flush_journal;
+        usec_t flush_timestamp;
+        unsigned n_flushed;
+
         bool compress;
         bool seal;
         bool read_kmsg;
@@ -158,6 +175,8 @@ struct Server {
         bool send_watchdog:1;
         bool sent_notify_ready:1;
         bool sync_scheduled:1;
+        bool flushing:1;
+        bool flush_requested:1;
 
         char machine_id_field[sizeof("_MACHINE_ID=") + 32];
         char boot_id_field[sizeof("_BOOT_ID=") + 32];
@@ -175,6 +194,10 @@ struct Server {
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
+        Hashmap *cgroup_contexts;
+
+        int units_watch_fd;
+        sd_event_source *units_watch_event_source;
 
         ClientContext *my_context; /* the context of journald itself */
         ClientContext *pid1_context; /* the context of PID 1 */
@@ -94,7 +94,8 @@ struct StdoutStream {
         bool in_notify_queue:1;
 
         char *buffer;
-        size_t length;
+        size_t offset;   /* where the unprocessed data starts in buffer */
+        size_t length;   /* how much unprocessed data there is */
         size_t allocated;
 
         sd_event_source *event_source;
@@ -445,7 +446,7 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
 
         assert(s);
 
-        p = s->buffer;
+        p = s->buffer + s->offset;
         remaining = s->length;
 
         /* XXX: This function does nothing if (s->length == 0) */
@@ -493,17 +494,19 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
                 remaining = 0;
         }
 
-        if (p > s->buffer) {
-                memmove(s->buffer, p, remaining);
-                s->length = remaining;
-        }
+        /* Don't move the incomplete line left over to the front of the buffer here, that's done lazily before the
+         * next read, and only if we run out of room behind it. If everything was processed we can start from the
+         * beginning again for free. */
+        s->offset = remaining > 0 ? (size_t) (p - s->buffer) : 0;
+        s->length = remaining;
 
         return 0;
 }
 
 static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         StdoutStream *s = userdata;
-        size_t limit;
+        size_t limit, room;
+        bool full;
         ssize_t l;
         int r;
 
@@ -515,8 +518,14 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         }
 
         /* If the buffer is full already (discounting the extra NUL we need), add room for another 1K */
-        if (s->length + 1 >= s->allocated) {
-                if (!GREEDY_REALLOC(s->buffer, s->allocated, s->length + 1 + 1024)) {
+        if (s->offset + s->length + 1 >= s->allocated) {
+                if (s->offset > 0) {
+                        memmove(s->buffer, s->buffer + s->offset, s->length);
+                        s->offset = 0;
+                }
+
+                if (s->length + 1 >= s->allocated &&
+                    !GREEDY_REALLOC(s->buffer, s->allocated, s->length + 1 + 1024)) {
                         log_oom();
                         goto terminate;
                 }
@@ -526,7 +535,20 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
          * always leave room for a terminating NUL we might need to add. */
         limit = MIN(s->allocated - 1, s->server->line_max);
 
-        l = read(s->fd, s->buffer + s->length, limit - s->length);
+        /* If an incomplete line is left over and there's less than half of what we could read free behind it,
+         * move it to the front first. This way short partial lines are only moved once in a while, not after
+         * every read. */
+        room = s->allocated - 1 - s->offset - s->length;
+        if (s->offset > 0 && room < (limit - s->length) / 2) {
+                memmove(s->buffer, s->buffer + s->offset, s->length);
+                s->offset = 0;
+                room = s->allocated - 1 - s->length;
+        }
+
+        room = MIN(room, limit - s->length);
+
+        l = read(s->fd, s->buffer + s->offset + s->length, room);
+        full = l > 0 && (size_t) l == room;
         if (l < 0) {
                 if (errno == EAGAIN)
                         return 0;
@@ -545,6 +567,12 @@ static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents,
         if (r < 0)
                 goto terminate;
 
+        /* The read used up all the room we had, hence there's likely more queued. Make room for bigger reads next
+         * time, so that chatty streams get by with fewer wakeups and read() calls. This is merely an
+         * optimization, hence ignore OOM here. */
+        if (full && s->allocated - 1 < s->server->line_max)
+                (void) GREEDY_REALLOC(s->buffer, s->allocated, s->allocated + 1);
+
         return 1;
 
 terminate:
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include "alloc-util.h"
 #include "fd-util.h"
@@ -67,6 +68,7 @@ struct MMapFileDescriptor {
         MMapCache *cache;
         int fd;
         bool sigbus;
+        bool pread;
         LIST_HEAD(Window, windows);
 };
 
@@ -75,6 +77,10 @@ struct MMapCache {
         unsigned n_windows;
 
         unsigned n_hit, n_missed;
+        unsigned n_mapped, n_remapped;
+
+        uint64_t window_size;
+        bool readahead;
 
         Hashmap *fds;
         Context *contexts[MMAP_CACHE_MAX_CONTEXTS];
@@ -92,6 +98,12 @@ struct MMapCache {
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
 #endif
 
+#define WINDOW_SIZE_MAX (1024ULL*1024ULL*1024ULL)
+
+/* Windows that are at least this large start at file offsets aligned to it, so that the kernel may back them
+ * with transparent huge pages. */
+#define WINDOW_HUGE_PAGE_SIZE (2ULL*1024ULL*1024ULL)
+
 MMapCache* mmap_cache_new(void) {
         MMapCache *m;
 
@@ -100,9 +112,35 @@ MMapCache* mmap_cache_new(void) {
                 return NULL;
 
         m->n_ref = 1;
+        m->window_size = WINDOW_SIZE;
         return m;
 }
 
+int mmap_cache_set_window_size(MMapCache *m, uint64_t size) {
+        assert(m);
+
+#if ENABLE_DEBUG_MMAP_CACHE
+        /* Keep the tiny windows, they are the point of debug mode */
+        return 0;
+#else
+        if (size == 0)
+                size = WINDOW_SIZE;
+
+        if (size > WINDOW_SIZE_MAX)
+                return -ERANGE;
+
+        /* Only affects windows mapped from now on */
+        m->window_size = PAGE_ALIGN(size);
+        return 0;
+#endif
+}
+
+void mmap_cache_set_readahead(MMapCache *m, bool b) {
+        assert(m);
+
+        m->readahead = b;
+}
+
 MMapCache* mmap_cache_ref(MMapCache *m) {
         assert(m);
         assert(m->n_ref > 0);
@@ -197,6 +235,7 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, int prot, bool ke
                 w = m->last_unused;
                 window_unlink(w);
                 zero(*w);
+                m->n_remapped++;
         }
 
         w->cache = m;
@@ -335,6 +374,7 @@ static int make_room(MMapCache *m) {
                 return 0;
 
         window_free(m->last_unused);
+        m->n_remapped++;
         return 1;
 }
 
@@ -455,6 +495,67 @@ static int mmap_try_harder(MMapCache *m, void *addr, MMapFileDescriptor *f, int
         return 0;
 }
 
+static int pread_try_harder(MMapCache *m, MMapFileDescriptor *f, int prot, uint64_t offset, size_t size, size_t size_min, void **res) {
+        size_t done = 0;
+        void *ptr;
+        int r;
+
+        assert(m);
+        assert(f);
+        assert(res);
+
+        /* Read the window into anonymous memory, so that it can be released with munmap() like any other. */
+        for (;;) {
+                ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+                if (ptr != MAP_FAILED)
+                        break;
+                if (errno != ENOMEM)
+                        return negative_errno();
+
+                r = make_room(m);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -ENOMEM;
+        }
+
+        while (done < size) {
+                ssize_t k;
+
+                k = pread(f->fd, (uint8_t*) ptr + done, size - done, offset + done);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        r = -errno;
+                        goto fail;
+                }
+                if (k == 0)
+                        break;
+
+                done += k;
+        }
+
+        /* The file got truncated underneath us, that's what would have caused SIGBUS with a real mapping. The rest
+         * of the window beyond the end of file remains zeroed. */
+        if (done < size_min) {
+                r = -EIO;
+                goto fail;
+        }
+
+        if (mprotect(ptr, size, prot) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        *res = ptr;
+        return 0;
+
+fail:
+        (void) munmap(ptr, size);
+        return r;
+}
+
 static int add_mmap(
                 MMapCache *m,
                 MMapFileDescriptor *f,
@@ -483,17 +584,27 @@ static int add_mmap(
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
+        /* Windows we keep around forever (i.e. the file headers) are not enlarged, since there's one for each
+         * open file, and with many files open they would add up. */
+        if (wsize < m->window_size && !keep_always) {
                 uint64_t delta;
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+                delta = PAGE_ALIGN((m->window_size - wsize) / 2);
 
                 if (delta > offset)
                         woffset = 0;
                 else
                         woffset -= delta;
 
-                wsize = WINDOW_SIZE;
+                wsize = m->window_size;
+
+                if (wsize >= WINDOW_HUGE_PAGE_SIZE) {
+                        woffset &= ~(WINDOW_HUGE_PAGE_SIZE - 1ULL);
+
+                        /* Make sure the rounding didn't move the end of the window before the object */
+                        if (woffset + wsize < offset + size)
+                                wsize = ALIGN_TO(offset + size - woffset, WINDOW_HUGE_PAGE_SIZE);
+                }
         }
 
         if (st) {
@@ -508,10 +619,26 @@ static int add_mmap(
                         wsize = PAGE_ALIGN(st->st_size - woffset);
         }
 
-        r = mmap_try_harder(m, NULL, f, prot, MAP_SHARED, woffset, wsize, &d);
+        if (f->pread && !(prot & PROT_WRITE))
+                r = pread_try_harder(m, f, prot, woffset, wsize, offset + size - woffset, &d);
+        else
+                r = mmap_try_harder(m, NULL, f, prot, MAP_SHARED, woffset, wsize, &d);
         if (r < 0)
                 return r;
 
+        m->n_mapped++;
+
+        if (m->readahead && !f->pread) {
+                uint64_t skip;
+
+                /* When somebody walks through the file front to back, tell the kernel to read the rest of the
+                 * window in the background, rather than faulting it in page by page. */
+                skip = (offset - woffset) & ~((uint64_t) page_size() - 1ULL);
+
+                (void) madvise(d, wsize, MADV_SEQUENTIAL);
+                (void) madvise((uint8_t*) d + skip, wsize - skip, MADV_WILLNEED);
+        }
+
         c = context_add(m, context);
         if (!c)
                 goto outofmem;
@@ -586,6 +713,18 @@ unsigned mmap_cache_get_missed(MMapCache *m) {
         return m->n_missed;
 }
 
+unsigned mmap_cache_get_mapped(MMapCache *m) {
+        assert(m);
+
+        return m->n_mapped;
+}
+
+unsigned mmap_cache_get_remapped(MMapCache *m) {
+        assert(m);
+
+        return m->n_remapped;
+}
+
 static void mmap_cache_process_sigbus(MMapCache *m) {
         bool found = false;
         MMapFileDescriptor *f;
@@ -687,6 +826,31 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
         return f;
 }
 
+void mmap_cache_fd_set_pread(MMapCache *m, MMapFileDescriptor *f, bool b) {
+        assert(m);
+        assert(f);
+
+        /* Read windows with pread() rather than mapping the file. This avoids page faults and SIGBUS on
+         * network file systems, but windows become snapshots: only use this for files that don't change
+         * anymore. Windows mapped writable are never affected. */
+        f->pread = b;
+}
+
+void mmap_cache_fd_release(MMapCache *m, MMapFileDescriptor *f) {
+        Window *w, *n;
+
+        assert(m);
+        assert(f);
+
+        /* Unmap the windows of this file nobody refers to at the moment. Useful if the file is likely not
+         * going to be looked at again for a while, so that its windows don't occupy the unused list until they
+         * are eventually reused. */
+
+        LIST_FOREACH_SAFE(by_fd, w, n, f->windows)
+                if (w->in_unused)
+                        window_free(w);
+}
+
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f) {
         assert(m);
         assert(f);
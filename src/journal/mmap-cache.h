@@ -20,6 +20,7 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <sys/stat.h>
 
@@ -33,6 +34,9 @@ MMapCache* mmap_cache_new(void);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
 
+int mmap_cache_set_window_size(MMapCache *m, uint64_t size);
+void mmap_cache_set_readahead(MMapCache *m, bool b);
+
 int mmap_cache_get(
         MMapCache *m,
         MMapFileDescriptor *f,
@@ -45,9 +49,13 @@ int mmap_cache_get(
         void **ret,
         size_t *ret_size);
 MMapFileDescriptor * mmap_cache_add_fd(MMapCache *m, int fd);
+void mmap_cache_fd_release(MMapCache *m, MMapFileDescriptor *f);
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f);
+void mmap_cache_fd_set_pread(MMapCache *m, MMapFileDescriptor *f, bool b);
 
 unsigned mmap_cache_get_hit(MMapCache *m);
 unsigned mmap_cache_get_missed(MMapCache *m);
+unsigned mmap_cache_get_mapped(MMapCache *m);
+unsigned mmap_cache_get_remapped(MMapCache *m);
 
 bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f);
@@ -47,7 +47,9 @@
 #include "list.h"
 #include "lookup3.h"
 #include "missing.h"
+#include "parse-util.h"
 #include "path-util.h"
+#include "prioq.h"
 #include "replace-var.h"
 #include "stat-util.h"
 #include "stdio-util.h"
@@ -62,8 +64,174 @@
 
 #define DEFAULT_DATA_THRESHOLD (64*1024)
 
+/* How much decompressed payload to keep around for sd_journal_get_data() and sd_journal_enumerate_data() */
+#define DEFAULT_DATA_CACHE_MAX (4U*1024U*1024U)
+
 static void remove_file_real(sd_journal *j, JournalFile *f);
 
+static unsigned journal_chain_cache_max(sd_journal *j) {
+        assert(j);
+
+        /* Every match refers to a different entry array chain in each file, and iterating without matches uses
+         * the global one. Leave some room for the data objects we look at while bisecting. */
+        return j->n_matches * 2 + 1;
+}
+
+static void update_chain_cache_max(sd_journal *j) {
+        JournalFile *f;
+        Iterator i;
+
+        assert(j);
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i)
+                journal_file_set_chain_cache_max(f, journal_chain_cache_max(j));
+        j->files_by_location_valid = false;
+}
+
+struct DataCacheKey {
+        JournalFile *file;
+        uint64_t offset;
+};
+
+struct DataCacheEntry {
+        struct DataCacheKey key;
+        size_t size;
+        LIST_FIELDS(DataCacheEntry, lru);
+        uint8_t data[];
+};
+
+static void data_cache_key_hash_func(const void *p, struct siphash *state) {
+        const struct DataCacheKey *k = p;
+
+        siphash24_compress(&k->file, sizeof(k->file), state);
+        siphash24_compress(&k->offset, sizeof(k->offset), state);
+}
+
+static int data_cache_key_compare_func(const void *a, const void *b) {
+        const struct DataCacheKey *x = a, *y = b;
+
+        if (x->file != y->file)
+                return x->file < y->file ? -1 : 1;
+
+        return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static const struct hash_ops data_cache_hash_ops = {
+        .hash = data_cache_key_hash_func,
+        .compare = data_cache_key_compare_func
+};
+
+static void data_cache_remove(sd_journal *j, DataCacheEntry *e) {
+        assert(j);
+        assert(e);
+
+        hashmap_remove(j->data_cache, &e->key);
+        if (j->data_cache_lru_tail == e)
+                j->data_cache_lru_tail = e->lru_prev;
+        LIST_REMOVE(lru, j->data_cache_lru, e);
+        j->data_cache_size -= e->size;
+        free(e);
+}
+
+static void data_cache_flush(sd_journal *j, JournalFile *f) {
+        DataCacheEntry *e, *n;
+
+        assert(j);
+
+        /* Drops the cached objects of the specified file, or all of them if f is NULL */
+
+        LIST_FOREACH_SAFE(lru, e, n, j->data_cache_lru)
+                if (!f || e->key.file == f)
+                        data_cache_remove(j, e);
+}
+
+static DataCacheEntry *data_cache_get(sd_journal *j, JournalFile *f, uint64_t offset) {
+        struct DataCacheKey k = {
+                .file = f,
+                .offset = offset,
+        };
+        DataCacheEntry *e;
+
+        assert(j);
+
+        e = hashmap_get(j->data_cache, &k);
+        if (!e)
+                return NULL;
+
+        /* Move to the front of the LRU list */
+        if (e != j->data_cache_lru) {
+                if (j->data_cache_lru_tail == e)
+                        j->data_cache_lru_tail = e->lru_prev;
+                LIST_REMOVE(lru, j->data_cache_lru, e);
+                LIST_PREPEND(lru, j->data_cache_lru, e);
+        }
+
+        j->data_cache_hit++;
+        return e;
+}
+
+static const void *data_cache_put(sd_journal *j, JournalFile *f, uint64_t offset, const void *data, size_t size) {
+        DataCacheEntry *e;
+
+        assert(j);
+        assert(data || size == 0);
+
+        /* Stores a copy of a freshly decompressed data object, and returns a pointer to it. If the object is
+         * not cached, for example because it would push out too much of the rest, the original pointer is
+         * returned. Either way the pointer stays valid until the next call that returns data. */
+
+        j->data_cache_missed++;
+
+        if (j->data_cache_max == 0 || size > j->data_cache_max / 8)
+                return data;
+
+        if (hashmap_ensure_allocated(&j->data_cache, &data_cache_hash_ops) < 0)
+                return data;
+
+        e = malloc(offsetof(DataCacheEntry, data) + size);
+        if (!e)
+                return data;
+
+        e->key.file = f;
+        e->key.offset = offset;
+        e->size = size;
+        memcpy_safe(e->data, data, size);
+
+        if (hashmap_put(j->data_cache, &e->key, e) < 0) {
+                free(e);
+                return data;
+        }
+
+        LIST_PREPEND(lru, j->data_cache_lru, e);
+        if (!j->data_cache_lru_tail)
+                j->data_cache_lru_tail = e;
+        j->data_cache_size += size;
+
+        /* Evict from the tail until we are below the limit again. The new entry stays, it's small enough. */
+        while (j->data_cache_size > j->data_cache_max && j->data_cache_lru_tail != e)
+                data_cache_remove(j, j->data_cache_lru_tail);
+
+        return e->data;
+}
+
+static void data_cache_init(sd_journal *j) {
+        const char *e;
+        uint64_t sz;
+
+        assert(j);
+
+        j->data_cache_max = DEFAULT_DATA_CACHE_MAX;
+
+        e = getenv("SYSTEMD_JOURNAL_DATA_CACHE_MAX");
+        if (!e)
+                return;
+
+        if (parse_size(e, 1024, &sz) < 0 || sz > SIZE_MAX)
+                log_debug("Failed to parse $SYSTEMD_JOURNAL_DATA_CACHE_MAX, ignoring: %s", e);
+        else
+                j->data_cache_max = (size_t) sz;
+}
+
 static bool journal_pid_changed(sd_journal *j) {
         assert(j);
 
@@ -123,6 +291,7 @@ static void detach_location(sd_journal *j) {
 
         j->current_file = NULL;
         j->current_field = 0;
+        j->files_by_location_valid = false;
 
         ORDERED_HASHMAP_FOREACH(f, j->files, i)
                 journal_file_reset_location(f);
@@ -150,6 +319,7 @@ static void init_location(Location *l, LocationType type, JournalFile *f, Object
         l->xor_hash = le64toh(o->entry.xor_hash);
 
         l->seqnum_set = l->realtime_set = l->monotonic_set = l->xor_hash_set = true;
+        l->offset_set = false;
 }
 
 static void set_location(sd_journal *j, JournalFile *f, Object *o) {
@@ -335,6 +505,9 @@ _public_ int sd_journal_add_match(sd_journal *j, const void *data, size_t size)
         if (!m->data)
                 goto fail;
 
+        j->n_matches++;
+        update_chain_cache_max(j);
+
         detach_location(j);
 
         return 0;
@@ -444,6 +617,11 @@ _public_ void sd_journal_flush_matches(sd_journal *j) {
 
         j->level0 = j->level1 = j->level2 = NULL;
 
+        if (j->n_matches > 0) {
+                j->n_matches = 0;
+                update_chain_cache_max(j);
+        }
+
         detach_location(j);
 }
 
@@ -498,6 +676,17 @@ _pure_ static int compare_with_location(JournalFile *f, Location *l) {
         return 0;
 }
 
+static uint64_t match_hash(Match *m, JournalFile *f) {
+        assert(m);
+        assert(f);
+
+        /* Matches carry the unkeyed hash, files using the keyed hash need their own one */
+        if (f->keyed_hash)
+                return journal_file_hash_data(f, m->data, m->size);
+
+        return le64toh(m->le_hash);
+}
+
 static int next_for_match(
                 sd_journal *j,
                 Match *m,
@@ -518,7 +707,14 @@ static int next_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                uint64_t hash;
+
+                hash = match_hash(m, f);
+
+                if (!journal_file_may_contain_data(f, m->data, m->size, hash))
+                        return 0;
+
+                r = journal_file_find_data_object_with_hash(f, m->data, m->size, hash, NULL, &dp);
                 if (r <= 0)
                         return r;
 
@@ -607,7 +803,14 @@ static int find_location_for_match(
         if (m->type == MATCH_DISCRETE) {
                 uint64_t dp;
 
-                r = journal_file_find_data_object_with_hash(f, m->data, m->size, le64toh(m->le_hash), NULL, &dp);
+                uint64_t hash;
+
+                hash = match_hash(m, f);
+
+                if (!journal_file_may_contain_data(f, m->data, m->size, hash))
+                        return 0;
+
+                r = journal_file_find_data_object_with_hash(f, m->data, m->size, hash, NULL, &dp);
                 if (r <= 0)
                         return r;
 
@@ -689,6 +892,83 @@ static int find_location_for_match(
         }
 }
 
+static int file_check_seek_location(sd_journal *j, JournalFile *f, direction_t direction) {
+        const Location *l = &j->current_location;
+        uint64_t head, tail;
+
+        assert(j);
+        assert(f);
+
+        /* Compares the seek location with the range of entries recorded in the file header, so that files
+         * which cannot contain anything beyond the location need not be bisected at all. Returns 0 if the
+         * file has no entry beyond the location, 1 if all entries are beyond it, and -EAGAIN if the file
+         * needs to be searched. Only the criterion the search would use is considered. */
+
+        if (l->type != LOCATION_SEEK)
+                return -EAGAIN;
+
+        if (l->seqnum_set && sd_id128_equal(l->seqnum_id, f->header->seqnum_id)) {
+                head = le64toh(f->header->head_entry_seqnum);
+                tail = le64toh(f->header->tail_entry_seqnum);
+
+                if (direction == DIRECTION_DOWN ? tail < l->seqnum : head > l->seqnum)
+                        return 0;
+                if (direction == DIRECTION_DOWN ? head >= l->seqnum : tail <= l->seqnum)
+                        return 1;
+
+                return -EAGAIN;
+        }
+
+        /* Whether the monotonic criterion applies depends on the boots in the file */
+        if (l->monotonic_set || !l->realtime_set)
+                return -EAGAIN;
+
+        head = le64toh(f->header->head_entry_realtime);
+        tail = le64toh(f->header->tail_entry_realtime);
+
+        /* If the clock jumped backwards while writing, the bounds say nothing */
+        if (head > tail)
+                return -EAGAIN;
+
+        if (direction == DIRECTION_DOWN ? tail < l->realtime : head > l->realtime)
+                return 0;
+        if (direction == DIRECTION_DOWN ? head >= l->realtime : tail <= l->realtime)
+                return 1;
+
+        return -EAGAIN;
+}
+
+static int find_location_by_hint(sd_journal *j, JournalFile *f, Object **ret, uint64_t *offset) {
+        const Location *l = &j->current_location;
+        Object *o;
+        int r;
+
+        assert(j);
+        assert(f);
+
+        /* Cursors record the file and offset the entry was found at. If that's this file, check the entry
+         * there directly, instead of searching for it. */
+
+        if (l->type != LOCATION_SEEK || !l->offset_set || !l->seqnum_set || !l->xor_hash_set)
+                return 0;
+
+        if (!sd_id128_equal(l->file_id, f->header->file_id) ||
+            !sd_id128_equal(l->seqnum_id, f->header->seqnum_id))
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, l->offset, &o);
+        if (r < 0)
+                return 0;
+
+        if (le64toh(o->entry.seqnum) != l->seqnum ||
+            le64toh(o->entry.xor_hash) != l->xor_hash)
+                return 0;
+
+        *ret = o;
+        *offset = l->offset;
+        return 1;
+}
+
 static int find_location_with_matches(
                 sd_journal *j,
                 JournalFile *f,
@@ -703,6 +983,10 @@ static int find_location_with_matches(
         assert(ret);
         assert(offset);
 
+        r = file_check_seek_location(j, f, direction);
+        if (r == 0)
+                return 0;
+
         if (!j->level0) {
                 /* No matches is simple */
 
@@ -710,6 +994,13 @@ static int find_location_with_matches(
                         return journal_file_next_entry(f, 0, DIRECTION_DOWN, ret, offset);
                 if (j->current_location.type == LOCATION_TAIL)
                         return journal_file_next_entry(f, 0, DIRECTION_UP, ret, offset);
+                if (r > 0)
+                        return journal_file_next_entry(f, 0, direction, ret, offset);
+
+                r = find_location_by_hint(j, f, ret, offset);
+                if (r != 0)
+                        return r;
+
                 if (j->current_location.seqnum_set && sd_id128_equal(j->current_location.seqnum_id, f->header->seqnum_id))
                         return journal_file_move_to_entry_by_seqnum(f, j->current_location.seqnum, direction, ret, offset);
                 if (j->current_location.monotonic_set) {
@@ -818,42 +1109,164 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *f, *new_file = NULL;
+static void journal_file_passed(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        /* There's nothing left in this file in the current direction. Unless we are following the journal,
+         * in which case new entries are likely to show up soon, release its memory maps and caches, so that
+         * merging many files only keeps those around that we are still reading from. */
+
+        if (j->inotify_fd >= 0)
+                return;
+
+        journal_file_drop_caches(f);
+}
+
+static int compare_files_down(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) a, (JournalFile*) b);
+}
+
+static int compare_files_up(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) b, (JournalFile*) a);
+}
+
+static void files_by_location_remove(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        if (f->location_prioq_idx == PRIOQ_IDX_NULL)
+                return;
+
+        prioq_remove(j->files_by_location, f, &f->location_prioq_idx);
+        f->location_prioq_idx = PRIOQ_IDX_NULL;
+}
+
+static int files_by_location_rebuild(sd_journal *j, direction_t direction) {
+        JournalFile *f;
         Iterator i;
-        Object *o;
         int r;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert(j);
+
+        /* Look for the next candidate in every file, and order the files by it. This is what we have to do
+         * after each seek, and whenever the set of files or the direction changed. Afterwards we only need to
+         * advance the file we took the last entry from, and the files that contain the same entry. */
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i)
+                f->location_prioq_idx = PRIOQ_IDX_NULL;
+
+        j->files_by_location = prioq_free(j->files_by_location);
+        j->files_by_location = prioq_new(direction == DIRECTION_DOWN ? compare_files_down : compare_files_up);
+        if (!j->files_by_location)
+                return -ENOMEM;
 
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
-                bool found;
+                r = next_beyond_location(j, f, direction);
+                if (r < 0) {
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                        remove_file_real(j, f);
+                        continue;
+                } else if (r == 0) {
+                        f->location_type = LOCATION_TAIL;
+                        journal_file_passed(j, f);
+                        continue;
+                }
 
+                r = prioq_put(j->files_by_location, f, &f->location_prioq_idx);
+                if (r < 0)
+                        return r;
+        }
+
+        j->files_by_location_direction = direction;
+        j->files_by_location_valid = true;
+
+        return 0;
+}
+
+static int files_by_location_refresh(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        Iterator i;
+        int r;
+
+        assert(j);
+        assert(j->files_by_location_valid);
+
+        /* Advance the files at the front until the first one has an entry beyond the current location. Since
+         * the queue is ordered, only files whose candidate is the current entry (the file we took it from, and
+         * others containing the same entry) need to move. Note that the file we took the current entry from is
+         * at the front, and it is the only one whose candidate was consumed. */
+
+        while ((f = prioq_peek(j->files_by_location))) {
                 r = next_beyond_location(j, f, direction);
                 if (r < 0) {
                         log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
                         remove_file_real(j, f);
                         continue;
                 } else if (r == 0) {
+                        files_by_location_remove(j, f);
                         f->location_type = LOCATION_TAIL;
+                        journal_file_passed(j, f);
                         continue;
                 }
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+                r = prioq_reshuffle(j->files_by_location, f, &f->location_prioq_idx);
+                if (r < 0)
+                        return r;
+
+                if (prioq_peek(j->files_by_location) == f)
+                        break;
+        }
 
-                        k = journal_file_compare_locations(f, new_file);
+        /* Files we hit EOF on might have gained new entries in the meantime. Checking for that is cheap, it's
+         * just a look at the header. */
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                if (f->location_prioq_idx != PRIOQ_IDX_NULL)
+                        continue;
+
+                if (le64toh(f->header->n_entries) == f->last_n_entries)
+                        continue;
+
+                r = next_beyond_location(j, f, direction);
+                if (r < 0) {
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                        remove_file_real(j, f);
+                        continue;
+                } else if (r == 0) {
+                        f->location_type = LOCATION_TAIL;
+                        continue;
                 }
 
-                if (found)
-                        new_file = f;
+                r = prioq_put(j->files_by_location, f, &f->location_prioq_idx);
+                if (r < 0)
+                        return r;
         }
 
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *new_file;
+        Object *o;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        /* Plain forward iteration touches every entry in order, let the kernel read ahead for us then */
+        mmap_cache_set_readahead(j->mmap, direction == DIRECTION_DOWN && !j->level0);
+
+        if (j->files_by_location_valid && j->files_by_location_direction == direction)
+                r = files_by_location_refresh(j, direction);
+        else
+                r = files_by_location_rebuild(j, direction);
+        if (r < 0) {
+                j->files_by_location_valid = false;
+                return r;
+        }
+
+        new_file = prioq_peek(j->files_by_location);
         if (!new_file)
                 return 0;
 
@@ -918,7 +1331,7 @@ _public_ int sd_journal_previous_skip(sd_journal *j, uint64_t skip) {
 _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
         Object *o;
         int r;
-        char bid[33], sid[33];
+        char bid[33], sid[33], fid[33];
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
@@ -933,13 +1346,16 @@ _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
 
         sd_id128_to_string(j->current_file->header->seqnum_id, sid);
         sd_id128_to_string(o->entry.boot_id, bid);
+        sd_id128_to_string(j->current_file->header->file_id, fid);
 
+        /* The file ID and offset are only hints for seeking, and are ignored when testing cursors. */
         if (asprintf(cursor,
-                     "s=%s;i=%"PRIx64";b=%s;m=%"PRIx64";t=%"PRIx64";x=%"PRIx64,
+                     "s=%s;i=%"PRIx64";b=%s;m=%"PRIx64";t=%"PRIx64";x=%"PRIx64";f=%s;o=%"PRIx64,
                      sid, le64toh(o->entry.seqnum),
                      bid, le64toh(o->entry.monotonic),
                      le64toh(o->entry.realtime),
-                     le64toh(o->entry.xor_hash)) < 0)
+                     le64toh(o->entry.xor_hash),
+                     fid, j->current_file->current_offset) < 0)
                 return -ENOMEM;
 
         return 0;
@@ -948,15 +1364,17 @@ _public_ int sd_journal_get_cursor(sd_journal *j, char **cursor) {
 _public_ int sd_journal_seek_cursor(sd_journal *j, const char *cursor) {
         const char *word, *state;
         size_t l;
-        unsigned long long seqnum, monotonic, realtime, xor_hash;
+        unsigned long long seqnum, monotonic, realtime, xor_hash, offset;
         bool
                 seqnum_id_set = false,
                 seqnum_set = false,
                 boot_id_set = false,
                 monotonic_set = false,
                 realtime_set = false,
-                xor_hash_set = false;
-        sd_id128_t seqnum_id, boot_id;
+                xor_hash_set = false,
+                file_id_set = false,
+                offset_set = false;
+        sd_id128_t seqnum_id, boot_id, file_id;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
@@ -1008,6 +1426,17 @@ _public_ int sd_journal_seek_cursor(sd_journal *j, const char *cursor) {
                         if (sscanf(item+2, "%llx", &xor_hash) != 1)
                                 k = -EINVAL;
                         break;
+
+                case 'f':
+                        file_id_set = true;
+                        k = sd_id128_from_string(item+2, &file_id);
+                        break;
+
+                case 'o':
+                        offset_set = true;
+                        if (sscanf(item+2, "%llx", &offset) != 1)
+                                k = -EINVAL;
+                        break;
                 }
 
                 free(item);
@@ -1047,6 +1476,12 @@ _public_ int sd_journal_seek_cursor(sd_journal *j, const char *cursor) {
                 j->current_location.xor_hash_set = true;
         }
 
+        if (file_id_set && offset_set) {
+                j->current_location.file_id = file_id;
+                j->current_location.offset = (uint64_t) offset;
+                j->current_location.offset_set = true;
+        }
+
         return 0;
 }
 
@@ -1178,18 +1613,13 @@ _public_ int sd_journal_seek_tail(sd_journal *j) {
         return 0;
 }
 
-static void check_network(sd_journal *j, int fd) {
+static bool fd_on_network(int fd) {
         struct statfs sfs;
 
-        assert(j);
-
-        if (j->on_network)
-                return;
-
         if (fstatfs(fd, &sfs) < 0)
-                return;
+                return false;
 
-        j->on_network =
+        return
                 F_TYPE_EQUAL(sfs.f_type, CIFS_MAGIC_NUMBER) ||
                 F_TYPE_EQUAL(sfs.f_type, CODA_SUPER_MAGIC) ||
                 F_TYPE_EQUAL(sfs.f_type, NCP_SUPER_MAGIC) ||
@@ -1197,6 +1627,15 @@ static void check_network(sd_journal *j, int fd) {
                 F_TYPE_EQUAL(sfs.f_type, SMB_SUPER_MAGIC);
 }
 
+static void check_network(sd_journal *j, int fd) {
+        assert(j);
+
+        if (j->on_network)
+                return;
+
+        j->on_network = fd_on_network(fd);
+}
+
 static bool file_has_type_prefix(const char *prefix, const char *filename) {
         const char *full, *tilded, *atted;
 
@@ -1304,6 +1743,9 @@ static int add_any_file(sd_journal *j, int fd, const char *path) {
                 goto fail;
         }
 
+        journal_file_set_chain_cache_max(f, journal_chain_cache_max(j));
+        j->files_by_location_valid = false;
+
         if (!j->has_runtime_files && path_has_prefix(j, f->path, "/run"))
                 j->has_runtime_files = true;
         else if (!j->has_persistent_files && path_has_prefix(j, f->path, "/var"))
@@ -1313,6 +1755,11 @@ static int add_any_file(sd_journal *j, int fd, const char *path) {
 
         check_network(j, f->fd);
 
+        /* Archived files won't change anymore, hence on network file systems read them with pread() instead of
+         * mapping them, to avoid page fault latency and SIGBUS when the server goes away. */
+        if (f->header->state == STATE_ARCHIVED && fd_on_network(f->fd))
+                mmap_cache_fd_set_pread(f->mmap, f->cache_fd, true);
+
         j->current_invalidate_counter++;
 
         return 0;
@@ -1363,9 +1810,15 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
         assert(f);
 
         ordered_hashmap_remove(j->files, f->path);
+        files_by_location_remove(j, f);
 
         log_debug("File %s removed.", f->path);
 
+        j->chain_cache_hit += f->chain_cache_hit;
+        j->chain_cache_missed += f->chain_cache_missed;
+
+        data_cache_flush(j, f);
+
         if (j->current_file == f) {
                 j->current_file = NULL;
                 j->current_field = 0;
@@ -1721,6 +2174,7 @@ static sd_journal *journal_new(int flags, const char *path) {
         j->inotify_fd = -1;
         j->flags = flags;
         j->data_threshold = DEFAULT_DATA_THRESHOLD;
+        data_cache_init(j);
 
         if (path) {
                 char *t;
@@ -1735,8 +2189,8 @@ static sd_journal *journal_new(int flags, const char *path) {
                         j->path = t;
         }
 
-        j->files = ordered_hashmap_new(&string_hash_ops);
-        j->directories_by_path = hashmap_new(&string_hash_ops);
+        j->files = ordered_hashmap_new(&trusted_string_hash_ops);
+        j->directories_by_path = hashmap_new(&trusted_string_hash_ops);
         j->mmap = mmap_cache_new();
         if (!j->files || !j->directories_by_path || !j->mmap)
                 goto fail;
@@ -1976,6 +2430,7 @@ fail:
 }
 
 _public_ void sd_journal_close(sd_journal *j) {
+        unsigned chain_cache_hit, chain_cache_missed;
         Directory *d;
 
         if (!j)
@@ -1983,7 +2438,17 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         sd_journal_flush_matches(j);
 
+        journal_get_chain_cache_stats(j, &chain_cache_hit, &chain_cache_missed);
+        if (chain_cache_hit + chain_cache_missed > 0)
+                log_debug("Chain cache statistics: %u hit, %u miss", chain_cache_hit, chain_cache_missed);
+        if (j->data_cache_hit + j->data_cache_missed > 0)
+                log_debug("Data cache statistics: %u hit, %u miss", j->data_cache_hit, j->data_cache_missed);
+
+        data_cache_flush(j, NULL);
+        hashmap_free(j->data_cache);
+
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
+        prioq_free(j->files_by_location);
 
         while ((d = hashmap_first(j->directories_by_path)))
                 remove_directory(j, d);
@@ -1997,7 +2462,9 @@ _public_ void sd_journal_close(sd_journal *j) {
         safe_close(j->inotify_fd);
 
         if (j->mmap) {
-                log_debug("mmap cache statistics: %u hit, %u miss", mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap));
+                log_debug("mmap cache statistics: %u hit, %u miss, %u mapped, %u remapped",
+                          mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap),
+                          mmap_cache_get_mapped(j->mmap), mmap_cache_get_remapped(j->mmap));
                 mmap_cache_unref(j->mmap);
         }
 
@@ -2006,7 +2473,9 @@ _public_ void sd_journal_close(sd_journal *j) {
         free(j->path);
         free(j->prefix);
         free(j->unique_field);
+        set_free(j->unique_hashes);
         free(j->fields_buffer);
+        catalog_cache_free(j->catalog_cache);
         free(j);
 }
 
@@ -2146,29 +2615,44 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
-#if HAVE_XZ || HAVE_LZ4
-                        r = decompress_startswith(compression,
-                                                  o->data.payload, l,
-                                                  &f->compress_buffer, &f->compress_buffer_size,
-                                                  field, field_length, '=');
-                        if (r < 0)
-                                log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
-                                                object_compressed_to_string(compression), l, p);
-                        else if (r > 0) {
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
+                        DataCacheEntry *e;
 
-                                size_t rsize;
+                        e = data_cache_get(j, f, p);
+                        if (e) {
+                                if (e->size >= field_length+1 &&
+                                    memcmp(e->data, field, field_length) == 0 &&
+                                    e->data[field_length] == '=') {
 
-                                r = decompress_blob(compression,
-                                                    o->data.payload, l,
-                                                    &f->compress_buffer, &f->compress_buffer_size, &rsize,
-                                                    j->data_threshold);
+                                        *data = e->data;
+                                        *size = e->size;
+
+                                        return 0;
+                                }
+                        } else {
+                                r = decompress_startswith(compression,
+                                                          o->data.payload, l,
+                                                          &f->compress_buffer, &f->compress_buffer_size,
+                                                          field, field_length, '=');
                                 if (r < 0)
-                                        return r;
+                                        log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
+                                                        object_compressed_to_string(compression), l, p);
+                                else if (r > 0) {
 
-                                *data = f->compress_buffer;
-                                *size = (size_t) rsize;
+                                        size_t rsize;
 
-                                return 0;
+                                        r = decompress_blob(compression,
+                                                            o->data.payload, l,
+                                                            &f->compress_buffer, &f->compress_buffer_size, &rsize,
+                                                            j->data_threshold);
+                                        if (r < 0)
+                                                return r;
+
+                                        *data = data_cache_put(j, f, p, f->compress_buffer, rsize);
+                                        *size = (size_t) rsize;
+
+                                        return 0;
+                                }
                         }
 #else
                         return -EPROTONOSUPPORT;
@@ -2196,7 +2680,7 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         return -ENOENT;
 }
 
-static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **data, size_t *size) {
+static int return_data(sd_journal *j, JournalFile *f, uint64_t p, Object *o, const void **data, size_t *size) {
         size_t t;
         uint64_t l;
         int compression;
@@ -2210,17 +2694,25 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
 
         compression = o->object.flags & OBJECT_COMPRESSION_MASK;
         if (compression) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
+                DataCacheEntry *e;
                 size_t rsize;
                 int r;
 
+                e = data_cache_get(j, f, p);
+                if (e) {
+                        *data = e->data;
+                        *size = e->size;
+                        return 0;
+                }
+
                 r = decompress_blob(compression,
                                     o->data.payload, l, &f->compress_buffer,
                                     &f->compress_buffer_size, &rsize, j->data_threshold);
                 if (r < 0)
                         return r;
 
-                *data = f->compress_buffer;
+                *data = data_cache_put(j, f, p, f->compress_buffer, rsize);
                 *size = (size_t) rsize;
 #else
                 return -EPROTONOSUPPORT;
@@ -2269,7 +2761,7 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         if (le_hash != o->data.hash)
                 return -EBADMSG;
 
-        r = return_data(j, f, o, data, size);
+        r = return_data(j, f, p, o, data, size);
         if (r < 0)
                 return r;
 
@@ -2586,6 +3078,28 @@ void journal_print_header(sd_journal *j) {
         }
 }
 
+void journal_get_chain_cache_stats(sd_journal *j, unsigned *ret_hit, unsigned *ret_missed) {
+        unsigned hit, missed;
+        Iterator i;
+        JournalFile *f;
+
+        assert(j);
+        assert(ret_hit);
+        assert(ret_missed);
+
+        /* Statistics of files already removed are kept in the sd_journal object */
+        hit = j->chain_cache_hit;
+        missed = j->chain_cache_missed;
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                hit += f->chain_cache_hit;
+                missed += f->chain_cache_missed;
+        }
+
+        *ret_hit = hit;
+        *ret_missed = missed;
+}
+
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         Iterator i;
         JournalFile *f;
@@ -2625,18 +3139,24 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        set_clear(j->unique_hashes);
 
         return 0;
 }
 
-_public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l) {
+static void *unique_hash_to_ptr(uint64_t h) {
+        /* On 32bit archs this truncates the hash, which is fine, since hits are verified anyway. The set
+         * cannot store NULL, hence map 0 to some other value. */
+        return UINT64_TO_PTR(h) ?: UINT_TO_PTR(1);
+}
+
+static int enumerate_unique(sd_journal *j, const void **data, size_t *l, uint64_t *ret_count) {
         size_t k;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
-        assert_return(data, -EINVAL);
-        assert_return(l, -EINVAL);
-        assert_return(j->unique_field, -EINVAL);
+        assert(j);
+        assert(data);
+        assert(l);
+        assert(j->unique_field);
 
         k = strlen(j->unique_field);
 
@@ -2657,6 +3177,7 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 Object *o;
                 const void *odata;
                 size_t ol;
+                uint64_t h, n;
                 bool found;
                 int r;
 
@@ -2699,7 +3220,7 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
-                r = return_data(j, j->unique_file, o, &odata, &ol);
+                r = return_data(j, j->unique_file, j->unique_offset, o, &odata, &ol);
                 if (r < 0)
                         return r;
 
@@ -2718,38 +3239,98 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
+                /* Files might use different hash functions, hence we remember the unkeyed hash of the values we
+                 * returned already, and calculate the one of the respective file when looking them up there. */
+                h = j->unique_file->keyed_hash ? hash64(odata, ol) : le64toh(o->data.hash);
+                n = le64toh(o->data.n_entries);
+
                 /* OK, now let's see if we already returned this data
-                 * object by checking if it exists in the earlier
-                 * traversed files. */
+                 * object. Only if we returned one with the same hash
+                 * before, check if it exists in the earlier traversed
+                 * files, to rule out a collision. */
                 found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files, i) {
-                        if (of == j->unique_file)
-                                break;
+                if (set_contains(j->unique_hashes, unique_hash_to_ptr(h)))
+                        ORDERED_HASHMAP_FOREACH(of, j->files, i) {
+                                if (of == j->unique_file)
+                                        break;
 
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
+                                /* Skip this file it didn't have any fields indexed */
+                                if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
+                                        continue;
 
-                        r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), NULL, NULL);
-                        if (r < 0)
-                                return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
+                                r = journal_file_find_data_object_with_hash(of, odata, ol,
+                                                                            of->keyed_hash ? journal_file_hash_data(of, odata, ol) : h,
+                                                                            NULL, NULL);
+                                if (r < 0)
+                                        return r;
+                                if (r > 0) {
+                                        found = true;
+                                        break;
+                                }
                         }
-                }
 
                 if (found)
                         continue;
 
-                r = return_data(j, j->unique_file, o, data, l);
+                r = set_ensure_allocated(&j->unique_hashes, NULL);
+                if (r < 0)
+                        return r;
+
+                r = set_put(j->unique_hashes, unique_hash_to_ptr(h));
+                if (r < 0)
+                        return r;
+
+                if (ret_count) {
+                        /* The value was not in any earlier file, hence add up the entries referencing it
+                         * in this and the later files. */
+                        for (of = ordered_hashmap_next(j->files, j->unique_file->path); of; of = ordered_hashmap_next(j->files, of->path)) {
+                                Object *d;
+
+                                if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
+                                        continue;
+
+                                r = journal_file_find_data_object_with_hash(of, odata, ol,
+                                                                            of->keyed_hash ? journal_file_hash_data(of, odata, ol) : h,
+                                                                            &d, NULL);
+                                if (r < 0)
+                                        return r;
+                                if (r > 0)
+                                        n += le64toh(d->data.n_entries);
+                        }
+                }
+
+                r = return_data(j, j->unique_file, j->unique_offset, o, data, l);
                 if (r < 0)
                         return r;
 
+                if (ret_count)
+                        *ret_count = n;
+
                 return 1;
         }
 }
 
+_public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(data, -EINVAL);
+        assert_return(l, -EINVAL);
+        assert_return(j->unique_field, -EINVAL);
+
+        return enumerate_unique(j, data, l, NULL);
+}
+
+_public_ int sd_journal_enumerate_unique_with_count(sd_journal *j, const void **data, size_t *l, uint64_t *count) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(data, -EINVAL);
+        assert_return(l, -EINVAL);
+        assert_return(count, -EINVAL);
+        assert_return(j->unique_field, -EINVAL);
+
+        return enumerate_unique(j, data, l, count);
+}
+
 _public_ void sd_journal_restart_unique(sd_journal *j) {
         if (!j)
                 return;
@@ -2757,6 +3338,7 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
         j->unique_file = NULL;
         j->unique_offset = 0;
         j->unique_file_lost = false;
+        set_clear(j->unique_hashes);
 }
 
 _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
@@ -2864,7 +3446,10 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
                         if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
                                 continue;
 
-                        r = journal_file_find_field_object_with_hash(of, o->field.payload, sz, le64toh(o->field.hash), NULL, NULL);
+                        r = journal_file_find_field_object_with_hash(
+                                        of, o->field.payload, sz,
+                                        f->keyed_hash || of->keyed_hash ? journal_file_hash_data(of, o->field.payload, sz) : le64toh(o->field.hash),
+                                        NULL, NULL);
                         if (r < 0)
                                 return r;
                         if (r > 0) {
@@ -2957,7 +3542,7 @@ _public_ int sd_journal_get_catalog(sd_journal *j, char **ret) {
         if (r < 0)
                 return r;
 
-        r = catalog_get(CATALOG_DATABASE, id, &text);
+        r = catalog_get_cached(&j->catalog_cache, CATALOG_DATABASE, id, &text);
         if (r < 0)
                 return r;
 
@@ -2979,7 +3564,12 @@ _public_ int sd_journal_set_data_threshold(sd_journal *j, size_t sz) {
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
 
-        j->data_threshold = sz;
+        if (j->data_threshold != sz) {
+                /* Cached objects were truncated to the old threshold */
+                data_cache_flush(j, NULL);
+                j->data_threshold = sz;
+        }
+
         return 0;
 }
 
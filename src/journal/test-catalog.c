@@ -33,6 +33,7 @@
 #include "log.h"
 #include "macro.h"
 #include "string-util.h"
+#include "time-util.h"
 #include "util.h"
 
 static const char *catalog_dirs[] = {
@@ -181,6 +182,7 @@ static const char* database = NULL;
 
 static void test_catalog_update(void) {
         static char name[] = "/tmp/test-catalog.XXXXXX";
+        struct stat st, st2;
         int r;
 
         r = mkostemp_safe(name);
@@ -200,6 +202,33 @@ static void test_catalog_update(void) {
            catalog_list below will fail. */
         r = catalog_update(database, NULL, catalog_dirs);
         assert_se(r >= 0);
+
+        /* Nothing changed, so the database should not be rewritten. */
+        assert_se(stat(database, &st) >= 0);
+        r = catalog_update(database, NULL, catalog_dirs);
+        assert_se(r >= 0);
+        assert_se(stat(database, &st2) >= 0);
+        assert_se(st.st_ino == st2.st_ino);
+        assert_se(timespec_load(&st.st_mtim) == timespec_load(&st2.st_mtim));
+}
+
+static void test_catalog_get_cached(void) {
+        _cleanup_(catalog_cache_freep) CatalogCache *cache = NULL;
+        _cleanup_free_ char *text = NULL, *text2 = NULL, *text3 = NULL;
+        CatalogCache *saved;
+
+        assert_se(catalog_get_cached(&cache, database, SD_MESSAGE_COREDUMP, &text) >= 0);
+        assert_se(cache);
+        saved = cache;
+
+        assert_se(catalog_get_cached(&cache, database, SD_MESSAGE_COREDUMP, &text2) >= 0);
+        assert_se(cache == saved);
+        assert_se(streq(text, text2));
+
+        assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &text3) >= 0);
+        assert_se(streq(text, text3));
+
+        assert_se(catalog_get_cached(&cache, "/bin/hopefully/no/database", SD_MESSAGE_COREDUMP, &text3) == -ENOENT);
 }
 
 static void test_catalog_file_lang(void) {
@@ -258,6 +287,8 @@ int main(int argc, char *argv[]) {
         assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &text) >= 0);
         printf(">>>%s<<<\n", text);
 
+        test_catalog_get_cached();
+
         if (database)
                 unlink(database);
 
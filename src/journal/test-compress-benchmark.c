@@ -21,10 +21,12 @@
 #include "alloc-util.h"
 #include "compress.h"
 #include "env-util.h"
+#include "fileio.h"
 #include "macro.h"
 #include "parse-util.h"
 #include "random-util.h"
 #include "string-util.h"
+#include "strv.h"
 #include "util.h"
 
 typedef int (compress_t)(const void *src, uint64_t src_size, void *dst,
@@ -32,7 +34,7 @@ typedef int (compress_t)(const void *src, uint64_t src_size, void *dst,
 typedef int (decompress_t)(const void *src, uint64_t src_size,
                            void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
 
 static usec_t arg_duration;
 static size_t arg_start;
@@ -82,6 +84,16 @@ static char* make_buf(size_t count, const char *type) {
                 memzero(buf + 7*step, step);
                 random_bytes(buf + 8*step, step);
                 memzero(buf + 9*step, step);
+        } else if (streq(type, "journal")) {
+                _cleanup_free_ char *t = NULL;
+                size_t n = 0;
+
+                /* Real journal data, e.g. from "journalctl -o export", repeated as often as needed */
+                assert_se(read_full_file(getenv("SYSTEMD_TEST_JOURNAL_EXPORT"), &t, &n) >= 0);
+                assert_se(n > 0);
+
+                for (i = 0; i < count; i++)
+                        buf[i] = t[i % n];
         } else
                 assert_not_reached("here");
 
@@ -118,7 +130,7 @@ static void test_compress_decompress(const char* label, const char* type,
 
                 r = compress(text, size, buf, size, &j);
                 /* assume compression must be successful except for small or random inputs */
-                assert_se(r == 0 || (size < 2048 && r == -ENOBUFS) || streq(type, "random"));
+                assert_se(r == 0 || (size < 2048 && r == -ENOBUFS) || STR_IN_SET(type, "random", "journal"));
 
                 /* check for overwrites */
                 assert_se(buf[size] == 0);
@@ -158,7 +170,7 @@ static void test_compress_decompress(const char* label, const char* type,
 #endif
 
 int main(int argc, char *argv[]) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         const char *i;
         int r;
 
@@ -183,12 +195,18 @@ int main(int argc, char *argv[]) {
         else
                 arg_start = getpid_cached();
 
-        NULSTR_FOREACH(i, "zeros\0simple\0random\0") {
+        NULSTR_FOREACH(i, "zeros\0simple\0random\0journal\0") {
+                if (streq(i, "journal") && !getenv("SYSTEMD_TEST_JOURNAL_EXPORT"))
+                        continue;
+
 #if HAVE_XZ
                 test_compress_decompress("XZ", i, compress_blob_xz, decompress_blob_xz);
 #endif
 #if HAVE_LZ4
                 test_compress_decompress("LZ4", i, compress_blob_lz4, decompress_blob_lz4);
+#endif
+#if HAVE_ZSTD
+                test_compress_decompress("ZSTD", i, compress_blob_zstd, decompress_blob_zstd);
 #endif
         }
         return 0;
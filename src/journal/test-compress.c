@@ -24,10 +24,12 @@
 
 #include "alloc-util.h"
 #include "compress.h"
+#include "copy.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "macro.h"
 #include "path-util.h"
+#include "process-util.h"
 #include "random-util.h"
 #include "util.h"
 
@@ -54,9 +56,11 @@ typedef int (decompress_sw_t)(const void *src, uint64_t src_size,
                               uint8_t extra);
 
 typedef int (compress_stream_t)(int fdf, int fdt, uint64_t max_bytes);
+typedef int (compress_stream_tee_t)(int fdf, int fdt, uint64_t max_bytes,
+                                   compress_tee_t tee, void *userdata, uint64_t *ret_size);
 typedef int (decompress_stream_t)(int fdf, int fdt, uint64_t max_size);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
 static void test_compress_decompress(int compression,
                                      compress_blob_t compress,
                                      decompress_blob_t decompress,
@@ -212,6 +216,73 @@ static void test_compress_stream(int compression,
         assert_se(unlink(pattern) == 0);
         assert_se(unlink(pattern2) == 0);
 }
+
+static int tee_count(const void *data, size_t size, void *userdata) {
+        uint64_t *n = userdata;
+
+        *n += size;
+        return 0;
+}
+
+static void test_compress_stream_tee(int compression,
+                                     compress_stream_tee_t compress,
+                                     decompress_stream_t decompress,
+                                     const char *srcfile) {
+
+        _cleanup_close_ int src = -1, dst = -1, dst2 = -1;
+        _cleanup_close_pair_ int pipefd[2] = { -1, -1 };
+        char pattern[] = "/tmp/systemd-test.compressed.XXXXXX",
+             pattern2[] = "/tmp/systemd-test.compressed.XXXXXX";
+        uint64_t copied = 0, size = 0;
+        struct stat st = {};
+        pid_t pid;
+
+        log_debug("/* testing %s compression from a pipe */",
+                  object_compressed_to_string(compression));
+
+        assert_se((src = open(srcfile, O_RDONLY|O_CLOEXEC)) >= 0);
+        assert_se(fstat(src, &st) == 0);
+        assert_se(st.st_size > 2);
+
+        assert_se((dst = mkostemp_safe(pattern)) >= 0);
+        assert_se((dst2 = mkostemp_safe(pattern2)) >= 0);
+
+        /* Feed the file through a pipe, cut off in the middle */
+        assert_se(pipe2(pipefd, O_CLOEXEC) == 0);
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0) {
+                pipefd[0] = safe_close(pipefd[0]);
+                (void) copy_bytes(src, pipefd[1], (uint64_t) -1, 0);
+                _exit(EXIT_SUCCESS);
+        }
+        pipefd[1] = safe_close(pipefd[1]);
+
+        assert_se(compress(pipefd[0], dst, st.st_size / 2, tee_count, &copied, &size) == 1);
+        assert_se(size == (uint64_t) st.st_size / 2);
+        assert_se(copied == size);
+
+        pipefd[0] = safe_close(pipefd[0]);
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+
+        assert_se(lseek(dst, 0, SEEK_SET) == 0);
+        assert_se(decompress(dst, dst2, st.st_size) == 0);
+        assert_se(fstat(dst2, &st) == 0);
+        assert_se((uint64_t) st.st_size == size);
+
+        /* And the whole file again, which should not be reported as truncated */
+        assert_se(lseek(src, 0, SEEK_SET) == 0);
+        assert_se(ftruncate(dst, 0) == 0);
+        assert_se(lseek(dst, 0, SEEK_SET) == 0);
+        copied = 0;
+        assert_se(compress(src, dst, (uint64_t) -1, tee_count, &copied, &size) == 0);
+        assert_se(fstat(src, &st) == 0);
+        assert_se(size == (uint64_t) st.st_size);
+        assert_se(copied == size);
+
+        assert_se(unlink(pattern) == 0);
+        assert_se(unlink(pattern2) == 0);
+}
 #endif
 
 #if HAVE_LZ4
@@ -257,7 +328,7 @@ static void test_lz4_decompress_partial(void) {
 #endif
 
 int main(int argc, char *argv[]) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_XZ || HAVE_LZ4 || HAVE_ZSTD
         const char text[] =
                 "text\0foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF"
                 "foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF";
@@ -294,6 +365,8 @@ int main(int argc, char *argv[]) {
 
         test_compress_stream(OBJECT_COMPRESSED_XZ, "xzcat",
                              compress_stream_xz, decompress_stream_xz, srcfile);
+        test_compress_stream_tee(OBJECT_COMPRESSED_XZ,
+                                 compress_stream_xz_tee, decompress_stream_xz, srcfile);
 #else
         log_info("/* XZ test skipped */");
 #endif
@@ -316,12 +389,33 @@ int main(int argc, char *argv[]) {
 
         test_compress_stream(OBJECT_COMPRESSED_LZ4, "lz4cat",
                              compress_stream_lz4, decompress_stream_lz4, srcfile);
+        test_compress_stream_tee(OBJECT_COMPRESSED_LZ4,
+                                 compress_stream_lz4_tee, decompress_stream_lz4, srcfile);
 
         test_lz4_decompress_partial();
 #else
         log_info("/* LZ4 test skipped */");
 #endif
 
+#if HAVE_ZSTD
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 text, sizeof(text), false);
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 data, sizeof(data), true);
+
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   text, sizeof(text), false);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   data, sizeof(data), true);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   huge, sizeof(huge), true);
+#else
+        log_info("/* ZSTD test skipped */");
+#endif
+
         return 0;
 #else
         return EXIT_TEST_SKIP;
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* A synthetic, reproducible workload: every entry carries the same set of fields, with values cycling
+ * through fixed ranges, and timestamps derived from the entry index only. */
+
+#define N_UNITS 100U
+#define N_SEEKS 1000U
+#define REALTIME_BASE (1500000000ULL * USEC_PER_SEC)
+
+static void make_entry(unsigned i, char fields[5][64], struct iovec iovec[5]) {
+        unsigned k;
+
+        xsprintf(fields[0], "MESSAGE=benchmark message number %u", i);
+        xsprintf(fields[1], "PRIORITY=%u", i % 8);
+        xsprintf(fields[2], "_SYSTEMD_UNIT=unit-%u.service", i % N_UNITS);
+        xsprintf(fields[3], "_PID=%u", 1000 + i % 1000);
+        strcpy(fields[4], "_HOSTNAME=benchmark");
+
+        for (k = 0; k < 5; k++)
+                iovec[k] = IOVEC_MAKE_STRING(fields[k]);
+}
+
+static void benchmark_append(const char *fn, unsigned n) {
+        char name[DECIMAL_STR_MAX(unsigned) + 16];
+        JournalFile *f;
+        unsigned i;
+        usec_t ts;
+
+        assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0644, true, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                char fields[5][64];
+                struct iovec iovec[5];
+                dual_timestamp t = {
+                        .realtime = REALTIME_BASE + i,
+                        .monotonic = i + 1,
+                };
+
+                make_entry(i, fields, iovec);
+                assert_se(journal_file_append_entry(f, &t, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+        xsprintf(name, "journal.append.%u", n);
+        benchmark_report(name, n, now(CLOCK_MONOTONIC) - ts);
+
+        (void) journal_file_close(f);
+}
+
+static void benchmark_next(const char *fn, unsigned n) {
+        char name[DECIMAL_STR_MAX(unsigned) + 32];
+        const char *paths[] = { fn, NULL };
+        sd_journal *j;
+        unsigned c = 0;
+        usec_t ts;
+
+        assert_se(sd_journal_open_files(&j, paths, 0) >= 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                c++;
+        }
+        xsprintf(name, "journal.query.next.%u", n);
+        benchmark_report(name, c, now(CLOCK_MONOTONIC) - ts);
+        assert_se(c == n);
+
+        sd_journal_close(j);
+}
+
+static void benchmark_match(const char *fn, unsigned n) {
+        char name[DECIMAL_STR_MAX(unsigned) + 32];
+        const char *paths[] = { fn, NULL };
+        unsigned c = 0, expected = 0, i;
+        sd_journal *j;
+        usec_t ts;
+
+        assert_se(sd_journal_open_files(&j, paths, 0) >= 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(sd_journal_add_match(j, "_SYSTEMD_UNIT=unit-7.service", 0) >= 0);
+        assert_se(sd_journal_add_match(j, "PRIORITY=7", 0) >= 0);
+        SD_JOURNAL_FOREACH(j)
+                c++;
+        xsprintf(name, "journal.query.match.%u", n);
+        benchmark_report(name, c, now(CLOCK_MONOTONIC) - ts);
+
+        for (i = 0; i < n; i++)
+                if (i % N_UNITS == 7 && i % 8 == 7)
+                        expected++;
+        assert_se(c == expected);
+
+        sd_journal_close(j);
+}
+
+static void benchmark_seek(const char *fn, unsigned n) {
+        char name[DECIMAL_STR_MAX(unsigned) + 32];
+        const char *paths[] = { fn, NULL };
+        sd_journal *j;
+        unsigned i;
+        usec_t ts;
+
+        assert_se(sd_journal_open_files(&j, paths, 0) >= 0);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_SEEKS; i++) {
+                /* Spread the seeks over the whole file, in an order that doesn't favour caching */
+                uint64_t p = ((uint64_t) i * 7919) % n;
+
+                assert_se(sd_journal_seek_realtime_usec(j, REALTIME_BASE + p) >= 0);
+                assert_se(sd_journal_next(j) > 0);
+        }
+        xsprintf(name, "journal.query.seek-realtime.%u", n);
+        benchmark_report(name, N_SEEKS, now(CLOCK_MONOTONIC) - ts);
+
+        sd_journal_close(j);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        char t[] = "/tmp/journal-benchmark-XXXXXX";
+        const char *fn;
+        unsigned n;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+        else
+                n = slow_tests_enabled() ? 1000000 : 10000;
+
+        assert_se(mkdtemp(t));
+        assert_se(dir = strdup(t));
+        fn = strjoina(t, "/benchmark.journal");
+
+        benchmark_append(fn, n);
+        benchmark_next(fn, n);
+        benchmark_match(fn, n);
+        benchmark_seek(fn, n);
+
+        return 0;
+}
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "journal-boot-index.h"
+#include "journal-file.h"
+#include "log.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "util.h"
+
+static sd_id128_t boot_a, boot_b, boot_c;
+
+static void append(JournalFile *f, sd_id128_t boot_id, usec_t realtime, uint64_t *seqnum) {
+        char buf[sizeof("_BOOT_ID=") + SD_ID128_STRING_MAX];
+        dual_timestamp ts = {
+                .realtime = realtime,
+                .monotonic = realtime,
+        };
+        struct iovec iovec[2];
+
+        xsprintf(buf, "_BOOT_ID=" SD_ID128_FORMAT_STR, SD_ID128_FORMAT_VAL(boot_id));
+        iovec[0] = IOVEC_MAKE_STRING(buf);
+        iovec[1] = IOVEC_MAKE_STRING("MESSAGE=boot");
+
+        assert_se(journal_file_append_entry(f, &ts, iovec, 2, seqnum, NULL, NULL) == 0);
+}
+
+static void check_boots(const char *directory) {
+        _cleanup_free_ JournalBoot *boots = NULL;
+        sd_journal *j;
+        size_t n;
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+        assert_se(journal_get_boots(j, &boots, &n) >= 0);
+        sd_journal_close(j);
+
+        /* Boot b spans both files */
+        assert_se(n == 3);
+
+        assert_se(sd_id128_equal(boots[0].id, boot_a));
+        assert_se(boots[0].first == 100 && boots[0].last == 200);
+        assert_se(boots[0].first_seqnum == 1 && boots[0].last_seqnum == 2);
+
+        assert_se(sd_id128_equal(boots[1].id, boot_b));
+        assert_se(boots[1].first == 300 && boots[1].last == 400);
+        assert_se(boots[1].first_seqnum == 3 && boots[1].last_seqnum == 4);
+
+        assert_se(sd_id128_equal(boots[2].id, boot_c));
+        assert_se(boots[2].first == 500 && boots[2].last == 600);
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-boot-index-XXXXXX";
+        _cleanup_free_ char *index = NULL;
+        _cleanup_free_ JournalBoot *boots = NULL;
+        JournalFile *f;
+        uint64_t seqnum = 0;
+        sd_journal *j;
+        size_t n;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(sd_id128_randomize(&boot_a) >= 0);
+        assert_se(sd_id128_randomize(&boot_b) >= 0);
+        assert_se(sd_id128_randomize(&boot_c) >= 0);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "system@00000000000000000000000000000000-0000000000000001-0000000000000001.journal",
+                                    O_RDWR|O_CREAT, 0644, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+        append(f, boot_a, 100, &seqnum);
+        append(f, boot_a, 200, &seqnum);
+        append(f, boot_b, 300, &seqnum);
+        f->archive = true;
+        (void) journal_file_close(f);
+
+        assert_se(journal_file_open(-1, "system.journal", O_RDWR|O_CREAT, 0644, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+        append(f, boot_b, 400, &seqnum);
+        append(f, boot_c, 500, &seqnum);
+        append(f, boot_c, 600, &seqnum);
+        (void) journal_file_close(f);
+
+        check_boots(t);
+
+        /* The archived file has been recorded in the index now, the online one not */
+        assert_se(read_full_file(".boot-index", &index, NULL) >= 0);
+        assert_se(strstr(index, "system@"));
+        assert_se(!strstr(index, " system.journal"));
+
+        /* And the second time around the index is used, with the same result */
+        check_boots(t);
+
+        /* Files with entries that lack _BOOT_ID= need to be looked at the slow way */
+        assert_se(journal_file_open(-1, "user-1000.journal", O_RDWR|O_CREAT, 0644, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_append_entry(f, NULL, &IOVEC_MAKE_STRING("MESSAGE=no boot"), 1, NULL, NULL, NULL) == 0);
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(journal_get_boots(j, &boots, &n) == -ENODATA);
+        sd_journal_close(j);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
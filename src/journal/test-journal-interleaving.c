@@ -206,6 +206,71 @@ static void test_skip(void (*setup)(void)) {
         puts("------------------------------------------------------------");
 }
 
+static void test_cursor_seek(sd_journal *j, const char *cursor, int n) {
+        assert_ret(sd_journal_seek_cursor(j, cursor));
+        assert_se(sd_journal_next(j) > 0);
+        test_check_number(j, n);
+        assert_se(sd_journal_test_cursor(j, cursor) > 0);
+
+        assert_ret(sd_journal_seek_cursor(j, cursor));
+        assert_se(sd_journal_previous(j) > 0);
+        test_check_number(j, n);
+}
+
+static void test_cursor(void (*setup)(void)) {
+        char t[] = "/tmp/journal-cursor-XXXXXX";
+        char *cursors[4] = {};
+        sd_journal *j;
+        int i;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        setup();
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        for (i = 0; i < 4; i++) {
+                assert_se(sd_journal_next(j) > 0);
+                assert_ret(sd_journal_get_cursor(j, &cursors[i]));
+        }
+        sd_journal_close(j);
+
+        /* Seek to each cursor in a new instance, with and without the
+         * file and offset hints, and with a bogus offset hint. */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        for (i = 3; i >= 0; i--) {
+                _cleanup_free_ char *nohint = NULL, *badhint = NULL;
+                char *p;
+
+                test_cursor_seek(j, cursors[i], i + 1);
+
+                p = strstr(cursors[i], ";f=");
+                assert_se(p);
+                assert_se(nohint = strndup(cursors[i], p - cursors[i]));
+                test_cursor_seek(j, nohint, i + 1);
+
+                p = strstr(cursors[i], ";o=");
+                assert_se(p);
+                assert_se(asprintf(&badhint, "%.*s10", (int) (p - cursors[i] + 3), cursors[i]) >= 0);
+                test_cursor_seek(j, badhint, i + 1);
+        }
+        sd_journal_close(j);
+
+        for (i = 0; i < 4; i++)
+                free(cursors[i]);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_sequence_numbers(void) {
 
         char t[] = "/tmp/journal-seq-XXXXXX";
@@ -301,6 +366,9 @@ int main(int argc, char *argv[]) {
         test_skip(setup_sequential);
         test_skip(setup_interleaved);
 
+        test_cursor(setup_sequential);
+        test_cursor(setup_interleaved);
+
         test_sequence_numbers();
 
         return 0;
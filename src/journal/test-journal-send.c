@@ -42,6 +42,12 @@ int main(int argc, char *argv[]) {
         struct iovec message2[] = {
                 {(char*) "MESSAGE=graph\n", strlen("MESSAGE=graph\n")}
         };
+        struct iovec batch[] = {
+                {(char*) "MESSAGE=batch1", strlen("MESSAGE=batch1")},
+                {NULL, 0},
+                {(char*) "MESSAGE=batch2\n", strlen("MESSAGE=batch2\n")},
+                {(char*) "PRIORITY=6", strlen("PRIORITY=6")},
+        };
 
         assert_se(sd_journal_print(LOG_INFO, "piepapo") == 0);
 
@@ -97,6 +103,11 @@ int main(int argc, char *argv[]) {
         assert_se(sd_journal_sendv(message1, 1) == 0);
         assert_se(sd_journal_sendv(message2, 1) == 0);
 
+        assert_se(sd_journal_sendv_batch(batch, ELEMENTSOF(batch)) == 0);
+        assert_se(sd_journal_sendv_batch(batch, 1) == 0);
+        assert_se(sd_journal_sendv_batch(batch, 2) == -EINVAL);
+        assert_se(sd_journal_sendv_batch(batch + 1, 2) == -EINVAL);
+
         sleep(1);
 
         return 0;
@@ -77,7 +77,8 @@ static void verify_contents(sd_journal *j, unsigned skip) {
 int main(int argc, char *argv[]) {
         JournalFile *one, *two, *three;
         char t[] = "/tmp/journal-stream-XXXXXX";
-        unsigned i;
+        unsigned i, quux;
+        uint64_t count;
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         char *z;
         const void *data;
@@ -188,8 +189,29 @@ int main(int argc, char *argv[]) {
         verify_contents(j, 0);
 
         assert_se(sd_journal_query_unique(j, "NUMBER") >= 0);
-        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+        i = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l) {
                 printf("%.*s\n", (int) l, (const char*) data);
+                i++;
+        }
+        assert_se(i == N_ENTRIES);
+
+        /* Each entry with MAGIC=quux is in one file, or in two for every third one not in three.journal */
+        for (i = 0, quux = 0; i < N_ENTRIES; i += 5)
+                quux += i % 10 != 0 && i % 3 == 0 ? 2 : 1;
+
+        assert_se(sd_journal_query_unique(j, "MAGIC") >= 0);
+        i = 0;
+        while (sd_journal_enumerate_unique_with_count(j, &data, &l, &count) > 0) {
+                printf("%.*s %" PRIu64 "\n", (int) l, (const char*) data, count);
+
+                if (l == strlen("MAGIC=quux") && memcmp(data, "MAGIC=quux", l) == 0)
+                        assert_se(count == quux);
+                else
+                        assert_se(l == strlen("MAGIC=waldo") && memcmp(data, "MAGIC=waldo", l) == 0);
+                i++;
+        }
+        assert_se(i == 2);
 
         assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
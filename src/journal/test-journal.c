@@ -21,11 +21,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "sd-journal.h"
+
+#include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "log.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
 
 static bool arg_keep = false;
 
@@ -165,6 +171,500 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
+static void test_append_entries(void) {
+        static const char host[] = "_HOSTNAME=batch", a[] = "MESSAGE=a", b[] = "MESSAGE=b";
+        struct iovec iovec[4];
+        JournalAppendItem batch[3];
+        JournalFile *f;
+        uint64_t p, seqnum = 0;
+        unsigned n = 0;
+        Object *o;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test-batch.journal", O_RDWR|O_CREAT, 0666, true, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        iovec[0] = IOVEC_MAKE_STRING(host);
+        iovec[1] = IOVEC_MAKE_STRING(a);
+        iovec[2] = IOVEC_MAKE_STRING(host);
+        iovec[3] = IOVEC_MAKE_STRING(b);
+
+        dual_timestamp_get(&batch[0].ts);
+        batch[0].iovec = iovec;
+        batch[0].n_iovec = 2;
+        batch[1].ts = batch[0].ts;
+        batch[1].iovec = iovec + 2;
+        batch[1].n_iovec = 2;
+        batch[2].ts = batch[0].ts;
+        batch[2].iovec = iovec;
+        batch[2].n_iovec = 2;
+
+        assert_se(journal_file_append_entries(f, batch, 0, &seqnum, &n) == 0);
+        assert_se(n == 0);
+
+        assert_se(journal_file_append_entries(f, batch, ELEMENTSOF(batch), &seqnum, &n) == 0);
+        assert_se(n == 3);
+        assert_se(seqnum == 3);
+
+        assert_se(le64toh(f->header->n_entries) == 3);
+        assert_se(le64toh(f->header->n_data) == 3);
+
+        assert_se(journal_file_find_data_object(f, host, strlen(host), NULL, &p) == 1);
+        assert_se(journal_file_move_to_object(f, OBJECT_DATA, p, &o) >= 0);
+        assert_se(le64toh(o->data.n_entries) == 3);
+
+        assert_se(journal_file_find_data_object(f, a, strlen(a), NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 3);
+
+        assert_se(journal_file_find_data_object(f, b, strlen(b), NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 2);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_unique_values(void) {
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test-unique.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Lookups for fresh values are answered from the in-memory filter of the writer, make sure it never
+         * hides objects that are actually there */
+        for (i = 0; i < 2000; i++) {
+                char buf[sizeof("UNIQUE=") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec;
+
+                xsprintf(buf, "UNIQUE=%u", i / 2);
+                iovec = IOVEC_MAKE_STRING(buf);
+                assert_se(journal_file_append_entry(f, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(le64toh(f->header->n_entries) == 2000);
+        assert_se(le64toh(f->header->n_data) == 1000);
+
+        for (i = 0; i < 1000; i++) {
+                char buf[sizeof("UNIQUE=") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(buf, "UNIQUE=%u", i);
+                assert_se(journal_file_find_data_object(f, buf, strlen(buf), NULL, NULL) == 1);
+
+                xsprintf(buf, "UNIQUE=%u", i + 1000);
+                assert_se(journal_file_find_data_object(f, buf, strlen(buf), NULL, NULL) == 0);
+        }
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_bloom(void) {
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i, n_absent = 0;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test-bloom.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 100; i++) {
+                char buf[sizeof("_SYSTEMD_UNIT=.service") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec[2];
+
+                xsprintf(buf, "_SYSTEMD_UNIT=%u.service", i);
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING("MESSAGE=bloom");
+                assert_se(journal_file_append_entry(f, NULL, iovec, 2, NULL, NULL, NULL) == 0);
+        }
+
+        f->archive = true;
+        (void) journal_file_close(f);
+
+        assert_se(journal_file_open(-1, "test-bloom.journal", O_RDONLY, 0, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(f->header->state == STATE_ARCHIVED);
+
+        for (i = 0; i < 1000; i++) {
+                char buf[sizeof("_SYSTEMD_UNIT=.service") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(buf, "_SYSTEMD_UNIT=%u.service", i);
+
+                /* Values that are in the file must never be filtered out */
+                if (i < 100)
+                        assert_se(journal_file_may_contain_data(f, buf, strlen(buf), journal_file_hash_data(f, buf, strlen(buf))));
+                else if (!journal_file_may_contain_data(f, buf, strlen(buf), journal_file_hash_data(f, buf, strlen(buf))))
+                        n_absent++;
+        }
+
+        /* Fields that aren't covered by the filter have to be looked up */
+        assert_se(journal_file_may_contain_data(f, "MESSAGE=other", strlen("MESSAGE=other"), journal_file_hash_data(f, "MESSAGE=other", strlen("MESSAGE=other"))));
+
+        /* The file system might not support user extended attributes, in which case there's no filter */
+        if (f->data_bloom)
+                assert_se(n_absent > 850);
+        else
+                assert_se(n_absent == 0);
+
+        log_info("Bloom filter excluded %u of 900 absent values", n_absent);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_vacuum_index(void) {
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test-vacuum.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        /* Three non-empty archived files, and an empty one */
+        for (i = 0; i < 4; i++) {
+                struct iovec iovec = IOVEC_MAKE_STRING("MESSAGE=vacuum");
+
+                if (i < 3)
+                        assert_se(journal_file_append_entry(f, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+
+                assert_se(journal_file_rotate(&f, false, false, NULL) >= 0);
+        }
+
+        (void) journal_file_close(f);
+
+        /* The first run indexes the files and drops the empty one, the second one uses the index, and the last one
+         * deletes all but one archived file, and updates the index accordingly */
+        assert_se(journal_directory_vacuum(".", 0, 100, 0, NULL, true) >= 0);
+        assert_se(access(".vacuum-index", F_OK) >= 0);
+        assert_se(journal_directory_vacuum(".", 0, 100, 0, NULL, true) >= 0);
+        assert_se(journal_directory_vacuum(".", 0, 2, 0, NULL, true) >= 0);
+
+        assert_se(journal_directory_vacuum(".", 0, 1, 0, NULL, true) >= 0);
+        assert_se(access(".vacuum-index", F_OK) >= 0);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_seek(void) {
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+        unsigned i, k;
+        Object *o;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test-seek.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < 1000; i++) {
+                struct iovec iovec = IOVEC_MAKE_STRING("SEEK=1");
+                dual_timestamp ts = {
+                        .realtime = 1000000 + i * 10,
+                        .monotonic = 1000 + i,
+                };
+
+                assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        /* Seek around wildly, so that later seeks make use of the entry array index built by earlier ones */
+        for (k = 0; k < 3; k++)
+                for (i = 0; i < 1000; i += 7) {
+                        unsigned j = (i * 337 + k * 101) % 1000;
+
+                        assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + j * 10, DIRECTION_DOWN, &o, NULL) == 1);
+                        assert_se(le64toh(o->entry.seqnum) == j + 1);
+
+                        assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + j * 10 + 5, DIRECTION_UP, &o, NULL) == 1);
+                        assert_se(le64toh(o->entry.seqnum) == j + 1);
+
+                        assert_se(journal_file_move_to_entry_by_seqnum(f, j + 1, DIRECTION_DOWN, &o, NULL) == 1);
+                        assert_se(le64toh(o->entry.realtime) == 1000000 + j * 10);
+                }
+
+        assert_se(f->n_entry_array_index > 0);
+
+        assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + 1000 * 10, DIRECTION_DOWN, &o, NULL) == 0);
+        assert_se(journal_file_move_to_entry_by_realtime(f, 1000000 + 999 * 10 + 1, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1000);
+        assert_se(journal_file_move_to_entry_by_realtime(f, 999999, DIRECTION_UP, &o, NULL) == 0);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_standby(void) {
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+        struct iovec iovec = IOVEC_MAKE_STRING("MESSAGE=standby");
+        sd_id128_t seqnum_id;
+        uint64_t seqnum = 0;
+        Object *o;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test-standby.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+        seqnum_id = f->header->seqnum_id;
+
+        assert_se(journal_file_prepare_standby(f, false, false) >= 0);
+        assert_se(f->standby);
+        assert_se(access(".#test-standby.journal.standby", F_OK) >= 0);
+
+        /* Entries appended after the standby was created are accounted for when it is taken */
+        assert_se(journal_file_append_entry(f, NULL, &iovec, 1, &seqnum, NULL, NULL) == 0);
+        assert_se(journal_file_append_entry(f, NULL, &iovec, 1, &seqnum, NULL, NULL) == 0);
+
+        assert_se(journal_file_rotate(&f, false, false, NULL) >= 0);
+        assert_se(!f->standby);
+        assert_se(streq(f->path, "test-standby.journal"));
+        assert_se(access(".#test-standby.journal.standby", F_OK) < 0 && errno == ENOENT);
+        assert_se(access("test-standby.journal", F_OK) >= 0);
+        assert_se(sd_id128_equal(f->header->seqnum_id, seqnum_id));
+        assert_se(le64toh(f->header->n_entries) == 0);
+
+        assert_se(journal_file_append_entry(f, NULL, &iovec, 1, &seqnum, &o, NULL) == 0);
+        assert_se(le64toh(o->entry.seqnum) == 3);
+
+        /* An unused standby file is removed when closing */
+        assert_se(journal_file_prepare_standby(f, false, false) >= 0);
+        assert_se(access(".#test-standby.journal.standby", F_OK) >= 0);
+        (void) journal_file_close(f);
+        assert_se(access(".#test-standby.journal.standby", F_OK) < 0 && errno == ENOENT);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_keyed_hash(void) {
+        JournalFile *keyed, *plain;
+        char t[] = "/tmp/journal-XXXXXX";
+        struct iovec iovec[] = {
+                IOVEC_MAKE_STRING("MESSAGE=both"),
+                IOVEC_MAKE_STRING("FOO=bar"),
+        };
+        struct iovec only = IOVEC_MAKE_STRING("MESSAGE=keyed");
+        dual_timestamp ts = {
+                .realtime = 1000000,
+                .monotonic = 1000,
+        };
+        const void *data;
+        size_t l;
+        Object *a, *b;
+        sd_journal *j;
+        unsigned n = 0;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(setenv("SYSTEMD_JOURNAL_KEYED_HASH", "1", 1) >= 0);
+        assert_se(journal_file_open(-1, "keyed.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, NULL, &keyed) == 0);
+        assert_se(unsetenv("SYSTEMD_JOURNAL_KEYED_HASH") >= 0);
+        assert_se(journal_file_open(-1, "plain.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, NULL, &plain) == 0);
+
+        assert_se(JOURNAL_HEADER_KEYED_HASH(keyed->header));
+        assert_se(!JOURNAL_HEADER_KEYED_HASH(plain->header));
+        assert_se(journal_file_hash_data(keyed, "FOO=bar", 7) != journal_file_hash_data(plain, "FOO=bar", 7));
+
+        assert_se(journal_file_append_entry(keyed, &ts, iovec, ELEMENTSOF(iovec), NULL, &a, NULL) == 0);
+        assert_se(journal_file_append_entry(plain, &ts, iovec, ELEMENTSOF(iovec), NULL, &b, NULL) == 0);
+
+        /* The same entry is recognizable as such in both files */
+        assert_se(a->entry.xor_hash == b->entry.xor_hash);
+
+        ts.realtime++;
+        ts.monotonic++;
+        assert_se(journal_file_append_entry(keyed, &ts, &only, 1, NULL, NULL, NULL) == 0);
+
+        assert_se(journal_file_find_data_object(keyed, "FOO=bar", 7, NULL, NULL) == 1);
+        assert_se(journal_file_find_field_object(keyed, "FOO", 3, NULL, NULL) == 1);
+        assert_se(journal_file_may_contain_data(keyed, "FOO=bar", 7, journal_file_hash_data(keyed, "FOO=bar", 7)));
+
+        (void) journal_file_close(keyed);
+        (void) journal_file_close(plain);
+
+        /* Reopening picks up the hash function from the header */
+        assert_se(journal_file_open(-1, "keyed.journal", O_RDONLY, 0666, false, false, NULL, NULL, NULL, NULL, &keyed) == 0);
+        assert_se(keyed->keyed_hash);
+        assert_se(journal_file_find_data_object(keyed, "MESSAGE=keyed", 13, NULL, NULL) == 1);
+        (void) journal_file_close(keyed);
+
+        /* Matches and unique values work across files with different hash functions */
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        assert_se(sd_journal_add_match(j, "FOO=bar", 0) >= 0);
+        SD_JOURNAL_FOREACH(j)
+                n++;
+        assert_se(n == 1);
+
+        sd_journal_flush_matches(j);
+        assert_se(sd_journal_add_match(j, "MESSAGE=keyed", 0) >= 0);
+        n = 0;
+        SD_JOURNAL_FOREACH(j)
+                n++;
+        assert_se(n == 1);
+
+        assert_se(sd_journal_query_unique(j, "MESSAGE") >= 0);
+        n = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+                n++;
+        assert_se(n == 2);
+
+        sd_journal_close(j);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_data_cache(void) {
+        JournalFile *f;
+        char t[] = "/tmp/journal-XXXXXX";
+        char big[4096 + sizeof("BIG=")], other[4096 + sizeof("OTHER=")];
+        struct iovec iovec[3];
+        const void *data, *first;
+        size_t l;
+        sd_journal *j;
+        unsigned n = 0;
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        memcpy(big, "BIG=", 4);
+        memset(big + 4, 'b', sizeof(big) - 5);
+        big[sizeof(big) - 1] = 0;
+        memcpy(other, "OTHER=", 6);
+        memset(other + 6, 'o', sizeof(other) - 7);
+        other[sizeof(other) - 1] = 0;
+
+        iovec[0] = IOVEC_MAKE_STRING("MESSAGE=cache");
+        iovec[1] = IOVEC_MAKE_STRING(big);
+        iovec[2] = IOVEC_MAKE_STRING(other);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_append_entry(f, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        (void) journal_file_close(f);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+
+        assert_se(sd_journal_get_data(j, "BIG", &first, &l) >= 0);
+        assert_se(l == strlen(big) && memcmp(first, big, l) == 0);
+
+        /* A different compressed object must not be confused with the cached one */
+        assert_se(sd_journal_get_data(j, "OTHER", &data, &l) >= 0);
+        assert_se(l == strlen(other) && memcmp(data, other, l) == 0);
+
+        /* The second lookup is served from the cache */
+        assert_se(sd_journal_get_data(j, "BIG", &data, &l) >= 0);
+        assert_se(data == first);
+        assert_se(l == strlen(big) && memcmp(data, big, l) == 0);
+
+        SD_JOURNAL_FOREACH_DATA(j, data, l)
+                if (l == strlen(big))
+                        assert_se(memcmp(data, big, l) == 0 || memcmp(data, other, l) == 0);
+
+        /* Changing the threshold must not return data truncated to the old one, or vice versa */
+        assert_se(sd_journal_set_data_threshold(j, 16) >= 0);
+        assert_se(sd_journal_get_data(j, "BIG", &data, &l) >= 0);
+        assert_se(l >= 16 && l < strlen(big) && memcmp(data, big, l) == 0);
+
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+        assert_se(sd_journal_get_data(j, "BIG", &data, &l) >= 0);
+        assert_se(l == strlen(big) && memcmp(data, big, l) == 0);
+
+        assert_se(j->data_cache_hit > 0);
+        assert_se(j->data_cache_size <= j->data_cache_max);
+
+        sd_journal_close(j);
+
+        /* With the cache disabled everything still works */
+        assert_se(setenv("SYSTEMD_JOURNAL_DATA_CACHE_MAX", "0", 1) >= 0);
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(unsetenv("SYSTEMD_JOURNAL_DATA_CACHE_MAX") >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                assert_se(sd_journal_get_data(j, "BIG", &data, &l) >= 0);
+                assert_se(l == strlen(big) && memcmp(data, big, l) == 0);
+                assert_se(sd_journal_get_data(j, "BIG", &data, &l) >= 0);
+                assert_se(l == strlen(big) && memcmp(data, big, l) == 0);
+                n++;
+        }
+        assert_se(n == 1);
+        assert_se(j->data_cache_hit == 0);
+        assert_se(!j->data_cache_lru);
+
+        sd_journal_close(j);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 int main(int argc, char *argv[]) {
         arg_keep = argc > 1;
 
@@ -173,6 +673,14 @@ int main(int argc, char *argv[]) {
                 return EXIT_TEST_SKIP;
 
         test_non_empty();
+        test_append_entries();
+        test_unique_values();
+        test_seek();
+        test_bloom();
+        test_vacuum_index();
+        test_standby();
+        test_keyed_hash();
+        test_data_cache();
         test_empty();
 
         return 0;
@@ -18,8 +18,10 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -30,7 +32,7 @@
 #include "util.h"
 
 int main(int argc, char *argv[]) {
-        MMapFileDescriptor *fx;
+        MMapFileDescriptor *fx, *fy;
         int x, y, z, r;
         char px[] = "/tmp/testmmapXXXXXXX", py[] = "/tmp/testmmapYXXXXXX", pz[] = "/tmp/testmmapZXXXXXX";
         MMapCache *m;
@@ -73,7 +75,62 @@ int main(int argc, char *argv[]) {
 
         assert_se((uint8_t*) p + 1 == (uint8_t*) q);
 
+        assert_se(mmap_cache_get_mapped(m) == 2);
+
+        /* With small windows, objects a bit apart need separate maps */
+        assert_se(mmap_cache_set_window_size(m, 64ULL*1024ULL) == 0);
+        mmap_cache_set_readahead(m, true);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 2, false, 32ULL*1024ULL*1024ULL, 2, NULL, &p, NULL);
+        assert_se(r >= 0);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 2, false, 32ULL*1024ULL*1024ULL + 1024ULL*1024ULL, 2, NULL, &q, NULL);
+        assert_se(r >= 0);
+
+        assert_se(mmap_cache_get_mapped(m) == 4);
+
+        /* Windows kept around forever are not enlarged beyond what was asked for */
+        r = mmap_cache_get(m, fx, PROT_READ, 3, true, 48ULL*1024ULL*1024ULL, 2, NULL, &p, NULL);
+        assert_se(r >= 0);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 3, false, 48ULL*1024ULL*1024ULL + page_size(), 2, NULL, &q, NULL);
+        assert_se(r >= 0);
+
+        assert_se(mmap_cache_get_mapped(m) == 6);
+
+        /* Released windows are unmapped, the ones still in use and the kept ones remain */
+        mmap_cache_fd_release(m, fx);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 0, false, 1, 2, NULL, &p, NULL);
+        assert_se(r >= 0);
+        assert_se(mmap_cache_get_mapped(m) == 7);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 2, false, 32ULL*1024ULL*1024ULL + 1024ULL*1024ULL, 2, NULL, &p, NULL);
+        assert_se(r >= 0);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 2, false, 48ULL*1024ULL*1024ULL, 2, NULL, &p, NULL);
+        assert_se(r >= 0);
+        assert_se(mmap_cache_get_mapped(m) == 7);
+
         mmap_cache_free_fd(m, fx);
+
+        /* Windows read with pread() see the file contents as well, but objects beyond the end of file fail */
+        assert_se(write(y, "foobar", 6) == 6);
+        assert_se(fy = mmap_cache_add_fd(m, y));
+        mmap_cache_fd_set_pread(m, fy, true);
+
+        r = mmap_cache_get(m, fy, PROT_READ, 0, false, 3, 3, NULL, &p, NULL);
+        assert_se(r >= 0);
+        assert_se(memcmp(p, "bar", 3) == 0);
+
+        r = mmap_cache_get(m, fy, PROT_READ, 1, false, 4, 4, NULL, &q, NULL);
+        assert_se(r >= 0);
+        assert_se((uint8_t*) p + 1 == (uint8_t*) q);
+
+        r = mmap_cache_get(m, fy, PROT_READ, 1, false, 1024ULL*1024ULL*1024ULL, 2, NULL, &q, NULL);
+        assert_se(r == -EIO);
+
+        mmap_cache_free_fd(m, fy);
         mmap_cache_unref(m);
 
         safe_close(x);
@@ -54,6 +54,26 @@ static void lldp_callback(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *
         lldp->callback(lldp, event, n, lldp->userdata);
 }
 
+static sd_lldp_neighbor *lldp_least_recently_seen(sd_lldp *lldp) {
+        sd_lldp_neighbor *n, *oldest = NULL;
+        usec_t oldest_seen = USEC_INFINITY;
+        Iterator i;
+
+        assert(lldp);
+
+        HASHMAP_FOREACH(n, lldp->neighbor_by_id, i) {
+                usec_t seen;
+
+                seen = usec_sub_unsigned(n->until, n->ttl * USEC_PER_SEC);
+                if (!oldest || seen < oldest_seen) {
+                        oldest = n;
+                        oldest_seen = seen;
+                }
+        }
+
+        return oldest;
+}
+
 static int lldp_make_space(sd_lldp *lldp, size_t extra) {
         usec_t t = USEC_INFINITY;
         bool changed = false;
@@ -61,27 +81,30 @@ static int lldp_make_space(sd_lldp *lldp, size_t extra) {
         assert(lldp);
 
         /* Remove all entries that are past their TTL, and more until at least the specified number of extra entries
-         * are free. */
+         * are free. When over the limit, the neighbors we heard from least recently go first, so that a flood of
+         * short-lived neighbors cannot push out the ones that keep refreshing. */
 
         for (;;) {
                 _cleanup_(sd_lldp_neighbor_unrefp) sd_lldp_neighbor *n = NULL;
-
-                n = prioq_peek(lldp->neighbor_by_expiry);
-                if (!n)
-                        break;
-
-                sd_lldp_neighbor_ref(n);
+                sd_lldp_neighbor *victim;
 
                 if (hashmap_size(lldp->neighbor_by_id) > LESS_BY(lldp->neighbors_max, extra))
-                        goto remove_one;
+                        victim = lldp_least_recently_seen(lldp);
+                else {
+                        victim = prioq_peek(lldp->neighbor_by_expiry);
+                        if (!victim)
+                                break;
+
+                        if (t == USEC_INFINITY)
+                                t = now(clock_boottime_or_monotonic());
 
-                if (t == USEC_INFINITY)
-                        t = now(clock_boottime_or_monotonic());
+                        if (victim->until > t)
+                                break;
+                }
 
-                if (n->until > t)
-                        break;
+                assert(victim);
+                n = sd_lldp_neighbor_ref(victim);
 
-        remove_one:
                 lldp_neighbor_unlink(n);
                 lldp_callback(lldp, SD_LLDP_EVENT_REMOVED, n);
                 changed = true;
@@ -507,7 +530,7 @@ _public_ int sd_lldp_get_neighbors(sd_lldp *lldp, sd_lldp_neighbor ***ret) {
 
 _public_ int sd_lldp_set_neighbors_max(sd_lldp *lldp, uint64_t m) {
         assert_return(lldp, -EINVAL);
-        assert_return(m <= 0, -EINVAL);
+        assert_return(m > 0, -EINVAL);
 
         lldp->neighbors_max = m;
         lldp_make_space(lldp, 0);
@@ -247,6 +247,66 @@ static void test_receive_oui_packet(sd_event *e) {
         assert_se(stop_lldp(lldp) == 0);
 }
 
+static void test_neighbors_max_evicts_least_recent(sd_event *e) {
+
+        uint8_t frame[] = {
+                /* Ethernet header */
+                0x01, 0x80, 0xc2, 0x00, 0x00, 0x03,     /* Destination MAC */
+                0x01, 0x02, 0x03, 0x04, 0x05, 0x06,     /* Source MAC */
+                0x88, 0xcc,                             /* Ethertype */
+                /* LLDP mandatory TLVs */
+                0x02, 0x07, 0x04, 0x00, 0x01, 0x02,     /* Chassis: MAC, 00:01:02:03:04:xx */
+                0x03, 0x04, 0x00,
+                0x04, 0x04, 0x05, 0x31, 0x2f, 0x33,     /* Port: interface name, "1/3" */
+                0x06, 0x02, 0x00, 0x78,                 /* TTL: 120 seconds */
+                0x00, 0x00                              /* End Of LLDPDU */
+        };
+        const size_t chassis_byte = 22, ttl_byte = 32;
+
+        sd_lldp *lldp;
+        sd_lldp_neighbor **neighbors;
+        const void *data;
+        size_t length;
+        uint8_t type;
+        bool seen_a = false, seen_c = false;
+        const char *c;
+        int i, n;
+
+        lldp_handler_calls = 0;
+        assert_se(start_lldp(&lldp, e, lldp_handler, NULL) == 0);
+        assert_se(sd_lldp_set_neighbors_max(lldp, 2) == 0);
+
+        /* neighbors A and B, then A again, then C: B must make room for C, even though it has the
+         * longer TTL */
+        for (c = "ABAC"; *c; c++) {
+                frame[chassis_byte] = *c;
+                frame[ttl_byte] = *c == 'B' ? 0xf0 : 0x78;
+                assert_se(write(test_fd[1], frame, sizeof(frame)) == sizeof(frame));
+                sd_event_run(e, 0);
+                usleep(1000);
+        }
+
+        n = sd_lldp_get_neighbors(lldp, &neighbors);
+        assert_se(n == 2);
+
+        for (i = 0; i < n; i++) {
+                assert_se(sd_lldp_neighbor_get_chassis_id(neighbors[i], &type, &data, &length) == 0);
+                assert_se(length == ETH_ALEN);
+
+                if (((const uint8_t*) data)[5] == 'A')
+                        seen_a = true;
+                else if (((const uint8_t*) data)[5] == 'C')
+                        seen_c = true;
+
+                sd_lldp_neighbor_unref(neighbors[i]);
+        }
+        free(neighbors);
+
+        assert_se(seen_a && seen_c);
+
+        assert_se(stop_lldp(lldp) == 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *e = NULL;
 
@@ -257,6 +317,7 @@ int main(int argc, char *argv[]) {
         test_receive_basic_packet(e);
         test_receive_incomplete_packet(e);
         test_receive_oui_packet(e);
+        test_neighbors_max_evicts_least_recent(e);
 
         return 0;
 }
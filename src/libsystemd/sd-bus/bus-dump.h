@@ -36,3 +36,5 @@ int bus_creds_dump(sd_bus_creds *c, FILE *f, bool terse);
 
 int bus_pcap_header(size_t snaplen, FILE *f);
 int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f);
+size_t bus_message_pcap_frame_size(sd_bus_message *m, size_t snaplen);
+void bus_message_pcap_frame_to_buffer(sd_bus_message *m, size_t snaplen, void *buffer);
@@ -19,236 +19,175 @@
 ***/
 
 #include "bus-gvariant.h"
-#include "bus-signature.h"
 #include "bus-type.h"
 
-int bus_gvariant_get_size(const char *signature) {
-        const char *p;
-        int sum = 0, r;
+static int analyze_sequence(const char **p, const char *e, char closing, size_t *ret_size, size_t *ret_alignment);
 
-        /* For fixed size structs. Fails for variable size structs. */
+static int analyze_complete_type(const char **p, const char *e, size_t *ret_size, size_t *ret_alignment) {
+        size_t sz, a;
+        char closing;
+        int r;
+
+        /* Determines fixed size and alignment of the single complete type at *p, and moves *p past
+         * it. Returns > 0 if the type is fixed size, 0 if it is variable size. */
 
-        p = signature;
-        while (*p != 0) {
-                size_t n;
+        if (*p >= e)
+                return -EINVAL;
+
+        switch (*((*p)++)) {
+
+        case SD_BUS_TYPE_BYTE:
+        case SD_BUS_TYPE_BOOLEAN:
+                *ret_size = *ret_alignment = 1;
+                return 1;
+
+        case SD_BUS_TYPE_INT16:
+        case SD_BUS_TYPE_UINT16:
+                *ret_size = *ret_alignment = 2;
+                return 1;
+
+        case SD_BUS_TYPE_INT32:
+        case SD_BUS_TYPE_UINT32:
+        case SD_BUS_TYPE_UNIX_FD:
+                *ret_size = *ret_alignment = 4;
+                return 1;
+
+        case SD_BUS_TYPE_INT64:
+        case SD_BUS_TYPE_UINT64:
+        case SD_BUS_TYPE_DOUBLE:
+                *ret_size = *ret_alignment = 8;
+                return 1;
 
-                r = signature_element_length(p, &n);
+        case SD_BUS_TYPE_STRING:
+        case SD_BUS_TYPE_OBJECT_PATH:
+        case SD_BUS_TYPE_SIGNATURE:
+                *ret_size = 0;
+                *ret_alignment = 1;
+                return 0;
+
+        case SD_BUS_TYPE_VARIANT:
+                *ret_size = 0;
+                *ret_alignment = 8;
+                return 0;
+
+        case SD_BUS_TYPE_ARRAY:
+                /* Arrays are aligned like their element type */
+                r = analyze_complete_type(p, e, &sz, &a);
                 if (r < 0)
                         return r;
-                else {
-                        char t[n+1];
-
-                        memcpy(t, p, n);
-                        t[n] = 0;
-
-                        r = bus_gvariant_get_alignment(t);
-                        if (r < 0)
-                                return r;
-
-                        sum = ALIGN_TO(sum, r);
-                }
-
-                switch (*p) {
-
-                case SD_BUS_TYPE_BOOLEAN:
-                case SD_BUS_TYPE_BYTE:
-                        sum += 1;
-                        break;
-
-                case SD_BUS_TYPE_INT16:
-                case SD_BUS_TYPE_UINT16:
-                        sum += 2;
-                        break;
-
-                case SD_BUS_TYPE_INT32:
-                case SD_BUS_TYPE_UINT32:
-                case SD_BUS_TYPE_UNIX_FD:
-                        sum += 4;
-                        break;
-
-                case SD_BUS_TYPE_INT64:
-                case SD_BUS_TYPE_UINT64:
-                case SD_BUS_TYPE_DOUBLE:
-                        sum += 8;
-                        break;
-
-                case SD_BUS_TYPE_STRUCT_BEGIN:
-                case SD_BUS_TYPE_DICT_ENTRY_BEGIN: {
-                        if (n == 2) {
-                                /* unary type () has fixed size of 1 */
-                                r = 1;
-                        } else {
-                                char t[n-1];
-
-                                memcpy(t, p + 1, n - 2);
-                                t[n - 2] = 0;
-
-                                r = bus_gvariant_get_size(t);
-                                if (r < 0)
-                                        return r;
-                        }
-
-                        sum += r;
-                        break;
-                }
-
-                case SD_BUS_TYPE_STRING:
-                case SD_BUS_TYPE_OBJECT_PATH:
-                case SD_BUS_TYPE_SIGNATURE:
-                case SD_BUS_TYPE_ARRAY:
-                case SD_BUS_TYPE_VARIANT:
-                        return -EINVAL;
 
-                default:
-                        assert_not_reached("Unknown signature type");
-                }
+                *ret_size = 0;
+                *ret_alignment = a;
+                return 0;
 
-                p += n;
-        }
+        case SD_BUS_TYPE_STRUCT_BEGIN:
+        case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
+                closing = (*p)[-1] == SD_BUS_TYPE_STRUCT_BEGIN ? SD_BUS_TYPE_STRUCT_END : SD_BUS_TYPE_DICT_ENTRY_END;
 
-        r = bus_gvariant_get_alignment(signature);
-        if (r < 0)
+                r = analyze_sequence(p, e, closing, &sz, &a);
+                if (r < 0)
+                        return r;
+
+                /* unary type () has fixed size of 1 */
+                if (r > 0 && sz == 0)
+                        sz = 1;
+
+                *ret_size = sz;
+                *ret_alignment = a;
                 return r;
 
-        return ALIGN_TO(sum, r);
+        default:
+                return -EINVAL;
+        }
 }
 
-int bus_gvariant_get_alignment(const char *signature) {
-        size_t alignment = 1;
-        const char *p;
+static int analyze_sequence(const char **p, const char *e, char closing, size_t *ret_size, size_t *ret_alignment) {
+        size_t sum = 0, alignment = 1;
+        bool fixed = true;
         int r;
 
-        p = signature;
-        while (*p != 0 && alignment < 8) {
-                size_t n;
-                int a;
+        while (*p < e && **p != closing) {
+                size_t sz, a;
 
-                r = signature_element_length(p, &n);
+                r = analyze_complete_type(p, e, &sz, &a);
                 if (r < 0)
                         return r;
 
-                switch (*p) {
+                if (a > alignment)
+                        alignment = a;
 
-                case SD_BUS_TYPE_BYTE:
-                case SD_BUS_TYPE_BOOLEAN:
-                case SD_BUS_TYPE_STRING:
-                case SD_BUS_TYPE_OBJECT_PATH:
-                case SD_BUS_TYPE_SIGNATURE:
-                        a = 1;
-                        break;
-
-                case SD_BUS_TYPE_INT16:
-                case SD_BUS_TYPE_UINT16:
-                        a = 2;
-                        break;
+                if (r == 0)
+                        fixed = false;
+                else if (fixed)
+                        sum = ALIGN_TO(sum, a) + sz;
+        }
 
-                case SD_BUS_TYPE_INT32:
-                case SD_BUS_TYPE_UINT32:
-                case SD_BUS_TYPE_UNIX_FD:
-                        a = 4;
-                        break;
+        if (closing != 0) {
+                if (*p >= e)
+                        return -EINVAL;
 
-                case SD_BUS_TYPE_INT64:
-                case SD_BUS_TYPE_UINT64:
-                case SD_BUS_TYPE_DOUBLE:
-                case SD_BUS_TYPE_VARIANT:
-                        a = 8;
-                        break;
+                (*p)++;
+        }
 
-                case SD_BUS_TYPE_ARRAY: {
-                        char t[n];
+        *ret_size = fixed ? ALIGN_TO(sum, alignment) : 0;
+        *ret_alignment = alignment;
+        return fixed;
+}
 
-                        memcpy(t, p + 1, n - 1);
-                        t[n - 1] = 0;
+int bus_gvariant_analyze(const char *signature, size_t n, size_t *ret_size, size_t *ret_alignment) {
+        const char *p = signature;
+        size_t sz, a;
+        int r;
 
-                        a = bus_gvariant_get_alignment(t);
-                        break;
-                }
+        assert(signature || n == 0);
 
-                case SD_BUS_TYPE_STRUCT_BEGIN:
-                case SD_BUS_TYPE_DICT_ENTRY_BEGIN: {
-                        char t[n-1];
+        /* Determines size and alignment of the first n characters of a signature, treated like the
+         * contents of a struct, in a single pass and without copying any sub-signatures. Returns > 0
+         * if the signature is fixed size, 0 if it is variable size, in which case the size returned
+         * is 0. */
 
-                        memcpy(t, p + 1, n - 2);
-                        t[n - 2] = 0;
+        r = analyze_sequence(&p, signature + n, 0, &sz, &a);
+        if (r < 0)
+                return r;
 
-                        a = bus_gvariant_get_alignment(t);
-                        break;
-                }
+        if (ret_size)
+                *ret_size = sz;
+        if (ret_alignment)
+                *ret_alignment = a;
 
-                default:
-                        assert_not_reached("Unknown signature type");
-                }
+        return r;
+}
 
-                if (a < 0)
-                        return a;
+int bus_gvariant_get_size(const char *signature) {
+        size_t sz;
+        int r;
 
-                assert(a > 0 && a <= 8);
-                if ((size_t) a > alignment)
-                        alignment = (size_t) a;
+        /* For fixed size structs. Fails for variable size structs. */
 
-                p += n;
-        }
+        r = bus_gvariant_analyze(signature, strlen(signature), &sz, NULL);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -EINVAL;
 
-        return alignment;
+        return (int) sz;
 }
 
-int bus_gvariant_is_fixed_size(const char *signature) {
-        const char *p;
+int bus_gvariant_get_alignment(const char *signature) {
+        size_t a;
         int r;
 
-        assert(signature);
-
-        p = signature;
-        while (*p != 0) {
-                size_t n;
+        r = bus_gvariant_analyze(signature, strlen(signature), NULL, &a);
+        if (r < 0)
+                return r;
 
-                r = signature_element_length(p, &n);
-                if (r < 0)
-                        return r;
+        return (int) a;
+}
 
-                switch (*p) {
-
-                case SD_BUS_TYPE_STRING:
-                case SD_BUS_TYPE_OBJECT_PATH:
-                case SD_BUS_TYPE_SIGNATURE:
-                case SD_BUS_TYPE_ARRAY:
-                case SD_BUS_TYPE_VARIANT:
-                        return 0;
-
-                case SD_BUS_TYPE_BYTE:
-                case SD_BUS_TYPE_BOOLEAN:
-                case SD_BUS_TYPE_INT16:
-                case SD_BUS_TYPE_UINT16:
-                case SD_BUS_TYPE_INT32:
-                case SD_BUS_TYPE_UINT32:
-                case SD_BUS_TYPE_UNIX_FD:
-                case SD_BUS_TYPE_INT64:
-                case SD_BUS_TYPE_UINT64:
-                case SD_BUS_TYPE_DOUBLE:
-                        break;
-
-                case SD_BUS_TYPE_STRUCT_BEGIN:
-                case SD_BUS_TYPE_DICT_ENTRY_BEGIN: {
-                        char t[n-1];
-
-                        memcpy(t, p + 1, n - 2);
-                        t[n - 2] = 0;
-
-                        r = bus_gvariant_is_fixed_size(t);
-                        if (r <= 0)
-                                return r;
-                        break;
-                }
-
-                default:
-                        assert_not_reached("Unknown signature type");
-                }
-
-                p += n;
-        }
+int bus_gvariant_is_fixed_size(const char *signature) {
+        assert(signature);
 
-        return true;
+        return bus_gvariant_analyze(signature, strlen(signature), NULL, NULL);
 }
 
 size_t bus_gvariant_determine_word_size(size_t sz, size_t extra) {
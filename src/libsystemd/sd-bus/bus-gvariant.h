@@ -22,6 +22,7 @@
 
 #include "macro.h"
 
+int bus_gvariant_analyze(const char *signature, size_t n, size_t *ret_size, size_t *ret_alignment);
 int bus_gvariant_get_size(const char *signature) _pure_;
 int bus_gvariant_get_alignment(const char *signature) _pure_;
 int bus_gvariant_is_fixed_size(const char *signature) _pure_;
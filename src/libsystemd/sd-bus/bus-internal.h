@@ -71,6 +71,9 @@ struct node {
         LIST_HEAD(struct node_vtable, vtables);
         LIST_HEAD(struct node_enumerator, enumerators);
         LIST_HEAD(struct node_object_manager, object_managers);
+
+        /* Introspection XML of the direct child nodes, dropped whenever one is added or removed */
+        char *child_introspection;
 };
 
 struct node_callback {
@@ -108,6 +111,9 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* Introspection XML of the vtable's members, generated on first use */
+        char *introspection;
+
         unsigned last_iteration;
 
         LIST_FIELDS(struct node_vtable, vtables);
@@ -210,6 +216,7 @@ struct sd_bus {
         bool exited:1;
         bool exit_triggered:1;
         bool is_local:1;
+        bool corked:1;
 
         int use_memfd;
 
@@ -282,6 +289,12 @@ struct sd_bus {
         struct memfd_cache memfd_cache[MEMFD_CACHE_MAX];
         unsigned n_memfd_cache;
 
+        /* Released message allocations, ready for reuse. This is
+         * protected by the memfd cache mutex, for the same
+         * reason. */
+        void *message_pool;
+        unsigned n_message_pool;
+
         pid_t original_pid;
 
         uint64_t hello_flags;
@@ -307,6 +320,7 @@ struct sd_bus {
         char *description;
 
         sd_bus_track *track_queue;
+        Hashmap *track_watches;
 
         LIST_HEAD(sd_bus_slot, slots);
         LIST_HEAD(sd_bus_track, tracks);
@@ -322,6 +336,12 @@ struct sd_bus {
 #define BUS_WQUEUE_MAX (192*1024)
 #define BUS_RQUEUE_MAX (192*1024)
 
+/* When corked, this many queued messages trigger a write even before the event loop gets around to it */
+#define BUS_WQUEUE_CORK_MAX 128U
+
+/* Upper limit on the iovecs we pass to a single sendmsg() when coalescing queued messages, well below IOV_MAX */
+#define BUS_WRITE_IOVEC_MAX 256U
+
 #define BUS_MESSAGE_SIZE_MAX (64*1024*1024)
 #define BUS_AUTH_SIZE_MAX (64*1024)
 
@@ -335,6 +355,8 @@ struct sd_bus {
 
 #define BUS_EXEC_ARGV_MAX 256
 
+#define BUS_MESSAGE_POOL_MAX 64
+
 bool interface_name_is_valid(const char *p) _pure_;
 bool service_name_is_valid(const char *p) _pure_;
 char* service_name_startswith(const char *a, const char *b);
@@ -361,6 +383,8 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m);
 
 int bus_rqueue_make_room(sd_bus *bus);
 
+int bus_set_cork(sd_bus *bus, bool b);
+
 bool bus_pid_changed(sd_bus *bus);
 
 char *bus_address_escape(const char *v);
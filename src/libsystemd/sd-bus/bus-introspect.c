@@ -43,6 +43,22 @@ int introspect_begin(struct introspect *i, bool trusted) {
         return 0;
 }
 
+int introspect_begin_fragment(struct introspect *i, bool trusted) {
+        assert(i);
+
+        /* Starts a piece of introspection XML that is meant to be cached
+         * and pasted into complete documents later on */
+
+        zero(*i);
+        i->trusted = trusted;
+
+        i->f = open_memstream(&i->introspection, &i->size);
+        if (!i->f)
+                return -ENOMEM;
+
+        return 0;
+}
+
 int introspect_write_default_interfaces(struct introspect *i, bool object_manager) {
         assert(i);
 
@@ -56,6 +72,18 @@ int introspect_write_default_interfaces(struct introspect *i, bool object_manage
         return 0;
 }
 
+void introspect_write_child_node(struct introspect *i, const char *path, const char *prefix) {
+        const char *e;
+
+        assert(i);
+        assert(path);
+        assert(prefix);
+
+        e = object_path_startswith(path, prefix);
+        if (e && e[0])
+                fprintf(i->f, " <node name=\"%s\"/>\n", e);
+}
+
 int introspect_write_child_nodes(struct introspect *i, Set *s, const char *prefix) {
         char *node;
 
@@ -63,12 +91,7 @@ int introspect_write_child_nodes(struct introspect *i, Set *s, const char *prefi
         assert(prefix);
 
         while ((node = set_steal_first(s))) {
-                const char *e;
-
-                e = object_path_startswith(node, prefix);
-                if (e && e[0])
-                        fprintf(i->f, " <node name=\"%s\"/>\n", e);
-
+                introspect_write_child_node(i, node, prefix);
                 free(node);
         }
 
@@ -203,6 +226,24 @@ int introspect_finish(struct introspect *i, sd_bus *bus, sd_bus_message *m, sd_b
         return 0;
 }
 
+int introspect_finish_fragment(struct introspect *i, char **ret) {
+        int r;
+
+        assert(i);
+        assert(ret);
+
+        r = fflush_and_check(i->f);
+        if (r < 0)
+                return r;
+
+        i->f = safe_fclose(i->f);
+
+        *ret = i->introspection;
+        i->introspection = NULL;
+
+        return 0;
+}
+
 void introspect_free(struct introspect *i) {
         assert(i);
 
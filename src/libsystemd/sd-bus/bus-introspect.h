@@ -34,8 +34,11 @@ struct introspect {
 };
 
 int introspect_begin(struct introspect *i, bool trusted);
+int introspect_begin_fragment(struct introspect *i, bool trusted);
 int introspect_write_default_interfaces(struct introspect *i, bool object_manager);
+void introspect_write_child_node(struct introspect *i, const char *path, const char *prefix);
 int introspect_write_child_nodes(struct introspect *i, Set *s, const char *prefix);
 int introspect_write_interface(struct introspect *i, const sd_bus_vtable *v);
 int introspect_finish(struct introspect *i, sd_bus *bus, sd_bus_message *m, sd_bus_message **reply);
+int introspect_finish_fragment(struct introspect *i, char **ret);
 void introspect_free(struct introspect *i);
@@ -63,6 +63,11 @@
  *  ` BUS_MATCH_SENDER
  *    ` BUS_MATCH_VALUE: value == miau
  *      ` BUS_MATCH_LEAF: E
+ *
+ * The value nodes of most compare nodes are kept in a hash table keyed by
+ * the value, so that only the matching branch has to be visited. This
+ * includes the namespace compares, which look up every prefix of the tested
+ * string that ends at a label boundary.
  */
 
 static inline bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
@@ -70,11 +75,18 @@ static inline bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static inline bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
+        return (t >= BUS_MATCH_SENDER && t <= BUS_MATCH_PATH_NAMESPACE) ||
                 (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST) ||
                 (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
 }
 
+static inline bool BUS_MATCH_IS_WELL_KNOWN_SENDER(struct bus_match_node *node) {
+        return node->type == BUS_MATCH_VALUE &&
+                node->parent->type == BUS_MATCH_SENDER &&
+                node->value.str[0] != ':';
+}
+
 static void bus_match_node_free(struct bus_match_node *node) {
         assert(node);
         assert(node->parent);
@@ -106,6 +118,16 @@ static void bus_match_node_free(struct bus_match_node *node) {
                 else if (BUS_MATCH_CAN_HASH(node->parent->type) && node->value.str)
                         hashmap_remove(node->parent->compare.children, node->value.str);
 
+                if (node->value.str && BUS_MATCH_IS_WELL_KNOWN_SENDER(node)) {
+                        if (node->prev)
+                                node->prev->next = node->next;
+                        else
+                                node->parent->compare.well_known = node->next;
+
+                        if (node->next)
+                                node->next->prev = node->prev;
+                }
+
                 free(node->value.str);
         }
 
@@ -256,6 +278,136 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_hashed(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                const char *value,
+                sd_bus_message *m) {
+
+        struct bus_match_node *found;
+
+        if (!value)
+                return 0;
+
+        found = hashmap_get(node->compare.children, value);
+        if (!found)
+                return 0;
+
+        return bus_match_run(bus, found, m);
+}
+
+static int bus_match_run_sender(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                const char *sender,
+                sd_bus_message *m) {
+
+        struct bus_match_node *c;
+        int r;
+
+        assert(node->type == BUS_MATCH_SENDER);
+
+        r = bus_match_run_hashed(bus, node, sender, m);
+        if (r != 0)
+                return r;
+
+        if (bus && bus->match_callbacks_modified)
+                return 0;
+
+        if (m->creds.mask & SD_BUS_CREDS_WELL_KNOWN_NAMES) {
+                char **i;
+
+                /* on kdbus we have the well known names list in the credentials, let's make use of that for an
+                 * accurate match */
+
+                STRV_FOREACH(i, m->creds.well_known_names) {
+                        if (streq_ptr(*i, sender))
+                                continue;
+
+                        r = bus_match_run_hashed(bus, node, *i, m);
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+
+                return 0;
+        }
+
+        /* If we don't have kdbus, we don't know the well-known names of the senders. In that, let's just hope that
+         * dbus-daemon doesn't send us stuff we didn't want. */
+
+        if (!sender || sender[0] != ':')
+                return 0;
+
+        for (c = node->compare.well_known; c; c = c->next) {
+                r = bus_match_run(bus, c, m);
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        return 0;
+}
+
+static int bus_match_run_namespace(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                char separator,
+                const char *value,
+                sd_bus_message *m) {
+
+        _cleanup_free_ char *prefix = NULL;
+        size_t i;
+        int r;
+
+        /* A namespace "a.b" matches "a.b" itself and everything below it, and "a.b." matches everything below
+         * "a.b". Hence look up every prefix of the value that ends right before or right after a separator. If
+         * the value has two separators in a row, the former and the latter are the same string, so skip it the
+         * second time. */
+
+        if (!value)
+                return 0;
+
+        prefix = strdup(value);
+        if (!prefix)
+                return -ENOMEM;
+
+        for (i = 0;; i++) {
+                char c = value[i];
+
+                if (c != separator && c != 0)
+                        continue;
+
+                if (i == 0 || value[i-1] != separator) {
+                        prefix[i] = 0;
+                        r = bus_match_run_hashed(bus, node, prefix, m);
+                        prefix[i] = c;
+                        if (r != 0)
+                                return r;
+
+                        if (bus && bus->match_callbacks_modified)
+                                return 0;
+                }
+
+                if (c == 0)
+                        return 0;
+
+                c = prefix[i+1];
+                prefix[i+1] = 0;
+                r = bus_match_run_hashed(bus, node, prefix, m);
+                prefix[i+1] = c;
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -388,7 +540,22 @@ int bus_match_run(
                 assert_not_reached("Unknown match type.");
         }
 
-        if (BUS_MATCH_CAN_HASH(node->type)) {
+        if (node->type == BUS_MATCH_SENDER) {
+                r = bus_match_run_sender(bus, node, test_str, m);
+                if (r != 0)
+                        return r;
+
+        } else if (node->type == BUS_MATCH_PATH_NAMESPACE) {
+                r = bus_match_run_namespace(bus, node, '/', test_str, m);
+                if (r != 0)
+                        return r;
+
+        } else if (node->type >= BUS_MATCH_ARG_NAMESPACE && node->type <= BUS_MATCH_ARG_NAMESPACE_LAST) {
+                r = bus_match_run_namespace(bus, node, '.', test_str, m);
+                if (r != 0)
+                        return r;
+
+        } else if (BUS_MATCH_CAN_HASH(node->type)) {
                 struct bus_match_node *found;
 
                 /* Lookup via hash table, nice! So let's jump directly. */
@@ -536,6 +703,13 @@ static int bus_match_add_compare_value(
 
                 if (r < 0)
                         goto fail;
+
+                if (BUS_MATCH_IS_WELL_KNOWN_SENDER(n)) {
+                        n->next = c->compare.well_known;
+                        if (n->next)
+                                n->next->prev = n;
+                        c->compare.well_known = n;
+                }
         } else {
                 n->next = c->child;
                 if (n->next)
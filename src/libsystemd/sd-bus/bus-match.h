@@ -64,6 +64,10 @@ struct bus_match_node {
                 struct {
                         /* If this is set, then the child is NULL */
                         Hashmap *children;
+
+                        /* For sender compares: the value nodes of well-known names, which also match messages
+                         * from unique names, if we cannot tell which names the sender owns. */
+                        struct bus_match_node *well_known;
                 } compare;
         };
 };
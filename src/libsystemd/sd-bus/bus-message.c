@@ -109,7 +109,70 @@ static void message_reset_containers(sd_bus_message *m) {
         m->root_container.index = 0;
 }
 
+static sd_bus_message *message_alloc(sd_bus *bus, size_t size) {
+        sd_bus_message *m = NULL;
+
+        if (size > BUS_MESSAGE_ALLOC_SIZE)
+                return malloc0(size);
+
+        if (bus) {
+                assert_se(pthread_mutex_lock(&bus->memfd_cache_mutex) == 0);
+
+                if (bus->message_pool) {
+                        m = bus->message_pool;
+                        bus->message_pool = *(void**) m;
+                        bus->n_message_pool--;
+                }
+
+                assert_se(pthread_mutex_unlock(&bus->memfd_cache_mutex) == 0);
+        }
+
+        if (m)
+                memzero(m, BUS_MESSAGE_ALLOC_SIZE);
+        else {
+                m = malloc0(BUS_MESSAGE_ALLOC_SIZE);
+                if (!m)
+                        return NULL;
+        }
+
+        m->pooled = true;
+        return m;
+}
+
+static void message_release(sd_bus *bus, sd_bus_message *m) {
+
+        if (bus && m->pooled) {
+                assert_se(pthread_mutex_lock(&bus->memfd_cache_mutex) == 0);
+
+                if (bus->n_message_pool < BUS_MESSAGE_POOL_MAX) {
+                        *(void**) m = bus->message_pool;
+                        bus->message_pool = m;
+                        bus->n_message_pool++;
+                        m = NULL;
+                }
+
+                assert_se(pthread_mutex_unlock(&bus->memfd_cache_mutex) == 0);
+        }
+
+        free(m);
+}
+
+void bus_message_pool_flush(sd_bus *bus) {
+        void *p;
+
+        assert(bus);
+
+        while ((p = bus->message_pool)) {
+                bus->message_pool = *(void**) p;
+                free(p);
+        }
+
+        bus->n_message_pool = 0;
+}
+
 static void message_free(sd_bus_message *m) {
+        sd_bus *bus;
+
         assert(m);
 
         if (m->free_header)
@@ -117,7 +180,8 @@ static void message_free(sd_bus_message *m) {
 
         message_reset_parts(m);
 
-        sd_bus_unref(m->bus);
+        /* Keep the bus around until the allocation is back in its pool */
+        bus = m->bus;
 
         if (m->free_fds) {
                 close_many(m->fds, m->n_fds);
@@ -135,7 +199,9 @@ static void message_free(sd_bus_message *m) {
         free(m->root_container.peeked_signature);
 
         bus_creds_done(&m->creds);
-        free(m);
+
+        message_release(bus, m);
+        sd_bus_unref(bus);
 }
 
 static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz, bool add_offset) {
@@ -162,16 +228,20 @@ static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz, b
                 np = realloc(m->header, ALIGN8(new_size));
                 if (!np)
                         goto poison;
-        } else {
+        } else if (m->arena && ALIGN8(new_size) <= BUS_MESSAGE_HEADER_INLINE_MAX)
                 /* Initially, the header is allocated as part of
-                 * the sd_bus_message itself, let's replace it by
-                 * dynamic data */
+                 * the sd_bus_message itself, and there's still
+                 * room left there */
+                np = m->header;
+        else {
+                /* The header outgrew the sd_bus_message, let's
+                 * replace it by dynamic data */
 
                 np = malloc(ALIGN8(new_size));
                 if (!np)
                         goto poison;
 
-                memcpy(np, m->header, sizeof(struct bus_header));
+                memcpy(np, m->header, old_size);
         }
 
         /* Zero out padding */
@@ -190,7 +260,8 @@ static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz, b
         m->sender = adjust_pointer(m->sender, op, old_size, m->header);
         m->error.name = adjust_pointer(m->error.name, op, old_size, m->header);
 
-        m->free_header = true;
+        if (m->header != BUS_MESSAGE_INLINE_HEADER(m))
+                m->free_header = true;
 
         if (add_offset) {
                 if (m->n_header_offsets >= ELEMENTSOF(m->header_offsets))
@@ -455,7 +526,7 @@ int bus_message_from_header(
                 a += label_sz + 1;
         }
 
-        m = malloc0(a);
+        m = message_alloc(bus, a);
         if (!m)
                 return -ENOMEM;
 
@@ -586,12 +657,13 @@ _public_ int sd_bus_message_new(
         assert_return(m, -EINVAL);
         assert_return(type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
 
-        t = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        t = message_alloc(bus, BUS_MESSAGE_ALLOC_SIZE);
         if (!t)
                 return -ENOMEM;
 
         t->n_ref = 1;
-        t->header = (struct bus_header*) ((uint8_t*) t + ALIGN(sizeof(struct sd_bus_message)));
+        t->arena = true;
+        t->header = BUS_MESSAGE_INLINE_HEADER(t);
         t->header->endian = BUS_NATIVE_ENDIAN;
         t->header->type = type;
         t->header->version = bus->message_version;
@@ -1221,11 +1293,27 @@ static int part_make_space(
         if (m->poisoned)
                 return -ENOMEM;
 
-        if (part->allocated == 0 || sz > part->allocated) {
+        if (part->allocated == 0 && part == &m->body && m->arena && sz <= BUS_MESSAGE_BODY_INLINE_MAX) {
+                /* Small bodies start out in the room after the sd_bus_message */
+                part->data = BUS_MESSAGE_INLINE_BODY(m);
+                part->allocated = BUS_MESSAGE_BODY_INLINE_MAX;
+
+        } else if (part->allocated == 0 || sz > part->allocated) {
                 size_t new_allocated;
 
-                new_allocated = sz > 0 ? 2 * sz : 64;
-                n = realloc(part->data, new_allocated);
+                /* A fresh part for a large item is allocated exactly, it is not going to grow any further, see
+                 * message_extend_body() */
+                if (part->allocated == 0 && sz >= MEMFD_MIN_SIZE)
+                        new_allocated = sz;
+                else
+                        new_allocated = sz > 0 ? 2 * sz : 64;
+
+                if (part->data == BUS_MESSAGE_INLINE_BODY(m)) {
+                        n = malloc(new_allocated);
+                        if (n)
+                                memcpy(n, part->data, part->size);
+                } else
+                        n = realloc(part->data, new_allocated);
                 if (!n) {
                         m->poisoned = true;
                         return -ENOMEM;
@@ -1284,8 +1372,7 @@ static void *message_extend_body(
                 sd_bus_message *m,
                 size_t align,
                 size_t sz,
-                bool add_offset,
-                bool force_inline) {
+                bool add_offset) {
 
         size_t start_body, end_body, padding, added;
         void *p;
@@ -1315,11 +1402,15 @@ static void *message_extend_body(
                 struct bus_body_part *part = NULL;
                 bool add_new_part;
 
+                /* Large items get a part of their own, and large parts are never extended, so that we never
+                 * reallocate and copy big chunks of the body. The parts are handed to the kernel as an iovec
+                 * each, hence this costs nothing when sending. */
                 add_new_part =
                         m->n_body_parts <= 0 ||
                         m->body_end->sealed ||
                         (padding != ALIGN_TO(m->body_end->size, align) - m->body_end->size) ||
-                        (force_inline && m->body_end->size > MEMFD_MIN_SIZE); /* if this must be an inlined extension, let's create a new part if the previous part is large enough to be inlined */
+                        m->body_end->size >= MEMFD_MIN_SIZE ||
+                        sz >= MEMFD_MIN_SIZE;
 
                 if (add_new_part) {
                         if (padding > 0) {
@@ -1494,7 +1585,7 @@ int message_append_basic(sd_bus_message *m, char type, const void *p, const void
                 assert(align > 0);
                 assert(sz > 0);
 
-                a = message_extend_body(m, align, sz, true, false);
+                a = message_extend_body(m, align, sz, true);
                 if (!a)
                         return -ENOMEM;
 
@@ -1563,7 +1654,7 @@ int message_append_basic(sd_bus_message *m, char type, const void *p, const void
                 assert(align > 0);
                 assert(sz > 0);
 
-                a = message_extend_body(m, align, sz, false, false);
+                a = message_extend_body(m, align, sz, false);
                 if (!a)
                         return -ENOMEM;
 
@@ -1637,13 +1728,13 @@ _public_ int sd_bus_message_append_string_space(
         }
 
         if (BUS_MESSAGE_IS_GVARIANT(m)) {
-                a = message_extend_body(m, 1, size + 1, true, false);
+                a = message_extend_body(m, 1, size + 1, true);
                 if (!a)
                         return -ENOMEM;
 
                 *s = a;
         } else {
-                a = message_extend_body(m, 4, 4 + size + 1, false, false);
+                a = message_extend_body(m, 4, 4 + size + 1, false);
                 if (!a)
                         return -ENOMEM;
 
@@ -1748,7 +1839,7 @@ static int bus_message_open_array(
                         return alignment;
 
                 /* Add alignment padding and add to offset list */
-                if (!message_extend_body(m, alignment, 0, false, false))
+                if (!message_extend_body(m, alignment, 0, false))
                         return -ENOMEM;
 
                 r = bus_gvariant_is_fixed_size(contents);
@@ -1766,7 +1857,7 @@ static int bus_message_open_array(
                 if (alignment < 0)
                         return alignment;
 
-                a = message_extend_body(m, 4, 4, false, false);
+                a = message_extend_body(m, 4, 4, false);
                 if (!a)
                         return -ENOMEM;
 
@@ -1775,7 +1866,7 @@ static int bus_message_open_array(
                 os = m->body_end->size;
 
                 /* Add alignment between size and first element */
-                if (!message_extend_body(m, alignment, 0, false, false))
+                if (!message_extend_body(m, alignment, 0, false))
                         return -ENOMEM;
 
                 /* location of array size might have changed so let's readjust a */
@@ -1828,7 +1919,7 @@ static int bus_message_open_variant(
         if (BUS_MESSAGE_IS_GVARIANT(m)) {
                 /* Variants are always aligned to 8 */
 
-                if (!message_extend_body(m, 8, 0, false, false))
+                if (!message_extend_body(m, 8, 0, false))
                         return -ENOMEM;
 
         } else {
@@ -1836,7 +1927,7 @@ static int bus_message_open_variant(
                 void *a;
 
                 l = strlen(contents);
-                a = message_extend_body(m, 1, 1 + l + 1, false, false);
+                a = message_extend_body(m, 1, 1 + l + 1, false);
                 if (!a)
                         return -ENOMEM;
 
@@ -1902,7 +1993,7 @@ static int bus_message_open_struct(
                 if (alignment < 0)
                         return alignment;
 
-                if (!message_extend_body(m, alignment, 0, false, false))
+                if (!message_extend_body(m, alignment, 0, false))
                         return -ENOMEM;
 
                 r = bus_gvariant_is_fixed_size(contents);
@@ -1913,7 +2004,7 @@ static int bus_message_open_struct(
                 *need_offsets = r == 0;
         } else {
                 /* Align contents to 8 byte boundary */
-                if (!message_extend_body(m, 8, 0, false, false))
+                if (!message_extend_body(m, 8, 0, false))
                         return -ENOMEM;
         }
 
@@ -1963,7 +2054,7 @@ static int bus_message_open_dict_entry(
                 if (alignment < 0)
                         return alignment;
 
-                if (!message_extend_body(m, alignment, 0, false, false))
+                if (!message_extend_body(m, alignment, 0, false))
                         return -ENOMEM;
 
                 r = bus_gvariant_is_fixed_size(contents);
@@ -1974,7 +2065,7 @@ static int bus_message_open_dict_entry(
                 *need_offsets = r == 0;
         } else {
                 /* Align contents to 8 byte boundary */
-                if (!message_extend_body(m, 8, 0, false, false))
+                if (!message_extend_body(m, 8, 0, false))
                         return -ENOMEM;
         }
 
@@ -2065,7 +2156,7 @@ static int bus_message_close_array(sd_bus_message *m, struct bus_container *c) {
                 payload = c->n_offsets > 0 ? c->offsets[c->n_offsets-1] - c->begin : 0;
                 sz = bus_gvariant_determine_word_size(payload, c->n_offsets);
 
-                a = message_extend_body(m, 1, sz * c->n_offsets, true, false);
+                a = message_extend_body(m, 1, sz * c->n_offsets, true);
                 if (!a)
                         return -ENOMEM;
 
@@ -2076,7 +2167,7 @@ static int bus_message_close_array(sd_bus_message *m, struct bus_container *c) {
 
                 /* Fixed-width or empty arrays */
 
-                a = message_extend_body(m, 1, 0, true, false); /* let's add offset to parent */
+                a = message_extend_body(m, 1, 0, true); /* let's add offset to parent */
                 if (!a)
                         return -ENOMEM;
         }
@@ -2097,7 +2188,7 @@ static int bus_message_close_variant(sd_bus_message *m, struct bus_container *c)
 
         l = strlen(c->signature);
 
-        a = message_extend_body(m, 1, 1 + l, true, false);
+        a = message_extend_body(m, 1, 1 + l, true);
         if (!a)
                 return -ENOMEM;
 
@@ -2128,16 +2219,10 @@ static int bus_message_close_struct(sd_bus_message *m, struct bus_container *c,
                 r = signature_element_length(p, &n);
                 if (r < 0)
                         return r;
-                else {
-                        char t[n+1];
-
-                        memcpy(t, p, n);
-                        t[n] = 0;
 
-                        r = bus_gvariant_is_fixed_size(t);
-                        if (r < 0)
-                                return r;
-                }
+                r = bus_gvariant_analyze(p, n, NULL, NULL);
+                if (r < 0)
+                        return r;
 
                 assert(!c->need_offsets || i <= c->n_offsets);
 
@@ -2158,7 +2243,7 @@ static int bus_message_close_struct(sd_bus_message *m, struct bus_container *c,
 
         if (isempty(c->signature)) {
                 /* The unary type is encoded as fixed 1 byte padding */
-                a = message_extend_body(m, 1, 1, add_offset, false);
+                a = message_extend_body(m, 1, 1, add_offset);
                 if (!a)
                         return -ENOMEM;
 
@@ -2176,7 +2261,7 @@ static int bus_message_close_struct(sd_bus_message *m, struct bus_container *c,
 
                 assert(alignment > 0);
 
-                a = message_extend_body(m, alignment, 0, add_offset, false);
+                a = message_extend_body(m, alignment, 0, add_offset);
                 if (!a)
                         return -ENOMEM;
         } else {
@@ -2187,7 +2272,7 @@ static int bus_message_close_struct(sd_bus_message *m, struct bus_container *c,
 
                 sz = bus_gvariant_determine_word_size(m->body_size - c->begin, n_variable);
 
-                a = message_extend_body(m, 1, sz * n_variable, add_offset, false);
+                a = message_extend_body(m, 1, sz * n_variable, add_offset);
                 if (!a)
                         return -ENOMEM;
 
@@ -2199,20 +2284,15 @@ static int bus_message_close_struct(sd_bus_message *m, struct bus_container *c,
                         r = signature_element_length(p, &n);
                         if (r < 0)
                                 return r;
-                        else {
-                                char t[n+1];
 
-                                memcpy(t, p, n);
-                                t[n] = 0;
+                        r = bus_gvariant_analyze(p, n, NULL, NULL);
+                        if (r < 0)
+                                return r;
 
-                                p += n;
+                        p += n;
 
-                                r = bus_gvariant_is_fixed_size(t);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 || p[0] == 0)
-                                        continue;
-                        }
+                        if (r > 0 || p[0] == 0)
+                                continue;
 
                         k = n_variable - 1 - j;
 
@@ -2547,7 +2627,7 @@ _public_ int sd_bus_message_append_array_space(
         if (r < 0)
                 return r;
 
-        a = message_extend_body(m, align, size, false, false);
+        a = message_extend_body(m, align, size, false);
         if (!a)
                 return -ENOMEM;
 
@@ -2675,7 +2755,7 @@ _public_ int sd_bus_message_append_array_memfd(
         if (r < 0)
                 return r;
 
-        a = message_extend_body(m, align, 0, false, false);
+        a = message_extend_body(m, align, 0, false);
         if (!a)
                 return -ENOMEM;
 
@@ -2759,7 +2839,7 @@ _public_ int sd_bus_message_append_string_memfd(
         }
 
         if (!BUS_MESSAGE_IS_GVARIANT(m)) {
-                a = message_extend_body(m, 4, 4, false, false);
+                a = message_extend_body(m, 4, 4, false);
                 if (!a)
                         return -ENOMEM;
 
@@ -2853,7 +2933,7 @@ static int bus_message_close_header(sd_bus_message *m) {
                 l = strlen(signature);
 
                 sz = bus_gvariant_determine_word_size(sizeof(struct bus_header) + ALIGN8(m->fields_size) + m->body_size + 1 + l + 2, 1);
-                d = message_extend_body(m, 1, 1 + l + 2 + sz, false, true);
+                d = message_extend_body(m, 1, 1 + l + 2 + sz, false);
                 if (!d)
                         return -ENOMEM;
 
@@ -3160,21 +3240,19 @@ static int container_next_item(sd_bus_message *m, struct bus_container *c, size_
                 return 0;
 
         if (c->enclosing == SD_BUS_TYPE_ARRAY) {
-                int sz;
-
-                sz = bus_gvariant_get_size(c->signature);
-                if (sz < 0) {
-                        int alignment;
+                size_t sz;
 
+                /* Element framing was determined when entering the array */
+                sz = c->element_size;
+                if (sz == 0) {
                         if (c->offset_index+1 >= c->n_offsets)
                                 goto end;
 
                         /* Variable-size array */
 
-                        alignment = bus_gvariant_get_alignment(c->signature);
-                        assert(alignment > 0);
+                        assert(c->element_alignment > 0);
 
-                        *rindex = ALIGN_TO(c->offsets[c->offset_index], alignment);
+                        *rindex = ALIGN_TO(c->offsets[c->offset_index], c->element_alignment);
                         c->item_size = c->offsets[c->offset_index+1] - *rindex;
                 } else {
 
@@ -3190,8 +3268,7 @@ static int container_next_item(sd_bus_message *m, struct bus_container *c, size_
 
         } else if (IN_SET(c->enclosing, 0, SD_BUS_TYPE_STRUCT, SD_BUS_TYPE_DICT_ENTRY)) {
 
-                int alignment;
-                size_t n, j;
+                size_t alignment, n, j;
 
                 if (c->offset_index+1 >= c->n_offsets)
                         goto end;
@@ -3203,13 +3280,10 @@ static int container_next_item(sd_bus_message *m, struct bus_container *c, size_
                 r = signature_element_length(c->signature + c->index + n, &j);
                 if (r < 0)
                         return r;
-                else {
-                        char t[j+1];
-                        memcpy(t, c->signature + c->index + n, j);
-                        t[j] = 0;
 
-                        alignment = bus_gvariant_get_alignment(t);
-                }
+                r = bus_gvariant_analyze(c->signature + c->index + n, j, NULL, &alignment);
+                if (r < 0)
+                        return r;
 
                 assert(alignment > 0);
 
@@ -3555,10 +3629,13 @@ static int bus_message_enter_array(
                 const char *contents,
                 uint32_t **array_size,
                 size_t *item_size,
+                size_t *element_size,
+                size_t *element_alignment,
                 size_t **offsets,
                 size_t *n_offsets) {
 
         size_t rindex;
+        bool fixed = false;
         void *q;
         int r, alignment;
 
@@ -3567,6 +3644,8 @@ static int bus_message_enter_array(
         assert(contents);
         assert(array_size);
         assert(item_size);
+        assert(element_size);
+        assert(element_alignment);
         assert(offsets);
         assert(n_offsets);
 
@@ -3582,6 +3661,16 @@ static int bus_message_enter_array(
         if (!startswith(c->signature + c->index + 1, contents))
                 return -ENXIO;
 
+        if (BUS_MESSAGE_IS_GVARIANT(m)) {
+                /* Determine element framing once, so that iterating through the array doesn't have to
+                 * analyze the element signature again for each item */
+                r = bus_gvariant_analyze(contents, strlen(contents), element_size, element_alignment);
+                if (r < 0)
+                        return r;
+
+                fixed = r > 0;
+        }
+
         rindex = m->rindex;
 
         if (!BUS_MESSAGE_IS_GVARIANT(m)) {
@@ -3611,10 +3700,10 @@ static int bus_message_enter_array(
                 *offsets = NULL;
                 *n_offsets = 0;
 
-        } else if (bus_gvariant_is_fixed_size(contents)) {
+        } else if (fixed) {
 
                 /* gvariant: fixed length array */
-                *item_size = bus_gvariant_get_size(contents);
+                *item_size = *element_size;
                 *offsets = NULL;
                 *n_offsets = 0;
 
@@ -3798,15 +3887,8 @@ static int build_struct_offsets(
                 r = signature_element_length(p, &n);
                 if (r < 0)
                         return r;
-                else {
-                        char t[n+1];
-
-                        memcpy(t, p, n);
-                        t[n] = 0;
-
-                        r = bus_gvariant_is_fixed_size(t);
-                }
 
+                r = bus_gvariant_analyze(p, n, NULL, NULL);
                 if (r < 0)
                         return r;
                 if (r == 0 && p[n] != 0) /* except the last item */
@@ -3835,49 +3917,41 @@ static int build_struct_offsets(
         /* Second, loop again and build an offset table */
         p = signature;
         while (*p != 0) {
-                size_t n, offset;
-                int k;
+                size_t n, offset, k, align;
 
                 r = signature_element_length(p, &n);
                 if (r < 0)
                         return r;
-                else {
-                        char t[n+1];
-
-                        memcpy(t, p, n);
-                        t[n] = 0;
-
-                        k = bus_gvariant_get_size(t);
-                        if (k < 0) {
-                                size_t x;
 
-                                /* variable size */
-                                if (v > 0) {
-                                        v--;
+                r = bus_gvariant_analyze(p, n, &k, &align);
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        size_t x;
 
-                                        x = bus_gvariant_read_word_le((uint8_t*) q + v*sz, sz);
-                                        if (x >= size)
-                                                return -EBADMSG;
-                                        if (m->rindex + x < previous)
-                                                return -EBADMSG;
-                                } else
-                                        /* The last item's end
-                                         * is determined from
-                                         * the start of the
-                                         * offset array */
-                                        x = size - (n_variable * sz);
+                        /* variable size */
+                        if (v > 0) {
+                                v--;
 
-                                offset = m->rindex + x;
+                                x = bus_gvariant_read_word_le((uint8_t*) q + v*sz, sz);
+                                if (x >= size)
+                                        return -EBADMSG;
+                                if (m->rindex + x < previous)
+                                        return -EBADMSG;
+                        } else
+                                /* The last item's end
+                                 * is determined from
+                                 * the start of the
+                                 * offset array */
+                                x = size - (n_variable * sz);
 
-                        } else {
-                                size_t align;
+                        offset = m->rindex + x;
 
-                                /* fixed size */
-                                align = bus_gvariant_get_alignment(t);
-                                assert(align > 0);
+                } else {
+                        /* fixed size */
+                        assert(align > 0);
 
-                                offset = (*n_offsets == 0 ? m->rindex  : ALIGN_TO((*offsets)[*n_offsets-1], align)) + k;
-                        }
+                        offset = (*n_offsets == 0 ? m->rindex  : ALIGN_TO((*offsets)[*n_offsets-1], align)) + k;
                 }
 
                 previous = (*offsets)[(*n_offsets)++] = offset;
@@ -4012,7 +4086,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         char *signature;
         size_t before;
         size_t *offsets = NULL;
-        size_t n_offsets = 0, item_size = 0;
+        size_t n_offsets = 0, item_size = 0, element_size = 0, element_alignment = 1;
         int r;
 
         assert_return(m, -EINVAL);
@@ -4076,7 +4150,7 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         before = m->rindex;
 
         if (type == SD_BUS_TYPE_ARRAY)
-                r = bus_message_enter_array(m, c, contents, &array_size, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_array(m, c, contents, &array_size, &item_size, &element_size, &element_alignment, &offsets, &n_offsets);
         else if (type == SD_BUS_TYPE_VARIANT)
                 r = bus_message_enter_variant(m, c, contents, &item_size);
         else if (type == SD_BUS_TYPE_STRUCT)
@@ -4112,6 +4186,8 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
 
         w->array_size = array_size;
         w->item_size = item_size;
+        w->element_size = element_size;
+        w->element_alignment = element_alignment;
         w->offsets = offsets;
         w->n_offsets = n_offsets;
         w->offset_index = 0;
@@ -4575,6 +4651,41 @@ _public_ int sd_bus_message_read(sd_bus_message *m, const char *types, ...) {
         return r;
 }
 
+static int message_skip_container_contents(sd_bus_message *m) {
+        struct bus_container *c;
+        size_t rindex;
+        int r;
+
+        assert(m);
+
+        /* Jumps over the remaining contents of the current container without decoding them, if its
+         * extent is known from the framing. Returns 0 if the contents need to be skipped item by
+         * item. */
+
+        c = message_get_container(m);
+
+        if (BUS_MESSAGE_IS_GVARIANT(m)) {
+                if (m->rindex < c->end)
+                        m->rindex = c->end;
+
+                if (c->signature)
+                        c->index = strlen(c->signature);
+
+                return 1;
+        }
+
+        if (c->enclosing != SD_BUS_TYPE_ARRAY)
+                return 0;
+
+        rindex = m->rindex;
+        r = message_peek_body(m, &rindex, 1, c->begin + BUS_MESSAGE_BSWAP32(m, *c->array_size) - m->rindex, NULL);
+        if (r < 0)
+                return r;
+
+        m->rindex = rindex;
+        return 1;
+}
+
 _public_ int sd_bus_message_skip(sd_bus_message *m, const char *types) {
         int r;
 
@@ -4646,13 +4757,18 @@ _public_ int sd_bus_message_skip(sd_bus_message *m, const char *types) {
                         if (r <= 0)
                                 return r;
 
-                        for (;;) {
-                                r = sd_bus_message_skip(m, s);
-                                if (r < 0)
-                                        return r;
-                                if (r == 0)
-                                        break;
-                        }
+                        r = message_skip_container_contents(m);
+                        if (r < 0)
+                                return r;
+
+                        if (r == 0)
+                                for (;;) {
+                                        r = sd_bus_message_skip(m, s);
+                                        if (r < 0)
+                                                return r;
+                                        if (r == 0)
+                                                break;
+                                }
 
                         r = sd_bus_message_exit_container(m);
                         if (r < 0)
@@ -4714,7 +4830,9 @@ _public_ int sd_bus_message_skip(sd_bus_message *m, const char *types) {
                         if (r <= 0)
                                 return r;
 
-                        r = sd_bus_message_skip(m, s);
+                        r = message_skip_container_contents(m);
+                        if (r == 0)
+                                r = sd_bus_message_skip(m, s);
                         if (r < 0)
                                 return r;
 
@@ -5491,6 +5609,7 @@ int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
         void *p, *e;
         unsigned i;
         struct bus_body_part *part;
+        int r;
 
         assert(m);
         assert(buffer);
@@ -5503,8 +5622,16 @@ int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
                 return -ENOMEM;
 
         e = mempcpy(p, m->header, BUS_MESSAGE_BODY_BEGIN(m));
-        MESSAGE_FOREACH_PART(part, i, m)
+        MESSAGE_FOREACH_PART(part, i, m) {
+                /* Padding parts are not backed by memory until mapped */
+                r = bus_body_part_map(part);
+                if (r < 0) {
+                        free(p);
+                        return r;
+                }
+
                 e = mempcpy(e, part->data, part->size);
+        }
 
         assert(total == (size_t) ((uint8_t*) e - (uint8_t*) p));
 
@@ -48,6 +48,9 @@ struct bus_container {
         size_t *offsets, n_offsets, offsets_allocated, offset_index;
         size_t item_size;
 
+        /* gvariant: size (0 if variable) and alignment of the elements, if this is an array */
+        size_t element_size, element_alignment;
+
         char *peeked_signature;
 };
 
@@ -95,6 +98,8 @@ struct sd_bus_message {
         bool free_header:1;
         bool free_fds:1;
         bool poisoned:1;
+        bool pooled:1;
+        bool arena:1;
 
         /* The first and last bytes of the message */
         struct bus_header *header;
@@ -144,6 +149,21 @@ struct sd_bus_message {
         unsigned n_header_offsets;
 };
 
+/* Messages we build ourselves have room for a small header and body right after the object, so that a typical
+ * method call or reply needs no allocation besides the message itself. Allocations of this size are recycled
+ * through a per-bus pool. */
+#define BUS_MESSAGE_HEADER_INLINE_MAX 256U
+#define BUS_MESSAGE_BODY_INLINE_MAX 256U
+#define BUS_MESSAGE_ALLOC_SIZE (ALIGN(sizeof(sd_bus_message)) + BUS_MESSAGE_HEADER_INLINE_MAX + BUS_MESSAGE_BODY_INLINE_MAX)
+
+static inline void *BUS_MESSAGE_INLINE_HEADER(sd_bus_message *m) {
+        return (uint8_t*) m + ALIGN(sizeof(sd_bus_message));
+}
+
+static inline void *BUS_MESSAGE_INLINE_BODY(sd_bus_message *m) {
+        return (uint8_t*) m + ALIGN(sizeof(sd_bus_message)) + BUS_MESSAGE_HEADER_INLINE_MAX;
+}
+
 static inline bool BUS_MESSAGE_NEED_BSWAP(sd_bus_message *m) {
         return m->header->endian != BUS_NATIVE_ENDIAN;
 }
@@ -236,3 +256,5 @@ int bus_message_append_sender(sd_bus_message *m, const char *sender);
 
 void bus_message_set_sender_driver(sd_bus *bus, sd_bus_message *m);
 void bus_message_set_sender_local(sd_bus *bus, sd_bus_message *m);
+
+void bus_message_pool_flush(sd_bus *bus);
@@ -448,7 +448,6 @@ static int invoke_property_get(
         int r;
 
         assert(bus);
-        assert(slot);
         assert(v);
         assert(path);
         assert(interface);
@@ -457,11 +456,16 @@ static int invoke_property_get(
 
         if (v->x.property.get) {
 
-                bus->current_slot = sd_bus_slot_ref(slot);
-                bus->current_userdata = userdata;
+                /* Without a slot we are called from within some other callback, leave its context alone */
+                if (slot) {
+                        bus->current_slot = sd_bus_slot_ref(slot);
+                        bus->current_userdata = userdata;
+                }
                 r = v->x.property.get(bus, path, interface, property, reply, userdata, error);
-                bus->current_userdata = NULL;
-                bus->current_slot = sd_bus_slot_unref(slot);
+                if (slot) {
+                        bus->current_userdata = NULL;
+                        bus->current_slot = sd_bus_slot_unref(slot);
+                }
 
                 if (r < 0)
                         return r;
@@ -773,6 +777,73 @@ static int vtable_append_all_properties(
         return 1;
 }
 
+int bus_vtable_append_properties(
+                sd_bus *bus,
+                sd_bus_message *reply,
+                const char *path,
+                const char *interface,
+                const sd_bus_vtable *vtable,
+                void *userdata,
+                char **properties,
+                sd_bus_error *error) {
+
+        const sd_bus_vtable *v;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(path);
+        assert(interface);
+        assert(vtable);
+
+        /* Appends the properties of a vtable as "{sv}" entries to an already opened array, without going through
+         * the object tree. If a property list is specified only those are added, including explicit ones, like
+         * Get() would return them. Otherwise the same set as GetAll() is added. */
+
+        if (vtable[0].flags & SD_BUS_VTABLE_HIDDEN)
+                return 0;
+
+        for (v = vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                        continue;
+
+                if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                        continue;
+
+                if (strv_isempty(properties)) {
+                        if (v->flags & SD_BUS_VTABLE_PROPERTY_EXPLICIT)
+                                continue;
+                } else if (!strv_contains(properties, v->x.property.member))
+                        continue;
+
+                r = sd_bus_message_open_container(reply, 'e', "sv");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", v->x.property.member);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
+                if (r < 0)
+                        return r;
+
+                r = invoke_property_get(bus, NULL, v, path, interface, v->x.property.member, reply, vtable_property_convert_userdata(v, userdata), error);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int property_get_all_callbacks_run(
                 sd_bus *bus,
                 sd_bus_message *m,
@@ -899,6 +970,104 @@ static int bus_node_exists(
         return 0;
 }
 
+static int node_vtable_write_introspection(sd_bus *bus, struct introspect *intro, struct node_vtable *c) {
+        int r;
+
+        assert(bus);
+        assert(intro);
+        assert(c);
+
+        /* Vtables are static, hence generate their XML only once */
+
+        if (!c->introspection) {
+                struct introspect fragment;
+
+                r = introspect_begin_fragment(&fragment, bus->trusted);
+                if (r < 0)
+                        return r;
+
+                r = introspect_write_interface(&fragment, c->vtable);
+                if (r >= 0)
+                        r = introspect_finish_fragment(&fragment, &c->introspection);
+
+                introspect_free(&fragment);
+                if (r < 0)
+                        return r;
+        }
+
+        fputs_unlocked(c->introspection, intro->f);
+        return 0;
+}
+
+static int node_write_child_introspection(struct introspect *intro, struct node *n) {
+        int r;
+
+        assert(intro);
+        assert(n);
+
+        if (!n->child_introspection) {
+                struct introspect fragment;
+                struct node *i;
+
+                r = introspect_begin_fragment(&fragment, intro->trusted);
+                if (r < 0)
+                        return r;
+
+                LIST_FOREACH(siblings, i, n->child)
+                        introspect_write_child_node(&fragment, i->path, n->path);
+
+                r = introspect_finish_fragment(&fragment, &n->child_introspection);
+                introspect_free(&fragment);
+                if (r < 0)
+                        return r;
+        }
+
+        fputs_unlocked(n->child_introspection, intro->f);
+        return 0;
+}
+
+static int get_enumerated_child_nodes(
+                sd_bus *bus,
+                const char *prefix,
+                struct node *n,
+                Set **_s,
+                sd_bus_error *error) {
+
+        Set *s = NULL;
+        Iterator i;
+        char *path;
+        int r;
+
+        assert(bus);
+        assert(prefix);
+        assert(n);
+        assert(_s);
+
+        /* Like get_child_nodes() with no flags, but leaves out the registered child nodes, whose XML is
+         * cached in the node itself. */
+
+        s = set_new(&string_hash_ops);
+        if (!s)
+                return -ENOMEM;
+
+        r = add_enumerated_to_set(bus, prefix, n->enumerators, s, error);
+        if (r < 0) {
+                set_free_free(s);
+                return r;
+        }
+
+        SET_FOREACH(path, s, i) {
+                struct node *child;
+
+                child = hashmap_get(bus->nodes, path);
+                if (child && child->parent == n)
+                        free(set_remove(s, path));
+        }
+
+        *_s = s;
+        return 0;
+}
+
 static int process_introspect(
                 sd_bus *bus,
                 sd_bus_message *m,
@@ -920,7 +1089,12 @@ static int process_introspect(
         assert(n);
         assert(found_object);
 
-        r = get_child_nodes(bus, m->path, n, 0, &s, &error);
+        /* For fallback vtables the node is a prefix of the requested path, only some of its children might
+         * be below the path. Only use the cached XML if the node is the object itself. */
+        if (require_fallback)
+                r = get_child_nodes(bus, m->path, n, 0, &s, &error);
+        else
+                r = get_enumerated_child_nodes(bus, m->path, n, &s, &error);
         if (r < 0)
                 return bus_maybe_reply_error(m, r, &error);
         if (bus->nodes_modified)
@@ -934,7 +1108,7 @@ static int process_introspect(
         if (r < 0)
                 return r;
 
-        empty = set_isempty(s);
+        empty = set_isempty(s) && (require_fallback || !n->child);
 
         LIST_FOREACH(vtables, c, n->vtables) {
                 if (require_fallback && !c->is_fallback)
@@ -965,7 +1139,7 @@ static int process_introspect(
                         fprintf(intro.f, " <interface name=\"%s\">\n", c->interface);
                 }
 
-                r = introspect_write_interface(&intro, c->vtable);
+                r = node_vtable_write_introspection(bus, &intro, c);
                 if (r < 0)
                         goto finish;
 
@@ -991,6 +1165,12 @@ static int process_introspect(
 
         *found_object = true;
 
+        if (!require_fallback) {
+                r = node_write_child_introspection(&intro, n);
+                if (r < 0)
+                        goto finish;
+        }
+
         r = introspect_write_child_nodes(&intro, s, m->path);
         if (r < 0)
                 goto finish;
@@ -1238,26 +1418,37 @@ static int process_get_managed_objects(
         return 1;
 }
 
+static bool node_has_vtables(struct node *n, bool require_fallback) {
+        struct node_vtable *c;
+
+        assert(n);
+
+        if (!require_fallback)
+                return !!n->vtables;
+
+        LIST_FOREACH(vtables, c, n->vtables)
+                if (c->is_fallback)
+                        return true;
+
+        return false;
+}
+
 static int object_find_and_run(
                 sd_bus *bus,
                 sd_bus_message *m,
-                const char *p,
+                struct node *n,
                 bool require_fallback,
                 bool *found_object) {
 
-        struct node *n;
         struct vtable_member vtable_key, *v;
+        bool has_vtables;
         int r;
 
         assert(bus);
         assert(m);
-        assert(p);
+        assert(n);
         assert(found_object);
 
-        n = hashmap_get(bus->nodes, p);
-        if (!n)
-                return 0;
-
         /* First, try object callbacks */
         r = node_callbacks_run(bus, m, n->callbacks, require_fallback, found_object);
         if (r != 0)
@@ -1268,12 +1459,17 @@ static int object_find_and_run(
         if (!m->interface || !m->member)
                 return 0;
 
+        /* Most nodes on the way up to a fallback are just intermediate path components, don't bother hashing
+         * the member keys for those. Without vtables there is nothing to find in vtable_methods or
+         * vtable_properties anyway. */
+        has_vtables = node_has_vtables(n, require_fallback);
+
         /* Then, look for a known method */
-        vtable_key.path = (char*) p;
+        vtable_key.path = n->path;
         vtable_key.interface = m->interface;
         vtable_key.member = m->member;
 
-        v = hashmap_get(bus->vtable_methods, &vtable_key);
+        v = has_vtables ? hashmap_get(bus->vtable_methods, &vtable_key) : NULL;
         if (v) {
                 r = method_callbacks_run(bus, m, v, require_fallback, found_object);
                 if (r != 0)
@@ -1288,13 +1484,13 @@ static int object_find_and_run(
 
                 get = streq(m->member, "Get");
 
-                if (get || streq(m->member, "Set")) {
+                if (has_vtables && (get || streq(m->member, "Set"))) {
 
                         r = sd_bus_message_rewind(m, true);
                         if (r < 0)
                                 return r;
 
-                        vtable_key.path = (char*) p;
+                        vtable_key.path = n->path;
 
                         r = sd_bus_message_read(m, "ss", &vtable_key.interface, &vtable_key.member);
                         if (r < 0)
@@ -1388,22 +1584,37 @@ int bus_process_object(sd_bus *bus, sd_bus_message *m) {
         pl = strlen(m->path);
         do {
                 char prefix[pl+1];
+                struct node *n;
 
                 bus->nodes_modified = false;
 
-                r = object_find_and_run(bus, m, m->path, false, &found_object);
-                if (r != 0)
-                        return r;
-
-                /* Look for fallback prefixes */
-                OBJECT_PATH_FOREACH_PREFIX(prefix, m->path) {
-
+                n = hashmap_get(bus->nodes, m->path);
+                if (n) {
+                        r = object_find_and_run(bus, m, n, false, &found_object);
+                        if (r != 0)
+                                return r;
                         if (bus->nodes_modified)
-                                break;
+                                continue;
+
+                        n = n->parent;
+                } else {
+                        /* Look for the longest prefix that is registered. Nodes are always allocated together
+                         * with all their parents, hence from there on we can just follow the parent
+                         * pointers, instead of hashing every shorter prefix. */
+                        OBJECT_PATH_FOREACH_PREFIX(prefix, m->path) {
+                                n = hashmap_get(bus->nodes, prefix);
+                                if (n)
+                                        break;
+                        }
+                }
 
-                        r = object_find_and_run(bus, m, prefix, true, &found_object);
+                /* Look for fallback prefixes */
+                for (; n; n = n->parent) {
+                        r = object_find_and_run(bus, m, n, true, &found_object);
                         if (r != 0)
                                 return r;
+                        if (bus->nodes_modified)
+                                break;
                 }
 
         } while (bus->nodes_modified);
@@ -1479,8 +1690,10 @@ static struct node *bus_node_allocate(sd_bus *bus, const char *path) {
                 return mfree(n);
         }
 
-        if (parent)
+        if (parent) {
                 LIST_PREPEND(siblings, parent->child, n);
+                parent->child_introspection = mfree(parent->child_introspection);
+        }
 
         return n;
 }
@@ -1500,9 +1713,12 @@ void bus_node_gc(sd_bus *b, struct node *n) {
 
         assert_se(hashmap_remove(b->nodes, n->path) == n);
 
-        if (n->parent)
+        if (n->parent) {
                 LIST_REMOVE(siblings, n->parent->child, n);
+                n->parent->child_introspection = mfree(n->parent->child_introspection);
+        }
 
+        free(n->child_introspection);
         free(n->path);
         bus_node_gc(b, n->parent);
         free(n);
@@ -24,3 +24,5 @@
 
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
 void bus_node_gc(sd_bus *b, struct node *n);
+
+int bus_vtable_append_properties(sd_bus *bus, sd_bus_message *reply, const char *path, const char *interface, const sd_bus_vtable *vtable, void *userdata, char **properties, sd_bus_error *error);
@@ -766,38 +766,58 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **messages, unsigned n_messages, size_t *idx) {
+        sd_bus_message *m;
         struct iovec *iov;
+        unsigned i, j, n_iovec = 0;
         ssize_t k;
-        size_t n;
-        unsigned j;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
+        assert(n_messages > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
+        /* Writes out the first message, starting at *idx, and as many of the following ones as fit into a single
+         * sendmsg(). *idx is advanced by the number of bytes written, and hence might point beyond the first
+         * message afterwards. File descriptors are attached to the first byte sent, hence only the first
+         * message may carry any. */
+
+        m = messages[0];
         if (*idx >= BUS_MESSAGE_SIZE(m))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        for (i = 0; i < n_messages; i++) {
+                if (i > 0 && messages[i]->n_fds > 0)
+                        break;
+
+                r = bus_message_setup_iovec(messages[i]);
+                if (r < 0)
+                        return r;
+
+                if (i > 0 && n_iovec + messages[i]->n_iovec > BUS_WRITE_IOVEC_MAX)
+                        break;
+
+                n_iovec += messages[i]->n_iovec;
+        }
+        n_messages = i;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy_safe(iov, m->iovec, n);
+        iov = newa(struct iovec, n_iovec);
+        for (i = 0, j = 0; i < n_messages; i++) {
+                memcpy_safe(iov + j, messages[i]->iovec, messages[i]->n_iovec * sizeof(struct iovec));
+                j += messages[i]->n_iovec;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iovec);
         else {
                 struct msghdr mh = {
                         .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iovlen = n_iovec,
                 };
 
                 if (m->n_fds > 0 && *idx == 0) {
@@ -813,7 +833,7 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iovec);
                 }
         }
 
@@ -824,6 +844,10 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         return 1;
 }
 
+int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        return bus_socket_write_messages(bus, &m, 1, idx);
+}
+
 static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         uint32_t a, b;
         uint8_t e;
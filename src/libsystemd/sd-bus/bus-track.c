@@ -24,11 +24,22 @@
 #include "bus-internal.h"
 #include "bus-track.h"
 #include "bus-util.h"
+#include "set.h"
+
+/* All track objects of a bus connection share a single NameOwnerChanged match per tracked name. The
+ * watches are indexed by name in bus->track_watches, and each one knows the track objects to notify. */
+struct track_watch {
+        sd_bus *bus;
+        char *name;
+        sd_bus_slot *slot;
+        Set *tracks;
+};
 
 struct track_item {
         unsigned n_ref;
         char *name;
-        sd_bus_slot *slot;
+        sd_bus_track *track;
+        struct track_watch *watch;
 };
 
 struct sd_bus_track {
@@ -68,12 +79,41 @@ struct sd_bus_track {
                 _x;                                                     \
         })
 
+static struct track_watch* track_watch_free(struct track_watch *w) {
+
+        if (!w)
+                return NULL;
+
+        if (w->name)
+                hashmap_remove_value(w->bus->track_watches, w->name, w);
+
+        sd_bus_slot_unref(w->slot);
+        set_free(w->tracks);
+        free(w->name);
+        return mfree(w);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct track_watch*, track_watch_free);
+
+static void track_watch_release(struct track_watch *w, sd_bus_track *track) {
+        assert(w);
+        assert(track);
+
+        set_remove(w->tracks, track);
+
+        /* Drop the match once the last track object lost interest in the name */
+        if (set_isempty(w->tracks))
+                track_watch_free(w);
+}
+
 static struct track_item* track_item_free(struct track_item *i) {
 
         if (!i)
                 return NULL;
 
-        sd_bus_slot_unref(i->slot);
+        if (i->watch)
+                track_watch_release(i->watch, i->track);
+
         free(i->name);
         return mfree(i);
 }
@@ -204,25 +244,100 @@ _public_ sd_bus_track* sd_bus_track_unref(sd_bus_track *track) {
 }
 
 static int on_name_owner_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        sd_bus_track *track = userdata;
+        struct track_watch *w = userdata;
         const char *name, *old, *new;
         int r;
 
         assert(message);
-        assert(track);
+        assert(w);
 
         r = sd_bus_message_read(message, "sss", &name, &old, &new);
         if (r < 0)
                 return 0;
 
-        bus_track_remove_name_fully(track, name);
+        /* Each removal takes the track object out of the watch, and the last one frees the watch */
+        for (;;) {
+                sd_bus_track *track;
+                bool last;
+
+                track = set_first(w->tracks);
+                if (!track)
+                        break;
+
+                last = set_size(w->tracks) <= 1;
+
+                bus_track_remove_name_fully(track, name);
+                if (last)
+                        break;
+        }
+
         return 0;
 }
 
+static int track_watch_acquire(sd_bus_track *track, const char *name, struct track_watch **ret) {
+        _cleanup_(track_watch_freep) struct track_watch *n = NULL;
+        struct track_watch *w;
+        const char *match;
+        int r;
+
+        assert(track);
+        assert(name);
+        assert(ret);
+
+        w = hashmap_get(track->bus->track_watches, name);
+        if (w) {
+                r = set_put(w->tracks, track);
+                if (r < 0)
+                        return r;
+
+                *ret = w;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&track->bus->track_watches, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        n = new0(struct track_watch, 1);
+        if (!n)
+                return -ENOMEM;
+        n->bus = track->bus;
+
+        n->tracks = set_new(NULL);
+        if (!n->tracks)
+                return -ENOMEM;
+
+        r = set_put(n->tracks, track);
+        if (r < 0)
+                return r;
+
+        match = MATCH_FOR_NAME(name);
+
+        track->n_adding++; /* make sure we aren't dispatched while we synchronously add this match */
+        r = sd_bus_add_match(track->bus, &n->slot, match, on_name_owner_changed, n);
+        track->n_adding--;
+        if (r < 0)
+                return r;
+
+        n->name = strdup(name);
+        if (!n->name)
+                return -ENOMEM;
+
+        r = hashmap_put(track->bus->track_watches, n->name, n);
+        if (r < 0) {
+                n->name = mfree(n->name);
+                return r;
+        }
+
+        *ret = n;
+        n = NULL;
+
+        return 1;
+}
+
 _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         _cleanup_(track_item_freep) struct track_item *n = NULL;
         struct track_item *i;
-        const char *match;
         int r;
 
         assert_return(track, -EINVAL);
@@ -253,15 +368,12 @@ _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         n->name = strdup(name);
         if (!n->name)
                 return -ENOMEM;
+        n->track = track;
 
-        /* First, subscribe to this name */
-        match = MATCH_FOR_NAME(name);
-
+        /* First, subscribe to this name, sharing the match with other track objects watching it already */
         bus_track_remove_from_queue(track); /* don't dispatch this while we work in it */
 
-        track->n_adding++; /* make sure we aren't dispatched while we synchronously add this match */
-        r = sd_bus_add_match(track->bus, &n->slot, match, on_name_owner_changed, track);
-        track->n_adding--;
+        r = track_watch_acquire(track, name, &n->watch);
         if (r < 0) {
                 bus_track_add_to_queue(track);
                 return r;
@@ -110,6 +110,7 @@ static void bus_free(sd_bus *b) {
         assert(b);
         assert(!b->track_queue);
         assert(!b->tracks);
+        assert(hashmap_isempty(b->track_watches));
 
         b->state = BUS_CLOSED;
 
@@ -156,6 +157,8 @@ static void bus_free(sd_bus *b) {
         assert(b->match_callbacks.type == BUS_MATCH_ROOT);
         bus_match_free(&b->match_callbacks);
 
+        hashmap_free(b->track_watches);
+
         hashmap_free_free(b->vtable_methods);
         hashmap_free_free(b->vtable_properties);
 
@@ -163,6 +166,7 @@ static void bus_free(sd_bus *b) {
         hashmap_free(b->nodes);
 
         bus_flush_memfd(b);
+        bus_message_pool_flush(b);
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
 
@@ -1454,6 +1458,22 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
+static void log_sent_message(sd_bus_message *m) {
+        assert(m);
+
+        log_debug("Sent message type=%s sender=%s destination=%s object=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " error-name=%s error-message=%s",
+                  bus_message_type_to_string(m->header->type),
+                  strna(sd_bus_message_get_sender(m)),
+                  strna(sd_bus_message_get_destination(m)),
+                  strna(sd_bus_message_get_path(m)),
+                  strna(sd_bus_message_get_interface(m)),
+                  strna(sd_bus_message_get_member(m)),
+                  BUS_MESSAGE_COOKIE(m),
+                  m->reply_cookie,
+                  strna(m->error.name),
+                  strna(m->error.message));
+}
+
 static int bus_write_message(sd_bus *bus, sd_bus_message *m, bool hint_sync_call, size_t *idx) {
         int r;
 
@@ -1465,58 +1485,79 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, bool hint_sync_call
                 return r;
 
         if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s object=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " error-name=%s error-message=%s",
-                          bus_message_type_to_string(m->header->type),
-                          strna(sd_bus_message_get_sender(m)),
-                          strna(sd_bus_message_get_destination(m)),
-                          strna(sd_bus_message_get_path(m)),
-                          strna(sd_bus_message_get_interface(m)),
-                          strna(sd_bus_message_get_member(m)),
-                          BUS_MESSAGE_COOKIE(m),
-                          m->reply_cookie,
-                          strna(m->error.name),
-                          strna(m->error.message));
+                log_sent_message(m);
 
         return r;
 }
 
 static int dispatch_wqueue(sd_bus *bus) {
+        unsigned n = 0;
         int r, ret = 0;
 
         assert(bus);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        while (bus->wqueue_size > 0) {
+        while (bus->wqueue_size > n) {
 
-                r = bus_write_message(bus, bus->wqueue[0], false, &bus->windex);
-                if (r < 0)
-                        return r;
-                else if (r == 0)
+                /* Write as many queued messages as possible with a single syscall, and then drop all fully
+                 * written ones from the queue */
+                r = bus_socket_write_messages(bus, bus->wqueue + n, bus->wqueue_size - n, &bus->windex);
+                if (r < 0) {
+                        ret = r;
+                        break;
+                }
+                if (r == 0)
                         /* Didn't do anything this time */
-                        return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        sd_bus_message_unref(bus->wqueue[0]);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
+                        break;
+
+                while (n < bus->wqueue_size && bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[n])) {
+                        bus->windex -= BUS_MESSAGE_SIZE(bus->wqueue[n]);
+                        log_sent_message(bus->wqueue[n]);
+                        sd_bus_message_unref(bus->wqueue[n]);
+                        n++;
 
                         ret = 1;
                 }
         }
 
+        if (n > 0) {
+                bus->wqueue_size -= n;
+                memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
+        }
+
         return ret;
 }
 
+static int flush_wqueue(sd_bus *bus) {
+        int r;
+
+        assert(bus);
+
+        r = dispatch_wqueue(bus);
+        if (r < 0 && IN_SET(r, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN)) {
+                bus_enter_closing(bus);
+                return -ECONNRESET;
+        }
+
+        return r;
+}
+
+int bus_set_cork(sd_bus *bus, bool b) {
+        assert(bus);
+
+        /* When corked, messages are not written right away when they are enqueued, but collected in the write
+         * queue and written in batches, with as few syscalls as possible. The queue is flushed when the event
+         * loop prepares for its next iteration, on synchronous method calls and when it grows too long. Wire
+         * order is not affected. Only useful for buses attached to an event loop. */
+
+        bus->corked = b;
+
+        if (b || !IN_SET(bus->state, BUS_RUNNING, BUS_HELLO))
+                return 0;
+
+        return flush_wqueue(bus);
+}
+
 static int bus_read_message(sd_bus *bus, bool hint_priority, int64_t priority) {
         assert(bus);
 
@@ -1609,7 +1650,7 @@ static int bus_send_internal(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie,
         if (m->dont_send)
                 goto finish;
 
-        if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0) {
+        if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0 && !(bus->corked && !hint_sync_call)) {
                 size_t idx = 0;
 
                 r = bus_write_message(bus, m, hint_sync_call, &idx);
@@ -1643,6 +1684,15 @@ static int bus_send_internal(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie,
                         return -ENOMEM;
 
                 bus->wqueue[bus->wqueue_size++] = sd_bus_message_ref(m);
+
+                /* A synchronous call or a long queue can't wait for the event loop */
+                if (bus->corked &&
+                    IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) &&
+                    (hint_sync_call || bus->wqueue_size >= BUS_WQUEUE_CORK_MAX)) {
+                        r = flush_wqueue(bus);
+                        if (r < 0)
+                                return r;
+                }
         }
 
 finish:
@@ -2974,6 +3024,13 @@ static int prepare_callback(sd_event_source *s, void *userdata) {
         assert(s);
         assert(bus);
 
+        /* Write out whatever accumulated while corked during this iteration */
+        if (bus->corked && bus->wqueue_size > 0 && IN_SET(bus->state, BUS_RUNNING, BUS_HELLO)) {
+                r = flush_wqueue(bus);
+                if (r < 0 && r != -ECONNRESET)
+                        return r;
+        }
+
         e = sd_bus_get_events(bus);
         if (e < 0)
                 return e;
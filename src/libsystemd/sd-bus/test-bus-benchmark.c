@@ -89,6 +89,29 @@ static void transaction(sd_bus *b, size_t sz, const char *server_name) {
         assert_se(sd_bus_call(b, m, 0, NULL, &reply) >= 0);
 }
 
+static void local_messages(sd_bus *b) {
+        unsigned n;
+        usec_t t;
+
+        /* Measures building and releasing messages, without any I/O */
+
+        t = now(CLOCK_MONOTONIC);
+        for (n = 0;; n++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                assert_se(sd_bus_message_new_method_call(b, &m, "org.freedesktop.systemd1",
+                                                         "/org/freedesktop/systemd1/unit/dbus_2eservice",
+                                                         "org.freedesktop.DBus.Properties", "Get") >= 0);
+                assert_se(sd_bus_message_append(m, "ss", "org.freedesktop.systemd1.Unit", "ActiveState") >= 0);
+                assert_se(sd_bus_message_seal(m, n + 1, 0) >= 0);
+
+                if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
+                        break;
+        }
+
+        printf("MESSAGES\t%u\n", (unsigned) ((n * USEC_PER_SEC) / arg_loop_usec));
+}
+
 static void client_bisect(const char *address, const char *server_name) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *x = NULL;
         size_t lsize, rsize, csize;
@@ -226,6 +249,7 @@ int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_LOCAL,
         } mode = MODE_BISECT;
         Type type = TYPE_LEGACY;
         int i, pair[2] = { -1, -1 };
@@ -242,6 +266,9 @@ int main(int argc, char *argv[]) {
                 if (streq(argv[i], "chart")) {
                         mode = MODE_CHART;
                         continue;
+                } else if (streq(argv[i], "local")) {
+                        mode = MODE_LOCAL;
+                        continue;
                 } else if (streq(argv[i], "legacy")) {
                         type = TYPE_LEGACY;
                         continue;
@@ -287,6 +314,13 @@ int main(int argc, char *argv[]) {
         r = sd_bus_start(b);
         assert_se(r >= 0);
 
+        if (mode == MODE_LOCAL) {
+                local_messages(b);
+                safe_close(pair[1]);
+                sd_bus_unref(b);
+                return 0;
+        }
+
         if (type != TYPE_DIRECT) {
                 r = sd_bus_get_unique_name(b, &unique);
                 assert_se(r >= 0);
@@ -317,6 +351,9 @@ int main(int argc, char *argv[]) {
                 case MODE_CHART:
                         client_chart(type, address, server_name, pair[1]);
                         break;
+
+                case MODE_LOCAL:
+                        assert_not_reached("Local mode does not fork");
                 }
 
                 _exit(0);
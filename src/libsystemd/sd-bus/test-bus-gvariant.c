@@ -131,6 +131,29 @@ static void test_bus_gvariant_get_alignment(void) {
         assert_se(bus_gvariant_get_alignment("((t)(t))") == 8);
 }
 
+static void test_bus_gvariant_analyze(void) {
+        size_t sz, a;
+
+        assert_se(bus_gvariant_analyze("(bt)s", 4, &sz, &a) > 0);
+        assert_se(sz == 16);
+        assert_se(a == 8);
+
+        assert_se(bus_gvariant_analyze("(bt)s", 5, &sz, &a) == 0);
+        assert_se(sz == 0);
+        assert_se(a == 8);
+
+        assert_se(bus_gvariant_analyze("ynt", 2, &sz, &a) > 0);
+        assert_se(sz == 4);
+        assert_se(a == 2);
+
+        assert_se(bus_gvariant_analyze("a(yu)", 5, &sz, &a) == 0);
+        assert_se(a == 4);
+
+        assert_se(bus_gvariant_analyze("(u", 2, NULL, NULL) == -EINVAL);
+        assert_se(bus_gvariant_analyze("a", 1, NULL, NULL) == -EINVAL);
+        assert_se(bus_gvariant_analyze("u)", 2, NULL, NULL) == -EINVAL);
+}
+
 static void test_marshal(void) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *n = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
@@ -204,6 +227,10 @@ static void test_marshal(void) {
 
         assert_se(bus_message_dump(n, NULL, BUS_MESSAGE_DUMP_WITH_HEADER) >= 0);
 
+        assert_se(sd_bus_message_rewind(n, true) >= 0);
+        assert_se(sd_bus_message_skip(n, "a(usv)") > 0);
+        assert_se(sd_bus_message_at_end(n, true) > 0);
+
         m = sd_bus_message_unref(m);
 
         assert_se(sd_bus_message_new_method_call(bus, &m, "a.x", "/a/x", "a.x", "Ax") >= 0);
@@ -219,6 +246,7 @@ int main(int argc, char *argv[]) {
         test_bus_gvariant_is_fixed_size();
         test_bus_gvariant_get_size();
         test_bus_gvariant_get_alignment();
+        test_bus_gvariant_analyze();
         test_marshal();
 
         return 0;
@@ -121,6 +121,43 @@ static void test_bus_label_escape(void) {
         test_bus_label_escape_one(":1", "_3a1");
 }
 
+static void test_bus_large_array(sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ uint8_t *data = NULL;
+        const void *p;
+        const char *s;
+        void *buffer;
+        size_t i, sz, n = 2*1024*1024 + 3;
+        uint32_t u;
+
+        data = new(uint8_t, n);
+        assert_se(data);
+        for (i = 0; i < n; i++)
+                data[i] = (uint8_t) (i * 7);
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "foobar.waldo", "/", "foobar.waldo", "Piep") >= 0);
+        assert_se(sd_bus_message_append(m, "s", "before") >= 0);
+        assert_se(sd_bus_message_append_array(m, 'y', data, n) >= 0);
+        assert_se(sd_bus_message_append(m, "us", 4711, "after") >= 0);
+        assert_se(sd_bus_message_seal(m, 4712, 0) >= 0);
+
+        /* The array is not copied into the part of the string before it */
+        assert_se(m->n_body_parts >= 3);
+
+        assert_se(bus_message_get_blob(m, &buffer, &sz) >= 0);
+        m = sd_bus_message_unref(m);
+        assert_se(bus_message_from_malloc(bus, buffer, sz, NULL, 0, NULL, &m) >= 0);
+
+        assert_se(sd_bus_message_read(m, "s", &s) > 0);
+        assert_se(streq(s, "before"));
+        assert_se(sd_bus_message_read_array(m, 'y', &p, &sz) > 0);
+        assert_se(sz == n);
+        assert_se(memcmp(p, data, n) == 0);
+        assert_se(sd_bus_message_read(m, "us", &u, &s) > 0);
+        assert_se(u == 4711);
+        assert_se(streq(s, "after"));
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *copy = NULL;
         int r, boolean;
@@ -428,6 +465,7 @@ int main(int argc, char *argv[]) {
         test_bus_path_encode();
         test_bus_path_encode_unique();
         test_bus_path_encode_many();
+        test_bus_large_array(bus);
 
         return 0;
 }
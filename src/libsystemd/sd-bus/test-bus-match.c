@@ -18,12 +18,15 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "alloc-util.h"
 #include "bus-match.h"
 #include "bus-message.h"
 #include "bus-slot.h"
 #include "bus-util.h"
+#include "env-util.h"
 #include "log.h"
 #include "macro.h"
+#include "time-util.h"
 
 static bool mask[32];
 
@@ -75,6 +78,73 @@ static int match_add(sd_bus_slot *slots, struct bus_match_node *root, const char
         return r;
 }
 
+static unsigned n_counted = 0;
+
+static int counter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_counted++;
+        return 0;
+}
+
+static void test_benchmark(sd_bus *bus, bool slow) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        char a[FORMAT_TIMESPAN_MAX];
+        unsigned n_matches = slow ? 20000 : 2000, n_runs = slow ? 100000 : 10000, i;
+        sd_bus_slot *slots;
+        usec_t ts;
+
+        /* Mimic what PID 1 installs: a NameOwnerChanged match for every watched name, a match on the unique
+         * name of every tracked client, and per-object path_namespace matches */
+
+        slots = new0(sd_bus_slot, n_matches * 3);
+        assert_se(slots);
+
+        for (i = 0; i < n_matches * 3; i++) {
+                struct bus_match_component *components = NULL;
+                _cleanup_free_ char *match = NULL;
+                unsigned n_components = 0;
+
+                if (i % 3 == 0)
+                        assert_se(asprintf(&match,
+                                           "type='signal',sender='org.freedesktop.DBus',path='/org/freedesktop/DBus',"
+                                           "interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='foo%u.service'", i) >= 0);
+                else if (i % 3 == 1)
+                        assert_se(asprintf(&match, "type='signal',sender=':1.%u'", i) >= 0);
+                else
+                        assert_se(asprintf(&match, "type='signal',path_namespace='/org/freedesktop/systemd1/unit/u%u'", i) >= 0);
+
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+
+                slots[i].userdata = UINT_TO_PTR(i);
+                slots[i].match_callback.callback = counter;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+                bus_match_parse_free(components, n_components);
+        }
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/systemd1/unit/u2/x", "org.freedesktop.DBus.Properties", "PropertiesChanged") >= 0);
+        assert_se(sd_bus_message_append(m, "s", "foo0.service") >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+        m->sender = ":1.1";
+
+        n_counted = 0;
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n_runs; i++)
+                assert_se(bus_match_run(NULL, &root, m) == 0);
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        /* Every run matches the unique name and the path namespace */
+        assert_se(n_counted == n_runs * 2);
+
+        log_info("%u runs against %u matches: %s", n_runs, n_matches * 3, format_timespan(a, sizeof a, ts, 1));
+
+        m->sender = NULL;
+        bus_match_free(&root);
+        free(slots);
+}
+
 static void test_match_scope(const char *match, enum bus_match_scope scope) {
         struct bus_match_component *components = NULL;
         unsigned n_components = 0;
@@ -92,9 +162,13 @@ int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum bus_match_node_type i;
-        sd_bus_slot slots[19];
+        sd_bus_slot slots[25];
+        bool slow;
         int r;
 
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
         r = sd_bus_open_user(&bus);
         if (r < 0)
                 return EXIT_TEST_SKIP;
@@ -137,6 +211,29 @@ int main(int argc, char *argv[]) {
         assert_se(bus_match_run(NULL, &root, m) == 0);
         assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17 }, 9));
 
+        assert_se(match_add(slots, &root, "sender='org.freedesktop.DBus'", 19) >= 0);
+        assert_se(match_add(slots, &root, "sender=':1.42'", 20) >= 0);
+        assert_se(match_add(slots, &root, "sender=':1.43'", 21) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/'", 22) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.four'", 23) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/foo/bar/baz'", 24) >= 0);
+
+        bus_match_dump(&root, 0);
+
+        /* We cannot tell which well-known names a unique name owns, hence 19 matches too */
+        m->sender = ":1.42";
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 19, 20, 22, 23 }, 13));
+        m->sender = NULL;
+
+        assert_se(bus_match_remove(&root, &slots[19].match_callback) >= 0);
+        assert_se(bus_match_remove(&root, &slots[22].match_callback) >= 0);
+
+        zero(mask);
+        assert_se(bus_match_run(NULL, &root, m) == 0);
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 23 }, 10));
+
         for (i = 0; i < _BUS_MATCH_NODE_TYPE_MAX; i++) {
                 char buf[32];
                 const char *x;
@@ -149,6 +246,8 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        test_benchmark(bus, slow);
+
         test_match_scope("interface='foobar'", BUS_MATCH_GENERIC);
         test_match_scope("", BUS_MATCH_GENERIC);
         test_match_scope("interface='org.freedesktop.DBus.Local'", BUS_MATCH_LOCAL);
@@ -22,6 +22,7 @@
 #include <limits.h>
 #include <mqueue.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -45,6 +46,14 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* The socket we send notifications from is kept around between calls. It is never connected, so it doesn't matter
+ * if $NOTIFY_SOCKET changes, and it is shared with processes we fork off. As the program might close or replace the
+ * fd behind our back, we verify it is still our socket before each use, and simply forget about it if it isn't. */
+static pthread_mutex_t notify_socket_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int notify_socket_fd = -1;
+static dev_t notify_socket_dev = 0;
+static ino_t notify_socket_ino = 0;
+
 static void unsetenv_all(bool unset_environment) {
 
         if (!unset_environment)
@@ -459,6 +468,49 @@ _public_ int sd_is_mq(int fd, const char *path) {
         return 1;
 }
 
+static int notify_socket_new(void) {
+        int fd;
+
+        fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -errno;
+
+        fd_inc_sndbuf(fd, SNDBUF_SIZE);
+
+        return fd;
+}
+
+static bool notify_socket_cached_valid(void) {
+        struct stat st;
+
+        /* Must be called with notify_socket_mutex taken */
+
+        if (notify_socket_fd < 0)
+                return false;
+
+        if (fstat(notify_socket_fd, &st) < 0)
+                return false;
+
+        return S_ISSOCK(st.st_mode) &&
+                st.st_dev == notify_socket_dev &&
+                st.st_ino == notify_socket_ino;
+}
+
+static void notify_socket_cache(int fd) {
+        struct stat st;
+
+        /* Must be called with notify_socket_mutex taken. Takes possession of the fd, if successful. If we had a
+         * socket cached before it is not closed, since it is invalid and the fd number might be used by something
+         * else now. */
+
+        if (fstat(fd, &st) < 0)
+                return;
+
+        notify_socket_fd = fd;
+        notify_socket_dev = st.st_dev;
+        notify_socket_ino = st.st_ino;
+}
+
 _public_ int sd_pid_notify_with_fds(pid_t pid, int unset_environment, const char *state, const int *fds, unsigned n_fds) {
         union sockaddr_union sockaddr = {
                 .sa.sa_family = AF_UNIX,
@@ -471,11 +523,11 @@ _public_ int sd_pid_notify_with_fds(pid_t pid, int unset_environment, const char
                 .msg_iovlen = 1,
                 .msg_name = &sockaddr,
         };
-        _cleanup_close_ int fd = -1;
+        _cleanup_close_ int own_fd = -1;
         struct cmsghdr *cmsg = NULL;
+        bool have_pid, locked = false;
         const char *e;
-        bool have_pid;
-        int r;
+        int fd, r;
 
         if (!state) {
                 r = -EINVAL;
@@ -502,13 +554,27 @@ _public_ int sd_pid_notify_with_fds(pid_t pid, int unset_environment, const char
                 goto finish;
         }
 
-        fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0);
-        if (fd < 0) {
-                r = -errno;
-                goto finish;
-        }
+        /* Never wait for the lock, someone else might be holding it, or we might have been forked off while somebody
+         * else held it. In that case, just use a socket of our own for this call. */
+        locked = pthread_mutex_trylock(&notify_socket_mutex) == 0;
 
-        fd_inc_sndbuf(fd, SNDBUF_SIZE);
+        if (locked && notify_socket_cached_valid())
+                fd = notify_socket_fd;
+        else {
+                own_fd = notify_socket_new();
+                if (own_fd < 0) {
+                        r = own_fd;
+                        goto finish;
+                }
+
+                fd = own_fd;
+
+                if (locked && !unset_environment) {
+                        notify_socket_cache(own_fd);
+                        if (notify_socket_fd == own_fd)
+                                own_fd = -1;
+                }
+        }
 
         iovec.iov_len = strlen(state);
 
@@ -575,6 +641,17 @@ _public_ int sd_pid_notify_with_fds(pid_t pid, int unset_environment, const char
         r = -errno;
 
 finish:
+        if (locked) {
+                /* Without $NOTIFY_SOCKET there's nothing to send further notifications to */
+                if (unset_environment && notify_socket_fd >= 0) {
+                        if (notify_socket_cached_valid())
+                                safe_close(notify_socket_fd);
+                        notify_socket_fd = -1;
+                }
+
+                pthread_mutex_unlock(&notify_socket_mutex);
+        }
+
         if (unset_environment)
                 unsetenv("NOTIFY_SOCKET");
 
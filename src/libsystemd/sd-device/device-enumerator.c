@@ -26,6 +26,8 @@
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "glob-util.h"
+#include "path-util.h"
 #include "prioq.h"
 #include "set.h"
 #include "string-util.h"
@@ -466,6 +468,92 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
+static bool match_is_literal(Set *patterns) {
+        const char *p;
+        Iterator i;
+
+        /* Returns true if all patterns are plain directory entry names, so that the entries they match can be
+         * looked at directly, instead of reading the whole directory and matching every entry against them. */
+
+        if (set_isempty(patterns))
+                return false;
+
+        SET_FOREACH(p, patterns, i)
+                if (string_is_glob(p) || strchr(p, '\\') || !filename_is_valid(p) || p[0] == '.')
+                        return false;
+
+        return true;
+}
+
+static int enumerator_add_candidate(sd_device_enumerator *enumerator, const char *path, const char *name) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        char syspath[strlen(path) + strlen(name) + 1];
+        dev_t devnum;
+        int ifindex, initialized, r;
+
+        assert(enumerator);
+        assert(path);
+        assert(name);
+
+        if (!match_sysname(enumerator, name))
+                return 0;
+
+        (void)sprintf(syspath, "%s%s", path, name);
+
+        r = sd_device_new_from_syspath(&device, syspath);
+        if (r == -ENODEV)
+                /* this is necessarily racey, so ignore missing devices */
+                return 0;
+        if (r < 0)
+                return r;
+
+        /* The parent only needs the devpath, which we already know, check it before reading any files */
+        if (!match_parent(enumerator, device))
+                return 0;
+
+        /*
+         * All devices with a device node or network interfaces
+         * possibly need udev to adjust the device node permission
+         * or context, or rename the interface before it can be
+         * reliably used from other processes.
+         *
+         * For now, we can only check these types of devices, we
+         * might not store a database, and have no way to find out
+         * for all other types of devices.
+         *
+         * Only look at the uevent file and the database if this
+         * matters, walking all of sysfs without reading them is a
+         * lot cheaper.
+         */
+        if (!enumerator->match_allow_uninitialized) {
+                r = sd_device_get_devnum(device, &devnum);
+                if (r < 0)
+                        return r;
+
+                r = sd_device_get_ifindex(device, &ifindex);
+                if (r < 0)
+                        return r;
+
+                r = sd_device_get_is_initialized(device, &initialized);
+                if (r < 0)
+                        return r;
+
+                if (!initialized && (major(devnum) > 0 || ifindex > 0))
+                        return 0;
+        }
+
+        if (!match_tag(enumerator, device))
+                return 0;
+
+        if (!match_property(enumerator, device))
+                return 0;
+
+        if (!match_sysattr(enumerator, device))
+                return 0;
+
+        return device_enumerator_add_device(enumerator, device);
+}
+
 static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
@@ -483,79 +571,36 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
         if (subdir2)
                 path = strjoina(path, subdir2, "/");
 
-        dir = opendir(path);
-        if (!dir)
-                return -errno;
+        /* Looking for devices by name, e.g. "sda"? Then there's no need to read all of /sys/class/block. */
+        if (match_is_literal(enumerator->match_sysname)) {
+                const char *sysname;
+                Iterator i;
 
-        FOREACH_DIRENT_ALL(dent, dir, return -errno) {
-                _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
-                dev_t devnum;
-                int ifindex, initialized, k;
+                if (access(path, F_OK) < 0)
+                        return -errno;
 
-                if (dent->d_name[0] == '.')
-                        continue;
-
-                if (!match_sysname(enumerator, dent->d_name))
-                        continue;
+                SET_FOREACH(sysname, enumerator->match_sysname, i) {
+                        int k;
 
-                (void)sprintf(syspath, "%s%s", path, dent->d_name);
-
-                k = sd_device_new_from_syspath(&device, syspath);
-                if (k < 0) {
-                        if (k != -ENODEV)
-                                /* this is necessarily racey, so ignore missing devices */
+                        k = enumerator_add_candidate(enumerator, path, sysname);
+                        if (k < 0)
                                 r = k;
-
-                        continue;
                 }
 
-                k = sd_device_get_devnum(device, &devnum);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                k = sd_device_get_ifindex(device, &ifindex);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                k = sd_device_get_is_initialized(device, &initialized);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                /*
-                 * All devices with a device node or network interfaces
-                 * possibly need udev to adjust the device node permission
-                 * or context, or rename the interface before it can be
-                 * reliably used from other processes.
-                 *
-                 * For now, we can only check these types of devices, we
-                 * might not store a database, and have no way to find out
-                 * for all other types of devices.
-                 */
-                if (!enumerator->match_allow_uninitialized &&
-                    !initialized &&
-                    (major(devnum) > 0 || ifindex > 0))
-                        continue;
-
-                if (!match_parent(enumerator, device))
-                        continue;
+                return r;
+        }
 
-                if (!match_tag(enumerator, device))
-                        continue;
+        dir = opendir(path);
+        if (!dir)
+                return -errno;
 
-                if (!match_property(enumerator, device))
-                        continue;
+        FOREACH_DIRENT_ALL(dent, dir, return -errno) {
+                int k;
 
-                if (!match_sysattr(enumerator, device))
+                if (dent->d_name[0] == '.')
                         continue;
 
-                k = device_enumerator_add_device(enumerator, device);
+                k = enumerator_add_candidate(enumerator, path, dent->d_name);
                 if (k < 0)
                         r = k;
         }
@@ -594,6 +639,31 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
 
         path = strjoina("/sys/", basedir);
 
+        /* With only plain subsystem names to match, go to their directories right away */
+        if (!subsystem && match_is_literal(enumerator->match_subsystem)) {
+                const char *name;
+                Iterator i;
+
+                if (access(path, F_OK) < 0)
+                        return -errno;
+
+                log_debug("  device-enumerator: scanning %s, subsystems given", path);
+
+                SET_FOREACH(name, enumerator->match_subsystem, i) {
+                        int k;
+
+                        if (!match_subsystem(enumerator, name))
+                                continue;
+
+                        /* Every subsystem is either a bus or a class, the other directory won't exist */
+                        k = enumerator_scan_dir_and_add_devices(enumerator, basedir, name, subdir);
+                        if (k < 0 && k != -ENOENT)
+                                r = k;
+                }
+
+                return r;
+        }
+
         dir = opendir(path);
         if (!dir)
                 return -errno;
@@ -617,6 +687,54 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
         return r;
 }
 
+static bool match_device_id(sd_device_enumerator *enumerator, const char *id) {
+        const char *sep;
+        char *subsystem, *sysname, *p;
+
+        assert(enumerator);
+        assert(id);
+
+        /* The device ID already tells the subsystem of many devices, and the sysname of those without device
+         * node or network interface. Check them before looking up the device in /sys. See
+         * device_get_id_filename() for the format. */
+
+        switch (id[0]) {
+
+        case 'b':
+                return match_subsystem(enumerator, "block");
+
+        case 'n':
+                return match_subsystem(enumerator, "net");
+
+        case '+':
+                sep = strchr(id + 1, ':');
+                if (!sep)
+                        return true;
+
+                subsystem = strndupa(id + 1, sep - id - 1);
+                if (!match_subsystem(enumerator, subsystem))
+                        return false;
+
+                /* "+drivers:$subsys:$sysname" */
+                if (streq(subsystem, "drivers")) {
+                        sep = strchr(sep + 1, ':');
+                        if (!sep)
+                                return true;
+                }
+
+                /* the ID carries the name from the devpath, with '!' not yet translated */
+                sysname = strdupa(sep + 1);
+                for (p = sysname; *p; p++)
+                        if (*p == '!')
+                                *p = '/';
+
+                return match_sysname(enumerator, sysname);
+
+        default:
+                return true;
+        }
+}
+
 static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const char *tag) {
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
@@ -636,8 +754,6 @@ static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const c
                         return log_error_errno(errno, "sd-device-enumerator: could not open tags directory %s: %m", path);
         }
 
-        /* TODO: filter away subsystems? */
-
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
                 _cleanup_(sd_device_unrefp) sd_device *device = NULL;
                 const char *subsystem, *sysname;
@@ -646,6 +762,9 @@ static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const c
                 if (dent->d_name[0] == '.')
                         continue;
 
+                if (!match_device_id(enumerator, dent->d_name))
+                        continue;
+
                 k = sd_device_new_from_device_id(&device, dent->d_name);
                 if (k < 0) {
                         if (k != -ENODEV)
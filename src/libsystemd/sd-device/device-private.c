@@ -925,7 +925,10 @@ static int device_tag(sd_device *device, const char *tag, bool add) {
         path = strjoina("/run/udev/tags/", tag, "/", id);
 
         if (add) {
-                r = touch_file(path, true, USEC_INFINITY, UID_INVALID, GID_INVALID, 0444);
+                /* the tag directory usually exists already, only create it when needed */
+                r = touch_file(path, false, USEC_INFINITY, UID_INVALID, GID_INVALID, 0444);
+                if (r == -ENOENT)
+                        r = touch_file(path, true, USEC_INFINITY, UID_INVALID, GID_INVALID, 0444);
                 if (r < 0)
                         return r;
         } else {
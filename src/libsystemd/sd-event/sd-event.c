@@ -28,21 +28,31 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
 #include "hashmap.h"
 #include "list.h"
 #include "macro.h"
+#include "mempool.h"
 #include "missing.h"
+#include "missing_syscall.h"
 #include "prioq.h"
 #include "process-util.h"
 #include "set.h"
 #include "signal-util.h"
 #include "string-table.h"
 #include "string-util.h"
+#include "strv.h"
 #include "time-util.h"
 #include "util.h"
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
+/* How many epoll events to pick up at most in one iteration, by default. We look for events again on each
+ * iteration, even if the ones picked up before are not all dispatched yet, hence the cost of an iteration should not
+ * grow with the number of sources that are ready. */
+#define DEFAULT_BATCH_MAX 512U
+
 typedef enum EventSourceType {
         SOURCE_IO,
         SOURCE_TIME_REALTIME,
@@ -55,6 +65,7 @@ typedef enum EventSourceType {
         SOURCE_DEFER,
         SOURCE_POST,
         SOURCE_EXIT,
+        SOURCE_INOTIFY,
         SOURCE_WATCHDOG,
         _SOURCE_EVENT_SOURCE_TYPE_MAX,
         _SOURCE_EVENT_SOURCE_TYPE_INVALID = -1
@@ -72,6 +83,7 @@ static const char* const event_source_type_table[_SOURCE_EVENT_SOURCE_TYPE_MAX]
         [SOURCE_DEFER] = "defer",
         [SOURCE_POST] = "post",
         [SOURCE_EXIT] = "exit",
+        [SOURCE_INOTIFY] = "inotify",
         [SOURCE_WATCHDOG] = "watchdog",
 };
 
@@ -84,6 +96,7 @@ typedef enum WakeupType {
         WAKEUP_EVENT_SOURCE,
         WAKEUP_CLOCK_DATA,
         WAKEUP_SIGNAL_DATA,
+        WAKEUP_INOTIFY_DATA,
         _WAKEUP_TYPE_MAX,
         _WAKEUP_TYPE_INVALID = -1,
 } WakeupType;
@@ -106,6 +119,7 @@ struct sd_event_source {
         bool pending:1;
         bool dispatching:1;
         bool floating:1;
+        bool from_pool:1;
 
         int64_t priority;
         unsigned pending_index;
@@ -113,7 +127,11 @@ struct sd_event_source {
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
 
+        usec_t pending_usec;
+        sd_event_profile_stats *profile_stats;
+
         LIST_FIELDS(sd_event_source, sources);
+        LIST_FIELDS(sd_event_source, rearm);
 
         union {
                 struct {
@@ -121,11 +139,14 @@ struct sd_event_source {
                         int fd;
                         uint32_t events;
                         uint32_t revents;
+                        uint32_t registered_events; /* what epoll is armed with right now, 0 if disarmed */
                         bool registered:1;
+                        bool rearm:1;
                 } io;
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
+                        usec_t queued; /* what the prioqs are ordered by, might be earlier than next */
                         unsigned earliest_index;
                         unsigned latest_index;
                 } time;
@@ -139,6 +160,8 @@ struct sd_event_source {
                         siginfo_t siginfo;
                         pid_t pid;
                         int options;
+                        int pidfd;
+                        bool pidfd_registered:1;
                 } child;
                 struct {
                         sd_event_handler_t callback;
@@ -150,6 +173,11 @@ struct sd_event_source {
                         sd_event_handler_t callback;
                         unsigned prioq_index;
                 } exit;
+                struct {
+                        sd_event_inotify_handler_t callback;
+                        uint32_t mask;
+                        struct inode_data *inode;
+                } inotify;
         };
 };
 
@@ -184,6 +212,31 @@ struct signal_data {
         sd_event_source *current;
 };
 
+/* All watches of all inotify sources of an event loop share a single inotify fd */
+struct inotify_data {
+        WakeupType wakeup;
+        int fd;
+
+        Hashmap *inodes; /* indexed by watch descriptor */
+
+        /* Events are dispatched one at a time, straight from the buffer they were read into. The event at the
+         * current offset has been handed out to n_pending sources, once they all ran we move on to the next. */
+        unsigned n_pending;
+        bool current_queued:1;
+        size_t buffer_offset, buffer_filled;
+        union {
+                struct inotify_event ev;
+                uint8_t raw[32 * INOTIFY_EVENT_MAX];
+        } buffer;
+};
+
+/* The kernel hands out the same watch descriptor for the same inode, hence sources watching the same inode,
+ * possibly via different paths, share one of these */
+struct inode_data {
+        int wd;
+        Set *sources;
+};
+
 struct sd_event {
         unsigned n_ref;
 
@@ -214,6 +267,8 @@ struct sd_event {
 
         Prioq *exit;
 
+        struct inotify_data *inotify_data;
+
         pid_t original_pid;
 
         uint64_t iteration;
@@ -224,6 +279,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool profile:1;
 
         int exit_code;
 
@@ -236,8 +292,18 @@ struct sd_event {
 
         LIST_HEAD(sd_event_source, sources);
 
+        /* I/O sources whose epoll registration needs to be updated before the next epoll_wait() */
+        LIST_HEAD(sd_event_source, io_rearm);
+
+        struct epoll_event *event_queue;
+        size_t event_queue_allocated;
+        unsigned batch_max;
+
         usec_t last_run, last_log;
         unsigned delays[sizeof(usec_t) * 8];
+
+        /* Dispatch statistics, keyed by source description, or by source type for sources without one */
+        Hashmap *profile_stats;
 };
 
 static void source_disconnect(sd_event_source *s);
@@ -298,62 +364,33 @@ static int prepare_prioq_compare(const void *a, const void *b) {
         return 0;
 }
 
-static int earliest_time_prioq_compare(const void *a, const void *b) {
-        const sd_event_source *x = a, *y = b;
-
-        assert(EVENT_SOURCE_IS_TIME(x->type));
-        assert(x->type == y->type);
+/* The time prioqs are keyed: enabled ones first, then the ones which are not pending yet, then by time. Times
+ * beyond 2^62 µs are so far in the future that they are all treated as equal. */
+#define TIME_KEY_OFF (UINT64_C(1) << 63)
+#define TIME_KEY_PENDING (UINT64_C(1) << 62)
 
-        /* Enabled ones first */
-        if (x->enabled != SD_EVENT_OFF && y->enabled == SD_EVENT_OFF)
-                return -1;
-        if (x->enabled == SD_EVENT_OFF && y->enabled != SD_EVENT_OFF)
-                return 1;
+static uint64_t time_prioq_key(const sd_event_source *s, usec_t t) {
+        assert(EVENT_SOURCE_IS_TIME(s->type));
 
-        /* Move the pending ones to the end */
-        if (!x->pending && y->pending)
-                return -1;
-        if (x->pending && !y->pending)
-                return 1;
+        return (s->enabled == SD_EVENT_OFF ? TIME_KEY_OFF : 0) |
+                (s->pending ? TIME_KEY_PENDING : 0) |
+                MIN(t, TIME_KEY_PENDING - 1);
+}
 
-        /* Order by time */
-        if (x->time.next < y->time.next)
-                return -1;
-        if (x->time.next > y->time.next)
-                return 1;
+static uint64_t earliest_time_prioq_key(const void *a) {
+        const sd_event_source *s = a;
 
-        return 0;
+        return time_prioq_key(s, s->time.queued);
 }
 
 static usec_t time_event_source_latest(const sd_event_source *s) {
-        return usec_add(s->time.next, s->time.accuracy);
+        return usec_add(s->time.queued, s->time.accuracy);
 }
 
-static int latest_time_prioq_compare(const void *a, const void *b) {
-        const sd_event_source *x = a, *y = b;
-
-        assert(EVENT_SOURCE_IS_TIME(x->type));
-        assert(x->type == y->type);
+static uint64_t latest_time_prioq_key(const void *a) {
+        const sd_event_source *s = a;
 
-        /* Enabled ones first */
-        if (x->enabled != SD_EVENT_OFF && y->enabled == SD_EVENT_OFF)
-                return -1;
-        if (x->enabled == SD_EVENT_OFF && y->enabled != SD_EVENT_OFF)
-                return 1;
-
-        /* Move the pending ones to the end */
-        if (!x->pending && y->pending)
-                return -1;
-        if (x->pending && !y->pending)
-                return 1;
-
-        /* Order by time */
-        if (time_event_source_latest(x) < time_event_source_latest(y))
-                return -1;
-        if (time_event_source_latest(x) > time_event_source_latest(y))
-                return 1;
-
-        return 0;
+        return time_prioq_key(s, time_event_source_latest(s));
 }
 
 static int exit_prioq_compare(const void *a, const void *b) {
@@ -420,6 +457,16 @@ static void event_free(sd_event *e) {
 
         hashmap_free(e->child_sources);
         set_free(e->post_sources);
+
+        if (e->inotify_data) {
+                assert(hashmap_isempty(e->inotify_data->inodes));
+                hashmap_free(e->inotify_data->inodes);
+                safe_close(e->inotify_data->fd);
+                e->inotify_data = mfree(e->inotify_data);
+        }
+
+        free(e->event_queue);
+        hashmap_free_free_free(e->profile_stats);
         free(e);
 }
 
@@ -439,6 +486,7 @@ _public_ int sd_event_new(sd_event** ret) {
         e->realtime.wakeup = e->boottime.wakeup = e->monotonic.wakeup = e->realtime_alarm.wakeup = e->boottime_alarm.wakeup = WAKEUP_CLOCK_DATA;
         e->original_pid = getpid_cached();
         e->perturb = USEC_INFINITY;
+        e->batch_max = DEFAULT_BATCH_MAX;
 
         r = prioq_ensure_allocated(&e->pending, pending_prioq_compare);
         if (r < 0)
@@ -455,6 +503,11 @@ _public_ int sd_event_new(sd_event** ret) {
                 e->profile_delays = true;
         }
 
+        if (secure_getenv("SD_EVENT_PROFILE")) {
+                log_debug("Event source profiling enabled.");
+                e->profile = true;
+        }
+
         *ret = e;
         return 0;
 
@@ -497,12 +550,25 @@ static bool event_pid_changed(sd_event *e) {
         return e->original_pid != getpid_cached();
 }
 
+static void source_io_dequeue(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+
+        if (!s->io.rearm)
+                return;
+
+        LIST_REMOVE(rearm, s->event->io_rearm, s);
+        s->io.rearm = false;
+}
+
 static void source_io_unregister(sd_event_source *s) {
         int r;
 
         assert(s);
         assert(s->type == SOURCE_IO);
 
+        source_io_dequeue(s);
+
         if (event_pid_changed(s->event))
                 return;
 
@@ -515,6 +581,11 @@ static void source_io_unregister(sd_event_source *s) {
                                 strna(s->description), event_source_type_to_string(s->type));
 
         s->io.registered = false;
+        s->io.registered_events = 0;
+}
+
+static uint32_t source_io_epoll_events(int enabled, uint32_t events) {
+        return enabled == SD_EVENT_ONESHOT ? events | EPOLLONESHOT : events;
 }
 
 static int source_io_register(
@@ -523,26 +594,107 @@ static int source_io_register(
                 uint32_t events) {
 
         struct epoll_event ev = {};
-        int r;
 
         assert(s);
         assert(s->type == SOURCE_IO);
         assert(enabled != SD_EVENT_OFF);
 
-        ev.events = events;
+        /* Changes to a registered file descriptor are coalesced and applied once, right before we wait for
+         * events again, see event_flush_io_rearm(). Adding the file descriptor is done right away though, so
+         * that the caller learns whether it can be watched at all. */
+        if (s->io.registered) {
+                if (!s->io.rearm) {
+                        LIST_PREPEND(rearm, s->event->io_rearm, s);
+                        s->io.rearm = true;
+                }
+
+                return 0;
+        }
+
+        ev.events = source_io_epoll_events(enabled, events);
         ev.data.ptr = s;
 
-        if (enabled == SD_EVENT_ONESHOT)
-                ev.events |= EPOLLONESHOT;
+        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->io.fd, &ev) < 0)
+                return -errno;
+
+        s->io.registered = true;
+        s->io.registered_events = ev.events;
 
-        if (s->io.registered)
-                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_MOD, s->io.fd, &ev);
-        else
-                r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->io.fd, &ev);
+        return 0;
+}
+
+static void event_flush_io_rearm(sd_event *e) {
+        sd_event_source *s;
+
+        assert(e);
+
+        while ((s = e->io_rearm)) {
+                struct epoll_event ev = {
+                        .data.ptr = s,
+                };
+
+                source_io_dequeue(s);
+
+                /* Only edge-triggered sources stay registered while turned off, see sd_event_source_set_enabled() */
+                if (s->enabled == SD_EVENT_OFF)
+                        continue;
+
+                ev.events = source_io_epoll_events(s->enabled, s->io.events);
+                if (ev.events == s->io.registered_events)
+                        continue;
+
+                if (epoll_ctl(e->epoll_fd, EPOLL_CTL_MOD, s->io.fd, &ev) < 0) {
+                        log_debug_errno(errno, "Failed to update source %s (type %s) in epoll, disabling: %m",
+                                        strna(s->description), event_source_type_to_string(s->type));
+                        (void) sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                        continue;
+                }
+
+                s->io.registered_events = ev.events;
+        }
+}
+
+/* Child sources only waiting for the exit of the process are watched via a pidfd in epoll if the kernel supports
+ * it, so that only the child that actually exited needs to be looked at. All others are found by going through
+ * all children whenever SIGCHLD is seen. */
+#define EVENT_SOURCE_WATCH_PIDFD(s) ((s)->type == SOURCE_CHILD && (s)->child.pidfd >= 0)
+
+static void source_child_pidfd_unregister(sd_event_source *s) {
+        int r;
+
+        assert(s);
+        assert(EVENT_SOURCE_WATCH_PIDFD(s));
+
+        if (event_pid_changed(s->event))
+                return;
+
+        if (!s->child.pidfd_registered)
+                return;
+
+        r = epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, s->child.pidfd, NULL);
         if (r < 0)
+                log_debug_errno(errno, "Failed to remove source %s (type %s) from epoll: %m",
+                                strna(s->description), event_source_type_to_string(s->type));
+
+        s->child.pidfd_registered = false;
+}
+
+static int source_child_pidfd_register(sd_event_source *s) {
+        struct epoll_event ev = {
+                .events = EPOLLIN,
+                .data.ptr = s,
+        };
+
+        assert(s);
+        assert(EVENT_SOURCE_WATCH_PIDFD(s));
+
+        if (s->child.pidfd_registered)
+                return 0;
+
+        if (epoll_ctl(s->event->epoll_fd, EPOLL_CTL_ADD, s->child.pidfd, &ev) < 0)
                 return -errno;
 
-        s->io.registered = true;
+        s->child.pidfd_registered = true;
 
         return 0;
 }
@@ -788,6 +940,41 @@ static void event_gc_signal_data(sd_event *e, const int64_t *priority, int sig)
                 event_unmask_signal_data(e, d, sig);
 }
 
+static void source_inotify_unwatch(sd_event_source *s) {
+        struct inotify_data *d;
+        struct inode_data *i;
+
+        assert(s);
+        assert(s->type == SOURCE_INOTIFY);
+
+        d = s->event->inotify_data;
+        assert(d);
+
+        if (s->pending) {
+                assert(d->n_pending > 0);
+                d->n_pending--;
+        }
+
+        i = s->inotify.inode;
+        if (!i)
+                return;
+
+        s->inotify.inode = NULL;
+        set_remove(i->sources, s);
+
+        if (!set_isempty(i->sources))
+                return;
+
+        /* The last source watching the inode is gone. Note that we never narrow the mask of a watch that is
+         * still in use, other sources' callbacks only see the events they asked for either way. */
+        if (!event_pid_changed(s->event) && inotify_rm_watch(d->fd, i->wd) < 0)
+                log_debug_errno(errno, "Failed to remove inotify watch %i: %m", i->wd);
+
+        hashmap_remove(d->inodes, INT_TO_PTR(i->wd));
+        set_free(i->sources);
+        free(i);
+}
+
 static void source_disconnect(sd_event_source *s) {
         sd_event *event;
 
@@ -835,7 +1022,9 @@ static void source_disconnect(sd_event_source *s) {
 
         case SOURCE_CHILD:
                 if (s->child.pid > 0) {
-                        if (s->enabled != SD_EVENT_OFF) {
+                        if (EVENT_SOURCE_WATCH_PIDFD(s))
+                                source_child_pidfd_unregister(s);
+                        else if (s->enabled != SD_EVENT_OFF) {
                                 assert(s->event->n_enabled_child_sources > 0);
                                 s->event->n_enabled_child_sources--;
                         }
@@ -844,6 +1033,7 @@ static void source_disconnect(sd_event_source *s) {
                         event_gc_signal_data(s->event, &s->priority, SIGCHLD);
                 }
 
+                s->child.pidfd = safe_close(s->child.pidfd);
                 break;
 
         case SOURCE_DEFER:
@@ -858,6 +1048,10 @@ static void source_disconnect(sd_event_source *s) {
                 prioq_remove(s->event->exit, s, &s->exit.prioq_index);
                 break;
 
+        case SOURCE_INOTIFY:
+                source_inotify_unwatch(s);
+                break;
+
         default:
                 assert_not_reached("Wut? I shouldn't exist.");
         }
@@ -879,12 +1073,37 @@ static void source_disconnect(sd_event_source *s) {
                 sd_event_unref(event);
 }
 
+DEFINE_MEMPOOL(source_pool, sd_event_source, 64);
+
+#ifdef VALGRIND
+__attribute__((destructor)) static void cleanup_source_pool(void) {
+        _cleanup_free_ char *t = NULL;
+        int r;
+
+        /* Be nice to valgrind, see cleanup_pools() in hashmap.c */
+
+        if (!is_main_thread())
+                return;
+
+        r = get_proc_field("/proc/self/status", "Threads", WHITESPACE, &t);
+        if (r < 0 || !streq(t, "1"))
+                return;
+
+        mempool_drop(&source_pool);
+}
+#endif
+
 static void source_free(sd_event_source *s) {
         assert(s);
 
         source_disconnect(s);
+
         free(s->description);
-        free(s);
+
+        if (s->from_pool)
+                mempool_free_tile(&source_pool, s);
+        else
+                free(s);
 }
 
 static int source_set_pending(sd_event_source *s, bool b) {
@@ -900,6 +1119,7 @@ static int source_set_pending(sd_event_source *s, bool b) {
 
         if (b) {
                 s->pending_iteration = s->event->iteration;
+                s->pending_usec = s->event->timestamp.monotonic;
 
                 r = prioq_put(s->event->pending, s, &s->pending_index);
                 if (r < 0) {
@@ -928,18 +1148,37 @@ static int source_set_pending(sd_event_source *s, bool b) {
                         d->current = NULL;
         }
 
+        if (s->type == SOURCE_INOTIFY) {
+                struct inotify_data *d = s->event->inotify_data;
+
+                assert(d);
+
+                if (b)
+                        d->n_pending++;
+                else {
+                        assert(d->n_pending > 0);
+                        d->n_pending--;
+                }
+        }
+
         return 0;
 }
 
 static sd_event_source *source_new(sd_event *e, bool floating, EventSourceType type) {
         sd_event_source *s;
+        bool use_pool;
 
         assert(e);
 
-        s = new0(sd_event_source, 1);
+        /* The pool is not thread-safe, and event sources are freed in the thread they are allocated in, so
+         * use it in the main thread only, just like hashmap.c does */
+        use_pool = is_main_thread();
+
+        s = use_pool ? mempool_alloc0_tile(&source_pool) : new0(sd_event_source, 1);
         if (!s)
                 return NULL;
 
+        s->from_pool = use_pool;
         s->n_ref = 1;
         s->event = e;
         s->floating = floating;
@@ -1084,11 +1323,11 @@ _public_ int sd_event_add_time(
         d = event_get_clock_data(e, type);
         assert(d);
 
-        r = prioq_ensure_allocated(&d->earliest, earliest_time_prioq_compare);
+        r = prioq_ensure_allocated_keyed(&d->earliest, earliest_time_prioq_key);
         if (r < 0)
                 return r;
 
-        r = prioq_ensure_allocated(&d->latest, latest_time_prioq_compare);
+        r = prioq_ensure_allocated_keyed(&d->latest, latest_time_prioq_key);
         if (r < 0)
                 return r;
 
@@ -1102,7 +1341,7 @@ _public_ int sd_event_add_time(
         if (!s)
                 return -ENOMEM;
 
-        s->time.next = usec;
+        s->time.next = s->time.queued = usec;
         s->time.accuracy = accuracy == 0 ? DEFAULT_ACCURACY_USEC : accuracy;
         s->time.callback = callback;
         s->time.earliest_index = s->time.latest_index = PRIOQ_IDX_NULL;
@@ -1225,28 +1464,44 @@ _public_ int sd_event_add_child(
         if (!s)
                 return -ENOMEM;
 
+        s->wakeup = WAKEUP_EVENT_SOURCE;
         s->child.pid = pid;
         s->child.options = options;
         s->child.callback = callback;
+        s->child.pidfd = -1;
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
+        /* A pidfd only tells us about the exit of the process, hence only use it if that's all we are
+         * interested in. If the kernel doesn't know pidfds, or anything else fails, fall back to SIGCHLD. */
+        if (options == WEXITED)
+                s->child.pidfd = pidfd_open(pid, 0);
+
         r = hashmap_put(e->child_sources, PID_TO_PTR(pid), s);
         if (r < 0) {
                 source_free(s);
                 return r;
         }
 
-        e->n_enabled_child_sources++;
+        if (EVENT_SOURCE_WATCH_PIDFD(s)) {
+                /* If the child already exited the pidfd is readable right away, no need to check now */
+                r = source_child_pidfd_register(s);
+                if (r < 0) {
+                        source_free(s);
+                        return r;
+                }
+        } else {
+                e->n_enabled_child_sources++;
 
-        r = event_make_signal_data(e, SIGCHLD, NULL);
-        if (r < 0) {
-                e->n_enabled_child_sources--;
-                source_free(s);
-                return r;
-        }
+                r = event_make_signal_data(e, SIGCHLD, NULL);
+                if (r < 0) {
+                        e->n_enabled_child_sources--;
+                        source_free(s);
+                        return r;
+                }
 
-        e->need_process_child = true;
+                e->need_process_child = true;
+        }
 
         if (ret)
                 *ret = s;
@@ -1365,6 +1620,149 @@ _public_ int sd_event_add_exit(
         return 0;
 }
 
+static int event_make_inotify_data(sd_event *e) {
+        _cleanup_free_ struct inotify_data *d = NULL;
+        struct epoll_event ev = {};
+
+        assert(e);
+
+        if (e->inotify_data)
+                return 0;
+
+        d = new0(struct inotify_data, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->wakeup = WAKEUP_INOTIFY_DATA;
+
+        d->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (d->fd < 0)
+                return -errno;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = d;
+
+        if (epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
+                safe_close(d->fd);
+                return -errno;
+        }
+
+        e->inotify_data = d;
+        d = NULL;
+
+        return 0;
+}
+
+static int source_inotify_watch(sd_event_source *s, const char *path) {
+        _cleanup_free_ struct inode_data *n = NULL;
+        struct inotify_data *d;
+        struct inode_data *i;
+        int wd, r;
+
+        assert(s);
+        assert(s->type == SOURCE_INOTIFY);
+        assert(path);
+
+        d = s->event->inotify_data;
+        assert(d);
+
+        /* Extend the mask of an existing watch on the same inode rather than replacing it */
+        wd = inotify_add_watch(d->fd, path, s->inotify.mask | IN_MASK_ADD);
+        if (wd < 0)
+                return -errno;
+
+        i = hashmap_get(d->inodes, INT_TO_PTR(wd));
+        if (!i) {
+                r = hashmap_ensure_allocated(&d->inodes, NULL);
+                if (r < 0)
+                        goto fail;
+
+                n = new0(struct inode_data, 1);
+                if (!n) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                n->wd = wd;
+
+                r = hashmap_put(d->inodes, INT_TO_PTR(wd), n);
+                if (r < 0)
+                        goto fail;
+
+                i = n;
+                n = NULL;
+        }
+
+        r = set_ensure_allocated(&i->sources, NULL);
+        if (r < 0)
+                goto fail_inode;
+
+        r = set_put(i->sources, s);
+        if (r < 0)
+                goto fail_inode;
+
+        s->inotify.inode = i;
+        return 0;
+
+fail_inode:
+        if (!set_isempty(i->sources))
+                return r;
+
+        hashmap_remove(d->inodes, INT_TO_PTR(wd));
+        set_free(i->sources);
+        free(i);
+
+fail:
+        /* Only drop the watch if nobody else is using it */
+        if (!hashmap_contains(d->inodes, INT_TO_PTR(wd)))
+                (void) inotify_rm_watch(d->fd, wd);
+
+        return r;
+}
+
+_public_ int sd_event_add_inotify(
+                sd_event *e,
+                sd_event_source **ret,
+                const char *path,
+                uint32_t mask,
+                sd_event_inotify_handler_t callback,
+                void *userdata) {
+
+        sd_event_source *s;
+        int r;
+
+        assert_return(e, -EINVAL);
+        assert_return(path, -EINVAL);
+        assert_return(callback, -EINVAL);
+        assert_return(!(mask & (IN_MASK_ADD|IN_ONESHOT)), -EINVAL);
+        assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        r = event_make_inotify_data(e);
+        if (r < 0)
+                return r;
+
+        s = source_new(e, !ret, SOURCE_INOTIFY);
+        if (!s)
+                return -ENOMEM;
+
+        s->inotify.mask = mask;
+        s->inotify.callback = callback;
+        s->userdata = userdata;
+        s->enabled = SD_EVENT_ON;
+
+        r = source_inotify_watch(s, path);
+        if (r < 0) {
+                source_free(s);
+                return r;
+        }
+
+        if (ret)
+                *ret = s;
+
+        return 0;
+}
+
 _public_ sd_event_source* sd_event_source_ref(sd_event_source *s) {
 
         if (!s)
@@ -1409,6 +1807,9 @@ _public_ int sd_event_source_set_description(sd_event_source *s, const char *des
         assert_return(s, -EINVAL);
         assert_return(!event_pid_changed(s->event), -ECHILD);
 
+        /* Statistics are accounted under the new name from now on */
+        s->profile_stats = NULL;
+
         return free_and_strdup(&s->description, description);
 }
 
@@ -1457,12 +1858,15 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                 return 0;
 
         if (s->enabled == SD_EVENT_OFF) {
+                /* Edge-triggered sources might still be registered */
+                source_io_unregister(s);
                 s->io.fd = fd;
-                s->io.registered = false;
         } else {
+                uint32_t saved_events;
                 int saved_fd;
 
                 saved_fd = s->io.fd;
+                saved_events = s->io.registered_events;
                 assert(s->io.registered);
 
                 s->io.fd = fd;
@@ -1472,9 +1876,13 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                 if (r < 0) {
                         s->io.fd = saved_fd;
                         s->io.registered = true;
+                        s->io.registered_events = saved_events;
                         return r;
                 }
 
+                /* The new registration is up-to-date already */
+                source_io_dequeue(s);
+
                 epoll_ctl(s->event->epoll_fd, EPOLL_CTL_DEL, saved_fd, NULL);
         }
 
@@ -1505,6 +1913,11 @@ _public_ int sd_event_source_set_io_events(sd_event_source *s, uint32_t events)
                 return 0;
 
         if (s->enabled != SD_EVENT_OFF) {
+                /* Forget what epoll is armed with, so that the registration is refreshed even if nothing
+                 * changed, which is what resets the edges */
+                if (s->io.events == events)
+                        s->io.registered_events = 0;
+
                 r = source_io_register(s, s->enabled, events);
                 if (r < 0)
                         return r;
@@ -1614,7 +2027,10 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 switch (s->type) {
 
                 case SOURCE_IO:
-                        source_io_unregister(s);
+                        /* Edge-triggered sources stay registered, edges seen while turned off mark them pending,
+                         * and they are dispatched once turned on again. That makes toggling them cheap. */
+                        if (!(s->io.events & EPOLLET))
+                                source_io_unregister(s);
                         s->enabled = m;
                         break;
 
@@ -1644,6 +2060,11 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                 case SOURCE_CHILD:
                         s->enabled = m;
 
+                        if (EVENT_SOURCE_WATCH_PIDFD(s)) {
+                                source_child_pidfd_unregister(s);
+                                break;
+                        }
+
                         assert(s->event->n_enabled_child_sources > 0);
                         s->event->n_enabled_child_sources--;
 
@@ -1655,6 +2076,13 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         prioq_reshuffle(s->event->exit, s, &s->exit.prioq_index);
                         break;
 
+                case SOURCE_INOTIFY:
+                        s->enabled = m;
+
+                        /* Don't hold up the other sources waiting for the event at hand */
+                        source_set_pending(s, false);
+                        break;
+
                 case SOURCE_DEFER:
                 case SOURCE_POST:
                         s->enabled = m;
@@ -1707,6 +2135,15 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
 
                 case SOURCE_CHILD:
 
+                        if (EVENT_SOURCE_WATCH_PIDFD(s)) {
+                                r = source_child_pidfd_register(s);
+                                if (r < 0)
+                                        return r;
+
+                                s->enabled = m;
+                                break;
+                        }
+
                         if (s->enabled == SD_EVENT_OFF)
                                 s->event->n_enabled_child_sources++;
 
@@ -1727,6 +2164,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         prioq_reshuffle(s->event->exit, s, &s->exit.prioq_index);
                         break;
 
+                case SOURCE_INOTIFY:
                 case SOURCE_DEFER:
                 case SOURCE_POST:
                         s->enabled = m;
@@ -1764,12 +2202,22 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
         assert_return(s->event->state != SD_EVENT_FINISHED, -ESTALE);
         assert_return(!event_pid_changed(s->event), -ECHILD);
 
+        d = event_get_clock_data(s->event, s->type);
+        assert(d);
+
         s->time.next = usec;
 
-        source_set_pending(s, false);
+        if (!s->pending && usec >= s->time.queued) {
+                /* Services that keep a timeout per connection push it out again and again, without it ever
+                 * elapsing. Hence, if the source is postponed leave it where it is in the prioqs for now, and
+                 * only move it once it reaches the front, see clock_data_settle(). */
+                d->needs_rearm = true;
+                return 0;
+        }
 
-        d = event_get_clock_data(s->event, s->type);
-        assert(d);
+        s->time.queued = usec;
+
+        source_set_pending(s, false);
 
         prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
         prioq_reshuffle(d->latest, s, &s->time.latest_index);
@@ -1962,6 +2410,29 @@ static usec_t sleep_between(sd_event *e, usec_t a, usec_t b) {
         return b;
 }
 
+static void clock_data_settle(struct clock_data *d) {
+        sd_event_source *s;
+
+        assert(d);
+
+        /* Moves sources that were postponed by sd_event_source_set_time() to their proper place in the prioqs,
+         * as far as needed to make the front of both prioqs correct. Since sources are never queued later than
+         * they are due, anything behind the front is due after it. */
+
+        for (;;) {
+                s = prioq_peek(d->earliest);
+                if (!s || s->time.queued == s->time.next) {
+                        s = prioq_peek(d->latest);
+                        if (!s || s->time.queued == s->time.next)
+                                return;
+                }
+
+                s->time.queued = s->time.next;
+                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
+                prioq_reshuffle(d->latest, s, &s->time.latest_index);
+        }
+}
+
 static int event_arm_timer(
                 sd_event *e,
                 struct clock_data *d) {
@@ -1979,6 +2450,8 @@ static int event_arm_timer(
         else
                 d->needs_rearm = false;
 
+        clock_data_settle(d);
+
         a = prioq_peek(d->earliest);
         if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY) {
 
@@ -2037,9 +2510,154 @@ static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
         else
                 s->io.revents = revents;
 
+        /* The kernel disarmed the file descriptor */
+        if (s->io.registered_events & EPOLLONESHOT)
+                s->io.registered_events = 0;
+
         return source_set_pending(s, true);
 }
 
+static bool inotify_event_matches(const struct inotify_event *ev, uint32_t mask) {
+        assert(ev);
+
+        /* These are always delivered, the watch is gone after them */
+        if (ev->mask & (IN_IGNORED|IN_UNMOUNT|IN_Q_OVERFLOW))
+                return true;
+
+        return ev->mask & mask & IN_ALL_EVENTS;
+}
+
+static int inotify_queue_sources(struct inode_data *i, const struct inotify_event *ev) {
+        sd_event_source *s;
+        Iterator j;
+        int r;
+
+        assert(i);
+        assert(ev);
+
+        SET_FOREACH(s, i->sources, j) {
+                if (s->enabled == SD_EVENT_OFF)
+                        continue;
+
+                if (!inotify_event_matches(ev, s->inotify.mask))
+                        continue;
+
+                r = source_set_pending(s, true);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void inotify_data_drop_current(struct inotify_data *d) {
+        const struct inotify_event *ev;
+
+        assert(d);
+        assert(d->buffer_filled > d->buffer_offset);
+
+        ev = (const struct inotify_event*) (d->buffer.raw + d->buffer_offset);
+
+        /* The kernel dropped the watch, all sources on it are dead now */
+        if (ev->mask & IN_IGNORED) {
+                struct inode_data *i;
+
+                i = hashmap_remove(d->inodes, INT_TO_PTR(ev->wd));
+                if (i) {
+                        sd_event_source *s;
+
+                        while ((s = set_steal_first(i->sources)))
+                                s->inotify.inode = NULL;
+
+                        set_free(i->sources);
+                        free(i);
+                }
+        }
+
+        d->buffer_offset += offsetof(struct inotify_event, name) + ev->len;
+        if (d->buffer_offset >= d->buffer_filled)
+                d->buffer_offset = d->buffer_filled = 0;
+
+        d->current_queued = false;
+}
+
+static int process_inotify(sd_event *e) {
+        struct inotify_data *d;
+        int r;
+
+        assert(e);
+
+        d = e->inotify_data;
+        if (!d)
+                return 0;
+
+        /* Hand out the buffered events one by one. Each event is passed to the callbacks in place, so we may only
+         * move on once all sources interested in the current one have been dispatched. */
+        for (;;) {
+                const struct inotify_event *ev;
+
+                if (d->n_pending > 0)
+                        return 0;
+
+                if (d->current_queued)
+                        inotify_data_drop_current(d);
+
+                if (d->buffer_filled == 0)
+                        return 0;
+
+                if (d->buffer_filled - d->buffer_offset < offsetof(struct inotify_event, name))
+                        return -EIO;
+
+                ev = (const struct inotify_event*) (d->buffer.raw + d->buffer_offset);
+                d->current_queued = true;
+
+                if (ev->mask & IN_Q_OVERFLOW) {
+                        struct inode_data *i;
+                        Iterator j;
+
+                        HASHMAP_FOREACH(i, d->inodes, j) {
+                                r = inotify_queue_sources(i, ev);
+                                if (r < 0)
+                                        return r;
+                        }
+                } else {
+                        struct inode_data *i;
+
+                        i = hashmap_get(d->inodes, INT_TO_PTR(ev->wd));
+                        if (i) {
+                                r = inotify_queue_sources(i, ev);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+        }
+}
+
+static int flush_inotify(sd_event *e, struct inotify_data *d, uint32_t events) {
+        ssize_t n;
+
+        assert(e);
+        assert(d);
+
+        assert_return(events == EPOLLIN, -EIO);
+
+        /* Still busy with what we read last time, the rest stays queued in the kernel */
+        if (d->buffer_filled > 0)
+                return 0;
+
+        n = read(d->fd, &d->buffer, sizeof(d->buffer));
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                return -errno;
+        }
+
+        d->buffer_filled = (size_t) n;
+
+        return process_inotify(e);
+}
+
 static int flush_timer(sd_event *e, int fd, uint32_t events, usec_t *next) {
         uint64_t x;
         ssize_t ss;
@@ -2078,6 +2696,8 @@ static int process_timer(
         assert(d);
 
         for (;;) {
+                clock_data_settle(d);
+
                 s = prioq_peek(d->earliest);
                 if (!s ||
                     s->time.next > n ||
@@ -2133,6 +2753,10 @@ static int process_child(sd_event *e) {
                 if (s->enabled == SD_EVENT_OFF)
                         continue;
 
+                /* Those are woken up by their pidfd */
+                if (EVENT_SOURCE_WATCH_PIDFD(s))
+                        continue;
+
                 zero(s->child.siginfo);
                 r = waitid(P_PID, s->child.pid, &s->child.siginfo,
                            WNOHANG | (s->child.options & WEXITED ? WNOWAIT : 0) | s->child.options);
@@ -2161,6 +2785,29 @@ static int process_child(sd_event *e) {
         return 0;
 }
 
+static int process_pidfd(sd_event *e, sd_event_source *s, uint32_t revents) {
+        assert(e);
+        assert(s);
+        assert(EVENT_SOURCE_WATCH_PIDFD(s));
+
+        if (s->pending)
+                return 0;
+
+        if (s->enabled == SD_EVENT_OFF)
+                return 0;
+
+        /* The pidfd became readable, hence the process exited. Leave it as zombie until dispatched, like
+         * process_child() does. */
+        zero(s->child.siginfo);
+        if (waitid(P_PID, s->child.pid, &s->child.siginfo, WNOHANG|WNOWAIT|WEXITED) < 0)
+                return -errno;
+
+        if (s->child.siginfo.si_pid == 0)
+                return 0;
+
+        return source_set_pending(s, true);
+}
+
 static int process_signal(sd_event *e, struct signal_data *d, uint32_t events) {
         bool read_one = false;
         int r;
@@ -2222,8 +2869,62 @@ static int process_signal(sd_event *e, struct signal_data *d, uint32_t events) {
         }
 }
 
+static sd_event_profile_stats *source_get_profile_stats(sd_event_source *s) {
+        _cleanup_free_ sd_event_profile_stats *stats = NULL;
+        _cleanup_free_ char *name = NULL;
+        const char *key;
+
+        assert(s);
+
+        if (s->profile_stats)
+                return s->profile_stats;
+
+        key = s->description ?: event_source_type_to_string(s->type);
+
+        s->profile_stats = hashmap_get(s->event->profile_stats, key);
+        if (s->profile_stats)
+                return s->profile_stats;
+
+        if (hashmap_ensure_allocated(&s->event->profile_stats, &string_hash_ops) < 0)
+                return NULL;
+
+        name = strdup(key);
+        stats = new0(sd_event_profile_stats, 1);
+        if (!name || !stats)
+                return NULL;
+
+        if (hashmap_put(s->event->profile_stats, name, stats) < 0)
+                return NULL;
+
+        name = NULL;
+        s->profile_stats = stats;
+        stats = NULL;
+
+        return s->profile_stats;
+}
+
+static void profile_stats_account(sd_event_profile_stats *stats, usec_t begin, usec_t end, usec_t ready) {
+        usec_t d;
+
+        assert(stats);
+
+        d = end - begin;
+
+        stats->n_dispatched++;
+        stats->dispatch_usec_total += d;
+        stats->dispatch_usec_max = MAX(stats->dispatch_usec_max, d);
+        stats->histogram[d > 0 ? MIN(u64log2(d), SD_EVENT_PROFILE_BUCKETS - 1U) : 0]++;
+
+        if (ready > 0 && begin > ready) {
+                stats->latency_usec_total += begin - ready;
+                stats->latency_usec_max = MAX(stats->latency_usec_max, begin - ready);
+        }
+}
+
 static int source_dispatch(sd_event_source *s) {
+        sd_event_profile_stats *stats = NULL;
         EventSourceType saved_type;
+        usec_t begin = 0, ready = 0;
         int r = 0;
 
         assert(s);
@@ -2262,6 +2963,18 @@ static int source_dispatch(sd_event_source *s) {
                         return r;
         }
 
+        if (s->event->profile) {
+                stats = source_get_profile_stats(s);
+                if (stats) {
+                        /* Defer and exit sources stay pending while enabled, there's no moment of readiness to
+                         * measure the latency from */
+                        if (!IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT))
+                                ready = s->pending_usec;
+
+                        begin = now(CLOCK_MONOTONIC);
+                }
+        }
+
         s->dispatching = true;
 
         switch (s->type) {
@@ -2290,9 +3003,14 @@ static int source_dispatch(sd_event_source *s) {
                 r = s->child.callback(s, &s->child.siginfo, s->userdata);
 
                 /* Now, reap the PID for good. */
-                if (zombie)
+                if (zombie) {
                         waitid(P_PID, s->child.pid, &s->child.siginfo, WNOHANG|WEXITED);
 
+                        /* The pidfd stays readable forever now */
+                        if (EVENT_SOURCE_WATCH_PIDFD(s))
+                                source_child_pidfd_unregister(s);
+                }
+
                 break;
         }
 
@@ -2308,6 +3026,16 @@ static int source_dispatch(sd_event_source *s) {
                 r = s->exit.callback(s, s->userdata);
                 break;
 
+        case SOURCE_INOTIFY: {
+                struct inotify_data *d = s->event->inotify_data;
+
+                assert(d);
+                assert(d->current_queued);
+
+                r = s->inotify.callback(s, (const struct inotify_event*) (d->buffer.raw + d->buffer_offset), s->userdata);
+                break;
+        }
+
         case SOURCE_WATCHDOG:
         case _SOURCE_EVENT_SOURCE_TYPE_MAX:
         case _SOURCE_EVENT_SOURCE_TYPE_INVALID:
@@ -2316,6 +3044,10 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        /* Note that the source might be gone already at this point, the statistics are owned by the event loop */
+        if (stats)
+                profile_stats_account(stats, begin, now(CLOCK_MONOTONIC), ready);
+
         if (r < 0)
                 log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                                 strna(s->description), event_source_type_to_string(saved_type));
@@ -2464,6 +3196,13 @@ _public_ int sd_event_prepare(sd_event *e) {
         if (r < 0)
                 return r;
 
+        event_flush_io_rearm(e);
+
+        /* Queue the next of the inotify events we read earlier, if the previous one is done with */
+        r = process_inotify(e);
+        if (r < 0)
+                return r;
+
         r = event_arm_timer(e, &e->realtime);
         if (r < 0)
                 return r;
@@ -2501,7 +3240,6 @@ pending:
 }
 
 _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
-        struct epoll_event *ev_queue;
         unsigned ev_queue_max;
         int r, m, i;
 
@@ -2515,10 +3253,19 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
                 return 1;
         }
 
-        ev_queue_max = MAX(e->n_sources, 1u);
-        ev_queue = newa(struct epoll_event, ev_queue_max);
+        /* Sources might have been changed since sd_event_prepare(), if the caller runs another event loop in
+         * between */
+        event_flush_io_rearm(e);
+
+        /* Events we don't pick up now stay queued in the kernel, and since epoll hands out ready file descriptors
+         * round-robin they will be returned next time. */
+        ev_queue_max = CLAMP(e->n_sources, 1u, e->batch_max);
+        if (!GREEDY_REALLOC(e->event_queue, e->event_queue_allocated, ev_queue_max)) {
+                r = -ENOMEM;
+                goto finish;
+        }
 
-        m = epoll_wait(e->epoll_fd, ev_queue, ev_queue_max,
+        m = epoll_wait(e->epoll_fd, e->event_queue, ev_queue_max,
                        timeout == (uint64_t) -1 ? -1 : (int) ((timeout + USEC_PER_MSEC - 1) / USEC_PER_MSEC));
         if (m < 0) {
                 if (errno == EINTR) {
@@ -2534,25 +3281,35 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout) {
 
         for (i = 0; i < m; i++) {
 
-                if (ev_queue[i].data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
-                        r = flush_timer(e, e->watchdog_fd, ev_queue[i].events, NULL);
+                if (e->event_queue[i].data.ptr == INT_TO_PTR(SOURCE_WATCHDOG))
+                        r = flush_timer(e, e->watchdog_fd, e->event_queue[i].events, NULL);
                 else {
-                        WakeupType *t = ev_queue[i].data.ptr;
+                        WakeupType *t = e->event_queue[i].data.ptr;
 
                         switch (*t) {
 
-                        case WAKEUP_EVENT_SOURCE:
-                                r = process_io(e, ev_queue[i].data.ptr, ev_queue[i].events);
+                        case WAKEUP_EVENT_SOURCE: {
+                                sd_event_source *s = e->event_queue[i].data.ptr;
+
+                                if (s->type == SOURCE_CHILD)
+                                        r = process_pidfd(e, s, e->event_queue[i].events);
+                                else
+                                        r = process_io(e, s, e->event_queue[i].events);
                                 break;
+                        }
 
                         case WAKEUP_CLOCK_DATA: {
-                                struct clock_data *d = ev_queue[i].data.ptr;
-                                r = flush_timer(e, d->fd, ev_queue[i].events, &d->next);
+                                struct clock_data *d = e->event_queue[i].data.ptr;
+                                r = flush_timer(e, d->fd, e->event_queue[i].events, &d->next);
                                 break;
                         }
 
                         case WAKEUP_SIGNAL_DATA:
-                                r = process_signal(e, ev_queue[i].data.ptr, ev_queue[i].events);
+                                r = process_signal(e, e->event_queue[i].data.ptr, e->event_queue[i].events);
+                                break;
+
+                        case WAKEUP_INOTIFY_DATA:
+                                r = flush_inotify(e, e->event_queue[i].data.ptr, e->event_queue[i].events);
                                 break;
 
                         default:
@@ -2817,6 +3574,23 @@ _public_ int sd_event_get_tid(sd_event *e, pid_t *tid) {
         return -ENXIO;
 }
 
+_public_ int sd_event_set_batch_max(sd_event *e, unsigned max) {
+        assert_return(e, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        e->batch_max = max > 0 ? max : DEFAULT_BATCH_MAX;
+        return 0;
+}
+
+_public_ int sd_event_get_batch_max(sd_event *e, unsigned *ret) {
+        assert_return(e, -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        *ret = e->batch_max;
+        return 0;
+}
+
 _public_ int sd_event_set_watchdog(sd_event *e, int b) {
         int r;
 
@@ -2883,3 +3657,70 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         *ret = e->iteration;
         return 0;
 }
+
+_public_ int sd_event_set_profile(sd_event *e, int b) {
+        assert_return(e, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        e->profile = b;
+        return e->profile;
+}
+
+_public_ int sd_event_get_profile(sd_event *e) {
+        assert_return(e, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        return e->profile;
+}
+
+_public_ int sd_event_get_profile_names(sd_event *e, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        sd_event_profile_stats *stats;
+        const char *name;
+        Iterator i;
+
+        assert_return(e, -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        HASHMAP_FOREACH_KEY(stats, name, e->profile_stats, i)
+                if (strv_extend(&l, name) < 0)
+                        return -ENOMEM;
+
+        if (!l) {
+                l = new0(char*, 1);
+                if (!l)
+                        return -ENOMEM;
+        }
+
+        *ret = strv_sort(l);
+        l = NULL;
+
+        return 0;
+}
+
+_public_ int sd_event_get_profile_stats(sd_event *e, const char *name, sd_event_profile_stats *ret) {
+        sd_event_profile_stats *stats;
+
+        assert_return(e, -EINVAL);
+        assert_return(name, -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        stats = hashmap_get(e->profile_stats, name);
+        if (!stats)
+                return -ENOENT;
+
+        *ret = *stats;
+        return 0;
+}
+
+_public_ int sd_event_source_get_inotify_mask(sd_event_source *s, uint32_t *mask) {
+        assert_return(s, -EINVAL);
+        assert_return(mask, -EINVAL);
+        assert_return(s->type == SOURCE_INOTIFY, -EDOM);
+        assert_return(!event_pid_changed(s->event), -ECHILD);
+
+        *mask = s->inotify.mask;
+        return 0;
+}
@@ -18,14 +18,21 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <sys/socket.h>
 #include <sys/wait.h>
 
 #include "sd-event.h"
 
+#include "alloc-util.h"
+#include "env-util.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
 #include "log.h"
 #include "macro.h"
 #include "signal-util.h"
+#include "string-util.h"
+#include "strv.h"
 #include "util.h"
 
 static int prepare_handler(sd_event_source *s, void *userdata) {
@@ -354,7 +361,398 @@ static void test_rtqueue(void) {
         sd_event_unref(e);
 }
 
+static unsigned n_postpone;
+
+static int postpone_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        uint64_t t;
+
+        assert_se(sd_event_source_get_time(s, &t) >= 0);
+        assert_se(usec == t);
+        assert_se(now(CLOCK_MONOTONIC) >= usec);
+
+        /* The source postponed most often is due last */
+        assert_se(PTR_TO_UINT(userdata) == n_postpone);
+        if (++n_postpone == 3)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 0;
+}
+
+static void test_time_postpone(void) {
+        sd_event_source *x = NULL, *y = NULL, *z = NULL;
+        sd_event *e = NULL;
+        usec_t t;
+        unsigned i;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+        assert_se(sd_event_add_time(e, &x, CLOCK_MONOTONIC, t + 10 * USEC_PER_MSEC, 1, postpone_handler, UINT_TO_PTR(2)) >= 0);
+        assert_se(sd_event_add_time(e, &y, CLOCK_MONOTONIC, t + 30 * USEC_PER_MSEC, 1, postpone_handler, UINT_TO_PTR(0)) >= 0);
+        assert_se(sd_event_add_time(e, &z, CLOCK_MONOTONIC, t + 20 * USEC_PER_MSEC, 1, postpone_handler, UINT_TO_PTR(1)) >= 0);
+
+        /* Push x out in small steps, like a connection timeout, then move z forward and back again */
+        for (i = 1; i <= 100; i++)
+                assert_se(sd_event_source_set_time(x, t + 10 * USEC_PER_MSEC + i * 500) >= 0);
+        assert_se(sd_event_source_set_time(z, t + 25 * USEC_PER_MSEC) >= 0);
+        assert_se(sd_event_source_set_time(z, t + 40 * USEC_PER_MSEC) >= 0);
+
+        n_postpone = 0;
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(n_postpone == 3);
+
+        sd_event_source_unref(x);
+        sd_event_source_unref(y);
+        sd_event_source_unref(z);
+        sd_event_unref(e);
+}
+
+static unsigned n_batch_io;
+
+static int batch_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        char ch;
+
+        assert_se(read(fd, &ch, 1) == 1);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        n_batch_io++;
+
+        return 1;
+}
+
+static void test_batch_max(void) {
+        sd_event_source *sources[10] = {};
+        int fds[10][2];
+        sd_event *e = NULL;
+        unsigned i, max;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(sd_event_get_batch_max(e, &max) >= 0);
+        assert_se(max > 0);
+
+        assert_se(sd_event_set_batch_max(e, 2) >= 0);
+        assert_se(sd_event_get_batch_max(e, &max) >= 0);
+        assert_se(max == 2);
+
+        for (i = 0; i < ELEMENTSOF(sources); i++) {
+                assert_se(pipe2(fds[i], O_CLOEXEC|O_NONBLOCK) >= 0);
+                assert_se(sd_event_add_io(e, &sources[i], fds[i][0], EPOLLIN, batch_io_handler, NULL) >= 0);
+                assert_se(write(fds[i][1], "x", 1) == 1);
+        }
+
+        /* Only two of the ready sources are picked up at a time, but all of them get their turn, one on each
+         * iteration */
+        n_batch_io = 0;
+        for (i = 0; i < ELEMENTSOF(sources); i++)
+                assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_batch_io == ELEMENTSOF(sources));
+        assert_se(sd_event_run(e, 0) == 0);
+
+        for (i = 0; i < ELEMENTSOF(sources); i++) {
+                sd_event_source_unref(sources[i]);
+                safe_close_pair(fds[i]);
+        }
+
+        sd_event_unref(e);
+}
+
+static int profile_handler(sd_event_source *s, void *userdata) {
+        usleep(10);
+        return 0;
+}
+
+static void test_profile(void) {
+        sd_event_source *a = NULL, *b = NULL, *c = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        sd_event_profile_stats stats;
+        sd_event *e = NULL;
+        unsigned i;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_profile(e, true) >= 0);
+        assert_se(sd_event_get_profile(e) > 0);
+
+        assert_se(sd_event_add_defer(e, &a, profile_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(a, "hot") >= 0);
+        assert_se(sd_event_source_set_enabled(a, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_add_defer(e, &b, profile_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(b, "hot") >= 0);
+        assert_se(sd_event_source_set_priority(b, SD_EVENT_PRIORITY_IDLE) >= 0);
+        assert_se(sd_event_add_post(e, &c, profile_handler, NULL) >= 0);
+
+        /* The first source always wins. Once it is turned off the post source gets its turn, and then the idle
+         * one. */
+        for (i = 0; i < 10; i++)
+                assert_se(sd_event_run(e, 0) > 0);
+        assert_se(sd_event_source_set_enabled(a, SD_EVENT_OFF) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(sd_event_source_set_enabled(b, SD_EVENT_OFF) >= 0);
+
+        /* Sources sharing a description are accounted together, the others by their type */
+        assert_se(sd_event_get_profile_names(e, &names) >= 0);
+        assert_se(strv_equal(names, STRV_MAKE("hot", "post")));
+
+        assert_se(sd_event_get_profile_stats(e, "hot", &stats) >= 0);
+        assert_se(stats.n_dispatched == 11);
+        assert_se(stats.dispatch_usec_total >= 11 * 10);
+        assert_se(stats.dispatch_usec_max >= 10);
+        assert_se(stats.dispatch_usec_max <= stats.dispatch_usec_total);
+        assert_se(stats.latency_usec_total == 0);
+
+        assert_se(sd_event_get_profile_stats(e, "post", &stats) >= 0);
+        assert_se(stats.n_dispatched == 1);
+        assert_se(stats.histogram[u64log2(stats.dispatch_usec_max)] == 1);
+
+        assert_se(sd_event_get_profile_stats(e, "io", &stats) == -ENOENT);
+
+        sd_event_source_unref(a);
+        sd_event_source_unref(b);
+        sd_event_source_unref(c);
+        sd_event_unref(e);
+}
+
+static unsigned n_rearm_io;
+static uint32_t last_rearm_revents;
+
+static int rearm_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        n_rearm_io++;
+        last_rearm_revents = revents;
+        return 1;
+}
+
+static void test_io_rearm(void) {
+        sd_event_source *s = NULL;
+        sd_event *e = NULL;
+        int fds[2], enabled;
+        unsigned i;
+        char ch;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, fds) >= 0);
+
+        /* Only the last of the changes made in one iteration matters */
+        assert_se(sd_event_add_io(e, &s, fds[0], EPOLLIN, rearm_io_handler, NULL) >= 0);
+        for (i = 0; i < 100; i++) {
+                assert_se(sd_event_source_set_io_events(s, EPOLLIN|EPOLLOUT) >= 0);
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+                assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        }
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_rearm_io == 0);
+
+        assert_se(sd_event_source_set_io_events(s, EPOLLOUT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_rearm_io == 1);
+        assert_se(last_rearm_revents == EPOLLOUT);
+
+        assert_se(sd_event_source_set_io_events(s, EPOLLIN) >= 0);
+        assert_se(sd_event_run(e, 0) == 0);
+
+        s = sd_event_source_unref(s);
+
+        /* Edge-triggered sources remember edges seen while turned off */
+        n_rearm_io = 0;
+        assert_se(sd_event_add_io(e, &s, fds[0], EPOLLIN|EPOLLET, rearm_io_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(write(fds[1], "x", 1) == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_rearm_io == 0);
+
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_rearm_io == 1);
+        assert_se(last_rearm_revents == EPOLLIN);
+
+        /* Without draining there's no new edge, hence no further wakeup */
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_rearm_io == 1);
+
+        assert_se(write(fds[1], "x", 1) == 1);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_rearm_io == 2);
+
+        /* Oneshot sources are disarmed after the dispatch, and need to be turned on again */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(write(fds[1], "x", 1) == 1);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_rearm_io == 3);
+        assert_se(sd_event_source_get_enabled(s, &enabled) >= 0);
+        assert_se(enabled == SD_EVENT_OFF);
+
+        assert_se(write(fds[1], "x", 1) == 1);
+        assert_se(sd_event_run(e, 0) == 0);
+        assert_se(n_rearm_io == 3);
+
+        /* Re-arming makes epoll look at the file descriptor again, which still has data queued */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_rearm_io == 4);
+
+        for (i = 0; i < 4; i++)
+                assert_se(read(fds[0], &ch, 1) == 1);
+
+        sd_event_source_unref(s);
+        safe_close_pair(fds);
+        sd_event_unref(e);
+}
+
+struct inotify_context {
+        unsigned n_create, n_delete, n_ignored;
+        char *last_name;
+};
+
+static int inotify_handler(sd_event_source *s, const struct inotify_event *ev, void *userdata) {
+        struct inotify_context *c = userdata;
+        uint32_t mask;
+
+        assert_se(sd_event_source_get_inotify_mask(s, &mask) >= 0);
+
+        /* Only what we asked for, even though the watch is shared */
+        if (ev->mask & IN_IGNORED)
+                c->n_ignored++;
+        else {
+                assert_se(ev->mask & mask);
+
+                if (ev->mask & IN_CREATE)
+                        c->n_create++;
+                if (ev->mask & IN_DELETE)
+                        c->n_delete++;
+        }
+
+        if (ev->len > 0)
+                assert_se(free_and_strdup(&c->last_name, ev->name) >= 0);
+
+        return 0;
+}
+
+static void test_inotify(void) {
+        struct inotify_context a = {}, b = {}, x = {};
+        sd_event_source *sa = NULL, *sb = NULL, *sx = NULL;
+        _cleanup_free_ char *p = NULL, *q = NULL, *dot = NULL;
+        char *dir = NULL;
+        sd_event *e = NULL;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(mkdtemp_malloc("/tmp/test-event-inotify-XXXXXX", &dir) >= 0);
+        dot = strjoin(dir, "/.");
+        p = strjoin(dir, "/foo");
+        q = strjoin(dir, "/bar");
+        assert_se(dot && p && q);
+
+        /* Three sources on the same directory, two of which reach it via different paths */
+        assert_se(sd_event_add_inotify(e, &sa, dir, IN_CREATE, inotify_handler, &a) >= 0);
+        assert_se(sd_event_add_inotify(e, &sb, dot, IN_DELETE, inotify_handler, &b) >= 0);
+        assert_se(sd_event_add_inotify(e, &sx, dir, IN_CREATE|IN_DELETE, inotify_handler, &x) >= 0);
+        assert_se(sd_event_add_inotify(e, NULL, dir, IN_CREATE|IN_ONESHOT, inotify_handler, NULL) == -EINVAL);
+
+        assert_se(touch(p) >= 0);
+        assert_se(touch(q) >= 0);
+        assert_se(unlink(p) >= 0);
+
+        while (sd_event_run(e, 0) > 0)
+                ;
+
+        assert_se(a.n_create == 2 && a.n_delete == 0);
+        assert_se(b.n_create == 0 && b.n_delete == 1);
+        assert_se(x.n_create == 2 && x.n_delete == 1);
+        assert_se(streq(a.last_name, "bar"));
+        assert_se(streq(b.last_name, "foo"));
+
+        /* A disabled source does not hold up the others */
+        assert_se(sd_event_source_set_enabled(sa, SD_EVENT_OFF) >= 0);
+        assert_se(touch(p) >= 0);
+        while (sd_event_run(e, 0) > 0)
+                ;
+        assert_se(a.n_create == 2);
+        assert_se(x.n_create == 3);
+
+        /* Removing sources keeps the watch alive for the rest */
+        sa = sd_event_source_unref(sa);
+        sb = sd_event_source_unref(sb);
+        assert_se(unlink(p) >= 0);
+        while (sd_event_run(e, 0) > 0)
+                ;
+        assert_se(b.n_delete == 1);
+        assert_se(x.n_delete == 2);
+
+        /* Once the directory is gone, so is the watch */
+        assert_se(unlink(q) >= 0);
+        assert_se(rmdir(dir) >= 0);
+        while (sd_event_run(e, 0) > 0)
+                ;
+        assert_se(x.n_delete == 3);
+        assert_se(x.n_ignored == 1);
+
+        sd_event_source_unref(sx);
+        sd_event_unref(e);
+
+        free(a.last_name);
+        free(b.last_name);
+        free(x.last_name);
+        free(dir);
+}
+
+static pid_t *many_pids;
+static unsigned n_many_pids, n_many_exited;
+
+static int many_child_handler(sd_event_source *s, const siginfo_t *si, void *userdata) {
+        unsigned i = PTR_TO_UINT(userdata);
+
+        assert_se(i == n_many_exited);
+        assert_se(si->si_pid == many_pids[i]);
+        assert_se(si->si_code == CLD_KILLED);
+
+        /* Let the children exit one after the other, so that the scan for the exited child, if any, is done
+         * once for each of them */
+        if (++n_many_exited < n_many_pids)
+                assert_se(kill(many_pids[n_many_exited], SIGKILL) >= 0);
+        else
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 1;
+}
+
+static void test_child_many(unsigned n, int options) {
+        sd_event *e = NULL;
+        usec_t t;
+        unsigned i;
+
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGCHLD, -1) >= 0);
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(many_pids = new(pid_t, n));
+        n_many_pids = n;
+        n_many_exited = 0;
+
+        for (i = 0; i < n; i++) {
+                many_pids[i] = fork();
+                assert_se(many_pids[i] >= 0);
+
+                if (many_pids[i] == 0)
+                        for (;;)
+                                pause();
+
+                assert_se(sd_event_add_child(e, NULL, many_pids[i], options, many_child_handler, UINT_TO_PTR(i)) >= 0);
+        }
+
+        t = now(CLOCK_MONOTONIC);
+
+        assert_se(kill(many_pids[0], SIGKILL) >= 0);
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(n_many_exited == n);
+
+        log_info("%u children with options %i exited one by one in %s", n, options,
+                 format_timespan((char[FORMAT_TIMESPAN_MAX]) {}, FORMAT_TIMESPAN_MAX, now(CLOCK_MONOTONIC) - t, USEC_PER_MSEC));
+
+        many_pids = mfree(many_pids);
+        sd_event_unref(e);
+}
+
 int main(int argc, char *argv[]) {
+        bool slow;
+        int r;
 
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
@@ -362,6 +760,18 @@ int main(int argc, char *argv[]) {
         test_basic();
         test_sd_event_now();
         test_rtqueue();
+        test_batch_max();
+        test_time_postpone();
+        test_profile();
+        test_io_rearm();
+        test_inotify();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+        /* Only waiting for the exit is done via pidfds, watching for stops makes us look at all children */
+        test_child_many(slow ? 10000 : 200, WEXITED);
+        test_child_many(slow ? 1000 : 200, WEXITED|WSTOPPED);
 
         return 0;
 }
@@ -38,6 +38,14 @@
 #include "refcnt.h"
 #include "string-util.h"
 
+/* number of recently looked up modaliases whose properties are kept */
+#define HWDB_CACHE_MAX 8
+
+struct hwdb_cache_entry {
+        char *modalias;
+        OrderedHashmap *properties;
+};
+
 struct sd_hwdb {
         RefCount n_ref;
         int refcount;
@@ -52,6 +60,10 @@ struct sd_hwdb {
         OrderedHashmap *properties;
         Iterator properties_iterator;
         bool properties_modified;
+
+        /* most recently used first, properties points to the first entry's map */
+        struct hwdb_cache_entry cache[HWDB_CACHE_MAX];
+        unsigned n_cache;
 };
 
 struct linebuf {
@@ -121,22 +133,30 @@ static const char *trie_string(sd_hwdb *hwdb, le64_t off) {
         return hwdb->map + le64toh(off);
 }
 
-static int trie_children_cmp_f(const void *v1, const void *v2) {
-        const struct trie_child_entry_f *n1 = v1;
-        const struct trie_child_entry_f *n2 = v2;
+static const struct trie_node_f *node_lookup_f(sd_hwdb *hwdb, const struct trie_node_f *node, uint8_t c) {
+        size_t lo = 0, hi = node->children_count;
+
+        /* Children are sorted by their character. Most nodes have only a few, and the glob
+         * characters are looked up at every level of every search, so compare inline instead of
+         * calling out to bsearch(), and give up early if c is outside the range of children. */
+        if (hi == 0 ||
+            c < trie_node_child(hwdb, node, 0)->c ||
+            c > trie_node_child(hwdb, node, hi - 1)->c)
+                return NULL;
+
+        while (lo < hi) {
+                const struct trie_child_entry_f *child;
+                size_t mid = (lo + hi) / 2;
 
-        return n1->c - n2->c;
-}
+                child = trie_node_child(hwdb, node, mid);
+                if (child->c == c)
+                        return trie_node_from_off(hwdb, child->child_off);
+                if (child->c < c)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
 
-static const struct trie_node_f *node_lookup_f(sd_hwdb *hwdb, const struct trie_node_f *node, uint8_t c) {
-        struct trie_child_entry_f *child;
-        struct trie_child_entry_f search;
-
-        search.c = c;
-        child = bsearch(&search, (const char *)node + le64toh(hwdb->head->node_size), node->children_count,
-                        le64toh(hwdb->head->child_entry_size), trie_children_cmp_f);
-        if (child)
-                return trie_node_from_off(hwdb, child->child_off);
         return NULL;
 }
 
@@ -389,10 +409,15 @@ _public_ sd_hwdb *sd_hwdb_ref(sd_hwdb *hwdb) {
 
 _public_ sd_hwdb *sd_hwdb_unref(sd_hwdb *hwdb) {
         if (hwdb && REFCNT_DEC(hwdb->n_ref) == 0) {
+                unsigned i;
+
                 if (hwdb->map)
                         munmap((void *)hwdb->map, hwdb->st.st_size);
                 safe_fclose(hwdb->f);
-                ordered_hashmap_free(hwdb->properties);
+                for (i = 0; i < hwdb->n_cache; i++) {
+                        free(hwdb->cache[i].modalias);
+                        ordered_hashmap_free(hwdb->cache[i].properties);
+                }
                 free(hwdb);
         }
 
@@ -425,13 +450,52 @@ bool hwdb_validate(sd_hwdb *hwdb) {
 }
 
 static int properties_prepare(sd_hwdb *hwdb, const char *modalias) {
+        struct hwdb_cache_entry e;
+        unsigned i;
+        int r;
+
         assert(hwdb);
         assert(modalias);
 
-        ordered_hashmap_clear(hwdb->properties);
         hwdb->properties_modified = true;
 
-        return trie_search_f(hwdb, modalias);
+        /* Callers usually ask for several keys of the same modalias, and udev asks for the
+         * same few modaliases over and over, so keep the results of the last lookups. */
+        for (i = 0; i < hwdb->n_cache; i++)
+                if (streq(hwdb->cache[i].modalias, modalias))
+                        break;
+
+        if (i < hwdb->n_cache)
+                e = hwdb->cache[i];
+        else {
+                e.modalias = strdup(modalias);
+                if (!e.modalias)
+                        return -ENOMEM;
+
+                hwdb->properties = NULL;
+                r = trie_search_f(hwdb, modalias);
+                if (r < 0) {
+                        free(e.modalias);
+                        ordered_hashmap_free(hwdb->properties);
+                        hwdb->properties = hwdb->n_cache > 0 ? hwdb->cache[0].properties : NULL;
+                        return r;
+                }
+                e.properties = hwdb->properties;
+
+                if (hwdb->n_cache < HWDB_CACHE_MAX)
+                        i = hwdb->n_cache++;
+                else {
+                        i = HWDB_CACHE_MAX - 1;
+                        free(hwdb->cache[i].modalias);
+                        ordered_hashmap_free(hwdb->cache[i].properties);
+                }
+        }
+
+        memmove(hwdb->cache + 1, hwdb->cache, i * sizeof(struct hwdb_cache_entry));
+        hwdb->cache[0] = e;
+        hwdb->properties = e.properties;
+
+        return 0;
 }
 
 _public_ int sd_hwdb_get(sd_hwdb *hwdb, const char *modalias, const char *key, const char **_value) {
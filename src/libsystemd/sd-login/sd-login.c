@@ -40,7 +40,9 @@
 #include "macro.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "set.h"
 #include "socket-util.h"
+#include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
 #include "user-util.h"
@@ -152,6 +154,124 @@ _public_ int sd_pid_get_cgroup(pid_t pid, char **cgroup) {
         return 0;
 }
 
+_public_ int sd_pid_get_identity(
+                pid_t pid,
+                char **session,
+                uid_t *owner_uid,
+                char **unit,
+                char **user_unit,
+                char **slice,
+                char **user_slice,
+                char **machine,
+                char **cgroup) {
+
+        _cleanup_free_ char *raw = NULL, *s = NULL, *u = NULL, *uu = NULL, *sl = NULL, *usl = NULL, *m = NULL, *c = NULL;
+        uid_t o = UID_INVALID;
+        const char *shifted;
+        int r;
+
+        assert_return(pid >= 0, -EINVAL);
+
+        /* Returns all the cgroup-derived metadata the calls above return individually, but reads and parses
+         * /proc/$PID/cgroup only once. Fields that do not apply to the process are returned as NULL (or
+         * UID_INVALID for the owner UID), instead of failing the whole call with -ENODATA. */
+
+        r = cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, pid, &raw);
+        if (r < 0)
+                return IN_SET(r, -ENXIO, -ENOMEDIUM) ? -ENODATA : r;
+
+        r = cg_shift_path(raw, NULL, &shifted);
+        if (r < 0)
+                return r;
+
+        if (session) {
+                r = cg_path_get_session(shifted, &s);
+                if (r < 0 && r != -ENXIO)
+                        return r;
+        }
+
+        if (owner_uid) {
+                r = cg_path_get_owner_uid(shifted, &o);
+                if (r < 0 && r != -ENXIO)
+                        return r;
+        }
+
+        if (unit) {
+                r = cg_path_get_unit(shifted, &u);
+                if (r < 0 && r != -ENXIO)
+                        return r;
+        }
+
+        if (user_unit) {
+                r = cg_path_get_user_unit(shifted, &uu);
+                if (r < 0 && r != -ENXIO)
+                        return r;
+        }
+
+        if (slice) {
+                r = cg_path_get_slice(shifted, &sl);
+                if (r < 0 && r != -ENXIO)
+                        return r;
+        }
+
+        if (user_slice) {
+                r = cg_path_get_user_slice(shifted, &usl);
+                if (r < 0 && r != -ENXIO)
+                        return r;
+        }
+
+        if (machine) {
+                r = cg_path_get_machine_name(shifted, &m);
+                if (r < 0 && !IN_SET(r, -ENXIO, -ENOENT))
+                        return r;
+        }
+
+        if (cgroup) {
+                /* Like sd_pid_get_cgroup(), return the unshifted path, and "/" for the root cgroup. */
+                if (isempty(raw)) {
+                        c = strdup("/");
+                        if (!c)
+                                return -ENOMEM;
+                } else {
+                        c = raw;
+                        raw = NULL;
+                }
+        }
+
+        if (session) {
+                *session = s;
+                s = NULL;
+        }
+        if (owner_uid)
+                *owner_uid = o;
+        if (unit) {
+                *unit = u;
+                u = NULL;
+        }
+        if (user_unit) {
+                *user_unit = uu;
+                uu = NULL;
+        }
+        if (slice) {
+                *slice = sl;
+                sl = NULL;
+        }
+        if (user_slice) {
+                *user_slice = usl;
+                usl = NULL;
+        }
+        if (machine) {
+                *machine = m;
+                m = NULL;
+        }
+        if (cgroup) {
+                *cgroup = c;
+                c = NULL;
+        }
+
+        return 0;
+}
+
 _public_ int sd_peer_get_session(int fd, char **session) {
         struct ucred ucred = {};
         int r;
@@ -264,6 +384,29 @@ _public_ int sd_peer_get_cgroup(int fd, char **cgroup) {
         return sd_pid_get_cgroup(ucred.pid, cgroup);
 }
 
+_public_ int sd_peer_get_identity(
+                int fd,
+                char **session,
+                uid_t *owner_uid,
+                char **unit,
+                char **user_unit,
+                char **slice,
+                char **user_slice,
+                char **machine,
+                char **cgroup) {
+
+        struct ucred ucred;
+        int r;
+
+        assert_return(fd >= 0, -EBADF);
+
+        r = getpeercred(fd, &ucred);
+        if (r < 0)
+                return r;
+
+        return sd_pid_get_identity(ucred.pid, session, owner_uid, unit, user_unit, slice, user_slice, machine, cgroup);
+}
+
 static int file_of_uid(uid_t uid, char **p) {
 
         assert_return(uid_is_valid(uid), -EINVAL);
@@ -981,97 +1124,228 @@ _public_ int sd_machine_get_ifindices(const char *machine, int **ifindices) {
         return nr;
 }
 
-static inline int MONITOR_TO_FD(sd_login_monitor *m) {
-        return (int) (unsigned long) m - 1;
-}
+enum {
+        MONITOR_SEAT,
+        MONITOR_SESSION,
+        MONITOR_UID,
+        MONITOR_MACHINE,
+        _MONITOR_MAX,
+        _MONITOR_INVALID = -1,
+};
 
-static inline sd_login_monitor* FD_TO_MONITOR(int fd) {
-        return (sd_login_monitor*) (unsigned long) (fd + 1);
-}
+struct sd_login_monitor {
+        int fd;
+        int wd[_MONITOR_MAX];
 
-_public_ int sd_login_monitor_new(const char *category, sd_login_monitor **m) {
-        int fd, k;
-        bool good = false;
+        /* Names of objects that changed since the last sd_login_monitor_get_changes() call */
+        Set *changed[_MONITOR_MAX];
+        bool overflow[_MONITOR_MAX];
+};
 
-        assert_return(m, -EINVAL);
+static const char* const monitor_category_table[_MONITOR_MAX] = {
+        [MONITOR_SEAT] = "seat",
+        [MONITOR_SESSION] = "session",
+        [MONITOR_UID] = "uid",
+        [MONITOR_MACHINE] = "machine",
+};
 
-        fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
-        if (fd < 0)
-                return -errno;
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_FROM_STRING(monitor_category, int);
 
-        if (!category || streq(category, "seat")) {
-                k = inotify_add_watch(fd, "/run/systemd/seats/", IN_MOVED_TO|IN_DELETE);
-                if (k < 0) {
-                        safe_close(fd);
-                        return -errno;
-                }
+static const char* const monitor_directory_table[_MONITOR_MAX] = {
+        [MONITOR_SEAT] = "/run/systemd/seats/",
+        [MONITOR_SESSION] = "/run/systemd/sessions/",
+        [MONITOR_UID] = "/run/systemd/users/",
+        [MONITOR_MACHINE] = "/run/systemd/machines/",
+};
 
-                good = true;
-        }
+_public_ int sd_login_monitor_new(const char *category, sd_login_monitor **m) {
+        _cleanup_(sd_login_monitor_unrefp) sd_login_monitor *n = NULL;
+        bool good = false;
+        unsigned c;
 
-        if (!category || streq(category, "session")) {
-                k = inotify_add_watch(fd, "/run/systemd/sessions/", IN_MOVED_TO|IN_DELETE);
-                if (k < 0) {
-                        safe_close(fd);
-                        return -errno;
-                }
+        assert_return(m, -EINVAL);
 
-                good = true;
-        }
+        n = new0(sd_login_monitor, 1);
+        if (!n)
+                return -ENOMEM;
 
-        if (!category || streq(category, "uid")) {
-                k = inotify_add_watch(fd, "/run/systemd/users/", IN_MOVED_TO|IN_DELETE);
-                if (k < 0) {
-                        safe_close(fd);
-                        return -errno;
-                }
+        n->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+        if (n->fd < 0)
+                return -errno;
 
-                good = true;
-        }
+        for (c = 0; c < _MONITOR_MAX; c++) {
+                n->wd[c] = -1;
+
+                if (category && !streq(category, monitor_category_table[c]))
+                        continue;
 
-        if (!category || streq(category, "machine")) {
-                k = inotify_add_watch(fd, "/run/systemd/machines/", IN_MOVED_TO|IN_DELETE);
-                if (k < 0) {
-                        safe_close(fd);
+                n->wd[c] = inotify_add_watch(n->fd, monitor_directory_table[c], IN_MOVED_TO|IN_DELETE);
+                if (n->wd[c] < 0)
                         return -errno;
-                }
 
                 good = true;
         }
 
-        if (!good) {
-                close_nointr(fd);
+        if (!good)
                 return -EINVAL;
-        }
 
-        *m = FD_TO_MONITOR(fd);
+        *m = n;
+        n = NULL;
+
         return 0;
 }
 
 _public_ sd_login_monitor* sd_login_monitor_unref(sd_login_monitor *m) {
-        int fd;
+        unsigned c;
 
         if (!m)
                 return NULL;
 
-        fd = MONITOR_TO_FD(m);
-        close_nointr(fd);
+        safe_close(m->fd);
 
-        return NULL;
+        for (c = 0; c < _MONITOR_MAX; c++)
+                set_free_free(m->changed[c]);
+
+        return mfree(m);
 }
 
 _public_ int sd_login_monitor_flush(sd_login_monitor *m) {
+        unsigned c;
 
         assert_return(m, -EINVAL);
 
-        return flush_fd(MONITOR_TO_FD(m));
+        for (c = 0; c < _MONITOR_MAX; c++) {
+                m->changed[c] = set_free_free(m->changed[c]);
+                m->overflow[c] = false;
+        }
+
+        return flush_fd(m->fd);
 }
 
 _public_ int sd_login_monitor_get_fd(sd_login_monitor *m) {
 
         assert_return(m, -EINVAL);
 
-        return MONITOR_TO_FD(m);
+        return m->fd;
+}
+
+static bool monitor_name_is_valid(int c, const char *name) {
+        uid_t uid;
+
+        /* Skip the temporary files the state files are written to, and the other auxiliary files that are
+         * placed next to them. */
+
+        switch (c) {
+
+        case MONITOR_SEAT:
+                return filename_is_valid(name) && name[0] != '.';
+
+        case MONITOR_SESSION:
+                return session_id_valid(name);
+
+        case MONITOR_UID:
+                return parse_uid(name, &uid) >= 0;
+
+        case MONITOR_MACHINE:
+                return !startswith(name, "unit:") && machine_name_is_valid(name);
+
+        default:
+                return false;
+        }
+}
+
+static int monitor_process(sd_login_monitor *m) {
+        union inotify_event_buffer buffer;
+        struct inotify_event *e;
+        ssize_t l;
+        unsigned c;
+        int r;
+
+        assert(m);
+
+        for (;;) {
+                l = read(m->fd, &buffer, sizeof(buffer));
+                if (l < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN)
+                                return 0;
+
+                        return -errno;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, l) {
+
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                /* We lost events, hence everything might have changed */
+                                for (c = 0; c < _MONITOR_MAX; c++) {
+                                        m->changed[c] = set_free_free(m->changed[c]);
+                                        m->overflow[c] = m->wd[c] >= 0;
+                                }
+
+                                continue;
+                        }
+
+                        for (c = 0; c < _MONITOR_MAX; c++)
+                                if (m->wd[c] == e->wd)
+                                        break;
+                        if (c >= _MONITOR_MAX)
+                                continue;
+
+                        if (e->len <= 0 || m->overflow[c] || !monitor_name_is_valid(c, e->name))
+                                continue;
+
+                        r = set_ensure_allocated(&m->changed[c], &string_hash_ops);
+                        if (r < 0)
+                                return r;
+
+                        r = set_put_strdup(m->changed[c], e->name);
+                        if (r < 0)
+                                return r;
+                }
+        }
+}
+
+_public_ int sd_login_monitor_get_changes(sd_login_monitor *m, const char *category, char ***ret) {
+        _cleanup_free_ char **l = NULL;
+        int c, r;
+
+        assert_return(m, -EINVAL);
+        assert_return(category, -EINVAL);
+
+        c = monitor_category_from_string(category);
+        assert_return(c >= 0, -EINVAL);
+        assert_return(m->wd[c] >= 0, -EINVAL);
+
+        r = monitor_process(m);
+        if (r < 0)
+                return r;
+
+        if (m->overflow[c]) {
+                /* Tell the caller to enumerate everything again */
+                m->overflow[c] = false;
+                return -ENOBUFS;
+        }
+
+        r = (int) set_size(m->changed[c]);
+
+        if (ret) {
+                if (r > 0) {
+                        l = set_get_strv(m->changed[c]);
+                        if (!l)
+                                return -ENOMEM;
+
+                        /* The strings are owned by the strv now */
+                        m->changed[c] = set_free(m->changed[c]);
+                        strv_sort(l);
+                }
+
+                *ret = l;
+                l = NULL;
+        } else
+                m->changed[c] = set_free_free(m->changed[c]);
+
+        return r;
 }
 
 _public_ int sd_login_monitor_get_events(sd_login_monitor *m) {
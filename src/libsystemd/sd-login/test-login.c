@@ -29,6 +29,7 @@
 #include "log.h"
 #include "string-util.h"
 #include "strv.h"
+#include "user-util.h"
 #include "util.h"
 
 static char* format_uids(char **buf, uid_t* uids, int count) {
@@ -72,6 +73,33 @@ static void test_login(void) {
         assert_se(r >= 0 || r == -ENODATA);
         log_info("sd_pid_get_slice(0, …) → \"%s\"", strna(slice));
 
+        {
+                _cleanup_free_ char *id_session = NULL, *id_unit = NULL, *id_user_unit = NULL, *id_slice = NULL,
+                        *id_user_slice = NULL, *id_machine = NULL, *id_cgroup = NULL, *s = NULL;
+                uid_t id_owner_uid, o = UID_INVALID;
+
+                r = sd_pid_get_identity(0, &id_session, &id_owner_uid, &id_unit, &id_user_unit, &id_slice,
+                                        &id_user_slice, &id_machine, &id_cgroup);
+                assert_se(r >= 0 || r == -ENODATA);
+                if (r >= 0) {
+                        log_info("sd_pid_get_identity(0, …) → \"%s\" "UID_FMT" \"%s\" \"%s\" \"%s\" \"%s\" \"%s\" \"%s\"",
+                                 strna(id_session), id_owner_uid, strna(id_unit), strna(id_user_unit),
+                                 strna(id_slice), strna(id_user_slice), strna(id_machine), id_cgroup);
+
+                        assert_se(streq_ptr(id_unit, unit));
+                        assert_se(streq_ptr(id_user_unit, user_unit));
+                        assert_se(streq_ptr(id_slice, slice));
+
+                        (void) sd_pid_get_session(0, &s);
+                        assert_se(streq_ptr(id_session, s));
+                        (void) sd_pid_get_owner_uid(0, &o);
+                        assert_se(id_owner_uid == o);
+                }
+
+                /* Everything is optional */
+                assert_se(sd_pid_get_identity(0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL) == r);
+        }
+
         r = sd_pid_get_session(0, &session);
         if (r < 0) {
                 log_warning_errno(r, "sd_pid_get_session(0, …): %m");
@@ -259,6 +287,7 @@ static void test_login(void) {
 
 static void test_monitor(void) {
         sd_login_monitor *m = NULL;
+        char **changed = NULL, *t;
         unsigned n;
         int r;
 
@@ -283,8 +312,13 @@ static void test_monitor(void) {
 
                 assert_se(r >= 0);
 
-                sd_login_monitor_flush(m);
-                printf("Wake!\n");
+                r = sd_login_monitor_get_changes(m, "session", &changed);
+                assert_se(r >= 0 || r == -ENOBUFS);
+                assert_se(r < 0 || r == (int) strv_length(changed));
+                assert_se(t = strv_join(changed, " "));
+                printf("Wake! [%i] \"%s\"\n", r, t);
+                changed = strv_free(changed);
+                t = mfree(t);
         }
 
         sd_login_monitor_unref(m);
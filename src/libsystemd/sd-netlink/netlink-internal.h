@@ -34,6 +34,12 @@
 #define RTNL_WQUEUE_MAX 1024
 #define RTNL_RQUEUE_MAX 64*1024
 
+/* The most we write to the kernel with a single sendmsg(), well below the default socket send buffer */
+#define RTNL_WQUEUE_BATCH_SIZE (32U*1024U)
+
+/* Smallest receive buffer we allocate, large enough for typical dump datagrams from the kernel */
+#define RTNL_RBUFFER_SIZE_MIN (8U*1024U)
+
 #define RTNL_CONTAINER_DEPTH 32
 
 struct reply_callback {
@@ -73,8 +79,14 @@ struct sd_netlink {
         unsigned rqueue_partial_size;
         size_t rqueue_partial_allocated;
 
-        struct nlmsghdr *rbuffer;
-        size_t rbuffer_allocated;
+        /* Datagram most recently read from the socket. Received messages point into it rather than
+         * carrying a copy, so it is only reused once no message references it anymore. */
+        struct netlink_rbuffer *rbuffer;
+
+        /* Asynchronous calls queued up during one event loop iteration, written out in batches */
+        sd_netlink_message **wqueue;
+        unsigned wqueue_size;
+        size_t wqueue_allocated;
 
         bool processing:1;
 
@@ -93,8 +105,14 @@ struct sd_netlink {
         sd_event *event;
 };
 
+struct netlink_rbuffer {
+        unsigned n_ref;
+        size_t allocated;
+        uint8_t data[];
+};
+
 struct netlink_attribute {
-        size_t offset; /* offset from hdr to attribute */
+        uint32_t offset; /* offset from hdr to attribute */
         bool nested:1;
         bool net_byteorder:1;
 };
@@ -102,7 +120,10 @@ struct netlink_attribute {
 struct netlink_container {
         const struct NLTypeSystem *type_system; /* the type system of the container */
         size_t offset; /* offset from hdr to the start of the container */
-        struct netlink_attribute *attributes;
+        size_t rta_offset; /* offset from hdr to the first attribute in a received container */
+        size_t rta_len;
+        struct netlink_attribute *attributes; /* built lazily, on the second attribute lookup */
+        bool looked_up:1;
         unsigned short n_attributes; /* number of attributes in container */
 };
 
@@ -112,6 +133,7 @@ struct sd_netlink_message {
         sd_netlink *rtnl;
 
         struct nlmsghdr *hdr;
+        struct netlink_rbuffer *rbuffer; /* if set, hdr points into this buffer and is not owned */
         struct netlink_container containers[RTNL_CONTAINER_DEPTH];
         unsigned n_containers; /* number of containers */
         bool sealed:1;
@@ -128,8 +150,11 @@ int socket_bind(sd_netlink *nl);
 int socket_broadcast_group_ref(sd_netlink *nl, unsigned group);
 int socket_broadcast_group_unref(sd_netlink *nl, unsigned group);
 int socket_write_message(sd_netlink *nl, sd_netlink_message *m);
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount);
 int socket_read_message(sd_netlink *nl);
 
+struct netlink_rbuffer *netlink_rbuffer_unref(struct netlink_rbuffer *b);
+
 int rtnl_rqueue_make_room(sd_netlink *rtnl);
 int rtnl_rqueue_partial_make_room(sd_netlink *rtnl);
 
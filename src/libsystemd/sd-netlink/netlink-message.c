@@ -123,7 +123,10 @@ sd_netlink_message *sd_netlink_message_unref(sd_netlink_message *m) {
         while (m && REFCNT_DEC(m->n_ref) == 0) {
                 unsigned i;
 
-                free(m->hdr);
+                if (m->rbuffer)
+                        netlink_rbuffer_unref(m->rbuffer);
+                else
+                        free(m->hdr);
 
                 for (i = 0; i <= m->n_containers; i++)
                         free(m->containers[i].attributes);
@@ -512,28 +515,105 @@ int sd_netlink_message_close_container(sd_netlink_message *m) {
         return 0;
 }
 
+static int netlink_container_build_index(sd_netlink_message *m, struct netlink_container *container) {
+        _cleanup_free_ struct netlink_attribute *attributes = NULL;
+        struct rtattr *rta;
+        size_t rt_len;
+
+        assert(m);
+        assert(container);
+
+        attributes = new0(struct netlink_attribute, container->n_attributes);
+        if (!attributes)
+                return -ENOMEM;
+
+        rta = (struct rtattr*)((uint8_t *) m->hdr + container->rta_offset);
+        rt_len = container->rta_len;
+
+        for (; RTA_OK(rta, rt_len); rta = RTA_NEXT(rta, rt_len)) {
+                unsigned short type;
+
+                type = RTA_TYPE(rta);
+
+                /* if the kernel is newer than the headers we used
+                   when building, we ignore out-of-range attributes */
+                if (type >= container->n_attributes)
+                        continue;
+
+                if (attributes[type].offset)
+                        log_debug("rtnl: message parse - overwriting repeated attribute");
+
+                attributes[type].offset = (uint8_t *) rta - (uint8_t *) m->hdr;
+                attributes[type].nested = RTA_FLAGS(rta) & NLA_F_NESTED;
+                attributes[type].net_byteorder = RTA_FLAGS(rta) & NLA_F_NET_BYTEORDER;
+        }
+
+        container->attributes = attributes;
+        attributes = NULL;
+
+        return 0;
+}
+
+/* Finds the last attribute of the given type in the container, like the index would. */
+static struct rtattr *netlink_container_find(sd_netlink_message *m, struct netlink_container *container, unsigned short type) {
+        struct rtattr *rta, *found = NULL;
+        size_t rt_len;
+
+        assert(m);
+        assert(container);
+
+        rta = (struct rtattr*)((uint8_t *) m->hdr + container->rta_offset);
+        rt_len = container->rta_len;
+
+        for (; RTA_OK(rta, rt_len); rta = RTA_NEXT(rta, rt_len))
+                if (RTA_TYPE(rta) == type)
+                        found = rta;
+
+        return found;
+}
+
 static int netlink_message_read_internal(sd_netlink_message *m, unsigned short type, void **data, bool *net_byteorder) {
-        struct netlink_attribute *attribute;
+        struct netlink_container *container;
         struct rtattr *rta;
+        int r;
 
         assert_return(m, -EINVAL);
         assert_return(m->sealed, -EPERM);
         assert_return(data, -EINVAL);
         assert(m->n_containers < RTNL_CONTAINER_DEPTH);
-        assert(m->containers[m->n_containers].attributes);
-        assert(type < m->containers[m->n_containers].n_attributes);
 
-        attribute = &m->containers[m->n_containers].attributes[type];
+        container = &m->containers[m->n_containers];
+        assert(type < container->n_attributes);
 
-        if (!attribute->offset)
-                return -ENODATA;
+        if (!container->attributes && !container->looked_up) {
+                /* Many callers only ever look at one or two attributes of a message, so for the
+                 * first lookup just walk the attributes instead of building the whole index. */
+                container->looked_up = true;
 
-        rta = (struct rtattr*)((uint8_t *) m->hdr + attribute->offset);
+                rta = netlink_container_find(m, container, type);
+                if (!rta)
+                        return -ENODATA;
+        } else {
+                struct netlink_attribute *attribute;
+
+                if (!container->attributes) {
+                        r = netlink_container_build_index(m, container);
+                        if (r < 0)
+                                return r;
+                }
+
+                attribute = &container->attributes[type];
+
+                if (!attribute->offset)
+                        return -ENODATA;
+
+                rta = (struct rtattr*)((uint8_t *) m->hdr + attribute->offset);
+        }
 
         *data = RTA_DATA(rta);
 
         if (net_byteorder)
-                *net_byteorder = attribute->net_byteorder;
+                *net_byteorder = RTA_FLAGS(rta) & NLA_F_NET_BYTEORDER;
 
         return RTA_PAYLOAD(rta);
 }
@@ -724,40 +804,20 @@ int sd_netlink_message_read_in6_addr(sd_netlink_message *m, unsigned short type,
         return 0;
 }
 
-static int netlink_container_parse(sd_netlink_message *m,
-                                   struct netlink_container *container,
-                                   int count,
-                                   struct rtattr *rta,
-                                   unsigned int rt_len) {
-        _cleanup_free_ struct netlink_attribute *attributes = NULL;
-
-        attributes = new0(struct netlink_attribute, count);
-        if (!attributes)
-                return -ENOMEM;
-
-        for (; RTA_OK(rta, rt_len); rta = RTA_NEXT(rta, rt_len)) {
-                unsigned short type;
-
-                type = RTA_TYPE(rta);
-
-                /* if the kernel is newer than the headers we used
-                   when building, we ignore out-of-range attributes */
-                if (type >= count)
-                        continue;
-
-                if (attributes[type].offset)
-                        log_debug("rtnl: message parse - overwriting repeated attribute");
-
-                attributes[type].offset = (uint8_t *) rta - (uint8_t *) m->hdr;
-                attributes[type].nested = RTA_FLAGS(rta) & NLA_F_NESTED;
-                attributes[type].net_byteorder = RTA_FLAGS(rta) & NLA_F_NET_BYTEORDER;
-        }
+static void netlink_container_parse(sd_netlink_message *m,
+                                    struct netlink_container *container,
+                                    int count,
+                                    struct rtattr *rta,
+                                    unsigned int rt_len) {
+        assert(m);
+        assert(container);
 
-        container->attributes = attributes;
-        attributes = NULL;
+        /* Only remember where the attributes are, they are indexed on demand */
+        container->attributes = mfree(container->attributes);
+        container->looked_up = false;
+        container->rta_offset = (uint8_t *) rta - (uint8_t *) m->hdr;
+        container->rta_len = rt_len;
         container->n_attributes = count;
-
-        return 0;
 }
 
 int sd_netlink_message_enter_container(sd_netlink_message *m, unsigned short type_id) {
@@ -841,15 +901,11 @@ int sd_netlink_message_enter_container(sd_netlink_message *m, unsigned short typ
 
         m->n_containers++;
 
-        r = netlink_container_parse(m,
-                                    &m->containers[m->n_containers],
-                                    type_system_get_count(type_system),
-                                    container,
-                                    size);
-        if (r < 0) {
-                m->n_containers--;
-                return r;
-        }
+        netlink_container_parse(m,
+                                &m->containers[m->n_containers],
+                                type_system_get_count(type_system),
+                                container,
+                                size);
 
         m->containers[m->n_containers].type_system = type_system;
 
@@ -935,13 +991,11 @@ int sd_netlink_message_rewind(sd_netlink_message *m) {
 
                 m->containers[0].type_system = type_system;
 
-                r = netlink_container_parse(m,
-                                            &m->containers[m->n_containers],
-                                            type_system_get_count(type_system),
-                                            (struct rtattr*)((uint8_t*)NLMSG_DATA(m->hdr) + NLMSG_ALIGN(size)),
-                                            NLMSG_PAYLOAD(m->hdr, size));
-                if (r < 0)
-                        return r;
+                netlink_container_parse(m,
+                                        &m->containers[m->n_containers],
+                                        type_system_get_count(type_system),
+                                        (struct rtattr*)((uint8_t*)NLMSG_DATA(m->hdr) + NLMSG_ALIGN(size)),
+                                        NLMSG_PAYLOAD(m->hdr, size));
         }
 
         return 0;
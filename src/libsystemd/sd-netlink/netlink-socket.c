@@ -26,6 +26,7 @@
 
 #include "alloc-util.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "missing.h"
 #include "netlink-internal.h"
 #include "netlink-types.h"
@@ -256,6 +257,45 @@ int socket_write_message(sd_netlink *nl, sd_netlink_message *m) {
         return k;
 }
 
+/* Writes several messages with a single sendmsg(). The kernel processes them in order and replies to each one
+ * individually. Returns the number of bytes sent, or a negative error code */
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount) {
+        union {
+                struct sockaddr sa;
+                struct sockaddr_nl nl;
+        } addr = {
+                .nl.nl_family = AF_NETLINK,
+        };
+        struct iovec *iovs;
+        struct msghdr mh = {
+                .msg_name = &addr.sa,
+                .msg_namelen = sizeof(addr),
+        };
+        size_t i;
+        ssize_t k;
+
+        assert(nl);
+        assert(m);
+        assert(msgcount > 0);
+
+        iovs = newa(struct iovec, msgcount);
+
+        for (i = 0; i < msgcount; i++) {
+                assert(m[i]->hdr);
+
+                iovs[i] = IOVEC_MAKE(m[i]->hdr, m[i]->hdr->nlmsg_len);
+        }
+
+        mh.msg_iov = iovs;
+        mh.msg_iovlen = msgcount;
+
+        k = sendmsg(nl->fd, &mh, 0);
+        if (k < 0)
+                return -errno;
+
+        return k;
+}
+
 static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool peek) {
         union sockaddr_union sender;
         uint8_t cmsg_buffer[CMSG_SPACE(sizeof(struct nl_pktinfo))];
@@ -316,6 +356,57 @@ static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool
         return r;
 }
 
+struct netlink_rbuffer *netlink_rbuffer_unref(struct netlink_rbuffer *b) {
+        if (!b)
+                return NULL;
+
+        assert(b->n_ref > 0);
+
+        if (--b->n_ref == 0)
+                free(b);
+
+        return NULL;
+}
+
+/* Returns a buffer with room for at least size bytes to read the next datagram into. The
+ * previous buffer is recycled if no received message points into it anymore, otherwise it
+ * is left to the messages still referencing it and a new one is allocated. */
+static int rtnl_rbuffer_get(sd_netlink *rtnl, size_t size, struct netlink_rbuffer **ret) {
+        struct netlink_rbuffer *b;
+
+        assert(rtnl);
+        assert(ret);
+
+        b = rtnl->rbuffer;
+        if (b && b->n_ref == 1 && b->allocated >= size) {
+                *ret = b;
+                return 0;
+        }
+
+        if (b && b->n_ref == 1) {
+                size = MAX(size, b->allocated * 2);
+
+                b = realloc(b, offsetof(struct netlink_rbuffer, data) + size);
+                if (!b)
+                        return -ENOMEM;
+        } else {
+                size = MAX(size, (size_t) RTNL_RBUFFER_SIZE_MIN);
+
+                b = malloc(offsetof(struct netlink_rbuffer, data) + size);
+                if (!b)
+                        return -ENOMEM;
+
+                b->n_ref = 1;
+                netlink_rbuffer_unref(rtnl->rbuffer);
+        }
+
+        b->allocated = size;
+        rtnl->rbuffer = b;
+
+        *ret = b;
+        return 0;
+}
+
 /* On success, the number of bytes received is returned and *ret points to the received message
  * which has a valid header and the correct size.
  * If nothing useful was received 0 is returned.
@@ -326,14 +417,13 @@ int socket_read_message(sd_netlink *rtnl) {
         struct iovec iov = {};
         uint32_t group = 0;
         bool multi_part = false, done = false;
+        struct netlink_rbuffer *rbuffer;
         struct nlmsghdr *new_msg;
         size_t len;
         int r;
         unsigned i = 0;
 
         assert(rtnl);
-        assert(rtnl->rbuffer);
-        assert(rtnl->rbuffer_allocated >= sizeof(struct nlmsghdr));
 
         /* read nothing, just get the pending message size */
         r = socket_recv_message(rtnl->fd, &iov, NULL, true);
@@ -343,13 +433,12 @@ int socket_read_message(sd_netlink *rtnl) {
                 len = (size_t)r;
 
         /* make room for the pending message */
-        if (!greedy_realloc((void **)&rtnl->rbuffer,
-                            &rtnl->rbuffer_allocated,
-                            len, sizeof(uint8_t)))
-                return -ENOMEM;
+        r = rtnl_rbuffer_get(rtnl, MAX(len, sizeof(struct nlmsghdr)), &rbuffer);
+        if (r < 0)
+                return r;
 
-        iov.iov_base = rtnl->rbuffer;
-        iov.iov_len = rtnl->rbuffer_allocated;
+        iov.iov_base = rbuffer->data;
+        iov.iov_len = rbuffer->allocated;
 
         /* read the pending message */
         r = socket_recv_message(rtnl->fd, &iov, &group, false);
@@ -358,23 +447,25 @@ int socket_read_message(sd_netlink *rtnl) {
         else
                 len = (size_t)r;
 
-        if (len > rtnl->rbuffer_allocated)
+        if (len > rbuffer->allocated)
                 /* message did not fit in read buffer */
                 return -EIO;
 
-        if (NLMSG_OK(rtnl->rbuffer, len) && rtnl->rbuffer->nlmsg_flags & NLM_F_MULTI) {
+        new_msg = (struct nlmsghdr*) rbuffer->data;
+
+        if (NLMSG_OK(new_msg, len) && new_msg->nlmsg_flags & NLM_F_MULTI) {
                 multi_part = true;
 
                 for (i = 0; i < rtnl->rqueue_partial_size; i++) {
                         if (rtnl_message_get_serial(rtnl->rqueue_partial[i]) ==
-                            rtnl->rbuffer->nlmsg_seq) {
+                            new_msg->nlmsg_seq) {
                                 first = rtnl->rqueue_partial[i];
                                 break;
                         }
                 }
         }
 
-        for (new_msg = rtnl->rbuffer; NLMSG_OK(new_msg, len) && !done; new_msg = NLMSG_NEXT(new_msg, len)) {
+        for (; NLMSG_OK(new_msg, len) && !done; new_msg = NLMSG_NEXT(new_msg, len)) {
                 _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
                 const NLType *nl_type;
 
@@ -417,9 +508,10 @@ int socket_read_message(sd_netlink *rtnl) {
 
                 m->broadcast = !!group;
 
-                m->hdr = memdup(new_msg, new_msg->nlmsg_len);
-                if (!m->hdr)
-                        return -ENOMEM;
+                /* refer into the receive buffer rather than copying the message out of it */
+                m->hdr = new_msg;
+                m->rbuffer = rbuffer;
+                rbuffer->n_ref++;
 
                 /* seal and parse the top-level message */
                 r = sd_netlink_message_rewind(m);
@@ -571,9 +571,9 @@ static const NLType rtnl_route_types[] = {
 /*      [RTA_MULTIPATH]         = { .len = sizeof(struct rtnexthop) },
 */
         [RTA_FLOW]              = { .type = NETLINK_TYPE_U32 }, /* 6? */
+        [RTA_TABLE]             = { .type = NETLINK_TYPE_U32 },
 /*
         RTA_CACHEINFO,
-        RTA_TABLE,
         RTA_MARK,
         RTA_MFC_STATS,
         RTA_VIA,
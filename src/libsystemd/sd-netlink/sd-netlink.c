@@ -49,12 +49,6 @@ static int sd_netlink_new(sd_netlink **ret) {
 
         LIST_HEAD_INIT(rtnl->match_callbacks);
 
-        /* We guarantee that the read buffer has at least space for
-         * a message header */
-        if (!greedy_realloc((void**)&rtnl->rbuffer, &rtnl->rbuffer_allocated,
-                            sizeof(struct nlmsghdr), sizeof(uint8_t)))
-                return -ENOMEM;
-
         /* Change notification responses have sequence 0, so we must
          * start our request sequence numbers at 1, or we may confuse our
          * responses with notifications from the kernel */
@@ -162,6 +156,8 @@ sd_netlink *sd_netlink_ref(sd_netlink *rtnl) {
         return rtnl;
 }
 
+static int dispatch_wqueue(sd_netlink *nl);
+
 sd_netlink *sd_netlink_unref(sd_netlink *rtnl) {
         if (!rtnl)
                 return NULL;
@@ -172,6 +168,9 @@ sd_netlink *sd_netlink_unref(sd_netlink *rtnl) {
                 struct match_callback *f;
                 unsigned i;
 
+                /* Don't lose requests that were still waiting for the event loop */
+                (void) dispatch_wqueue(rtnl);
+
                 for (i = 0; i < rtnl->rqueue_size; i++)
                         sd_netlink_message_unref(rtnl->rqueue[i]);
                 free(rtnl->rqueue);
@@ -180,7 +179,9 @@ sd_netlink *sd_netlink_unref(sd_netlink *rtnl) {
                         sd_netlink_message_unref(rtnl->rqueue_partial[i]);
                 free(rtnl->rqueue_partial);
 
-                free(rtnl->rbuffer);
+                netlink_rbuffer_unref(rtnl->rbuffer);
+
+                free(rtnl->wqueue);
 
                 hashmap_free_free(rtnl->reply_callbacks);
                 prioq_free(rtnl->reply_callbacks_prioq);
@@ -217,6 +218,93 @@ static void rtnl_seal_message(sd_netlink *rtnl, sd_netlink_message *m) {
         return;
 }
 
+static void rtnl_wqueue_fail(sd_netlink *nl, unsigned n, int error) {
+        unsigned i;
+        int r;
+
+        assert(nl);
+        assert(error < 0);
+
+        /* Turn the failure to write a batch into error replies, so that the callbacks of the calls learn about it
+         * the normal way. If there is no room for them, they'll time out eventually. */
+        for (i = 0; i < n; i++) {
+                sd_netlink_message *m;
+
+                r = rtnl_rqueue_make_room(nl);
+                if (r < 0)
+                        return;
+
+                r = rtnl_message_new_synthetic_error(error, rtnl_message_get_serial(nl->wqueue[i]), &m);
+                if (r < 0)
+                        return;
+
+                nl->rqueue[nl->rqueue_size++] = m;
+        }
+}
+
+static int dispatch_wqueue(sd_netlink *nl) {
+        int r;
+
+        assert(nl);
+
+        while (nl->wqueue_size > 0) {
+                size_t size = 0;
+                unsigned n, i;
+
+                for (n = 0; n < nl->wqueue_size; n++) {
+                        size_t len = nl->wqueue[n]->hdr->nlmsg_len;
+
+                        if (n > 0 && size + len > RTNL_WQUEUE_BATCH_SIZE)
+                                break;
+
+                        size += len;
+                }
+
+                r = socket_writev_message(nl, nl->wqueue, n);
+                if (r == -EINTR)
+                        continue;
+                if (r < 0) {
+                        log_debug_errno(r, "sd-netlink: failed to write %u queued messages: %m", n);
+                        rtnl_wqueue_fail(nl, n, r);
+                }
+
+                for (i = 0; i < n; i++)
+                        sd_netlink_message_unref(nl->wqueue[i]);
+
+                nl->wqueue_size -= n;
+                memmove(nl->wqueue, nl->wqueue + n, sizeof(sd_netlink_message*) * nl->wqueue_size);
+        }
+
+        return 0;
+}
+
+static int rtnl_wqueue_message(sd_netlink *nl, sd_netlink_message *message, uint32_t *serial) {
+        int r;
+
+        assert(nl);
+        assert(message);
+        assert(serial);
+
+        if (message->sealed)
+                return -EPERM;
+
+        if (nl->wqueue_size >= RTNL_WQUEUE_MAX) {
+                r = dispatch_wqueue(nl);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!GREEDY_REALLOC(nl->wqueue, nl->wqueue_allocated, nl->wqueue_size + 1))
+                return -ENOMEM;
+
+        rtnl_seal_message(nl, message);
+
+        nl->wqueue[nl->wqueue_size++] = sd_netlink_message_ref(message);
+        *serial = rtnl_message_get_serial(message);
+
+        return 1;
+}
+
 int sd_netlink_send(sd_netlink *nl,
                  sd_netlink_message *message,
                  uint32_t *serial) {
@@ -227,6 +315,11 @@ int sd_netlink_send(sd_netlink *nl,
         assert_return(message, -EINVAL);
         assert_return(!message->sealed, -EPERM);
 
+        /* Keep the order: whatever was queued before goes out first */
+        r = dispatch_wqueue(nl);
+        if (r < 0)
+                return r;
+
         rtnl_seal_message(nl, message);
 
         r = socket_write_message(nl, message);
@@ -495,9 +588,15 @@ static int rtnl_poll(sd_netlink *rtnl, bool need_more, uint64_t timeout_usec) {
 }
 
 int sd_netlink_wait(sd_netlink *nl, uint64_t timeout_usec) {
+        int r;
+
         assert_return(nl, -EINVAL);
         assert_return(!rtnl_pid_changed(nl), -ECHILD);
 
+        r = dispatch_wqueue(nl);
+        if (r < 0)
+                return r;
+
         if (nl->rqueue_size > 0)
                 return 0;
 
@@ -555,7 +654,12 @@ int sd_netlink_call_async(sd_netlink *nl,
         c->userdata = userdata;
         c->timeout = calc_elapse(usec);
 
-        k = sd_netlink_send(nl, m, &s);
+        /* When running from an event loop, the message is only queued here, and written together with the
+         * others queued during this iteration right before the loop goes to sleep. */
+        if (nl->event)
+                k = rtnl_wqueue_message(nl, m, &s);
+        else
+                k = sd_netlink_send(nl, m, &s);
         if (k < 0) {
                 free(c);
                 return k;
@@ -756,6 +860,10 @@ static int prepare_callback(sd_event_source *s, void *userdata) {
         assert(s);
         assert(rtnl);
 
+        r = dispatch_wqueue(rtnl);
+        if (r < 0)
+                return r;
+
         e = sd_netlink_get_events(rtnl);
         if (e < 0)
                 return e;
@@ -838,6 +946,8 @@ int sd_netlink_detach_event(sd_netlink *rtnl) {
         assert_return(rtnl, -EINVAL);
         assert_return(rtnl->event, -ENXIO);
 
+        (void) dispatch_wqueue(rtnl);
+
         rtnl->io_event_source = sd_event_source_unref(rtnl->io_event_source);
 
         rtnl->time_event_source = sd_event_source_unref(rtnl->time_event_source);
@@ -291,6 +291,34 @@ static void test_pipe(int ifindex) {
         assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
 }
 
+static void test_pipe_event_loop(int ifindex) {
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        int counter = 0;
+        unsigned i;
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+        assert_se(sd_event_default(&event) >= 0);
+        assert_se(sd_netlink_attach_event(rtnl, event, 0) >= 0);
+
+        /* These are queued and written with a single sendmsg() before the event loop polls */
+        for (i = 0; i < 32; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+
+                counter++;
+                assert_se(sd_netlink_call_async(rtnl, m, pipe_handler, &counter, 0, NULL) >= 0);
+        }
+
+        while (counter > 0)
+                assert_se(sd_event_run(event, (uint64_t) -1) >= 0);
+
+        assert_se(sd_netlink_detach_event(rtnl) >= 0);
+
+        assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
+}
+
 static void test_container(void) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         uint16_t u16_data;
@@ -404,6 +432,8 @@ int main(void) {
 
         test_pipe(if_loopback);
 
+        test_pipe_event_loop(if_loopback);
+
         test_event_loop(if_loopback);
 
         test_link_configure(rtnl, if_loopback);
@@ -22,4 +22,10 @@
 
 #include "sd-network.h"
 
+#include "set.h"
+
 bool network_is_online(void);
+
+/* Like sd_network_monitor_flush(), but adds the ifindex of every link whose state file changed
+ * to *changed. Returns > 0 if changes may have been missed and all links need to be re-read. */
+int network_monitor_flush_links(sd_network_monitor *m, Set **changed);
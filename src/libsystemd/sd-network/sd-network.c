@@ -23,6 +23,7 @@
 #include <poll.h>
 #include <string.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 
 #include "sd-network.h"
 
@@ -31,7 +32,9 @@
 #include "fileio.h"
 #include "fs-util.h"
 #include "macro.h"
+#include "network-util.h"
 #include "parse-util.h"
+#include "set.h"
 #include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
@@ -103,17 +106,105 @@ _public_ int sd_network_get_route_domains(char ***ret) {
         return network_get_strv("ROUTE_DOMAINS", ret);
 }
 
-static int network_link_get_string(int ifindex, const char *field, char **ret) {
+/* The most recently parsed link state file. Readers usually query several properties of the same link
+ * in a row, this way the file is parsed only once for all of them. networkd replaces the file
+ * atomically, so a different inode, size or modification time means it needs to be parsed again. */
+static thread_local struct {
+        int ifindex;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        struct timespec mtim;
+        char **pairs;
+} link_state_cache;
+
+static bool link_state_cache_valid(int ifindex, const struct stat *st) {
+        assert(st);
+
+        return link_state_cache.pairs &&
+                link_state_cache.ifindex == ifindex &&
+                link_state_cache.dev == st->st_dev &&
+                link_state_cache.ino == st->st_ino &&
+                link_state_cache.size == st->st_size &&
+                link_state_cache.mtim.tv_sec == st->st_mtim.tv_sec &&
+                link_state_cache.mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static int network_link_get_value(int ifindex, const char *key, char **ret) {
         char path[strlen("/run/systemd/netif/links/") + DECIMAL_STR_MAX(ifindex) + 1];
+        const char *value = NULL;
+        struct stat st;
+        char **p;
+        int r;
+
+        assert(ifindex > 0);
+        assert(key);
+        assert(ret);
+
+        xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
+
+        if (stat(path, &st) < 0)
+                return -errno;
+
+        if (!link_state_cache_valid(ifindex, &st)) {
+                _cleanup_strv_free_ char **pairs = NULL;
+                _cleanup_fclose_ FILE *f = NULL;
+
+                f = fopen(path, "re");
+                if (!f)
+                        return -errno;
+
+                /* the file might have been replaced since the stat() above */
+                if (fstat(fileno(f), &st) < 0)
+                        return -errno;
+
+                r = load_env_file_pairs(f, path, NEWLINE, &pairs);
+                if (r < 0)
+                        return r;
+
+                strv_free(link_state_cache.pairs);
+                link_state_cache.pairs = pairs;
+                pairs = NULL;
+
+                /* an empty file still needs a non-NULL entry to be cached */
+                if (!link_state_cache.pairs) {
+                        link_state_cache.pairs = new0(char*, 1);
+                        if (!link_state_cache.pairs)
+                                return -ENOMEM;
+                }
+
+                link_state_cache.ifindex = ifindex;
+                link_state_cache.dev = st.st_dev;
+                link_state_cache.ino = st.st_ino;
+                link_state_cache.size = st.st_size;
+                link_state_cache.mtim = st.st_mtim;
+        }
+
+        /* like parse_env_file(), the last assignment wins */
+        for (p = link_state_cache.pairs; p[0] && p[1]; p += 2)
+                if (streq(p[0], key))
+                        value = p[1];
+
+        if (!value) {
+                *ret = NULL;
+                return 0;
+        }
+
+        *ret = strdup(value);
+        if (!*ret)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int network_link_get_string(int ifindex, const char *field, char **ret) {
         _cleanup_free_ char *s = NULL;
         int r;
 
         assert_return(ifindex > 0, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
-
-        r = parse_env_file(path, NEWLINE, field, &s, NULL);
+        r = network_link_get_value(ifindex, field, &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -128,7 +219,6 @@ static int network_link_get_string(int ifindex, const char *field, char **ret) {
 }
 
 static int network_link_get_strv(int ifindex, const char *key, char ***ret) {
-        char path[strlen("/run/systemd/netif/links/") + DECIMAL_STR_MAX(ifindex) + 1];
         _cleanup_strv_free_ char **a = NULL;
         _cleanup_free_ char *s = NULL;
         int r;
@@ -136,8 +226,7 @@ static int network_link_get_strv(int ifindex, const char *key, char ***ret) {
         assert_return(ifindex > 0, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
-        r = parse_env_file(path, NEWLINE, key, &s, NULL);
+        r = network_link_get_value(ifindex, key, &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -224,7 +313,6 @@ _public_ int sd_network_link_get_route_domains(int ifindex, char ***ret) {
 }
 
 static int network_link_get_ifindexes(int ifindex, const char *key, int **ret) {
-        char path[strlen("/run/systemd/netif/links/") + DECIMAL_STR_MAX(ifindex) + 1];
         _cleanup_free_ int *ifis = NULL;
         _cleanup_free_ char *s = NULL;
         size_t allocated = 0, c = 0;
@@ -234,8 +322,7 @@ static int network_link_get_ifindexes(int ifindex, const char *key, int **ret) {
         assert_return(ifindex > 0, -EINVAL);
         assert_return(ret, -EINVAL);
 
-        xsprintf(path, "/run/systemd/netif/links/%i", ifindex);
-        r = parse_env_file(path, NEWLINE, key, &s, NULL);
+        r = network_link_get_value(ifindex, key, &s);
         if (r == -ENOENT)
                 return -ENODATA;
         if (r < 0)
@@ -346,9 +433,10 @@ _public_ sd_network_monitor* sd_network_monitor_unref(sd_network_monitor *m) {
         return NULL;
 }
 
-_public_ int sd_network_monitor_flush(sd_network_monitor *m) {
+static int monitor_flush(sd_network_monitor *m, Set **changed) {
         union inotify_event_buffer buffer;
         struct inotify_event *e;
+        bool rescan = false;
         ssize_t l;
         int fd, k;
 
@@ -373,10 +461,50 @@ _public_ int sd_network_monitor_flush(sd_network_monitor *m) {
                         k = inotify_rm_watch(fd, e->wd);
                         if (k < 0)
                                 return -errno;
+
+                        rescan = true;
+                        continue;
+                }
+
+                if (!changed)
+                        continue;
+
+                if (e->mask & IN_Q_OVERFLOW) {
+                        rescan = true;
+                        continue;
+                }
+
+                /* link state files are named after their ifindex */
+                if (e->len > 0) {
+                        int ifindex;
+
+                        if (safe_atoi(e->name, &ifindex) < 0 || ifindex <= 0)
+                                continue;
+
+                        k = set_ensure_allocated(changed, NULL);
+                        if (k < 0)
+                                return k;
+
+                        k = set_put(*changed, INT_TO_PTR(ifindex));
+                        if (k < 0)
+                                return k;
                 }
         }
 
-        return 0;
+        return rescan;
+}
+
+_public_ int sd_network_monitor_flush(sd_network_monitor *m) {
+        int r;
+
+        r = monitor_flush(m, NULL);
+        return r < 0 ? r : 0;
+}
+
+int network_monitor_flush_links(sd_network_monitor *m, Set **changed) {
+        assert(changed);
+
+        return monitor_flush(m, changed);
 }
 
 _public_ int sd_network_monitor_get_fd(sd_network_monitor *m) {
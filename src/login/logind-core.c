@@ -29,7 +29,9 @@
 #include "bus-util.h"
 #include "cgroup-util.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "logind.h"
+#include "mkdir.h"
 #include "parse-util.h"
 #include "strv.h"
 #include "terminal-util.h"
@@ -601,3 +603,31 @@ bool manager_is_docked_or_external_displays(Manager *m) {
 
         return false;
 }
+
+int logind_write_state_file(const char *dir, const char *path, char **data, char **saved) {
+        int r;
+
+        assert(dir);
+        assert(path);
+        assert(data);
+        assert(*data);
+        assert(saved);
+
+        /* Every state file update wakes up all sd_login_monitor clients, hence skip the write if the file
+         * already carries exactly these contents. On success the buffer is moved into *saved, so that we can
+         * compare the next update with it. */
+
+        if (streq_ptr(*saved, *data))
+                return 0;
+
+        r = mkdir_safe_label(dir, 0755, 0, 0, false);
+        if (r < 0)
+                return r;
+
+        r = write_string_file(path, *data, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE);
+        if (r < 0)
+                return r;
+
+        free_and_replace(*saved, *data);
+        return 1;
+}
@@ -31,7 +31,6 @@
 #include "format-util.h"
 #include "logind-acl.h"
 #include "logind-seat.h"
-#include "mkdir.h"
 #include "parse-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -81,12 +80,14 @@ void seat_free(Seat *s) {
 
         free(s->positions);
         free(s->state_file);
+        free(s->state_file_data);
         free(s);
 }
 
 int seat_save(Seat *s) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size;
         int r;
 
         assert(s);
@@ -94,15 +95,11 @@ int seat_save(Seat *s) {
         if (!s->started)
                 return 0;
 
-        r = mkdir_safe_label("/run/systemd/seats", 0755, 0, 0, false);
-        if (r < 0)
+        f = open_memstream(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
-
-        r = fopen_temporary(s->state_file, &f, &temp_path);
-        if (r < 0)
-                goto fail;
-
-        fchmod(fileno(f), 0644);
+        }
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -148,18 +145,17 @@ int seat_save(Seat *s) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, s->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = logind_write_state_file("/run/systemd/seats", s->state_file, &data, &s->state_file_data);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(s->state_file);
-
-        if (temp_path)
-                (void) unlink(temp_path);
+        s->state_file_data = mfree(s->state_file_data);
 
         return log_error_errno(r, "Failed to save seat data %s: %m", s->state_file);
 }
@@ -452,6 +448,7 @@ int seat_stop(Seat *s, bool force) {
         seat_stop_sessions(s, force);
 
         unlink(s->state_file);
+        s->state_file_data = mfree(s->state_file_data);
         seat_add_to_gc_queue(s);
 
         if (s->started)
@@ -30,6 +30,7 @@ struct Seat {
         char *id;
 
         char *state_file;
+        char *state_file_data;
 
         LIST_HEAD(Device, devices);
 
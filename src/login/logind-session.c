@@ -50,6 +50,10 @@
 
 #define RELEASE_USEC (20*USEC_PER_SEC)
 
+/* The kernel updates the atime of TTYs only every 8s anyway, hence there's no point in checking it more often than
+ * once a second per session, however many clients ask for the idle hint. */
+#define TTY_ATIME_CACHE_USEC (1*USEC_PER_SEC)
+
 static void session_remove_fifo(Session *s);
 
 Session* session_new(Manager *m, const char *id) {
@@ -144,6 +148,7 @@ void session_free(Session *s) {
         hashmap_remove(s->manager->sessions, s->id);
 
         free(s->state_file);
+        free(s->state_file_data);
         free(s);
 }
 
@@ -168,8 +173,9 @@ static void session_save_devices(Session *s, FILE *f) {
 }
 
 int session_save(Session *s) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size;
         int r = 0;
 
         assert(s);
@@ -180,18 +186,14 @@ int session_save(Session *s) {
         if (!s->started)
                 return 0;
 
-        r = mkdir_safe_label("/run/systemd/sessions", 0755, 0, 0, false);
-        if (r < 0)
-                goto fail;
-
-        r = fopen_temporary(s->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
+        }
 
         assert(s->user);
 
-        fchmod(fileno(f), 0644);
-
         fprintf(f,
                 "# This is private data. Do not parse.\n"
                 "UID="UID_FMT"\n"
@@ -305,18 +307,17 @@ int session_save(Session *s) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, s->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = logind_write_state_file("/run/systemd/sessions", s->state_file, &data, &s->state_file_data);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(s->state_file);
-
-        if (temp_path)
-                (void) unlink(temp_path);
+        s->state_file_data = mfree(s->state_file_data);
 
         return log_error_errno(r, "Failed to save session data %s: %m", s->state_file);
 }
@@ -747,6 +748,7 @@ int session_finalize(Session *s) {
                 session_device_free(sd);
 
         (void) unlink(s->state_file);
+        s->state_file_data = mfree(s->state_file_data);
         session_add_to_gc_queue(s);
         user_add_to_gc_queue(s->user);
 
@@ -840,6 +842,40 @@ static int get_process_ctty_atime(pid_t pid, usec_t *atime) {
         return get_tty_atime(p, atime);
 }
 
+static int session_get_tty_atime(Session *s, usec_t *atime) {
+        usec_t n;
+        int r = -ENOENT;
+
+        assert(s);
+        assert(atime);
+
+        n = now(CLOCK_MONOTONIC);
+        if (s->tty_atime_checked > 0 && n < s->tty_atime_checked + TTY_ATIME_CACHE_USEC) {
+                if (s->tty_atime_result < 0)
+                        return s->tty_atime_result;
+
+                *atime = s->tty_atime;
+                return 0;
+        }
+
+        /* For sessions with an explicitly configured tty, let's check
+         * its atime */
+        if (s->tty)
+                r = get_tty_atime(s->tty, atime);
+
+        /* For sessions with a leader but no explicitly configured
+         * tty, let's check the controlling tty of the leader */
+        if (r < 0 && s->leader > 0)
+                r = get_process_ctty_atime(s->leader, atime);
+
+        s->tty_atime_checked = n;
+        s->tty_atime_result = r;
+        if (r >= 0)
+                s->tty_atime = *atime;
+
+        return r;
+}
+
 int session_get_idle_hint(Session *s, dual_timestamp *t) {
         usec_t atime = 0, n;
         int r;
@@ -859,21 +895,9 @@ int session_get_idle_hint(Session *s, dual_timestamp *t) {
         if (SESSION_TYPE_IS_GRAPHICAL(s->type))
                 goto dont_know;
 
-        /* For sessions with an explicitly configured tty, let's check
-         * its atime */
-        if (s->tty) {
-                r = get_tty_atime(s->tty, &atime);
-                if (r >= 0)
-                        goto found_atime;
-        }
-
-        /* For sessions with a leader but no explicitly configured
-         * tty, let's check the controlling tty of the leader */
-        if (s->leader > 0) {
-                r = get_process_ctty_atime(s->leader, &atime);
-                if (r >= 0)
-                        goto found_atime;
-        }
+        r = session_get_tty_atime(s, &atime);
+        if (r >= 0)
+                goto found_atime;
 
 dont_know:
         if (t)
@@ -74,6 +74,7 @@ struct Session {
         SessionClass class;
 
         char *state_file;
+        char *state_file_data;
 
         User *user;
 
@@ -106,6 +107,10 @@ struct Session {
         bool idle_hint;
         dual_timestamp idle_hint_timestamp;
 
+        usec_t tty_atime;
+        usec_t tty_atime_checked;
+        int tty_atime_result;
+
         bool locked_hint;
 
         bool in_gc_queue:1;
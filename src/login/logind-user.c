@@ -129,28 +129,26 @@ User *user_free(User *u) {
         u->slice = mfree(u->slice);
         u->runtime_path = mfree(u->runtime_path);
         u->state_file = mfree(u->state_file);
+        u->state_file_data = mfree(u->state_file_data);
         u->name = mfree(u->name);
 
         return mfree(u);
 }
 
 static int user_save_internal(User *u) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size;
         int r;
 
         assert(u);
         assert(u->state_file);
 
-        r = mkdir_safe_label("/run/systemd/users", 0755, 0, 0, false);
-        if (r < 0)
+        f = open_memstream(&data, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
-
-        r = fopen_temporary(u->state_file, &f, &temp_path);
-        if (r < 0)
-                goto fail;
-
-        fchmod(fileno(f), 0644);
+        }
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -270,18 +268,17 @@ static int user_save_internal(User *u) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, u->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = logind_write_state_file("/run/systemd/users", u->state_file, &data, &u->state_file_data);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(u->state_file);
-
-        if (temp_path)
-                (void) unlink(temp_path);
+        u->state_file_data = mfree(u->state_file_data);
 
         return log_error_errno(r, "Failed to save user data %s: %m", u->state_file);
 }
@@ -624,6 +621,7 @@ int user_finalize(User *u) {
         }
 
         unlink(u->state_file);
+        u->state_file_data = mfree(u->state_file_data);
         user_add_to_gc_queue(u);
 
         if (u->started) {
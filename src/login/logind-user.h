@@ -42,6 +42,7 @@ struct User {
         gid_t gid;
         char *name;
         char *state_file;
+        char *state_file_data;
         char *runtime_path;
         char *slice;
         char *service;
@@ -19,6 +19,7 @@
 ***/
 
 #include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/mount.h>
 
 #include "alloc-util.h"
@@ -34,6 +35,7 @@
 #include "loop-util.h"
 #include "machine-image.h"
 #include "mount-util.h"
+#include "path-util.h"
 #include "process-util.h"
 #include "raw-clone.h"
 #include "strv.h"
@@ -111,6 +113,7 @@ int bus_image_method_rename(
         Image *image = userdata;
         Manager *m = image->userdata;
         const char *new_name;
+        bool cached;
         int r;
 
         assert(message);
@@ -137,7 +140,15 @@ int bus_image_method_rename(
         if (r == 0)
                 return 1; /* Will call us back */
 
+        /* The cache is keyed by the image name, which is about to change */
+        cached = hashmap_remove_value(m->image_cache, image->name, image) == image;
+        manager_image_cache_invalidate(m);
+
         r = image_rename(image, new_name);
+
+        if (cached && hashmap_put(m->image_cache, image->name, image) < 0)
+                image_unref(image);
+
         if (r < 0)
                 return r;
 
@@ -245,6 +256,7 @@ int bus_image_method_mark_read_only(
                 return 1; /* Will call us back */
 
         r = image_read_only(image, read_only);
+        manager_image_cache_invalidate(m);
         if (r < 0)
                 return r;
 
@@ -284,6 +296,7 @@ int bus_image_method_set_limit(
                 return 1; /* Will call us back */
 
         r = image_set_limit(image, limit);
+        manager_image_cache_invalidate(m);
         if (r < 0)
                 return r;
 
@@ -394,16 +407,183 @@ const sd_bus_vtable image_vtable[] = {
         SD_BUS_VTABLE_END
 };
 
-static int image_flush_cache(sd_event_source *s, void *userdata) {
-        Manager *m = userdata;
+/* Some changes, for example to the btrfs quota, don't show up as inotify events on the image directories,
+ * hence rescan at least this often, even if nothing was reported. The cached metadata stays valid as long
+ * as the inode didn't change. */
+#define IMAGE_CACHE_MAX_AGE_USEC (5 * USEC_PER_SEC)
+
+#define IMAGE_INOTIFY_MASK                                              \
+        (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB|        \
+         IN_CLOSE_WRITE|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR)
+
+static int manager_image_watch(Manager *m) {
+        const char *path;
 
-        assert(s);
         assert(m);
 
-        hashmap_clear_with_destructor(m->image_cache, image_unref);
+        /* Watches all image directories. Adding a watch for an inode that is already watched just updates it,
+         * hence this is called again on each rescan, which also picks up directories created in the meantime. */
+
+        if (m->image_inotify_fd < 0) {
+                m->image_inotify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+                if (m->image_inotify_fd < 0)
+                        return -errno;
+        }
+
+        NULSTR_FOREACH(path, image_search_path) {
+                _cleanup_free_ char *p = NULL;
+
+                p = strdup(path);
+                if (!p)
+                        return -ENOMEM;
+
+                for (;;) {
+                        char *parent;
+
+                        if (inotify_add_watch(m->image_inotify_fd, p, IMAGE_INOTIFY_MASK) >= 0)
+                                break;
+                        if (errno != ENOENT || path_equal(p, "/"))
+                                return -errno;
+
+                        /* The directory doesn't exist (yet), watch the closest parent that does instead, so
+                         * that we notice when it is created. */
+                        parent = dirname_malloc(p);
+                        if (!parent)
+                                return -ENOMEM;
+
+                        free_and_replace(p, parent);
+                }
+        }
+
         return 0;
 }
 
+static bool manager_image_cache_is_valid(Manager *m) {
+        int r;
+
+        assert(m);
+
+        if (!m->image_cache || m->image_cache_dirty || m->image_inotify_fd < 0)
+                return false;
+
+        if (now(CLOCK_MONOTONIC) >= usec_add(m->image_cache_timestamp, IMAGE_CACHE_MAX_AGE_USEC))
+                return false;
+
+        /* We don't care what changed, any event means we need to rescan */
+        r = flush_fd(m->image_inotify_fd);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to read image directory inotify events, rescanning: %m");
+                return false;
+        }
+
+        return r == 0;
+}
+
+void manager_image_cache_invalidate(Manager *m) {
+        assert(m);
+
+        m->image_cache_dirty = true;
+}
+
+static void image_take_metadata(Image *i, Image *old) {
+        assert(i);
+        assert(old);
+
+        if (!old->metadata_valid ||
+            i->type != old->type ||
+            !path_equal(i->path, old->path) ||
+            i->device != old->device ||
+            i->inode != old->inode ||
+            i->inode_mtime != old->inode_mtime)
+                return;
+
+        free_and_replace(i->hostname, old->hostname);
+        i->machine_id = old->machine_id;
+        strv_free_and_replace(i->machine_info, old->machine_info);
+        strv_free_and_replace(i->os_release, old->os_release);
+        i->metadata_valid = true;
+}
+
+int manager_get_images(Manager *m, Hashmap **ret) {
+        _cleanup_(image_hashmap_freep) Hashmap *images = NULL;
+        Image *image;
+        Iterator i;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns all images, from the cache if nothing changed since the last scan. The returned hashmap is
+         * owned by the manager, and is only valid until the next call. */
+
+        if (manager_image_cache_is_valid(m)) {
+                *ret = m->image_cache;
+                return 0;
+        }
+
+        /* Set up the watches before we scan, so that we don't miss anything that changes while we do */
+        if (m->image_inotify_fd >= 0)
+                (void) flush_fd(m->image_inotify_fd);
+
+        r = manager_image_watch(m);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to watch image directories, not caching images: %m");
+                m->image_inotify_fd = safe_close(m->image_inotify_fd);
+        }
+
+        images = hashmap_new(&string_hash_ops);
+        if (!images)
+                return -ENOMEM;
+
+        r = image_discover(images);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(image, images, i) {
+                Image *old;
+
+                image->userdata = m;
+
+                /* Reading the metadata is expensive, reuse what we have if the image wasn't replaced */
+                old = hashmap_get(m->image_cache, image->name);
+                if (old)
+                        image_take_metadata(image, old);
+        }
+
+        hashmap_free_with_destructor(m->image_cache, image_unref);
+        m->image_cache = images;
+        images = NULL;
+
+        m->image_cache_timestamp = now(CLOCK_MONOTONIC);
+        m->image_cache_dirty = false;
+
+        *ret = m->image_cache;
+        return 0;
+}
+
+int manager_find_image(Manager *m, const char *name, Image **ret) {
+        Hashmap *images;
+        Image *image;
+        int r;
+
+        assert(m);
+        assert(name);
+
+        /* Like image_find(), but the image is owned by the cache */
+
+        r = manager_get_images(m, &images);
+        if (r < 0)
+                return r;
+
+        image = hashmap_get(images, name);
+        if (!image)
+                return 0;
+
+        if (ret)
+                *ret = image;
+        return 1;
+}
+
 int image_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
         _cleanup_free_ char *e = NULL;
         Manager *m = userdata;
@@ -424,42 +604,10 @@ int image_object_find(sd_bus *bus, const char *path, const char *interface, void
         if (!e)
                 return -ENOMEM;
 
-        image = hashmap_get(m->image_cache, e);
-        if (image) {
-                *found = image;
-                return 1;
-        }
-
-        r = hashmap_ensure_allocated(&m->image_cache, &string_hash_ops);
-        if (r < 0)
-                return r;
-
-        if (!m->image_cache_defer_event) {
-                r = sd_event_add_defer(m->event, &m->image_cache_defer_event, image_flush_cache, m);
-                if (r < 0)
-                        return r;
-
-                r = sd_event_source_set_priority(m->image_cache_defer_event, SD_EVENT_PRIORITY_IDLE);
-                if (r < 0)
-                        return r;
-        }
-
-        r = sd_event_source_set_enabled(m->image_cache_defer_event, SD_EVENT_ONESHOT);
-        if (r < 0)
-                return r;
-
-        r = image_find(e, &image);
+        r = manager_find_image(m, e, &image);
         if (r <= 0)
                 return r;
 
-        image->userdata = m;
-
-        r = hashmap_put(m->image_cache, image->name, image);
-        if (r < 0) {
-                image_unref(image);
-                return r;
-        }
-
         *found = image;
         return 1;
 }
@@ -477,8 +625,9 @@ char *image_bus_path(const char *name) {
 }
 
 int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
-        _cleanup_(image_hashmap_freep) Hashmap *images = NULL;
         _cleanup_strv_free_ char **l = NULL;
+        Manager *m = userdata;
+        Hashmap *images;
         Image *image;
         Iterator i;
         int r;
@@ -487,11 +636,7 @@ int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char **
         assert(path);
         assert(nodes);
 
-        images = hashmap_new(&string_hash_ops);
-        if (!images)
-                return -ENOMEM;
-
-        r = image_discover(images);
+        r = manager_get_images(m, &images);
         if (r < 0)
                 return r;
 
@@ -19,13 +19,18 @@
   You should have received a copy of the GNU Lesser General Public License
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
-
+#include "machine-image.h"
+#include "machined.h"
 #include "machined.h"
 
 extern const sd_bus_vtable image_vtable[];
 
 char *image_bus_path(const char *name);
 
+int manager_get_images(Manager *m, Hashmap **ret);
+int manager_find_image(Manager *m, const char *name, Image **ret);
+void manager_image_cache_invalidate(Manager *m);
+
 int image_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error);
 int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error);
 
@@ -19,7 +19,9 @@
 ***/
 
 #include <errno.h>
+#include <linux/rtnetlink.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include "sd-messages.h"
@@ -27,20 +29,24 @@
 #include "alloc-util.h"
 #include "bus-error.h"
 #include "bus-util.h"
+#include "copy.h"
 #include "escape.h"
 #include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "format-util.h"
+#include "fs-util.h"
 #include "hashmap.h"
 #include "machine-dbus.h"
 #include "machine.h"
 #include "mkdir.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "socket-util.h"
 #include "special.h"
 #include "stdio-util.h"
 #include "string-table.h"
+#include "strv.h"
 #include "terminal-util.h"
 #include "unit-name.h"
 #include "util.h"
@@ -71,6 +77,7 @@ Machine* machine_new(Manager *manager, MachineClass class, const char *name) {
         }
 
         m->class = class;
+        m->n_addresses = -1;
 
         if (hashmap_put(manager->machines, m->name, m) < 0)
                 goto fail;
@@ -108,6 +115,10 @@ void machine_free(Machine *m) {
 
         sd_bus_message_unref(m->create_message);
 
+        sd_netlink_unref(m->rtnl);
+        free(m->addresses);
+        strv_free(m->os_release);
+
         free(m->name);
         free(m->state_file);
         free(m->service);
@@ -548,6 +559,297 @@ int machine_kill(Machine *m, KillWho who, int signo) {
         return manager_kill_unit(m->manager, m->unit, signo, NULL);
 }
 
+static int machine_on_address_change(sd_netlink *rtnl, sd_netlink_message *message, void *userdata) {
+        Machine *m = userdata;
+
+        assert(m);
+
+        m->addresses = mfree(m->addresses);
+        m->n_addresses = -1;
+
+        return 0;
+}
+
+static int machine_open_netlink(Machine *m) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_close_ int netns_fd = -1, fd = -1;
+        siginfo_t si;
+        pid_t child;
+        int r;
+
+        assert(m);
+
+        if (m->rtnl)
+                return 0;
+
+        /* A netlink socket stays in the network namespace it was created in, hence create one from within the
+         * container once, and use it from here on for all queries. */
+
+        r = namespace_open(m->leader, NULL, NULL, &netns_fd, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        if (socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0, pair) < 0)
+                return -errno;
+
+        child = fork();
+        if (child < 0)
+                return -errno;
+
+        if (child == 0) {
+                pair[0] = safe_close(pair[0]);
+
+                r = namespace_enter(-1, -1, netns_fd, -1, -1);
+                if (r < 0)
+                        _exit(EXIT_FAILURE);
+
+                fd = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC|SOCK_NONBLOCK, NETLINK_ROUTE);
+                if (fd < 0)
+                        _exit(EXIT_FAILURE);
+
+                r = send_one_fd(pair[1], fd, 0);
+                if (r < 0)
+                        _exit(EXIT_FAILURE);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        pair[1] = safe_close(pair[1]);
+
+        r = wait_for_terminate(child, &si);
+        if (r < 0)
+                return r;
+        if (si.si_code != CLD_EXITED || si.si_status != EXIT_SUCCESS)
+                return -EIO;
+
+        fd = receive_one_fd(pair[0], MSG_DONTWAIT);
+        if (fd < 0)
+                return fd;
+
+        r = sd_netlink_open_fd(&rtnl, fd);
+        if (r < 0)
+                return r;
+        fd = -1;
+
+        r = sd_netlink_add_match(rtnl, RTM_NEWADDR, machine_on_address_change, m);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_add_match(rtnl, RTM_DELADDR, machine_on_address_change, m);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_attach_event(rtnl, m->manager->event, 0);
+        if (r < 0)
+                return r;
+
+        m->rtnl = rtnl;
+        rtnl = NULL;
+
+        return 0;
+}
+
+int machine_get_addresses(Machine *m, struct local_address **ret) {
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns -ENONET if the container shares the network namespace with the host */
+
+        switch (m->class) {
+
+        case MACHINE_HOST:
+                return local_addresses(NULL, 0, AF_UNSPEC, ret);
+
+        case MACHINE_CONTAINER:
+                if (!m->rtnl) {
+                        _cleanup_free_ char *us = NULL, *them = NULL;
+                        const char *p;
+
+                        r = readlink_malloc("/proc/self/ns/net", &us);
+                        if (r < 0)
+                                return r;
+
+                        p = procfs_file_alloca(m->leader, "ns/net");
+                        r = readlink_malloc(p, &them);
+                        if (r < 0)
+                                return r;
+
+                        if (streq(us, them))
+                                return -ENONET;
+
+                        r = machine_open_netlink(m);
+                        if (r < 0)
+                                return r;
+                }
+
+                if (m->n_addresses < 0) {
+                        r = local_addresses(m->rtnl, 0, AF_UNSPEC, &m->addresses);
+                        if (r < 0)
+                                return r;
+
+                        m->n_addresses = r;
+                }
+
+                if (m->n_addresses == 0) {
+                        *ret = NULL;
+                        return 0;
+                }
+
+                *ret = newdup(struct local_address, m->addresses, m->n_addresses);
+                if (!*ret)
+                        return -ENOMEM;
+
+                return m->n_addresses;
+
+        default:
+                return -EOPNOTSUPP;
+        }
+}
+
+#define EXIT_NOT_FOUND 2
+
+static int machine_read_os_release(Machine *m, char ***ret) {
+        _cleanup_close_ int mntns_fd = -1, root_fd = -1;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        siginfo_t si;
+        pid_t child;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        r = namespace_open(m->leader, NULL, &mntns_fd, NULL, NULL, &root_fd);
+        if (r < 0)
+                return r;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair) < 0)
+                return -errno;
+
+        child = fork();
+        if (child < 0)
+                return -errno;
+
+        if (child == 0) {
+                int fd = -1;
+
+                pair[0] = safe_close(pair[0]);
+
+                r = namespace_enter(-1, mntns_fd, -1, -1, root_fd);
+                if (r < 0)
+                        _exit(EXIT_FAILURE);
+
+                fd = open("/etc/os-release", O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (fd < 0 && errno == ENOENT) {
+                        fd = open("/usr/lib/os-release", O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                        if (fd < 0 && errno == ENOENT)
+                                _exit(EXIT_NOT_FOUND);
+                }
+                if (fd < 0)
+                        _exit(EXIT_FAILURE);
+
+                r = copy_bytes(fd, pair[1], (uint64_t) -1, 0);
+                if (r < 0)
+                        _exit(EXIT_FAILURE);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        pair[1] = safe_close(pair[1]);
+
+        f = fdopen(pair[0], "re");
+        if (!f)
+                return -errno;
+
+        pair[0] = -1;
+
+        r = load_env_file_pairs(f, "/etc/os-release", NULL, &l);
+        if (r < 0)
+                return r;
+
+        r = wait_for_terminate(child, &si);
+        if (r < 0)
+                return r;
+        if (si.si_code == CLD_EXITED && si.si_status == EXIT_NOT_FOUND)
+                return -ENODATA;
+        if (si.si_code != CLD_EXITED || si.si_status != EXIT_SUCCESS)
+                return -EIO;
+
+        *ret = l;
+        l = NULL;
+
+        return 0;
+}
+
+static void machine_os_release_stat(Machine *m, struct stat st[2]) {
+        const char *p;
+
+        /* We only look at the inodes from the outside, in order to notice changes. Which file actually
+         * has the data is figured out from within the container. */
+
+        p = procfs_file_alloca(m->leader, "root/etc/os-release");
+        if (lstat(p, st) < 0)
+                zero(st[0]);
+
+        p = procfs_file_alloca(m->leader, "root/usr/lib/os-release");
+        if (lstat(p, st + 1) < 0)
+                zero(st[1]);
+}
+
+static bool stat_unchanged(const struct stat *a, const struct stat *b) {
+        return a->st_dev == b->st_dev &&
+                a->st_ino == b->st_ino &&
+                a->st_size == b->st_size &&
+                timespec_load(&a->st_mtim) == timespec_load(&b->st_mtim);
+}
+
+int machine_get_os_release(Machine *m, char ***ret) {
+        struct stat st[2];
+        char **l;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns -ENODATA if the container has no os-release file */
+
+        switch (m->class) {
+
+        case MACHINE_HOST:
+                return load_env_file_pairs(NULL, "/etc/os-release", NULL, ret);
+
+        case MACHINE_CONTAINER:
+                machine_os_release_stat(m, st);
+
+                if (!m->os_release ||
+                    !stat_unchanged(st, m->os_release_stat) ||
+                    !stat_unchanged(st + 1, m->os_release_stat + 1)) {
+
+                        m->os_release = strv_free(m->os_release);
+
+                        r = machine_read_os_release(m, &m->os_release);
+                        if (r < 0)
+                                return r;
+
+                        memcpy(m->os_release_stat, st, sizeof(st));
+                }
+
+                l = strv_copy(m->os_release);
+                if (!l)
+                        return -ENOMEM;
+
+                *ret = l;
+                return 0;
+
+        default:
+                return -EOPNOTSUPP;
+        }
+}
+
 int machine_openpt(Machine *m, int flags) {
         assert(m);
 
@@ -23,7 +23,12 @@
 typedef struct Machine Machine;
 typedef enum KillWho KillWho;
 
+#include <sys/stat.h>
+
+#include "sd-netlink.h"
+
 #include "list.h"
+#include "local-addresses.h"
 #include "machined.h"
 #include "operation.h"
 
@@ -78,6 +83,17 @@ struct Machine {
         int *netif;
         unsigned n_netif;
 
+        /* A netlink socket in the container's network namespace, so that we can query its addresses without
+         * forking, and are told when they change. The addresses are cached until then, n_addresses is -1 if
+         * they are not. */
+        sd_netlink *rtnl;
+        struct local_address *addresses;
+        int n_addresses;
+
+        /* The container's os-release data, and the inodes it was read from */
+        char **os_release;
+        struct stat os_release_stat[2];
+
         LIST_HEAD(Operation, operations);
 
         LIST_FIELDS(Machine, gc_queue);
@@ -94,6 +110,9 @@ int machine_save(Machine *m);
 int machine_load(Machine *m);
 int machine_kill(Machine *m, KillWho who, int signo);
 
+int machine_get_addresses(Machine *m, struct local_address **ret);
+int machine_get_os_release(Machine *m, char ***ret);
+
 void machine_release_unit(Machine *m);
 
 MachineState machine_get_state(Machine *u);
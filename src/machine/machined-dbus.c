@@ -171,7 +171,7 @@ static int method_get_image(sd_bus_message *message, void *userdata, sd_bus_erro
         if (r < 0)
                 return r;
 
-        r = image_find(name, NULL);
+        r = manager_find_image(m, name, NULL);
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
         if (r < 0)
@@ -269,6 +269,92 @@ static int method_list_machines(sd_bus_message *message, void *userdata, sd_bus_
         return sd_bus_send(NULL, reply, NULL);
 }
 
+static int method_list_machines_ex(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        Machine *machine;
+        Iterator i;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Like ListMachines(), but also includes what GetMachineAddresses() and GetMachineOSRelease() would
+         * return, so that clients polling all machines need only one call. Both are cached per machine. If
+         * they are not available for a machine, empty arrays are returned for it. */
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return sd_bus_error_set_errno(error, r);
+
+        r = sd_bus_message_open_container(reply, 'a', "(sssoa(iay)a{ss})");
+        if (r < 0)
+                return sd_bus_error_set_errno(error, r);
+
+        HASHMAP_FOREACH(machine, m->machines, i) {
+                _cleanup_free_ struct local_address *addresses = NULL;
+                _cleanup_strv_free_ char **os_release = NULL;
+                _cleanup_free_ char *p = NULL;
+                char **k, **v;
+                int n;
+
+                p = machine_bus_path(machine);
+                if (!p)
+                        return -ENOMEM;
+
+                n = machine_get_addresses(machine, &addresses);
+                if (n < 0) {
+                        if (!IN_SET(n, -ENONET, -EOPNOTSUPP))
+                                log_debug_errno(n, "Failed to get addresses of machine %s, ignoring: %m", machine->name);
+                        n = 0;
+                }
+
+                r = machine_get_os_release(machine, &os_release);
+                if (r < 0 && !IN_SET(r, -ENODATA, -EOPNOTSUPP))
+                        log_debug_errno(r, "Failed to get OS release data of machine %s, ignoring: %m", machine->name);
+
+                r = sd_bus_message_open_container(reply, 'r', "sssoa(iay)a{ss}");
+                if (r < 0)
+                        return sd_bus_error_set_errno(error, r);
+
+                r = sd_bus_message_append(reply, "ssso",
+                                          machine->name,
+                                          strempty(machine_class_to_string(machine->class)),
+                                          machine->service,
+                                          p);
+                if (r < 0)
+                        return sd_bus_error_set_errno(error, r);
+
+                r = bus_machine_append_addresses(reply, addresses, n);
+                if (r < 0)
+                        return sd_bus_error_set_errno(error, r);
+
+                r = sd_bus_message_open_container(reply, 'a', "{ss}");
+                if (r < 0)
+                        return sd_bus_error_set_errno(error, r);
+
+                STRV_FOREACH_PAIR(k, v, os_release) {
+                        r = sd_bus_message_append(reply, "{ss}", *k, *v);
+                        if (r < 0)
+                                return sd_bus_error_set_errno(error, r);
+                }
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return sd_bus_error_set_errno(error, r);
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return sd_bus_error_set_errno(error, r);
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return sd_bus_error_set_errno(error, r);
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_create_or_register_machine(Manager *manager, sd_bus_message *message, bool read_network, Machine **_m, sd_bus_error *error) {
         const char *name, *service, *class, *root_directory;
         const int32_t *netif = NULL;
@@ -558,8 +644,8 @@ static int method_get_machine_os_release(sd_bus_message *message, void *userdata
 
 static int method_list_images(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
-        _cleanup_(image_hashmap_freep) Hashmap *images = NULL;
         Manager *m = userdata;
+        Hashmap *images;
         Image *image;
         Iterator i;
         int r;
@@ -567,11 +653,7 @@ static int method_list_images(sd_bus_message *message, void *userdata, sd_bus_er
         assert(message);
         assert(m);
 
-        images = hashmap_new(&string_hash_ops);
-        if (!images)
-                return -ENOMEM;
-
-        r = image_discover(images);
+        r = manager_get_images(m, &images);
         if (r < 0)
                 return r;
 
@@ -751,7 +833,7 @@ static int method_get_machine_uid_shift(sd_bus_message *message, void *userdata,
 }
 
 static int method_remove_image(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image* i = NULL;
+        Image *i;
         const char *name;
         int r;
 
@@ -764,18 +846,17 @@ static int method_remove_image(sd_bus_message *message, void *userdata, sd_bus_e
         if (!image_name_is_valid(name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", name);
 
-        r = image_find(name, &i);
+        r = manager_find_image(userdata, name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
 
-        i->userdata = userdata;
         return bus_image_method_remove(message, i, error);
 }
 
 static int method_rename_image(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image* i = NULL;
+        Image *i;
         const char *old_name;
         int r;
 
@@ -788,18 +869,17 @@ static int method_rename_image(sd_bus_message *message, void *userdata, sd_bus_e
         if (!image_name_is_valid(old_name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", old_name);
 
-        r = image_find(old_name, &i);
+        r = manager_find_image(userdata, old_name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", old_name);
 
-        i->userdata = userdata;
         return bus_image_method_rename(message, i, error);
 }
 
 static int method_clone_image(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image *i = NULL;
+        Image *i;
         const char *old_name;
         int r;
 
@@ -812,18 +892,17 @@ static int method_clone_image(sd_bus_message *message, void *userdata, sd_bus_er
         if (!image_name_is_valid(old_name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", old_name);
 
-        r = image_find(old_name, &i);
+        r = manager_find_image(userdata, old_name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", old_name);
 
-        i->userdata = userdata;
         return bus_image_method_clone(message, i, error);
 }
 
 static int method_mark_image_read_only(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image *i = NULL;
+        Image *i;
         const char *name;
         int r;
 
@@ -836,18 +915,17 @@ static int method_mark_image_read_only(sd_bus_message *message, void *userdata,
         if (!image_name_is_valid(name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", name);
 
-        r = image_find(name, &i);
+        r = manager_find_image(userdata, name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
 
-        i->userdata = userdata;
         return bus_image_method_mark_read_only(message, i, error);
 }
 
 static int method_get_image_hostname(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image *i = NULL;
+        Image *i;
         const char *name;
         int r;
 
@@ -860,18 +938,17 @@ static int method_get_image_hostname(sd_bus_message *message, void *userdata, sd
         if (!image_name_is_valid(name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", name);
 
-        r = image_find(name, &i);
+        r = manager_find_image(userdata, name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
 
-        i->userdata = userdata;
         return bus_image_method_get_hostname(message, i, error);
 }
 
 static int method_get_image_machine_id(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image *i = NULL;
+        Image *i;
         const char *name;
         int r;
 
@@ -884,18 +961,17 @@ static int method_get_image_machine_id(sd_bus_message *message, void *userdata,
         if (!image_name_is_valid(name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", name);
 
-        r = image_find(name, &i);
+        r = manager_find_image(userdata, name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
 
-        i->userdata = userdata;
         return bus_image_method_get_machine_id(message, i, error);
 }
 
 static int method_get_image_machine_info(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image *i = NULL;
+        Image *i;
         const char *name;
         int r;
 
@@ -908,18 +984,17 @@ static int method_get_image_machine_info(sd_bus_message *message, void *userdata
         if (!image_name_is_valid(name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", name);
 
-        r = image_find(name, &i);
+        r = manager_find_image(userdata, name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
 
-        i->userdata = userdata;
         return bus_image_method_get_machine_info(message, i, error);
 }
 
 static int method_get_image_os_release(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image *i = NULL;
+        Image *i;
         const char *name;
         int r;
 
@@ -932,13 +1007,12 @@ static int method_get_image_os_release(sd_bus_message *message, void *userdata,
         if (!image_name_is_valid(name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", name);
 
-        r = image_find(name, &i);
+        r = manager_find_image(userdata, name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
 
-        i->userdata = userdata;
         return bus_image_method_get_os_release(message, i, error);
 }
 
@@ -1225,7 +1299,7 @@ static int method_set_pool_limit(sd_bus_message *message, void *userdata, sd_bus
 }
 
 static int method_set_image_limit(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        _cleanup_(image_unrefp) Image *i = NULL;
+        Image *i;
         const char *name;
         int r;
 
@@ -1238,13 +1312,12 @@ static int method_set_image_limit(sd_bus_message *message, void *userdata, sd_bu
         if (!image_name_is_valid(name))
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image name '%s' is invalid.", name);
 
-        r = image_find(name, &i);
+        r = manager_find_image(userdata, name, &i);
         if (r < 0)
                 return r;
         if (r == 0)
                 return sd_bus_error_setf(error, BUS_ERROR_NO_SUCH_IMAGE, "No image '%s' known", name);
 
-        i->userdata = userdata;
         return bus_image_method_set_limit(message, i, error);
 }
 
@@ -1493,6 +1566,7 @@ const sd_bus_vtable manager_vtable[] = {
         SD_BUS_METHOD("GetImage", "s", "o", method_get_image, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetMachineByPID", "u", "o", method_get_machine_by_pid, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListMachines", NULL, "a(ssso)", method_list_machines, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("ListMachinesEx", NULL, "a(sssoa(iay)a{ss})", method_list_machines_ex, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ListImages", NULL, "a(ssbttto)", method_list_images, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("CreateMachine", "sayssusa(sv)", "o", method_create_machine, 0),
         SD_BUS_METHOD("CreateMachineWithNetwork", "sayssusaia(sv)", "o", method_create_machine_with_network, 0),
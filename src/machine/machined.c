@@ -63,6 +63,8 @@ Manager *manager_new(void) {
 
         sd_event_set_watchdog(m->event, true);
 
+        m->image_inotify_fd = -1;
+
         return m;
 }
 
@@ -84,8 +86,7 @@ void manager_free(Manager *m) {
         hashmap_free(m->machine_leaders);
 
         hashmap_free_with_destructor(m->image_cache, image_unref);
-
-        sd_event_source_unref(m->image_cache_defer_event);
+        safe_close(m->image_inotify_fd);
 
         bus_verify_polkit_async_registry_free(m->polkit_registry);
 
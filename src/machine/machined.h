@@ -45,8 +45,12 @@ struct Manager {
 
         Hashmap *polkit_registry;
 
+        /* All images we discovered, refreshed when the inotify watches on the image directories report a
+         * change, or when the cache got too old */
         Hashmap *image_cache;
-        sd_event_source *image_cache_defer_event;
+        usec_t image_cache_timestamp;
+        bool image_cache_dirty;
+        int image_inotify_fd;
 
         LIST_HEAD(Machine, machine_gc_queue);
 
@@ -189,7 +189,7 @@ static int decode_link(sd_netlink_message *m, LinkInfo *info) {
         return 1;
 }
 
-static int acquire_link_info_strv(sd_netlink *rtnl, char **l, LinkInfo **ret) {
+static int acquire_link_info_single(sd_netlink *rtnl, char **l, LinkInfo **ret) {
         _cleanup_free_ LinkInfo *links = NULL;
         char **i;
         size_t c = 0;
@@ -278,6 +278,50 @@ static int acquire_link_info_all(sd_netlink *rtnl, LinkInfo **ret) {
         return (int) c;
 }
 
+static int acquire_link_info_strv(sd_netlink *rtnl, char **l, LinkInfo **ret) {
+        _cleanup_free_ LinkInfo *links = NULL, *all = NULL;
+        char **i;
+        size_t c = 0;
+        int n;
+
+        assert(rtnl);
+        assert(ret);
+
+        if (strv_length(l) <= 1)
+                return acquire_link_info_single(rtnl, l, ret);
+
+        /* For more than one link, a single dump is a lot cheaper than one request per link */
+        n = acquire_link_info_all(rtnl, &all);
+        if (n < 0)
+                return n;
+
+        links = new(LinkInfo, strv_length(l));
+        if (!links)
+                return log_oom();
+
+        STRV_FOREACH(i, l) {
+                int ifindex, k;
+
+                if (parse_ifindex(*i, &ifindex) < 0)
+                        ifindex = 0;
+
+                for (k = 0; k < n; k++)
+                        if (ifindex > 0 ? all[k].ifindex == ifindex : streq(all[k].name, *i))
+                                break;
+                if (k >= n)
+                        return log_error_errno(ENODEV, "Failed to request link %s: %m", *i);
+
+                links[c++] = all[k];
+        }
+
+        qsort_safe(links, c, sizeof(LinkInfo), link_info_compare);
+
+        *ret = links;
+        links = NULL;
+
+        return (int) c;
+}
+
 static int list_links(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
         _cleanup_free_ LinkInfo *links = NULL;
@@ -30,9 +30,15 @@
 #include "networkd-link.h"
 #include "networkd-manager.h"
 #include "networkd-network.h"
+#include "random-util.h"
 #include "string-util.h"
 #include "sysctl-util.h"
 
+/* At most this many DHCPv4 clients are started per interval, the rest is queued and started in
+ * batches, so that bringing up hundreds of links at once does not flood the DHCP servers. */
+#define DHCP4_START_BURST 32U
+#define DHCP4_START_INTERVAL_USEC (1 * USEC_PER_SEC)
+
 static int dhcp4_route_handler(sd_netlink *rtnl, sd_netlink_message *m,
                                void *userdata) {
         _cleanup_link_unref_ Link *link = userdata;
@@ -763,3 +769,114 @@ int dhcp4_configure(Link *link) {
 
         return 0;
 }
+
+static void dhcp4_start_schedule(Manager *m, usec_t base);
+
+static int dhcp4_start_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+        Link *link;
+
+        assert(m);
+
+        m->dhcp4_start_event_source = sd_event_source_unref(m->dhcp4_start_event_source);
+        m->dhcp4_start_window_usec = usec;
+        m->dhcp4_start_count = 0;
+
+        while (m->dhcp4_start_count < DHCP4_START_BURST &&
+               (link = set_steal_first(m->dhcp4_start_queue))) {
+                int r;
+
+                if (link->dhcp_client && !IN_SET(link->state, LINK_STATE_FAILED, LINK_STATE_LINGER)) {
+                        m->dhcp4_start_count++;
+
+                        r = sd_dhcp_client_start(link->dhcp_client);
+                        if (r < 0) {
+                                log_link_warning_errno(link, r, "Could not acquire DHCPv4 lease: %m");
+                                link_enter_failed(link);
+                        }
+                }
+
+                link_unref(link);
+        }
+
+        if (!set_isempty(m->dhcp4_start_queue))
+                dhcp4_start_schedule(m, usec);
+
+        return 0;
+}
+
+static void dhcp4_start_schedule(Manager *m, usec_t base) {
+        int r;
+
+        assert(m);
+
+        if (m->dhcp4_start_event_source)
+                return;
+
+        /* Jitter each batch, so that machines rebooted together do not stay in lockstep */
+        r = sd_event_add_time(m->event, &m->dhcp4_start_event_source, clock_boottime_or_monotonic(),
+                              usec_add(base, DHCP4_START_INTERVAL_USEC + random_u64() % DHCP4_START_INTERVAL_USEC), 0,
+                              dhcp4_start_handler, m);
+        if (r < 0) {
+                Link *link;
+
+                log_warning_errno(r, "Failed to schedule delayed DHCPv4 clients, starting them now: %m");
+
+                while ((link = set_steal_first(m->dhcp4_start_queue))) {
+                        if (link->dhcp_client && !IN_SET(link->state, LINK_STATE_FAILED, LINK_STATE_LINGER))
+                                (void) sd_dhcp_client_start(link->dhcp_client);
+                        link_unref(link);
+                }
+
+                return;
+        }
+
+        (void) sd_event_source_set_description(m->dhcp4_start_event_source, "dhcp4-start");
+}
+
+int dhcp4_start(Link *link) {
+        Manager *m;
+        usec_t n;
+        int r;
+
+        assert(link);
+        assert(link->dhcp_client);
+        assert(link->manager);
+
+        m = link->manager;
+
+        n = now(clock_boottime_or_monotonic());
+        if (n >= usec_add(m->dhcp4_start_window_usec, DHCP4_START_INTERVAL_USEC)) {
+                m->dhcp4_start_window_usec = n;
+                m->dhcp4_start_count = 0;
+        }
+
+        if (!m->dhcp4_start_event_source && m->dhcp4_start_count < DHCP4_START_BURST) {
+                m->dhcp4_start_count++;
+                return sd_dhcp_client_start(link->dhcp_client);
+        }
+
+        r = set_ensure_allocated(&m->dhcp4_start_queue, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_put(m->dhcp4_start_queue, link);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                link_ref(link);
+
+        log_link_debug(link, "Delaying DHCPv4 client, %u pending", set_size(m->dhcp4_start_queue));
+
+        dhcp4_start_schedule(m, m->dhcp4_start_window_usec);
+
+        return 0;
+}
+
+void dhcp4_start_cancel(Link *link) {
+        assert(link);
+        assert(link->manager);
+
+        if (set_remove(link->manager->dhcp4_start_queue, link))
+                link_unref(link);
+}
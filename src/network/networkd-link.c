@@ -43,6 +43,9 @@
 #include "util.h"
 #include "virt.h"
 
+/* how often we rewrite a link's LLDP neighbor file at most */
+#define LLDP_SAVE_INTERVAL_USEC (1 * USEC_PER_SEC)
+
 static bool link_dhcp6_enabled(Link *link) {
         assert(link);
 
@@ -532,6 +535,7 @@ static void link_free(Link *link) {
         free(link->lease_file);
 
         sd_lldp_unref(link->lldp);
+        sd_event_source_unref(link->lldp_save_event_source);
         free(link->lldp_file);
 
         ndisc_flush(link);
@@ -550,6 +554,7 @@ static void link_free(Link *link) {
 
         (void)unlink(link->state_file);
         free(link->state_file);
+        free(link->state_file_contents);
 
         udev_device_unref(link->udev_device);
 
@@ -636,6 +641,8 @@ static int link_stop_clients(Link *link) {
         assert(link->manager->event);
 
         if (link->dhcp_client) {
+                dhcp4_start_cancel(link);
+
                 k = sd_dhcp_client_stop(link->dhcp_client);
                 if (k < 0)
                         r = log_link_warning_errno(link, k, "Could not stop DHCPv4 client: %m");
@@ -1509,6 +1516,9 @@ static int link_lldp_save(Link *link) {
                 return 0;
         }
 
+        link->lldp_save_event_source = sd_event_source_unref(link->lldp_save_event_source);
+        link->lldp_saved_usec = now(clock_boottime_or_monotonic());
+
         r = sd_lldp_get_neighbors(link->lldp, &l);
         if (r < 0)
                 goto finish;
@@ -1566,13 +1576,55 @@ finish:
         return r;
 }
 
+static int link_lldp_save_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        Link *link = userdata;
+
+        assert(link);
+
+        (void) link_lldp_save(link);
+
+        return 0;
+}
+
+static void link_lldp_save_ratelimited(Link *link) {
+        usec_t n;
+        int r;
+
+        assert(link);
+
+        /* Chatty neighbors may change their data with every frame, don't rewrite the file more often
+         * than every LLDP_SAVE_INTERVAL_USEC. */
+
+        if (link->lldp_save_event_source)
+                return;
+
+        n = now(clock_boottime_or_monotonic());
+        if (link->lldp_saved_usec == 0 || n >= usec_add(link->lldp_saved_usec, LLDP_SAVE_INTERVAL_USEC)) {
+                (void) link_lldp_save(link);
+                return;
+        }
+
+        r = sd_event_add_time(link->manager->event, &link->lldp_save_event_source, clock_boottime_or_monotonic(),
+                              usec_add(link->lldp_saved_usec, LLDP_SAVE_INTERVAL_USEC), 0,
+                              link_lldp_save_handler, link);
+        if (r < 0) {
+                log_link_debug_errno(link, r, "Failed to delay saving LLDP data, saving now: %m");
+                (void) link_lldp_save(link);
+                return;
+        }
+
+        (void) sd_event_source_set_description(link->lldp_save_event_source, "link-lldp-save");
+}
+
 static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n, void *userdata) {
         Link *link = userdata;
         int r;
 
         assert(link);
 
-        (void) link_lldp_save(link);
+        /* A refresh only restarts the neighbor's TTL, the data we saved is still the same */
+        if (event != SD_LLDP_EVENT_REFRESHED)
+                link_lldp_save_ratelimited(link);
 
         if (link_lldp_emit_enabled(link) && event == SD_LLDP_EVENT_ADDED) {
                 /* If we received information about a new neighbor, restart the LLDP "fast" logic */
@@ -1649,7 +1701,7 @@ static int link_acquire_ipv4_conf(Link *link) {
 
                 log_link_debug(link, "Acquiring DHCPv4 lease");
 
-                r = sd_dhcp_client_start(link->dhcp_client);
+                r = dhcp4_start(link);
                 if (r < 0)
                         return log_link_warning_errno(link, r, "Could not acquire DHCPv4 lease: %m");
         }
@@ -2136,6 +2188,7 @@ void link_drop(Link *link) {
         log_link_debug(link, "Link removed");
 
         (void)unlink(link->state_file);
+        link->state_file_contents = mfree(link->state_file_contents);
         link_unref(link);
 
         return;
@@ -3365,9 +3418,10 @@ static void print_link_hashmap(FILE *f, const char *prefix, Hashmap* h) {
 }
 
 int link_save(Link *link) {
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         const char *admin_state, *oper_state;
+        size_t size;
         Address *a;
         Route *route;
         Iterator i;
@@ -3380,10 +3434,11 @@ int link_save(Link *link) {
 
         if (link->state == LINK_STATE_LINGER) {
                 unlink(link->state_file);
+                link->state_file_contents = mfree(link->state_file_contents);
                 return 0;
         }
 
-        link_lldp_save(link);
+        link_lldp_save_ratelimited(link);
 
         admin_state = link_state_to_string(link->state);
         assert(admin_state);
@@ -3391,11 +3446,11 @@ int link_save(Link *link) {
         oper_state = link_operstate_to_string(link->operstate);
         assert(oper_state);
 
-        r = fopen_temporary(link->state_file, &f, &temp_path);
-        if (r < 0)
+        f = open_memstream(&contents, &size);
+        if (!f) {
+                r = -ENOMEM;
                 goto fail;
-
-        (void) fchmod(fileno(f), 0644);
+        }
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -3665,17 +3720,17 @@ int link_save(Link *link) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, link->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = network_state_file_write(link->state_file, &contents, &link->state_file_contents);
+        if (r < 0)
                 goto fail;
-        }
 
         return 0;
 
 fail:
         (void) unlink(link->state_file);
-        if (temp_path)
-                (void) unlink(temp_path);
+        link->state_file_contents = mfree(link->state_file_contents);
 
         return log_link_error_errno(link, r, "Failed to save link data to %s: %m", link->state_file);
 }
@@ -73,6 +73,7 @@ typedef struct Link {
         char *kind;
         unsigned short iftype;
         char *state_file;
+        char *state_file_contents; /* what we last wrote to state_file */
         struct ether_addr mac;
         struct in6_addr ipv6ll_address;
         uint32_t mtu;
@@ -128,6 +129,8 @@ typedef struct Link {
         /* This is about LLDP reception */
         sd_lldp *lldp;
         char *lldp_file;
+        usec_t lldp_saved_usec;
+        sd_event_source *lldp_save_event_source;
 
         /* This is about LLDP transmission */
         unsigned lldp_tx_fast; /* The LLDP txFast counter (See 802.1ab-2009, section 9.2.5.18) */
@@ -171,6 +174,8 @@ int link_set_mtu(Link *link, uint32_t mtu);
 int ipv4ll_configure(Link *link);
 int dhcp4_configure(Link *link);
 int dhcp4_set_promote_secondaries(Link *link);
+int dhcp4_start(Link *link);
+void dhcp4_start_cancel(Link *link);
 int dhcp6_configure(Link *link);
 int dhcp6_request_address(Link *link, int ir);
 
@@ -20,15 +20,69 @@
 
 #include "alloc-util.h"
 #include "bus-util.h"
+#include "metrics.h"
 #include "networkd-manager.h"
 
 static BUS_DEFINE_PROPERTY_GET_ENUM(property_get_operational_state, link_operstate, LinkOperationalState);
 
+static uint64_t links_in_state(Manager *m, LinkState state) {
+        uint64_t n = 0;
+        Iterator i;
+        Link *link;
+
+        HASHMAP_FOREACH(link, m->links, i)
+                if (link->state == state)
+                        n++;
+
+        return n;
+}
+
+static uint64_t metric_links(void *userdata) {
+        Manager *m = userdata;
+
+        return hashmap_size(m->links);
+}
+
+static uint64_t metric_links_configured(void *userdata) {
+        return links_in_state(userdata, LINK_STATE_CONFIGURED);
+}
+
+static uint64_t metric_links_failed(void *userdata) {
+        return links_in_state(userdata, LINK_STATE_FAILED);
+}
+
+static uint64_t metric_networks(void *userdata) {
+        Manager *m = userdata;
+        uint64_t n = 0;
+        Network *network;
+
+        LIST_FOREACH(networks, network, m->networks)
+                n++;
+
+        return n;
+}
+
+static const MetricDescriptor manager_metrics[] = {
+        METRIC_FUNC("links.current", METRIC_GAUGE, metric_links),
+        METRIC_FUNC("links.configured", METRIC_GAUGE, metric_links_configured),
+        METRIC_FUNC("links.failed", METRIC_GAUGE, metric_links_failed),
+        METRIC_FUNC("networks.loaded", METRIC_GAUGE, metric_networks),
+        METRIC_END
+};
+
+static int method_get_metrics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        assert(message);
+
+        return bus_reply_metrics(message, manager_metrics, userdata);
+}
+
 const sd_bus_vtable manager_vtable[] = {
         SD_BUS_VTABLE_START(0),
 
         SD_BUS_PROPERTY("OperationalState", "s", property_get_operational_state, offsetof(Manager, operational_state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
 
+        SD_BUS_METHOD("GetMetrics", NULL, "a(sst)", method_get_metrics, SD_BUS_VTABLE_UNPRIVILEGED),
+
         SD_BUS_VTABLE_END
 };
 
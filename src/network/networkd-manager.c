@@ -45,6 +45,9 @@
 /* use 8 MB for receive socket kernel queue. */
 #define RCVBUF_SIZE    (8*1024*1024)
 
+/* how often we rebuild the manager state file at most */
+#define STATE_SAVE_INTERVAL_USEC (100 * USEC_PER_MSEC)
+
 const char* const network_dirs[] = {
         "/etc/systemd/network",
         "/run/systemd/network",
@@ -294,7 +297,8 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         Link *link = NULL;
         uint16_t type;
         uint32_t ifindex, priority = 0;
-        unsigned char protocol, scope, tos, table, rt_type;
+        unsigned char protocol, scope, tos, rt_type;
+        uint32_t table = 0;
         int family;
         unsigned char dst_prefixlen, src_prefixlen;
         union in_addr_union dst = {}, gw = {}, src = {}, prefsrc = {};
@@ -445,7 +449,14 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
                 return 0;
         }
 
-        r = sd_rtnl_message_route_get_table(message, &table);
+        /* The table in the header only has 8 bits, RTA_TABLE carries the full value */
+        r = sd_netlink_message_read_u32(message, RTA_TABLE, &table);
+        if (r == -ENODATA) {
+                unsigned char table8;
+
+                r = sd_rtnl_message_route_get_table(message, &table8);
+                table = table8;
+        }
         if (r < 0) {
                 log_link_warning_errno(link, r, "rtnl: received route with invalid table, ignoring: %m");
                 return 0;
@@ -462,7 +473,11 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         switch (type) {
         case RTM_NEWROUTE:
                 if (!route) {
-                        /* A route appeared that we did not request */
+                        /* A route appeared that we did not request. Unless told to, don't spend memory on
+                         * tracking such routes, there might be a whole lot of them. */
+                        if (!m->manage_foreign_routes)
+                                return 0;
+
                         r = route_add_foreign(link, family, &dst, dst_prefixlen, tos, priority, table, &route);
                         if (r < 0)
                                 return 0;
@@ -1003,8 +1018,9 @@ static int manager_save(Manager *m) {
         _cleanup_ordered_set_free_free_ OrderedSet *dns = NULL, *ntp = NULL, *search_domains = NULL, *route_domains = NULL;
         Link *link;
         Iterator i;
-        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *f = NULL;
+        size_t size;
         LinkOperationalState operstate = LINK_OPERSTATE_OFF;
         const char *operstate_str;
         int r;
@@ -1110,11 +1126,9 @@ static int manager_save(Manager *m) {
         operstate_str = link_operstate_to_string(operstate);
         assert(operstate_str);
 
-        r = fopen_temporary(m->state_file, &f, &temp_path);
-        if (r < 0)
-                return r;
-
-        (void) fchmod(fileno(f), 0644);
+        f = open_memstream(&contents, &size);
+        if (!f)
+                return -ENOMEM;
 
         fprintf(f,
                 "# This is private data. Do not parse.\n"
@@ -1133,10 +1147,11 @@ static int manager_save(Manager *m) {
         if (r < 0)
                 goto fail;
 
-        if (rename(temp_path, m->state_file) < 0) {
-                r = -errno;
+        f = safe_fclose(f);
+
+        r = network_state_file_write(m->state_file, &contents, &m->state_file_contents);
+        if (r < 0)
                 goto fail;
-        }
 
         if (m->operational_state != operstate) {
                 m->operational_state = operstate;
@@ -1146,16 +1161,60 @@ static int manager_save(Manager *m) {
         }
 
         m->dirty = false;
+        m->state_saved_usec = now(clock_boottime_or_monotonic());
 
         return 0;
 
 fail:
         (void) unlink(m->state_file);
-        (void) unlink(temp_path);
+        m->state_file_contents = mfree(m->state_file_contents);
 
         return log_error_errno(r, "Failed to save network state to %s: %m", m->state_file);
 }
 
+static int manager_save_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        m->state_save_event_source = sd_event_source_unref(m->state_save_event_source);
+
+        if (m->dirty)
+                manager_save(m);
+
+        return 0;
+}
+
+static void manager_save_ratelimited(Manager *m) {
+        usec_t n;
+        int r;
+
+        assert(m);
+
+        /* The manager's state aggregates everything from all links, don't rebuild it more often than every
+         * STATE_SAVE_INTERVAL_USEC when things keep changing. */
+
+        if (m->state_save_event_source)
+                return;
+
+        n = now(clock_boottime_or_monotonic());
+        if (m->state_saved_usec == 0 || n >= usec_add(m->state_saved_usec, STATE_SAVE_INTERVAL_USEC)) {
+                manager_save(m);
+                return;
+        }
+
+        r = sd_event_add_time(m->event, &m->state_save_event_source, clock_boottime_or_monotonic(),
+                              usec_add(m->state_saved_usec, STATE_SAVE_INTERVAL_USEC), 0,
+                              manager_save_handler, m);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to delay saving state, saving now: %m");
+                manager_save(m);
+                return;
+        }
+
+        (void) sd_event_source_set_description(m->state_save_event_source, "manager-save-state");
+}
+
 static int manager_dirty_handler(sd_event_source *s, void *userdata) {
         Manager *m = userdata;
         Link *link;
@@ -1165,7 +1224,7 @@ static int manager_dirty_handler(sd_event_source *s, void *userdata) {
         assert(m);
 
         if (m->dirty)
-                manager_save(m);
+                manager_save_ratelimited(m);
 
         SET_FOREACH(link, m->dirty_links, i) {
                 r = link_save(link);
@@ -1213,6 +1272,7 @@ int manager_new(Manager **ret, sd_event *event) {
                 return r;
 
         m->duid.type = DUID_TYPE_EN;
+        m->manage_foreign_routes = true;
 
         (void) routing_policy_load_rules(m->state_file, &m->rules_saved);
 
@@ -1236,6 +1296,11 @@ void manager_free(Manager *m) {
         while ((network = m->networks))
                 network_free(network);
 
+        while ((link = set_steal_first(m->dhcp4_start_queue)))
+                link_unref(link);
+        set_free(m->dhcp4_start_queue);
+        sd_event_source_unref(m->dhcp4_start_event_source);
+
         while ((link = hashmap_first(m->links)))
                 link_unref(link);
         hashmap_free(m->links);
@@ -1264,7 +1329,9 @@ void manager_free(Manager *m) {
         sd_bus_unref(m->bus);
         sd_bus_slot_unref(m->prepare_for_sleep_slot);
         sd_event_source_unref(m->bus_retry_event_source);
+        sd_event_source_unref(m->state_save_event_source);
 
+        free(m->state_file_contents);
         free(m->dynamic_timezone);
         free(m->dynamic_hostname);
 
@@ -1387,6 +1454,11 @@ int manager_rtnl_enumerate_routes(Manager *m) {
         assert(m);
         assert(m->rtnl);
 
+        /* Only foreign routes would be learnt from the dump, we'll track the routes we configure ourselves as we
+         * go. If we don't manage foreign routes, skip the dump, which might contain a full routing table. */
+        if (!m->manage_foreign_routes)
+                return 0;
+
         r = sd_rtnl_message_new_route(m->rtnl, &req, RTM_GETROUTE, 0, 0);
         if (r < 0)
                 return r;
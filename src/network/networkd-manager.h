@@ -49,10 +49,20 @@ struct Manager {
 
         bool enumerating:1;
         bool dirty:1;
+        bool manage_foreign_routes;
 
         Set *dirty_links;
 
         char *state_file;
+        char *state_file_contents; /* what we last wrote to state_file */
+        usec_t state_saved_usec;
+        sd_event_source *state_save_event_source;
+
+        /* DHCPv4 clients waiting for their turn to start, see dhcp4_start() */
+        Set *dhcp4_start_queue;
+        sd_event_source *dhcp4_start_event_source;
+        usec_t dhcp4_start_window_usec;
+        unsigned dhcp4_start_count;
         LinkOperationalState operational_state;
 
         Hashmap *links;
@@ -51,6 +51,61 @@ static int ndisc_netlink_handler(sd_netlink *rtnl, sd_netlink_message *m, void *
         return 1;
 }
 
+static int ndisc_route_refresh(Link *link, Route *route) {
+        int r;
+
+        /* Routers re-announce the same routes over and over again, and with large prefix sets sending
+         * a RTM_NEWROUTE for each of them on each RA is expensive. Only the lifetime changes in that
+         * case, and that is tracked by us, not by the kernel, hence just move the timer. */
+        r = route_refresh_lifetime(route, link);
+        if (r < 0)
+                log_link_debug_errno(link, r, "Failed to refresh NDisc route lifetime, reconfiguring: %m");
+
+        return r;
+}
+
+static uint32_t ndisc_address_lifetime_remaining(uint32_t lifetime, uint32_t tstamp, usec_t time_now) {
+        usec_t end;
+
+        if (lifetime == CACHE_INFO_INFINITY_LIFE_TIME)
+                return CACHE_INFO_INFINITY_LIFE_TIME;
+
+        end = tstamp / 100 + lifetime;
+        if (end <= time_now / USEC_PER_SEC)
+                return 0;
+
+        return end - time_now / USEC_PER_SEC;
+}
+
+static bool ndisc_address_needs_update(const Address *existing, const Address *address, usec_t time_now) {
+        uint32_t valid, preferred;
+
+        assert(existing);
+        assert(address);
+
+        /* The kernel keeps the address lifetimes itself, so there is no need to push each RA down to
+         * it as long as what it has is still reasonably close to what was advertised. Refresh once
+         * half of the advertised lifetime has passed, which still leaves plenty of margin for the next
+         * RAs to come in. */
+
+        if ((existing->flags & address->flags) != address->flags)
+                return true;
+
+        valid = ndisc_address_lifetime_remaining(existing->cinfo.ifa_valid, existing->cinfo.tstamp, time_now);
+        preferred = ndisc_address_lifetime_remaining(existing->cinfo.ifa_prefered, existing->cinfo.tstamp, time_now);
+
+        if (address->cinfo.ifa_valid == CACHE_INFO_INFINITY_LIFE_TIME ||
+            address->cinfo.ifa_prefered == CACHE_INFO_INFINITY_LIFE_TIME)
+                return valid != address->cinfo.ifa_valid || preferred != address->cinfo.ifa_prefered;
+
+        /* The preferred lifetime may also shrink, e.g. when a prefix is being deprecated, and that
+         * needs to be propagated right away. */
+        if (preferred > address->cinfo.ifa_prefered || valid > address->cinfo.ifa_valid)
+                return true;
+
+        return valid < address->cinfo.ifa_valid / 2 || preferred < address->cinfo.ifa_prefered / 2;
+}
+
 static void ndisc_router_process_default(Link *link, sd_ndisc_router *rt) {
         _cleanup_route_free_ Route *route = NULL;
         struct in6_addr gateway;
@@ -140,6 +195,10 @@ static void ndisc_router_process_default(Link *link, sd_ndisc_router *rt) {
         route->lifetime = time_now + lifetime * USEC_PER_SEC;
         route->mtu = mtu;
 
+        r = ndisc_route_refresh(link, route);
+        if (r > 0)
+                return;
+
         r = route_configure(route, link, ndisc_netlink_handler);
         if (r < 0) {
                 log_link_warning_errno(link, r, "Could not set default route: %m");
@@ -230,14 +289,18 @@ static void ndisc_router_process_autonomous_prefix(Link *link, sd_ndisc_router *
                         address->cinfo.ifa_valid = lifetime_remaining;
                 else
                         address->cinfo.ifa_valid = NDISC_PREFIX_LFT_MIN;
-        } else if (lifetime_valid > 0)
+        } else if (lifetime_valid > 0) {
+                existing_address = NULL; /* a foreign address is taken over unconditionally */
                 address->cinfo.ifa_valid = lifetime_valid;
-        else
+        } else
                 return; /* see RFC4862 section 5.5.3.d */
 
         if (address->cinfo.ifa_valid == 0)
                 return;
 
+        if (existing_address && !ndisc_address_needs_update(existing_address, address, time_now))
+                return;
+
         r = address_configure(address, link, ndisc_netlink_handler, true);
         if (r < 0) {
                 log_link_warning_errno(link, r, "Could not set SLAAC address: %m");
@@ -296,6 +359,10 @@ static void ndisc_router_process_onlink_prefix(Link *link, sd_ndisc_router *rt)
                 return;
         }
 
+        r = ndisc_route_refresh(link, route);
+        if (r > 0)
+                return;
+
         r = route_configure(route, link, ndisc_netlink_handler);
         if (r < 0) {
                 log_link_warning_errno(link, r, "Could not set prefix route: %m");
@@ -368,6 +435,10 @@ static void ndisc_router_process_route(Link *link, sd_ndisc_router *rt) {
                 return;
         }
 
+        r = ndisc_route_refresh(link, route);
+        if (r > 0)
+                return;
+
         r = route_configure(route, link, ndisc_netlink_handler);
         if (r < 0) {
                 log_link_warning_errno(link, r, "Could not set additional route: %m");
@@ -656,6 +727,13 @@ static void ndisc_router_handler(Link *link, sd_ndisc_router *rt) {
 
         ndisc_router_process_default(link, rt);
         ndisc_router_process_options(link, rt);
+
+        /* Nothing had to be sent to the kernel for this RA, hence no netlink reply will mark us
+         * configured. */
+        if (link->ndisc_messages == 0) {
+                link->ndisc_configured = true;
+                link_check_ready(link);
+        }
 }
 
 static void ndisc_handler(sd_ndisc *nd, sd_ndisc_event event, sd_ndisc_router *rt, void *userdata) {
@@ -516,6 +516,9 @@ int route_configure(
 
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
         _cleanup_(sd_event_source_unrefp) sd_event_source *expire = NULL;
+        union in_addr_union gw;
+        unsigned char protocol, type, pref;
+        uint32_t mtu;
         usec_t lifetime;
         int r;
 
@@ -647,11 +650,24 @@ int route_configure(
         link_ref(link);
 
         lifetime = route->lifetime;
+        gw = route->gw;
+        protocol = route->protocol;
+        type = route->type;
+        pref = route->pref;
+        mtu = route->mtu;
 
         r = route_add(link, route->family, &route->dst, route->dst_prefixlen, route->tos, route->priority, route->table, &route);
         if (r < 0)
                 return log_error_errno(r, "Could not add route: %m");
 
+        /* Remember what we asked for, so that an identical request can later be recognized by
+         * route_refresh_lifetime(). */
+        route->gw = gw;
+        route->protocol = protocol;
+        route->type = type;
+        route->pref = pref;
+        route->mtu = mtu;
+
         /* TODO: drop expiration handling once it can be pushed into the kernel */
         route->lifetime = lifetime;
 
@@ -669,6 +685,45 @@ int route_configure(
         return 0;
 }
 
+/* If the very same route was configured by us before and is still tracked with an expiration timer,
+ * push the timer out to the new lifetime instead of sending another RTM_NEWROUTE. The kernel does
+ * not know about the lifetime anyway, so there is nothing to tell it. Returns > 0 if the route was
+ * refreshed, 0 if it needs to be configured the regular way. */
+int route_refresh_lifetime(Route *route, Link *link) {
+        Route *existing;
+        int r;
+
+        assert(route);
+        assert(link);
+
+        if (route->lifetime == USEC_INFINITY)
+                return 0;
+
+        r = route_get(link, route->family, &route->dst, route->dst_prefixlen, route->tos, route->priority, route->table, &existing);
+        if (r <= 0)
+                return 0;
+
+        if (!existing->expire ||
+            existing->protocol != route->protocol ||
+            existing->type != route->type ||
+            existing->pref != route->pref ||
+            existing->mtu != route->mtu ||
+            !in_addr_equal(route->family, &existing->gw, &route->gw))
+                return 0;
+
+        r = sd_event_source_set_time(existing->expire, route->lifetime);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(existing->expire, SD_EVENT_ONESHOT);
+        if (r < 0)
+                return r;
+
+        existing->lifetime = route->lifetime;
+
+        return 1;
+}
+
 int config_parse_gateway(const char *unit,
                 const char *filename,
                 unsigned line,
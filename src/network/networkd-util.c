@@ -18,7 +18,9 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "alloc-util.h"
 #include "conf-parser.h"
+#include "fileio.h"
 #include "networkd-util.h"
 #include "parse-util.h"
 #include "string-table.h"
@@ -99,3 +101,32 @@ int config_parse_address_family_boolean_with_kernel(
 
         return 0;
 }
+
+/* Atomically replaces the state file with *contents, unless that's what we wrote there the last time. This spares
+ * the sd-network clients watching /run/systemd/netif/ a wakeup for each change that doesn't concern them. Takes
+ * ownership of *contents, and remembers it in *last. Returns > 0 if the file was written. */
+int network_state_file_write(const char *path, char **contents, char **last) {
+        int r;
+
+        assert(path);
+        assert(contents);
+        assert(*contents);
+        assert(last);
+
+        if (*last && streq(*last, *contents)) {
+                *contents = mfree(*contents);
+                return 0;
+        }
+
+        r = write_string_file(path, *contents, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_AVOID_NEWLINE);
+        if (r < 0) {
+                *last = mfree(*last);
+                return r;
+        }
+
+        free(*last);
+        *last = *contents;
+        *contents = NULL;
+
+        return 1;
+}
@@ -20,8 +20,11 @@
 
 #include "alloc-util.h"
 #include "dhcp-lease-internal.h"
+#include "fd-util.h"
+#include "fileio.h"
 #include "network-internal.h"
 #include "networkd-manager.h"
+#include "string-util.h"
 #include "udev-util.h"
 
 static void test_deserialize_in_addr(void) {
@@ -186,6 +189,40 @@ static void test_address_equality(void) {
         assert_se(!address_equal(a1, a2));
 }
 
+static void test_state_file_write(void) {
+        _cleanup_free_ char *last = NULL, *contents = NULL, *read = NULL;
+        char path[] = "/tmp/test-network-state.XXXXXX";
+        struct stat st1, st2;
+        int fd;
+
+        fd = mkostemp_safe(path);
+        assert_se(fd >= 0);
+        safe_close(fd);
+
+        assert_se(contents = strdup("OPER_STATE=routable\n"));
+        assert_se(network_state_file_write(path, &contents, &last) > 0);
+        assert_se(!contents);
+        assert_se(streq(last, "OPER_STATE=routable\n"));
+        assert_se(read_full_file(path, &read, NULL) >= 0);
+        assert_se(streq(read, last));
+        assert_se(stat(path, &st1) >= 0);
+
+        /* Same contents again: the file is left alone */
+        assert_se(contents = strdup("OPER_STATE=routable\n"));
+        assert_se(network_state_file_write(path, &contents, &last) == 0);
+        assert_se(!contents);
+        assert_se(stat(path, &st2) >= 0);
+        assert_se(st1.st_ino == st2.st_ino);
+
+        assert_se(contents = strdup("OPER_STATE=degraded\n"));
+        assert_se(network_state_file_write(path, &contents, &last) > 0);
+        read = mfree(read);
+        assert_se(read_full_file(path, &read, NULL) >= 0);
+        assert_se(streq(read, "OPER_STATE=degraded\n"));
+
+        assert_se(unlink(path) >= 0);
+}
+
 int main(void) {
         _cleanup_manager_free_ Manager *manager = NULL;
         _cleanup_(sd_event_unrefp) sd_event *event = NULL;
@@ -196,6 +233,7 @@ int main(void) {
         test_deserialize_in_addr();
         test_deserialize_dhcp_routes();
         test_address_equality();
+        test_state_file_write();
 
         assert_se(sd_event_default(&event) >= 0);
 
@@ -26,6 +26,7 @@
 #include "link.h"
 #include "manager.h"
 #include "string-util.h"
+#include "strv.h"
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname) {
         _cleanup_(link_freep) Link *l = NULL;
@@ -75,11 +76,16 @@ Link *link_free(Link *l) {
                 return NULL;
 
         if (l->manager) {
+                l->manager->n_links_pending -= l->pending;
+                l->manager->n_links_online -= l->online;
+
                 hashmap_remove(l->manager->links, INT_TO_PTR(l->ifindex));
                 hashmap_remove(l->manager->links_by_name, l->ifname);
         }
 
         free(l->ifname);
+        free(l->operational_state);
+        free(l->state);
         return mfree(l);
  }
 
@@ -115,6 +121,8 @@ int link_update_rtnl(Link *l, sd_netlink_message *m) {
                         return r;
         }
 
+        link_update_readiness(l);
+
         return 0;
 }
 
@@ -131,5 +139,40 @@ int link_update_monitor(Link *l) {
 
         sd_network_link_get_setup_state(l->ifindex, &l->state);
 
+        link_update_readiness(l);
+
         return 0;
 }
+
+/* Recalculates what this link contributes to manager_all_configured(), so that the manager only
+ * has to look at links that actually changed. */
+void link_update_readiness(Link *l) {
+        Manager *m;
+        bool pending = false, online = false;
+
+        assert(l);
+        assert(l->manager);
+
+        m = l->manager;
+
+        if (!manager_ignore_link(m, l)) {
+                if (!l->state) {
+                        log_debug("link %s has not yet been processed by udev", l->ifname);
+                        pending = true;
+                } else if (STR_IN_SET(l->state, "configuring", "pending")) {
+                        log_debug("link %s is being processed by networkd", l->ifname);
+                        pending = true;
+                }
+
+                /* we wait for at least one link to be ready,
+                   regardless of who manages it */
+                online = l->operational_state &&
+                         STR_IN_SET(l->operational_state, "degraded", "routable");
+        }
+
+        m->n_links_pending = m->n_links_pending - l->pending + pending;
+        m->n_links_online = m->n_links_online - l->online + online;
+
+        l->pending = pending;
+        l->online = online;
+}
@@ -36,11 +36,16 @@ struct Link {
         bool required_for_online;
         char *operational_state;
         char *state;
+
+        /* what this link currently contributes to the manager's readiness counters */
+        bool pending:1;
+        bool online:1;
 };
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname);
 Link *link_free(Link *l);
 int link_update_rtnl(Link *l, sd_netlink_message *m);
 int link_update_monitor(Link *l);
+void link_update_readiness(Link *l);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Link*, link_free);
@@ -27,6 +27,8 @@
 #include "manager.h"
 #include "netlink-util.h"
 #include "network-internal.h"
+#include "network-util.h"
+#include "set.h"
 #include "time-util.h"
 #include "util.h"
 
@@ -50,48 +52,23 @@ bool manager_ignore_link(Manager *m, Link *link) {
 }
 
 bool manager_all_configured(Manager *m) {
-        Iterator i;
-        Link *l;
         char **ifname;
-        bool one_ready = false;
 
         /* wait for all the links given on the command line to appear */
-        STRV_FOREACH(ifname, m->interfaces) {
-                l = hashmap_get(m->links_by_name, *ifname);
-                if (!l) {
+        STRV_FOREACH(ifname, m->interfaces)
+                if (!hashmap_get(m->links_by_name, *ifname)) {
                         log_debug("still waiting for %s", *ifname);
                         return false;
                 }
-        }
 
         /* wait for all links networkd manages to be in admin state 'configured'
-           and at least one link to gain a carrier */
-        HASHMAP_FOREACH(l, m->links, i) {
-                if (manager_ignore_link(m, l)) {
-                        log_info("ignoring: %s", l->ifname);
-                        continue;
-                }
-
-                if (!l->state) {
-                        log_debug("link %s has not yet been processed by udev",
-                                  l->ifname);
-                        return false;
-                }
-
-                if (STR_IN_SET(l->state, "configuring", "pending")) {
-                        log_debug("link %s is being processed by networkd",
-                                  l->ifname);
-                        return false;
-                }
-
-                if (l->operational_state &&
-                    STR_IN_SET(l->operational_state, "degraded", "routable"))
-                        /* we wait for at least one link to be ready,
-                           regardless of who manages it */
-                        one_ready = true;
+           and at least one link to gain a carrier, see link_update_readiness() */
+        if (m->n_links_pending > 0) {
+                log_debug("%u links are still being configured", m->n_links_pending);
+                return false;
         }
 
-        return one_ready;
+        return m->n_links_online > 0;
 }
 
 static int manager_process_link(sd_netlink *rtnl, sd_netlink_message *mm, void *userdata) {
@@ -217,20 +194,36 @@ static int manager_rtnl_listen(Manager *m) {
 }
 
 static int on_network_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        _cleanup_set_free_ Set *changed = NULL;
         Manager *m = userdata;
         Iterator i;
+        void *p;
         Link *l;
         int r;
 
         assert(m);
 
-        sd_network_monitor_flush(m->network_monitor);
+        r = network_monitor_flush_links(m->network_monitor, &changed);
+        if (r < 0)
+                log_warning_errno(r, "Failed to flush network monitor, re-reading all links: %m");
 
-        HASHMAP_FOREACH(l, m->links, i) {
-                r = link_update_monitor(l);
-                if (r < 0)
-                        log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
-        }
+        if (r != 0) {
+                HASHMAP_FOREACH(l, m->links, i) {
+                        r = link_update_monitor(l);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
+                }
+        } else
+                /* only re-read the links whose state file changed */
+                SET_FOREACH(p, changed, i) {
+                        l = hashmap_get(m->links, p);
+                        if (!l)
+                                continue;
+
+                        r = link_update_monitor(l);
+                        if (r < 0)
+                                log_warning_errno(r, "Failed to update monitor information for %i: %m", l->ifindex);
+                }
 
         if (manager_all_configured(m))
                 sd_event_exit(m->event, 0);
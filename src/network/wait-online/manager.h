@@ -33,6 +33,10 @@ struct Manager {
         Hashmap *links;
         Hashmap *links_by_name;
 
+        /* non-ignored links still being configured, and non-ignored links that are online */
+        unsigned n_links_pending;
+        unsigned n_links_online;
+
         char **interfaces;
         char **ignore;
 
@@ -20,6 +20,8 @@
 
 #include <fcntl.h>
 #include <linux/magic.h>
+#include <pthread.h>
+#include <signal.h>
 #if HAVE_ACL
 #include <sys/acl.h>
 #endif
@@ -32,6 +34,7 @@
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
+#include "list.h"
 #include "missing.h"
 #include "nspawn-def.h"
 #include "nspawn-patch-uid.h"
@@ -246,7 +249,6 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
 static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift) {
         uid_t new_uid;
         gid_t new_gid;
-        bool changed = false;
         int r;
 
         assert(fd >= 0);
@@ -258,33 +260,35 @@ static int patch_fd(int fd, const char *name, const struct stat *st, uid_t shift
         if (!uid_is_valid(new_uid) || !gid_is_valid(new_gid))
                 return -EINVAL;
 
-        if (st->st_uid != new_uid || st->st_gid != new_gid) {
-                if (name)
-                        r = fchownat(fd, name, new_uid, new_gid, AT_SYMLINK_NOFOLLOW);
-                else
-                        r = fchown(fd, new_uid, new_gid);
-                if (r < 0)
-                        return -errno;
-
-                /* The Linux kernel alters the mode in some cases of chown(). Let's undo this. */
-                if (name) {
-                        if (!S_ISLNK(st->st_mode))
-                                r = fchmodat(fd, name, st->st_mode, 0);
-                        else /* AT_SYMLINK_NOFOLLOW is not available for fchmodat() */
-                                r = 0;
-                } else
-                        r = fchmod(fd, st->st_mode);
-                if (r < 0)
-                        return -errno;
-
-                changed = true;
-        }
+        /* The ACLs are patched before the ownership, hence an inode that is owned by the right range already is
+         * complete. This way resuming an interrupted run doesn't have to look at the ACLs of everything that was
+         * already done again. */
+        if (st->st_uid == new_uid && st->st_gid == new_gid)
+                return 0;
 
         r = patch_acls(fd, name, st, shift);
         if (r < 0)
                 return r;
 
-        return r > 0 || changed;
+        if (name)
+                r = fchownat(fd, name, new_uid, new_gid, AT_SYMLINK_NOFOLLOW);
+        else
+                r = fchown(fd, new_uid, new_gid);
+        if (r < 0)
+                return -errno;
+
+        /* The Linux kernel alters the mode in some cases of chown(). Let's undo this. */
+        if (name) {
+                if (!S_ISLNK(st->st_mode))
+                        r = fchmodat(fd, name, st->st_mode, 0);
+                else /* AT_SYMLINK_NOFOLLOW is not available for fchmodat() */
+                        r = 0;
+        } else
+                r = fchmod(fd, st->st_mode);
+        if (r < 0)
+                return -errno;
+
+        return true;
 }
 
 /*
@@ -432,6 +436,312 @@ finish:
         return r;
 }
 
+/* Never keep more than this many directories open at the same time, below that subtrees are patched inline */
+#define PATCH_OPEN_DIRS_MAX 256U
+
+#define PATCH_WORKERS_MAX 8U
+
+typedef struct PatchDir PatchDir;
+
+struct PatchDir {
+        PatchDir *parent;
+        int fd;
+        DIR *d;
+        struct stat st;
+        unsigned n_ref;           /* one for the scan of the directory itself, plus one per queued subdirectory */
+        bool skip;                /* don't patch the directory itself, it's read-only or a special file system */
+
+        LIST_FIELDS(PatchDir, queue);
+};
+
+typedef struct PatchPool {
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;      /* signalled when a directory is queued, or when we are done */
+
+        LIST_HEAD(PatchDir, queue);
+        unsigned n_open;
+
+        uid_t shift;
+        bool changed;
+        bool done;
+        int error;
+} PatchPool;
+
+static void patch_pool_result(PatchPool *pool, int r) {
+        if (r == 0)
+                return;
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        if (r > 0)
+                pool->changed = true;
+        else if (pool->error == 0)
+                pool->error = r;
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+}
+
+static bool patch_pool_failed(PatchPool *pool) {
+        bool failed;
+
+        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+        failed = pool->error < 0;
+        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+        return failed;
+}
+
+static void patch_dir_release(PatchPool *pool, PatchDir *dir) {
+
+        /* Drops one reference to the directory. Whoever drops the last one patches the directory itself and
+         * drops the reference it held on its parent. This way the top-level directory is still patched last
+         * of all. If we failed somewhere we don't patch any directory anymore, so that the top-level one stays
+         * marked as busy. */
+
+        while (dir) {
+                PatchDir *parent;
+                unsigned n;
+                int r;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                assert(dir->n_ref > 0);
+                n = --dir->n_ref;
+                if (n == 0)
+                        pool->n_open--;
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                if (n > 0)
+                        return;
+
+                parent = dir->parent;
+
+                if (!dir->skip && !patch_pool_failed(pool)) {
+                        /* Like recurse_fd(), only a read-only top-level directory is considered fatal here */
+                        r = patch_fd(dir->d ? dirfd(dir->d) : dir->fd, NULL, &dir->st, pool->shift);
+                        if (r == -EROFS && parent) {
+                                _cleanup_free_ char *name = NULL;
+
+                                (void) fd_get_path(dir->d ? dirfd(dir->d) : dir->fd, &name);
+                                log_debug("Skippping read-only file or directory %s.", strna(name));
+                        } else if (r > 0 || r == -EROFS)
+                                patch_pool_result(pool, r);
+                }
+
+                if (dir->d)
+                        closedir(dir->d);
+                else
+                        safe_close(dir->fd);
+                free(dir);
+
+                if (!parent) {
+                        assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                        pool->done = true;
+                        assert_se(pthread_cond_broadcast(&pool->cond) == 0);
+                        assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+                        return;
+                }
+
+                dir = parent;
+        }
+}
+
+static void patch_dir_scan(PatchPool *pool, PatchDir *dir) {
+        struct dirent *de;
+        struct statfs sfs;
+        int r;
+
+        assert(pool);
+        assert(dir);
+
+        if (patch_pool_failed(pool))
+                goto finish;
+
+        if (fstatfs(dir->fd, &sfs) < 0) {
+                patch_pool_result(pool, -errno);
+                goto finish;
+        }
+
+        /* Same rules as in recurse_fd(): don't descend into special file systems, and skip read-only subtrees */
+        if (is_fs_fully_userns_compatible(&sfs)) {
+                dir->skip = true;
+                goto finish;
+        }
+
+        if ((sfs.f_flags & ST_RDONLY) ||
+            access_fd(dir->fd, W_OK) == -EROFS) {
+                dir->skip = true;
+
+                if (dir->parent) {
+                        _cleanup_free_ char *name = NULL;
+
+                        (void) fd_get_path(dir->fd, &name);
+                        log_debug("Skippping read-only file or directory %s.", strna(name));
+                }
+                goto finish;
+        }
+
+        dir->d = fdopendir(dir->fd);
+        if (!dir->d) {
+                patch_pool_result(pool, -errno);
+                goto finish;
+        }
+        dir->fd = -1;
+
+        FOREACH_DIRENT_ALL(de, dir->d, patch_pool_result(pool, -errno); break) {
+                PatchDir *child;
+                struct stat fst;
+                int subdir_fd;
+                bool inline_;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
+
+                if (patch_pool_failed(pool))
+                        break;
+
+                if (fstatat(dirfd(dir->d), de->d_name, &fst, AT_SYMLINK_NOFOLLOW) < 0) {
+                        patch_pool_result(pool, -errno);
+                        break;
+                }
+
+                if (!S_ISDIR(fst.st_mode)) {
+                        patch_pool_result(pool, patch_fd(dirfd(dir->d), de->d_name, &fst, pool->shift));
+                        continue;
+                }
+
+                subdir_fd = openat(dirfd(dir->d), de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW|O_NOATIME);
+                if (subdir_fd < 0) {
+                        patch_pool_result(pool, -errno);
+                        break;
+                }
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                inline_ = pool->n_open >= PATCH_OPEN_DIRS_MAX;
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                child = inline_ ? NULL : new(PatchDir, 1);
+                if (!child) {
+                        r = recurse_fd(subdir_fd, true, &fst, pool->shift, false);
+                        patch_pool_result(pool, r);
+                        if (r < 0)
+                                break;
+
+                        continue;
+                }
+
+                *child = (PatchDir) {
+                        .parent = dir,
+                        .fd = subdir_fd,
+                        .st = fst,
+                        .n_ref = 1,
+                };
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+                dir->n_ref++;
+                pool->n_open++;
+                LIST_PREPEND(queue, pool->queue, child);
+                assert_se(pthread_cond_signal(&pool->cond) == 0);
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+        }
+
+finish:
+        patch_dir_release(pool, dir);
+}
+
+static void *patch_worker(void *p) {
+        PatchPool *pool = p;
+
+        for (;;) {
+                PatchDir *dir;
+
+                assert_se(pthread_mutex_lock(&pool->mutex) == 0);
+
+                while (!pool->queue && !pool->done)
+                        assert_se(pthread_cond_wait(&pool->cond, &pool->mutex) == 0);
+
+                dir = pool->queue;
+                if (dir)
+                        LIST_REMOVE(queue, pool->queue, dir);
+
+                assert_se(pthread_mutex_unlock(&pool->mutex) == 0);
+
+                if (!dir)
+                        return NULL;
+
+                patch_dir_scan(pool, dir);
+        }
+}
+
+static int recurse_fd_parallel(int fd, bool donate_fd, const struct stat *st, uid_t shift) {
+        pthread_t workers[PATCH_WORKERS_MAX];
+        unsigned n_workers, i;
+        sigset_t ss, saved_ss;
+        PatchPool pool = {
+                .shift = shift,
+                .n_open = 1,
+        };
+        PatchDir *root;
+        long ncpus;
+        int r;
+
+        assert(fd >= 0);
+        assert(st);
+        assert(S_ISDIR(st->st_mode));
+
+        /* Like recurse_fd(), but patches the tree from a bunch of threads. Each queued directory is scanned by
+         * one worker, which patches everything but subdirectories right away and queues those in turn. */
+
+        if (!donate_fd) {
+                fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+                if (fd < 0)
+                        return -errno;
+        }
+
+        root = new0(PatchDir, 1);
+        if (!root) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        root->fd = fd;
+        root->st = *st;
+        root->n_ref = 1;
+
+        assert_se(pthread_mutex_init(&pool.mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&pool.cond, NULL) == 0);
+
+        LIST_PREPEND(queue, pool.queue, root);
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = CLAMP(ncpus, 2, (long) PATCH_WORKERS_MAX) - 1;
+
+        /* The workers shall not get any signals delivered */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                n_workers = 0;
+
+        for (i = 0; i < n_workers; i++)
+                if (pthread_create(workers + i, NULL, patch_worker, &pool) > 0)
+                        break;
+        n_workers = i;
+
+        if (r == 0)
+                assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        /* The calling thread joins in, which also means things just work if no worker could be started. */
+        (void) patch_worker(&pool);
+
+        for (i = 0; i < n_workers; i++)
+                assert_se(pthread_join(workers[i], NULL) == 0);
+
+        assert(!pool.queue);
+        assert(pool.n_open == 0);
+
+        assert_se(pthread_cond_destroy(&pool.cond) == 0);
+        assert_se(pthread_mutex_destroy(&pool.mutex) == 0);
+
+        return pool.error < 0 ? pool.error : pool.changed;
+}
+
 static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t range) {
         struct stat st;
         int r;
@@ -489,6 +799,9 @@ static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t rang
                 }
         }
 
+        if (S_ISDIR(st.st_mode))
+                return recurse_fd_parallel(fd, donate_fd, &st, shift);
+
         return recurse_fd(fd, donate_fd, &st, shift, true);
 
 finish:
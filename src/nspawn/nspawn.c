@@ -3273,6 +3273,18 @@ static int load_settings(void) {
         return 0;
 }
 
+static void log_startup_phase(const char *phase, usec_t *ts) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t n;
+
+        assert(phase);
+        assert(ts);
+
+        n = now(CLOCK_MONOTONIC);
+        log_debug("Container startup: %s took %s.", phase, format_timespan(buf, sizeof(buf), usec_sub_unsigned(n, *ts), USEC_PER_MSEC));
+        *ts = n;
+}
+
 static int run(int master,
                const char* console,
                DissectedImage *dissected_image,
@@ -3307,11 +3319,14 @@ static int run(int master,
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         ContainerStatus container_status = 0;
+        usec_t startup_begin, startup_ts;
         char last_char = 0;
         int ifi = 0, r;
         ssize_t l;
         sigset_t mask_chld;
 
+        startup_begin = startup_ts = now(CLOCK_MONOTONIC);
+
         assert_se(sigemptyset(&mask_chld) == 0);
         assert_se(sigaddset(&mask_chld, SIGCHLD) == 0);
 
@@ -3420,6 +3435,16 @@ static int run(int master,
         uid_shift_socket_pair[1] = safe_close(uid_shift_socket_pair[1]);
         unified_cgroup_hierarchy_socket_pair[1] = safe_close(unified_cgroup_hierarchy_socket_pair[1]);
 
+        /* Connecting to the bus doesn't depend on the container in any way, hence start doing so while the outer
+         * child sets up the file system. The authentication and Hello() happen asynchronously, hence this doesn't
+         * block. Anything synchronous has to wait until the outer child is gone though, since its SIGCHLD would
+         * interrupt a blocking bus call. */
+        if (arg_register || !arg_keep_unit) {
+                r = sd_bus_default_system(&bus);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to open system bus: %m");
+        }
+
         if (arg_userns_mode != USER_NAMESPACE_NO) {
                 /* The child just let us know the UID shift it might have read from the image. */
                 l = recv(uid_shift_socket_pair[0], &arg_uid_shift, sizeof arg_uid_shift, 0);
@@ -3490,6 +3515,7 @@ static int run(int master,
                                        "Failed to receive notification socket from the outer child: %m");
 
         log_debug("Init process invoked as PID "PID_FMT, *pid);
+        log_startup_phase("namespace and file system setup", &startup_ts);
 
         if (arg_userns_mode != USER_NAMESPACE_NO) {
                 if (!barrier_place_and_sync(&barrier)) { /* #1 */
@@ -3502,6 +3528,7 @@ static int run(int master,
                         return r;
 
                 (void) barrier_place(&barrier); /* #2 */
+                log_startup_phase("UID map setup", &startup_ts);
         }
 
         if (arg_private_network) {
@@ -3552,12 +3579,8 @@ static int run(int master,
                 r = setup_ipvlan(arg_machine, *pid, arg_network_ipvlan);
                 if (r < 0)
                         return r;
-        }
 
-        if (arg_register || !arg_keep_unit) {
-                r = sd_bus_default_system(&bus);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to open system bus: %m");
+                log_startup_phase("network setup", &startup_ts);
         }
 
         if (!arg_keep_unit) {
@@ -3609,6 +3632,9 @@ static int run(int master,
         } else if (arg_slice || arg_property)
                 log_notice("Machine and scope registration turned off, --slice= and --property= settings will have no effect.");
 
+        if (bus)
+                log_startup_phase(arg_register ? "machine registration" : "scope allocation", &startup_ts);
+
         r = sync_cgroup(*pid, arg_unified_cgroup_hierarchy, arg_uid_shift);
         if (r < 0)
                 return r;
@@ -3623,6 +3649,8 @@ static int run(int master,
         if (r < 0)
                 return r;
 
+        log_startup_phase("cgroup setup", &startup_ts);
+
         /* Notify the child that the parent is ready with all
          * its setup (including cgroup-ification), and that
          * the child can now hand over control to the code to
@@ -3658,6 +3686,9 @@ static int run(int master,
                 return -ESRCH;
         }
 
+        log_startup_phase("container setup", &startup_ts);
+        log_startup_phase("startup as a whole", &startup_begin);
+
         /* At this point we have made use of the UID we picked, and thus nss-mymachines
          * will make them appear in getpwuid(), thus we can release the /etc/passwd lock. */
         etc_passwd_lock = safe_close(etc_passwd_lock);
@@ -4120,7 +4151,7 @@ finish:
         if (remove_directory && arg_directory) {
                 int k;
 
-                k = rm_rf(arg_directory, REMOVE_ROOT|REMOVE_PHYSICAL|REMOVE_SUBVOLUME);
+                k = rm_rf(arg_directory, REMOVE_ROOT|REMOVE_PHYSICAL|REMOVE_SUBVOLUME|REMOVE_PARALLEL);
                 if (k < 0)
                         log_warning_errno(k, "Cannot remove '%s', ignoring: %m", arg_directory);
         }
@@ -21,15 +21,19 @@
 #include <errno.h>
 #include <netdb.h>
 #include <nss.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "sd-bus.h"
 
+#include "alloc-util.h"
 #include "bus-common-errors.h"
 #include "in-addr-util.h"
 #include "macro.h"
 #include "nss-util.h"
+#include "process-util.h"
 #include "string-util.h"
 #include "util.h"
 #include "signal-util.h"
@@ -39,6 +43,89 @@ NSS_GETHOSTBYADDR_PROTOTYPES(resolve);
 
 #define DNS_CALL_TIMEOUT_USEC (45*USEC_PER_SEC)
 
+typedef struct ThreadBus {
+        sd_bus *bus;
+        pid_t pid;
+        dev_t dev;
+        ino_t ino;
+} ThreadBus;
+
+static pthread_key_t thread_bus_key;
+static pthread_once_t thread_bus_once = PTHREAD_ONCE_INIT;
+static bool thread_bus_key_valid = false;
+
+static void thread_bus_free(void *p) {
+        ThreadBus *b = p;
+
+        if (!b)
+                return;
+
+        sd_bus_flush_close_unref(b->bus);
+        free(b);
+}
+
+static void thread_bus_init(void) {
+        thread_bus_key_valid = pthread_key_create(&thread_bus_key, thread_bus_free) == 0;
+}
+
+static int acquire_bus(sd_bus **ret) {
+        struct stat st;
+        ThreadBus *b;
+        int r;
+
+        assert(ret);
+
+        /* Setting up a bus connection costs more than the lookup itself, hence keep one around per thread
+         * (sd-bus objects must not be shared between threads), and reuse it for later lookups. */
+
+        (void) pthread_once(&thread_bus_once, thread_bus_init);
+        if (!thread_bus_key_valid)
+                return sd_bus_open_system(ret);
+
+        b = pthread_getspecific(thread_bus_key);
+        if (!b) {
+                b = new0(ThreadBus, 1);
+                if (!b)
+                        return -ENOMEM;
+
+                if (pthread_setspecific(thread_bus_key, b) != 0) {
+                        free(b);
+                        return sd_bus_open_system(ret);
+                }
+        }
+
+        if (b->bus) {
+                if (b->pid != getpid_cached())
+                        /* We have been forked off, the connection belongs to our parent. */
+                        b->bus = sd_bus_unref(b->bus);
+                else if (fstat(sd_bus_get_fd(b->bus), &st) < 0 || st.st_dev != b->dev || st.st_ino != b->ino)
+                        /* The program closed our socket behind our back and the fd might be used for
+                         * something else now, hence don't touch it anymore, and leak the object. */
+                        b->bus = NULL;
+                else if (sd_bus_is_open(b->bus) <= 0)
+                        b->bus = sd_bus_flush_close_unref(b->bus);
+        }
+
+        if (!b->bus) {
+                r = sd_bus_open_system(&b->bus);
+                if (r < 0)
+                        return r;
+
+                if (fstat(sd_bus_get_fd(b->bus), &st) < 0) {
+                        r = -errno;
+                        b->bus = sd_bus_flush_close_unref(b->bus);
+                        return r;
+                }
+
+                b->pid = getpid_cached();
+                b->dev = st.st_dev;
+                b->ino = st.st_ino;
+        }
+
+        *ret = sd_bus_ref(b->bus);
+        return 0;
+}
+
 static bool bus_error_shall_fallback(sd_bus_error *e) {
         return sd_bus_error_has_name(e, SD_BUS_ERROR_SERVICE_UNKNOWN) ||
                sd_bus_error_has_name(e, SD_BUS_ERROR_NAME_HAS_NO_OWNER) ||
@@ -120,7 +207,7 @@ enum nss_status _nss_resolve_gethostbyname4_r(
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         struct gaih_addrtuple *r_tuple, *r_tuple_first = NULL;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         const char *canonical = NULL;
         size_t l, ms, idx;
@@ -135,7 +222,7 @@ enum nss_status _nss_resolve_gethostbyname4_r(
         assert(errnop);
         assert(h_errnop);
 
-        r = sd_bus_open_system(&bus);
+        r = acquire_bus(&bus);
         if (r < 0)
                 goto fail;
 
@@ -291,7 +378,7 @@ enum nss_status _nss_resolve_gethostbyname3_r(
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         size_t l, idx, ms, alen;
         const char *canonical;
@@ -313,7 +400,7 @@ enum nss_status _nss_resolve_gethostbyname3_r(
                 goto fail;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = acquire_bus(&bus);
         if (r < 0)
                 goto fail;
 
@@ -476,7 +563,7 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *req = NULL, *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         char *r_name, *r_aliases, *r_addr, *r_addr_list;
-        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         enum nss_status ret = NSS_STATUS_UNAVAIL;
         unsigned c = 0, i = 0;
         size_t ms = 0, idx;
@@ -503,7 +590,7 @@ enum nss_status _nss_resolve_gethostbyaddr2_r(
                 return NSS_STATUS_UNAVAIL;
         }
 
-        r = sd_bus_open_system(&bus);
+        r = acquire_bus(&bus);
         if (r < 0)
                 goto fail;
 
@@ -71,6 +71,15 @@ static const struct group nobody_group = {
 NSS_GETPW_PROTOTYPES(systemd);
 NSS_GETGR_PROTOTYPES(systemd);
 
+static int direct_lookup_missing(void) {
+
+        /* A direct lookup symlink doesn't exist. If the directory exists, that's because there's no such dynamic user
+         * and we return -ENOENT. If it is not visible to us at all (PID 1 never allocated a dynamic user, or a mount
+         * namespace hides /run from us) we don't know, and return -ENXIO so that the caller asks PID 1 instead. */
+
+        return access("/run/systemd/dynamic-uid", F_OK) >= 0 ? -ENOENT : -ENXIO;
+}
+
 static int direct_lookup_name(const char *name, uid_t *ret) {
         _cleanup_free_ char *s = NULL;
         const char *path;
@@ -78,13 +87,15 @@ static int direct_lookup_name(const char *name, uid_t *ret) {
 
         assert(name);
 
-        /* Normally, we go via the bus to resolve names. That has the benefit that it is available from any mount
-         * namespace and subject to proper authentication. However, there's one problem: if our module is called from
-         * dbus-daemon itself we really can't use D-Bus to communicate. In this case, resort to a client-side hack,
-         * and look for the dynamic names directly. This is pretty ugly, but breaks the cyclic dependency. */
+        /* PID 1 keeps world-readable symlinks for each dynamic user it allocated in /run/systemd/dynamic-uid/, in both
+         * directions. These are much cheaper to read than asking PID 1 via the bus, and we have to use them anyway
+         * when called from dbus-daemon itself, as it really can't use D-Bus to communicate. Hence look there first,
+         * and only go via the bus if the directory isn't visible to us. */
 
         path = strjoina("/run/systemd/dynamic-uid/direct:", name);
         r = readlink_malloc(path, &s);
+        if (r == -ENOENT)
+                return direct_lookup_missing();
         if (r < 0)
                 return r;
 
@@ -98,6 +109,8 @@ static int direct_lookup_uid(uid_t uid, char **ret) {
         xsprintf(path, "/run/systemd/dynamic-uid/direct:" UID_FMT, uid);
 
         r = readlink_malloc(path, &s);
+        if (r == -ENOENT)
+                return direct_lookup_missing();
         if (r < 0)
                 return r;
         if (!valid_user_group_name(s)) { /* extra safety check */
@@ -117,7 +130,7 @@ enum nss_status _nss_systemd_getpwnam_r(
 
         uint32_t translated;
         size_t l;
-        int bypass, r;
+        int r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -147,17 +160,20 @@ enum nss_status _nss_systemd_getpwnam_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
+        r = direct_lookup_name(name, (uid_t*) &translated);
+        if (r == -ENOENT)
+                goto not_found;
+        if (r == -ENXIO) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
                 _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
                 _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
 
+                if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+                        goto not_found;
+
                 r = sd_bus_open_system(&bus);
-                if (r < 0) {
-                        bypass = 1;
-                        goto direct_lookup;
-                }
+                if (r < 0)
+                        goto not_found;
 
                 r = sd_bus_call_method(bus,
                                        "org.freedesktop.systemd1",
@@ -178,17 +194,8 @@ enum nss_status _nss_systemd_getpwnam_r(
                 r = sd_bus_message_read(reply, "u", &translated);
                 if (r < 0)
                         goto fail;
-        }
-
-direct_lookup:
-        if (bypass > 0) {
-                /* Access the dynamic UID allocation directly if we are called from dbus-daemon, see above. */
-                r = direct_lookup_name(name, (uid_t*) &translated);
-                if (r == -ENOENT)
-                        goto not_found;
-                if (r < 0)
-                        goto fail;
-        }
+        } else if (r < 0)
+                goto fail;
 
         l = strlen(name);
         if (buflen < l+1) {
@@ -230,7 +237,7 @@ enum nss_status _nss_systemd_getpwuid_r(
         _cleanup_free_ char *direct = NULL;
         const char *translated;
         size_t l;
-        int bypass, r;
+        int r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -251,19 +258,23 @@ enum nss_status _nss_systemd_getpwuid_r(
                 }
         }
 
-        if (uid <= SYSTEM_UID_MAX)
+        /* PID 1 allocates dynamic users from a fixed range only, everything else can't be ours */
+        if (!uid_is_dynamic(uid))
                 goto not_found;
 
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
+        r = direct_lookup_uid(uid, &direct);
+        if (r == -ENOENT)
+                goto not_found;
+        if (r == -ENXIO) {
+                if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+                        goto not_found;
+
                 r = sd_bus_open_system(&bus);
-                if (r < 0) {
-                        bypass = 1;
-                        goto direct_lookup;
-                }
+                if (r < 0)
+                        goto not_found;
 
                 r = sd_bus_call_method(bus,
                                        "org.freedesktop.systemd1",
@@ -284,20 +295,11 @@ enum nss_status _nss_systemd_getpwuid_r(
                 r = sd_bus_message_read(reply, "s", &translated);
                 if (r < 0)
                         goto fail;
-        }
-
-direct_lookup:
-        if (bypass > 0) {
-                r = direct_lookup_uid(uid, &direct);
-                if (r == -ENOENT)
-                        goto not_found;
-                if (r < 0)
-                        goto fail;
-
+        } else if (r < 0)
+                goto fail;
+        else
                 translated = direct;
 
-        }
-
         l = strlen(translated) + 1;
         if (buflen < l) {
                 *errnop = ERANGE;
@@ -334,7 +336,7 @@ enum nss_status _nss_systemd_getgrnam_r(
 
         uint32_t translated;
         size_t l;
-        int bypass, r;
+        int r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -361,17 +363,20 @@ enum nss_status _nss_systemd_getgrnam_r(
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
+        r = direct_lookup_name(name, (uid_t*) &translated);
+        if (r == -ENOENT)
+                goto not_found;
+        if (r == -ENXIO) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
                 _cleanup_(sd_bus_message_unrefp) sd_bus_message* reply = NULL;
                 _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
 
+                if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+                        goto not_found;
+
                 r = sd_bus_open_system(&bus);
-                if (r < 0) {
-                        bypass = 1;
-                        goto direct_lookup;
-                }
+                if (r < 0)
+                        goto not_found;
 
                 r = sd_bus_call_method(bus,
                                        "org.freedesktop.systemd1",
@@ -392,17 +397,8 @@ enum nss_status _nss_systemd_getgrnam_r(
                 r = sd_bus_message_read(reply, "u", &translated);
                 if (r < 0)
                         goto fail;
-        }
-
-direct_lookup:
-        if (bypass > 0) {
-                /* Access the dynamic GID allocation directly if we are called from dbus-daemon, see above. */
-                r = direct_lookup_name(name, (uid_t*) &translated);
-                if (r == -ENOENT)
-                        goto not_found;
-                if (r < 0)
-                        goto fail;
-        }
+        } else if (r < 0)
+                goto fail;
 
         l = sizeof(char*) + strlen(name) + 1;
         if (buflen < l) {
@@ -442,7 +438,7 @@ enum nss_status _nss_systemd_getgrgid_r(
         _cleanup_free_ char *direct = NULL;
         const char *translated;
         size_t l;
-        int bypass, r;
+        int r;
 
         BLOCK_SIGNALS(NSS_SIGNALS_BLOCK);
 
@@ -463,19 +459,22 @@ enum nss_status _nss_systemd_getgrgid_r(
                 }
         }
 
-        if (gid <= SYSTEM_GID_MAX)
+        if (!uid_is_dynamic((uid_t) gid))
                 goto not_found;
 
         if (getenv_bool_secure("SYSTEMD_NSS_DYNAMIC_BYPASS") > 0)
                 goto not_found;
 
-        bypass = getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS");
-        if (bypass <= 0) {
+        r = direct_lookup_uid(gid, &direct);
+        if (r == -ENOENT)
+                goto not_found;
+        if (r == -ENXIO) {
+                if (getenv_bool_secure("SYSTEMD_NSS_BYPASS_BUS") > 0)
+                        goto not_found;
+
                 r = sd_bus_open_system(&bus);
-                if (r < 0) {
-                        bypass = 1;
-                        goto direct_lookup;
-                }
+                if (r < 0)
+                        goto not_found;
 
                 r = sd_bus_call_method(bus,
                                        "org.freedesktop.systemd1",
@@ -496,19 +495,10 @@ enum nss_status _nss_systemd_getgrgid_r(
                 r = sd_bus_message_read(reply, "s", &translated);
                 if (r < 0)
                         goto fail;
-        }
-
-direct_lookup:
-        if (bypass > 0) {
-
-                r = direct_lookup_uid(gid, &direct);
-                if (r == -ENOENT)
-                        goto not_found;
-                if (r < 0)
-                        goto fail;
-
+        } else if (r < 0)
+                goto fail;
+        else
                 translated = direct;
-        }
 
         l = sizeof(char*) + strlen(translated) + 1;
         if (buflen < l) {
@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/fanotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sd-daemon.h"
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "def.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "hashmap.h"
+#include "log.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "process-util.h"
+#include "signal-util.h"
+#include "string-util.h"
+#include "util.h"
+
+/* Stop collecting after this time, the boot should be long over by then */
+#define COLLECT_TIMEOUT_USEC (2*USEC_PER_MINUTE)
+
+/* Don't record more than this many files */
+#define COLLECT_FILES_MAX 16384U
+
+typedef struct PackEntry {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+} PackEntry;
+
+static void pack_entry_free(PackEntry *e) {
+        if (!e)
+                return;
+
+        free(e->path);
+        free(e);
+}
+
+static int pack_entry_compare(const void *a, const void *b) {
+        const PackEntry *x = *(const PackEntry**) a, *y = *(const PackEntry**) b;
+
+        /* Files are replayed in the order of their inodes, which roughly follows their placement on disk for most
+         * file systems, and keeps the replay from seeking around too much */
+
+        if (x->dev < y->dev)
+                return -1;
+        if (x->dev > y->dev)
+                return 1;
+
+        if (x->ino < y->ino)
+                return -1;
+        if (x->ino > y->ino)
+                return 1;
+
+        return 0;
+}
+
+static int collect_file(Hashmap *files, int fd) {
+        _cleanup_free_ char *path = NULL;
+        PackEntry *e;
+        struct stat st;
+        int r;
+
+        assert(files);
+        assert(fd >= 0);
+
+        if (hashmap_size(files) >= COLLECT_FILES_MAX)
+                return 0;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (!S_ISREG(st.st_mode) || st.st_size <= 0)
+                return 0;
+
+        r = fd_get_path(fd, &path);
+        if (r < 0)
+                return r;
+
+        /* Files deleted in the meantime won't be around on the next boot */
+        if (!path_is_absolute(path) || endswith(path, " (deleted)"))
+                return 0;
+
+        if (hashmap_contains(files, path))
+                return 0;
+
+        e = new0(PackEntry, 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->path = path;
+        e->dev = st.st_dev;
+        e->ino = st.st_ino;
+        path = NULL;
+
+        r = hashmap_put(files, e->path, e);
+        if (r < 0) {
+                pack_entry_free(e);
+                return r;
+        }
+
+        return 1;
+}
+
+static int on_fanotify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        union {
+                struct fanotify_event_metadata metadata;
+                char buffer[4096];
+        } data;
+        struct fanotify_event_metadata *f;
+        Hashmap *files = userdata;
+        ssize_t n;
+
+        n = read(fd, &data, sizeof(data));
+        if (n < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                log_error_errno(errno, "Failed to read fanotify event: %m");
+                return sd_event_exit(sd_event_source_get_event(s), -errno);
+        }
+
+        for (f = &data.metadata; FAN_EVENT_OK(f, n); f = FAN_EVENT_NEXT(f, n)) {
+                int r;
+
+                if (f->vers != FANOTIFY_METADATA_VERSION) {
+                        log_error("Unsupported fanotify event version %u.", f->vers);
+                        return sd_event_exit(sd_event_source_get_event(s), -EPROTONOSUPPORT);
+                }
+
+                if (f->fd < 0)
+                        continue;
+
+                if (f->pid != getpid_cached()) {
+                        r = collect_file(files, f->fd);
+                        if (r == -ENOMEM) {
+                                safe_close(f->fd);
+                                log_oom();
+                                return sd_event_exit(sd_event_source_get_event(s), r);
+                        }
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to record opened file, ignoring: %m");
+                }
+
+                safe_close(f->fd);
+        }
+
+        return 0;
+}
+
+static int on_exit_request(sd_event_source *s, void *userdata) {
+        return sd_event_exit(sd_event_source_get_event(s), 0);
+}
+
+static int on_signal(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
+        return on_exit_request(s, userdata);
+}
+
+static int on_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
+        log_debug("Collection timeout reached.");
+        return on_exit_request(s, userdata);
+}
+
+static int write_pack(Hashmap *files) {
+        _cleanup_free_ PackEntry **entries = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *t = NULL;
+        size_t n = 0, i;
+        PackEntry *e;
+        Iterator it;
+        int r;
+
+        assert(files);
+
+        entries = new(PackEntry*, hashmap_size(files) + 1);
+        if (!entries)
+                return log_oom();
+
+        HASHMAP_FOREACH(e, files, it)
+                entries[n++] = e;
+
+        qsort_safe(entries, n, sizeof(PackEntry*), pack_entry_compare);
+
+        (void) mkdir_parents(READAHEAD_PACK_PATH, 0755);
+
+        r = fopen_temporary(READAHEAD_PACK_PATH, &f, &t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create " READAHEAD_PACK_PATH ": %m");
+
+        (void) fchmod(fileno(f), 0644);
+
+        fputs("# Files opened during the last boot, in replay order\n", f);
+
+        for (i = 0; i < n; i++) {
+                fputs(entries[i]->path, f);
+                fputc('\n', f);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(t, READAHEAD_PACK_PATH) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        log_debug("Recorded %zu files.", n);
+        return 0;
+
+fail:
+        (void) unlink(t);
+        return log_error_errno(r, "Failed to write " READAHEAD_PACK_PATH ": %m");
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        _cleanup_close_ int fanotify_fd = -1;
+        Hashmap *files = NULL;
+        const char *p;
+        int r;
+
+        if (argc > 1) {
+                log_error("This program takes no arguments.");
+                return EXIT_FAILURE;
+        }
+
+        log_set_target(LOG_TARGET_AUTO);
+        log_parse_environment();
+        log_open();
+
+        umask(0022);
+
+        files = hashmap_new(&string_hash_ops);
+        if (!files) {
+                r = log_oom();
+                goto finish;
+        }
+
+        fanotify_fd = fanotify_init(FAN_CLOEXEC|FAN_NONBLOCK, O_RDONLY|O_LARGEFILE|O_CLOEXEC|O_NOATIME);
+        if (fanotify_fd < 0) {
+                r = log_error_errno(errno, "Failed to create fanotify object: %m");
+                goto finish;
+        }
+
+        /* The files we care about, binaries, libraries and configuration, usually live on the root and /usr file
+         * systems. Marking /usr is harmless if it is no mount point of its own, it's the same mount then. */
+        NULSTR_FOREACH(p, "/\0/usr\0") {
+                if (fanotify_mark(fanotify_fd, FAN_MARK_ADD|FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, p) < 0) {
+                        r = log_error_errno(errno, "Failed to mark %s: %m", p);
+                        goto finish;
+                }
+        }
+
+        assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGTERM, SIGINT, -1) >= 0);
+
+        r = sd_event_default(&event);
+        if (r < 0) {
+                log_error_errno(r, "Failed to allocate event loop: %m");
+                goto finish;
+        }
+
+        r = sd_event_add_io(event, NULL, fanotify_fd, EPOLLIN, on_fanotify, files);
+        if (r < 0) {
+                log_error_errno(r, "Failed to watch fanotify object: %m");
+                goto finish;
+        }
+
+        r = sd_event_add_signal(event, NULL, SIGTERM, on_signal, NULL);
+        if (r >= 0)
+                r = sd_event_add_signal(event, NULL, SIGINT, on_signal, NULL);
+        if (r < 0) {
+                log_error_errno(r, "Failed to install signal handlers: %m");
+                goto finish;
+        }
+
+        r = sd_event_add_time(event, NULL, CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + COLLECT_TIMEOUT_USEC, 0, on_timeout, NULL);
+        if (r < 0) {
+                log_error_errno(r, "Failed to install timeout: %m");
+                goto finish;
+        }
+
+        (void) sd_notify(false,
+                         "READY=1\n"
+                         "STATUS=Collecting files opened during boot...");
+
+        r = sd_event_loop(event);
+        if (r < 0) {
+                log_error_errno(r, "Failed to run event loop: %m");
+                goto finish;
+        }
+
+        (void) sd_notify(false,
+                         "STOPPING=1\n"
+                         "STATUS=Writing readahead pack...");
+
+        /* Stop watching before we write the pack, we don't want to see ourselves */
+        event = sd_event_unref(event);
+        fanotify_fd = safe_close(fanotify_fd);
+
+        r = write_pack(files);
+
+finish:
+        event = sd_event_unref(event);
+        hashmap_free_with_destructor(files, pack_entry_free);
+
+        return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -22,6 +22,7 @@
 #include "bus-common-errors.h"
 #include "bus-util.h"
 #include "dns-domain.h"
+#include "metrics.h"
 #include "resolved-bus.h"
 #include "resolved-def.h"
 #include "resolved-dns-synthesize.h"
@@ -1404,6 +1405,158 @@ static int bus_property_get_dnssec_statistics(
                                      (uint64_t) m->n_dnssec_verdict[DNSSEC_INDETERMINATE]);
 }
 
+static int bus_append_latency_histogram(sd_bus_message *reply, const DnsLatencyHistogram *h) {
+        assert(reply);
+        assert(h);
+
+        return sd_bus_message_append_array(reply, 't', h->buckets, sizeof(h->buckets));
+}
+
+static int bus_property_get_transaction_phase_statistics(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        DnsTransactionPhase phase;
+        int r;
+
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(sat)");
+        if (r < 0)
+                return r;
+
+        for (phase = 0; phase < _DNS_TRANSACTION_PHASE_MAX; phase++) {
+                r = sd_bus_message_open_container(reply, 'r', "sat");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "s", dns_transaction_phase_to_string(phase));
+                if (r < 0)
+                        return r;
+
+                r = bus_append_latency_histogram(reply, m->transaction_phase_latency + phase);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int bus_dns_server_append_statistics(sd_bus_message *reply, DnsServer *s) {
+        DnsServerFeatureLevel level;
+        int r;
+
+        assert(reply);
+        assert(s);
+
+        r = sd_bus_message_open_container(reply, 'r', "iiayata(st)");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "ii", dns_server_ifindex(s), s->family);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array(reply, 'y', &s->address, FAMILY_ADDRESS_SIZE(s->family));
+        if (r < 0)
+                return r;
+
+        r = bus_append_latency_histogram(reply, &s->rtt_histogram);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(st)");
+        if (r < 0)
+                return r;
+
+        for (level = 0; level < _DNS_SERVER_FEATURE_LEVEL_MAX; level++) {
+                r = sd_bus_message_append(reply, "(st)", dns_server_feature_level_to_string(level), s->n_downgrades[level]);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int bus_property_get_server_statistics(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        DnsServer *s;
+        Iterator i;
+        Link *l;
+        int r;
+
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(iiayata(st))");
+        if (r < 0)
+                return r;
+
+        LIST_FOREACH(servers, s, m->dns_servers) {
+                r = bus_dns_server_append_statistics(reply, s);
+                if (r < 0)
+                        return r;
+        }
+
+        HASHMAP_FOREACH(l, m->links, i) {
+                LIST_FOREACH(servers, s, l->dns_servers) {
+                        r = bus_dns_server_append_statistics(reply, s);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        LIST_FOREACH(servers, s, m->fallback_dns_servers) {
+                r = bus_dns_server_append_statistics(reply, s);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int bus_property_get_stub_statistics(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+
+        assert(reply);
+        assert(m);
+
+        return sd_bus_message_append(reply, "(tt)",
+                                     (uint64_t) m->n_dns_stub_queries,
+                                     (uint64_t) m->n_dns_stub_queries_max);
+}
+
 static int bus_property_get_dnssec_supported(
                 sd_bus *bus,
                 const char *path,
@@ -1453,9 +1606,70 @@ static int bus_property_get_ntas(
 
 static BUS_DEFINE_PROPERTY_GET_ENUM(bus_property_get_dns_stub_listener_mode, dns_stub_listener_mode, DnsStubListenerMode);
 
+static uint64_t metric_cache_size(void *userdata) {
+        Manager *m = userdata;
+        uint64_t size = 0;
+        DnsScope *s;
+
+        LIST_FOREACH(scopes, s, m->dns_scopes)
+                size += dns_cache_size(&s->cache);
+
+        return size;
+}
+
+static uint64_t metric_cache_hit(void *userdata) {
+        Manager *m = userdata;
+        uint64_t hit = 0;
+        DnsScope *s;
+
+        LIST_FOREACH(scopes, s, m->dns_scopes)
+                hit += s->cache.n_hit;
+
+        return hit;
+}
+
+static uint64_t metric_cache_miss(void *userdata) {
+        Manager *m = userdata;
+        uint64_t miss = 0;
+        DnsScope *s;
+
+        LIST_FOREACH(scopes, s, m->dns_scopes)
+                miss += s->cache.n_miss;
+
+        return miss;
+}
+
+static uint64_t metric_transactions_current(void *userdata) {
+        Manager *m = userdata;
+
+        return hashmap_size(m->dns_transactions);
+}
+
+static const MetricDescriptor manager_metrics[] = {
+        METRIC_FUNC("transactions.current", METRIC_GAUGE, metric_transactions_current),
+        METRIC_FIELD("transactions.total", METRIC_COUNTER, Manager, n_transactions_total),
+        METRIC_FIELD("queries.current", METRIC_GAUGE, Manager, n_dns_queries),
+        METRIC_FUNC("cache.size", METRIC_GAUGE, metric_cache_size),
+        METRIC_FUNC("cache.hit", METRIC_COUNTER, metric_cache_hit),
+        METRIC_FUNC("cache.miss", METRIC_COUNTER, metric_cache_miss),
+        METRIC_FIELD("dnssec.secure", METRIC_COUNTER, Manager, n_dnssec_verdict[DNSSEC_SECURE]),
+        METRIC_FIELD("dnssec.insecure", METRIC_COUNTER, Manager, n_dnssec_verdict[DNSSEC_INSECURE]),
+        METRIC_FIELD("dnssec.bogus", METRIC_COUNTER, Manager, n_dnssec_verdict[DNSSEC_BOGUS]),
+        METRIC_FIELD("dnssec.indeterminate", METRIC_COUNTER, Manager, n_dnssec_verdict[DNSSEC_INDETERMINATE]),
+        METRIC_END
+};
+
+static int bus_method_get_metrics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        assert(message);
+
+        return bus_reply_metrics(message, manager_metrics, userdata);
+}
+
 static int bus_method_reset_statistics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         Manager *m = userdata;
         DnsScope *s;
+        Iterator i;
+        Link *l;
 
         assert(message);
         assert(m);
@@ -1465,6 +1679,14 @@ static int bus_method_reset_statistics(sd_bus_message *message, void *userdata,
 
         m->n_transactions_total = 0;
         zero(m->n_dnssec_verdict);
+        zero(m->transaction_phase_latency);
+        m->n_dns_stub_queries_max = m->n_dns_stub_queries;
+
+        dns_server_reset_statistics_all(m->dns_servers);
+        dns_server_reset_statistics_all(m->fallback_dns_servers);
+
+        HASHMAP_FOREACH(l, m->links, i)
+                dns_server_reset_statistics_all(l->dns_servers);
 
         return sd_bus_reply_method_return(message, NULL);
 }
@@ -1589,6 +1811,9 @@ static const sd_bus_vtable resolve_vtable[] = {
         SD_BUS_PROPERTY("TransactionStatistics", "(tt)", bus_property_get_transaction_statistics, 0, 0),
         SD_BUS_PROPERTY("CacheStatistics", "(ttt)", bus_property_get_cache_statistics, 0, 0),
         SD_BUS_PROPERTY("DNSSECStatistics", "(tttt)", bus_property_get_dnssec_statistics, 0, 0),
+        SD_BUS_PROPERTY("TransactionPhaseStatistics", "a(sat)", bus_property_get_transaction_phase_statistics, 0, 0),
+        SD_BUS_PROPERTY("ServerStatistics", "a(iiayata(st))", bus_property_get_server_statistics, 0, 0),
+        SD_BUS_PROPERTY("StubStatistics", "(tt)", bus_property_get_stub_statistics, 0, 0),
         SD_BUS_PROPERTY("DNSSECSupported", "b", bus_property_get_dnssec_supported, 0, 0),
         SD_BUS_PROPERTY("DNSSECNegativeTrustAnchors", "as", bus_property_get_ntas, 0, 0),
         SD_BUS_PROPERTY("DNSStubListener", "s", bus_property_get_dns_stub_listener_mode, offsetof(Manager, dns_stub_listener_mode), 0),
@@ -1598,6 +1823,7 @@ static const sd_bus_vtable resolve_vtable[] = {
         SD_BUS_METHOD("ResolveRecord", "isqqt", "a(iqqay)t", bus_method_resolve_record, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ResolveService", "isssit", "a(qqqsa(iiay)s)aayssst", bus_method_resolve_service, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("ResetStatistics", NULL, NULL, bus_method_reset_statistics, 0),
+        SD_BUS_METHOD("GetMetrics", NULL, "a(sst)", bus_method_get_metrics, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("FlushCaches", NULL, NULL, bus_method_flush_caches, 0),
         SD_BUS_METHOD("ResetServerFeatures", NULL, NULL, bus_method_reset_server_features, 0),
         SD_BUS_METHOD("GetLink", "i", "o", bus_method_get_link, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -28,10 +28,6 @@
 #include "resolved-dns-packet.h"
 #include "string-util.h"
 
-/* Never cache more than 4K entries. RFC 1536, Section 5 suggests to
- * leave DNS caches unbounded, but that's crazy. */
-#define CACHE_MAX 4096
-
 /* We never keep any item longer than 2h in our cache */
 #define CACHE_TTL_MAX_USEC (2 * USEC_PER_HOUR)
 
@@ -64,6 +60,11 @@ struct DnsCacheItem {
         union in_addr_union owner_address;
 
         unsigned prioq_idx;
+
+        /* when this item was last used, as value of DnsCache's use_counter */
+        uint64_t last_use;
+        unsigned use_prioq_idx;
+
         LIST_FIELDS(DnsCacheItem, by_key);
 };
 
@@ -116,6 +117,7 @@ static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
                 hashmap_remove(c->by_key, i->key);
 
         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        prioq_remove(c->by_use, i, &i->use_prioq_idx);
 
         dns_cache_item_free(i);
 }
@@ -150,6 +152,7 @@ static bool dns_cache_remove_by_key(DnsCache *c, DnsResourceKey *key) {
 
         LIST_FOREACH_SAFE(by_key, i, n, first) {
                 prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                prioq_remove(c->by_use, i, &i->use_prioq_idx);
                 dns_cache_item_free(i);
         }
 
@@ -166,33 +169,43 @@ void dns_cache_flush(DnsCache *c) {
 
         assert(hashmap_size(c->by_key) == 0);
         assert(prioq_size(c->by_expiry) == 0);
+        assert(prioq_size(c->by_use) == 0);
 
         c->by_key = hashmap_free(c->by_key);
         c->by_expiry = prioq_free(c->by_expiry);
+        c->by_use = prioq_free(c->by_use);
 }
 
 static void dns_cache_make_space(DnsCache *c, unsigned add) {
+        unsigned max_size;
+
         assert(c);
 
         if (add <= 0)
                 return;
 
+        max_size = c->max_size > 0 ? c->max_size : DNS_CACHE_SIZE_DEFAULT;
+
         /* Makes space for n new entries. Note that we actually allow
-         * the cache to grow beyond CACHE_MAX, but only when we shall
-         * add more RRs to the cache than CACHE_MAX at once. In that
-         * case the cache will be emptied completely otherwise. */
+         * the cache to grow beyond the maximum size, but only when we
+         * shall add more RRs to the cache than that at once. In that
+         * case the cache will be emptied completely otherwise.
+         *
+         * Evict the least recently used entries first: popular names
+         * are looked up all the time and should stay, no matter when
+         * they expire. */
 
         for (;;) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
                 DnsCacheItem *i;
 
-                if (prioq_size(c->by_expiry) <= 0)
+                if (prioq_size(c->by_use) <= 0)
                         break;
 
-                if (prioq_size(c->by_expiry) + add < CACHE_MAX)
+                if (prioq_size(c->by_use) + add < max_size)
                         break;
 
-                i = prioq_peek(c->by_expiry);
+                i = prioq_peek(c->by_use);
                 assert(i);
 
                 /* Take an extra reference to the key so that it
@@ -243,14 +256,24 @@ void dns_cache_prune(DnsCache *c) {
         }
 }
 
-static int dns_cache_item_prioq_compare_func(const void *a, const void *b) {
-        const DnsCacheItem *x = a, *y = b;
+static uint64_t dns_cache_item_prioq_key_func(const void *a) {
+        const DnsCacheItem *i = a;
 
-        if (x->until < y->until)
-                return -1;
-        if (x->until > y->until)
-                return 1;
-        return 0;
+        return i->until;
+}
+
+static uint64_t dns_cache_item_use_prioq_key_func(const void *a) {
+        const DnsCacheItem *i = a;
+
+        return i->last_use;
+}
+
+static void dns_cache_item_touch(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        i->last_use = ++c->use_counter;
+        prioq_reshuffle(c->by_use, i, &i->use_prioq_idx);
 }
 
 static int dns_cache_init(DnsCache *c) {
@@ -258,7 +281,11 @@ static int dns_cache_init(DnsCache *c) {
 
         assert(c);
 
-        r = prioq_ensure_allocated(&c->by_expiry, dns_cache_item_prioq_compare_func);
+        r = prioq_ensure_allocated_keyed(&c->by_expiry, dns_cache_item_prioq_key_func);
+        if (r < 0)
+                return r;
+
+        r = prioq_ensure_allocated_keyed(&c->by_use, dns_cache_item_use_prioq_key_func);
         if (r < 0)
                 return r;
 
@@ -280,6 +307,13 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
         if (r < 0)
                 return r;
 
+        i->last_use = ++c->use_counter;
+        r = prioq_put(c->by_use, i, &i->use_prioq_idx);
+        if (r < 0) {
+                prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                return r;
+        }
+
         first = hashmap_get(c->by_key, i->key);
         if (first) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *k = NULL;
@@ -301,6 +335,7 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
                 r = hashmap_put(c->by_key, i->key, i);
                 if (r < 0) {
                         prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                        prioq_remove(c->by_use, i, &i->use_prioq_idx);
                         return r;
                 }
         }
@@ -398,6 +433,7 @@ static void dns_cache_item_update_positive(
         i->owner_address = *owner_address;
 
         prioq_reshuffle(c->by_expiry, i, &i->prioq_idx);
+        dns_cache_item_touch(c, i);
 }
 
 static int dns_cache_put_positive(
@@ -471,6 +507,7 @@ static int dns_cache_put_positive(
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
         i->prioq_idx = PRIOQ_IDX_NULL;
+        i->use_prioq_idx = PRIOQ_IDX_NULL;
 
         r = dns_cache_link_item(c, i);
         if (r < 0)
@@ -555,6 +592,7 @@ static int dns_cache_put_negative(
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
         i->prioq_idx = PRIOQ_IDX_NULL;
+        i->use_prioq_idx = PRIOQ_IDX_NULL;
         i->rcode = rcode;
 
         if (i->type == DNS_CACHE_NXDOMAIN) {
@@ -888,6 +926,8 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         }
 
         LIST_FOREACH(by_key, j, first) {
+                dns_cache_item_touch(c, j);
+
                 if (j->rr) {
                         if (j->rr->key->type == DNS_TYPE_NSEC)
                                 nsec = j;
@@ -1029,18 +1069,20 @@ int dns_cache_check_conflicts(DnsCache *cache, DnsResourceRecord *rr, int owner_
         return 1;
 }
 
-int dns_cache_export_shared_to_packet(DnsCache *cache, DnsPacket *p) {
+int dns_cache_export_shared_to_packet(DnsCache *cache, DnsQuestion *q, usec_t ts, DnsPacket *p) {
         unsigned ancount = 0;
-        Iterator iterator;
-        DnsCacheItem *i;
+        DnsResourceKey *key;
         int r;
 
         assert(cache);
         assert(p);
 
-        HASHMAP_FOREACH(i, cache->by_key, iterator) {
-                DnsCacheItem *j;
+        /* Only the items for the keys we are actually asking for are relevant as known answers, hence look
+         * them up directly instead of walking the whole cache. */
+        DNS_QUESTION_FOREACH(key, q) {
+                DnsCacheItem *i, *j;
 
+                i = hashmap_get(cache->by_key, key);
                 LIST_FOREACH(by_key, j, i) {
                         if (!j->rr)
                                 continue;
@@ -1048,6 +1090,11 @@ int dns_cache_export_shared_to_packet(DnsCache *cache, DnsPacket *p) {
                         if (!j->shared_owner)
                                 continue;
 
+                        /* RFC 6762, section 7.1: don't include records whose remaining TTL is less than
+                         * half of the original one, the responder should refresh those for us. */
+                        if (j->until <= ts || (j->until - ts) * 2 < (usec_t) j->rr->ttl * USEC_PER_SEC)
+                                continue;
+
                         r = dns_packet_append_rr(p, j->rr, 0, NULL, NULL);
                         if (r == -EMSGSIZE && p->protocol == DNS_PROTOCOL_MDNS) {
                                 /* For mDNS, if we're unable to stuff all known answers into the given packet,
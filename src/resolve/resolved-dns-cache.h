@@ -25,9 +25,16 @@
 #include "prioq.h"
 #include "time-util.h"
 
+/* Never cache more than 4K entries by default. RFC 1536, Section 5 suggests to
+ * leave DNS caches unbounded, but that's crazy. */
+#define DNS_CACHE_SIZE_DEFAULT 4096
+
 typedef struct DnsCache {
         Hashmap *by_key;
         Prioq *by_expiry;
+        Prioq *by_use;
+        uint64_t use_counter;
+        unsigned max_size;
         unsigned n_hit;
         unsigned n_miss;
 } DnsCache;
@@ -50,4 +57,4 @@ bool dns_cache_is_empty(DnsCache *cache);
 
 unsigned dns_cache_size(DnsCache *cache);
 
-int dns_cache_export_shared_to_packet(DnsCache *cache, DnsPacket *p);
+int dns_cache_export_shared_to_packet(DnsCache *cache, DnsQuestion *q, usec_t ts, DnsPacket *p);
@@ -25,6 +25,7 @@
 #include "alloc-util.h"
 #include "dns-domain.h"
 #include "gcrypt-util.h"
+#include "hashmap.h"
 #include "hexdecoct.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
@@ -39,6 +40,10 @@
 /* Maximum number of NSEC3 iterations we'll do. RFC5155 says 2500 shall be the maximum useful value */
 #define NSEC3_ITERATIONS_MAX 2500
 
+/* Maximum number of remembered signature verification results */
+#define VERIFY_CACHE_MAX 4096
+#define VERIFY_CACHE_ID_SIZE 32
+
 /*
  * The DNSSEC Chain of trust:
  *
@@ -599,6 +604,95 @@ static void dnssec_fix_rrset_ttl(
         rrsig->expiry = rrsig->rrsig.expiration * USEC_PER_SEC;
 }
 
+/* The public key operations are by far the most expensive part of validation, and the same RRsets are validated
+ * over and over again with the same signatures and keys: by every transaction that needs them as part of a chain,
+ * and again whenever they're refetched. The outcome of a verification only depends on the digest of the signed data,
+ * the signature and the key, hence remember it under the SHA-256 of these. Expiry and inception of the signature are
+ * covered by the digest, and are checked before the cache is consulted. */
+
+typedef struct VerifyCacheEntry {
+        uint8_t id[VERIFY_CACHE_ID_SIZE];
+        bool valid;
+} VerifyCacheEntry;
+
+static Hashmap *verify_cache = NULL;
+
+static void verify_cache_hash_func(const void *p, struct siphash *state) {
+        siphash24_compress(p, VERIFY_CACHE_ID_SIZE, state);
+}
+
+static int verify_cache_compare_func(const void *a, const void *b) {
+        return memcmp(a, b, VERIFY_CACHE_ID_SIZE);
+}
+
+static const struct hash_ops verify_cache_hash_ops = {
+        .hash = verify_cache_hash_func,
+        .compare = verify_cache_compare_func,
+};
+
+static int verify_cache_id(
+                int md_algorithm,
+                const void *hash, size_t hash_size,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                uint8_t id[static VERIFY_CACHE_ID_SIZE]) {
+
+        gcry_md_hd_t md = NULL;
+        void *digest;
+
+        assert(gcry_md_get_algo_dlen(GCRY_MD_SHA256) == VERIFY_CACHE_ID_SIZE);
+
+        gcry_md_open(&md, GCRY_MD_SHA256, 0);
+        if (!md)
+                return -EIO;
+
+        md_add_uint8(md, rrsig->rrsig.algorithm);
+        md_add_uint8(md, (uint8_t) md_algorithm);
+        md_add_uint16(md, (uint16_t) hash_size);
+        gcry_md_write(md, hash, hash_size);
+        md_add_uint16(md, (uint16_t) rrsig->rrsig.signature_size);
+        gcry_md_write(md, rrsig->rrsig.signature, rrsig->rrsig.signature_size);
+        md_add_uint16(md, (uint16_t) dnskey->dnskey.key_size);
+        gcry_md_write(md, dnskey->dnskey.key, dnskey->dnskey.key_size);
+
+        digest = gcry_md_read(md, 0);
+        if (!digest) {
+                gcry_md_close(md);
+                return -EIO;
+        }
+
+        memcpy(id, digest, VERIFY_CACHE_ID_SIZE);
+        gcry_md_close(md);
+
+        return 0;
+}
+
+static void verify_cache_add(const uint8_t id[static VERIFY_CACHE_ID_SIZE], bool valid) {
+        VerifyCacheEntry *e;
+
+        if (hashmap_ensure_allocated(&verify_cache, &verify_cache_hash_ops) < 0)
+                return;
+
+        /* Keep this simple, if we are full just start from scratch */
+        if (hashmap_size(verify_cache) >= VERIFY_CACHE_MAX)
+                dnssec_verify_cache_flush();
+
+        e = new(VerifyCacheEntry, 1);
+        if (!e)
+                return;
+
+        memcpy(e->id, id, sizeof(e->id));
+        e->valid = valid;
+
+        if (hashmap_put(verify_cache, e->id, e) <= 0)
+                free(e);
+}
+
+void dnssec_verify_cache_flush(void) {
+        hashmap_free_free(verify_cache);
+        verify_cache = NULL;
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
@@ -608,6 +702,8 @@ int dnssec_verify_rrset(
                 DnssecResult *result) {
 
         uint8_t wire_format_name[DNS_WIRE_FOMAT_HOSTNAME_MAX];
+        uint8_t verify_id[VERIFY_CACHE_ID_SIZE];
+        VerifyCacheEntry *cached = NULL;
         DnsResourceRecord **list, *rr;
         const char *source, *name;
         gcry_md_hd_t md = NULL;
@@ -780,7 +876,14 @@ int dnssec_verify_rrset(
                 goto finish;
         }
 
-        switch (rrsig->rrsig.algorithm) {
+        r = verify_cache_id(md_algorithm, hash, hash_size, rrsig, dnskey, verify_id);
+        if (r < 0)
+                goto finish;
+
+        cached = hashmap_get(verify_cache, verify_id);
+        if (cached)
+                r = cached->valid;
+        else switch (rrsig->rrsig.algorithm) {
 
         case DNSSEC_ALGORITHM_RSASHA1:
         case DNSSEC_ALGORITHM_RSASHA1_NSEC3_SHA1:
@@ -807,6 +910,9 @@ int dnssec_verify_rrset(
         if (r < 0)
                 goto finish;
 
+        if (!cached)
+                verify_cache_add(verify_id, r > 0);
+
         /* Now, fix the ttl, expiry, and remember the synthesizing source and the signer */
         if (r > 0)
                 dnssec_fix_rrset_ttl(list, n, rrsig, realtime);
@@ -2111,6 +2217,9 @@ int dnssec_test_positive_wildcard(
 
 #else
 
+void dnssec_verify_cache_flush(void) {
+}
+
 int dnssec_verify_rrset(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
@@ -77,6 +77,8 @@ int dnssec_has_rrsig(DnsAnswer *a, const DnsResourceKey *key);
 
 uint16_t dnssec_keytag(DnsResourceRecord *dnskey, bool mask_revoke);
 
+void dnssec_verify_cache_flush(void);
+
 int dnssec_canonicalize(const char *n, char *buffer, size_t buffer_max);
 
 int dnssec_nsec3_hash(DnsResourceRecord *nsec3, const char *name, void *ret);
@@ -1386,9 +1386,11 @@ int dns_packet_read_name(
 
         _cleanup_(rewind_dns_packet) DnsPacketRewinder rewinder;
         size_t after_rindex = 0, jump_barrier;
-        _cleanup_free_ char *ret = NULL;
-        size_t n = 0, allocated = 0;
+        /* escaped form of the longest valid name, every byte of it might need 4 characters */
+        char ret[DNS_WIRE_FOMAT_HOSTNAME_MAX * 4 + 1];
+        size_t n = 0, wire = 1;
         bool first = true;
+        char *name;
         int r;
 
         assert(p);
@@ -1417,15 +1419,18 @@ int dns_packet_read_name(
                         if (r < 0)
                                 return r;
 
-                        if (!GREEDY_REALLOC(ret, allocated, n + !first + DNS_LABEL_ESCAPED_MAX))
-                                return -ENOMEM;
+                        /* Names are limited to 255 bytes in wire format (RFC 1035, Section 2.3.4), hence we can
+                         * decode into a buffer on the stack and allocate the result only once. */
+                        wire += 1 + c;
+                        if (wire > DNS_WIRE_FOMAT_HOSTNAME_MAX)
+                                return -EBADMSG;
 
                         if (first)
                                 first = false;
                         else
                                 ret[n++] = '.';
 
-                        r = dns_label_escape(label, c, ret + n, DNS_LABEL_ESCAPED_MAX);
+                        r = dns_label_escape(label, c, ret + n, sizeof(ret) - n);
                         if (r < 0)
                                 return r;
 
@@ -1453,16 +1458,14 @@ int dns_packet_read_name(
                         return -EBADMSG;
         }
 
-        if (!GREEDY_REALLOC(ret, allocated, n + 1))
+        name = strndup(ret, n);
+        if (!name)
                 return -ENOMEM;
 
-        ret[n] = 0;
-
         if (after_rindex != 0)
                 p->rindex= after_rindex;
 
-        *_ret = ret;
-        ret = NULL;
+        *_ret = name;
 
         if (start)
                 *start = rewinder.saved_rindex;
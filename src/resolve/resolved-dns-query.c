@@ -35,6 +35,9 @@
 #define QUERIES_MAX 2048
 #define AUXILIARY_QUERIES_MAX 64
 
+/* How many search domains to look up at the same time */
+#define SEARCH_DOMAINS_PARALLEL_MAX 3
+
 static int dns_query_candidate_new(DnsQueryCandidate **ret, DnsQuery *q, DnsScope *s) {
         DnsQueryCandidate *c;
 
@@ -56,18 +59,32 @@ static int dns_query_candidate_new(DnsQueryCandidate **ret, DnsQuery *q, DnsScop
         return 0;
 }
 
-static void dns_query_candidate_stop(DnsQueryCandidate *c) {
+static void dns_query_candidate_release(DnsQueryCandidate *c, Set *transactions) {
         DnsTransaction *t;
 
         assert(c);
 
-        while ((t = set_steal_first(c->transactions))) {
+        /* Empties the specified set, and detaches the candidate from the transactions in it, unless they are still
+         * referenced by one of the candidate's own sets. */
+
+        while ((t = set_steal_first(transactions))) {
+                if (set_contains(c->transactions, t) ||
+                    set_contains(c->prefetch_transactions, t))
+                        continue;
+
                 set_remove(t->notify_query_candidates, c);
                 set_remove(t->notify_query_candidates_done, c);
                 dns_transaction_gc(t);
         }
 }
 
+static void dns_query_candidate_stop(DnsQueryCandidate *c) {
+        assert(c);
+
+        dns_query_candidate_release(c, c->transactions);
+        dns_query_candidate_release(c, c->prefetch_transactions);
+}
+
 DnsQueryCandidate* dns_query_candidate_free(DnsQueryCandidate *c) {
 
         if (!c)
@@ -76,6 +93,7 @@ DnsQueryCandidate* dns_query_candidate_free(DnsQueryCandidate *c) {
         dns_query_candidate_stop(c);
 
         set_free(c->transactions);
+        set_free(c->prefetch_transactions);
         dns_search_domain_unref(c->search_domain);
 
         if (c->query)
@@ -114,11 +132,12 @@ static int dns_query_candidate_next_search_domain(DnsQueryCandidate *c) {
         return 1;
 }
 
-static int dns_query_candidate_add_transaction(DnsQueryCandidate *c, DnsResourceKey *key) {
+static int dns_query_candidate_add_transaction(DnsQueryCandidate *c, Set **transactions, DnsResourceKey *key) {
         DnsTransaction *t;
         int r;
 
         assert(c);
+        assert(transactions);
         assert(key);
 
         t = dns_scope_find_transaction(c->scope, key, true);
@@ -127,11 +146,11 @@ static int dns_query_candidate_add_transaction(DnsQueryCandidate *c, DnsResource
                 if (r < 0)
                         return r;
         } else {
-                if (set_contains(c->transactions, t))
+                if (set_contains(*transactions, t))
                         return 0;
         }
 
-        r = set_ensure_allocated(&c->transactions, NULL);
+        r = set_ensure_allocated(transactions, NULL);
         if (r < 0)
                 goto gc;
 
@@ -147,9 +166,11 @@ static int dns_query_candidate_add_transaction(DnsQueryCandidate *c, DnsResource
         if (r < 0)
                 goto gc;
 
-        r = set_put(c->transactions, t);
+        r = set_put(*transactions, t);
         if (r < 0) {
-                (void) set_remove(t->notify_query_candidates, c);
+                if (!set_contains(c->transactions, t) &&
+                    !set_contains(c->prefetch_transactions, t))
+                        (void) set_remove(t->notify_query_candidates, c);
                 goto gc;
         }
 
@@ -161,6 +182,8 @@ gc:
         return r;
 }
 
+static void dns_query_candidate_prefetch(DnsQueryCandidate *c);
+
 static int dns_query_candidate_go(DnsQueryCandidate *c) {
         DnsTransaction *t;
         Iterator i;
@@ -181,6 +204,8 @@ static int dns_query_candidate_go(DnsQueryCandidate *c) {
                 n++;
         }
 
+        dns_query_candidate_prefetch(c);
+
         /* If there was nothing to start, then let's proceed immediately */
         if (n == 0)
                 dns_query_candidate_notify(c);
@@ -258,14 +283,13 @@ static bool dns_query_candidate_is_routable(DnsQueryCandidate *c, uint16_t type)
                 return manager_routable(c->scope->manager, family);
 }
 
-static int dns_query_candidate_setup_transactions(DnsQueryCandidate *c) {
+static int dns_query_candidate_add_transactions(DnsQueryCandidate *c, Set **transactions, DnsSearchDomain *domain) {
         DnsQuestion *question;
         DnsResourceKey *key;
         int n = 0, r;
 
         assert(c);
-
-        dns_query_candidate_stop(c);
+        assert(transactions);
 
         question = dns_query_question_for_protocol(c->query, c->scope->protocol);
 
@@ -277,10 +301,10 @@ static int dns_query_candidate_setup_transactions(DnsQueryCandidate *c) {
                 if (!dns_query_candidate_is_routable(c, key->type))
                         continue;
 
-                if (c->search_domain) {
-                        r = dns_resource_key_new_append_suffix(&new_key, key, c->search_domain->name);
+                if (domain) {
+                        r = dns_resource_key_new_append_suffix(&new_key, key, domain->name);
                         if (r < 0)
-                                goto fail;
+                                return r;
 
                         qkey = new_key;
                 } else
@@ -289,20 +313,75 @@ static int dns_query_candidate_setup_transactions(DnsQueryCandidate *c) {
                 if (!dns_scope_good_key(c->scope, qkey))
                         continue;
 
-                r = dns_query_candidate_add_transaction(c, qkey);
+                r = dns_query_candidate_add_transaction(c, transactions, qkey);
                 if (r < 0)
-                        goto fail;
+                        return r;
 
                 n++;
         }
 
         return n;
+}
+
+static int dns_query_candidate_setup_transactions(DnsQueryCandidate *c) {
+        int r;
+
+        assert(c);
+
+        /* Leave the prefetched transactions alone, the ones for the new search domain are likely among them */
+        dns_query_candidate_release(c, c->transactions);
+
+        r = dns_query_candidate_add_transactions(c, &c->transactions, c->search_domain);
+        if (r < 0)
+                dns_query_candidate_stop(c);
 
-fail:
-        dns_query_candidate_stop(c);
         return r;
 }
 
+static void dns_query_candidate_prefetch(DnsQueryCandidate *c) {
+        _cleanup_set_free_ Set *old = NULL;
+        DnsSearchDomain *d;
+        DnsTransaction *t;
+        unsigned n = 1;
+        Iterator i;
+        int r;
+
+        assert(c);
+
+        /* Start the transactions for the next few search domains right away, so that a miss on the current one
+         * doesn't cost another full round trip. This doesn't change which answer is used: the candidate still only
+         * looks at the transactions of its current search domain, and moves on to the next one only once that
+         * failed. */
+
+        old = c->prefetch_transactions;
+        c->prefetch_transactions = NULL;
+
+        if (c->search_domain && c->search_domain->linked)
+                for (d = c->search_domain->domains_next; d && n < SEARCH_DOMAINS_PARALLEL_MAX; d = d->domains_next) {
+                        if (d->route_only)
+                                continue;
+
+                        r = dns_query_candidate_add_transactions(c, &c->prefetch_transactions, d);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed to prefetch search domain %s, ignoring: %m", d->name);
+                                break;
+                        }
+
+                        n++;
+                }
+
+        dns_query_candidate_release(c, old);
+
+        SET_FOREACH(t, c->prefetch_transactions, i) {
+                if (t->state != DNS_TRANSACTION_NULL)
+                        continue;
+
+                r = dns_transaction_go(t);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to start prefetch transaction, ignoring: %m");
+        }
+}
+
 void dns_query_candidate_notify(DnsQueryCandidate *c) {
         DnsTransactionState state;
         int r;
@@ -419,6 +498,11 @@ DnsQuery *dns_query_free(DnsQuery *q) {
         if (q->manager) {
                 LIST_REMOVE(queries, q->manager->dns_queries, q);
                 q->manager->n_dns_queries--;
+
+                if (q->request_dns_packet) {
+                        assert(q->manager->n_dns_stub_queries > 0);
+                        q->manager->n_dns_stub_queries--;
+                }
         }
 
         return mfree(q);
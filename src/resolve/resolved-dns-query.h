@@ -42,6 +42,10 @@ struct DnsQueryCandidate {
         int error_code;
         Set *transactions;
 
+        /* Transactions for the next search domains, already started so that they are ready if the current one
+         * fails */
+        Set *prefetch_transactions;
+
         LIST_FIELDS(DnsQueryCandidate, candidates_by_query);
         LIST_FIELDS(DnsQueryCandidate, candidates_by_scope);
 };
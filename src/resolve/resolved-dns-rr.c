@@ -25,6 +25,8 @@
 #include "dns-type.h"
 #include "escape.h"
 #include "hexdecoct.h"
+#include "mempool.h"
+#include "process-util.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
 #include "resolved-dns-rr.h"
@@ -381,13 +383,20 @@ bool dns_resource_key_reduce(DnsResourceKey **a, DnsResourceKey **b) {
         return true;
 }
 
+/* The cache holds lots of these, and they come and go all the time */
+DEFINE_MEMPOOL(rr_pool, DnsResourceRecord, 64);
+
 DnsResourceRecord* dns_resource_record_new(DnsResourceKey *key) {
         DnsResourceRecord *rr;
+        bool use_pool;
+
+        use_pool = is_main_thread();
 
-        rr = new0(DnsResourceRecord, 1);
+        rr = use_pool ? mempool_alloc0_tile(&rr_pool) : new0(DnsResourceRecord, 1);
         if (!rr)
                 return NULL;
 
+        rr->from_pool = use_pool;
         rr->n_ref = 1;
         rr->key = dns_resource_key_ref(key);
         rr->expiry = USEC_INFINITY;
@@ -512,7 +521,13 @@ DnsResourceRecord* dns_resource_record_unref(DnsResourceRecord *rr) {
         }
 
         free(rr->to_string);
-        return mfree(rr);
+
+        if (rr->from_pool)
+                mempool_free_tile(&rr_pool, rr);
+        else
+                free(rr);
+
+        return NULL;
 }
 
 int dns_resource_record_new_reverse(DnsResourceRecord **ret, int family, const union in_addr_union *address, const char *hostname) {
@@ -55,6 +55,7 @@ int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int
         s->protocol = protocol;
         s->family = family;
         s->resend_timeout = MULTICAST_RESEND_TIMEOUT_MIN_USEC;
+        s->cache.max_size = m->cache_size;
 
         if (protocol == DNS_PROTOCOL_DNS) {
                 /* Copy DNSSEC mode from the link if it is set there,
@@ -122,6 +123,9 @@ DnsScope* dns_scope_free(DnsScope *s) {
 
         sd_event_source_unref(s->announce_event_source);
 
+        sd_event_source_unref(s->mdns_response_event_source);
+        dns_answer_unref(s->mdns_pending_answer);
+
         dns_cache_flush(&s->cache);
         dns_zone_flush(&s->zone);
 
@@ -60,6 +60,10 @@ struct DnsScope {
         bool announced:1;
         sd_event_source *announce_event_source;
 
+        /* mDNS answers to shared questions, collected from several queries and sent in one response */
+        DnsAnswer *mdns_pending_answer;
+        sd_event_source *mdns_response_event_source;
+
         RateLimit ratelimit;
 
         usec_t resend_timeout;
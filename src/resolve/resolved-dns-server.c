@@ -136,6 +136,8 @@ DnsServer* dns_server_unref(DnsServer *s)  {
         if (s->n_ref > 0)
                 return NULL;
 
+        dns_server_unref_stream(s);
+
         free(s->server_string);
         return mfree(s);
 }
@@ -181,9 +183,30 @@ void dns_server_unlink(DnsServer *s) {
         if (s->manager->current_dns_server == s)
                 manager_set_dns_server(s->manager, NULL);
 
+        /* No new transactions will pick this server, so don't keep its connection open beyond the ongoing ones */
+        dns_server_unref_stream(s);
+
         dns_server_unref(s);
 }
 
+void dns_server_unref_stream(DnsServer *s) {
+        DnsStream *ref;
+
+        assert(s);
+
+        /* Detaches the TCP connection from this server. Transactions using it may keep it around until they are
+         * done with it. */
+
+        if (!s->stream)
+                return;
+
+        ref = s->stream;
+        s->stream = NULL;
+
+        ref->server = NULL;
+        dns_stream_unref(ref);
+}
+
 void dns_server_move_back_and_unmark(DnsServer *s) {
         DnsServer *tail;
 
@@ -299,6 +322,8 @@ void dns_server_packet_received(DnsServer *s, int protocol, DnsServerFeatureLeve
         if (protocol == IPPROTO_UDP && s->received_udp_packet_max < size)
                 s->received_udp_packet_max = size;
 
+        dns_latency_histogram_record(&s->rtt_histogram, rtt);
+
         if (s->max_rtt < rtt) {
                 s->max_rtt = rtt;
                 s->resend_timeout = CLAMP(s->max_rtt * 2, DNS_TIMEOUT_MIN_USEC, DNS_TIMEOUT_MAX_USEC);
@@ -498,6 +523,9 @@ DnsServerFeatureLevel dns_server_possible_feature_level(DnsServer *s) {
                         /* We changed the feature level, reset the counting */
                         dns_server_reset_counters(s);
 
+                        if (s->possible_feature_level < p)
+                                s->n_downgrades[s->possible_feature_level]++;
+
                         log_warning("Using degraded feature set (%s) for DNS server %s.",
                                     dns_server_feature_level_to_string(s->possible_feature_level),
                                     dns_server_string(s));
@@ -854,6 +882,30 @@ void dns_server_reset_features_all(DnsServer *s) {
                 dns_server_reset_features(i);
 }
 
+void dns_server_reset_statistics_all(DnsServer *s) {
+        DnsServer *i;
+
+        LIST_FOREACH(servers, i, s) {
+                zero(i->rtt_histogram);
+                zero(i->n_downgrades);
+        }
+}
+
+void dns_latency_histogram_record(DnsLatencyHistogram *h, usec_t usec) {
+        unsigned b;
+
+        assert(h);
+
+        if (usec < USEC_PER_MSEC)
+                b = 0;
+        else if (usec / USEC_PER_MSEC >= UINT_MAX)
+                b = DNS_LATENCY_HISTOGRAM_BUCKETS - 1;
+        else
+                b = MIN(log2u(usec / USEC_PER_MSEC) + 1, DNS_LATENCY_HISTOGRAM_BUCKETS - 1);
+
+        h->buckets[b]++;
+}
+
 void dns_server_dump(DnsServer *s, FILE *f) {
         assert(s);
 
@@ -21,6 +21,7 @@
 ***/
 
 #include "in-addr-util.h"
+#include "time-util.h"
 
 typedef struct DnsServer DnsServer;
 
@@ -50,6 +51,17 @@ typedef enum DnsServerFeatureLevel {
 const char* dns_server_feature_level_to_string(int i) _const_;
 int dns_server_feature_level_from_string(const char *s) _pure_;
 
+/* Bucket 0 counts latencies below 1ms, bucket n > 0 those of at least 2^(n-1) ms and below 2^n ms. The last
+ * bucket also collects everything slower than that. */
+#define DNS_LATENCY_HISTOGRAM_BUCKETS 16
+
+typedef struct DnsLatencyHistogram {
+        uint64_t buckets[DNS_LATENCY_HISTOGRAM_BUCKETS];
+} DnsLatencyHistogram;
+
+void dns_latency_histogram_record(DnsLatencyHistogram *h, usec_t usec);
+
+#include "resolved-dns-stream.h"
 #include "resolved-link.h"
 #include "resolved-manager.h"
 
@@ -82,9 +94,17 @@ struct DnsServer {
         bool packet_bad_opt:1;
         bool packet_rrsig_missing:1;
 
+        /* The TCP connection to this server, if there is one. Transactions share it, and it stays around for a while
+         * after the last one is done. */
+        DnsStream *stream;
+
         usec_t verified_usec;
         usec_t features_grace_period_usec;
 
+        /* Statistics, as exposed on the bus */
+        DnsLatencyHistogram rtt_histogram;
+        uint64_t n_downgrades[_DNS_SERVER_FEATURE_LEVEL_MAX]; /* indexed by the level we downgraded to */
+
         /* Whether we already warned about downgrading to non-DNSSEC mode for this server */
         bool warned_downgrade:1;
 
@@ -109,6 +129,7 @@ DnsServer* dns_server_ref(DnsServer *s);
 DnsServer* dns_server_unref(DnsServer *s);
 
 void dns_server_unlink(DnsServer *s);
+void dns_server_unref_stream(DnsServer *s);
 void dns_server_move_back_and_unmark(DnsServer *s);
 
 void dns_server_packet_received(DnsServer *s, int protocol, DnsServerFeatureLevel level, usec_t rtt, size_t size);
@@ -156,4 +177,6 @@ void dns_server_flush_cache(DnsServer *s);
 void dns_server_reset_features(DnsServer *s);
 void dns_server_reset_features_all(DnsServer *s);
 
+void dns_server_reset_statistics_all(DnsServer *s);
+
 void dns_server_dump(DnsServer *s, FILE *f);
@@ -50,6 +50,17 @@ static int dns_stream_update_io(DnsStream *s) {
         return sd_event_source_set_io_events(s->io_event_source, f);
 }
 
+static void dns_stream_reset_timeout(DnsStream *s) {
+        assert(s);
+
+        /* Streams shared between transactions stay open as long as there's traffic on them */
+
+        if (!s->timeout_event_source)
+                return;
+
+        (void) sd_event_source_set_time(s->timeout_event_source, now(clock_boottime_or_monotonic()) + DNS_STREAM_TIMEOUT_USEC);
+}
+
 static int dns_stream_complete(DnsStream *s, int error) {
         assert(s);
 
@@ -197,7 +208,7 @@ static int on_stream_timeout(sd_event_source *es, usec_t usec, void *userdata) {
 }
 
 static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
-        DnsStream *s = userdata;
+        _cleanup_(dns_stream_unrefp) DnsStream *s = dns_stream_ref(userdata); /* Protect stream while we process it */
         int r;
 
         assert(s);
@@ -227,8 +238,18 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
                 } else
                         s->n_written += ss;
 
-                /* Are we done? If so, disable the event source for EPOLLOUT */
+                /* Are we done? Then move on to the next queued packet, or disable the event source for EPOLLOUT */
                 if (s->n_written >= sizeof(s->write_size) + s->write_packet->size) {
+                        DnsPacket *next;
+
+                        next = ordered_set_steal_first(s->write_queue);
+                        if (next) {
+                                dns_packet_unref(s->write_packet);
+                                s->write_packet = next;
+                                s->write_size = htobe16(next->size);
+                                s->n_written = 0;
+                        }
+
                         r = dns_stream_update_io(s);
                         if (r < 0)
                                 return dns_stream_complete(s, -r);
@@ -311,8 +332,21 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
                                 /* If there's a packet handler
                                  * installed, call that. Note that
                                  * this is optional... */
-                                if (s->on_packet)
-                                        return s->on_packet(s);
+                                if (s->on_packet) {
+                                        r = s->on_packet(s);
+                                        if (r < 0)
+                                                return r;
+
+                                        /* If the handler took the packet off us, it wants to read the next one */
+                                        if (s->read_packet || s->fd < 0)
+                                                return 0;
+
+                                        r = dns_stream_update_io(s);
+                                        if (r < 0)
+                                                return dns_stream_complete(s, -r);
+
+                                        return 0;
+                                }
                         }
                 }
         }
@@ -325,6 +359,8 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
 }
 
 DnsStream *dns_stream_unref(DnsStream *s) {
+        DnsPacket *p;
+
         if (!s)
                 return NULL;
 
@@ -344,11 +380,13 @@ DnsStream *dns_stream_unref(DnsStream *s) {
         dns_packet_unref(s->write_packet);
         dns_packet_unref(s->read_packet);
 
+        while ((p = ordered_set_steal_first(s->write_queue)))
+                dns_packet_unref(p);
+        ordered_set_free(s->write_queue);
+
         return mfree(s);
 }
 
-DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStream*, dns_stream_unref);
-
 DnsStream *dns_stream_ref(DnsStream *s) {
         if (!s)
                 return NULL;
@@ -406,14 +444,57 @@ int dns_stream_new(Manager *m, DnsStream **ret, DnsProtocol protocol, int fd) {
 }
 
 int dns_stream_write_packet(DnsStream *s, DnsPacket *p) {
+        int r;
+
         assert(s);
+        assert(p);
 
-        if (s->write_packet)
-                return -EBUSY;
+        if (s->write_packet && s->n_written < sizeof(s->write_size) + s->write_packet->size) {
+                /* Still busy writing the previous packet? Then queue this one after it. */
 
+                r = ordered_set_ensure_allocated(&s->write_queue, NULL);
+                if (r < 0)
+                        return r;
+
+                r = ordered_set_put(s->write_queue, p);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        dns_packet_ref(p);
+
+                dns_stream_reset_timeout(s);
+                return 0;
+        }
+
+        dns_packet_unref(s->write_packet);
         s->write_packet = dns_packet_ref(p);
         s->write_size = htobe16(p->size);
         s->n_written = 0;
 
+        dns_stream_reset_timeout(s);
+
         return dns_stream_update_io(s);
 }
+
+DnsPacket *dns_stream_take_read_packet(DnsStream *s) {
+        DnsPacket *p;
+
+        assert(s);
+
+        /* Returns the packet read completely so far, and resets the read state so that the next one can be read on the
+         * same stream. */
+
+        if (!s->read_packet)
+                return NULL;
+
+        if (s->n_read < sizeof(s->read_size) + s->read_packet->size)
+                return NULL;
+
+        p = s->read_packet;
+        s->read_packet = NULL;
+        s->n_read = 0;
+
+        dns_stream_reset_timeout(s);
+
+        return p;
+}
@@ -20,6 +20,7 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "ordered-set.h"
 #include "socket-util.h"
 
 typedef struct DnsStream DnsStream;
@@ -33,6 +34,10 @@ typedef struct DnsStream DnsStream;
  *   1. The normal transaction logic when doing a DNS or LLMNR lookup via TCP
  *   2. The LLMNR logic when accepting a TCP-based lookup
  *   3. The DNS stub logic when accepting a TCP-based lookup
+ *
+ * LLMNR lookups use one stream per transaction. For unicast DNS the stream is owned by the DnsServer and kept open
+ * for a while, and any number of transactions may have queries outstanding on it at the same time. Replies are
+ * matched to them by ID.
  */
 
 struct DnsStream {
@@ -56,13 +61,19 @@ struct DnsStream {
         be16_t write_size, read_size;
         DnsPacket *write_packet, *read_packet;
         size_t n_written, n_read;
+        OrderedSet *write_queue;
 
         int (*on_packet)(DnsStream *s);
         int (*complete)(DnsStream *s, int error);
 
-        DnsTransaction *transaction; /* when used by the transaction logic */
+        DnsTransaction *transaction; /* when used by the transaction logic for LLMNR */
         DnsQuery *query;             /* when used by the DNS stub logic */
 
+        /* when shared by the transaction logic for unicast DNS */
+        DnsServer *server;
+        unsigned n_replies;
+        LIST_HEAD(DnsTransaction, transactions);
+
         LIST_FIELDS(DnsStream, streams);
 };
 
@@ -70,7 +81,10 @@ int dns_stream_new(Manager *m, DnsStream **s, DnsProtocol protocol, int fd);
 DnsStream *dns_stream_unref(DnsStream *s);
 DnsStream *dns_stream_ref(DnsStream *s);
 
+DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStream*, dns_stream_unref);
+
 int dns_stream_write_packet(DnsStream *s, DnsPacket *p);
+DnsPacket *dns_stream_take_read_packet(DnsStream *s);
 
 static inline bool DNS_STREAM_QUEUED(DnsStream *s) {
         assert(s);
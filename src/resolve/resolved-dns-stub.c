@@ -18,14 +18,277 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "alloc-util.h"
 #include "fd-util.h"
 #include "resolved-dns-stub.h"
 #include "socket-util.h"
+#include "string-util.h"
+#include "unaligned.h"
 
 /* The MTU of the loopback device is 64K on Linux, advertise that as maximum datagram size, but subtract the Ethernet,
  * IP and UDP header sizes */
 #define ADVERTISE_DATAGRAM_SIZE_MAX (65536U-14U-20U-8U)
 
+/* Finished reply packets are kept around for a short while, so that repeated queries for the same name are answered
+ * without going through a full DnsQuery. Keep this short: the scope caches are flushed at various occasions (DNS
+ * server or link configuration changes, ...) which we don't track individually. */
+#define DNS_STUB_REPLY_CACHE_USEC_MAX (5 * USEC_PER_SEC)
+#define DNS_STUB_REPLY_CACHE_MAX 1024U
+
+/* Maximum number of UDP queries processed per wakeup */
+#define DNS_STUB_UDP_BATCH_MAX 32U
+#define DNS_STUB_UDP_RCVBUF_SIZE (4*1024*1024)
+
+typedef struct DnsStubReply {
+        char *key;
+
+        void *data;
+        size_t size;
+
+        /* offsets of the TTL fields of the answer section, patched on each use */
+        size_t *ttl_offsets;
+        unsigned n_ttl_offsets;
+
+        usec_t timestamp;
+        usec_t until;
+} DnsStubReply;
+
+static DnsStubReply *dns_stub_reply_free(DnsStubReply *r) {
+        if (!r)
+                return NULL;
+
+        free(r->key);
+        free(r->data);
+        free(r->ttl_offsets);
+        return mfree(r);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStubReply*, dns_stub_reply_free);
+
+void manager_dns_stub_flush_replies(Manager *m) {
+        DnsStubReply *r;
+
+        assert(m);
+
+        while ((r = hashmap_steal_first(m->dns_stub_replies)))
+                dns_stub_reply_free(r);
+}
+
+static char *dns_stub_reply_key(DnsPacket *p) {
+        char key_str[DNS_RESOURCE_KEY_STRING_MAX];
+
+        assert(p);
+
+        /* The question is copied into the reply as is, hence the name is compared case-sensitively. Whether the
+         * client speaks EDNS0 and whether it asked for DNSSEC data changes the reply too. */
+
+        if (dns_question_size(p->question) != 1)
+                return NULL;
+
+        return strjoin(dns_resource_key_to_string(p->question->keys[0], key_str, sizeof(key_str)),
+                       p->opt ? " opt" : "",
+                       DNS_PACKET_DO(p) ? " do" : "");
+}
+
+static bool dns_stub_reply_cacheable(DnsQuery *q) {
+        DnsQueryCandidate *c;
+
+        assert(q);
+
+        if (!q->manager->enable_cache)
+                return false;
+
+        if (q->answer_protocol != DNS_PROTOCOL_DNS)
+                return false;
+
+        /* Replies assembled from CNAME redirects are built from several queries, don't bother with those */
+        if (q->n_cname_redirects > 0)
+                return false;
+
+        if (!q->candidates)
+                return false;
+
+        /* Only keep replies that were cached by the scopes too: not from local zones, and not from DNS servers on
+         * the local host, which do their own caching */
+        LIST_FOREACH(candidates_by_query, c, q->candidates) {
+                DnsTransaction *t;
+                Iterator i;
+
+                SET_FOREACH(t, c->transactions, i) {
+                        if (t->answer_source == DNS_TRANSACTION_CACHE)
+                                continue;
+                        if (t->answer_source == DNS_TRANSACTION_NETWORK && t->received && DNS_PACKET_SHALL_CACHE(t->received))
+                                continue;
+
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+static void dns_stub_reply_put(DnsQuery *q) {
+        _cleanup_(dns_stub_reply_freep) DnsStubReply *e = NULL;
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        DnsPacket *reply, *p;
+        DnsResourceRecord *rr;
+        uint32_t ttl = UINT32_MAX;
+        usec_t t;
+        unsigned n, i;
+        int r;
+
+        assert(q);
+
+        reply = q->reply_dns_packet;
+        p = q->request_dns_packet;
+
+        if (!dns_stub_reply_cacheable(q))
+                return;
+
+        DNS_ANSWER_FOREACH(rr, q->answer)
+                ttl = MIN(ttl, rr->ttl);
+        if (ttl == 0 || ttl == UINT32_MAX)
+                return;
+
+        n = DNS_PACKET_ANCOUNT(reply);
+        if (n <= 0 || DNS_PACKET_QDCOUNT(reply) != 1)
+                return;
+
+        e = new0(DnsStubReply, 1);
+        if (!e)
+                return;
+
+        e->key = dns_stub_reply_key(p);
+        if (!e->key)
+                return;
+
+        e->ttl_offsets = new(size_t, n);
+        if (!e->ttl_offsets)
+                return;
+
+        /* Find the TTL fields of the answer RRs */
+        dns_packet_rewind(reply, DNS_PACKET_HEADER_SIZE);
+
+        r = dns_packet_read_key(reply, &key, NULL, NULL);
+        if (r < 0)
+                goto finish;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *name = NULL;
+                uint16_t rdlength;
+                uint32_t rr_ttl;
+
+                r = dns_packet_read_name(reply, &name, true, NULL);
+                if (r < 0)
+                        goto finish;
+
+                /* type and class */
+                r = dns_packet_read(reply, 4, NULL, NULL);
+                if (r < 0)
+                        goto finish;
+
+                r = dns_packet_read_uint32(reply, &rr_ttl, &e->ttl_offsets[i]);
+                if (r < 0)
+                        goto finish;
+
+                r = dns_packet_read_uint16(reply, &rdlength, NULL);
+                if (r < 0)
+                        goto finish;
+
+                r = dns_packet_read(reply, rdlength, NULL, NULL);
+                if (r < 0)
+                        goto finish;
+        }
+        e->n_ttl_offsets = n;
+
+        e->data = memdup(DNS_PACKET_DATA(reply), reply->size);
+        if (!e->data)
+                goto finish;
+        e->size = reply->size;
+
+        t = now(clock_boottime_or_monotonic());
+        e->timestamp = t;
+        e->until = t + MIN(ttl * USEC_PER_SEC, DNS_STUB_REPLY_CACHE_USEC_MAX);
+
+        r = hashmap_ensure_allocated(&q->manager->dns_stub_replies, &string_hash_ops);
+        if (r < 0)
+                goto finish;
+
+        /* Entries live only for a few seconds, if we are full simply start over */
+        if (hashmap_size(q->manager->dns_stub_replies) >= DNS_STUB_REPLY_CACHE_MAX)
+                manager_dns_stub_flush_replies(q->manager);
+
+        dns_stub_reply_free(hashmap_remove(q->manager->dns_stub_replies, e->key));
+
+        r = hashmap_put(q->manager->dns_stub_replies, e->key, e);
+        if (r < 0)
+                goto finish;
+
+        e = NULL;
+
+finish:
+        dns_packet_rewind(reply, DNS_PACKET_HEADER_SIZE);
+}
+
+static int dns_stub_reply_get(Manager *m, DnsPacket *p, DnsPacket **ret) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        _cleanup_free_ char *key = NULL;
+        DnsStubReply *e;
+        uint32_t elapsed;
+        usec_t t;
+        unsigned i;
+        int r;
+
+        assert(m);
+        assert(p);
+        assert(ret);
+
+        if (hashmap_isempty(m->dns_stub_replies))
+                return 0;
+
+        key = dns_stub_reply_key(p);
+        if (!key)
+                return 0;
+
+        e = hashmap_get(m->dns_stub_replies, key);
+        if (!e)
+                return 0;
+
+        t = now(clock_boottime_or_monotonic());
+        if (t >= e->until) {
+                hashmap_remove(m->dns_stub_replies, e->key);
+                dns_stub_reply_free(e);
+                return 0;
+        }
+
+        if (e->size > DNS_PACKET_PAYLOAD_SIZE_MAX(p))
+                return 0;
+
+        r = dns_packet_new(&reply, DNS_PROTOCOL_DNS, e->size, DNS_PACKET_SIZE_MAX);
+        if (r < 0)
+                return r;
+
+        r = dns_packet_append_blob(reply, (uint8_t*) e->data + DNS_PACKET_HEADER_SIZE, e->size - DNS_PACKET_HEADER_SIZE, NULL);
+        if (r < 0)
+                return r;
+
+        memcpy(DNS_PACKET_DATA(reply), e->data, DNS_PACKET_HEADER_SIZE);
+        DNS_PACKET_HEADER(reply)->id = DNS_PACKET_ID(p);
+
+        /* The entry never outlives the shortest TTL, hence this never underflows */
+        elapsed = (uint32_t) ((t - e->timestamp) / USEC_PER_SEC);
+        for (i = 0; i < e->n_ttl_offsets; i++) {
+                uint8_t *ttl = DNS_PACKET_DATA(reply) + e->ttl_offsets[i];
+
+                unaligned_write_be32(ttl, unaligned_read_be32(ttl) - elapsed);
+        }
+
+        *ret = reply;
+        reply = NULL;
+
+        return 1;
+}
+
 static int manager_dns_stub_udp_fd(Manager *m);
 static int manager_dns_stub_tcp_fd(Manager *m);
 
@@ -239,6 +502,9 @@ static void dns_stub_query_complete(DnsQuery *q) {
                         break;
                 }
 
+                if (!truncated)
+                        dns_stub_reply_put(q);
+
                 (void) dns_stub_send(q->manager, q->request_dns_stream, q->request_dns_packet, q->reply_dns_packet);
                 break;
         }
@@ -299,6 +565,7 @@ static int dns_stub_stream_complete(DnsStream *s, int error) {
 }
 
 static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
         DnsQuery *q = NULL;
         int r;
 
@@ -353,6 +620,18 @@ static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
                 goto fail;
         }
 
+        r = dns_stub_reply_get(m, p, &reply);
+        if (r < 0)
+                log_debug_errno(r, "Failed to build reply from cached reply packet, ignoring: %m");
+        if (r > 0) {
+                log_debug("Answering from cached reply packet.");
+                (void) dns_stub_send(m, s, p, reply);
+
+                if (s && DNS_STREAM_QUEUED(s))
+                        dns_stub_detach_stream(s);
+                return;
+        }
+
         r = dns_query_new(m, &q, p->question, p->question, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH);
         if (r < 0) {
                 log_error_errno(r, "Failed to generate query object: %m");
@@ -364,6 +643,8 @@ static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
         q->clamp_ttl = true;
 
         q->request_dns_packet = dns_packet_ref(p);
+        m->n_dns_stub_queries++;
+        m->n_dns_stub_queries_max = MAX(m->n_dns_stub_queries_max, m->n_dns_stub_queries);
         q->request_dns_stream = dns_stream_ref(s); /* make sure the stream stays around until we can send a reply through it */
         q->complete = dns_stub_query_complete;
 
@@ -391,20 +672,29 @@ fail:
 }
 
 static int on_dns_stub_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
         Manager *m = userdata;
+        unsigned n;
         int r;
 
-        r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
-        if (r <= 0)
-                return r;
+        /* Clients tend to send their queries in bursts (A and AAAA, several names at once, ...). Handle a couple of
+         * them per wakeup rather than going through the event loop for each. If more are queued we'll be called
+         * again. */
+        for (n = 0; n < DNS_STUB_UDP_BATCH_MAX; n++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
 
-        if (dns_packet_validate_query(p) > 0) {
-                log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+                r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
+                if (IN_SET(r, -EAGAIN, -EINTR)) /* Queue drained */
+                        return 0;
+                if (r <= 0)
+                        return r;
 
-                dns_stub_process_query(m, NULL, p);
-        } else
-                log_debug("Invalid DNS stub UDP packet, ignoring.");
+                if (dns_packet_validate_query(p) > 0) {
+                        log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
+
+                        dns_stub_process_query(m, NULL, p);
+                } else
+                        log_debug("Invalid DNS stub UDP packet, ignoring.");
+        }
 
         return 0;
 }
@@ -435,6 +725,9 @@ static int manager_dns_stub_udp_fd(Manager *m) {
         if (setsockopt(fd, IPPROTO_IP, IP_RECVTTL, &one, sizeof one) < 0)
                 return -errno;
 
+        /* Queries from local clients arrive in bursts, don't drop them while we are busy */
+        (void) fd_inc_rcvbuf(fd, DNS_STUB_UDP_RCVBUF_SIZE);
+
         /* Make sure no traffic from outside the local host can leak to onto this socket */
         if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, "lo", 3) < 0)
                 return -errno;
@@ -595,4 +888,7 @@ void manager_dns_stub_stop(Manager *m) {
 
         m->dns_stub_udp_fd = safe_close(m->dns_stub_udp_fd);
         m->dns_stub_tcp_fd = safe_close(m->dns_stub_tcp_fd);
+
+        manager_dns_stub_flush_replies(m);
+        m->dns_stub_replies = hashmap_free(m->dns_stub_replies);
 }
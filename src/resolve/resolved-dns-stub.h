@@ -26,4 +26,5 @@
 #define INADDR_DNS_STUB ((in_addr_t) 0x7f000035U)
 
 void manager_dns_stub_stop(Manager *m);
+void manager_dns_stub_flush_replies(Manager *m);
 int manager_dns_stub_start(Manager *m);
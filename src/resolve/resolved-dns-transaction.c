@@ -63,10 +63,16 @@ static void dns_transaction_close_connection(DnsTransaction *t) {
         assert(t);
 
         if (t->stream) {
-                /* Let's detach the stream from our transaction, in case something else keeps a reference to it. */
-                t->stream->complete = NULL;
-                t->stream->on_packet = NULL;
-                t->stream->transaction = NULL;
+                if (t->scope->protocol == DNS_PROTOCOL_DNS)
+                        /* Unicast DNS streams are shared with other transactions, only remove ourselves from it */
+                        LIST_REMOVE(transactions_by_stream, t->stream->transactions, t);
+                else {
+                        /* Let's detach the stream from our transaction, in case something else keeps a reference to it. */
+                        t->stream->complete = NULL;
+                        t->stream->on_packet = NULL;
+                        t->stream->transaction = NULL;
+                }
+
                 t->stream = dns_stream_unref(t->stream);
         }
 
@@ -106,12 +112,16 @@ DnsTransaction* dns_transaction_free(DnsTransaction *t) {
                         hashmap_remove(t->scope->manager->dns_transactions, UINT_TO_PTR(t->id));
         }
 
-        while ((c = set_steal_first(t->notify_query_candidates)))
+        while ((c = set_steal_first(t->notify_query_candidates))) {
                 set_remove(c->transactions, t);
+                set_remove(c->prefetch_transactions, t);
+        }
         set_free(t->notify_query_candidates);
 
-        while ((c = set_steal_first(t->notify_query_candidates_done)))
+        while ((c = set_steal_first(t->notify_query_candidates_done))) {
                 set_remove(c->transactions, t);
+                set_remove(c->prefetch_transactions, t);
+        }
         set_free(t->notify_query_candidates_done);
 
         while ((i = set_steal_first(t->notify_zone_items)))
@@ -359,7 +369,10 @@ void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         t->block_gc++;
 
         SET_FOREACH_MOVE(c, t->notify_query_candidates_done, t->notify_query_candidates)
-                dns_query_candidate_notify(c);
+                /* Candidates also keep transactions for search domains they didn't get to yet, only wake them up
+                 * for the ones they are currently waiting for. */
+                if (set_contains(c->transactions, t))
+                        dns_query_candidate_notify(c);
         SWAP_TWO(t->notify_query_candidates, t->notify_query_candidates_done);
 
         SET_FOREACH_MOVE(z, t->notify_zone_items_done, t->notify_zone_items)
@@ -460,6 +473,35 @@ static int dns_transaction_maybe_restart(DnsTransaction *t) {
         return 1;
 }
 
+static int dns_transaction_on_stream_packet(DnsTransaction *t, DnsPacket *p) {
+        assert(t);
+        assert(p);
+
+        dns_transaction_close_connection(t);
+
+        if (dns_packet_validate_reply(p) <= 0) {
+                log_debug("Invalid TCP reply packet.");
+                dns_transaction_complete(t, DNS_TRANSACTION_INVALID_REPLY);
+                return 0;
+        }
+
+        dns_scope_check_conflicts(t->scope, p);
+
+        t->block_gc++;
+        dns_transaction_process_reply(t, p);
+        t->block_gc--;
+
+        /* If the response wasn't useful, then complete the transition
+         * now. After all, we are the worst feature set now with TCP
+         * sockets, and there's really no point in retrying. */
+        if (t->state == DNS_TRANSACTION_PENDING)
+                dns_transaction_complete(t, DNS_TRANSACTION_INVALID_REPLY);
+        else
+                dns_transaction_gc(t);
+
+        return 0;
+}
+
 static int on_stream_complete(DnsStream *s, int error) {
         _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
         DnsTransaction *t;
@@ -497,30 +539,74 @@ static int on_stream_complete(DnsStream *s, int error) {
                 return 0;
         }
 
-        if (dns_packet_validate_reply(p) <= 0) {
-                log_debug("Invalid TCP reply packet.");
-                dns_transaction_complete(t, DNS_TRANSACTION_INVALID_REPLY);
+        return dns_transaction_on_stream_packet(t, p);
+}
+
+static int on_server_stream_packet(DnsStream *s) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        DnsTransaction *t;
+
+        assert(s);
+
+        p = dns_stream_take_read_packet(s);
+        assert(p);
+
+        s->n_replies++;
+
+        /* Several queries may be outstanding on this stream, find the one this is the reply to */
+        t = hashmap_get(s->manager->dns_transactions, UINT_TO_PTR(DNS_PACKET_ID(p)));
+        if (!t || t->stream != s) {
+                log_debug("Received TCP reply packet with unexpected ID %" PRIu16 ", ignoring.", DNS_PACKET_ID(p));
                 return 0;
         }
 
-        dns_scope_check_conflicts(t->scope, p);
+        return dns_transaction_on_stream_packet(t, p);
+}
 
-        t->block_gc++;
-        dns_transaction_process_reply(t, p);
-        t->block_gc--;
+static int on_server_stream_complete(DnsStream *s, int error) {
+        _cleanup_(dns_stream_unrefp) DnsStream *ref = NULL;
+        DnsTransaction *t;
 
-        /* If the response wasn't useful, then complete the transition
-         * now. After all, we are the worst feature set now with TCP
-         * sockets, and there's really no point in retrying. */
-        if (t->state == DNS_TRANSACTION_PENDING)
-                dns_transaction_complete(t, DNS_TRANSACTION_INVALID_REPLY);
-        else
-                dns_transaction_gc(t);
+        assert(s);
+
+        ref = dns_stream_ref(s);
+
+        /* The connection is gone, make sure no new transactions are queued on it */
+        if (s->server && s->server->stream == s)
+                dns_server_unref_stream(s->server);
+
+        if (error != 0 && s->transactions)
+                log_debug_errno(error, "Connection failure for DNS TCP stream: %m");
+
+        while ((t = s->transactions)) {
+                dns_transaction_close_connection(t);
+
+                if (ERRNO_IS_DISCONNECT(error)) {
+                        usec_t usec;
+
+                        if (s->n_replies > 0) {
+                                /* We already used this connection successfully before. Servers close idle
+                                 * connections whenever they like, don't hold that against it, and reconnect. */
+                                dns_transaction_retry(t, false);
+                                continue;
+                        }
+
+                        assert_se(sd_event_now(t->scope->manager->event, clock_boottime_or_monotonic(), &usec) >= 0);
+                        dns_server_packet_lost(t->server, IPPROTO_TCP, t->current_feature_level, usec - t->start_usec);
+
+                        dns_transaction_retry(t, true);
+                        continue;
+                }
+
+                t->answer_errno = error != 0 ? error : ECONNRESET;
+                dns_transaction_complete(t, DNS_TRANSACTION_ERRNO);
+        }
 
         return 0;
 }
 
 static int dns_transaction_open_tcp(DnsTransaction *t) {
+        _cleanup_(dns_stream_unrefp) DnsStream *s = NULL;
         _cleanup_close_ int fd = -1;
         int r;
 
@@ -542,7 +628,11 @@ static int dns_transaction_open_tcp(DnsTransaction *t) {
                 if (r < 0)
                         return r;
 
-                fd = dns_scope_socket_tcp(t->scope, AF_UNSPEC, NULL, t->server, 53);
+                /* If there's already a connection to this server, queue our query on it */
+                if (t->server->stream)
+                        s = dns_stream_ref(t->server->stream);
+                else
+                        fd = dns_scope_socket_tcp(t->scope, AF_UNSPEC, NULL, t->server, 53);
                 break;
 
         case DNS_PROTOCOL_LLMNR:
@@ -574,27 +664,41 @@ static int dns_transaction_open_tcp(DnsTransaction *t) {
                 return -EAFNOSUPPORT;
         }
 
-        if (fd < 0)
-                return fd;
+        if (!s) {
+                if (fd < 0)
+                        return fd;
 
-        r = dns_stream_new(t->scope->manager, &t->stream, t->scope->protocol, fd);
+                r = dns_stream_new(t->scope->manager, &s, t->scope->protocol, fd);
+                if (r < 0)
+                        return r;
+                fd = -1;
+
+                /* The interface index is difficult to determine if we are
+                 * connecting to the local host, hence fill this in right away
+                 * instead of determining it from the socket */
+                s->ifindex = dns_scope_ifindex(t->scope);
+
+                if (t->scope->protocol == DNS_PROTOCOL_DNS) {
+                        s->on_packet = on_server_stream_packet;
+                        s->complete = on_server_stream_complete;
+                        s->server = t->server;
+                        t->server->stream = dns_stream_ref(s);
+                }
+        }
+
+        r = dns_stream_write_packet(s, t->sent);
         if (r < 0)
                 return r;
-        fd = -1;
 
-        r = dns_stream_write_packet(t->stream, t->sent);
-        if (r < 0) {
-                t->stream = dns_stream_unref(t->stream);
-                return r;
+        if (t->scope->protocol == DNS_PROTOCOL_DNS)
+                LIST_PREPEND(transactions_by_stream, s->transactions, t);
+        else {
+                s->complete = on_stream_complete;
+                s->transaction = t;
         }
 
-        t->stream->complete = on_stream_complete;
-        t->stream->transaction = t;
-
-        /* The interface index is difficult to determine if we are
-         * connecting to the local host, hence fill this in right away
-         * instead of determining it from the socket */
-        t->stream->ifindex = dns_scope_ifindex(t->scope);
+        t->stream = s;
+        s = NULL;
 
         dns_transaction_reset_answer(t);
 
@@ -705,7 +809,14 @@ fail:
         return 0;
 }
 
+static void dns_transaction_record_phase(DnsTransaction *t, DnsTransactionPhase phase, usec_t usec) {
+        assert(t);
+
+        dns_latency_histogram_record(&t->scope->manager->transaction_phase_latency[phase], usec);
+}
+
 static void dns_transaction_process_dnssec(DnsTransaction *t) {
+        usec_t validate_start;
         int r;
 
         assert(t);
@@ -717,6 +828,11 @@ static void dns_transaction_process_dnssec(DnsTransaction *t) {
         if (r == 0) /* We aren't ready yet (or one of our auxiliary transactions failed, and we shouldn't validate now */
                 return;
 
+        if (t->dnssec_keys_usec > 0) {
+                dns_transaction_record_phase(t, DNS_TRANSACTION_PHASE_DNSSEC_KEYS, now(clock_boottime_or_monotonic()) - t->dnssec_keys_usec);
+                t->dnssec_keys_usec = 0;
+        }
+
         /* See if we learnt things from the additional DNSSEC transactions, that we didn't know before, and better
          * restart the lookup immediately. */
         r = dns_transaction_maybe_restart(t);
@@ -727,7 +843,9 @@ static void dns_transaction_process_dnssec(DnsTransaction *t) {
 
         /* All our auxiliary DNSSEC transactions are complete now. Try
          * to validate our RRset now. */
+        validate_start = now(CLOCK_MONOTONIC);
         r = dns_transaction_validate_dnssec(t);
+        dns_transaction_record_phase(t, DNS_TRANSACTION_PHASE_DNSSEC_VALIDATE, now(CLOCK_MONOTONIC) - validate_start);
         if (r == -EBADMSG) {
                 dns_transaction_complete(t, DNS_TRANSACTION_INVALID_REPLY);
                 return;
@@ -1011,6 +1129,7 @@ void dns_transaction_process_reply(DnsTransaction *t, DnsPacket *p) {
 
                 /* Report that we successfully received a packet */
                 dns_server_packet_received(t->server, p->ipproto, t->current_feature_level, ts - t->start_usec, p->size);
+                dns_transaction_record_phase(t, DNS_TRANSACTION_PHASE_UPSTREAM, ts - t->start_usec);
         }
 
         /* See if we know things we didn't know before that indicate we better restart the lookup immediately. */
@@ -1068,6 +1187,7 @@ void dns_transaction_process_reply(DnsTransaction *t, DnsPacket *p) {
                 if (r > 0) {
                         /* There are DNSSEC transactions pending now. Update the state accordingly. */
                         t->state = DNS_TRANSACTION_VALIDATING;
+                        t->dnssec_keys_usec = now(clock_boottime_or_monotonic());
                         dns_transaction_close_connection(t);
                         dns_transaction_stop_timeout(t);
                         return;
@@ -1279,6 +1399,7 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
 
         dns_transaction_reset_answer(t);
         dns_transaction_flush_dnssec_transactions(t);
+        t->dnssec_keys_usec = 0;
 
         /* Check the trust anchor. Do so only on classic DNS, since DNSSEC does not apply otherwise. */
         if (t->scope->protocol == DNS_PROTOCOL_DNS) {
@@ -1347,6 +1468,7 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         /* Check the cache, but only if this transaction is not used
          * for probing or verifying a zone item. */
         if (set_isempty(t->notify_zone_items)) {
+                usec_t cache_start;
 
                 /* Before trying the cache, let's make sure we figured out a
                  * server to use. Should this cause a change of server this
@@ -1356,7 +1478,9 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
                 /* Let's then prune all outdated entries */
                 dns_cache_prune(&t->scope->cache);
 
+                cache_start = now(CLOCK_MONOTONIC);
                 r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, &t->answer_rcode, &t->answer, &t->answer_authenticated);
+                dns_transaction_record_phase(t, DNS_TRANSACTION_PHASE_CACHE, now(CLOCK_MONOTONIC) - cache_start);
                 if (r < 0)
                         return r;
                 if (r > 0) {
@@ -1374,11 +1498,11 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
 
 static int dns_transaction_make_packet_mdns(DnsTransaction *t) {
 
+        _cleanup_(dns_question_unrefp) DnsQuestion *known_answer_keys = NULL;
         _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
-        bool add_known_answers = false;
         DnsTransaction *other;
-        unsigned qdcount;
-        usec_t ts;
+        unsigned qdcount, n = 1;
+        usec_t ts, nw;
         int r;
 
         assert(t);
@@ -1397,8 +1521,20 @@ static int dns_transaction_make_packet_mdns(DnsTransaction *t) {
 
         qdcount = 1;
 
-        if (dns_key_is_shared(t->key))
-                add_known_answers = true;
+        /* Collect the shared keys we ask for, so that the known answer section can be built from the cache
+         * entries of exactly these keys. */
+        LIST_FOREACH(transactions_by_scope, other, t->scope->transactions)
+                n++;
+
+        known_answer_keys = dns_question_new(n);
+        if (!known_answer_keys)
+                return -ENOMEM;
+
+        if (dns_key_is_shared(t->key)) {
+                r = dns_question_add(known_answer_keys, t->key);
+                if (r < 0)
+                        return r;
+        }
 
         /*
          * For mDNS, we want to coalesce as many open queries in pending transactions into one single
@@ -1406,7 +1542,8 @@ static int dns_transaction_make_packet_mdns(DnsTransaction *t) {
          * in our current scope, and see whether their timing contraints allow them to be sent.
          */
 
-        assert_se(sd_event_now(t->scope->manager->event, clock_boottime_or_monotonic(), &ts) >= 0);
+        assert_se(sd_event_now(t->scope->manager->event, clock_boottime_or_monotonic(), &nw) >= 0);
+        ts = nw;
 
         LIST_FOREACH(transactions_by_scope, other, t->scope->transactions) {
 
@@ -1457,15 +1594,18 @@ static int dns_transaction_make_packet_mdns(DnsTransaction *t) {
 
                 qdcount++;
 
-                if (dns_key_is_shared(other->key))
-                        add_known_answers = true;
+                if (dns_key_is_shared(other->key)) {
+                        r = dns_question_add(known_answer_keys, other->key);
+                        if (r < 0)
+                                return r;
+                }
         }
 
         DNS_PACKET_HEADER(p)->qdcount = htobe16(qdcount);
 
         /* Append known answer section if we're asking for any shared record */
-        if (add_known_answers) {
-                r = dns_cache_export_shared_to_packet(&t->scope->cache, p);
+        if (dns_question_size(known_answer_keys) > 0) {
+                r = dns_cache_export_shared_to_packet(&t->scope->cache, known_answer_keys, nw, p);
                 if (r < 0)
                         return r;
         }
@@ -3146,3 +3286,11 @@ static const char* const dns_transaction_source_table[_DNS_TRANSACTION_SOURCE_MA
         [DNS_TRANSACTION_TRUST_ANCHOR] = "trust-anchor",
 };
 DEFINE_STRING_TABLE_LOOKUP(dns_transaction_source, DnsTransactionSource);
+
+static const char* const dns_transaction_phase_table[_DNS_TRANSACTION_PHASE_MAX] = {
+        [DNS_TRANSACTION_PHASE_CACHE] = "cache",
+        [DNS_TRANSACTION_PHASE_UPSTREAM] = "upstream",
+        [DNS_TRANSACTION_PHASE_DNSSEC_KEYS] = "dnssec-keys",
+        [DNS_TRANSACTION_PHASE_DNSSEC_VALIDATE] = "dnssec-validate",
+};
+DEFINE_STRING_TABLE_LOOKUP(dns_transaction_phase, DnsTransactionPhase);
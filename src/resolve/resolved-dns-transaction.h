@@ -23,6 +23,7 @@
 typedef struct DnsTransaction DnsTransaction;
 typedef enum DnsTransactionState DnsTransactionState;
 typedef enum DnsTransactionSource DnsTransactionSource;
+typedef enum DnsTransactionPhase DnsTransactionPhase;
 
 enum DnsTransactionState {
         DNS_TRANSACTION_NULL,
@@ -56,6 +57,16 @@ enum DnsTransactionSource {
         _DNS_TRANSACTION_SOURCE_INVALID = -1
 };
 
+/* The parts of a transaction's lifetime we keep latency histograms for */
+enum DnsTransactionPhase {
+        DNS_TRANSACTION_PHASE_CACHE,            /* cache lookup */
+        DNS_TRANSACTION_PHASE_UPSTREAM,         /* waiting for the reply of a DNS server */
+        DNS_TRANSACTION_PHASE_DNSSEC_KEYS,      /* waiting for the auxiliary DS/DNSKEY/SOA transactions */
+        DNS_TRANSACTION_PHASE_DNSSEC_VALIDATE,  /* validating the RRsets */
+        _DNS_TRANSACTION_PHASE_MAX,
+        _DNS_TRANSACTION_PHASE_INVALID = -1
+};
+
 #include "resolved-dns-answer.h"
 #include "resolved-dns-packet.h"
 #include "resolved-dns-question.h"
@@ -106,6 +117,9 @@ struct DnsTransaction {
 
         usec_t start_usec;
         usec_t next_attempt_after;
+
+        /* When we started waiting for auxiliary DNSSEC transactions, or 0 */
+        usec_t dnssec_keys_usec;
         sd_event_source *timeout_event_source;
         unsigned n_attempts;
 
@@ -147,6 +161,7 @@ struct DnsTransaction {
         unsigned block_gc;
 
         LIST_FIELDS(DnsTransaction, transactions_by_scope);
+        LIST_FIELDS(DnsTransaction, transactions_by_stream);
 };
 
 int dns_transaction_new(DnsTransaction **ret, DnsScope *s, DnsResourceKey *key);
@@ -168,6 +183,9 @@ DnsTransactionState dns_transaction_state_from_string(const char *s) _pure_;
 const char* dns_transaction_source_to_string(DnsTransactionSource p) _const_;
 DnsTransactionSource dns_transaction_source_from_string(const char *s) _pure_;
 
+const char* dns_transaction_phase_to_string(DnsTransactionPhase p) _const_;
+DnsTransactionPhase dns_transaction_phase_from_string(const char *s) _pure_;
+
 /* LLMNR Jitter interval, see RFC 4795 Section 7 */
 #define LLMNR_JITTER_INTERVAL_USEC (100 * USEC_PER_MSEC)
 
@@ -34,34 +34,43 @@ typedef struct EtcHostsItem {
         int family;
         union in_addr_union address;
 
+        /* NULL terminated, the strings are owned by EtcHosts.names */
         char **names;
+        size_t n_names, n_allocated;
 } EtcHostsItem;
 
 typedef struct EtcHostsItemByName {
-        char *name;
+        const char *name;
 
         EtcHostsItem **items;
         size_t n_items, n_allocated;
 } EtcHostsItemByName;
 
-void manager_etc_hosts_flush(Manager *m) {
+static void etc_hosts_free(EtcHosts *hosts) {
         EtcHostsItem *item;
         EtcHostsItemByName *bn;
 
-        while ((item = set_steal_first(m->etc_hosts_by_address))) {
-                strv_free(item->names);
+        assert(hosts);
+
+        while ((item = set_steal_first(hosts->by_address))) {
+                free(item->names);
                 free(item);
         }
 
-        while ((bn = hashmap_steal_first(m->etc_hosts_by_name))) {
-                free(bn->name);
+        while ((bn = hashmap_steal_first(hosts->by_name))) {
                 free(bn->items);
                 free(bn);
         }
 
-        m->etc_hosts_by_address = set_free(m->etc_hosts_by_address);
-        m->etc_hosts_by_name = hashmap_free(m->etc_hosts_by_name);
+        hosts->by_address = set_free(hosts->by_address);
+        hosts->by_name = hashmap_free(hosts->by_name);
+
+        hosts->names = mfree(hosts->names);
+        hosts->names_size = hosts->names_allocated = 0;
+}
 
+void manager_etc_hosts_flush(Manager *m) {
+        etc_hosts_free(&m->etc_hosts);
         m->etc_hosts_mtime = USEC_INFINITY;
 }
 
@@ -96,7 +105,52 @@ static const struct hash_ops etc_hosts_item_ops = {
         .compare = etc_hosts_item_compare_func,
 };
 
-static int add_item(Manager *m, int family, const union in_addr_union *address, char **names) {
+static int etc_hosts_find_name(EtcHosts *hosts, const char *name, EtcHostsItemByName **ret) {
+        EtcHostsItemByName *bn;
+        size_t l;
+        int r;
+
+        assert(hosts);
+        assert(name);
+        assert(ret);
+
+        /* Looks up the entry for the specified name, and creates it if necessary, with a copy of the name in the
+         * names buffer. The buffer is sized to the whole file up front, so that names never move while we still
+         * have pointers to them. */
+
+        bn = hashmap_get(hosts->by_name, name);
+        if (bn) {
+                *ret = bn;
+                return 0;
+        }
+
+        l = strlen(name) + 1;
+        if (l > hosts->names_allocated - hosts->names_size)
+                return -EFBIG; /* The file grew since we looked at its size */
+
+        r = hashmap_ensure_allocated(&hosts->by_name, &dns_name_hash_ops);
+        if (r < 0)
+                return log_oom();
+
+        bn = new0(EtcHostsItemByName, 1);
+        if (!bn)
+                return log_oom();
+
+        bn->name = memcpy(hosts->names + hosts->names_size, name, l);
+
+        r = hashmap_put(hosts->by_name, bn->name, bn);
+        if (r < 0) {
+                free(bn);
+                return log_oom();
+        }
+
+        hosts->names_size += l;
+
+        *ret = bn;
+        return 1;
+}
+
+static int add_item(EtcHosts *hosts, int family, const union in_addr_union *address, char **names) {
 
         EtcHostsItem key = {
                 .family = family,
@@ -106,7 +160,7 @@ static int add_item(Manager *m, int family, const union in_addr_union *address,
         char **n;
         int r;
 
-        assert(m);
+        assert(hosts);
         assert(address);
 
         r = in_addr_is_null(family, address);
@@ -119,14 +173,9 @@ static int add_item(Manager *m, int family, const union in_addr_union *address,
         else {
                 /* If this is a normal address, then, simply add entry mapping it to the specified names */
 
-                item = set_get(m->etc_hosts_by_address, &key);
-                if (item) {
-                        r = strv_extend_strv(&item->names, names, true);
-                        if (r < 0)
-                                return log_oom();
-                } else {
-
-                        r = set_ensure_allocated(&m->etc_hosts_by_address, &etc_hosts_item_ops);
+                item = set_get(hosts->by_address, &key);
+                if (!item) {
+                        r = set_ensure_allocated(&hosts->by_address, &etc_hosts_item_ops);
                         if (r < 0)
                                 return log_oom();
 
@@ -136,9 +185,8 @@ static int add_item(Manager *m, int family, const union in_addr_union *address,
 
                         item->family = family;
                         item->address = *address;
-                        item->names = names;
 
-                        r = set_put(m->etc_hosts_by_address, item);
+                        r = set_put(hosts->by_address, item);
                         if (r < 0) {
                                 free(item);
                                 return log_oom();
@@ -148,50 +196,45 @@ static int add_item(Manager *m, int family, const union in_addr_union *address,
 
         STRV_FOREACH(n, names) {
                 EtcHostsItemByName *bn;
+                size_t i;
 
-                bn = hashmap_get(m->etc_hosts_by_name, *n);
-                if (!bn) {
-                        r = hashmap_ensure_allocated(&m->etc_hosts_by_name, &dns_name_hash_ops);
-                        if (r < 0)
-                                return log_oom();
+                r = etc_hosts_find_name(hosts, *n, &bn);
+                if (r < 0)
+                        return r;
 
-                        bn = new0(EtcHostsItemByName, 1);
-                        if (!bn)
-                                return log_oom();
+                if (!item)
+                        continue;
 
-                        bn->name = strdup(*n);
-                        if (!bn->name) {
-                                free(bn);
-                                return log_oom();
-                        }
+                if (!GREEDY_REALLOC(bn->items, bn->n_allocated, bn->n_items+1))
+                        return log_oom();
 
-                        r = hashmap_put(m->etc_hosts_by_name, bn->name, bn);
-                        if (r < 0) {
-                                free(bn->name);
-                                free(bn);
-                                return log_oom();
-                        }
-                }
+                bn->items[bn->n_items++] = item;
 
-                if (item) {
-                        if (!GREEDY_REALLOC(bn->items, bn->n_allocated, bn->n_items+1))
-                                return log_oom();
+                /* Names are stored only once, hence comparing the pointers is enough to suppress duplicates */
+                for (i = 0; i < item->n_names; i++)
+                        if (item->names[i] == bn->name)
+                                break;
+                if (i < item->n_names)
+                        continue;
 
-                        bn->items[bn->n_items++] = item;
-                }
+                if (!GREEDY_REALLOC(item->names, item->n_allocated, item->n_names+2))
+                        return log_oom();
+
+                item->names[item->n_names++] = (char*) bn->name;
+                item->names[item->n_names] = NULL;
         }
 
         return 0;
 }
 
-static int parse_line(Manager *m, unsigned nr, const char *line) {
+static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
         _cleanup_free_ char *address = NULL;
         _cleanup_strv_free_ char **names = NULL;
         union in_addr_union in;
         bool suppressed = false;
         int family, r;
 
-        assert(m);
+        assert(hosts);
         assert(line);
 
         r = extract_first_word(&line, &address, NULL, EXTRACT_RELAX);
@@ -241,16 +284,11 @@ static int parse_line(Manager *m, unsigned nr, const char *line) {
                 return -EINVAL;
         }
 
-        /* Takes possession of the names strv */
-        r = add_item(m, family, &in, names);
-        if (r < 0)
-                return r;
-
-        names = NULL;
-        return r;
+        return add_item(hosts, family, &in, names);
 }
 
 int manager_etc_hosts_read(Manager *m) {
+        _cleanup_(etc_hosts_free) EtcHosts hosts = {};
         _cleanup_fclose_ FILE *f = NULL;
         char line[LINE_MAX];
         struct stat st;
@@ -297,8 +335,13 @@ int manager_etc_hosts_read(Manager *m) {
         if (r < 0)
                 return log_error_errno(errno, "Failed to fstat() /etc/hosts: %m");
 
-        manager_etc_hosts_flush(m);
+        /* No name can be longer than the file, so this is all the space we'll ever need for the names */
+        hosts.names_allocated = st.st_size + 1;
+        hosts.names = malloc(hosts.names_allocated);
+        if (!hosts.names)
+                return log_oom();
 
+        /* Build the new tables on the side, the old ones stay in place (and are used for lookups) if we fail. */
         FOREACH_LINE(line, f, return log_error_errno(errno, "Failed to read /etc/hosts: %m")) {
                 char *l;
 
@@ -310,11 +353,17 @@ int manager_etc_hosts_read(Manager *m) {
                 if (l[0] == '#')
                         continue;
 
-                r = parse_line(m, nr, l);
-                if (r == -ENOMEM) /* On OOM we abandon the half-built-up structure. All other errors we ignore and proceed */
-                        goto clear;
+                r = parse_line(&hosts, nr, l);
+                if (r == -ENOMEM) /* On OOM we abandon the half-built-up structure, and keep the old one. All other errors we ignore and proceed */
+                        return r;
+                if (r == -EFBIG)
+                        return log_debug_errno(r, "/etc/hosts changed while we read it, trying again later.");
         }
 
+        etc_hosts_free(&m->etc_hosts);
+        m->etc_hosts = hosts;
+        hosts = (EtcHosts) {};
+
         m->etc_hosts_mtime = timespec_load(&st.st_mtim);
         m->etc_hosts_last = ts;
 
@@ -351,7 +400,7 @@ int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
                 EtcHostsItem *item;
                 DnsResourceKey *found_ptr = NULL;
 
-                item = set_get(m->etc_hosts_by_address, &k);
+                item = set_get(m->etc_hosts.by_address, &k);
                 if (!item)
                         return 0;
 
@@ -400,7 +449,7 @@ int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
                 return 1;
         }
 
-        bn = hashmap_get(m->etc_hosts_by_name, name);
+        bn = hashmap_get(m->etc_hosts.by_name, name);
         if (!bn)
                 return 0;
 
@@ -20,6 +20,18 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "hashmap.h"
+#include "set.h"
+
+typedef struct EtcHosts {
+        Set *by_address;
+        Hashmap *by_name;
+
+        /* All host names, each stored once, back to back */
+        char *names;
+        size_t names_size, names_allocated;
+} EtcHosts;
+
 #include "resolved-manager.h"
 #include "resolved-dns-question.h"
 #include "resolved-dns-answer.h"
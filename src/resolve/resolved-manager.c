@@ -34,6 +34,7 @@
 #include "fileio-label.h"
 #include "hostname-util.h"
 #include "io-util.h"
+#include "mempool.h"
 #include "netlink-util.h"
 #include "network-internal.h"
 #include "ordered-set.h"
@@ -41,6 +42,7 @@
 #include "random-util.h"
 #include "resolved-bus.h"
 #include "resolved-conf.h"
+#include "resolved-dns-dnssec.h"
 #include "resolved-dns-stub.h"
 #include "resolved-etc-hosts.h"
 #include "resolved-llmnr.h"
@@ -545,6 +547,8 @@ static int manager_sigusr1(sd_event_source *s, const struct signalfd_siginfo *si
                 LIST_FOREACH(servers, server, l->dns_servers)
                         dns_server_dump(server, f);
 
+        mempool_dump_all(f);
+
         if (fflush_and_check(f) < 0)
                 return log_oom();
 
@@ -595,6 +599,7 @@ int manager_new(Manager **ret) {
         m->mdns_support = RESOLVE_SUPPORT_YES;
         m->dnssec_mode = DEFAULT_DNSSEC_MODE;
         m->enable_cache = true;
+        m->cache_size = DNS_CACHE_SIZE_DEFAULT;
         m->dns_stub_listener_mode = DNS_STUB_LISTENER_UDP;
         m->read_resolv_conf = true;
         m->need_builtin_fallbacks = true;
@@ -721,6 +726,7 @@ Manager *manager_free(Manager *m) {
 
         dns_trust_anchor_flush(&m->trust_anchor);
         manager_etc_hosts_flush(m);
+        dnssec_verify_cache_flush();
 
         return mfree(m);
 }
@@ -1418,6 +1424,8 @@ void manager_flush_caches(Manager *m) {
         LIST_FOREACH(scopes, scope, m->dns_scopes)
                 dns_cache_flush(&scope->cache);
 
+        manager_dns_stub_flush_replies(m);
+
         log_info("Flushed all caches.");
 }
 
@@ -37,6 +37,7 @@ typedef struct Manager Manager;
 #include "resolved-dns-server.h"
 #include "resolved-dns-stream.h"
 #include "resolved-dns-trust-anchor.h"
+#include "resolved-etc-hosts.h"
 #include "resolved-link.h"
 
 #define MANAGER_SEARCH_DOMAINS_MAX 32
@@ -49,6 +50,7 @@ struct Manager {
         ResolveSupport mdns_support;
         DnssecMode dnssec_mode;
         bool enable_cache;
+        unsigned cache_size;
         DnsStubListenerMode dns_stub_listener_mode;
 
         /* Network */
@@ -65,6 +67,9 @@ struct Manager {
         LIST_HEAD(DnsQuery, dns_queries);
         unsigned n_dns_queries;
 
+        /* Queries received on the stub listener that are still being processed */
+        unsigned n_dns_stub_queries, n_dns_stub_queries_max;
+
         LIST_HEAD(DnsStream, dns_streams);
         unsigned n_dns_streams;
 
@@ -131,10 +136,10 @@ struct Manager {
 
         unsigned n_transactions_total;
         unsigned n_dnssec_verdict[_DNSSEC_VERDICT_MAX];
+        DnsLatencyHistogram transaction_phase_latency[_DNS_TRANSACTION_PHASE_MAX];
 
         /* Data from /etc/hosts */
-        Set* etc_hosts_by_address;
-        Hashmap* etc_hosts_by_name;
+        EtcHosts etc_hosts;
         usec_t etc_hosts_last, etc_hosts_mtime;
 
         /* Local DNS stub on 127.0.0.53:53 */
@@ -143,6 +148,9 @@ struct Manager {
 
         sd_event_source *dns_stub_udp_event_source;
         sd_event_source *dns_stub_tcp_event_source;
+
+        /* Recently sent stub replies, by question */
+        Hashmap *dns_stub_replies;
 };
 
 /* Manager */
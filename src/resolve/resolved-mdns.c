@@ -23,6 +23,7 @@
 #include <arpa/inet.h>
 
 #include "fd-util.h"
+#include "random-util.h"
 #include "resolved-manager.h"
 #include "resolved-mdns.h"
 
@@ -68,11 +69,111 @@ eaddrinuse:
         return 0;
 }
 
-static int mdns_scope_process_query(DnsScope *s, DnsPacket *p) {
-        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL, *soa = NULL;
+/* Drops all RRs from *answer that are also listed in 'known' with at least half of our TTL, see RFC 6762,
+ * sections 7.1 and 7.4. */
+static int mdns_answer_suppress_known(DnsAnswer **answer, DnsAnswer *known) {
+        DnsResourceRecord *rr;
+        int r;
+
+        assert(answer);
+
+        DNS_ANSWER_FOREACH(rr, known) {
+                DnsResourceRecord *ours;
+
+                DNS_ANSWER_FOREACH(ours, *answer) {
+                        r = dns_resource_record_equal(ours, rr);
+                        if (r < 0)
+                                return r;
+                        if (r == 0)
+                                continue;
+
+                        if ((uint64_t) rr->ttl * 2 >= ours->ttl) {
+                                r = dns_answer_remove_by_rr(answer, rr);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        break;
+                }
+        }
+
+        return 0;
+}
+
+static int mdns_scope_send_answer(DnsScope *s, uint16_t id, DnsAnswer *answer) {
         _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        int r;
+
+        assert(s);
+
+        if (dns_answer_isempty(answer))
+                return 0;
+
+        r = dns_scope_make_reply_packet(s, id, DNS_RCODE_SUCCESS, NULL, answer, NULL, false, &reply);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to build reply packet: %m");
+
+        if (!ratelimit_test(&s->ratelimit))
+                return 0;
+
+        r = dns_scope_emit_udp(s, -1, reply);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to send reply packet: %m");
+
+        return 0;
+}
+
+static int on_mdns_response_timeout(sd_event_source *es, usec_t usec, void *userdata) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        DnsScope *s = userdata;
+
+        assert(s);
+
+        s->mdns_response_event_source = sd_event_source_unref(s->mdns_response_event_source);
+
+        answer = s->mdns_pending_answer;
+        s->mdns_pending_answer = NULL;
+
+        (void) mdns_scope_send_answer(s, 0, answer);
+        return 0;
+}
+
+static int mdns_scope_queue_answer(DnsScope *s, DnsAnswer *answer) {
+        uint64_t jitter;
+        int r;
+
+        assert(s);
+
+        r = dns_answer_extend(&s->mdns_pending_answer, answer);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to queue answer: %m");
+
+        if (s->mdns_response_event_source)
+                return 0;
+
+        /* RFC 6762, section 6: responses to shared questions are delayed by 20-120ms, which lets us answer
+         * all queries for them that arrive in the meantime with a single packet. */
+        random_bytes(&jitter, sizeof(jitter));
+        jitter %= MDNS_JITTER_RANGE_USEC;
+
+        r = sd_event_add_time(s->manager->event,
+                              &s->mdns_response_event_source,
+                              clock_boottime_or_monotonic(),
+                              now(clock_boottime_or_monotonic()) + MDNS_JITTER_MIN_USEC + jitter,
+                              0,
+                              on_mdns_response_timeout, s);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to add mDNS response event: %m");
+
+        (void) sd_event_source_set_description(s->mdns_response_event_source, "mdns-response");
+
+        return 0;
+}
+
+static int mdns_scope_process_query(DnsScope *s, DnsPacket *p) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *full_answer = NULL;
         DnsResourceKey *key = NULL;
-        bool tentative = false;
+        bool shared = true;
         int r;
 
         assert(s);
@@ -82,28 +183,48 @@ static int mdns_scope_process_query(DnsScope *s, DnsPacket *p) {
         if (r < 0)
                 return log_debug_errno(r, "Failed to extract resource records from incoming packet: %m");
 
-        /* TODO: there might be more than one question in mDNS queries. */
         assert_return((dns_question_size(p->question) > 0), -EINVAL);
-        key = p->question->keys[0];
 
-        r = dns_zone_lookup(&s->zone, key, 0, &answer, &soa, &tentative);
-        if (r < 0)
-                return log_debug_errno(r, "Failed to lookup key: %m");
-        if (r == 0)
-                return 0;
+        DNS_QUESTION_FOREACH(key, p->question) {
+                _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL, *soa = NULL;
+                bool tentative = false;
+
+                r = dns_zone_lookup(&s->zone, key, 0, &answer, &soa, &tentative);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to lookup key: %m");
+                if (r == 0)
+                        continue;
+
+                r = dns_answer_extend(&full_answer, answer);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to merge answers: %m");
 
-        r = dns_scope_make_reply_packet(s, DNS_PACKET_ID(p), DNS_RCODE_SUCCESS, NULL, answer, NULL, false, &reply);
+                if (!dns_key_is_shared(key))
+                        shared = false;
+        }
+
+        /* Don't repeat what the querier told us it already knows */
+        r = mdns_answer_suppress_known(&full_answer, p->answer);
         if (r < 0)
-                return log_debug_errno(r, "Failed to build reply packet: %m");
+                return log_debug_errno(r, "Failed to apply known answer suppression: %m");
 
-        if (!ratelimit_test(&s->ratelimit))
+        if (dns_answer_isempty(full_answer))
                 return 0;
 
-        r = dns_scope_emit_udp(s, -1, reply);
-        if (r < 0)
-                return log_debug_errno(r, "Failed to send reply packet: %m");
+        if (shared)
+                return mdns_scope_queue_answer(s, full_answer);
 
-        return 0;
+        /* Answers to unique records go out right away; piggyback whatever shared answers were waiting. */
+        if (s->mdns_pending_answer) {
+                r = dns_answer_extend(&full_answer, s->mdns_pending_answer);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to merge answers: %m");
+
+                s->mdns_pending_answer = dns_answer_unref(s->mdns_pending_answer);
+                s->mdns_response_event_source = sd_event_source_unref(s->mdns_response_event_source);
+        }
+
+        return mdns_scope_send_answer(s, DNS_PACKET_ID(p), full_answer);
 }
 
 static int on_mdns_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
@@ -147,6 +268,11 @@ static int on_mdns_packet(sd_event_source *s, int fd, uint32_t revents, void *us
 
                 dns_scope_check_conflicts(scope, p);
 
+                /* Someone else on this link already answered what we were about to send */
+                r = mdns_answer_suppress_known(&scope->mdns_pending_answer, p->answer);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to apply duplicate answer suppression, ignoring: %m");
+
                 DNS_ANSWER_FOREACH(rr, p->answer) {
                         const char *name = dns_resource_key_name(rr->key);
                         DnsTransaction *t;
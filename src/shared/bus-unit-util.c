@@ -1320,10 +1320,26 @@ int bus_append_unit_property_assignment_many(sd_bus_message *m, char **l) {
         return 0;
 }
 
+typedef struct BusWaitForJobsResult BusWaitForJobsResult;
+
+struct BusWaitForJobsResult {
+        char *name;
+        char *result;
+
+        LIST_FIELDS(BusWaitForJobsResult, results);
+};
+
 typedef struct BusWaitForJobs {
         sd_bus *bus;
         Set *jobs;
 
+        /* Results of removed jobs, in the order they came in, not yet looked at. Jobs may finish while
+         * others are still being enqueued, and messages may hence be dispatched before
+         * bus_wait_for_jobs() is called. */
+        LIST_HEAD(BusWaitForJobsResult, results);
+        BusWaitForJobsResult *results_tail;
+
+        /* The result currently being looked at */
         char *name;
         char *result;
 
@@ -1343,6 +1359,7 @@ static int match_disconnected(sd_bus_message *m, void *userdata, sd_bus_error *e
 static int match_job_removed(sd_bus_message *m, void *userdata, sd_bus_error *error) {
         const char *path, *unit, *result;
         BusWaitForJobs *d = userdata;
+        BusWaitForJobsResult *x;
         uint32_t id;
         char *found;
         int r;
@@ -1362,11 +1379,21 @@ static int match_job_removed(sd_bus_message *m, void *userdata, sd_bus_error *er
 
         free(found);
 
-        if (!isempty(result))
-                d->result = strdup(result);
+        if (isempty(result))
+                return 0;
+
+        x = new0(BusWaitForJobsResult, 1);
+        if (!x) {
+                log_oom();
+                return 0;
+        }
 
+        x->result = strdup(result);
         if (!isempty(unit))
-                d->name = strdup(unit);
+                x->name = strdup(unit);
+
+        LIST_INSERT_AFTER(results, d->results, d->results_tail, x);
+        d->results_tail = x;
 
         return 0;
 }
@@ -1377,6 +1404,15 @@ void bus_wait_for_jobs_free(BusWaitForJobs *d) {
 
         set_free_free(d->jobs);
 
+        while (d->results) {
+                BusWaitForJobsResult *x = d->results;
+
+                LIST_REMOVE(results, d->results, x);
+                free(x->name);
+                free(x->result);
+                free(x);
+        }
+
         sd_bus_slot_unref(d->slot_disconnected);
         sd_bus_slot_unref(d->slot_job_removed);
 
@@ -1599,25 +1635,39 @@ int bus_wait_for_jobs(BusWaitForJobs *d, bool quiet, const char* const* extra_ar
 
         assert(d);
 
-        while (!set_isempty(d->jobs)) {
+        for (;;) {
+                BusWaitForJobsResult *x;
                 int q;
 
-                q = bus_process_wait(d->bus);
-                if (q < 0)
-                        return log_error_errno(q, "Failed to wait for response: %m");
+                while ((x = d->results)) {
+                        LIST_REMOVE(results, d->results, x);
+                        if (d->results_tail == x)
+                                d->results_tail = NULL;
+
+                        d->name = x->name;
+                        d->result = x->result;
+                        free(x);
 
-                if (d->result) {
-                        q = check_wait_response(d, quiet, extra_args);
-                        /* Return the first error as it is most likely to be
-                         * meaningful. */
-                        if (q < 0 && r == 0)
-                                r = q;
+                        if (d->result) {
+                                q = check_wait_response(d, quiet, extra_args);
+                                /* Return the first error as it is most likely to be
+                                 * meaningful. */
+                                if (q < 0 && r == 0)
+                                        r = q;
 
-                        log_debug_errno(q, "Got result %s/%m for job %s", strna(d->result), strna(d->name));
+                                log_debug_errno(q, "Got result %s/%m for job %s", strna(d->result), strna(d->name));
+                        }
+
+                        d->name = mfree(d->name);
+                        d->result = mfree(d->result);
                 }
 
-                d->name = mfree(d->name);
-                d->result = mfree(d->result);
+                if (set_isempty(d->jobs))
+                        break;
+
+                q = bus_process_wait(d->bus);
+                if (q < 0)
+                        return log_error_errno(q, "Failed to wait for response: %m");
         }
 
         return r;
@@ -230,21 +230,20 @@ static int parse_line(
                         return -EBADMSG;
                 }
 
-                n = strndup(l+1, k-2);
-                if (!n)
-                        return -ENOMEM;
+                /* The line lives in the buffer of the whole file, which stays around until we are done
+                 * with it, hence the section name can be referenced in place. */
+                l[k-1] = 0;
+                n = l+1;
 
                 if (sections && !nulstr_contains(sections, n)) {
 
                         if (!(flags & CONFIG_PARSE_RELAXED) && !startswith(n, "X-"))
                                 log_syntax(unit, LOG_WARNING, filename, line, 0, "Unknown section '%s'. Ignoring.", n);
 
-                        free(n);
-                        *section = mfree(*section);
+                        *section = NULL;
                         *section_line = 0;
                         *section_ignored = true;
                 } else {
-                        free(*section);
                         *section = n;
                         *section_line = line;
                         *section_ignored = false;
@@ -293,10 +292,12 @@ int config_parse(const char *unit,
                  ConfigParseFlags flags,
                  void *userdata) {
 
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
+        _cleanup_free_ char *contents = NULL;
         _cleanup_fclose_ FILE *ours = NULL;
+        char *section = NULL, *continuation = NULL, *p, *end;
         unsigned line = 0, section_line = 0;
         bool section_ignored = false;
+        size_t size;
         int r;
 
         assert(filename);
@@ -316,32 +317,38 @@ int config_parse(const char *unit,
 
         fd_warn_permissions(filename, fileno(f));
 
-        for (;;) {
-                _cleanup_free_ char *buf = NULL;
+        /* Read the whole file in one go and split it into lines in place. Lines are terminated by \n or
+         * \0, as with read_line(). Section names and assignments are handed out as pointers into this
+         * buffer, only the parsers that store a setting copy anything. */
+        r = read_full_stream(f, &contents, &size);
+        if (r < 0) {
+                if (flags & CONFIG_PARSE_WARN)
+                        log_error_errno(r, "%s: Error while reading configuration file: %m", filename);
+
+                return r;
+        }
+
+        for (p = contents, end = contents + size; p < end; ) {
                 bool escaped = false;
-                char *l, *p, *e;
+                char *l, *e;
+                size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &buf);
-                if (r == 0)
-                        break;
-                if (r == -ENOBUFS) {
+                k = strcspn(p, "\n");
+                if (k >= LONG_LINE_MAX) {
                         if (flags & CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Line too long", filename, line);
+                                log_error_errno(ENOBUFS, "%s:%u: Line too long", filename, line);
 
-                        return r;
+                        return -ENOBUFS;
                 }
-                if (r < 0) {
-                        if (CONFIG_PARSE_WARN)
-                                log_error_errno(r, "%s:%u: Error while reading configuration file: %m", filename, line);
 
-                        return r;
-                }
+                l = p;
+                l[k] = 0;
+                p += k + 1;
 
-                l = buf;
                 if (!(flags & CONFIG_PARSE_REFUSE_BOM)) {
                         char *q;
 
-                        q = startswith(buf, UTF8_BYTE_ORDER_MARK);
+                        q = startswith(l, UTF8_BYTE_ORDER_MARK);
                         if (q) {
                                 l = q;
                                 flags |= CONFIG_PARSE_REFUSE_BOM;
@@ -349,23 +356,23 @@ int config_parse(const char *unit,
                 }
 
                 if (continuation) {
-                        if (strlen(continuation) + strlen(l) > LONG_LINE_MAX) {
+                        size_t c = strlen(continuation), n = strlen(l);
+
+                        if (c + n > LONG_LINE_MAX) {
                                 if (flags & CONFIG_PARSE_WARN)
                                         log_error("%s:%u: Continuation line too long", filename, line);
                                 return -ENOBUFS;
                         }
 
-                        if (!strextend(&continuation, l, NULL)) {
-                                if (flags & CONFIG_PARSE_WARN)
-                                        log_oom();
-                                return -ENOMEM;
-                        }
-
-                        p = continuation;
-                } else
-                        p = l;
+                        /* The continued line ends right in front of this one, so close the gap by moving
+                         * this line down onto the terminator of the previous one. */
+                        memmove(continuation + c, l, n + 1);
+                        l = continuation + c;
+                }
 
-                for (e = p; *e; e++) {
+                /* Only the new part needs to be scanned: the escape state was reset by turning the
+                 * trailing backslash of the previous part into a space. */
+                for (e = l; *e; e++) {
                         if (escaped)
                                 escaped = false;
                         else if (*e == '\\')
@@ -375,14 +382,8 @@ int config_parse(const char *unit,
                 if (escaped) {
                         *(e-1) = ' ';
 
-                        if (!continuation) {
-                                continuation = strdup(l);
-                                if (!continuation) {
-                                        if (flags & CONFIG_PARSE_WARN)
-                                                log_oom();
-                                        return -ENOMEM;
-                                }
-                        }
+                        if (!continuation)
+                                continuation = l;
 
                         continue;
                 }
@@ -397,7 +398,7 @@ int config_parse(const char *unit,
                                &section,
                                &section_line,
                                &section_ignored,
-                               p,
+                               continuation ?: l,
                                userdata);
                 if (r < 0) {
                         if (flags & CONFIG_PARSE_WARN)
@@ -406,7 +407,7 @@ int config_parse(const char *unit,
 
                 }
 
-                continuation = mfree(continuation);
+                continuation = NULL;
         }
 
         return 0;
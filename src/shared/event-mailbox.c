@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "event-mailbox.h"
+#include "fd-util.h"
+#include "list.h"
+#include "log.h"
+
+typedef struct Message Message;
+
+struct Message {
+        event_mailbox_handler_t handler;
+        void *userdata;
+
+        LIST_FIELDS(Message, messages);
+};
+
+struct EventMailbox {
+        sd_event_source *event_source;
+        int fd;
+
+        pthread_mutex_t mutex;
+        LIST_HEAD(Message, messages);
+        Message *messages_tail;
+};
+
+static void event_mailbox_dispatch(EventMailbox *m) {
+        Message *list, *msg;
+
+        assert(m);
+
+        assert_se(pthread_mutex_lock(&m->mutex) == 0);
+        list = m->messages;
+        m->messages = m->messages_tail = NULL;
+        assert_se(pthread_mutex_unlock(&m->mutex) == 0);
+
+        while ((msg = list)) {
+                LIST_REMOVE(messages, list, msg);
+                msg->handler(msg->userdata);
+                free(msg);
+        }
+}
+
+static int on_mailbox(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        EventMailbox *m = userdata;
+        uint64_t x;
+
+        assert(m);
+
+        /* Reset the counter first, so that anything posted after we took the messages wakes us up again */
+        if (read(fd, &x, sizeof(x)) < 0 && errno != EAGAIN)
+                return log_error_errno(errno, "Failed to read from mailbox eventfd: %m");
+
+        event_mailbox_dispatch(m);
+        return 0;
+}
+
+int event_mailbox_new(EventMailbox **ret, sd_event *event, int64_t priority) {
+        _cleanup_(event_mailbox_freep) EventMailbox *m = NULL;
+        int r;
+
+        assert(ret);
+        assert(event);
+
+        m = new0(EventMailbox, 1);
+        if (!m)
+                return -ENOMEM;
+
+        m->fd = -1;
+        m->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+
+        m->fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (m->fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(event, &m->event_source, m->fd, EPOLLIN, on_mailbox, m);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(m->event_source, priority);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->event_source, "mailbox");
+
+        *ret = m;
+        m = NULL;
+
+        return 0;
+}
+
+EventMailbox *event_mailbox_free(EventMailbox *m) {
+        Message *msg;
+
+        if (!m)
+                return NULL;
+
+        /* Messages not dispatched yet are dropped. Use event_mailbox_flush() beforehand to run them. No other
+         * thread may post to the mailbox anymore at this point. */
+
+        while ((msg = m->messages)) {
+                LIST_REMOVE(messages, m->messages, msg);
+                free(msg);
+        }
+
+        sd_event_source_unref(m->event_source);
+        safe_close(m->fd);
+        pthread_mutex_destroy(&m->mutex);
+
+        return mfree(m);
+}
+
+int event_mailbox_post(EventMailbox *m, event_mailbox_handler_t handler, void *userdata) {
+        static const uint64_t one = 1;
+        Message *msg;
+        bool wake;
+
+        assert(m);
+        assert(handler);
+
+        /* May be called from any thread. The handler is invoked from the event loop the mailbox belongs to, in
+         * the order the messages were posted. */
+
+        msg = new0(Message, 1);
+        if (!msg)
+                return -ENOMEM;
+
+        msg->handler = handler;
+        msg->userdata = userdata;
+
+        assert_se(pthread_mutex_lock(&m->mutex) == 0);
+        wake = !m->messages;
+        LIST_INSERT_AFTER(messages, m->messages, m->messages_tail, msg);
+        m->messages_tail = msg;
+        assert_se(pthread_mutex_unlock(&m->mutex) == 0);
+
+        /* Only the first message needs to wake up the event loop, it picks up all of them at once */
+        if (wake && write(m->fd, &one, sizeof(one)) < 0)
+                return -errno;
+
+        return 0;
+}
+
+void event_mailbox_flush(EventMailbox *m) {
+        assert(m);
+
+        /* Runs the handlers of all messages posted so far right away. Must be called from the thread of the
+         * event loop. */
+
+        event_mailbox_dispatch(m);
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "sd-event.h"
+
+#include "macro.h"
+
+/* A queue of callbacks to run in the thread of an event loop, which may be fed from any thread. */
+
+typedef struct EventMailbox EventMailbox;
+
+typedef void (*event_mailbox_handler_t)(void *userdata);
+
+int event_mailbox_new(EventMailbox **ret, sd_event *event, int64_t priority);
+EventMailbox *event_mailbox_free(EventMailbox *m);
+
+int event_mailbox_post(EventMailbox *m, event_mailbox_handler_t handler, void *userdata);
+void event_mailbox_flush(EventMailbox *m);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(EventMailbox*, event_mailbox_free);
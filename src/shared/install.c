@@ -41,6 +41,7 @@
 #include "hashmap.h"
 #include "install-printf.h"
 #include "install.h"
+#include "list.h"
 #include "locale-util.h"
 #include "log.h"
 #include "macro.h"
@@ -84,6 +85,28 @@ typedef struct {
         size_t n_rules;
 } Presets;
 
+/* A snapshot of all symlinks below one search path, so that the state of many units can be determined
+ * without walking the directory tree and reading every link again for each of them. Only suitable for
+ * operations that do not modify the search paths themselves. */
+typedef struct SymlinkEntry SymlinkEntry;
+
+struct SymlinkEntry {
+        char *path;     /* the symlink itself */
+        char *dest;     /* where it points to, made absolute */
+
+        LIST_FIELDS(SymlinkEntry, entries);
+        LIST_FIELDS(SymlinkEntry, by_name);
+        LIST_FIELDS(SymlinkEntry, by_dest);
+};
+
+typedef struct {
+        char *path;
+        LIST_HEAD(SymlinkEntry, entries);
+        Hashmap *by_name;       /* basename of the symlink → list of entries */
+        Hashmap *by_dest;       /* basename of its destination → list of entries */
+        int error;              /* the first error hit while reading the tree */
+} SymlinkDir;
+
 static inline bool unit_file_install_info_has_rules(UnitFileInstallInfo *i) {
         assert(i);
 
@@ -111,7 +134,7 @@ static inline void presets_freep(Presets *p) {
         p->n_rules = 0;
 }
 
-static int unit_file_lookup_state(UnitFileScope scope, const LookupPaths *paths, const char *name, UnitFileState *ret);
+static int unit_file_lookup_state(UnitFileScope scope, const LookupPaths *paths, Hashmap *symlink_dirs, const char *name, UnitFileState *ret);
 
 bool unit_type_may_alias(UnitType type) {
         return IN_SET(type,
@@ -725,6 +748,60 @@ static bool is_symlink_with_known_name(const UnitFileInstallInfo *i, const char
         return false;
 }
 
+static int find_symlinks_check(
+                UnitFileInstallInfo *i,
+                bool match_aliases,
+                const char *p,
+                const char *dest,
+                const char *config_path,
+                bool *same_name_link) {
+
+        bool found_path, found_dest, b = false;
+        int q;
+
+        /* Check if the symlink itself matches what we
+         * are looking for */
+        if (path_is_absolute(i->name))
+                found_path = path_equal(p, i->name);
+        else
+                found_path = streq(basename(p), i->name);
+
+        /* Check if what the symlink points to
+         * matches what we are looking for */
+        if (path_is_absolute(i->name))
+                found_dest = path_equal(dest, i->name);
+        else
+                found_dest = streq(basename(dest), i->name);
+
+        if (found_path && found_dest) {
+                _cleanup_free_ char *t = NULL;
+
+                /* Filter out same name links in the main
+                 * config path */
+                t = path_make_absolute(i->name, config_path);
+                if (!t)
+                        return -ENOMEM;
+
+                b = path_equal(t, p);
+        }
+
+        if (b)
+                *same_name_link = true;
+        else if (found_path || found_dest) {
+                if (!match_aliases)
+                        return 1;
+
+                /* Check if symlink name is in the set of names used by [Install] */
+                q = is_symlink_with_known_name(i, basename(p));
+                if (q < 0)
+                        return q;
+                if (q > 0)
+                        return 1;
+        }
+
+        return 0;
+}
+
 static int find_symlinks_fd(
                 const char *root_dir,
                 UnitFileInstallInfo *i,
@@ -784,7 +861,6 @@ static int find_symlinks_fd(
 
                 } else if (de->d_type == DT_LNK) {
                         _cleanup_free_ char *p = NULL, *dest = NULL;
-                        bool found_path, found_dest, b = false;
                         int q;
 
                         /* Acquire symlink name */
@@ -814,53 +890,246 @@ static int find_symlinks_fd(
                                 dest = x;
                         }
 
-                        /* Check if the symlink itself matches what we
-                         * are looking for */
-                        if (path_is_absolute(i->name))
-                                found_path = path_equal(p, i->name);
-                        else
-                                found_path = streq(de->d_name, i->name);
+                        q = find_symlinks_check(i, match_aliases, p, dest, config_path, same_name_link);
+                        if (q != 0)
+                                return q;
+                }
+        }
 
-                        /* Check if what the symlink points to
-                         * matches what we are looking for */
-                        if (path_is_absolute(i->name))
-                                found_dest = path_equal(dest, i->name);
-                        else
-                                found_dest = streq(basename(dest), i->name);
+        return r;
+}
 
-                        if (found_path && found_dest) {
-                                _cleanup_free_ char *t = NULL;
+static SymlinkDir *symlink_dir_free(SymlinkDir *d) {
+        SymlinkEntry *e;
 
-                                /* Filter out same name links in the main
-                                 * config path */
-                                t = path_make_absolute(i->name, config_path);
-                                if (!t)
-                                        return -ENOMEM;
+        if (!d)
+                return NULL;
+
+        while ((e = d->entries)) {
+                LIST_REMOVE(entries, d->entries, e);
+                free(e->path);
+                free(e->dest);
+                free(e);
+        }
+
+        hashmap_free(d->by_name);
+        hashmap_free(d->by_dest);
+        free(d->path);
+
+        return mfree(d);
+}
+
+static int symlink_dir_index(Hashmap *h, SymlinkEntry *e, const char *key, bool dest) {
+        SymlinkEntry *head;
+
+        head = hashmap_get(h, key);
+        if (dest)
+                LIST_PREPEND(by_dest, head, e);
+        else
+                LIST_PREPEND(by_name, head, e);
+
+        /* The key of the list is taken from its head */
+        return hashmap_replace(h, key, head);
+}
+
+static int symlink_dir_add(SymlinkDir *d, char *p, char *dest) {
+        SymlinkEntry *e;
+        int r;
+
+        e = new0(SymlinkEntry, 1);
+        if (!e)
+                return -ENOMEM;
 
-                                b = path_equal(t, p);
+        e->path = p;
+        e->dest = dest;
+        LIST_PREPEND(entries, d->entries, e);
+
+        r = symlink_dir_index(d->by_name, e, basename(e->path), false);
+        if (r < 0)
+                return r;
+
+        return symlink_dir_index(d->by_dest, e, basename(e->dest), true);
+}
+
+static int symlink_dir_load_fd(SymlinkDir *d, const char *root_dir, int fd, const char *path) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *de;
+        int r;
+
+        assert(d);
+        assert(fd >= 0);
+        assert(path);
+
+        /* Walks the tree the same way as find_symlinks_fd(), but only records what it finds. Errors that
+         * find_symlinks_fd() would continue on are remembered in d->error. */
+
+        dir = fdopendir(fd);
+        if (!dir) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+
+                dirent_ensure_type(dir, de);
+
+                if (de->d_type == DT_DIR) {
+                        _cleanup_free_ char *p = NULL;
+                        int nfd;
+
+                        nfd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                        if (nfd < 0) {
+                                if (errno != ENOENT && d->error == 0)
+                                        d->error = -errno;
+                                continue;
                         }
 
-                        if (b)
-                                *same_name_link = true;
-                        else if (found_path || found_dest) {
-                                if (!match_aliases)
-                                        return 1;
-
-                                /* Check if symlink name is in the set of names used by [Install] */
-                                q = is_symlink_with_known_name(i, de->d_name);
-                                if (q < 0)
-                                        return q;
-                                if (q > 0)
-                                        return 1;
+                        p = path_make_absolute(de->d_name, path);
+                        if (!p) {
+                                safe_close(nfd);
+                                return -ENOMEM;
                         }
+
+                        /* This will close nfd, regardless whether it succeeds or not */
+                        r = symlink_dir_load_fd(d, root_dir, nfd, p);
+                        if (r == -ENOMEM)
+                                return r;
+                        if (r < 0 && d->error == 0)
+                                d->error = r;
+
+                } else if (de->d_type == DT_LNK) {
+                        _cleanup_free_ char *p = NULL, *dest = NULL;
+
+                        p = path_make_absolute(de->d_name, path);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = readlink_malloc(p, &dest);
+                        if (r == -ENOENT)
+                                continue;
+                        if (r < 0) {
+                                if (d->error == 0)
+                                        d->error = r;
+                                continue;
+                        }
+
+                        if (!path_is_absolute(dest)) {
+                                char *x;
+
+                                x = prefix_root(root_dir, dest);
+                                if (!x)
+                                        return -ENOMEM;
+
+                                free(dest);
+                                dest = x;
+                        }
+
+                        r = symlink_dir_add(d, p, dest);
+                        if (r < 0)
+                                return r;
+
+                        p = dest = NULL;
                 }
         }
 
-        return r;
+        return 0;
+}
+
+static int symlink_dir_get(Hashmap *symlink_dirs, const char *root_dir, const char *config_path, SymlinkDir **ret) {
+        SymlinkDir *d;
+        int fd, r;
+
+        assert(symlink_dirs);
+        assert(config_path);
+        assert(ret);
+
+        d = hashmap_get(symlink_dirs, config_path);
+        if (d) {
+                *ret = d;
+                return 0;
+        }
+
+        d = new0(SymlinkDir, 1);
+        if (!d)
+                return -ENOMEM;
+
+        d->path = strdup(config_path);
+        d->by_name = hashmap_new(&string_hash_ops);
+        d->by_dest = hashmap_new(&string_hash_ops);
+        if (!d->path || !d->by_name || !d->by_dest) {
+                symlink_dir_free(d);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(symlink_dirs, d->path, d);
+        if (r < 0) {
+                symlink_dir_free(d);
+                return r;
+        }
+
+        fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0) {
+                if (!IN_SET(errno, ENOENT, ENOTDIR, EACCES))
+                        d->error = -errno;
+        } else {
+                /* This takes possession of fd and closes it */
+                r = symlink_dir_load_fd(d, root_dir, fd, config_path);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0 && d->error == 0)
+                        d->error = r;
+        }
+
+        *ret = d;
+        return 0;
+}
+
+static Hashmap *symlink_dirs_free(Hashmap *h) {
+        return hashmap_free_with_destructor(h, symlink_dir_free);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, symlink_dirs_free);
+
+static int find_symlinks_cached(
+                const SymlinkDir *d,
+                UnitFileInstallInfo *i,
+                bool match_aliases,
+                const char *config_path,
+                bool *same_name_link) {
+
+        SymlinkEntry *e;
+        int r;
+
+        assert(d);
+        assert(i);
+
+        if (path_is_absolute(i->name)) {
+                LIST_FOREACH(entries, e, d->entries) {
+                        r = find_symlinks_check(i, match_aliases, e->path, e->dest, config_path, same_name_link);
+                        if (r != 0)
+                                return r;
+                }
+        } else {
+                /* Only links named like the unit, or pointing to something named like it, can match */
+                LIST_FOREACH(by_name, e, (SymlinkEntry*) hashmap_get(d->by_name, i->name)) {
+                        r = find_symlinks_check(i, match_aliases, e->path, e->dest, config_path, same_name_link);
+                        if (r != 0)
+                                return r;
+                }
+
+                LIST_FOREACH(by_dest, e, (SymlinkEntry*) hashmap_get(d->by_dest, i->name)) {
+                        r = find_symlinks_check(i, match_aliases, e->path, e->dest, config_path, same_name_link);
+                        if (r != 0)
+                                return r;
+                }
+        }
+
+        return d->error;
 }
 
 static int find_symlinks(
                 const char *root_dir,
+                Hashmap *symlink_dirs,
                 UnitFileInstallInfo *i,
                 bool match_name,
                 const char *config_path,
@@ -872,6 +1141,17 @@ static int find_symlinks(
         assert(config_path);
         assert(same_name_link);
 
+        if (symlink_dirs) {
+                SymlinkDir *d;
+                int r;
+
+                r = symlink_dir_get(symlink_dirs, root_dir, config_path, &d);
+                if (r < 0)
+                        return r;
+
+                return find_symlinks_cached(d, i, match_name, config_path, same_name_link);
+        }
+
         fd = open(config_path, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
         if (fd < 0) {
                 if (IN_SET(errno, ENOENT, ENOTDIR, EACCES))
@@ -887,6 +1167,7 @@ static int find_symlinks(
 static int find_symlinks_in_scope(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                Hashmap *symlink_dirs,
                 UnitFileInstallInfo *i,
                 bool match_name,
                 UnitFileState *state) {
@@ -902,7 +1183,7 @@ static int find_symlinks_in_scope(
         STRV_FOREACH(p, paths->search_path)  {
                 bool same_name_link = false;
 
-                r = find_symlinks(paths->root_dir, i, match_name, *p, &same_name_link);
+                r = find_symlinks(paths->root_dir, symlink_dirs, i, match_name, *p, &same_name_link);
                 if (r < 0)
                         return r;
                 if (r > 0) {
@@ -2646,6 +2927,7 @@ int unit_file_get_default(
 static int unit_file_lookup_state(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                Hashmap *symlink_dirs,
                 const char *name,
                 UnitFileState *ret) {
 
@@ -2699,7 +2981,7 @@ static int unit_file_lookup_state(
                 /* Check if any of the Alias= symlinks have been created.
                  * We ignore other aliases, and only check those that would
                  * be created by systemctl enable for this unit. */
-                r = find_symlinks_in_scope(scope, paths, i, true, &state);
+                r = find_symlinks_in_scope(scope, paths, symlink_dirs, i, true, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2707,7 +2989,7 @@ static int unit_file_lookup_state(
 
                 /* Check if the file is known under other names. If it is,
                  * it might be in use. Report that as UNIT_FILE_INDIRECT. */
-                r = find_symlinks_in_scope(scope, paths, i, false, &state);
+                r = find_symlinks_in_scope(scope, paths, symlink_dirs, i, false, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2748,7 +3030,7 @@ int unit_file_get_state(
         if (r < 0)
                 return r;
 
-        return unit_file_lookup_state(scope, &paths, name, ret);
+        return unit_file_lookup_state(scope, &paths, NULL, name, ret);
 }
 
 int unit_file_exists(UnitFileScope scope, const LookupPaths *paths, const char *name) {
@@ -3142,6 +3424,7 @@ int unit_file_get_list(
                 char **patterns) {
 
         _cleanup_lookup_paths_free_ LookupPaths paths = {};
+        _cleanup_(symlink_dirs_freep) Hashmap *symlink_dirs = NULL;
         char **i;
         int r;
 
@@ -3153,6 +3436,12 @@ int unit_file_get_list(
         if (r < 0)
                 return r;
 
+        /* Nothing is changed on disk here, hence read the symlinks in each search path only once instead of
+         * once per unit */
+        symlink_dirs = hashmap_new(&string_hash_ops);
+        if (!symlink_dirs)
+                return -ENOMEM;
+
         STRV_FOREACH(i, paths.search_path) {
                 _cleanup_closedir_ DIR *d = NULL;
                 struct dirent *de;
@@ -3194,7 +3483,7 @@ int unit_file_get_list(
                         if (!f->path)
                                 return -ENOMEM;
 
-                        r = unit_file_lookup_state(scope, &paths, de->d_name, &f->state);
+                        r = unit_file_lookup_state(scope, &paths, symlink_dirs, de->d_name, &f->state);
                         if (r < 0)
                                 f->state = UNIT_FILE_BAD;
 
@@ -45,6 +45,7 @@
 #include "output-mode.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "siphash24.h"
 #include "sparse-endian.h"
 #include "stdio-util.h"
 #include "string-table.h"
@@ -61,6 +62,9 @@
 
 #define JSON_THRESHOLD 4096
 
+/* Entries with more fields than this are checked for repeated fields the slow way */
+#define JSON_FIELDS_FAST_MAX 64
+
 static int print_catalog(FILE *f, sd_journal *j) {
         int r;
         _cleanup_free_ char *t = NULL, *z = NULL;
@@ -122,12 +126,24 @@ typedef struct ParseFieldVec {
         { .field = _field, .field_len = strlen(_field), .target = _target, .target_len = _target_len }
 
 static int parse_fieldv(const void *data, size_t length, const ParseFieldVec *fields, unsigned n_fields) {
+        const char *eq;
+        size_t n;
         unsigned i;
 
+        /* Find the end of the field name once, so that only fields
+         * with a name of matching length need to be compared */
+        eq = memchr(data, '=', length);
+        if (!eq)
+                return 0;
+        n = eq - (const char*) data + 1;
+
         for (i = 0; i < n_fields; i++) {
                 const ParseFieldVec *f = &fields[i];
                 int r;
 
+                if (f->field_len != n)
+                        continue;
+
                 r = parse_field(data, length, f->field, f->field_len, f->target, f->target_len);
                 if (r < 0)
                         return r;
@@ -668,6 +684,10 @@ static int output_export(
         return 0;
 }
 
+static inline bool json_need_escape(char c) {
+        return (uint8_t) c < ' ' || IN_SET(c, '"', '\\');
+}
+
 void json_escape(
                 FILE *f,
                 const char* p,
@@ -699,27 +719,77 @@ void json_escape(
 
                 fputs(" ]", f);
         } else {
+                const char *e = p + l;
+
                 fputc('\"', f);
 
-                while (l > 0) {
+                while (p < e) {
+                        const char *q;
+
+                        /* Write runs of characters that need no escaping in one go */
+                        for (q = p; q < e && !json_need_escape(*q); q++)
+                                ;
+
+                        if (q > p) {
+                                fwrite(p, 1, q - p, f);
+                                p = q;
+
+                                if (p >= e)
+                                        break;
+                        }
+
                         if (IN_SET(*p, '"', '\\')) {
                                 fputc('\\', f);
                                 fputc(*p, f);
                         } else if (*p == '\n')
                                 fputs("\\n", f);
-                        else if ((uint8_t) *p < ' ')
-                                fprintf(f, "\\u%04x", (uint8_t) *p);
                         else
-                                fputc(*p, f);
+                                fprintf(f, "\\u%04x", (uint8_t) *p);
 
                         p++;
-                        l--;
                 }
 
                 fputc('\"', f);
         }
 }
 
+static int json_fields_unique(sd_journal *j) {
+        static const uint8_t hash_key[16] = {};
+        uint64_t hashes[JSON_FIELDS_FAST_MAX];
+        const void *data;
+        size_t length, n = 0, i;
+        int r;
+
+        assert(j);
+
+        /* Returns > 0 if no field name appears more than once in the
+         * current entry. Compares hashes of the names only, so a
+         * collision just makes us take the slow path. */
+
+        JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
+                const char *eq;
+
+                eq = memchr(data, '=', length);
+                if (!eq)
+                        continue;
+
+                if (n >= ELEMENTSOF(hashes))
+                        return 0;
+
+                hashes[n++] = siphash24(data, eq - (const char*) data, hash_key);
+        }
+        if (r < 0)
+                return r;
+
+        qsort_safe(hashes, n, sizeof(uint64_t), uint64_compare_func);
+
+        for (i = 1; i < n; i++)
+                if (hashes[i-1] == hashes[i])
+                        return 0;
+
+        return 1;
+}
+
 static int output_json(
                 FILE *f,
                 sd_journal *j,
@@ -780,6 +850,48 @@ static int output_json(
                         sd_id128_to_string(boot_id, sid));
         }
 
+        r = json_fields_unique(j);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                /* The common case: every field appears once, so no need to group them */
+                JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
+                        const char *eq;
+                        size_t m;
+
+                        if (length >= 9 &&
+                            memcmp(data, "_BOOT_ID=", 9) == 0)
+                                continue;
+
+                        eq = memchr(data, '=', length);
+                        if (!eq)
+                                continue;
+
+                        m = eq - (const char*) data;
+
+                        if (output_fields) {
+                                r = field_set_test(output_fields, data, m);
+                                if (r < 0)
+                                        return r;
+                                if (r == 0)
+                                        continue;
+                        }
+
+                        if (mode == OUTPUT_JSON_PRETTY)
+                                fputs(",\n\t", f);
+                        else
+                                fputs(", ", f);
+
+                        json_escape(f, data, m, flags);
+                        fputs(" : ", f);
+                        json_escape(f, eq + 1, length - m - 1, flags);
+                }
+                if (r < 0)
+                        return r;
+
+                goto end;
+        }
+
         h = hashmap_new(&string_hash_ops);
         if (!h)
                 return log_oom();
@@ -823,7 +935,7 @@ static int output_json(
         }
 
         if (r < 0)
-                return r;
+                goto finish;
 
         separator = true;
         do {
@@ -926,6 +1038,7 @@ static int output_json(
 
         } while (!done);
 
+end:
         if (mode == OUTPUT_JSON_PRETTY)
                 fputs("\n}\n", f);
         else if (mode == OUTPUT_JSON_SSE)
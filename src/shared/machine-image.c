@@ -58,7 +58,7 @@
 #include "util.h"
 #include "xattr-util.h"
 
-static const char image_search_path[] =
+const char image_search_path[] =
         "/var/lib/machines\0"
         "/var/lib/container\0" /* legacy */
         "/usr/local/lib/machines\0"
@@ -128,6 +128,7 @@ static int image_new(
                 bool read_only,
                 usec_t crtime,
                 usec_t mtime,
+                const struct stat *st,
                 Image **ret) {
 
         _cleanup_(image_unrefp) Image *i = NULL;
@@ -136,6 +137,7 @@ static int image_new(
         assert(t < _IMAGE_TYPE_MAX);
         assert(pretty);
         assert(filename);
+        assert(st);
         assert(ret);
 
         i = new0(Image, 1);
@@ -148,6 +150,9 @@ static int image_new(
         i->mtime = mtime;
         i->usage = i->usage_exclusive = (uint64_t) -1;
         i->limit = i->limit_exclusive = (uint64_t) -1;
+        i->device = st->st_dev;
+        i->inode = st->st_ino;
+        i->inode_mtime = timespec_load(&st->st_mtim);
 
         i->name = strdup(pretty);
         if (!i->name)
@@ -228,6 +233,7 @@ static int image_make(
                                               info.read_only || read_only,
                                               info.otime,
                                               0,
+                                              &st,
                                               ret);
                                 if (r < 0)
                                         return r;
@@ -262,6 +268,7 @@ static int image_make(
                               read_only || (file_attr & FS_IMMUTABLE_FL),
                               0,
                               0,
+                              &st,
                               ret);
                 if (r < 0)
                         return r;
@@ -288,6 +295,7 @@ static int image_make(
                               !(st.st_mode & 0222) || read_only,
                               crtime,
                               timespec_load(&st.st_mtim),
+                              &st,
                               ret);
                 if (r < 0)
                         return r;
@@ -340,6 +348,7 @@ static int image_make(
                               !(st.st_mode & 0222) || read_only,
                               0,
                               0,
+                              &st,
                               ret);
                 if (r < 0)
                         return r;
@@ -499,7 +508,7 @@ int image_remove(Image *i) {
         case IMAGE_DIRECTORY:
                 /* Allow deletion of read-only directories */
                 (void) chattr_path(i->path, 0, FS_IMMUTABLE_FL);
-                r = rm_rf(i->path, REMOVE_ROOT|REMOVE_PHYSICAL|REMOVE_SUBVOLUME);
+                r = rm_rf(i->path, REMOVE_ROOT|REMOVE_PHYSICAL|REMOVE_SUBVOLUME|REMOVE_PARALLEL);
                 if (r < 0)
                         return r;
 
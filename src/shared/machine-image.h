@@ -60,6 +60,11 @@ typedef struct Image {
 
         bool metadata_valid;
 
+        /* The inode the image was made from, so that cached metadata can be reused while it didn't change */
+        dev_t device;
+        ino_t inode;
+        usec_t inode_mtime;
+
         void *userdata;
 } Image;
 
@@ -71,6 +76,8 @@ static inline Hashmap* image_hashmap_free(Hashmap *map) {
 DEFINE_TRIVIAL_CLEANUP_FUNC(Image*, image_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Hashmap*, image_hashmap_free);
 
+extern const char image_search_path[];
+
 int image_find(const char *name, Image **ret);
 int image_discover(Hashmap *map);
 
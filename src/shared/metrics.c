@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+
+#include "alloc-util.h"
+#include "metrics.h"
+#include "stdio-util.h"
+#include "string-table.h"
+#include "string-util.h"
+
+static const char* const metric_type_table[_METRIC_TYPE_MAX] = {
+        [METRIC_COUNTER] = "counter",
+        [METRIC_GAUGE] = "gauge",
+        [METRIC_HISTOGRAM] = "histogram",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(metric_type, MetricType);
+
+static uint64_t metric_read_field(const MetricDescriptor *d, void *object) {
+        const uint8_t *p = (const uint8_t*) object + d->offset;
+
+        switch (d->size) {
+
+        case sizeof(uint8_t):
+                return *p;
+
+        case sizeof(uint16_t):
+                return *(const uint16_t*) p;
+
+        case sizeof(uint32_t):
+                return *(const uint32_t*) p;
+
+        case sizeof(uint64_t):
+                return *(const uint64_t*) p;
+
+        default:
+                assert_not_reached("Unexpected metric field size");
+        }
+}
+
+static int metric_foreach_histogram(const MetricDescriptor *d, const Histogram *h, metric_callback_t cb, void *userdata) {
+        char name[strlen(d->name) + sizeof(".le.") + DECIMAL_STR_MAX(uint64_t)];
+        uint64_t n = 0;
+        unsigned i, last = 0;
+        int r;
+
+        for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+                if (h->buckets[i] > 0)
+                        last = i;
+
+        /* Only report buckets up to the last one in use, they are cumulative anyway */
+        for (i = 0; i <= last; i++) {
+                n += h->buckets[i];
+
+                if (i == HISTOGRAM_BUCKETS - 1)
+                        xsprintf(name, "%s.le.inf", d->name);
+                else
+                        xsprintf(name, "%s.le.%" PRIu64, d->name, (UINT64_C(1) << i) - 1);
+
+                r = cb(name, METRIC_HISTOGRAM, n, userdata);
+                if (r < 0)
+                        return r;
+        }
+
+        xsprintf(name, "%s.count", d->name);
+        r = cb(name, METRIC_HISTOGRAM, h->count, userdata);
+        if (r < 0)
+                return r;
+
+        xsprintf(name, "%s.sum", d->name);
+        return cb(name, METRIC_HISTOGRAM, h->sum, userdata);
+}
+
+int metrics_foreach(const MetricDescriptor *table, void *object, metric_callback_t cb, void *userdata) {
+        const MetricDescriptor *d;
+        int r;
+
+        assert(table);
+        assert(cb);
+
+        for (d = table; d->name; d++) {
+                if (d->type == METRIC_HISTOGRAM) {
+                        assert(!d->get);
+                        assert(d->size == sizeof(Histogram));
+
+                        r = metric_foreach_histogram(d, (const Histogram*) ((const uint8_t*) object + d->offset), cb, userdata);
+                } else
+                        r = cb(d->name, d->type, d->get ? d->get(object) : metric_read_field(d, object), userdata);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+typedef struct DumpContext {
+        FILE *f;
+        const char *prefix;
+} DumpContext;
+
+static int dump_one(const char *name, MetricType type, uint64_t value, void *userdata) {
+        DumpContext *c = userdata;
+
+        fprintf(c->f, "%s%s (%s): %" PRIu64 "\n", c->prefix, name, metric_type_to_string(type), value);
+        return 0;
+}
+
+int metrics_dump(const MetricDescriptor *table, void *object, FILE *f, const char *prefix) {
+        DumpContext c = {
+                .f = f,
+                .prefix = strempty(prefix),
+        };
+
+        assert(table);
+        assert(f);
+
+        return metrics_foreach(table, object, dump_one, &c);
+}
+
+static int append_one(const char *name, MetricType type, uint64_t value, void *userdata) {
+        return sd_bus_message_append(userdata, "(sst)", name, metric_type_to_string(type), value);
+}
+
+int bus_message_append_metrics(sd_bus_message *m, const MetricDescriptor *table, void *object) {
+        int r;
+
+        assert(m);
+        assert(table);
+
+        r = sd_bus_message_open_container(m, 'a', "(sst)");
+        if (r < 0)
+                return r;
+
+        r = metrics_foreach(table, object, append_one, m);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(m);
+}
+
+int bus_reply_metrics(sd_bus_message *call, const MetricDescriptor *table, void *object) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        int r;
+
+        assert(call);
+        assert(table);
+
+        r = sd_bus_message_new_method_return(call, &reply);
+        if (r < 0)
+                return r;
+
+        r = bus_message_append_metrics(reply, table, object);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sd-bus.h"
+
+#include "macro.h"
+
+/* Metrics are plain fields in the object they describe, updated with ordinary increments, or computed on
+ * demand by a getter. A daemon describes them with a static table, similar to an sd-bus vtable, which is
+ * used to export them. Names are of the form "<subsystem>.<metric>", e.g. "jobs.installed", with a unit
+ * suffix where it applies, e.g. "jobs.duration_usec". */
+
+typedef enum MetricType {
+        METRIC_COUNTER,             /* only ever increases */
+        METRIC_GAUGE,               /* current value */
+        METRIC_HISTOGRAM,           /* distribution of values, see Histogram below */
+        _METRIC_TYPE_MAX,
+        _METRIC_TYPE_INVALID = -1,
+} MetricType;
+
+#define HISTOGRAM_BUCKETS 64
+
+/* Bucket 0 counts zero values, bucket i values of up to 2^i - 1, the last one everything above that */
+typedef struct Histogram {
+        uint64_t buckets[HISTOGRAM_BUCKETS];
+        uint64_t count;
+        uint64_t sum;
+} Histogram;
+
+static inline void histogram_add(Histogram *h, uint64_t v) {
+        unsigned i;
+
+        i = v == 0 ? 0 : (unsigned) (64 - __builtin_clzll(v));
+        h->buckets[MIN(i, HISTOGRAM_BUCKETS - 1U)]++;
+        h->count++;
+        h->sum += v;
+}
+
+typedef uint64_t (*metric_get_t)(void *userdata);
+
+typedef struct MetricDescriptor {
+        const char *name;
+        MetricType type;
+        metric_get_t get;           /* if NULL, read the field at offset/size from userdata */
+        size_t offset;
+        size_t size;
+} MetricDescriptor;
+
+#define METRIC_FIELD(_name, _type, object, member)                      \
+        {                                                               \
+                .name = (_name),                                        \
+                .type = (_type),                                        \
+                .offset = offsetof(object, member),                     \
+                .size = sizeof(((object*) NULL)->member),               \
+        }
+
+#define METRIC_HISTOGRAM_FIELD(_name, object, member)                   \
+        {                                                               \
+                .name = (_name),                                        \
+                .type = METRIC_HISTOGRAM,                               \
+                .offset = offsetof(object, member),                     \
+                .size = sizeof(Histogram),                              \
+        }
+
+#define METRIC_FUNC(_name, _type, _get)                                 \
+        {                                                               \
+                .name = (_name),                                        \
+                .type = (_type),                                        \
+                .get = (_get),                                          \
+        }
+
+#define METRIC_END { .name = NULL }
+
+const char *metric_type_to_string(MetricType t) _const_;
+MetricType metric_type_from_string(const char *s) _pure_;
+
+/* Histograms are flattened into "<name>.count", "<name>.sum" and cumulative "<name>.le.<bound>" entries */
+typedef int (*metric_callback_t)(const char *name, MetricType type, uint64_t value, void *userdata);
+int metrics_foreach(const MetricDescriptor *table, void *object, metric_callback_t cb, void *userdata);
+
+int metrics_dump(const MetricDescriptor *table, void *object, FILE *f, const char *prefix);
+
+/* Appends an "a(sst)" array of name, type and value */
+int bus_message_append_metrics(sd_bus_message *m, const MetricDescriptor *table, void *object);
+int bus_reply_metrics(sd_bus_message *call, const MetricDescriptor *table, void *object);
@@ -198,13 +198,15 @@ bool pager_have(void) {
         return pager_pid > 0;
 }
 
-int show_man_page(const char *desc, bool null_stdio) {
+int spawn_man_page(const char *desc, bool null_stdio, pid_t *ret) {
         const char *args[4] = { "man", NULL, NULL, NULL };
         char *e = NULL;
         pid_t pid;
         size_t k;
         int r;
-        siginfo_t status;
+
+        assert(desc);
+        assert(ret);
 
         k = strlen(desc);
 
@@ -245,6 +247,19 @@ int show_man_page(const char *desc, bool null_stdio) {
                 _exit(EXIT_FAILURE);
         }
 
+        *ret = pid;
+        return 0;
+}
+
+int show_man_page(const char *desc, bool null_stdio) {
+        siginfo_t status;
+        pid_t pid;
+        int r;
+
+        r = spawn_man_page(desc, null_stdio, &pid);
+        if (r < 0)
+                return r;
+
         r = wait_for_terminate(pid, &status);
         if (r < 0)
                 return r;
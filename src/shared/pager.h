@@ -21,6 +21,7 @@
 ***/
 
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include "macro.h"
 
@@ -28,4 +29,5 @@ int pager_open(bool no_pager, bool jump_to_end);
 void pager_close(void);
 bool pager_have(void) _pure_;
 
+int spawn_man_page(const char *page, bool null_stdio, pid_t *ret);
 int show_man_page(const char *page, bool null_stdio);
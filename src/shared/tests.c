@@ -21,11 +21,15 @@
 #include <alloc-util.h>
 #include <fs-util.h>
 #include <libgen.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <util.h>
 
+#include "env-util.h"
+#include "log.h"
 #include "tests.h"
 #include "path-util.h"
+#include "string-util.h"
 
 char* setup_fake_runtime_dir(void) {
         char t[] = "/tmp/fake-xdg-runtime-XXXXXX", *p;
@@ -72,3 +76,34 @@ const char* get_testdata_dir(const char *suffix) {
         strncpy(testdir + strlen(testdir), suffix, sizeof(testdir) - strlen(testdir) - 1);
         return testdir;
 }
+
+bool slow_tests_enabled(void) {
+        int r;
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        return r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+}
+
+void benchmark_report(const char *name, uint64_t n_ops, usec_t elapsed) {
+        char ts[FORMAT_TIMESPAN_MAX];
+        double nsec_per_op, ops_per_sec;
+        const char *e;
+
+        assert(name);
+        assert(in_charset(name, LOWERCASE_LETTERS DIGITS ".-"));
+
+        nsec_per_op = n_ops > 0 ? elapsed * 1000.0 / n_ops : 0;
+        ops_per_sec = elapsed > 0 ? n_ops * (double) USEC_PER_SEC / elapsed : 0;
+
+        /* With $SYSTEMD_BENCHMARK_OUTPUT=json, emit one JSON object per line on stdout, for consumption by
+         * scripts. Otherwise just log the result. */
+        e = getenv("SYSTEMD_BENCHMARK_OUTPUT");
+        if (streq_ptr(e, "json")) {
+                printf("{\"benchmark\":\"%s\",\"ops\":%" PRIu64 ",\"usec\":" USEC_FMT ",\"nsec_per_op\":%.1f,\"ops_per_sec\":%.1f}\n",
+                       name, n_ops, elapsed, nsec_per_op, ops_per_sec);
+                fflush(stdout);
+        } else
+                log_info("%s: %" PRIu64 " ops in %s, %.1f ns/op, %.0f ops/s",
+                         name, n_ops, format_timespan(ts, sizeof(ts), elapsed, 1),
+                         nsec_per_op, ops_per_sec);
+}
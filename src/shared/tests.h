@@ -20,5 +20,16 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "time-util.h"
+
 char* setup_fake_runtime_dir(void);
 const char* get_testdata_dir(const char *suffix);
+
+bool slow_tests_enabled(void);
+
+/* Benchmark names are "<component>.<operation>", optionally followed by ".<parameter>", e.g.
+ * "journal.append.10000". Keep them stable, results are compared across releases by name. */
+void benchmark_report(const char *name, uint64_t n_ops, usec_t elapsed);
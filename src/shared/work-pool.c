@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "event-mailbox.h"
+#include "list.h"
+#include "macro.h"
+#include "work-pool.h"
+
+typedef struct WorkItem WorkItem;
+
+struct WorkItem {
+        work_func_t work;
+        work_done_func_t done;
+        void *userdata;
+        int result;
+
+        LIST_FIELDS(WorkItem, items);
+};
+
+struct WorkPool {
+        EventMailbox *mailbox;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+        LIST_HEAD(WorkItem, items);
+        WorkItem *items_tail;
+        unsigned n_idle;
+        bool shutdown;
+
+        pthread_t *threads;
+        unsigned n_threads, n_threads_max;
+};
+
+static void work_item_done(void *userdata) {
+        WorkItem *i = userdata;
+
+        assert(i);
+
+        if (i->done)
+                i->done(i->result, i->userdata);
+
+        free(i);
+}
+
+static void *work_pool_thread(void *userdata) {
+        WorkPool *p = userdata;
+
+        assert(p);
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        for (;;) {
+                WorkItem *i;
+
+                while (!p->items && !p->shutdown) {
+                        p->n_idle++;
+                        assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+                        p->n_idle--;
+                }
+
+                if (p->shutdown)
+                        break;
+
+                i = p->items;
+                LIST_REMOVE(items, p->items, i);
+                if (p->items_tail == i)
+                        p->items_tail = NULL;
+
+                assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+                i->result = i->work(i->userdata);
+
+                /* The mailbox only fails on OOM. Retry rather than losing the completion, the caller relies on
+                 * the done callback being called exactly once. */
+                while (event_mailbox_post(p->mailbox, work_item_done, i) == -ENOMEM)
+                        usleep(1000);
+
+                assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        return NULL;
+}
+
+static int work_pool_spawn_locked(WorkPool *p) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(p);
+        assert(p->n_threads < p->n_threads_max);
+
+        /* Workers should never see any signals, the event loop thread takes care of them */
+        if (sigfillset(&ss) < 0)
+                return -errno;
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(p->threads + p->n_threads, NULL, work_pool_thread, p);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+
+        if (r > 0)
+                return -r;
+        if (k > 0) {
+                /* The thread is running already, account for it before bailing out */
+                p->n_threads++;
+                return -k;
+        }
+
+        p->n_threads++;
+        return 0;
+}
+
+int work_pool_new(WorkPool **ret, sd_event *event, unsigned n_threads) {
+        _cleanup_(work_pool_freep) WorkPool *p = NULL;
+        int r;
+
+        assert(ret);
+        assert(event);
+
+        if (n_threads == 0) {
+                long n;
+
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+                n_threads = n > 0 ? (unsigned) n : 1;
+        }
+        n_threads = MIN(n_threads, WORK_POOL_THREADS_MAX);
+
+        p = new0(WorkPool, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->threads = new(pthread_t, n_threads);
+        if (!p->threads)
+                return -ENOMEM;
+
+        p->n_threads_max = n_threads;
+        p->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+        p->cond = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+
+        r = event_mailbox_new(&p->mailbox, event, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0)
+                return r;
+
+        *ret = p;
+        p = NULL;
+
+        return 0;
+}
+
+WorkPool *work_pool_free(WorkPool *p) {
+        WorkItem *i;
+        unsigned k;
+
+        if (!p)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+        p->shutdown = true;
+        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+
+        /* Work items that are already running are finished, the rest are cancelled */
+        for (k = 0; k < p->n_threads; k++)
+                (void) pthread_join(p->threads[k], NULL);
+
+        while ((i = p->items)) {
+                LIST_REMOVE(items, p->items, i);
+                i->result = -ECANCELED;
+                work_item_done(i);
+        }
+
+        if (p->mailbox) {
+                event_mailbox_flush(p->mailbox);
+                event_mailbox_free(p->mailbox);
+        }
+
+        pthread_cond_destroy(&p->cond);
+        pthread_mutex_destroy(&p->mutex);
+        free(p->threads);
+
+        return mfree(p);
+}
+
+int work_pool_submit(WorkPool *p, work_func_t work, work_done_func_t done, void *userdata) {
+        WorkItem *i;
+        int r = 0;
+
+        assert(p);
+        assert(work);
+
+        i = new0(WorkItem, 1);
+        if (!i)
+                return -ENOMEM;
+
+        i->work = work;
+        i->done = done;
+        i->userdata = userdata;
+
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+
+        if (p->shutdown) {
+                r = -ESHUTDOWN;
+                goto finish;
+        }
+
+        /* Spawn workers lazily, only when nobody is around to pick up the new item */
+        if (p->n_idle == 0 && p->n_threads < p->n_threads_max) {
+                r = work_pool_spawn_locked(p);
+                if (r < 0 && p->n_threads == 0)
+                        goto finish;
+
+                r = 0;
+        }
+
+        LIST_INSERT_AFTER(items, p->items, p->items_tail, i);
+        p->items_tail = i;
+        i = NULL;
+
+        assert_se(pthread_cond_signal(&p->cond) == 0);
+
+finish:
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+        free(i);
+
+        return r;
+}
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "sd-event.h"
+
+#include "macro.h"
+
+/* A small pool of worker threads attached to an event loop. Work items are run on the workers, their completion
+ * callbacks are run from the event loop, in its thread. */
+
+typedef struct WorkPool WorkPool;
+
+typedef int (*work_func_t)(void *userdata);
+typedef void (*work_done_func_t)(int r, void *userdata);
+
+#define WORK_POOL_THREADS_MAX 16U
+
+int work_pool_new(WorkPool **ret, sd_event *event, unsigned n_threads);
+WorkPool *work_pool_free(WorkPool *p);
+
+int work_pool_submit(WorkPool *p, work_func_t work, work_done_func_t done, void *userdata);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(WorkPool*, work_pool_free);
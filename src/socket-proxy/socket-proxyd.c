@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,13 +42,21 @@
 #include "socket-util.h"
 #include "string-util.h"
 #include "parse-util.h"
+#include "time-util.h"
 #include "util.h"
 
 #define BUFFER_SIZE (256 * 1024)
+#define THREADS_MAX 256U
+
 static unsigned arg_connections_max = 256;
+static size_t arg_buffer_size = BUFFER_SIZE;
+static unsigned arg_threads = 1;
 
 static const char *arg_remote_host = NULL;
 
+/* The number of connections currently open, across all threads */
+static unsigned n_connections = 0;
+
 typedef struct Context {
         sd_event *event;
         sd_resolve *resolve;
@@ -69,6 +78,10 @@ typedef struct Connection {
         sd_event_source *server_event_source, *client_event_source;
 
         sd_resolve_query *resolve_query;
+
+        char *peer;
+        usec_t accept_timestamp, connect_timestamp;
+        uint64_t server_to_client_bytes, client_to_server_bytes;
 } Connection;
 
 static void connection_free(Connection *c) {
@@ -77,6 +90,18 @@ static void connection_free(Connection *c) {
         if (c->context)
                 set_remove(c->context->connections, c);
 
+        if (c->connect_timestamp > 0) {
+                char setup[FORMAT_TIMESPAN_MAX], lifetime[FORMAT_TIMESPAN_MAX];
+
+                log_debug("Connection from %s closed after %s, %" PRIu64 " bytes forwarded to remote, %" PRIu64 " bytes forwarded from remote, connecting took %s.",
+                          strna(c->peer),
+                          format_timespan(lifetime, sizeof(lifetime), now(CLOCK_MONOTONIC) - c->accept_timestamp, USEC_PER_MSEC),
+                          c->server_to_client_bytes, c->client_to_server_bytes,
+                          format_timespan(setup, sizeof(setup), c->connect_timestamp - c->accept_timestamp, 1));
+        }
+
+        __sync_sub_and_fetch(&n_connections, 1);
+
         sd_event_source_unref(c->server_event_source);
         sd_event_source_unref(c->client_event_source);
 
@@ -88,6 +113,7 @@ static void connection_free(Connection *c) {
 
         sd_resolve_query_unref(c->resolve_query);
 
+        free(c->peer);
         free(c);
 }
 
@@ -115,7 +141,7 @@ static int connection_create_pipes(Connection *c, int buffer[2], size_t *sz) {
         if (r < 0)
                 return log_error_errno(errno, "Failed to allocate pipe buffer: %m");
 
-        (void) fcntl(buffer[0], F_SETPIPE_SZ, BUFFER_SIZE);
+        (void) fcntl(buffer[0], F_SETPIPE_SZ, arg_buffer_size);
 
         r = fcntl(buffer[0], F_GETPIPE_SZ);
         if (r < 0)
@@ -130,7 +156,7 @@ static int connection_create_pipes(Connection *c, int buffer[2], size_t *sz) {
 static int connection_shovel(
                 Connection *c,
                 int *from, int buffer[2], int *to,
-                size_t *full, size_t *sz,
+                size_t *full, size_t *sz, uint64_t *bytes,
                 sd_event_source **from_source, sd_event_source **to_source) {
 
         bool shoveled;
@@ -143,6 +169,7 @@ static int connection_shovel(
         assert(to);
         assert(full);
         assert(sz);
+        assert(bytes);
         assert(from_source);
         assert(to_source);
 
@@ -167,6 +194,7 @@ static int connection_shovel(
                         z = splice(buffer[0], NULL, *to, NULL, *full, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
                         if (z > 0) {
                                 *full -= z;
+                                *bytes += z;
                                 shoveled = true;
                         } else if (z == 0 || IN_SET(errno, EPIPE, ECONNRESET)) {
                                 *to_source = sd_event_source_unref(*to_source);
@@ -191,14 +219,14 @@ static int traffic_cb(sd_event_source *s, int fd, uint32_t revents, void *userda
 
         r = connection_shovel(c,
                               &c->server_fd, c->server_to_client_buffer, &c->client_fd,
-                              &c->server_to_client_buffer_full, &c->server_to_client_buffer_size,
+                              &c->server_to_client_buffer_full, &c->server_to_client_buffer_size, &c->server_to_client_bytes,
                               &c->server_event_source, &c->client_event_source);
         if (r < 0)
                 goto quit;
 
         r = connection_shovel(c,
                               &c->client_fd, c->client_to_server_buffer, &c->server_fd,
-                              &c->client_to_server_buffer_full, &c->client_to_server_buffer_size,
+                              &c->client_to_server_buffer_full, &c->client_to_server_buffer_size, &c->client_to_server_bytes,
                               &c->client_event_source, &c->server_event_source);
         if (r < 0)
                 goto quit;
@@ -270,6 +298,8 @@ static int connection_complete(Connection *c) {
 
         assert(c);
 
+        c->connect_timestamp = now(CLOCK_MONOTONIC);
+
         r = connection_create_pipes(c, c->server_to_client_buffer, &c->server_to_client_buffer_size);
         if (r < 0)
                 goto fail;
@@ -431,14 +461,18 @@ fail:
         return 0; /* ignore errors, continue serving */
 }
 
-static int add_connection_socket(Context *context, int fd) {
+static int add_connection_socket(Context *context, int fd, char **peer) {
         Connection *c;
         int r;
 
         assert(context);
         assert(fd >= 0);
+        assert(peer);
 
-        if (set_size(context->connections) > arg_connections_max) {
+        /* The counter is shared between all threads, hence take the slot first and give it back if we are over the
+         * limit. */
+        if (__sync_add_and_fetch(&n_connections, 1) > arg_connections_max) {
+                __sync_sub_and_fetch(&n_connections, 1);
                 log_warning("Hit connection limit, refusing connection.");
                 safe_close(fd);
                 return 0;
@@ -446,12 +480,16 @@ static int add_connection_socket(Context *context, int fd) {
 
         r = set_ensure_allocated(&context->connections, NULL);
         if (r < 0) {
+                __sync_sub_and_fetch(&n_connections, 1);
+                safe_close(fd);
                 log_oom();
                 return 0;
         }
 
         c = new0(Connection, 1);
         if (!c) {
+                __sync_sub_and_fetch(&n_connections, 1);
+                safe_close(fd);
                 log_oom();
                 return 0;
         }
@@ -461,10 +499,14 @@ static int add_connection_socket(Context *context, int fd) {
         c->client_fd = -1;
         c->server_to_client_buffer[0] = c->server_to_client_buffer[1] = -1;
         c->client_to_server_buffer[0] = c->client_to_server_buffer[1] = -1;
+        c->accept_timestamp = now(CLOCK_MONOTONIC);
+        c->peer = *peer;
+        *peer = NULL;
 
         r = set_put(context->connections, c);
         if (r < 0) {
-                free(c);
+                c->context = NULL;
+                connection_free(c);
                 log_oom();
                 return 0;
         }
@@ -484,13 +526,14 @@ static int accept_cb(sd_event_source *s, int fd, uint32_t revents, void *userdat
 
         nfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC);
         if (nfd < 0) {
-                if (errno != -EAGAIN)
+                /* With multiple threads watching the same listening socket, somebody else might have been quicker */
+                if (errno != EAGAIN)
                         log_warning_errno(errno, "Failed to accept() socket: %m");
         } else {
                 getpeername_pretty(nfd, true, &peer);
                 log_debug("New connection from %s", strna(peer));
 
-                r = add_connection_socket(context, nfd);
+                r = add_connection_socket(context, nfd, &peer);
                 if (r < 0) {
                         log_error_errno(r, "Failed to accept connection, ignoring: %m");
                         safe_close(fd);
@@ -557,6 +600,8 @@ static void help(void) {
                "%1$s [SOCKET]\n\n"
                "Bidirectionally proxy local sockets to another (possibly remote) socket.\n\n"
                "  -c --connections-max=  Set the maximum number of connections to be accepted\n"
+               "     --buffer-size=      Set the size of the pipe buffers of each connection\n"
+               "     --threads=          Set the number of threads serving connections\n"
                "  -h --help              Show this help\n"
                "     --version           Show package version\n",
                program_invocation_short_name);
@@ -566,11 +611,15 @@ static int parse_argv(int argc, char *argv[]) {
 
         enum {
                 ARG_VERSION = 0x100,
-                ARG_IGNORE_ENV
+                ARG_IGNORE_ENV,
+                ARG_BUFFER_SIZE,
+                ARG_THREADS,
         };
 
         static const struct option options[] = {
-                { "connections-max", required_argument, NULL, 'c'           },
+                { "connections-max", required_argument, NULL, 'c'             },
+                { "buffer-size",     required_argument, NULL, ARG_BUFFER_SIZE },
+                { "threads",         required_argument, NULL, ARG_THREADS     },
                 { "help",            no_argument,       NULL, 'h'           },
                 { "version",         no_argument,       NULL, ARG_VERSION   },
                 {}
@@ -603,6 +652,38 @@ static int parse_argv(int argc, char *argv[]) {
 
                         break;
 
+                case ARG_BUFFER_SIZE: {
+                        uint64_t sz;
+
+                        r = parse_size(optarg, 1024, &sz);
+                        if (r < 0) {
+                                log_error("Failed to parse --buffer-size= argument: %s", optarg);
+                                return r;
+                        }
+
+                        if (sz < page_size() || sz > INT_MAX) {
+                                log_error("Buffer size out of range: %s", optarg);
+                                return -ERANGE;
+                        }
+
+                        arg_buffer_size = (size_t) sz;
+                        break;
+                }
+
+                case ARG_THREADS:
+                        r = safe_atou(optarg, &arg_threads);
+                        if (r < 0) {
+                                log_error("Failed to parse --threads= argument: %s", optarg);
+                                return r;
+                        }
+
+                        if (arg_threads < 1 || arg_threads > THREADS_MAX) {
+                                log_error("Number of threads out of range: %s", optarg);
+                                return -ERANGE;
+                        }
+
+                        break;
+
                 case ARG_VERSION:
                         return version();
 
@@ -627,16 +708,9 @@ static int parse_argv(int argc, char *argv[]) {
         return 1;
 }
 
-int main(int argc, char *argv[]) {
+static int context_run(int n_fds, bool watchdog) {
         Context context = {};
-        int r, n, fd;
-
-        log_parse_environment();
-        log_open();
-
-        r = parse_argv(argc, argv);
-        if (r <= 0)
-                goto finish;
+        int r, fd;
 
         r = sd_event_default(&context.event);
         if (r < 0) {
@@ -656,7 +730,44 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
-        sd_event_set_watchdog(context.event, true);
+        if (watchdog)
+                sd_event_set_watchdog(context.event, true);
+
+        /* Every thread watches all listening sockets in oneshot mode, whoever gets to accept() a connection first
+         * serves it from then on. */
+        for (fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + n_fds; fd++) {
+                r = add_listen_socket(&context, fd);
+                if (r < 0)
+                        goto finish;
+        }
+
+        r = sd_event_loop(context.event);
+        if (r < 0) {
+                log_error_errno(r, "Failed to run event loop: %m");
+                goto finish;
+        }
+
+finish:
+        context_free(&context);
+
+        return r;
+}
+
+static void *worker_thread(void *userdata) {
+        (void) context_run(PTR_TO_INT(userdata), false);
+        return NULL;
+}
+
+int main(int argc, char *argv[]) {
+        unsigned i;
+        int r, n;
+
+        log_parse_environment();
+        log_open();
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                goto finish;
 
         n = sd_listen_fds(1);
         if (n < 0) {
@@ -669,20 +780,29 @@ int main(int argc, char *argv[]) {
                 goto finish;
         }
 
-        for (fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + n; fd++) {
-                r = add_listen_socket(&context, fd);
-                if (r < 0)
+        for (i = 1; i < arg_threads; i++) {
+                pthread_attr_t attr;
+                pthread_t t;
+
+                r = pthread_attr_init(&attr);
+                if (r > 0) {
+                        r = log_error_errno(r, "Failed to initialize thread attributes: %m");
                         goto finish;
-        }
+                }
 
-        r = sd_event_loop(context.event);
-        if (r < 0) {
-                log_error_errno(r, "Failed to run event loop: %m");
-                goto finish;
+                r = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+                if (r == 0)
+                        r = pthread_create(&t, &attr, worker_thread, INT_TO_PTR(n));
+                pthread_attr_destroy(&attr);
+                if (r > 0) {
+                        r = log_error_errno(r, "Failed to start worker thread: %m");
+                        goto finish;
+                }
         }
 
-finish:
-        context_free(&context);
+        /* The main thread serves connections too, and is the one that pings the watchdog */
+        r = context_run(n, true);
 
+finish:
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
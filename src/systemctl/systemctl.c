@@ -131,6 +131,7 @@ static bool arg_no_wtmp = false;
 static bool arg_no_sync = false;
 static bool arg_no_wall = false;
 static bool arg_no_reload = false;
+static bool arg_if_changed = false;
 static bool arg_value = false;
 static bool arg_show_types = false;
 static bool arg_ignore_inhibitors = false;
@@ -2993,6 +2994,186 @@ static int start_unit_one(
         return 0;
 }
 
+/* How many StartUnit() (and friends) calls to keep in flight at once. The system bus limits the number of
+ * replies a connection may wait for (128 by default), so stay well below that. */
+#define START_UNIT_PIPELINE_MAX 64U
+
+typedef struct StartUnitPipeline {
+        const char *method;
+        const char *mode;
+        BusWaitForJobs *w;
+        unsigned n_pending;
+        int r;
+} StartUnitPipeline;
+
+typedef struct StartUnitCall {
+        StartUnitPipeline *pipeline;
+        const char *name;
+} StartUnitCall;
+
+static int start_unit_pipelined_reload_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        StartUnitCall *c = userdata;
+        int b;
+
+        assert(c);
+
+        c->pipeline->n_pending--;
+
+        /* Errors are ignored here, this is used to show a warning only */
+        if (sd_bus_message_is_method_error(m, NULL))
+                return 0;
+
+        if (sd_bus_message_read(m, "v", "b", &b) >= 0 && b)
+                warn_unit_file_changed(c->name);
+
+        return 0;
+}
+
+static int start_unit_pipelined_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        _cleanup_free_ char *unit_path = NULL;
+        StartUnitCall *c = userdata;
+        StartUnitPipeline *p;
+        const char *path;
+        int r;
+
+        assert(c);
+        p = c->pipeline;
+
+        if (sd_bus_message_is_method_error(m, NULL)) {
+                const sd_bus_error *error = sd_bus_message_get_error(m);
+
+                r = sd_bus_message_get_errno(m);
+
+                log_error("Failed to %s %s: %s", method_to_verb(p->method), c->name, bus_error_message(error, r));
+
+                if (!sd_bus_error_has_name(error, BUS_ERROR_NO_SUCH_UNIT) &&
+                    !sd_bus_error_has_name(error, BUS_ERROR_UNIT_MASKED))
+                        log_error("See %s logs and 'systemctl%s status%s %s' for details.",
+                                   arg_scope == UNIT_FILE_SYSTEM ? "system" : "user",
+                                   arg_scope == UNIT_FILE_SYSTEM ? "" : " --user",
+                                   c->name[0] == '-' ? " --" : "",
+                                   c->name);
+
+                if (p->r >= 0)
+                        p->r = translate_bus_error_to_exit_status(r, error);
+                goto finish;
+        }
+
+        r = sd_bus_message_read(m, "o", &path);
+        if (r < 0) {
+                if (p->r >= 0)
+                        p->r = bus_log_parse_error(r);
+                goto finish;
+        }
+
+        if (p->w) {
+                log_debug("Adding %s to the set", path);
+                r = bus_wait_for_jobs_add(p->w, path);
+                if (r < 0) {
+                        if (p->r >= 0)
+                                p->r = log_oom();
+                        goto finish;
+                }
+        }
+
+        /* The unit is loaded now, hence its object path may be used directly to check whether it needs a
+         * daemon reload, and that check can be queued right behind without waiting for anything. */
+        unit_path = unit_dbus_path_from_name(c->name);
+        if (!unit_path)
+                goto finish;
+
+        r = sd_bus_call_method_async(
+                        sd_bus_message_get_bus(m),
+                        NULL,
+                        "org.freedesktop.systemd1",
+                        unit_path,
+                        "org.freedesktop.DBus.Properties",
+                        "Get",
+                        start_unit_pipelined_reload_reply,
+                        c,
+                        "ss", "org.freedesktop.systemd1.Unit", "NeedDaemonReload");
+        if (r >= 0)
+                return 0; /* still pending */
+
+finish:
+        p->n_pending--;
+        return 0;
+}
+
+static int start_units_pipelined(
+                sd_bus *bus,
+                const char *method,
+                char **names,
+                const char *mode,
+                BusWaitForJobs *w) {
+
+        StartUnitPipeline p = {
+                .method = method,
+                .mode = mode,
+                .w = w,
+        };
+        _cleanup_free_ StartUnitCall *calls = NULL;
+        size_t n, next = 0;
+        int r;
+
+        assert(bus);
+        assert(method);
+        assert(mode);
+
+        /* Same as calling start_unit_one() for each unit, but without waiting for each reply before sending
+         * the next call. With many units most of the time would otherwise be spent in round trips. */
+
+        n = strv_length(names);
+        calls = new0(StartUnitCall, n);
+        if (!calls)
+                return log_oom();
+
+        for (;;) {
+                while (next < n && p.n_pending < START_UNIT_PIPELINE_MAX) {
+                        StartUnitCall *c = calls + next;
+
+                        c->pipeline = &p;
+                        c->name = names[next++];
+
+                        log_debug("Calling manager for %s on %s, %s", method, c->name, mode);
+
+                        r = sd_bus_call_method_async(
+                                        bus,
+                                        NULL,
+                                        "org.freedesktop.systemd1",
+                                        "/org/freedesktop/systemd1",
+                                        "org.freedesktop.systemd1.Manager",
+                                        method,
+                                        start_unit_pipelined_reply,
+                                        c,
+                                        "ss", c->name, mode);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to %s %s: %m", method_to_verb(method), c->name);
+                                if (p.r >= 0)
+                                        p.r = r;
+                                continue;
+                        }
+
+                        p.n_pending++;
+                }
+
+                if (p.n_pending == 0)
+                        break;
+
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to process bus: %m");
+                if (r > 0)
+                        continue;
+
+                r = sd_bus_wait(bus, (uint64_t) -1);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to wait for response: %m");
+        }
+
+        return p.r;
+}
+
 static int expand_names(sd_bus *bus, char **names, const char* suffix, char ***ret) {
         _cleanup_strv_free_ char **mangled = NULL, **globs = NULL;
         char **name;
@@ -3176,14 +3357,17 @@ static int start_unit(int argc, char *argv[], void *userdata) {
                         return log_error_errno(r, "Failed to attach bus to event loop: %m");
         }
 
-        STRV_FOREACH(name, names) {
-                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-                int q;
+        if (arg_action == ACTION_SYSTEMCTL && !arg_wait && !arg_dry_run && strv_length(names) > 1)
+                r = start_units_pipelined(bus, method, names, mode, w);
+        else
+                STRV_FOREACH(name, names) {
+                        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+                        int q;
 
-                q = start_unit_one(bus, method, *name, mode, &error, w, arg_wait ? &wait_context : NULL);
-                if (r >= 0 && q < 0)
-                        r = translate_bus_error_to_exit_status(q, &error);
-        }
+                        q = start_unit_one(bus, method, *name, mode, &error, w, arg_wait ? &wait_context : NULL);
+                        if (r >= 0 && q < 0)
+                                r = translate_bus_error_to_exit_status(q, &error);
+                }
 
         if (!arg_no_block) {
                 int q, arg_count = 0;
@@ -5104,10 +5288,10 @@ static int print_property(const char *name, sd_bus_message *m, const char *conte
         return 0;
 }
 
-static int show_one(
+static int show_one_properties(
                 const char *verb,
                 sd_bus *bus,
-                const char *path,
+                sd_bus_message *reply,
                 const char *unit,
                 bool show_properties,
                 bool *new_line,
@@ -5119,7 +5303,6 @@ static int show_one(
                 {}
         };
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_set_free_ Set *found_properties = NULL;
         _cleanup_(unit_status_info_free) UnitStatusInfo info = {
@@ -5134,25 +5317,12 @@ static int show_one(
                 .ip_ingress_bytes = (uint64_t) -1,
                 .ip_egress_bytes = (uint64_t) -1,
         };
+        char type;
         int r;
 
-        assert(path);
+        assert(reply);
         assert(new_line);
 
-        log_debug("Showing one %s", path);
-
-        r = sd_bus_call_method(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.DBus.Properties",
-                        "GetAll",
-                        &error,
-                        &reply,
-                        "s", "");
-        if (r < 0)
-                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
-
         if (unit) {
                 r = bus_message_map_all_properties(reply, property_map, &error, &info);
                 if (r < 0)
@@ -5169,9 +5339,21 @@ static int show_one(
                                 return -ENOENT;
                 }
 
-                r = sd_bus_message_rewind(reply, true);
+                /* Go back to the start of the current container. That's either the GetAll() reply itself, or a
+                 * GetUnitPropertiesByPatterns() record, where the unit name precedes the properties. */
+                r = sd_bus_message_rewind(reply, false);
                 if (r < 0)
                         return log_error_errno(r, "Failed to rewind: %s", bus_error_message(&error, r));
+
+                r = sd_bus_message_peek_type(reply, &type, NULL);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                if (type == SD_BUS_TYPE_STRING) {
+                        r = sd_bus_message_skip(reply, "s");
+                        if (r < 0)
+                                return bus_log_parse_error(r);
+                }
         }
 
         r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "{sv}");
@@ -5250,6 +5432,39 @@ static int show_one(
         return r;
 }
 
+static int show_one(
+                const char *verb,
+                sd_bus *bus,
+                const char *path,
+                const char *unit,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r;
+
+        assert(path);
+        assert(new_line);
+
+        log_debug("Showing one %s", path);
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        path,
+                        "org.freedesktop.DBus.Properties",
+                        "GetAll",
+                        &error,
+                        &reply,
+                        "s", "");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
+
+        return show_one_properties(verb, bus, reply, unit, show_properties, new_line, ellipsized);
+}
+
 static int get_unit_dbus_path_by_pid(
                 sd_bus *bus,
                 uint32_t pid,
@@ -5284,6 +5499,87 @@ static int get_unit_dbus_path_by_pid(
         return 0;
 }
 
+static int show_all_batched(
+                const char* verb,
+                sd_bus *bus,
+                bool show_properties,
+                bool *new_line,
+                bool *ellipsized) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        int r, ret = 0;
+
+        /* Fetches the properties of all units in a single call, instead of one GetAll() per unit. The manager
+         * returns them in the same order show_all() would sort them in. Returns -EOPNOTSUPP if the manager is
+         * too old to know the call. */
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GetUnitPropertiesByPatterns");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, arg_states);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, NULL);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append_strv(m, show_properties ? arg_properties : NULL);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0 && (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) ||
+                      sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED))) {
+                log_debug_errno(r, "Failed to get unit properties: %s Falling back to GetAll() per unit.", bus_error_message(&error, r));
+                return -EOPNOTSUPP;
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to get unit properties: %s", bus_error_message(&error, r));
+
+        pager_open(arg_no_pager, false);
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(sa{sv})");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "sa{sv}")) > 0) {
+                const char *id;
+
+                r = sd_bus_message_read(reply, "s", &id);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+
+                log_debug("Showing one %s", id);
+
+                r = show_one_properties(verb, bus, reply, id, show_properties, new_line, ellipsized);
+                if (r < 0)
+                        return r;
+                else if (r > 0 && ret == 0)
+                        ret = r;
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        return ret;
+}
+
 static int show_all(
                 const char* verb,
                 sd_bus *bus,
@@ -5297,6 +5593,10 @@ static int show_all(
         unsigned c;
         int r, ret = 0;
 
+        r = show_all_batched(verb, bus, show_properties, new_line, ellipsized);
+        if (r != -EOPNOTSUPP)
+                return r;
+
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
                 return r;
@@ -5653,8 +5953,12 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
                 break;
 
         case ACTION_SYSTEMCTL:
-                method = streq(argv[0], "daemon-reexec") ? "Reexecute" :
-                                     /* "daemon-reload" */ "Reload";
+                if (streq(argv[0], "daemon-reexec"))
+                        method = "Reexecute";
+                else if (arg_if_changed && streq(argv[0], "daemon-reload"))
+                        method = "ReloadIfChanged";
+                else
+                        method = "Reload";
                 break;
 
         default:
@@ -5677,6 +5981,25 @@ static int daemon_reload(int argc, char *argv[], void *userdata) {
 
         r = sd_bus_call(bus, m, DEFAULT_TIMEOUT_USEC * 2, &error, NULL);
 
+        /* Older managers don't know how to skip the reload, do a full one then */
+        if (r < 0 && streq(method, "ReloadIfChanged") &&
+            sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD)) {
+                m = sd_bus_message_unref(m);
+                sd_bus_error_free(&error);
+
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                &m,
+                                "org.freedesktop.systemd1",
+                                "/org/freedesktop/systemd1",
+                                "org.freedesktop.systemd1.Manager",
+                                "Reload");
+                if (r < 0)
+                        return bus_log_create_error(r);
+
+                r = sd_bus_call(bus, m, DEFAULT_TIMEOUT_USEC * 2, &error, NULL);
+        }
+
         /* On reexecution, we expect a disconnect, not a reply */
         if (IN_SET(r, -ETIMEDOUT, -ECONNRESET) && streq(method, "Reexecute"))
                 r = 0;
@@ -7259,6 +7582,7 @@ static void systemctl_help(void) {
                "     --no-block       Do not wait until operation finished\n"
                "     --no-wall        Don't send wall message before halt/power-off/reboot\n"
                "     --no-reload      Don't reload daemon after en-/dis-abling unit files\n"
+               "     --if-changed     Only reload daemon if unit files changed on disk\n"
                "     --no-legend      Do not print a legend (column headers and hints)\n"
                "     --no-pager       Do not pipe output into a pager\n"
                "     --no-ask-password\n"
@@ -7515,6 +7839,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 ARG_NO_WALL,
                 ARG_ROOT,
                 ARG_NO_RELOAD,
+                ARG_IF_CHANGED,
                 ARG_KILL_WHO,
                 ARG_NO_ASK_PASSWORD,
                 ARG_FAILED,
@@ -7561,6 +7886,7 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                 { "root",                required_argument, NULL, ARG_ROOT                },
                 { "force",               no_argument,       NULL, ARG_FORCE               },
                 { "no-reload",           no_argument,       NULL, ARG_NO_RELOAD           },
+                { "if-changed",          no_argument,       NULL, ARG_IF_CHANGED          },
                 { "kill-who",            required_argument, NULL, ARG_KILL_WHO            },
                 { "signal",              required_argument, NULL, 's'                     },
                 { "no-ask-password",     no_argument,       NULL, ARG_NO_ASK_PASSWORD     },
@@ -7786,6 +8112,10 @@ static int systemctl_parse_argv(int argc, char *argv[]) {
                         arg_no_reload = true;
                         break;
 
+                case ARG_IF_CHANGED:
+                        arg_if_changed = true;
+                        break;
+
                 case ARG_KILL_WHO:
                         arg_kill_who = optarg;
                         break;
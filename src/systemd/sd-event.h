@@ -24,6 +24,7 @@
 #include <inttypes.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/inotify.h>
 #include <sys/signalfd.h>
 #include <sys/types.h>
 
@@ -75,6 +76,19 @@ typedef int (*sd_event_child_handler_t)(sd_event_source *s, const siginfo_t *si,
 #else
 typedef void* sd_event_child_handler_t;
 #endif
+typedef int (*sd_event_inotify_handler_t)(sd_event_source *s, const struct inotify_event *event, void *userdata);
+
+#define SD_EVENT_PROFILE_BUCKETS 32
+
+typedef struct sd_event_profile_stats {
+        uint64_t n_dispatched;
+        uint64_t dispatch_usec_total;
+        uint64_t dispatch_usec_max;
+        uint64_t latency_usec_total;
+        uint64_t latency_usec_max;
+        /* Bucket i counts callbacks that took [2^i, 2^(i+1)) µs, bucket 0 also counts those taking less than 1µs */
+        uint64_t histogram[SD_EVENT_PROFILE_BUCKETS];
+} sd_event_profile_stats;
 
 int sd_event_default(sd_event **e);
 
@@ -89,6 +103,7 @@ int sd_event_add_child(sd_event *e, sd_event_source **s, pid_t pid, int options,
 int sd_event_add_defer(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
 int sd_event_add_post(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
 int sd_event_add_exit(sd_event *e, sd_event_source **s, sd_event_handler_t callback, void *userdata);
+int sd_event_add_inotify(sd_event *e, sd_event_source **s, const char *path, uint32_t mask, sd_event_inotify_handler_t callback, void *userdata);
 
 int sd_event_prepare(sd_event *e);
 int sd_event_wait(sd_event *e, uint64_t usec);
@@ -103,9 +118,15 @@ int sd_event_get_fd(sd_event *e);
 int sd_event_get_state(sd_event *e);
 int sd_event_get_tid(sd_event *e, pid_t *tid);
 int sd_event_get_exit_code(sd_event *e, int *code);
+int sd_event_set_batch_max(sd_event *e, unsigned max);
+int sd_event_get_batch_max(sd_event *e, unsigned *ret);
 int sd_event_set_watchdog(sd_event *e, int b);
 int sd_event_get_watchdog(sd_event *e);
 int sd_event_get_iteration(sd_event *e, uint64_t *ret);
+int sd_event_set_profile(sd_event *e, int b);
+int sd_event_get_profile(sd_event *e);
+int sd_event_get_profile_names(sd_event *e, char ***ret);
+int sd_event_get_profile_stats(sd_event *e, const char *name, sd_event_profile_stats *ret);
 
 sd_event_source* sd_event_source_ref(sd_event_source *s);
 sd_event_source* sd_event_source_unref(sd_event_source *s);
@@ -134,6 +155,7 @@ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec);
 int sd_event_source_get_time_clock(sd_event_source *s, clockid_t *clock);
 int sd_event_source_get_signal(sd_event_source *s);
 int sd_event_source_get_child_pid(sd_event_source *s, pid_t *pid);
+int sd_event_source_get_inotify_mask(sd_event_source *s, uint32_t *mask);
 
 /* Define helpers so that __attribute__((cleanup(sd_event_unrefp))) and similar may be used. */
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_event, sd_event_unref);
@@ -40,6 +40,7 @@ int sd_journal_print(int priority, const char *format, ...) _sd_printf_(2, 3);
 int sd_journal_printv(int priority, const char *format, va_list ap) _sd_printf_(2, 0);
 int sd_journal_send(const char *format, ...) _sd_printf_(1, 0) _sd_sentinel_;
 int sd_journal_sendv(const struct iovec *iov, int n);
+int sd_journal_sendv_batch(const struct iovec *iov, int n);
 int sd_journal_perror(const char *message);
 
 /* Used by the macros below. You probably don't want to call this directly. */
@@ -129,6 +130,7 @@ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes);
 
 int sd_journal_query_unique(sd_journal *j, const char *field);
 int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l);
+int sd_journal_enumerate_unique_with_count(sd_journal *j, const void **data, size_t *l, uint64_t *count);
 void sd_journal_restart_unique(sd_journal *j);
 
 int sd_journal_enumerate_fields(sd_journal *j, const char **field);
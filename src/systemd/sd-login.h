@@ -84,6 +84,12 @@ int sd_pid_get_machine_name(pid_t pid, char **machine);
  * hierarchy. */
 int sd_pid_get_cgroup(pid_t pid, char **cgroup);
 
+/* Get all of the above from PID in one go, parsing the cgroup path of
+ * the process only once. Pass NULL for fields that are not needed.
+ * Fields that do not apply to the process are returned as NULL, or
+ * UID_INVALID in case of the owner UID. */
+int sd_pid_get_identity(pid_t pid, char **session, uid_t *owner_uid, char **unit, char **user_unit, char **slice, char **user_slice, char **machine, char **cgroup);
+
 /* Similar to sd_pid_get_session(), but retrieves data about the peer
  * of a connected AF_UNIX socket */
 int sd_peer_get_session(int fd, char **session);
@@ -116,6 +122,10 @@ int sd_peer_get_machine_name(int fd, char **machine);
  * of a connected AF_UNIX socket. */
 int sd_peer_get_cgroup(pid_t pid, char **cgroup);
 
+/* Similar to sd_pid_get_identity(), but retrieves data about the peer
+ * of a connected AF_UNIX socket. */
+int sd_peer_get_identity(int fd, char **session, uid_t *owner_uid, char **unit, char **user_unit, char **slice, char **user_slice, char **machine, char **cgroup);
+
 /* Get state from UID. Possible states: offline, lingering, online, active, closing */
 int sd_uid_get_state(uid_t uid, char **state);
 
@@ -239,6 +249,12 @@ int sd_login_monitor_get_events(sd_login_monitor *m);
 /* Get timeout for poll(), as usec value relative to CLOCK_MONOTONIC's epoch */
 int sd_login_monitor_get_timeout(sd_login_monitor *m, uint64_t *timeout_usec);
 
+/* Get the names of the objects of the specified category ("seat",
+ * "session", "uid" or "machine") that were added, changed or removed
+ * since the last call. Returns -ENOBUFS if events were lost, in which
+ * case everything needs to be enumerated again. */
+int sd_login_monitor_get_changes(sd_login_monitor *m, const char *category, char ***names);
+
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_login_monitor, sd_login_monitor_unref);
 
 _SD_END_DECLARATIONS;
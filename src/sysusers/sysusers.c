@@ -71,6 +71,7 @@ typedef struct Item {
 } Item;
 
 static char *arg_root = NULL;
+static bool arg_nss_check = true;
 
 static const char conf_file_dirs[] = CONF_PATHS_NULSTR("sysusers.d");
 
@@ -80,6 +81,7 @@ static Hashmap *members = NULL;
 
 static Hashmap *database_uid = NULL, *database_user = NULL;
 static Hashmap *database_gid = NULL, *database_group = NULL;
+static Hashmap *nss_uid_cache = NULL, *nss_gid_cache = NULL;
 
 static uid_t search_uid = UID_INVALID;
 static UidRange *uid_range = NULL;
@@ -800,11 +802,64 @@ static int write_files(void) {
         return 0;
 }
 
+static int nss_lookup_id(bool group, uid_t id, const char **ret) {
+        Hashmap **cache = group ? &nss_gid_cache : &nss_uid_cache;
+        _cleanup_free_ char *name = NULL;
+        int r;
+
+        assert(ret);
+
+        /* Returns 1 and the name of the user or group with the given ID if NSS knows it, 0 if it doesn't.
+         * Both user and group IDs are probed for every candidate ID, and usually more than once: when
+         * a user and its group are created, both uid_is_ok() and gid_is_ok() look at the same ID. With
+         * LDAP and friends each lookup might mean a network round trip, hence remember the answers. */
+
+        if (hashmap_contains(*cache, UID_TO_PTR(id))) {
+                *ret = hashmap_get(*cache, UID_TO_PTR(id));
+                return !!*ret;
+        }
+
+        errno = 0;
+        if (group) {
+                struct group *g;
+
+                g = getgrgid((gid_t) id);
+                if (g) {
+                        name = strdup(g->gr_name);
+                        if (!name)
+                                return -ENOMEM;
+                }
+        } else {
+                struct passwd *p;
+
+                p = getpwuid(id);
+                if (p) {
+                        name = strdup(p->pw_name);
+                        if (!name)
+                                return -ENOMEM;
+                }
+        }
+        if (!name && !IN_SET(errno, 0, ENOENT))
+                return -errno;
+
+        r = hashmap_ensure_allocated(cache, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(*cache, UID_TO_PTR(id), name);
+        if (r < 0)
+                return r;
+
+        *ret = name;
+        name = NULL;
+
+        return !!*ret;
+}
+
 static int uid_is_ok(uid_t uid, const char *name) {
-        struct passwd *p;
-        struct group *g;
         const char *n;
         Item *i;
+        int r;
 
         /* Let's see if we already have assigned the UID a second time */
         if (hashmap_get(todo_uids, UID_TO_PTR(uid)))
@@ -825,21 +880,16 @@ static int uid_is_ok(uid_t uid, const char *name) {
                 return 0;
 
         /* Let's also check via NSS, to avoid UID clashes over LDAP and such, just in case */
-        if (!arg_root) {
-                errno = 0;
-                p = getpwuid(uid);
-                if (p)
-                        return 0;
-                if (!IN_SET(errno, 0, ENOENT))
-                        return -errno;
+        if (!arg_root && arg_nss_check) {
+                r = nss_lookup_id(false, uid, &n);
+                if (r != 0)
+                        return r < 0 ? r : 0;
 
-                errno = 0;
-                g = getgrgid((gid_t) uid);
-                if (g) {
-                        if (!streq(g->gr_name, name))
-                                return 0;
-                } else if (!IN_SET(errno, 0, ENOENT))
-                        return -errno;
+                r = nss_lookup_id(true, uid, &n);
+                if (r < 0)
+                        return r;
+                if (r > 0 && !streq(n, name))
+                        return 0;
         }
 
         return 1;
@@ -1027,8 +1077,8 @@ static int add_user(Item *i) {
 }
 
 static int gid_is_ok(gid_t gid) {
-        struct group *g;
-        struct passwd *p;
+        const char *n;
+        int r;
 
         if (hashmap_get(todo_gids, GID_TO_PTR(gid)))
                 return 0;
@@ -1043,20 +1093,14 @@ static int gid_is_ok(gid_t gid) {
         if (hashmap_contains(database_uid, UID_TO_PTR(gid)))
                 return 0;
 
-        if (!arg_root) {
-                errno = 0;
-                g = getgrgid(gid);
-                if (g)
-                        return 0;
-                if (!IN_SET(errno, 0, ENOENT))
-                        return -errno;
+        if (!arg_root && arg_nss_check) {
+                r = nss_lookup_id(true, (uid_t) gid, &n);
+                if (r != 0)
+                        return r < 0 ? r : 0;
 
-                errno = 0;
-                p = getpwuid((uid_t) gid);
-                if (p)
-                        return 0;
-                if (!IN_SET(errno, 0, ENOENT))
-                        return -errno;
+                r = nss_lookup_id(false, (uid_t) gid, &n);
+                if (r != 0)
+                        return r < 0 ? r : 0;
         }
 
         return 1;
@@ -1714,6 +1758,7 @@ static void help(void) {
                "  -h --help                 Show this help\n"
                "     --version              Show package version\n"
                "     --root=PATH            Operate on an alternate filesystem root\n"
+               "     --no-nss-check         Don't check allocated IDs against NSS\n"
                , program_invocation_short_name);
 }
 
@@ -1722,12 +1767,14 @@ static int parse_argv(int argc, char *argv[]) {
         enum {
                 ARG_VERSION = 0x100,
                 ARG_ROOT,
+                ARG_NO_NSS_CHECK,
         };
 
         static const struct option options[] = {
-                { "help",    no_argument,       NULL, 'h'         },
-                { "version", no_argument,       NULL, ARG_VERSION },
-                { "root",    required_argument, NULL, ARG_ROOT    },
+                { "help",         no_argument,       NULL, 'h'              },
+                { "version",      no_argument,       NULL, ARG_VERSION      },
+                { "root",         required_argument, NULL, ARG_ROOT         },
+                { "no-nss-check", no_argument,       NULL, ARG_NO_NSS_CHECK },
                 {}
         };
 
@@ -1753,6 +1800,10 @@ static int parse_argv(int argc, char *argv[]) {
                                 return r;
                         break;
 
+                case ARG_NO_NSS_CHECK:
+                        arg_nss_check = false;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -1876,6 +1927,9 @@ finish:
         hashmap_free(todo_uids);
         hashmap_free(todo_gids);
 
+        hashmap_free_free(nss_uid_cache);
+        hashmap_free_free(nss_gid_cache);
+
         free_database(database_user, database_uid);
         free_database(database_group, database_gid);
 
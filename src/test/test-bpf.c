@@ -42,7 +42,7 @@ int main(int argc, char *argv[]) {
         CGroupContext *cc = NULL;
         _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
         Manager *m = NULL;
-        Unit *u;
+        Unit *u, *u2, *u3;
         char log_buf[65535];
         int r;
 
@@ -162,6 +162,27 @@ int main(int argc, char *argv[]) {
         assert_se(SERVICE(u)->exec_command[SERVICE_EXEC_START]->command_next->exec_status.code != CLD_EXITED ||
                   SERVICE(u)->exec_command[SERVICE_EXEC_START]->command_next->exec_status.status != EXIT_SUCCESS);
 
+        /* Units with identical access lists and no accounting share their access maps and programs */
+        assert_se(u2 = unit_new(m, sizeof(Service)));
+        assert_se(unit_add_name(u2, "bar.service") == 0);
+        assert_se(u3 = unit_new(m, sizeof(Service)));
+        assert_se(unit_add_name(u3, "quux.service") == 0);
+        u2->perpetual = u3->perpetual = true;
+
+        assert_se(cc = unit_get_cgroup_context(u2));
+        assert_se(config_parse_ip_address_access(u2->id, "filename", 1, "Service", 1, "IPAddressDeny", 0, "127.0.0.3", &cc->ip_address_deny, NULL) == 0);
+        assert_se(cc = unit_get_cgroup_context(u3));
+        assert_se(config_parse_ip_address_access(u3->id, "filename", 1, "Service", 1, "IPAddressDeny", 0, "127.0.0.3", &cc->ip_address_deny, NULL) == 0);
+
+        assert_se(bpf_firewall_compile(u2) >= 0);
+        assert_se(bpf_firewall_compile(u3) >= 0);
+
+        assert_se(u2->ip_bpf_policy);
+        assert_se(u2->ip_bpf_policy == u3->ip_bpf_policy);
+        assert_se(u2->ip_bpf_policy != u->ip_bpf_policy);
+        assert_se(u2->ip_bpf_ingress && u2->ip_bpf_ingress == u3->ip_bpf_ingress);
+        assert_se(u2->ip_bpf_egress && u2->ip_bpf_egress == u3->ip_bpf_egress);
+
         manager_free(m);
 
         return 0;
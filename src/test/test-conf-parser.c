@@ -25,6 +25,7 @@
 #include "macro.h"
 #include "string-util.h"
 #include "strv.h"
+#include "utf8.h"
 #include "util.h"
 
 static void test_config_parse_path_one(const char *rvalue, const char *expected) {
@@ -274,6 +275,16 @@ static const char* const config_file[] = {
         "[Section]\n"
         "setting1="          /* many continuation lines, together above the limit */
         x1000(x1000("x") x10("abcde") "\\\n") "xxx",
+
+        UTF8_BYTE_ORDER_MARK
+        "[Section]\n"
+        "setting1=1\n"
+        "[Unknown]\n"       /* ignored section in between */
+        "setting1=2\n"
+        "[Section]\n"
+        "setting1=3\\\n"  /* several continuations in a row */
+        "\\\n"
+        "4\n",
 };
 
 static void test_config_parse(unsigned i, const char *s) {
@@ -344,6 +355,11 @@ static void test_config_parse(unsigned i, const char *s) {
                 assert_se(r == -ENOBUFS);
                 assert_se(setting1 == NULL);
                 break;
+
+        case 10:
+                assert_se(r == 0);
+                assert_se(streq(setting1, "3  4"));
+                break;
         }
 }
 
@@ -161,6 +161,81 @@ static void test_copy_tree(void) {
         (void) rm_rf(original_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
 }
 
+typedef struct CopyProgress {
+        uint64_t n_bytes;
+        unsigned n_paths;
+} CopyProgress;
+
+static int copy_progress_bytes(uint64_t n_bytes, void *userdata) {
+        CopyProgress *p = userdata;
+
+        p->n_bytes += n_bytes;
+        return 0;
+}
+
+static int copy_progress_path(const char *path, const struct stat *st, void *userdata) {
+        CopyProgress *p = userdata;
+
+        assert_se(path);
+        assert_se(!path_is_absolute(path));
+
+        p->n_paths++;
+        return 0;
+}
+
+static void test_copy_tree_parallel(void) {
+        char original_dir[] = "/tmp/test-copy_tree_parallel-XXXXXX";
+        const char *copy_dir = "/tmp/test-copy_tree_parallel-copy";
+        CopyProgress progress = {};
+        uint64_t n_bytes = 0;
+        unsigned i;
+
+        log_info("%s", __func__);
+
+        assert_se(mkdtemp(original_dir));
+        (void) rm_rf(copy_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+
+        /* Enough files to keep the queue full, some larger than the copy buffer */
+        for (i = 0; i < 100; i++) {
+                _cleanup_free_ char *f = NULL, *contents = NULL;
+
+                assert_se(asprintf(&f, "%s/dir%u/file%u", original_dir, i % 7, i) >= 0);
+                assert_se(contents = malloc(i * 512 + 1));
+                memset(contents, 'a' + i % 26, i * 512);
+                contents[i * 512] = 0;
+
+                assert_se(mkdir_parents(f, 0755) >= 0);
+                assert_se(write_string_file(f, contents, WRITE_STRING_FILE_CREATE) == 0);
+                n_bytes += i * 512 + 1;
+        }
+
+        assert_se(copy_tree_at_full(AT_FDCWD, original_dir, AT_FDCWD, copy_dir, UID_INVALID, GID_INVALID,
+                                    COPY_REFLINK|COPY_PARALLEL,
+                                    copy_progress_path, copy_progress_bytes, &progress) == 0);
+
+        assert_se(progress.n_paths == 100 + 7);
+        assert_se(progress.n_bytes == n_bytes);
+
+        for (i = 0; i < 100; i++) {
+                _cleanup_free_ char *f = NULL, *buf = NULL;
+                size_t sz = 0, j;
+
+                assert_se(asprintf(&f, "%s/dir%u/file%u", copy_dir, i % 7, i) >= 0);
+                assert_se(read_full_file(f, &buf, &sz) == 0);
+                assert_se(sz == i * 512 + 1);
+
+                for (j = 0; j < i * 512; j++)
+                        assert_se(buf[j] == 'a' + (char) (i % 26));
+                assert_se(buf[j] == '\n');
+        }
+
+        /* Without COPY_MERGE copying on top of an existing tree fails */
+        assert_se(copy_tree(original_dir, copy_dir, UID_INVALID, GID_INVALID, COPY_PARALLEL) < 0);
+
+        (void) rm_rf(copy_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+        (void) rm_rf(original_dir, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static void test_copy_bytes(void) {
         _cleanup_close_pair_ int pipefd[2] = {-1, -1};
         _cleanup_close_ int infd = -1;
@@ -257,6 +332,7 @@ int main(int argc, char *argv[]) {
         test_copy_file();
         test_copy_file_fd();
         test_copy_tree();
+        test_copy_tree_parallel();
         test_copy_bytes();
         test_copy_bytes_regular_file(argv[0], false, (uint64_t) -1);
         test_copy_bytes_regular_file(argv[0], true, (uint64_t) -1);
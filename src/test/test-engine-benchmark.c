@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "bus-error.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "manager.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "test-helper.h"
+#include "tests.h"
+#include "unit.h"
+
+#define N_TRANSACTIONS 10U
+
+/* A synthetic, reproducible set of units: bench-0.service is the root of a binary tree, each unit pulls in
+ * and is ordered before its two children. Starting the root hence pulls in all of them. */
+static void write_units(const char *dir, unsigned n) {
+        unsigned i;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_fclose_ FILE *f = NULL;
+                char fn[strlen(dir) + sizeof("/bench-.service") + DECIMAL_STR_MAX(unsigned)];
+                unsigned k;
+
+                xsprintf(fn, "%s/bench-%u.service", dir, i);
+                assert_se(f = fopen(fn, "we"));
+
+                fprintf(f,
+                        "[Unit]\n"
+                        "Description=Benchmark unit %u\n"
+                        "DefaultDependencies=no\n",
+                        i);
+
+                for (k = 2 * i + 1; k <= 2 * i + 2 && k < n; k++)
+                        fprintf(f,
+                                "Wants=bench-%u.service\n"
+                                "Before=bench-%u.service\n",
+                                k, k);
+
+                fputs("\n"
+                      "[Service]\n"
+                      "Type=oneshot\n"
+                      "ExecStart=/bin/true\n", f);
+
+                assert_se(fflush_and_check(f) >= 0);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL, *unit_dir = NULL;
+        char t[] = "/tmp/test-engine-benchmark-XXXXXX", name[DECIMAL_STR_MAX(unsigned) + 32];
+        Manager *m = NULL;
+        Unit *root;
+        unsigned n, i;
+        usec_t ts;
+        int r;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+        else
+                n = slow_tests_enabled() ? 10000 : 500;
+
+        r = enter_cgroup_subroot();
+        if (r == -ENOMEDIUM) {
+                log_notice_errno(r, "Skipping test: cgroupfs not available");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp(t));
+        assert_se(unit_dir = strdup(t));
+        write_units(unit_dir, n);
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (MANAGER_SKIP_TEST(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                return EXIT_TEST_SKIP;
+        }
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        /* Loading the root pulls all other units into the load queue, which is dispatched before this
+         * returns. */
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_load_unit(m, "bench-0.service", NULL, NULL, &root) >= 0);
+        xsprintf(name, "manager.load.%u", n);
+        benchmark_report(name, n, now(CLOCK_MONOTONIC) - ts);
+        assert_se(root->load_state == UNIT_LOADED);
+        assert_se(hashmap_size(m->units) >= n);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < N_TRANSACTIONS; i++) {
+                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+
+                r = manager_add_job(m, JOB_START, root, JOB_REPLACE, &error, NULL);
+                if (r < 0)
+                        log_error("Failed to add job: %s", bus_error_message(&error, r));
+                assert_se(r >= 0);
+                assert_se(hashmap_size(m->jobs) == n);
+
+                manager_clear_jobs(m);
+        }
+        xsprintf(name, "manager.transaction.%u", n);
+        benchmark_report(name, N_TRANSACTIONS, now(CLOCK_MONOTONIC) - ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(manager_reload(m) >= 0);
+        xsprintf(name, "manager.reload.%u", n);
+        benchmark_report(name, 1, now(CLOCK_MONOTONIC) - ts);
+        assert_se(manager_get_unit(m, "bench-0.service"));
+
+        manager_free(m);
+
+        return 0;
+}
@@ -68,8 +68,15 @@ int main(int argc, char *argv[]) {
         assert_se(r == 0);
         manager_dump_jobs(m, stdout, "\t");
 
+        /* a is ordered before b, hence b has to wait for a's job */
+        assert_se(a->job && b->job);
+        assert_se(b->n_after_jobs == 1);
+        assert_se(a->n_after_jobs == 0);
+        assert_se(a->n_before_stop_jobs == 0);
+
         printf("Load2:\n");
         manager_clear_jobs(m);
+        assert_se(b->n_after_jobs == 0);
         assert_se(manager_load_unit(m, "d.service", NULL, NULL, &d) >= 0);
         assert_se(manager_load_unit(m, "e.service", NULL, NULL, &e) >= 0);
         manager_dump_units(m, stdout, "\t");
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+/* Compare builds with and without -Dhashmap-simd-probe=true by running this with the same
+ * arguments: "test-hashmap-benchmark [MAX_ENTRIES]". */
+
+typedef struct Keys {
+        unsigned n;
+        void **hit;
+        void **miss;
+        bool strings;
+} Keys;
+
+static void keys_done(Keys *k) {
+        unsigned i;
+
+        if (k->strings)
+                for (i = 0; i < k->n; i++) {
+                        free(k->hit[i]);
+                        free(k->miss[i]);
+                }
+
+        free(k->hit);
+        free(k->miss);
+}
+
+static void keys_init(Keys *k, bool strings, unsigned n) {
+        unsigned i;
+
+        *k = (Keys) {
+                .n = n,
+                .strings = strings,
+        };
+
+        assert_se(k->hit = new(void*, n));
+        assert_se(k->miss = new(void*, n));
+
+        for (i = 0; i < n; i++)
+                if (strings) {
+                        assert_se(asprintf((char**) &k->hit[i], "hit-%u", i) >= 0);
+                        assert_se(asprintf((char**) &k->miss[i], "miss-%u", i) >= 0);
+                } else {
+                        k->hit[i] = UINT_TO_PTR(i + 1);
+                        k->miss[i] = UINT_TO_PTR(n + i + 1);
+                }
+}
+
+static void report(const char *type, const Keys *k, const char *op, usec_t start) {
+        char name[strlen(type) + strlen(op) + DECIMAL_STR_MAX(unsigned) + 32];
+
+        xsprintf(name, "hashmap.%s.%s.%s.%u", type, k->strings ? "string" : "pointer", op, k->n);
+        benchmark_report(name, k->n, now(CLOCK_MONOTONIC) - start);
+}
+
+static void benchmark_plain(const Keys *k) {
+        Hashmap *h;
+        unsigned i, found = 0;
+        Iterator j;
+        usec_t ts;
+        void *v;
+
+        assert_se(h = hashmap_new(k->strings ? &string_hash_ops : &trivial_hash_ops));
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < k->n; i++)
+                assert_se(hashmap_put(h, k->hit[i], k->hit[i]) > 0);
+        report("plain", k, "insert", ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < k->n; i++)
+                found += !!hashmap_get(h, k->hit[i]);
+        report("plain", k, "hit", ts);
+        assert_se(found == k->n);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < k->n; i++)
+                found -= !!hashmap_get(h, k->miss[i]);
+        report("plain", k, "miss", ts);
+        assert_se(found == k->n);
+
+        ts = now(CLOCK_MONOTONIC);
+        HASHMAP_FOREACH(v, h, j)
+                found--;
+        report("plain", k, "iterate", ts);
+        assert_se(found == 0);
+
+        hashmap_free(h);
+}
+
+static void benchmark_ordered(const Keys *k) {
+        OrderedHashmap *h;
+        unsigned i, found = 0;
+        Iterator j;
+        usec_t ts;
+        void *v;
+
+        assert_se(h = ordered_hashmap_new(k->strings ? &string_hash_ops : &trivial_hash_ops));
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < k->n; i++)
+                assert_se(ordered_hashmap_put(h, k->hit[i], k->hit[i]) > 0);
+        report("ordered", k, "insert", ts);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < k->n; i++)
+                found += !!ordered_hashmap_get(h, k->hit[i]);
+        report("ordered", k, "hit", ts);
+        assert_se(found == k->n);
+
+        ts = now(CLOCK_MONOTONIC);
+        for (i = 0; i < k->n; i++)
+                found -= !!ordered_hashmap_get(h, k->miss[i]);
+        report("ordered", k, "miss", ts);
+        assert_se(found == k->n);
+
+        ts = now(CLOCK_MONOTONIC);
+        ORDERED_HASHMAP_FOREACH(v, h, j)
+                found--;
+        report("ordered", k, "iterate", ts);
+        assert_se(found == 0);
+
+        ordered_hashmap_free(h);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n, max;
+
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &max) >= 0);
+        else
+                max = slow_tests_enabled() ? 10000000 : 10000;
+
+        log_info("SIMD probing %s", ENABLE_HASHMAP_SIMD_PROBE ? "enabled" : "disabled");
+
+        for (n = 10; n <= max; n *= 10) {
+                Keys k;
+
+                keys_init(&k, false, n);
+                benchmark_plain(&k);
+                benchmark_ordered(&k);
+                keys_done(&k);
+
+                keys_init(&k, true, n);
+                benchmark_plain(&k);
+                benchmark_ordered(&k);
+                keys_done(&k);
+        }
+
+        return 0;
+}
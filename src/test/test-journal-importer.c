@@ -21,11 +21,18 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 
+#include "env-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
 #include "log.h"
 #include "journal-importer.h"
+#include "parse-util.h"
 #include "string-util.h"
 #include "tests.h"
+#include "unaligned.h"
 
 static void assert_iovec_entry(const struct iovec *iovec, const char* content) {
         assert_se(strlen(content) == iovec->iov_len);
@@ -80,12 +87,118 @@ static void test_bad_input(void) {
         assert_se(journal_importer_eof(&imp));
 }
 
+static int make_export(size_t size) {
+        _cleanup_close_ int fd = -1;
+        char buf[LINE_CHUNK];
+        size_t written = 0, n;
+        unsigned i;
+        int r;
+
+        /* An export stream that looks roughly like what journal-upload sends,
+         * including one binary field per entry */
+
+        fd = open_tmpfile_unlinkable(NULL, O_RDWR|O_CLOEXEC);
+        assert_se(fd >= 0);
+
+        for (i = 0; written < size; i++) {
+                uint8_t le[8];
+
+                n = snprintf(buf, sizeof(buf),
+                             "__CURSOR=s=0;i=%u\n"
+                             "__REALTIME_TIMESTAMP=%u\n"
+                             "__MONOTONIC_TIMESTAMP=%u\n"
+                             "_BOOT_ID=1531fd22ec84429e85ae888b12fadb91\n"
+                             "_TRANSPORT=journal\n"
+                             "_HOSTNAME=host%u.example.com\n"
+                             "_PID=%u\n"
+                             "_COMM=benchmark\n"
+                             "PRIORITY=6\n"
+                             "MESSAGE=This is message number %u, and it is not very long.\n"
+                             "BINARY\n",
+                             i, 1478389147u + i, 1000u + i, i % 3000, i % 32768, i);
+                assert_se(n < sizeof(buf));
+                assert_se(loop_write(fd, buf, n, false) >= 0);
+                written += n;
+
+                unaligned_write_le64(le, 4);
+                assert_se(loop_write(fd, le, sizeof(le), false) >= 0);
+                assert_se(loop_write(fd, "a\nb\n\n\n", 6, false) >= 0);
+                written += sizeof(le) + 6;
+        }
+
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+
+        r = fd;
+        fd = -1;
+        return r;
+}
+
+static void test_performance(size_t size) {
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = {};
+        const char *path;
+        uint64_t entries = 0, fields = 0, bytes = 0;
+        usec_t start, t;
+        int r;
+
+        /* Pass SYSTEMD_TEST_JOURNAL_EXPORT= to replay the output of "journalctl -o export" instead */
+        path = getenv("SYSTEMD_TEST_JOURNAL_EXPORT");
+        if (path) {
+                imp.fd = open(path, O_RDONLY|O_CLOEXEC);
+                assert_se(imp.fd >= 0);
+        } else
+                imp.fd = make_export(size);
+
+        start = now(CLOCK_MONOTONIC);
+
+        for (;;) {
+                r = journal_importer_process_data(&imp);
+                assert_se(r >= 0);
+                if (journal_importer_eof(&imp))
+                        break;
+                if (r == 0)
+                        continue;
+
+                entries++;
+                fields += imp.iovw.count;
+                bytes += iovw_size(&imp.iovw);
+
+                journal_importer_drop_iovw(&imp);
+        }
+
+        t = now(CLOCK_MONOTONIC) - start;
+
+        if (!path)
+                assert_se(entries > 0 && fields == entries * 8);
+
+        log_info("Parsed %" PRIu64 " entries with %" PRIu64 " fields and %" PRIu64 " bytes of payload in %.2fs (%.2fMiB/s)",
+                 entries, fields, bytes, t / 1e6,
+                 bytes / 1024. / 1024 / MAX(t / 1e6, 1e-6));
+}
+
 int main(int argc, char **argv) {
+        size_t size = 0;
+        int r;
+
         log_set_max_level(LOG_DEBUG);
         log_parse_environment();
 
         test_basic_parsing();
         test_bad_input();
 
+        log_set_max_level(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atozu(argv[1], &size) >= 0);
+        else {
+                bool slow;
+
+                r = getenv_bool("SYSTEMD_SLOW_TESTS");
+                slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
+
+                size = slow ? 1024*1024*1024 : 4*1024*1024;
+        }
+
+        test_performance(size);
+
         return 0;
 }
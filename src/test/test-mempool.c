@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "macro.h"
+#include "mempool.h"
+#include "string-util.h"
+
+struct tile {
+        uint64_t a, b, c;
+};
+
+DEFINE_MEMPOOL(tile_pool, struct tile, 4);
+
+static void test_mempool(void) {
+        _cleanup_free_ char *buf = NULL;
+        struct tile *t[100];
+        size_t size = 0;
+        unsigned i;
+        FILE *f;
+
+        assert_se(streq(tile_pool.name, "struct tile"));
+        assert_se(tile_pool.n_used == 0);
+
+        for (i = 0; i < ELEMENTSOF(t); i++) {
+                t[i] = mempool_alloc0_tile(&tile_pool);
+                assert_se(t[i]);
+                assert_se(t[i]->a == 0 && t[i]->b == 0 && t[i]->c == 0);
+                t[i]->a = i;
+        }
+
+        assert_se(tile_pool.n_used == ELEMENTSOF(t));
+        assert_se(tile_pool.n_used_max == ELEMENTSOF(t));
+        assert_se(tile_pool.n_tiles >= ELEMENTSOF(t));
+
+        for (i = 0; i < ELEMENTSOF(t); i++)
+                assert_se(t[i]->a == i);
+
+        for (i = 0; i < ELEMENTSOF(t) / 2; i++)
+                mempool_free_tile(&tile_pool, t[i]);
+
+        assert_se(tile_pool.n_used == ELEMENTSOF(t) / 2);
+        assert_se(tile_pool.n_used_max == ELEMENTSOF(t));
+
+        /* Released tiles are handed out again before the pool grows */
+        i = tile_pool.n_tiles;
+        t[0] = mempool_alloc_tile(&tile_pool);
+        assert_se(t[0]);
+        assert_se(tile_pool.n_tiles == i);
+        assert_se(tile_pool.n_used == ELEMENTSOF(t) / 2 + 1);
+
+        f = open_memstream(&buf, &size);
+        assert_se(f);
+        mempool_dump_all(f);
+        assert_se(fclose(f) == 0);
+
+        printf("%s", buf);
+        assert_se(strstr(buf, "Memory pool struct tile: 51 objects in use (100 at most)"));
+}
+
+int main(int argc, char *argv[]) {
+        test_mempool();
+
+        return 0;
+}
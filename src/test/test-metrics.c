@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "log.h"
+#include "macro.h"
+#include "metrics.h"
+#include "string-util.h"
+
+typedef struct Object {
+        unsigned n_small;
+        uint64_t n_large;
+        Histogram latency;
+} Object;
+
+static uint64_t get_constant(void *userdata) {
+        return 4711;
+}
+
+static const MetricDescriptor metrics[] = {
+        METRIC_FIELD("test.small", METRIC_COUNTER, Object, n_small),
+        METRIC_FIELD("test.large", METRIC_GAUGE, Object, n_large),
+        METRIC_FUNC("test.constant", METRIC_GAUGE, get_constant),
+        METRIC_HISTOGRAM_FIELD("test.latency_usec", Object, latency),
+        METRIC_END
+};
+
+static void test_metric_type(void) {
+        MetricType t;
+
+        for (t = 0; t < _METRIC_TYPE_MAX; t++)
+                assert_se(metric_type_from_string(metric_type_to_string(t)) == t);
+
+        assert_se(metric_type_from_string("foo") < 0);
+}
+
+static void test_histogram(void) {
+        Histogram h = {};
+
+        histogram_add(&h, 0);
+        histogram_add(&h, 1);
+        histogram_add(&h, 2);
+        histogram_add(&h, 3);
+        histogram_add(&h, 4);
+        histogram_add(&h, UINT64_MAX);
+
+        assert_se(h.buckets[0] == 1);
+        assert_se(h.buckets[1] == 1);
+        assert_se(h.buckets[2] == 2);
+        assert_se(h.buckets[3] == 1);
+        assert_se(h.buckets[HISTOGRAM_BUCKETS - 1] == 1);
+        assert_se(h.count == 6);
+        assert_se(h.sum == UINT64_MAX + 10); /* wraps, that's fine */
+}
+
+static void test_metrics_dump(void) {
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        Object o = {
+                .n_small = 7,
+                .n_large = UINT64_C(1) << 40,
+        };
+        size_t sz = 0;
+
+        histogram_add(&o.latency, 0);
+        histogram_add(&o.latency, 5);
+        histogram_add(&o.latency, 6);
+
+        assert_se(f = open_memstream(&buf, &sz));
+        assert_se(metrics_dump(metrics, &o, f, "\t") >= 0);
+        f = safe_fclose(f);
+
+        log_info("%s", buf);
+
+        assert_se(streq(buf,
+                        "\ttest.small (counter): 7\n"
+                        "\ttest.large (gauge): 1099511627776\n"
+                        "\ttest.constant (gauge): 4711\n"
+                        "\ttest.latency_usec.le.0 (histogram): 1\n"
+                        "\ttest.latency_usec.le.1 (histogram): 1\n"
+                        "\ttest.latency_usec.le.3 (histogram): 1\n"
+                        "\ttest.latency_usec.le.7 (histogram): 3\n"
+                        "\ttest.latency_usec.count (histogram): 3\n"
+                        "\ttest.latency_usec.sum (histogram): 11\n"));
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_metric_type();
+        test_histogram();
+        test_metrics_dump();
+
+        return 0;
+}
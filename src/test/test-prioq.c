@@ -21,9 +21,12 @@
 #include <stdlib.h>
 
 #include "alloc-util.h"
+#include "env-util.h"
+#include "log.h"
 #include "prioq.h"
 #include "set.h"
 #include "siphash24.h"
+#include "time-util.h"
 #include "util.h"
 
 #define SET_SIZE 1024*4
@@ -89,6 +92,12 @@ static int test_compare(const void *a, const void *b) {
         return 0;
 }
 
+static uint64_t test_key(const void *a) {
+        const struct test *x = a;
+
+        return x->value;
+}
+
 static void test_hash(const void *a, struct siphash *state) {
         const struct test *x = a;
 
@@ -100,7 +109,7 @@ static const struct hash_ops test_hash_ops = {
         .compare = test_compare
 };
 
-static void test_struct(void) {
+static void test_struct(bool keyed) {
         Prioq *q;
         Set *s;
         unsigned previous = 0, i;
@@ -108,7 +117,7 @@ static void test_struct(void) {
 
         srand(0);
 
-        q = prioq_new(test_compare);
+        q = keyed ? prioq_new_keyed(test_key) : prioq_new(test_compare);
         assert_se(q);
 
         s = set_new(&test_hash_ops);
@@ -163,10 +172,116 @@ static void test_struct(void) {
         set_free(s);
 }
 
+static void test_reshuffle(bool keyed) {
+        struct test *buffer;
+        unsigned previous = 0, i;
+        Prioq *q;
+
+        srand(0);
+
+        q = keyed ? prioq_new_keyed(test_key) : prioq_new(test_compare);
+        assert_se(q);
+
+        buffer = new0(struct test, SET_SIZE);
+        assert_se(buffer);
+
+        for (i = 0; i < SET_SIZE; i++) {
+                buffer[i].value = (unsigned) rand();
+                assert_se(prioq_put(q, buffer + i, &buffer[i].idx) >= 0);
+        }
+
+        /* Move every other entry, in both directions */
+        for (i = 0; i < SET_SIZE; i += 2) {
+                buffer[i].value = (unsigned) rand();
+                assert_se(prioq_reshuffle(q, buffer + i, &buffer[i].idx) > 0);
+        }
+
+        for (i = 0; i < SET_SIZE; i++) {
+                struct test *t;
+
+                t = prioq_pop(q);
+                assert_se(t);
+
+                assert_se(previous <= t->value);
+                previous = t->value;
+        }
+
+        assert_se(prioq_isempty(q));
+        prioq_free(q);
+        free(buffer);
+}
+
+static usec_t benchmark_one(bool keyed, unsigned n) {
+        struct test *buffer;
+        usec_t ts;
+        unsigned i;
+        Prioq *q;
+
+        buffer = new0(struct test, n);
+        assert_se(buffer);
+
+        srand(0);
+        for (i = 0; i < n; i++)
+                buffer[i].value = (unsigned) rand();
+
+        ts = now(CLOCK_MONOTONIC);
+
+        q = keyed ? prioq_new_keyed(test_key) : prioq_new(test_compare);
+        assert_se(q);
+
+        for (i = 0; i < n; i++)
+                assert_se(prioq_put(q, buffer + i, &buffer[i].idx) >= 0);
+
+        /* Mimic the timer queues: the head is looked at, rescheduled and looked at again */
+        for (i = 0; i < n; i++) {
+                struct test *t;
+
+                t = prioq_peek(q);
+                t->value += (unsigned) rand() % 1024;
+                assert_se(prioq_reshuffle(q, t, &t->idx) > 0);
+        }
+
+        while (prioq_pop(q))
+                ;
+
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        prioq_free(q);
+        free(buffer);
+
+        return ts;
+}
+
+static void test_benchmark(bool slow) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n = slow ? 1000000 : 100000;
+        usec_t binary, keyed;
+
+        binary = benchmark_one(false, n);
+        keyed = benchmark_one(true, n);
+
+        log_info("%u entries: compare function %s, keyed %s",
+                 n,
+                 format_timespan(a, sizeof a, binary, 1),
+                 format_timespan(b, sizeof b, keyed, 1));
+}
+
 int main(int argc, char* argv[]) {
+        bool slow;
+        int r;
+
+        log_parse_environment();
+        log_open();
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        slow = r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT;
 
         test_unsigned();
-        test_struct();
+        test_struct(false);
+        test_struct(true);
+        test_reshuffle(false);
+        test_reshuffle(true);
+        test_benchmark(slow);
 
         return 0;
 }
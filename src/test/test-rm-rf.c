@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "log.h"
+#include "macro.h"
+#include "mkdir.h"
+#include "rm-rf.h"
+#include "string-util.h"
+
+static void make_tree(const char *top, unsigned depth, unsigned width) {
+        unsigned i;
+
+        for (i = 0; i < width; i++) {
+                _cleanup_free_ char *f = NULL, *d = NULL;
+
+                assert_se(asprintf(&f, "%s/file%u", top, i) >= 0);
+                assert_se(write_string_file(f, "file", WRITE_STRING_FILE_CREATE) >= 0);
+
+                if (depth == 0)
+                        continue;
+
+                assert_se(asprintf(&d, "%s/dir%u", top, i) >= 0);
+                assert_se(mkdir(d, 0755) >= 0);
+
+                make_tree(d, depth - 1, width);
+        }
+}
+
+static void test_rm_rf(RemoveFlags flags) {
+        char t[] = "/tmp/test-rm-rf-XXXXXX";
+        const char *f;
+
+        log_info("%s flags=%i", __func__, flags);
+
+        assert_se(mkdtemp(t));
+        make_tree(t, 4, 6);
+
+        /* Only directories, all files are left in place, hence nothing but the empty leaves may go */
+        assert_se(rm_rf(t, REMOVE_PHYSICAL|REMOVE_ONLY_DIRECTORIES|flags) < 0);
+        f = strjoina(t, "/dir0/dir1/dir2/file3");
+        assert_se(access(f, F_OK) >= 0);
+
+        assert_se(rm_rf(t, REMOVE_PHYSICAL|flags) >= 0);
+        assert_se(access(t, F_OK) >= 0);
+        f = strjoina(t, "/file0");
+        assert_se(access(f, F_OK) < 0 && errno == ENOENT);
+        f = strjoina(t, "/dir0");
+        assert_se(access(f, F_OK) < 0 && errno == ENOENT);
+
+        make_tree(t, 2, 3);
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL|flags) >= 0);
+        assert_se(access(t, F_OK) < 0 && errno == ENOENT);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_rm_rf(0);
+        test_rm_rf(REMOVE_PARALLEL);
+
+        return 0;
+}
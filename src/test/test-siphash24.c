@@ -18,7 +18,10 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include "env-util.h"
+#include "log.h"
 #include "siphash24.h"
+#include "time-util.h"
 #include "util.h"
 
 #define ITERATIONS 10000000ULL
@@ -103,6 +106,69 @@ static void test_short_hashes(void) {
         }
 }
 
+static void test_siphash13(const uint8_t *in, size_t len, const uint8_t *key) {
+        struct siphash state;
+        uint64_t out;
+        unsigned i, j;
+
+        out = siphash13(in, len, key);
+        assert_se(out != siphash24(in, len, key));
+
+        /* Same initial state, only the number of rounds differs */
+        siphash13_init(&state, key);
+        assert_se(state.v0 == 0x7469686173716475);
+        assert_se(state.v1 == 0x6b617f6d656e6665);
+        assert_se(state.v2 == 0x6b7f62616d677361);
+        assert_se(state.v3 == 0x7b6b696e727e6c7b);
+
+        for (i = 0; i < len; i++) {
+                for (j = i; j < len; j++) {
+                        siphash13_init(&state, key);
+                        siphash24_compress(in, i, &state);
+                        siphash24_compress(&in[i], j - i, &state);
+                        siphash24_compress(&in[j], len - j, &state);
+                        assert_se(siphash24_finalize(&state) == out);
+                }
+        }
+}
+
+static void test_throughput(bool slow) {
+        const uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                  0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+        /* Typical of what ends up in hashmaps: a unit name, and a longer path */
+        static const char *const inputs[] = {
+                "systemd-journald.service",
+                "/var/log/journal/0123456789abcdef0123456789abcdef/system@0123456789abcdef.journal",
+        };
+        unsigned long long n = slow ? ITERATIONS : ITERATIONS / 100, k;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        uint64_t sum = 0;
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(inputs); i++) {
+                size_t l = strlen(inputs[i]);
+                usec_t t24, t13;
+
+                t24 = now(CLOCK_MONOTONIC);
+                for (k = 0; k < n; k++)
+                        sum += siphash24(inputs[i], l, key);
+                t24 = now(CLOCK_MONOTONIC) - t24;
+
+                t13 = now(CLOCK_MONOTONIC);
+                for (k = 0; k < n; k++)
+                        sum += siphash13(inputs[i], l, key);
+                t13 = now(CLOCK_MONOTONIC) - t13;
+
+                log_info("%zu bytes, %llu times: SipHash-2-4 %s (%.1f MiB/s), SipHash-1-3 %s (%.1f MiB/s)",
+                         l, n,
+                         format_timespan(a, sizeof a, t24, 1), (double) l * n / MAX(t24, 1U) * USEC_PER_SEC / 1024 / 1024,
+                         format_timespan(b, sizeof b, t13, 1), (double) l * n / MAX(t13, 1U) * USEC_PER_SEC / 1024 / 1024);
+        }
+
+        /* Make sure the loops are not optimized away */
+        log_debug("%" PRIu64, sum);
+}
+
 /* see https://131002.net/siphash/siphash.pdf, Appendix A */
 int main(int argc, char *argv[]) {
         const uint8_t in[15]  = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
@@ -110,6 +176,7 @@ int main(int argc, char *argv[]) {
         const uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
                                   0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
         uint8_t in_buf[20];
+        int r;
 
         /* Test with same input but different alignments. */
         memcpy(in_buf, in, sizeof(in));
@@ -122,4 +189,9 @@ int main(int argc, char *argv[]) {
         do_test(in_buf + 4, sizeof(in), key);
 
         test_short_hashes();
+
+        test_siphash13(in, sizeof(in), key);
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        test_throughput(r >= 0 ? r : SYSTEMD_SLOW_TESTS_DEFAULT);
 }
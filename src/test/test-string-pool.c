@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "macro.h"
+#include "string-pool.h"
+#include "string-util.h"
+
+static void test_intern(void) {
+        _cleanup_(string_pool_freep) StringPool *p = NULL;
+        const char *a, *b, *c;
+        char buf[] = "/var/tmp";
+
+        assert_se(p = string_pool_new());
+
+        assert_se(string_pool_intern(p, "/var/tmp", &a) == 1);
+        assert_se(streq(a, "/var/tmp"));
+        assert_se(a != buf);
+
+        /* The same contents from a different buffer yield the same pointer */
+        assert_se(string_pool_intern(p, buf, &b) == 0);
+        assert_se(a == b);
+
+        assert_se(string_pool_intern(p, "/tmp", &c) == 1);
+        assert_se(c != a);
+        assert_se(string_pool_size(p) == 2);
+
+        assert_se(string_pool_lookup(p, buf) == a);
+        assert_se(!string_pool_lookup(p, "/srv"));
+
+        assert_se(string_pool_ref(p, a) == a);
+
+        /* Three references on "/var/tmp" now */
+        assert_se(!string_pool_unref(p, a));
+        assert_se(!string_pool_unref(p, b));
+        assert_se(string_pool_lookup(p, "/var/tmp") == a);
+        assert_se(!string_pool_unref(p, a));
+        assert_se(!string_pool_lookup(p, "/var/tmp"));
+        assert_se(string_pool_size(p) == 1);
+
+        assert_se(!string_pool_ref(p, NULL));
+        assert_se(!string_pool_unref(p, NULL));
+
+        /* "/tmp" is still referenced, and released together with the pool */
+}
+
+static void test_pointer_keys(void) {
+        _cleanup_(string_pool_freep) StringPool *p = NULL;
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        const char *a, *b;
+
+        assert_se(p = string_pool_new());
+
+        /* Interned strings may be used as keys of maps hashing the pointer only */
+        assert_se(h = hashmap_new(&trivial_hash_ops));
+
+        assert_se(string_pool_intern(p, "foo.service", &a) >= 0);
+        assert_se(hashmap_put(h, a, INT_TO_PTR(1)) == 1);
+
+        assert_se(string_pool_intern(p, "foo.service", &b) >= 0);
+        assert_se(hashmap_get(h, b) == INT_TO_PTR(1));
+        assert_se(hashmap_get(h, string_pool_lookup(p, "foo.service")) == INT_TO_PTR(1));
+
+        string_pool_unref(p, a);
+        string_pool_unref(p, b);
+}
+
+int main(int argc, char *argv[]) {
+        test_intern();
+        test_pointer_keys();
+
+        return 0;
+}
@@ -28,6 +28,12 @@ static void test_utf8_is_printable(void) {
         assert_se(utf8_is_printable("\342\204\242", 3));
         assert_se(!utf8_is_printable("\341\204", 2));
         assert_se(utf8_is_printable("ąę", 4));
+        assert_se(utf8_is_printable("line\nbreak", 10));
+        assert_se(!utf8_is_printable_newline("line\nbreak", 10, false));
+        assert_se(!utf8_is_printable("bell\a", 5));
+        assert_se(!utf8_is_printable("del\177", 4));
+        assert_se(!utf8_is_printable("\302\200", 2));
+        assert_se(!utf8_is_printable("nul\0", 4));
 }
 
 static void test_utf8_is_valid(void) {
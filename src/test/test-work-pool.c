@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+
+#include "event-mailbox.h"
+#include "macro.h"
+#include "util.h"
+#include "work-pool.h"
+
+#define N_ITEMS 1000U
+
+typedef struct Context {
+        sd_event *event;
+        unsigned n_done;
+        unsigned n_cancelled;
+        uint64_t sum;
+        pthread_t main_thread;
+} Context;
+
+typedef struct Item {
+        Context *context;
+        unsigned value;
+        unsigned result;
+} Item;
+
+static int work(void *userdata) {
+        Item *i = userdata;
+
+        /* Must not run in the event loop thread */
+        assert_se(!pthread_equal(pthread_self(), i->context->main_thread));
+
+        i->result = i->value * 2;
+        return (int) i->value;
+}
+
+static void done(int r, void *userdata) {
+        Item *i = userdata;
+        Context *c = i->context;
+
+        assert_se(pthread_equal(pthread_self(), c->main_thread));
+
+        if (r == -ECANCELED)
+                c->n_cancelled++;
+        else {
+                assert_se(r == (int) i->value);
+                assert_se(i->result == i->value * 2);
+                c->sum += i->result;
+        }
+
+        if (++c->n_done == N_ITEMS)
+                assert_se(sd_event_exit(c->event, 0) >= 0);
+}
+
+static void test_work_pool(unsigned n_threads) {
+        _cleanup_(work_pool_freep) WorkPool *p = NULL;
+        Context c = {
+                .main_thread = pthread_self(),
+        };
+        Item items[N_ITEMS];
+        unsigned k;
+
+        assert_se(sd_event_new(&c.event) >= 0);
+        assert_se(work_pool_new(&p, c.event, n_threads) >= 0);
+
+        for (k = 0; k < N_ITEMS; k++) {
+                items[k] = (Item) {
+                        .context = &c,
+                        .value = k,
+                };
+                assert_se(work_pool_submit(p, work, done, items + k) >= 0);
+        }
+
+        assert_se(sd_event_loop(c.event) >= 0);
+
+        assert_se(c.n_done == N_ITEMS);
+        assert_se(c.n_cancelled == 0);
+        assert_se(c.sum == (uint64_t) N_ITEMS * (N_ITEMS - 1));
+
+        p = work_pool_free(p);
+        c.event = sd_event_unref(c.event);
+}
+
+static int work_slow(void *userdata) {
+        usleep(10 * USEC_PER_MSEC);
+        return work(userdata);
+}
+
+static void test_work_pool_cancel(void) {
+        WorkPool *p = NULL;
+        Context c = {
+                .main_thread = pthread_self(),
+        };
+        Item items[N_ITEMS];
+        unsigned k;
+
+        assert_se(sd_event_new(&c.event) >= 0);
+        assert_se(work_pool_new(&p, c.event, 1) >= 0);
+
+        for (k = 0; k < N_ITEMS; k++) {
+                items[k] = (Item) {
+                        .context = &c,
+                        .value = k,
+                };
+                assert_se(work_pool_submit(p, work_slow, done, items + k) >= 0);
+        }
+
+        /* Freeing the pool runs every completion, the ones that never got to a worker are cancelled */
+        p = work_pool_free(p);
+
+        assert_se(c.n_done == N_ITEMS);
+        assert_se(c.n_cancelled > 0);
+
+        c.event = sd_event_unref(c.event);
+}
+
+typedef struct Poster {
+        EventMailbox *mailbox;
+        unsigned n_received;
+        sd_event *event;
+} Poster;
+
+static void on_message(void *userdata) {
+        Poster *p = userdata;
+
+        p->n_received++;
+        if (p->n_received == N_ITEMS)
+                assert_se(sd_event_exit(p->event, 0) >= 0);
+}
+
+static void *poster_thread(void *userdata) {
+        Poster *p = userdata;
+        unsigned k;
+
+        for (k = 0; k < N_ITEMS; k++)
+                assert_se(event_mailbox_post(p->mailbox, on_message, p) >= 0);
+
+        return NULL;
+}
+
+static void test_mailbox(void) {
+        _cleanup_(event_mailbox_freep) EventMailbox *m = NULL;
+        Poster p = {};
+        pthread_t t;
+
+        assert_se(sd_event_new(&p.event) >= 0);
+        assert_se(event_mailbox_new(&m, p.event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        p.mailbox = m;
+
+        assert_se(pthread_create(&t, NULL, poster_thread, &p) == 0);
+        assert_se(sd_event_loop(p.event) >= 0);
+        assert_se(pthread_join(t, NULL) == 0);
+
+        assert_se(p.n_received == N_ITEMS);
+
+        m = event_mailbox_free(m);
+        p.event = sd_event_unref(p.event);
+}
+
+int main(int argc, char *argv[]) {
+        test_work_pool(1);
+        test_work_pool(4);
+        test_work_pool(0);
+        test_work_pool_cancel();
+        test_mailbox();
+
+        return 0;
+}
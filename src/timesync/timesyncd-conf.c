@@ -129,5 +129,11 @@ int manager_parse_config_file(Manager *m) {
                 m->poll_interval_max_usec = MAX(NTP_POLL_INTERVAL_MAX_USEC, m->poll_interval_min_usec * 32);
         }
 
+        if (m->parallel_queries < 1 || m->parallel_queries > NTP_PARALLEL_QUERIES_MAX) {
+                log_warning("ParallelQueries= must be between 1 and %u. Using %u.",
+                            NTP_PARALLEL_QUERIES_MAX, CLAMP(m->parallel_queries, 1U, NTP_PARALLEL_QUERIES_MAX));
+                m->parallel_queries = CLAMP(m->parallel_queries, 1U, NTP_PARALLEL_QUERIES_MAX);
+        }
+
         return r;
 }
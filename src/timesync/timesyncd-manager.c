@@ -92,6 +92,9 @@
 
 #define TIMEOUT_USEC (10*USEC_PER_SEC)
 
+/* How long we wait for the answers when querying several addresses at once */
+#define PROBE_TIMEOUT_USEC (1*USEC_PER_SEC)
+
 struct ntp_ts {
         be32_t sec;
         be32_t frac;
@@ -120,6 +123,7 @@ static int manager_arm_timer(Manager *m, usec_t next);
 static int manager_clock_watch_setup(Manager *m);
 static int manager_listen_setup(Manager *m);
 static void manager_listen_stop(Manager *m);
+static int manager_probe_response(Manager *m, const union sockaddr_union *from, const struct ntp_msg *ntpmsg, const struct timespec *recv_time);
 
 static double ntp_ts_short_to_d(const struct ntp_ts_short *ts) {
         return be16toh(ts->sec) + (be16toh(ts->frac) / 65536.0);
@@ -147,18 +151,38 @@ static int manager_timeout(sd_event_source *source, usec_t usec, void *userdata)
         return manager_connect(m);
 }
 
-static int manager_send_request(Manager *m) {
-        _cleanup_free_ char *pretty = NULL;
-        struct ntp_msg ntpmsg = {
-                /*
-                 * "The client initializes the NTP message header, sends the request
-                 * to the server, and strips the time of day from the Transmit
-                 * Timestamp field of the reply.  For this purpose, all the NTP
-                 * header fields are set to 0, except the Mode, VN, and optional
-                 * Transmit Timestamp fields."
-                 */
+static void manager_prepare_request(Manager *m, struct ntp_msg *ntpmsg) {
+        assert(m);
+        assert(ntpmsg);
+
+        /*
+         * "The client initializes the NTP message header, sends the request
+         * to the server, and strips the time of day from the Transmit
+         * Timestamp field of the reply.  For this purpose, all the NTP
+         * header fields are set to 0, except the Mode, VN, and optional
+         * Transmit Timestamp fields."
+         */
+        *ntpmsg = (struct ntp_msg) {
                 .field = NTP_FIELD(0, 4, NTP_MODE_CLIENT),
         };
+
+        /*
+         * Set transmit timestamp, remember it; the server will send that back
+         * as the origin timestamp and we have an indication that this is the
+         * matching answer to our request.
+         *
+         * The actual value does not matter, We do not care about the correct
+         * NTP UINT_MAX fraction; we just pass the plain nanosecond value.
+         */
+        assert_se(clock_gettime(clock_boottime_or_monotonic(), &m->trans_time_mon) >= 0);
+        assert_se(clock_gettime(CLOCK_REALTIME, &m->trans_time) >= 0);
+        ntpmsg->trans_time.sec = htobe32(m->trans_time.tv_sec + OFFSET_1900_1970);
+        ntpmsg->trans_time.frac = htobe32(m->trans_time.tv_nsec);
+}
+
+static int manager_send_request(Manager *m) {
+        _cleanup_free_ char *pretty = NULL;
+        struct ntp_msg ntpmsg;
         ssize_t len;
         int r;
 
@@ -172,18 +196,7 @@ static int manager_send_request(Manager *m) {
         if (r < 0)
                 return log_warning_errno(r, "Failed to setup connection socket: %m");
 
-        /*
-         * Set transmit timestamp, remember it; the server will send that back
-         * as the origin timestamp and we have an indication that this is the
-         * matching answer to our request.
-         *
-         * The actual value does not matter, We do not care about the correct
-         * NTP UINT_MAX fraction; we just pass the plain nanosecond value.
-         */
-        assert_se(clock_gettime(clock_boottime_or_monotonic(), &m->trans_time_mon) >= 0);
-        assert_se(clock_gettime(CLOCK_REALTIME, &m->trans_time) >= 0);
-        ntpmsg.trans_time.sec = htobe32(m->trans_time.tv_sec + OFFSET_1900_1970);
-        ntpmsg.trans_time.frac = htobe32(m->trans_time.tv_nsec);
+        manager_prepare_request(m, &ntpmsg);
 
         server_address_pretty(m->current_server_address, &pretty);
 
@@ -520,13 +533,6 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 return manager_connect(m);
         }
 
-        if (!m->current_server_name ||
-            !m->current_server_address ||
-            !sockaddr_equal(&server_addr, &m->current_server_address->sockaddr)) {
-                log_debug("Response from unknown server.");
-                return 0;
-        }
-
         recv_time = NULL;
         CMSG_FOREACH(cmsg, &msghdr) {
                 if (cmsg->cmsg_level != SOL_SOCKET)
@@ -543,6 +549,16 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
                 return -EINVAL;
         }
 
+        if (m->event_probe_timeout)
+                return manager_probe_response(m, &server_addr, &ntpmsg, recv_time);
+
+        if (!m->current_server_name ||
+            !m->current_server_address ||
+            !sockaddr_equal(&server_addr, &m->current_server_address->sockaddr)) {
+                log_debug("Response from unknown server.");
+                return 0;
+        }
+
         if (!m->pending) {
                 log_debug("Unexpected reply. Ignoring.");
                 return 0;
@@ -750,6 +766,173 @@ static int manager_begin(Manager *m) {
         return manager_send_request(m);
 }
 
+static int manager_probe_finish(Manager *m) {
+        _cleanup_free_ char *pretty = NULL;
+        ServerAddress *best;
+
+        assert(m);
+        assert(m->current_server_name);
+
+        best = m->probe_best;
+
+        m->event_probe_timeout = sd_event_source_unref(m->event_probe_timeout);
+        m->probe_best = NULL;
+        m->probe_pending = 0;
+
+        manager_listen_stop(m);
+
+        if (!best) {
+                log_info("No address of %s replied.", m->current_server_name->string);
+
+                /* Continue with the addresses we did not query yet, or the next server */
+                m->current_server_address = m->probe_last;
+                m->probe_last = NULL;
+
+                return manager_connect(m);
+        }
+
+        m->probe_last = NULL;
+
+        server_address_pretty(best, &pretty);
+        log_debug("Address %s of %s replied with the lowest delay (%.3f sec).",
+                  strna(pretty), m->current_server_name->string, m->probe_best_delay);
+
+        manager_set_server_address(m, best);
+
+        return manager_begin(m);
+}
+
+static int manager_probe_timeout(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(m->current_server_name);
+
+        log_debug("Timed out waiting for %u replies from %s.", m->probe_pending, m->current_server_name->string);
+
+        return manager_probe_finish(m);
+}
+
+static int manager_probe_response(Manager *m, const union sockaddr_union *from, const struct ntp_msg *ntpmsg, const struct timespec *recv_time) {
+        double origin, receive, trans, dest, delay;
+        ServerAddress *a;
+
+        assert(m);
+        assert(m->current_server_name);
+        assert(from);
+        assert(ntpmsg);
+        assert(recv_time);
+
+        LIST_FOREACH(addresses, a, m->current_server_name->addresses)
+                if (sockaddr_equal(from, &a->sockaddr))
+                        break;
+        if (!a) {
+                log_debug("Response from unknown server.");
+                return 0;
+        }
+
+        /* all queries of a round carry the same "time cookie" */
+        if (be32toh(ntpmsg->origin_time.sec) != m->trans_time.tv_sec + OFFSET_1900_1970 ||
+            be32toh(ntpmsg->origin_time.frac) != m->trans_time.tv_nsec) {
+                log_debug("Invalid reply; not our transmit time. Ignoring.");
+                return 0;
+        }
+
+        if (m->probe_pending > 0)
+                m->probe_pending--;
+
+        if (be32toh(ntpmsg->recv_time.sec) < TIME_EPOCH + OFFSET_1900_1970 ||
+            be32toh(ntpmsg->trans_time.sec) < TIME_EPOCH + OFFSET_1900_1970 ||
+            NTP_FIELD_LEAP(ntpmsg->field) == NTP_LEAP_NOTINSYNC ||
+            ntpmsg->stratum == 0 || ntpmsg->stratum >= 16 ||
+            !IN_SET(NTP_FIELD_VERSION(ntpmsg->field), 3, 4) ||
+            NTP_FIELD_MODE(ntpmsg->field) != NTP_MODE_SERVER ||
+            ntp_ts_short_to_d(&ntpmsg->root_delay) / 2 + ntp_ts_short_to_d(&ntpmsg->root_dispersion) >
+            (double) m->max_root_distance_usec / (double) USEC_PER_SEC) {
+                _cleanup_free_ char *pretty = NULL;
+
+                server_address_pretty(a, &pretty);
+                log_debug("Unusable reply from %s (%s). Ignoring.", strna(pretty), m->current_server_name->string);
+        } else {
+                origin = ts_to_d(&m->trans_time) + OFFSET_1900_1970;
+                receive = ntp_ts_to_d(&ntpmsg->recv_time);
+                trans = ntp_ts_to_d(&ntpmsg->trans_time);
+                dest = ts_to_d(recv_time) + OFFSET_1900_1970;
+
+                delay = (dest - origin) - (trans - receive);
+
+                if (!m->probe_best || delay < m->probe_best_delay) {
+                        m->probe_best = a;
+                        m->probe_best_delay = delay;
+                }
+        }
+
+        if (m->probe_pending == 0)
+                return manager_probe_finish(m);
+
+        return 0;
+}
+
+/* Sends one request to each of the first few addresses of the current server, and then continues
+ * with whichever answered quickest. A slow or dead first address thus does not hold up the initial
+ * synchronization for a whole timeout. */
+static int manager_probe(Manager *m) {
+        struct ntp_msg ntpmsg;
+        ServerAddress *a;
+        unsigned n = 0;
+        int r;
+
+        assert(m);
+        assert(m->current_server_name);
+        assert(m->current_server_address);
+
+        r = manager_listen_setup(m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to setup connection socket: %m");
+
+        manager_prepare_request(m, &ntpmsg);
+
+        m->probe_best = NULL;
+        m->probe_last = NULL;
+
+        /* the socket is bound to one address family, so only query the run of addresses sharing it */
+        for (a = m->current_server_address;
+             a && a->sockaddr.sa.sa_family == m->current_server_address->sockaddr.sa.sa_family && n < m->parallel_queries;
+             a = a->addresses_next) {
+                _cleanup_free_ char *pretty = NULL;
+                ssize_t len;
+
+                m->probe_last = a;
+
+                server_address_pretty(a, &pretty);
+
+                len = sendto(m->server_socket, &ntpmsg, sizeof(ntpmsg), MSG_DONTWAIT, &a->sockaddr.sa, a->socklen);
+                if (len != sizeof(ntpmsg)) {
+                        log_debug_errno(errno, "Sending NTP request to %s (%s) failed: %m", strna(pretty), m->current_server_name->string);
+                        continue;
+                }
+
+                log_debug("Sent NTP request to %s (%s).", strna(pretty), m->current_server_name->string);
+                n++;
+        }
+
+        if (n == 0)
+                return manager_probe_finish(m);
+
+        m->probe_pending = n;
+
+        r = sd_event_add_time(
+                        m->event,
+                        &m->event_probe_timeout,
+                        clock_boottime_or_monotonic(),
+                        now(clock_boottime_or_monotonic()) + PROBE_TIMEOUT_USEC, 0,
+                        manager_probe_timeout, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to arm probe timer: %m");
+
+        return 0;
+}
+
 void manager_set_server_name(Manager *m, ServerName *n) {
         assert(m);
 
@@ -832,6 +1015,9 @@ static int manager_resolve_handler(sd_resolve_query *q, int ret, const struct ad
 
         manager_set_server_address(m, m->current_server_name->addresses);
 
+        if (m->parallel_queries > 1 && m->current_server_address->addresses_next)
+                return manager_probe(m);
+
         return manager_begin(m);
 }
 
@@ -963,6 +1149,10 @@ void manager_disconnect(Manager *m) {
 
         m->event_timeout = sd_event_source_unref(m->event_timeout);
 
+        m->event_probe_timeout = sd_event_source_unref(m->event_probe_timeout);
+        m->probe_pending = 0;
+        m->probe_last = m->probe_best = NULL;
+
         sd_notifyf(false, "STATUS=Idle.");
 }
 
@@ -1121,6 +1311,7 @@ int manager_new(Manager **ret) {
         m->max_root_distance_usec = NTP_MAX_ROOT_DISTANCE;
         m->poll_interval_min_usec = NTP_POLL_INTERVAL_MIN_USEC;
         m->poll_interval_max_usec = NTP_POLL_INTERVAL_MAX_USEC;
+        m->parallel_queries = 1;
 
         m->server_socket = m->clock_watch_fd = -1;
 
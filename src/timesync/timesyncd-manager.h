@@ -39,6 +39,9 @@ typedef struct Manager Manager;
 #define NTP_POLL_INTERVAL_MIN_USEC      (32 * USEC_PER_SEC)
 #define NTP_POLL_INTERVAL_MAX_USEC      (2048 * USEC_PER_SEC)
 
+/* At most this many addresses of a server are queried at once */
+#define NTP_PARALLEL_QUERIES_MAX        16U
+
 struct Manager {
         sd_event *event;
         sd_resolve *resolve;
@@ -67,6 +70,14 @@ struct Manager {
         sd_event_source *event_timeout;
         bool good;
 
+        /* parallel queries to the addresses of a server, to pick the quickest one */
+        unsigned parallel_queries;
+        sd_event_source *event_probe_timeout;
+        unsigned probe_pending;
+        ServerAddress *probe_last;
+        ServerAddress *probe_best;
+        double probe_best_delay;
+
         /* last sent packet */
         struct timespec trans_time_mon;
         struct timespec trans_time;
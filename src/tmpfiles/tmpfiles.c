@@ -26,6 +26,8 @@
 #include <glob.h>
 #include <limits.h>
 #include <linux/fs.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -53,6 +55,7 @@
 #include "glob-util.h"
 #include "io-util.h"
 #include "label.h"
+#include "list.h"
 #include "log.h"
 #include "macro.h"
 #include "missing.h"
@@ -163,6 +166,10 @@ static const char conf_file_dirs[] = CONF_PATHS_NULSTR("tmpfiles.d");
 
 #define MAX_DEPTH 256
 
+/* How many threads clean up directory trees, and how many directories they may keep open at a time */
+#define CLEAN_WORKERS_MAX 8U
+#define CLEAN_OPEN_DIRS_MAX 256U
+
 static OrderedHashmap *items = NULL, *globs = NULL;
 static Set *unix_sockets = NULL;
 
@@ -398,6 +405,129 @@ static DIR* opendir_nomod(const char *path) {
         return xopendirat_nomod(AT_FDCWD, path);
 }
 
+typedef struct CleanRoot CleanRoot;
+typedef struct CleanDir CleanDir;
+
+struct CleanRoot {
+        Item *item;
+        char *path;
+        usec_t cutoff;
+        dev_t rootdev;
+        bool report;              /* whether failures shall be propagated, see clean_item() */
+        int error;
+
+        LIST_FIELDS(CleanRoot, roots);
+};
+
+struct CleanDir {
+        CleanRoot *root;
+        CleanDir *parent;
+        char *path;
+        DIR *d;
+        struct stat st;
+        int maxdepth;
+        unsigned n_ref;           /* one for the scan of the directory itself, plus one per queued subdirectory */
+        bool mountpoint;
+        bool keep_this_level;
+        bool deleted;
+
+        LIST_FIELDS(CleanDir, queue);
+};
+
+typedef struct CleanPool {
+        pthread_mutex_t mutex;
+        pthread_cond_t work;      /* signalled when a directory is queued, or when we shall exit */
+        pthread_cond_t idle;      /* signalled when a tree is done */
+
+        pthread_t workers[CLEAN_WORKERS_MAX];
+        unsigned n_workers;
+
+        LIST_HEAD(CleanDir, queue);
+        LIST_HEAD(CleanRoot, roots);
+        unsigned n_open;
+
+        bool started;
+        bool exiting;
+        int error;
+} CleanPool;
+
+static CleanPool clean_pool = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .work = PTHREAD_COND_INITIALIZER,
+        .idle = PTHREAD_COND_INITIALIZER,
+};
+
+static int dir_cleanup_subdir(
+                const char *sub_path,
+                DIR *d,
+                const char *name,
+                const struct stat *s,
+                usec_t cutoff,
+                bool keep_this_level) {
+
+        usec_t age;
+
+        /* Note: if you are wondering why we don't
+         * support the sticky bit for excluding
+         * directories from cleaning like we do it for
+         * other file system objects: well, the sticky
+         * bit already has a meaning for directories,
+         * so we don't want to overload that. */
+
+        if (keep_this_level) {
+                log_debug("Keeping \"%s\".", sub_path);
+                return 0;
+        }
+
+        /* Ignore ctime, we change it when deleting */
+        age = timespec_load(&s->st_mtim);
+        if (age >= cutoff) {
+                char a[FORMAT_TIMESTAMP_MAX];
+                /* Follows spelling in stat(1). */
+                log_debug("Directory \"%s\": modify time %s is too new.",
+                          sub_path,
+                          format_timestamp_us(a, sizeof(a), age));
+                return 0;
+        }
+
+        age = timespec_load(&s->st_atim);
+        if (age >= cutoff) {
+                char a[FORMAT_TIMESTAMP_MAX];
+                log_debug("Directory \"%s\": access time %s is too new.",
+                          sub_path,
+                          format_timestamp_us(a, sizeof(a), age));
+                return 0;
+        }
+
+        log_debug("Removing directory \"%s\".", sub_path);
+        if (unlinkat(dirfd(d), name, AT_REMOVEDIR) < 0)
+                if (!IN_SET(errno, ENOENT, ENOTEMPTY))
+                        return log_error_errno(errno, "rmdir(%s): %m", sub_path);
+
+        return 0;
+}
+
+static void dir_cleanup_restore_times(const char *p, DIR *d, const struct stat *ds) {
+        struct timespec times[2];
+        usec_t age1, age2;
+        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX];
+
+        /* Restore original directory timestamps */
+        times[0] = ds->st_atim;
+        times[1] = ds->st_mtim;
+
+        age1 = timespec_load(&ds->st_atim);
+        age2 = timespec_load(&ds->st_mtim);
+        log_debug("Restoring access and modification time on \"%s\": %s, %s",
+                  p,
+                  format_timestamp_us(a, sizeof(a), age1),
+                  format_timestamp_us(b, sizeof(b), age2));
+        if (futimens(dirfd(d), times) < 0)
+                log_error_errno(errno, "utimensat(%s): %m", p);
+}
+
+static bool clean_dir_queue(CleanDir *parent, char *sub_path, DIR *d, const struct stat *st);
+
 static int dir_cleanup(
                 Item *i,
                 const char *p,
@@ -407,10 +537,10 @@ static int dir_cleanup(
                 dev_t rootdev,
                 bool mountpoint,
                 int maxdepth,
-                bool keep_this_level) {
+                bool keep_this_level,
+                CleanDir *self) {
 
         struct dirent *dent;
-        struct timespec times[2];
         bool deleted = false;
         int r = 0;
 
@@ -418,6 +548,7 @@ static int dir_cleanup(
                 struct stat s;
                 usec_t age;
                 _cleanup_free_ char *sub_path = NULL;
+                int k;
 
                 if (dot_or_dot_dot(dent->d_name))
                         continue;
@@ -496,49 +627,23 @@ static int dir_cleanup(
                                         continue;
                                 }
 
-                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false);
+                                /* If we run from the worker pool, let some other worker clean up the
+                                 * subdirectory. It is removed by whoever finishes it last, see
+                                 * clean_dir_release(). */
+                                if (self && clean_dir_queue(self, sub_path, sub_dir, &s)) {
+                                        sub_path = NULL;
+                                        sub_dir = NULL;
+                                        continue;
+                                }
+
+                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false, NULL);
                                 if (q < 0)
                                         r = q;
                         }
 
-                        /* Note: if you are wondering why we don't
-                         * support the sticky bit for excluding
-                         * directories from cleaning like we do it for
-                         * other file system objects: well, the sticky
-                         * bit already has a meaning for directories,
-                         * so we don't want to overload that. */
-
-                        if (keep_this_level) {
-                                log_debug("Keeping \"%s\".", sub_path);
-                                continue;
-                        }
-
-                        /* Ignore ctime, we change it when deleting */
-                        age = timespec_load(&s.st_mtim);
-                        if (age >= cutoff) {
-                                char a[FORMAT_TIMESTAMP_MAX];
-                                /* Follows spelling in stat(1). */
-                                log_debug("Directory \"%s\": modify time %s is too new.",
-                                          sub_path,
-                                          format_timestamp_us(a, sizeof(a), age));
-                                continue;
-                        }
-
-                        age = timespec_load(&s.st_atim);
-                        if (age >= cutoff) {
-                                char a[FORMAT_TIMESTAMP_MAX];
-                                log_debug("Directory \"%s\": access time %s is too new.",
-                                          sub_path,
-                                          format_timestamp_us(a, sizeof(a), age));
-                                continue;
-                        }
-
-                        log_debug("Removing directory \"%s\".", sub_path);
-                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0)
-                                if (!IN_SET(errno, ENOENT, ENOTEMPTY)) {
-                                        log_error_errno(errno, "rmdir(%s): %m", sub_path);
-                                        r = -errno;
-                                }
+                        k = dir_cleanup_subdir(sub_path, d, dent->d_name, &s, cutoff, keep_this_level);
+                        if (k < 0)
+                                r = k;
 
                 } else {
                         /* Skip files for which the sticky bit is
@@ -617,25 +722,307 @@ static int dir_cleanup(
         }
 
 finish:
-        if (deleted) {
-                usec_t age1, age2;
-                char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX];
+        /* When run from the worker pool, the timestamps are restored once all subdirectories are done too */
+        if (self)
+                self->deleted = deleted;
+        else if (deleted)
+                dir_cleanup_restore_times(p, d, ds);
 
-                /* Restore original directory timestamps */
-                times[0] = ds->st_atim;
-                times[1] = ds->st_mtim;
+        return r;
+}
+
+static void clean_root_result(CleanRoot *root, int r) {
+        if (r >= 0)
+                return;
+
+        assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+        if (root->error == 0)
+                root->error = r;
+        assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+}
+
+static void clean_dir_release(CleanDir *dir) {
+
+        /* Drops one reference to the directory. Whoever drops the last one restores the timestamps of the
+         * directory, and then possibly removes it, like dir_cleanup() does after recursing into it. */
+
+        while (dir) {
+                CleanRoot *root = dir->root;
+                CleanDir *parent;
+                unsigned n;
+                int r;
+
+                assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+                assert(dir->n_ref > 0);
+                n = --dir->n_ref;
+                if (n == 0)
+                        clean_pool.n_open--;
+                assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+
+                if (n > 0)
+                        return;
 
-                age1 = timespec_load(&ds->st_atim);
-                age2 = timespec_load(&ds->st_mtim);
-                log_debug("Restoring access and modification time on \"%s\": %s, %s",
-                          p,
-                          format_timestamp_us(a, sizeof(a), age1),
-                          format_timestamp_us(b, sizeof(b), age2));
-                if (futimens(dirfd(d), times) < 0)
-                        log_error_errno(errno, "utimensat(%s): %m", p);
+                parent = dir->parent;
+
+                if (dir->deleted)
+                        dir_cleanup_restore_times(dir->path, dir->d, &dir->st);
+
+                closedir(dir->d);
+
+                if (parent) {
+                        r = dir_cleanup_subdir(dir->path, parent->d, basename(dir->path), &dir->st,
+                                               root->cutoff, parent->keep_this_level);
+                        clean_root_result(root, r);
+                }
+
+                free(dir->path);
+                free(dir);
+
+                if (!parent) {
+                        assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+                        LIST_REMOVE(roots, clean_pool.roots, root);
+                        if (root->report && clean_pool.error == 0)
+                                clean_pool.error = root->error;
+                        assert_se(pthread_cond_broadcast(&clean_pool.idle) == 0);
+                        assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+
+                        free(root->path);
+                        free(root);
+                        return;
+                }
+
+                dir = parent;
         }
+}
 
-        return r;
+static bool clean_dir_queue(CleanDir *parent, char *sub_path, DIR *d, const struct stat *st) {
+        CleanDir *child;
+        bool full;
+
+        assert(parent);
+
+        /* Takes possession of sub_path and d on success. If too many directories are open already, we
+         * return false, and the caller recurses on its own. */
+
+        assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+        full = clean_pool.n_open >= CLEAN_OPEN_DIRS_MAX;
+        assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+        if (full)
+                return false;
+
+        child = new(CleanDir, 1);
+        if (!child)
+                return false;
+
+        *child = (CleanDir) {
+                .root = parent->root,
+                .parent = parent,
+                .path = sub_path,
+                .d = d,
+                .st = *st,
+                .maxdepth = parent->maxdepth - 1,
+                .n_ref = 1,
+        };
+
+        assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+        parent->n_ref++;
+        clean_pool.n_open++;
+        LIST_PREPEND(queue, clean_pool.queue, child);
+        assert_se(pthread_cond_signal(&clean_pool.work) == 0);
+        assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+
+        return true;
+}
+
+static void *clean_worker(void *p) {
+
+        for (;;) {
+                CleanDir *dir;
+                CleanRoot *root;
+                int r;
+
+                assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+
+                while (!clean_pool.queue && !clean_pool.exiting)
+                        assert_se(pthread_cond_wait(&clean_pool.work, &clean_pool.mutex) == 0);
+
+                dir = clean_pool.queue;
+                if (dir)
+                        LIST_REMOVE(queue, clean_pool.queue, dir);
+
+                assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+
+                if (!dir)
+                        return NULL;
+
+                root = dir->root;
+                r = dir_cleanup(root->item, dir->path, dir->d, &dir->st, root->cutoff, root->rootdev,
+                                dir->mountpoint, dir->maxdepth, dir->keep_this_level, dir);
+                clean_root_result(root, r);
+
+                clean_dir_release(dir);
+        }
+}
+
+static bool clean_pool_start(void) {
+        sigset_t ss, saved_ss;
+        unsigned n;
+        long ncpus;
+        int r;
+
+        if (clean_pool.started)
+                return clean_pool.n_workers > 0;
+
+        clean_pool.started = true;
+
+        /* The workers only read the socket list, hence make sure it is loaded before they start */
+        load_unix_sockets();
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = CLAMP(ncpus, 2, (long) CLEAN_WORKERS_MAX);
+
+        /* The workers shall not get any signals delivered */
+        assert_se(sigfillset(&ss) >= 0);
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return false;
+
+        for (clean_pool.n_workers = 0; clean_pool.n_workers < n; clean_pool.n_workers++)
+                if (pthread_create(clean_pool.workers + clean_pool.n_workers, NULL, clean_worker, NULL) > 0)
+                        break;
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        if (clean_pool.n_workers == 0)
+                log_debug("Failed to start cleanup workers, cleaning up serially.");
+
+        return clean_pool.n_workers > 0;
+}
+
+static bool clean_root_overlaps(CleanRoot *root, const char *prefix) {
+        return path_startswith(root->path, prefix) || path_startswith(prefix, root->path);
+}
+
+static void clean_pool_wait(const char *path) {
+        char *prefix = NULL;
+        CleanRoot *root;
+
+        /* Waits until no tree at or below path, or including path, is cleaned up anymore. For glob patterns
+         * we look at the directory up to the first glob character. With path == NULL waits for all trees. */
+
+        if (path) {
+                size_t n;
+
+                n = strcspn(path, GLOB_CHARS);
+                prefix = strndupa(path, n);
+                if (path[n]) {
+                        char *e;
+
+                        e = strrchr(prefix, '/');
+                        if (e)
+                                e[1] = 0;
+                }
+        }
+
+        assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+
+        for (;;) {
+                LIST_FOREACH(roots, root, clean_pool.roots)
+                        if (!prefix || clean_root_overlaps(root, prefix))
+                                break;
+
+                if (!root)
+                        break;
+
+                assert_se(pthread_cond_wait(&clean_pool.idle, &clean_pool.mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+}
+
+static int clean_pool_submit(Item *i, const char *path, DIR *d, const struct stat *st, usec_t cutoff, bool mountpoint) {
+        CleanRoot *root;
+        CleanDir *dir;
+
+        assert(i);
+        assert(path);
+        assert(d);
+        assert(st);
+
+        /* Hands the directory over to the worker pool, which takes possession of d on success. Returns
+         * 0 if the pool is not available, in which case the caller shall clean up the directory itself. */
+
+        if (!clean_pool_start())
+                return 0;
+
+        root = new0(CleanRoot, 1);
+        if (!root)
+                return log_oom();
+
+        dir = new0(CleanDir, 1);
+        if (!dir) {
+                free(root);
+                return log_oom();
+        }
+
+        root->path = strdup(path);
+        dir->path = strdup(path);
+        if (!root->path || !dir->path) {
+                free(root->path);
+                free(root);
+                free(dir->path);
+                free(dir);
+                return log_oom();
+        }
+
+        root->item = i;
+        root->cutoff = cutoff;
+        root->rootdev = st->st_dev;
+        /* clean_item() ignores failures for plain paths, and only propagates them for globs */
+        root->report = needs_glob(i->type);
+
+        dir->root = root;
+        dir->d = d;
+        dir->st = *st;
+        dir->maxdepth = MAX_DEPTH;
+        dir->n_ref = 1;
+        dir->mountpoint = mountpoint;
+        dir->keep_this_level = i->keep_first_level;
+
+        /* Trees that overlap are cleaned up one after the other, in the order they were submitted */
+        clean_pool_wait(path);
+
+        assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+        LIST_PREPEND(roots, clean_pool.roots, root);
+        clean_pool.n_open++;
+        LIST_APPEND(queue, clean_pool.queue, dir);
+        assert_se(pthread_cond_signal(&clean_pool.work) == 0);
+        assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+
+        return 1;
+}
+
+static int clean_pool_finish(void) {
+        unsigned n;
+
+        if (!clean_pool.started)
+                return 0;
+
+        clean_pool_wait(NULL);
+
+        assert_se(pthread_mutex_lock(&clean_pool.mutex) == 0);
+        clean_pool.exiting = true;
+        assert_se(pthread_cond_broadcast(&clean_pool.work) == 0);
+        assert_se(pthread_mutex_unlock(&clean_pool.mutex) == 0);
+
+        for (n = 0; n < clean_pool.n_workers; n++)
+                assert_se(pthread_join(clean_pool.workers[n], NULL) == 0);
+
+        assert(!clean_pool.queue);
+        assert(clean_pool.n_open == 0);
+
+        clean_pool.n_workers = 0;
+        return clean_pool.error;
 }
 
 static int path_set_perms(Item *i, const char *path) {
@@ -762,9 +1149,23 @@ static int path_set_xattrs(Item *i, const char *path) {
         assert(path);
 
         STRV_FOREACH_PAIR(name, value, i->xattrs) {
+                ssize_t l;
                 int n;
 
                 n = strlen(*value);
+
+                /* Don't write the attribute again if it is set already, this is run on every boot after
+                 * all. One extra byte is enough to notice that the current value is longer. */
+                {
+                        char buf[n + 1];
+
+                        l = lgetxattr(path, *name, buf, sizeof(buf));
+                        if (l == n && memcmp(buf, *value, n) == 0) {
+                                log_debug("Extended attribute '%s=%s' is already set on %s.", *name, *value, path);
+                                continue;
+                        }
+                }
+
                 log_debug("Setting extended attribute '%s=%s' on %s.", *name, *value, path);
                 if (lsetxattr(path, *name, *value, n, 0) < 0)
                         return log_error_errno(errno, "Setting extended attribute %s=%s on %s failed: %m",
@@ -795,7 +1196,7 @@ static int parse_acls_from_arg(Item *item) {
 #if HAVE_ACL
 static int path_set_acl(const char *path, const char *pretty, acl_type_t type, acl_t acl, bool modify) {
         _cleanup_(acl_free_charpp) char *t = NULL;
-        _cleanup_(acl_freep) acl_t dup = NULL;
+        _cleanup_(acl_freep) acl_t dup = NULL, cur = NULL;
         int r;
 
         /* Returns 0 for success, positive error if already warned,
@@ -822,6 +1223,16 @@ static int path_set_acl(const char *path, const char *pretty, acl_type_t type, a
                 return r;
 
         t = acl_to_any_text(dup, NULL, ',', TEXT_ABBREVIATE);
+
+        /* Don't write the ACL again if the file has it already */
+        cur = acl_get_file(path, type);
+        if (cur && acl_cmp(cur, dup) == 0) {
+                log_debug("%s ACL %s is already set on %s.",
+                          type == ACL_TYPE_ACCESS ? "Access" : "Default",
+                          strna(t), pretty);
+                return 0;
+        }
+
         log_debug("Setting %s ACL %s on %s.",
                   type == ACL_TYPE_ACCESS ? "access" : "default",
                   strna(t), pretty);
@@ -1541,7 +1952,7 @@ static int remove_item_instance(Item *i, const char *instance) {
                 /* FIXME: we probably should use dir_cleanup() here
                  * instead of rm_rf() so that 'x' is honoured. */
                 log_debug("rm -rf \"%s\"", instance);
-                r = rm_rf(instance, (i->type == RECURSIVE_REMOVE_PATH ? REMOVE_ROOT|REMOVE_SUBVOLUME : 0) | REMOVE_PHYSICAL);
+                r = rm_rf(instance, (i->type == RECURSIVE_REMOVE_PATH ? REMOVE_ROOT|REMOVE_SUBVOLUME : 0) | REMOVE_PHYSICAL | REMOVE_PARALLEL);
                 if (r < 0 && r != -ENOENT)
                         return log_error_errno(r, "rm_rf(%s): %m", instance);
 
@@ -1577,6 +1988,7 @@ static int clean_item_instance(Item *i, const char* instance) {
         bool mountpoint;
         usec_t cutoff, n;
         char timestamp[FORMAT_TIMESTAMP_MAX];
+        int r;
 
         assert(i);
 
@@ -1617,8 +2029,18 @@ static int clean_item_instance(Item *i, const char* instance) {
                   instance,
                   format_timestamp_us(timestamp, sizeof(timestamp), cutoff));
 
+        /* Trees that don't overlap are independent of each other, hence let the worker pool clean them up
+         * in the background, while we go on with the next items. */
+        r = clean_pool_submit(i, instance, d, &s, cutoff, mountpoint);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                d = NULL;
+                return 0;
+        }
+
         return dir_cleanup(i, instance, d, &s, cutoff, s.st_dev, mountpoint,
-                           MAX_DEPTH, i->keep_first_level);
+                           MAX_DEPTH, i->keep_first_level, NULL);
 }
 
 static int clean_item(Item *i) {
@@ -1677,6 +2099,9 @@ static int process_item(Item *i) {
         if (chase_symlinks(i->path, NULL, CHASE_NO_AUTOFS, NULL) == -EREMOTE)
                 return t;
 
+        /* Don't touch anything that is still being cleaned up in the background */
+        clean_pool_wait(i->path);
+
         r = arg_create ? create_item(i) : 0;
         q = arg_remove ? remove_item(i) : 0;
         p = arg_clean ? clean_item(i) : 0;
@@ -2392,6 +2817,10 @@ int main(int argc, char *argv[]) {
                         r = k;
         }
 
+        k = clean_pool_finish();
+        if (k < 0 && r == 0)
+                r = k;
+
 finish:
         ordered_hashmap_free_with_destructor(items, item_array_free);
         ordered_hashmap_free_with_destructor(globs, item_array_free);
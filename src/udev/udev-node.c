@@ -29,6 +29,8 @@
 #include "dirent-util.h"
 #include "format-util.h"
 #include "fs-util.h"
+#include "parse-util.h"
+#include "path-util.h"
 #include "selinux-util.h"
 #include "smack-util.h"
 #include "stdio-util.h"
@@ -127,12 +129,43 @@ exit:
         return err;
 }
 
+/* Read the priority and device node a stack entry records, "<priority>:<devnode>" as symlink
+ * target. Entries written by older versions are empty files, and return an error here. */
+static int link_read_claim(int dirfd, const char *name, int *priority, char *devnode, size_t size) {
+        char target[UTIL_PATH_SIZE];
+        char *colon;
+        ssize_t len;
+        int r;
+
+        len = readlinkat(dirfd, name, target, sizeof(target) - 1);
+        if (len < 0)
+                return -errno;
+        target[len] = '\0';
+
+        colon = strchr(target, ':');
+        if (!colon)
+                return -EINVAL;
+        *colon = '\0';
+
+        r = safe_atoi(target, priority);
+        if (r < 0)
+                return r;
+
+        /* ignore claims left behind by devices that are gone */
+        if (!path_startswith(colon + 1, "/dev/") || access(colon + 1, F_OK) < 0)
+                return -ENODEV;
+
+        strscpy(devnode, size, colon + 1);
+        return 0;
+}
+
 /* find device node of device with highest priority */
 static const char *link_find_prioritized(struct udev_device *dev, bool add, const char *stackdir, char *buf, size_t bufsize) {
         struct udev *udev = udev_device_get_udev(dev);
         DIR *dir;
         struct dirent *dent;
-        int priority = 0;
+        int priority = 0, p, r;
+        char claimed[UTIL_PATH_SIZE];
         const char *target = NULL;
 
         if (add) {
@@ -158,6 +191,20 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
                 if (streq(dent->d_name, udev_device_get_id_filename(dev)))
                         continue;
 
+                /* the entry records what we need, no need to look up the device */
+                r = link_read_claim(dirfd(dir), dent->d_name, &p, claimed, sizeof(claimed));
+                if (r == -ENODEV)
+                        continue;
+                if (r >= 0) {
+                        if (target == NULL || p > priority) {
+                                log_debug("'%s' claims priority %i for '%s'", dent->d_name, p, stackdir);
+                                priority = p;
+                                strscpy(buf, bufsize, claimed);
+                                target = buf;
+                        }
+                        continue;
+                }
+
                 dev_db = udev_device_new_from_device_id(udev, dent->d_name);
                 if (dev_db != NULL) {
                         const char *devnode;
@@ -205,19 +252,27 @@ static void link_update(struct udev_device *dev, const char *slink, bool add) {
         }
 
         if (add) {
+                char claim[DECIMAL_STR_MAX(int) + 1 + UTIL_PATH_SIZE];
+                char filename_tmp[UTIL_PATH_SIZE * 2];
                 int err;
 
-                do {
-                        int fd;
+                /* record priority and device node in the entry, so that other devices claiming
+                 * the link do not need to look us up; replace any entry atomically, names starting
+                 * with a dot are skipped when the stack is read */
+                xsprintf(claim, "%i:%s", udev_device_get_devlink_priority(dev), udev_device_get_devnode(dev));
+                strscpyl(filename_tmp, sizeof(filename_tmp), dirname, "/.", udev_device_get_id_filename(dev), NULL);
 
-                        err = mkdir_parents(filename, 0755);
+                do {
+                        err = mkdir_parents(filename_tmp, 0755);
                         if (!IN_SET(err, 0, -ENOENT))
                                 break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd >= 0)
-                                close(fd);
-                        else
+                        (void) unlink(filename_tmp);
+                        if (symlink(claim, filename_tmp) < 0)
+                                err = -errno;
+                        else if (rename(filename_tmp, filename) < 0) {
                                 err = -errno;
+                                (void) unlink(filename_tmp);
+                        }
                 } while (err == -ENOENT);
         }
 }
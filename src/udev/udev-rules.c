@@ -36,6 +36,7 @@
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
+#include "hashmap.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
 #include "stat-util.h"
@@ -49,6 +50,8 @@
 #include "util.h"
 
 #define PREALLOC_TOKEN          2048
+/* upper bound of the ACTION/SUBSYSTEM/DRIVER combinations we keep a list of candidate rules for */
+#define CANDIDATES_MAX          256
 
 struct uid_gid {
         unsigned int name_off;
@@ -78,6 +81,10 @@ struct udev_rules {
         /* all key strings are copied and de-duplicated in a single continuous string buffer */
         struct strbuf *strbuf;
 
+        /* "ACTION\nSUBSYSTEM\nDRIVER" of an event → offsets of the rules which can match such an
+         * event at all, terminated by the offset of the TK_END token; built on first use */
+        Hashmap *candidates;
+
         /* during rule parsing, uid/gid lookup results are cached */
         struct uid_gid *uids;
         unsigned int uids_cur;
@@ -1594,11 +1601,25 @@ struct udev_rules *udev_rules_unref(struct udev_rules *rules) {
                 return NULL;
         free(rules->tokens);
         strbuf_cleanup(rules->strbuf);
+        hashmap_free_free_free(rules->candidates);
         free(rules->uids);
         free(rules->gids);
         return mfree(rules);
 }
 
+bool udev_rules_equal(struct udev_rules *a, struct udev_rules *b) {
+        if (!a || !b)
+                return false;
+
+        /* Tokens refer to strings by their offset, and parsing the same files gives the same
+         * arrays. Anything else, including the result of a changed user or group lookup, differs. */
+        return a->resolve_names == b->resolve_names &&
+               a->token_cur == b->token_cur &&
+               memcmp(a->tokens, b->tokens, a->token_cur * sizeof(struct token)) == 0 &&
+               a->strbuf->len == b->strbuf->len &&
+               memcmp(a->strbuf->buf, b->strbuf->buf, a->strbuf->len) == 0;
+}
+
 bool udev_rules_check_timestamp(struct udev_rules *rules) {
         if (!rules)
                 return false;
@@ -1679,6 +1700,99 @@ static int match_key(struct udev_rules *rules, struct token *token, const char *
         return -1;
 }
 
+static bool rule_is_candidate(struct udev_rules *rules, struct token *rule,
+                              const char *action, const char *subsystem, const char *driver) {
+        struct token *cur;
+
+        /* The keys of a rule are sorted by type, the ones we look at come early */
+        for (cur = rule + 1; cur < rule + rule->rule.token_count && cur->type <= TK_M_DRIVER; cur++) {
+                const char *val;
+
+                switch (cur->type) {
+                case TK_M_ACTION:
+                        val = action;
+                        break;
+                case TK_M_SUBSYSTEM:
+                        val = subsystem;
+                        break;
+                case TK_M_DRIVER:
+                        val = driver;
+                        break;
+                default:
+                        continue;
+                }
+
+                if (match_key(rules, cur, val) != 0)
+                        return false;
+        }
+
+        return true;
+}
+
+static const unsigned *rules_get_candidates(struct udev_rules *rules, struct udev_device *dev) {
+        const char *action, *subsystem, *driver, *key;
+        _cleanup_free_ unsigned *candidates = NULL;
+        _cleanup_free_ char *k = NULL;
+        const unsigned *c;
+        size_t n = 0, allocated = 0;
+        unsigned i;
+        int r;
+
+        /* ACTION, SUBSYSTEM and DRIVER stay the same while an event is processed, and many events share
+         * them. Whether a rule's matches on these keys succeed is hence decided once per combination,
+         * and the result is remembered as the list of rules worth looking at. Returns NULL if all rules
+         * need to be processed. */
+
+        action = strempty(udev_device_get_action(dev));
+        subsystem = strempty(udev_device_get_subsystem(dev));
+        driver = strempty(udev_device_get_driver(dev));
+
+        key = strjoina(action, "\n", subsystem, "\n", driver);
+
+        c = hashmap_get(rules->candidates, key);
+        if (c)
+                return c;
+
+        if (hashmap_size(rules->candidates) >= CANDIDATES_MAX)
+                return NULL;
+
+        for (i = 0; rules->tokens[i].type != TK_END; i += rules->tokens[i].rule.token_count) {
+                assert(rules->tokens[i].type == TK_RULE);
+
+                if (!rule_is_candidate(rules, &rules->tokens[i], action, subsystem, driver))
+                        continue;
+
+                if (!GREEDY_REALLOC(candidates, allocated, n + 2))
+                        return NULL;
+
+                candidates[n++] = i;
+        }
+
+        if (!GREEDY_REALLOC(candidates, allocated, n + 1))
+                return NULL;
+        candidates[n] = i;
+
+        r = hashmap_ensure_allocated(&rules->candidates, &string_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        k = strdup(key);
+        if (!k)
+                return NULL;
+
+        r = hashmap_put(rules->candidates, k, candidates);
+        if (r < 0)
+                return NULL;
+        k = NULL;
+
+        log_debug("%zu of the rules can match events with ACTION '%s', SUBSYSTEM '%s', DRIVER '%s'",
+                  n, action, subsystem, driver);
+
+        c = candidates;
+        candidates = NULL;
+        return c;
+}
+
 static int match_attr(struct udev_rules *rules, struct udev_device *dev, struct udev_event *event, struct token *cur) {
         const char *name;
         char nbuf[UTIL_NAME_SIZE];
@@ -1738,15 +1852,19 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                usec_t timeout_usec,
                                usec_t timeout_warn_usec,
                                struct udev_list *properties_list) {
+        const unsigned *candidates;
         struct token *cur;
         struct token *rule;
         enum escape_type esc = ESCAPE_UNSET;
         bool can_set_name;
+        unsigned ci = 0;
         int r;
 
         if (rules->tokens == NULL)
                 return;
 
+        candidates = rules_get_candidates(rules, event->dev);
+
         can_set_name = ((!streq(udev_device_get_action(event->dev), "remove")) &&
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
@@ -1758,6 +1876,16 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                 dump_token(rules, cur);
                 switch (cur->type) {
                 case TK_RULE:
+                        /* skip ahead to the next rule which can match this event at all */
+                        if (candidates) {
+                                while (candidates[ci] < (unsigned) (cur - rules->tokens))
+                                        ci++;
+                                if (candidates[ci] != (unsigned) (cur - rules->tokens)) {
+                                        cur = &rules->tokens[candidates[ci]];
+                                        continue;
+                                }
+                        }
+
                         /* current rule */
                         rule = cur;
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
@@ -73,6 +73,7 @@ struct udev_rules;
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names);
 struct udev_rules *udev_rules_unref(struct udev_rules *rules);
 bool udev_rules_check_timestamp(struct udev_rules *rules);
+bool udev_rules_equal(struct udev_rules *a, struct udev_rules *b);
 void udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event,
                                usec_t timeout_usec, usec_t timeout_warn_usec,
                                struct udev_list *properties_list);
@@ -19,11 +19,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <poll.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "set.h"
 #include "string-util.h"
 #include "udev-util.h"
 #include "udev.h"
@@ -33,12 +36,12 @@
 static int verbose;
 static int dry_run;
 
-static void exec_list(struct udev_enumerate *udev_enumerate, const char *action) {
+static int exec_list(struct udev_enumerate *udev_enumerate, const char *action, Set *settle_set) {
         struct udev_list_entry *entry;
 
         udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(udev_enumerate)) {
                 char filename[UTIL_PATH_SIZE];
-                int fd;
+                int fd, r;
 
                 if (verbose)
                         printf("%s\n", udev_list_entry_get_name(entry));
@@ -48,10 +51,57 @@ static void exec_list(struct udev_enumerate *udev_enumerate, const char *action)
                 fd = open(filename, O_WRONLY|O_CLOEXEC);
                 if (fd < 0)
                         continue;
-                if (write(fd, action, strlen(action)) < 0)
+                if (write(fd, action, strlen(action)) < 0) {
                         log_debug_errno(errno, "error writing '%s' to '%s': %m", action, filename);
+                        close(fd);
+                        continue;
+                }
                 close(fd);
+
+                /* remember the device, to wait for the event we just caused */
+                if (settle_set) {
+                        r = set_put_strdup(settle_set, udev_list_entry_get_name(entry));
+                        if (r < 0)
+                                return log_oom();
+                }
+        }
+
+        return 0;
+}
+
+static int wait_for_settle(struct udev_monitor *monitor, Set *settle_set) {
+        struct pollfd pfd = {
+                .fd = udev_monitor_get_fd(monitor),
+                .events = POLLIN,
+        };
+
+        /* wait until udevd announced a processed event for every device we triggered,
+         * regardless of any other events that may be queued */
+        while (!set_isempty(settle_set)) {
+                _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
+                const char *syspath;
+
+                if (poll(&pfd, 1, -1) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return log_error_errno(errno, "failed to poll: %m");
+                }
+
+                dev = udev_monitor_receive_device(monitor);
+                if (!dev)
+                        continue;
+
+                syspath = udev_device_get_syspath(dev);
+                if (!syspath)
+                        continue;
+
+                free(set_remove(settle_set, syspath));
+
+                if (verbose)
+                        printf("settled %s\n", syspath);
         }
+
+        return 0;
 }
 
 static const char *keyval(const char *str, const char **val, char *buf, size_t size) {
@@ -87,6 +137,7 @@ static void help(void) {
                "  -y --sysname-match=NAME           Trigger devices with this /sys path\n"
                "     --name-match=NAME              Trigger devices with this /dev name\n"
                "  -b --parent-match=NAME            Trigger devices with that parent device\n"
+               "  -w --settle                       Wait for the triggered events to complete\n"
                , program_invocation_short_name);
 }
 
@@ -109,6 +160,7 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                 { "sysname-match",     required_argument, NULL, 'y'      },
                 { "name-match",        required_argument, NULL, ARG_NAME },
                 { "parent-match",      required_argument, NULL, 'b'      },
+                { "settle",            no_argument,       NULL, 'w'      },
                 { "version",           no_argument,       NULL, 'V'      },
                 { "help",              no_argument,       NULL, 'h'      },
                 {}
@@ -119,13 +171,16 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
         } device_type = TYPE_DEVICES;
         const char *action = "change";
         _cleanup_udev_enumerate_unref_ struct udev_enumerate *udev_enumerate = NULL;
+        _cleanup_udev_monitor_unref_ struct udev_monitor *udev_monitor = NULL;
+        _cleanup_set_free_free_ Set *settle_set = NULL;
+        bool settle = false;
         int c, r;
 
         udev_enumerate = udev_enumerate_new(udev);
         if (udev_enumerate == NULL)
                 return 1;
 
-        while ((c = getopt_long(argc, argv, "vnt:c:s:S:a:A:p:g:y:b:Vh", options, NULL)) >= 0) {
+        while ((c = getopt_long(argc, argv, "vnt:c:s:S:a:A:p:g:y:b:wVh", options, NULL)) >= 0) {
                 const char *key;
                 const char *val;
                 char buf[UTIL_PATH_SIZE];
@@ -241,6 +296,10 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                         break;
                 }
 
+                case 'w':
+                        settle = true;
+                        break;
+
                 case 'V':
                         print_version();
                         return 0;
@@ -270,18 +329,52 @@ static int adm_trigger(struct udev *udev, int argc, char *argv[]) {
                 }
         }
 
+        if (settle && !dry_run) {
+                /* listen before triggering, so that no processed event can be missed */
+                udev_monitor = udev_monitor_new_from_netlink(udev, "udev");
+                if (!udev_monitor) {
+                        log_error_errno(errno, "error: unable to create netlink socket: %m");
+                        return 3;
+                }
+
+                /* the events only get read once all of them are triggered */
+                (void) udev_monitor_set_receive_buffer_size(udev_monitor, 128*1024*1024);
+
+                r = udev_monitor_enable_receiving(udev_monitor);
+                if (r < 0) {
+                        log_error_errno(r, "error: unable to subscribe to udev events: %m");
+                        return 3;
+                }
+
+                settle_set = set_new(&string_hash_ops);
+                if (!settle_set) {
+                        log_oom();
+                        return 1;
+                }
+        }
+
         switch (device_type) {
         case TYPE_SUBSYSTEMS:
                 udev_enumerate_scan_subsystems(udev_enumerate);
-                exec_list(udev_enumerate, action);
-                return 0;
+                break;
         case TYPE_DEVICES:
                 udev_enumerate_scan_devices(udev_enumerate);
-                exec_list(udev_enumerate, action);
-                return 0;
+                break;
         default:
                 assert_not_reached("device_type");
         }
+
+        r = exec_list(udev_enumerate, action, settle_set);
+        if (r < 0)
+                return 1;
+
+        if (settle_set) {
+                r = wait_for_settle(udev_monitor, settle_set);
+                if (r < 0)
+                        return 1;
+        }
+
+        return 0;
 }
 
 const struct udevadm_cmd udevadm_trigger = {
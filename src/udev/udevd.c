@@ -81,6 +81,9 @@ typedef struct Manager {
         sd_event *event;
         Hashmap *workers;
         LIST_HEAD(struct event, events);
+        struct event *events_tail;
+        /* key → struct event_key_list, see event_index() */
+        Hashmap *event_keys;
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
@@ -99,6 +102,11 @@ typedef struct Manager {
 
         usec_t last_usec;
 
+        /* queue wait statistics of the events started since the queue was last empty */
+        unsigned n_events_started;
+        usec_t queue_wait_usec;
+        usec_t queue_wait_max_usec;
+
         bool stop_exec_queue:1;
         bool exit:1;
 } Manager;
@@ -109,6 +117,19 @@ enum event_state {
         EVENT_RUNNING,
 };
 
+/* The queued events sharing one key, in queue order */
+struct event_key_list {
+        char *key;
+        LIST_HEAD(struct event_key, keys);
+        struct event_key *tail;
+};
+
+struct event_key {
+        LIST_FIELDS(struct event_key, keys);
+        struct event *event;
+        struct event_key_list *list;
+};
+
 struct event {
         LIST_FIELDS(struct event, event);
         Manager *manager;
@@ -117,7 +138,9 @@ struct event {
         struct udev_device *dev_kernel;
         struct worker *worker;
         enum event_state state;
-        unsigned long long int delaying_seqnum;
+        struct event_key *keys;
+        size_t n_keys, n_keys_allocated;
+        usec_t queued_usec;
         unsigned long long int seqnum;
         const char *devpath;
         size_t devpath_len;
@@ -151,14 +174,48 @@ struct worker {
 struct worker_message {
 };
 
+static void event_unindex(struct event *event) {
+        size_t i;
+
+        assert(event);
+
+        for (i = 0; i < event->n_keys; i++) {
+                struct event_key *k = &event->keys[i];
+                struct event_key_list *l = k->list;
+
+                if (!l)
+                        continue;
+
+                if (l->tail == k)
+                        l->tail = k->keys_prev;
+                LIST_REMOVE(keys, l->keys, k);
+
+                if (!l->keys) {
+                        hashmap_remove(event->manager->event_keys, l->key);
+                        free(l->key);
+                        free(l);
+                }
+        }
+
+        event->keys = mfree(event->keys);
+        event->n_keys = 0;
+}
+
 static void event_free(struct event *event) {
+        Manager *manager;
         int r;
 
         if (!event)
                 return;
         assert(event->manager);
 
-        LIST_REMOVE(event, event->manager->events, event);
+        manager = event->manager;
+
+        event_unindex(event);
+
+        if (manager->events_tail == event)
+                manager->events_tail = event->event_prev;
+        LIST_REMOVE(event, manager->events, event);
         udev_device_unref(event->dev);
         udev_device_unref(event->dev_kernel);
 
@@ -168,12 +225,25 @@ static void event_free(struct event *event) {
         if (event->worker)
                 event->worker->event = NULL;
 
-        if (LIST_IS_EMPTY(event->manager->events)) {
+        if (LIST_IS_EMPTY(manager->events)) {
                 /* only clean up the queue from the process that created it */
-                if (event->manager->pid == getpid_cached()) {
+                if (manager->pid == getpid_cached()) {
                         r = unlink("/run/udev/queue");
                         if (r < 0)
                                 log_warning_errno(errno, "could not unlink /run/udev/queue: %m");
+
+                        if (manager->n_events_started > 0) {
+                                char avg[FORMAT_TIMESPAN_MAX], max[FORMAT_TIMESPAN_MAX];
+
+                                log_debug("queue empty, %u events started, waited %s on average and %s at most",
+                                          manager->n_events_started,
+                                          format_timespan(avg, sizeof(avg), manager->queue_wait_usec / manager->n_events_started, USEC_PER_MSEC),
+                                          format_timespan(max, sizeof(max), manager->queue_wait_max_usec, USEC_PER_MSEC));
+
+                                manager->n_events_started = 0;
+                                manager->queue_wait_usec = 0;
+                                manager->queue_wait_max_usec = 0;
+                        }
                 }
         }
 
@@ -282,6 +352,14 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
 
         assert_se(sd_event_now(e, CLOCK_MONOTONIC, &usec) >= 0);
 
+        if (event->queued_usec > 0 && usec > event->queued_usec) {
+                usec_t wait = usec - event->queued_usec;
+
+                worker->manager->n_events_started++;
+                worker->manager->queue_wait_usec += wait;
+                worker->manager->queue_wait_max_usec = MAX(worker->manager->queue_wait_max_usec, wait);
+        }
+
         (void) sd_event_add_time(e, &event->timeout_warning, CLOCK_MONOTONIC,
                                  usec + arg_event_timeout_warn_usec, USEC_PER_SEC, on_event_timeout_warning, event);
 
@@ -308,6 +386,8 @@ static void manager_free(Manager *manager) {
         udev_ctrl_unref(manager->ctrl);
         udev_ctrl_connection_unref(manager->ctrl_conn_blocking);
 
+        hashmap_free(manager->event_keys);
+
         udev_list_cleanup(&manager->properties);
         udev_rules_unref(manager->rules);
 
@@ -545,10 +625,12 @@ out:
         }
 }
 
-static void event_run(Manager *manager, struct event *event) {
+static bool event_run(Manager *manager, struct event *event) {
         struct worker *worker;
         Iterator i;
 
+        /* Returns false if the event has to wait, because all workers are busy */
+
         assert(manager);
         assert(event);
 
@@ -567,17 +649,129 @@ static void event_run(Manager *manager, struct event *event) {
                         continue;
                 }
                 worker_attach_event(worker, event);
-                return;
+                return true;
         }
 
         if (hashmap_size(manager->workers) >= arg_children_max) {
                 if (arg_children_max > 1)
                         log_debug("maximum number (%i) of children reached", hashmap_size(manager->workers));
-                return;
+                return false;
         }
 
         /* start new worker and pass initial device */
         worker_spawn(manager, event);
+        return true;
+}
+
+static struct event_key *event_key_find_earlier(Manager *manager, const char *key, struct event *event) {
+        struct event_key_list *l;
+
+        /* Returns the first event with the given key queued before this one */
+
+        l = hashmap_get(manager->event_keys, key);
+        if (!l || l->keys->event->seqnum >= event->seqnum)
+                return NULL;
+
+        return l->keys;
+}
+
+static int event_key_add(Manager *manager, struct event *event, const char *key) {
+        struct event_key_list *l;
+        struct event_key *k;
+        int r;
+
+        assert(event->n_keys < event->n_keys_allocated);
+
+        l = hashmap_get(manager->event_keys, key);
+        if (!l) {
+                r = hashmap_ensure_allocated(&manager->event_keys, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                l = new0(struct event_key_list, 1);
+                if (!l)
+                        return -ENOMEM;
+
+                l->key = strdup(key);
+                if (!l->key) {
+                        free(l);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(manager->event_keys, l->key, l);
+                if (r < 0) {
+                        free(l->key);
+                        free(l);
+                        return r;
+                }
+        }
+
+        k = &event->keys[event->n_keys++];
+        k->event = event;
+        k->list = l;
+
+        LIST_INSERT_AFTER(keys, l->keys, l->tail, k);
+        l->tail = k;
+
+        return 0;
+}
+
+/* Index an event by everything is_devpath_busy() looks for: its devpath ("p"), each of
+ * its parent devpaths it is to be found below ("s"), its device number and its network
+ * interface. Each check then costs one lookup, instead of a walk through the queue. */
+static int event_index(Manager *manager, struct event *event) {
+        char *key;
+        size_t i, n = 1;
+        int r;
+
+        for (i = 1; i < event->devpath_len; i++)
+                if (event->devpath[i] == '/')
+                        n++;
+        if (major(event->devnum) != 0)
+                n++;
+        if (event->ifindex != 0)
+                n++;
+
+        event->keys = new0(struct event_key, n);
+        if (!event->keys)
+                return -ENOMEM;
+        event->n_keys_allocated = n;
+
+        key = newa(char, 1 + MAX(event->devpath_len, (size_t) DECIMAL_STR_MAX(unsigned) * 2 + 1) + 1);
+
+        key[0] = 'p';
+        strcpy(key + 1, event->devpath);
+        r = event_key_add(manager, event, key);
+        if (r < 0)
+                return r;
+
+        key[0] = 's';
+        for (i = 1; i < event->devpath_len; i++) {
+                if (event->devpath[i] != '/')
+                        continue;
+
+                key[1 + i] = '\0';
+                r = event_key_add(manager, event, key);
+                key[1 + i] = '/';
+                if (r < 0)
+                        return r;
+        }
+
+        if (major(event->devnum) != 0) {
+                sprintf(key, "%c%u:%u", event->is_block ? 'b' : 'c', major(event->devnum), minor(event->devnum));
+                r = event_key_add(manager, event, key);
+                if (r < 0)
+                        return r;
+        }
+
+        if (event->ifindex != 0) {
+                sprintf(key, "n%i", event->ifindex);
+                r = event_key_add(manager, event, key);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
 }
 
 static int event_queue_insert(Manager *manager, struct udev_device *dev) {
@@ -609,6 +803,15 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         event->devnum = udev_device_get_devnum(dev);
         event->is_block = streq("block", udev_device_get_subsystem(dev));
         event->ifindex = udev_device_get_ifindex(dev);
+        event->queued_usec = now(CLOCK_MONOTONIC);
+
+        r = event_index(manager, event);
+        if (r < 0) {
+                event_unindex(event);
+                udev_device_unref(event->dev_kernel);
+                free(event);
+                return log_oom();
+        }
 
         log_debug("seq %llu queued, '%s' '%s'", udev_device_get_seqnum(dev),
              udev_device_get_action(dev), udev_device_get_subsystem(dev));
@@ -621,7 +824,8 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
                         log_warning_errno(r, "could not touch /run/udev/queue: %m");
         }
 
-        LIST_APPEND(event, manager->events, event);
+        LIST_INSERT_AFTER(event, manager->events, manager->events_tail, event);
+        manager->events_tail = event;
 
         return 0;
 }
@@ -643,69 +847,62 @@ static void manager_kill_workers(Manager *manager) {
 
 /* lookup event for identical, parent, child device */
 static bool is_devpath_busy(Manager *manager, struct event *event) {
-        struct event *loop_event;
-        size_t common;
-
-        /* check if queue contains events we depend on */
-        LIST_FOREACH(event, loop_event, manager->events) {
-                /* we already found a later event, earlier can not block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
+        struct event_key *k;
+        char *key;
+        size_t i;
 
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
-
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
+        key = newa(char, 1 + MAX(event->devpath_len, (size_t) DECIMAL_STR_MAX(unsigned) * 2 + 1) + 1);
 
-                /* check major/minor */
-                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
+        /* check major/minor */
+        if (major(event->devnum) != 0) {
+                sprintf(key, "%c%u:%u", event->is_block ? 'b' : 'c', major(event->devnum), minor(event->devnum));
+                if (event_key_find_earlier(manager, key, event))
                         return true;
+        }
 
-                /* check network device ifindex */
-                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
+        /* check network device ifindex */
+        if (event->ifindex != 0) {
+                sprintf(key, "n%i", event->ifindex);
+                if (event_key_find_earlier(manager, key, event))
                         return true;
+        }
 
-                /* check our old name */
-                if (event->devpath_old != NULL && streq(loop_event->devpath, event->devpath_old)) {
-                        event->delaying_seqnum = loop_event->seqnum;
+        /* check our old name */
+        if (event->devpath_old != NULL) {
+                if (event_key_find_earlier(manager, strjoina("p", event->devpath_old), event))
                         return true;
-                }
-
-                /* compare devpath */
-                common = MIN(loop_event->devpath_len, event->devpath_len);
+        }
 
-                /* one devpath is contained in the other? */
-                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
+        /* identical device event found */
+        key[0] = 'p';
+        strcpy(key + 1, event->devpath);
+        for (k = event_key_find_earlier(manager, key, event); k && k->event->seqnum < event->seqnum; k = k->keys_next) {
+                /* devices names might have changed/swapped in the meantime */
+                if (major(event->devnum) != 0 && (event->devnum != k->event->devnum || event->is_block != k->event->is_block))
                         continue;
+                if (event->ifindex != 0 && event->ifindex != k->event->ifindex)
+                        continue;
+                return true;
+        }
 
-                /* identical device event found */
-                if (loop_event->devpath_len == event->devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
-                                continue;
-                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        /* child device event found */
+        key[0] = 's';
+        if (event_key_find_earlier(manager, key, event))
+                return true;
 
-                /* parent device event found */
-                if (event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        /* parent device event found */
+        key[0] = 'p';
+        for (i = 1; i < event->devpath_len; i++) {
+                bool found;
 
-                /* child device event found */
-                if (loop_event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+                if (event->devpath[i] != '/')
+                        continue;
 
-                /* no matching device */
-                continue;
+                key[1 + i] = '\0';
+                found = event_key_find_earlier(manager, key, event);
+                key[1 + i] = '/';
+                if (found)
+                        return true;
         }
 
         return false;
@@ -775,6 +972,31 @@ static void manager_reload(Manager *manager) {
                    "STATUS=Processing with %u children at max", arg_children_max);
 }
 
+/* rules files changed on disk */
+static void manager_reload_rules(Manager *manager) {
+        struct udev_rules *rules;
+
+        assert(manager);
+
+        /* Workers carry the rules they were forked with. Only replace them if the rules actually
+         * changed, so that touching or rewriting rules files with the same contents is cheap. */
+        rules = udev_rules_new(manager->udev, arg_resolve_names);
+        if (!rules) {
+                manager_reload(manager);
+                return;
+        }
+
+        if (udev_rules_equal(manager->rules, rules)) {
+                log_debug("Rules files changed, but the rules they contain did not, keeping workers.");
+                udev_rules_unref(manager->rules);
+                manager->rules = rules;
+                return;
+        }
+
+        manager_reload(manager);
+        manager->rules = rules;
+}
+
 static void event_queue_start(Manager *manager) {
         struct event *event;
         usec_t usec;
@@ -789,9 +1011,10 @@ static void event_queue_start(Manager *manager) {
         /* check for changed config, every 3 seconds at most */
         if (manager->last_usec == 0 ||
             (usec - manager->last_usec) > 3 * USEC_PER_SEC) {
-                if (udev_rules_check_timestamp(manager->rules) ||
-                    udev_builtin_validate(manager->udev))
+                if (udev_builtin_validate(manager->udev))
                         manager_reload(manager);
+                else if (udev_rules_check_timestamp(manager->rules))
+                        manager_reload_rules(manager);
 
                 manager->last_usec = usec;
         }
@@ -812,7 +1035,8 @@ static void event_queue_start(Manager *manager) {
                 if (is_devpath_busy(manager, event))
                         continue;
 
-                event_run(manager, event);
+                if (!event_run(manager, event))
+                        break;
         }
 }
 